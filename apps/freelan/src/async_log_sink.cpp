@@ -0,0 +1,132 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+
+/**
+ * \file async_log_sink.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An asynchronous batched log sink.
+ */
+
+#include "async_log_sink.hpp"
+
+#include <boost/lexical_cast.hpp>
+
+async_log_sink::async_log_sink(backend_type backend, size_t capacity) :
+	m_backend(backend),
+	m_capacity(capacity),
+	m_queue(),
+	m_dropped(0),
+	m_stopping(false),
+	m_thread(&async_log_sink::write_loop, this)
+{
+}
+
+async_log_sink::~async_log_sink()
+{
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		m_stopping = true;
+	}
+
+	m_condition.notify_one();
+	m_thread.join();
+}
+
+void async_log_sink::log(fscp::log_level level, const std::string& msg, const boost::posix_time::ptime& timestamp)
+{
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		if (m_queue.size() >= m_capacity)
+		{
+			++m_dropped;
+
+			return;
+		}
+
+		const record_type record = { level, msg, timestamp };
+
+		m_queue.push_back(record);
+	}
+
+	m_condition.notify_one();
+}
+
+void async_log_sink::write_loop()
+{
+	std::vector<record_type> batch;
+
+	while (true)
+	{
+		size_t dropped = 0;
+
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			while (m_queue.empty() && !m_stopping)
+			{
+				m_condition.wait(lock);
+			}
+
+			if (m_queue.empty() && m_stopping)
+			{
+				return;
+			}
+
+			// Take the whole queue in one go: the emitting threads never wait on the backend I/O, and the backend gets written once per batch instead of once per record.
+			batch.assign(m_queue.begin(), m_queue.end());
+			m_queue.clear();
+
+			std::swap(dropped, m_dropped);
+		}
+
+		for (auto&& record : batch)
+		{
+			m_backend(record.level, record.msg, record.timestamp);
+		}
+
+		if (dropped > 0)
+		{
+			m_backend(fscp::log_level::warning, "Dropped " + boost::lexical_cast<std::string>(dropped) + " log record(s): the log queue was full.", boost::posix_time::microsec_clock::local_time());
+		}
+
+		batch.clear();
+	}
+}
@@ -0,0 +1,124 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+
+/**
+ * \file async_log_sink.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An asynchronous batched log sink.
+ */
+
+#ifndef ASYNC_LOG_SINK_HPP
+#define ASYNC_LOG_SINK_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <fscp/logger.hpp>
+
+/**
+ * \brief An asynchronous batched log sink.
+ *
+ * Emitting threads push records into a bounded queue and return immediately; a dedicated writer thread drains the queue in batches and hands the records to the backend (console, syslog, ...). When the queue is full, records are dropped and counted: the count is reported through the backend once the queue drains.
+ */
+class async_log_sink
+{
+	public:
+
+		/**
+		 * \brief The backend type, called from the writer thread only.
+		 */
+		typedef fscp::logger::log_handler_type backend_type;
+
+		/**
+		 * \brief The default capacity of the queue, in records.
+		 */
+		static const size_t DEFAULT_CAPACITY = 4096;
+
+		/**
+		 * \brief Create the sink and start its writer thread.
+		 * \param backend The backend that performs the actual writing.
+		 * \param capacity The maximum count of records held in the queue.
+		 */
+		explicit async_log_sink(backend_type backend, size_t capacity = DEFAULT_CAPACITY);
+
+		async_log_sink(const async_log_sink&) = delete;
+		async_log_sink& operator=(const async_log_sink&) = delete;
+
+		/**
+		 * \brief Flush the remaining records and stop the writer thread.
+		 */
+		~async_log_sink();
+
+		/**
+		 * \brief Queue a log record.
+		 * \param level The log level.
+		 * \param msg The message.
+		 * \param timestamp The timestamp.
+		 *
+		 * Never blocks on I/O: if the queue is full, the record is dropped and counted.
+		 */
+		void log(fscp::log_level level, const std::string& msg, const boost::posix_time::ptime& timestamp);
+
+	private:
+
+		struct record_type
+		{
+			fscp::log_level level;
+			std::string msg;
+			boost::posix_time::ptime timestamp;
+		};
+
+		void write_loop();
+
+		backend_type m_backend;
+		size_t m_capacity;
+		std::deque<record_type> m_queue;
+		size_t m_dropped;
+		bool m_stopping;
+		boost::mutex m_mutex;
+		boost::condition_variable m_condition;
+		boost::thread m_thread;
+};
+
+#endif /* ASYNC_LOG_SINK_HPP */
@@ -47,11 +47,18 @@
 #include "configuration_helper.hpp"
 
 #include <vector>
+#include <exception>
 
 #include <boost/asio.hpp>
+#include <boost/algorithm/string.hpp>
 #include <boost/foreach.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include "configuration_types.hpp"
+#include "der_cache.hpp"
+
+#include <fstream>
 
 // This file is generated locally.
 #include <defines.hpp>
@@ -93,13 +100,124 @@ namespace
 		value = fl::security_configuration::crl_type::from_certificate_revocation_list(file);
 	}
 
+	// The DER cache of the configuration's PEM files, enabled by security.der_cache_file.
+	der_cache configuration_der_cache;
+
+	std::vector<unsigned char> to_der_bytes(const cryptoplus::buffer& der)
+	{
+		const unsigned char* const data = cryptoplus::buffer_cast<const unsigned char*>(der);
+
+		return std::vector<unsigned char>(data, data + cryptoplus::buffer_size(der));
+	}
+
+	bool file_contains_trust_attributes(const fs::path& filename)
+	{
+		std::ifstream is(filename.string().c_str(), std::ios::binary);
+		const std::string content((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+
+		return content.find("TRUSTED CERTIFICATE") != std::string::npos;
+	}
+
+	bool load_cached(fl::security_configuration::cert_type& value, const fs::path& filename)
+	{
+		std::vector<unsigned char> der;
+
+		if (!configuration_der_cache.lookup(filename, der_cache::KIND_CERTIFICATE, der) || der.empty())
+		{
+			return false;
+		}
+
+		value = fl::security_configuration::cert_type::from_der(&der[0], der.size());
+
+		return true;
+	}
+
+	bool load_cached(trusted_cert_type& value, const fs::path& filename)
+	{
+		std::vector<unsigned char> der;
+
+		if (!configuration_der_cache.lookup(filename, der_cache::KIND_TRUSTED_CERTIFICATE, der) || der.empty())
+		{
+			return false;
+		}
+
+		value.cert = fl::security_configuration::cert_type::from_der(&der[0], der.size());
+
+		return true;
+	}
+
+	bool load_cached(fl::security_configuration::crl_type& value, const fs::path& filename)
+	{
+		std::vector<unsigned char> der;
+
+		if (!configuration_der_cache.lookup(filename, der_cache::KIND_CERTIFICATE_REVOCATION_LIST, der) || der.empty())
+		{
+			return false;
+		}
+
+		value = fl::security_configuration::crl_type::from_der(&der[0], der.size());
+
+		return true;
+	}
+
+	bool load_cached(cryptoplus::pkey::pkey&, const fs::path&)
+	{
+		// Private keys are never cached.
+		return false;
+	}
+
+	void store_cached(const fl::security_configuration::cert_type& value, const fs::path& filename)
+	{
+		configuration_der_cache.store(filename, der_cache::KIND_CERTIFICATE, to_der_bytes(value.write_der()));
+	}
+
+	void store_cached(const trusted_cert_type& value, const fs::path& filename)
+	{
+		// PEM trust attributes do not survive the DER round-trip: files carrying them keep the PEM path.
+		if (file_contains_trust_attributes(filename))
+		{
+			return;
+		}
+
+		configuration_der_cache.store(filename, der_cache::KIND_TRUSTED_CERTIFICATE, to_der_bytes(value.cert.write_der()));
+	}
+
+	void store_cached(const fl::security_configuration::crl_type& value, const fs::path& filename)
+	{
+		configuration_der_cache.store(filename, der_cache::KIND_CERTIFICATE_REVOCATION_LIST, to_der_bytes(value.write_der()));
+	}
+
+	void store_cached(const cryptoplus::pkey::pkey&, const fs::path&)
+	{
+	}
+
 	template <typename ValueType>
 	bool load_file(const std::string& file_type, ValueType& value, const std::string& name, const fs::path& filename)
 	{
 		try
 		{
+			if (configuration_der_cache.enabled())
+			{
+				try
+				{
+					if (load_cached(value, filename))
+					{
+						return true;
+					}
+				}
+				catch (const std::exception&)
+				{
+					// A corrupt cache entry falls back to the PEM path and is overwritten below.
+				}
+			}
+
 			const cryptoplus::file file = cryptoplus::file::open(filename.native());
 			from_file(value, file);
+
+			if (configuration_der_cache.enabled())
+			{
+				store_cached(value, filename);
+			}
 		}
 		catch (const std::exception& ex)
 		{
@@ -141,20 +259,98 @@ namespace
 
 		const auto paths = vm[name].as<std::vector<fs::path> >();
 
+		std::vector<fs::path> filenames;
+
 		for (auto&& path : paths)
 		{
-			if (path.native().empty())
+			if (!path.native().empty())
+			{
+				filenames.push_back(fs::absolute(path, root));
+			}
+		}
+
+		if (filenames.empty())
+		{
+			return false;
+		}
+
+		// Load the files in parallel: with large authority lists the PEM parsing dominates the daemon's cold start. The results are assembled in their configuration order below, so the outcome stays deterministic.
+		std::vector<ValueType> loaded(filenames.size());
+		std::vector<char> loaded_flags(filenames.size(), 0);
+		std::vector<std::exception_ptr> errors(filenames.size());
+
+		boost::mutex index_mutex;
+		size_t next_index = 0;
+
+		const auto worker = [&]() {
+			while (true)
 			{
-				continue;
+				size_t index;
+
+				{
+					boost::mutex::scoped_lock lock(index_mutex);
+
+					if (next_index >= filenames.size())
+					{
+						return;
+					}
+
+					index = next_index++;
+				}
+
+				try
+				{
+					if (load_file(file_type, loaded[index], name, filenames[index]))
+					{
+						loaded_flags[index] = 1;
+					}
+				}
+				catch (...)
+				{
+					errors[index] = std::current_exception();
+				}
 			}
+		};
 
-			ValueType value;
+		size_t thread_count = boost::thread::hardware_concurrency();
 
-			const fs::path filename = fs::absolute(path, root);
+		if (thread_count == 0)
+		{
+			thread_count = 1;
+		}
+
+		thread_count = std::min(thread_count, filenames.size());
+
+		if (thread_count <= 1)
+		{
+			worker();
+		}
+		else
+		{
+			boost::thread_group threads;
 
-			if (load_file(file_type, value, name, filename))
+			for (size_t i = 0; i < thread_count; ++i)
 			{
-				values.push_back(value);
+				threads.create_thread(worker);
+			}
+
+			threads.join_all();
+		}
+
+		// Report the first failure in configuration order, like the sequential code did.
+		for (auto&& error : errors)
+		{
+			if (error)
+			{
+				std::rethrow_exception(error);
+			}
+		}
+
+		for (size_t i = 0; i < filenames.size(); ++i)
+		{
+			if (loaded_flags[i])
+			{
+				values.push_back(loaded[i]);
 			}
 		}
 
@@ -252,6 +448,22 @@ po::options_description get_fscp_options()
 	("fscp.contact", po::value<std::vector<asiotap::endpoint> >()->multitoken()->zero_tokens()->default_value(std::vector<asiotap::endpoint>(), ""), "The address of an host to contact.")
 	("fscp.accept_contact_requests", po::value<bool>()->default_value(true, "yes"), "Whether to accept CONTACT-REQUEST messages.")
 	("fscp.accept_contacts", po::value<bool>()->default_value(true, "yes"), "Whether to accept CONTACT messages.")
+	("fscp.state_file", po::value<fs::path>()->default_value(""), "The file used to persist known peers across restarts.")
+	("fscp.latency_tracing", po::value<bool>()->default_value(false, "no"), "Whether to trace the packet-path latencies into the metrics.")
+	("fscp.path_mtu_discovery", po::value<bool>()->default_value(false, "no"), "Whether to probe the path MTU of every peer.")
+	("fscp.multipath", po::value<bool>()->default_value(false, "no"), "Whether to spread traffic across every known path of a peer.")
+	("fscp.multipath_spray", po::value<bool>()->default_value(false, "no"), "Whether to spray bulk sends across all the healthy paths of a peer.")
+	("fscp.session_resumption", po::value<bool>()->default_value(false, "no"), "Whether to resume sessions across connectivity blips without a full handshake.")
+	("fscp.receive_buffer_size", po::value<size_t>()->default_value(0), "The kernel receive buffer size to request for the FSCP sockets, in bytes (0 to keep the kernel default).")
+	("fscp.send_buffer_size", po::value<size_t>()->default_value(0), "The kernel send buffer size to request for the FSCP sockets, in bytes (0 to keep the kernel default).")
+	("fscp.busy_poll", po::value<unsigned int>()->default_value(0), "The socket busy-poll budget, in microseconds (0 to disable busy polling).")
+	("fscp.data_tos", po::value<int>()->default_value(-1), "The IP TOS byte of data traffic (-1 to keep the kernel default).")
+	("fscp.control_tos", po::value<int>()->default_value(-1), "The IP TOS byte of control traffic (-1 to mark it like data traffic).")
+	("fscp.dscp_mapping", po::value<std::string>()->default_value(""), "A comma-separated list of <dscp>:<tos> pairs mapping inner DSCP values onto outer TOS bytes (empty to disable).")
+	("fscp.handshake_rate_limit", po::value<size_t>()->default_value(0), "The maximum count of handshake datagrams accepted per source address and per 10 seconds window (0 to disable the limit).")
+	("fscp.lazy_keep_alive", po::value<bool>()->default_value(false, "no"), "Whether to probe idle sessions on a decaying schedule instead of at the full keep-alive rate.")
+	("fscp.cipher_engine", po::value<std::string>()->default_value(""), "The OpenSSL engine to encrypt and decrypt data messages with, such as \"afalg\" (empty to keep the software implementation).")
+	("fscp.cipher_engine_threshold", po::value<size_t>()->default_value(0), "The payload size, in bytes, under which the cipher engine is not engaged (0 to engage it for every size).")
 	("fscp.dynamic_contact_file", po::value<std::vector<fs::path> >()->multitoken()->zero_tokens()->default_value(std::vector<fs::path>(), ""), "The certificate of an host to dynamically contact.")
 	("fscp.never_contact", po::value<std::vector<asiotap::ip_network_address> >()->multitoken()->zero_tokens()->default_value(std::vector<asiotap::ip_network_address>(), ""), "A network address to avoid when dynamically contacting hosts.")
 	("fscp.cipher_suite_capability", po::value<std::vector<fscp::cipher_suite_type> >()->multitoken()->zero_tokens()->default_value(fscp::get_default_cipher_suites(), ""), "A cipher suite to allow.")
@@ -273,6 +485,8 @@ po::options_description get_security_options()
 	("security.authority_certificate_file", po::value<std::vector<fs::path> >()->multitoken()->zero_tokens()->default_value(std::vector<fs::path>(), ""), "An authority certificate file to use.")
 	("security.certificate_revocation_validation_method", po::value<fl::security_configuration::certificate_revocation_validation_method_type>()->default_value(fl::security_configuration::CRVM_NONE), "The certificate revocation validation method.")
 	("security.certificate_revocation_list_file", po::value<std::vector<fs::path> >()->multitoken()->zero_tokens()->default_value(std::vector<fs::path>(), ""), "A certificate revocation list file to use.")
+	("security.certificate_verification_cache_file", po::value<fs::path>()->default_value(""), "The file to persist the certificate verification cache to, so verdicts survive a restart.")
+	("security.der_cache_file", po::value<fs::path>()->default_value(""), "The file to cache the DER form of the PEM files to, so unchanged certificate material skips the PEM decoding on the next start. Private keys are never cached.")
 	;
 
 	return result;
@@ -293,6 +507,10 @@ po::options_description get_tap_adapter_options()
 	("tap_adapter.name", po::value<std::string>(), "The name of the tap adapter to use or create.")
 	("tap_adapter.mtu", po::value<fl::mtu_type>()->default_value(fl::auto_mtu_type()), "The MTU of the tap adapter.")
 	("tap_adapter.metric", po::value<fl::metric_type>()->default_value(fl::auto_metric_type()), "The metric of the tap adapter.")
+	("tap_adapter.read_ring_size", po::value<unsigned int>()->default_value(4), "The count of reads to keep pending on the tap adapter.")
+	("tap_adapter.queue_count", po::value<unsigned int>()->default_value(1), "The count of tap adapter queues to open (Linux multi-queue).")
+	("tap_adapter.offload", po::value<bool>()->default_value(false, "no"), "Whether to negotiate segmentation offload on the tap adapter. All the nodes of a network must use the same value.")
+	("tap_adapter.dedicated_io_thread", po::value<bool>()->default_value(false, "no"), "Whether to service the tap adapter from a dedicated I/O thread.")
 	("tap_adapter.ipv4_address_prefix_length", po::value<asiotap::ipv4_network_address>()->default_value(default_ipv4_network_address), "The tap adapter IPv4 address and prefix length.")
 	("tap_adapter.ipv6_address_prefix_length", po::value<asiotap::ipv6_network_address>()->default_value(default_ipv6_network_address), "The tap adapter IPv6 address and prefix length.")
 	("tap_adapter.remote_ipv4_address", po::value<asiotap::ipv4_network_address>(), "The tap adapter IPv4 remote address.")
@@ -315,6 +533,7 @@ po::options_description get_switch_options()
 	result.add_options()
 	("switch.routing_method", po::value<fl::switch_configuration::routing_method_type>()->default_value(fl::switch_configuration::RM_SWITCH), "The routing method for messages.")
 	("switch.relay_mode_enabled", po::value<bool>()->default_value(false, "no"), "Whether to enable the relay mode.")
+	("switch.multicast_snooping_enabled", po::value<bool>()->default_value(false, "no"), "Whether to enable IGMP/MLD snooping.")
 	;
 
 	return result;
@@ -336,11 +555,28 @@ po::options_description get_router_options()
 	return result;
 }
 
+po::options_description get_limits_options()
+{
+	po::options_description result("Limits options");
+
+	result.add_options()
+	("limits.peer_rate", po::value<uint64_t>()->default_value(0), "The per-peer rate, in bytes per second, applied to each direction of every peer (0 for unlimited).")
+	("limits.peer_burst", po::value<uint64_t>()->default_value(0), "The per-peer burst, in bytes (0 for one second worth of the rate).")
+	("limits.endpoints_rate", po::value<uint64_t>()->default_value(0), "The aggregate rate of all the peers together, in bytes per second, applied to each direction (0 for unlimited).")
+	("limits.endpoints_burst", po::value<uint64_t>()->default_value(0), "The aggregate burst, in bytes (0 for one second worth of the rate).")
+	;
+
+	return result;
+}
+
 void setup_configuration(fl::configuration& configuration, const boost::filesystem::path& root, const po::variables_map& vm)
 {
 	typedef fl::security_configuration::cert_type cert_type;
 	typedef cryptoplus::pkey::pkey pkey;
 
+	const fs::path der_cache_file = vm["security.der_cache_file"].as<fs::path>();
+	configuration_der_cache.open(der_cache_file.native().empty() ? fs::path() : fs::absolute(der_cache_file, root));
+
 	// Server options
 	configuration.server.enabled = vm["server.enabled"].as<bool>();
 	configuration.server.listen_on = vm["server.listen_on"].as<asiotap::endpoint>();
@@ -374,6 +610,56 @@ void setup_configuration(fl::configuration& configuration, const boost::filesyst
 
 	configuration.fscp.accept_contact_requests = vm["fscp.accept_contact_requests"].as<bool>();
 	configuration.fscp.accept_contacts = vm["fscp.accept_contacts"].as<bool>();
+	configuration.fscp.latency_tracing = vm["fscp.latency_tracing"].as<bool>();
+	configuration.fscp.path_mtu_discovery = vm["fscp.path_mtu_discovery"].as<bool>();
+	configuration.fscp.multipath = vm["fscp.multipath"].as<bool>();
+	configuration.fscp.multipath_spray = vm["fscp.multipath_spray"].as<bool>();
+	configuration.fscp.session_resumption = vm["fscp.session_resumption"].as<bool>();
+	configuration.fscp.receive_buffer_size = vm["fscp.receive_buffer_size"].as<size_t>();
+	configuration.fscp.send_buffer_size = vm["fscp.send_buffer_size"].as<size_t>();
+	configuration.fscp.busy_poll = vm["fscp.busy_poll"].as<unsigned int>();
+	configuration.fscp.data_tos = vm["fscp.data_tos"].as<int>();
+	configuration.fscp.control_tos = vm["fscp.control_tos"].as<int>();
+
+	const std::string dscp_mapping = vm["fscp.dscp_mapping"].as<std::string>();
+
+	if (!dscp_mapping.empty())
+	{
+		std::vector<std::string> pairs;
+		boost::split(pairs, dscp_mapping, boost::is_any_of(","));
+
+		for (auto&& pair : pairs)
+		{
+			const size_t separator = pair.find(':');
+
+			if (separator == std::string::npos)
+			{
+				throw std::runtime_error("Invalid fscp.dscp_mapping entry (expected <dscp>:<tos>): " + pair);
+			}
+
+			const int dscp = boost::lexical_cast<int>(boost::trim_copy(pair.substr(0, separator)));
+			const int tos = boost::lexical_cast<int>(boost::trim_copy(pair.substr(separator + 1)));
+
+			if ((dscp < 0) || (dscp > 63) || (tos < 0) || (tos > 255))
+			{
+				throw std::runtime_error("Invalid fscp.dscp_mapping entry (DSCP must be 0-63 and TOS 0-255): " + pair);
+			}
+
+			configuration.fscp.dscp_mapping[static_cast<unsigned int>(dscp)] = tos;
+		}
+	}
+
+	configuration.fscp.handshake_rate_limit = vm["fscp.handshake_rate_limit"].as<size_t>();
+	configuration.fscp.lazy_keep_alive = vm["fscp.lazy_keep_alive"].as<bool>();
+	configuration.fscp.cipher_engine = vm["fscp.cipher_engine"].as<std::string>();
+	configuration.fscp.cipher_engine_threshold = vm["fscp.cipher_engine_threshold"].as<size_t>();
+
+	const fs::path state_file = vm["fscp.state_file"].as<fs::path>();
+
+	if (!state_file.native().empty())
+	{
+		configuration.fscp.state_file = fs::absolute(state_file, root);
+	}
 
 	load_certificate_list(configuration.fscp.dynamic_contact_list, "fscp.dynamic_contact_file", vm, root);
 
@@ -401,6 +687,23 @@ void setup_configuration(fl::configuration& configuration, const boost::filesyst
 
 	load_crl_list(configuration.security.certificate_revocation_list_list, "security.certificate_revocation_list_file", vm, root);
 
+	configuration.security.certificate_revocation_list_files.clear();
+
+	for (auto&& path : vm["security.certificate_revocation_list_file"].as<std::vector<fs::path> >())
+	{
+		if (!path.native().empty())
+		{
+			configuration.security.certificate_revocation_list_files.push_back(fs::absolute(path, root));
+		}
+	}
+
+	const fs::path certificate_verification_cache_file = vm["security.certificate_verification_cache_file"].as<fs::path>();
+
+	if (!certificate_verification_cache_file.native().empty())
+	{
+		configuration.security.certificate_verification_cache_file = fs::absolute(certificate_verification_cache_file, root);
+	}
+
 	// Tap adapter options
 	configuration.tap_adapter.type = vm["tap_adapter.type"].as<fl::tap_adapter_configuration::tap_adapter_type>();
 	configuration.tap_adapter.enabled = vm["tap_adapter.enabled"].as<bool>();
@@ -412,6 +715,10 @@ void setup_configuration(fl::configuration& configuration, const boost::filesyst
 
 	configuration.tap_adapter.mtu = vm["tap_adapter.mtu"].as<fl::mtu_type>();
 	configuration.tap_adapter.metric = vm["tap_adapter.metric"].as<fl::metric_type>();
+	configuration.tap_adapter.read_ring_size = vm["tap_adapter.read_ring_size"].as<unsigned int>();
+	configuration.tap_adapter.queue_count = vm["tap_adapter.queue_count"].as<unsigned int>();
+	configuration.tap_adapter.offload = vm["tap_adapter.offload"].as<bool>();
+	configuration.tap_adapter.dedicated_io_thread = vm["tap_adapter.dedicated_io_thread"].as<bool>();
 	configuration.tap_adapter.ipv4_address_prefix_length = vm["tap_adapter.ipv4_address_prefix_length"].as<asiotap::ipv4_network_address>();
 	configuration.tap_adapter.ipv6_address_prefix_length = vm["tap_adapter.ipv6_address_prefix_length"].as<asiotap::ipv6_network_address>();
 
@@ -429,6 +736,7 @@ void setup_configuration(fl::configuration& configuration, const boost::filesyst
 	// Switch options
 	configuration.switch_.routing_method = vm["switch.routing_method"].as<fl::switch_configuration::routing_method_type>();
 	configuration.switch_.relay_mode_enabled = vm["switch.relay_mode_enabled"].as<bool>();
+	configuration.switch_.multicast_snooping_enabled = vm["switch.multicast_snooping_enabled"].as<bool>();
 
 	// Router
 	const auto local_ip_routes = vm["router.local_ip_route"].as<std::vector<asiotap::ip_route> >();
@@ -439,6 +747,15 @@ void setup_configuration(fl::configuration& configuration, const boost::filesyst
 	configuration.router.internal_route_acceptance_policy = vm["router.internal_route_acceptance_policy"].as<fl::router_configuration::internal_route_scope_type>();
 	configuration.router.system_route_acceptance_policy = vm["router.system_route_acceptance_policy"].as<fl::router_configuration::system_route_scope_type>();
 	configuration.router.maximum_routes_limit = vm["router.maximum_routes_limit"].as<unsigned int>();
+
+	// Limits options
+	configuration.limits.peer_rate = vm["limits.peer_rate"].as<uint64_t>();
+	configuration.limits.peer_burst = vm["limits.peer_burst"].as<uint64_t>();
+	configuration.limits.endpoints_rate = vm["limits.endpoints_rate"].as<uint64_t>();
+	configuration.limits.endpoints_burst = vm["limits.endpoints_burst"].as<uint64_t>();
+
+	// Persist the DER form of everything decoded above: the next start skips the PEM work for unchanged files.
+	configuration_der_cache.save();
 }
 
 boost::filesystem::path get_tap_adapter_up_script(const boost::filesystem::path& root, const boost::program_options::variables_map& vm)
@@ -94,6 +94,12 @@ boost::program_options::options_description get_switch_options();
  */
 boost::program_options::options_description get_router_options();
 
+/**
+ * \brief Get the limits options.
+ * \return The limits options.
+ */
+boost::program_options::options_description get_limits_options();
+
 /**
  * \brief Setup a freelan configuration from a variables map.
  * \param configuration The configuration to setup.
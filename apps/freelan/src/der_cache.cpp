@@ -0,0 +1,297 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file der_cache.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A binary DER cache for the PEM files of the configuration.
+ */
+
+#include "der_cache.hpp"
+
+#include <fstream>
+
+namespace
+{
+	const uint32_t DER_CACHE_MAGIC = 0x464c4443; // "FLDC"
+	const uint32_t DER_CACHE_VERSION = 1;
+
+	// The entries are bounded so a corrupted length field cannot trigger a huge allocation.
+	const uint32_t DER_CACHE_MAX_ENTRY_SIZE = 16 * 1024 * 1024;
+	const uint32_t DER_CACHE_MAX_PATH_SIZE = 4096;
+
+	template <typename IntegerType>
+	bool read_integer(std::istream& is, IntegerType& value)
+	{
+		unsigned char bytes[sizeof(IntegerType)];
+
+		if (!is.read(reinterpret_cast<char*>(bytes), sizeof(bytes)))
+		{
+			return false;
+		}
+
+		value = 0;
+
+		for (size_t i = 0; i < sizeof(bytes); ++i)
+		{
+			value |= static_cast<IntegerType>(bytes[i]) << (8 * i);
+		}
+
+		return true;
+	}
+
+	template <typename IntegerType>
+	void write_integer(std::ostream& os, IntegerType value)
+	{
+		unsigned char bytes[sizeof(IntegerType)];
+
+		for (size_t i = 0; i < sizeof(bytes); ++i)
+		{
+			bytes[i] = static_cast<unsigned char>(value >> (8 * i));
+		}
+
+		os.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+	}
+}
+
+void der_cache::open(const boost::filesystem::path& path)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	m_path = path;
+	m_entries.clear();
+	m_dirty = false;
+
+	if (m_path.empty())
+	{
+		return;
+	}
+
+	std::ifstream is(m_path.string().c_str(), std::ios::binary);
+
+	if (!is)
+	{
+		return;
+	}
+
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	uint32_t count = 0;
+
+	if (!read_integer(is, magic) || (magic != DER_CACHE_MAGIC) || !read_integer(is, version) || (version != DER_CACHE_VERSION) || !read_integer(is, count))
+	{
+		return;
+	}
+
+	entry_map_type entries;
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint32_t path_size = 0;
+
+		if (!read_integer(is, path_size) || (path_size > DER_CACHE_MAX_PATH_SIZE))
+		{
+			return;
+		}
+
+		std::string source(path_size, '\0');
+
+		if (path_size && !is.read(&source[0], path_size))
+		{
+			return;
+		}
+
+		entry_type entry;
+		uint32_t der_size = 0;
+
+		if (!read_integer(is, entry.source_size) || !read_integer(is, entry.source_mtime) || !read_integer(is, entry.kind) || !read_integer(is, der_size) || (der_size > DER_CACHE_MAX_ENTRY_SIZE))
+		{
+			return;
+		}
+
+		entry.der.resize(der_size);
+
+		if (der_size && !is.read(reinterpret_cast<char*>(&entry.der[0]), der_size))
+		{
+			return;
+		}
+
+		entries[source] = entry;
+	}
+
+	// Only a fully read cache file is trusted.
+	m_entries.swap(entries);
+}
+
+bool der_cache::lookup(const boost::filesystem::path& source, kind_type kind, std::vector<unsigned char>& der)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	if (m_path.empty())
+	{
+		return false;
+	}
+
+	const entry_map_type::const_iterator entry = m_entries.find(source.string());
+
+	if ((entry == m_entries.end()) || (entry->second.kind != static_cast<uint8_t>(kind)))
+	{
+		return false;
+	}
+
+	uint64_t size = 0;
+	int64_t mtime = 0;
+
+	if (!stat_source(source, size, mtime) || (size != entry->second.source_size) || (mtime != entry->second.source_mtime))
+	{
+		return false;
+	}
+
+	der = entry->second.der;
+
+	return true;
+}
+
+void der_cache::store(const boost::filesystem::path& source, kind_type kind, const std::vector<unsigned char>& der)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	if (m_path.empty() || (der.size() > DER_CACHE_MAX_ENTRY_SIZE))
+	{
+		return;
+	}
+
+	uint64_t size = 0;
+	int64_t mtime = 0;
+
+	if (!stat_source(source, size, mtime))
+	{
+		return;
+	}
+
+	entry_type& entry = m_entries[source.string()];
+
+	entry.source_size = size;
+	entry.source_mtime = mtime;
+	entry.kind = static_cast<uint8_t>(kind);
+	entry.der = der;
+
+	m_dirty = true;
+}
+
+void der_cache::save()
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	if (m_path.empty() || !m_dirty)
+	{
+		return;
+	}
+
+	try
+	{
+		const boost::filesystem::path temporary = m_path.string() + ".tmp";
+
+		{
+			std::ofstream os(temporary.string().c_str(), std::ios::binary | std::ios::trunc);
+
+			if (!os)
+			{
+				return;
+			}
+
+			write_integer(os, DER_CACHE_MAGIC);
+			write_integer(os, DER_CACHE_VERSION);
+			write_integer(os, static_cast<uint32_t>(m_entries.size()));
+
+			for (entry_map_type::const_iterator entry = m_entries.begin(); entry != m_entries.end(); ++entry)
+			{
+				write_integer(os, static_cast<uint32_t>(entry->first.size()));
+				os.write(entry->first.data(), entry->first.size());
+				write_integer(os, entry->second.source_size);
+				write_integer(os, entry->second.source_mtime);
+				write_integer(os, entry->second.kind);
+				write_integer(os, static_cast<uint32_t>(entry->second.der.size()));
+
+				if (!entry->second.der.empty())
+				{
+					os.write(reinterpret_cast<const char*>(&entry->second.der[0]), entry->second.der.size());
+				}
+			}
+
+			if (!os)
+			{
+				return;
+			}
+		}
+
+		boost::filesystem::rename(temporary, m_path);
+
+		m_dirty = false;
+	}
+	catch (const std::exception&)
+	{
+		// The cache never makes a start fail.
+	}
+}
+
+bool der_cache::stat_source(const boost::filesystem::path& source, uint64_t& size, int64_t& mtime) const
+{
+	boost::system::error_code ec;
+
+	const uintmax_t source_size = boost::filesystem::file_size(source, ec);
+
+	if (ec)
+	{
+		return false;
+	}
+
+	const std::time_t source_mtime = boost::filesystem::last_write_time(source, ec);
+
+	if (ec)
+	{
+		return false;
+	}
+
+	size = static_cast<uint64_t>(source_size);
+	mtime = static_cast<int64_t>(source_mtime);
+
+	return true;
+}
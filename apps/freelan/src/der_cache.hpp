@@ -0,0 +1,158 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file der_cache.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A binary DER cache for the PEM files of the configuration.
+ */
+
+#ifndef DER_CACHE_HPP
+#define DER_CACHE_HPP
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * \brief A binary DER cache for the PEM files of the configuration.
+ *
+ * PEM decoding the certificate material - especially large authority
+ * lists - dominates the daemon's cold start on small gateways. This
+ * cache keeps the DER form of every decoded file in a single versioned
+ * binary file: on the next start, a file whose size and modification
+ * time are unchanged is rebuilt from its DER entry with a single
+ * d2i call, skipping the base64 and PEM framing work entirely.
+ *
+ * The cache is best-effort: a missing, stale, truncated or
+ * version-mismatched cache file is ignored and rebuilt. Private keys
+ * are never cached.
+ */
+class der_cache
+{
+	public:
+
+		der_cache() :
+			m_dirty(false)
+		{}
+
+		/**
+		 * \brief The kind of a cached entry. A lookup only matches an entry of the same kind.
+		 */
+		enum kind_type
+		{
+			KIND_CERTIFICATE = 0,
+			KIND_TRUSTED_CERTIFICATE = 1,
+			KIND_CERTIFICATE_REVOCATION_LIST = 2
+		};
+
+		/**
+		 * \brief Open the cache.
+		 * \param path The cache file. Read if it exists; created or rewritten by save().
+		 *
+		 * Any previously opened state is discarded. An unreadable or incompatible cache file is silently ignored.
+		 */
+		void open(const boost::filesystem::path& path);
+
+		/**
+		 * \brief Check whether the cache was opened.
+		 * \return true when open() was called with a non-empty path.
+		 */
+		bool enabled() const
+		{
+			return !m_path.empty();
+		}
+
+		/**
+		 * \brief Look a source file up.
+		 * \param source The source file.
+		 * \param kind The expected kind.
+		 * \param der The DER bytes, filled on a hit.
+		 * \return true when an entry of the right kind exists and the source file's size and modification time are unchanged.
+		 */
+		bool lookup(const boost::filesystem::path& source, kind_type kind, std::vector<unsigned char>& der);
+
+		/**
+		 * \brief Record the DER form of a decoded source file.
+		 * \param source The source file.
+		 * \param kind The kind.
+		 * \param der The DER bytes.
+		 */
+		void store(const boost::filesystem::path& source, kind_type kind, const std::vector<unsigned char>& der);
+
+		/**
+		 * \brief Write the cache file, if the cache was opened and changed.
+		 *
+		 * The file is written to a temporary name and renamed into place, so a crash never leaves a truncated cache. Failures are silently ignored: the cache never makes a start fail.
+		 */
+		void save();
+
+	private:
+
+		struct entry_type
+		{
+			entry_type() :
+				source_size(0),
+				source_mtime(0),
+				kind(0)
+			{}
+
+			uint64_t source_size;
+			int64_t source_mtime;
+			uint8_t kind;
+			std::vector<unsigned char> der;
+		};
+
+		typedef std::map<std::string, entry_type> entry_map_type;
+
+		bool stat_source(const boost::filesystem::path& source, uint64_t& size, int64_t& mtime) const;
+
+		boost::filesystem::path m_path;
+		entry_map_type m_entries;
+		bool m_dirty;
+		mutable boost::mutex m_mutex;
+};
+
+#endif /* DER_CACHE_HPP */
@@ -162,6 +162,10 @@ int execute(const fscp::logger& logger, fs::path script, const std::vector<std::
 	std::vector<std::string> real_args = { script.string() };
 #endif
 	real_args.insert(real_args.end(), args.begin(), args.end());
+
+	logger(fscp::log_level::debug) << "Calling script " << script.string() << "...";
+
+#if defined(WINDOWS)
 	auto new_env = executeplus::get_current_environment();
 
 	for (auto&& pair : env)
@@ -169,14 +173,12 @@ int execute(const fscp::logger& logger, fs::path script, const std::vector<std::
 		new_env[pair.first] = pair.second;
 	}
 
-	logger(fscp::log_level::debug) << "Calling script " << script.string() << "...";
-
-#if defined(WINDOWS)
 	const auto return_code = executeplus::execute(real_args, new_env);
 #else
 	std::ostringstream oss;
 
-	const auto return_code = executeplus::execute(real_args, new_env, &oss);
+	// The daemon environment is snapshotted once and shared across the script launches: only the per-script variables are laid out for each call.
+	const auto return_code = executeplus::execute(real_args, executeplus::get_environment_snapshot(), env, &oss);
 #endif
 
 	const auto log_level = (return_code == 0) ? fscp::log_level::debug : fscp::log_level::warning;
@@ -504,6 +504,7 @@ namespace windows
 		if (ctx.service_status_handle != 0)
 		{
 			ctx.service_status.dwCurrentState = SERVICE_START_PENDING;
+			ctx.service_status.dwWaitHint = 30000;
 
 			// Start pending
 			::SetServiceStatus(ctx.service_status_handle, &ctx.service_status);
@@ -539,19 +540,43 @@ namespace windows
 					core.set_authentication_callback(boost::bind(&execute_authentication_script, fl_configuration.server.authentication_script, logger, _1, _2, _3, _4));
 				}
 
-				core.open();
-
 				boost::unique_lock<boost::mutex> lock(ctx.stop_function_mutex);
 
 				ctx.stop_function = boost::bind(&fl::core::close, boost::ref(core));
 
 				lock.unlock();
 
-				// Running
+				// Running. The essentials are bound: the slow part of the startup - certificate loads, contact resolution, the tap adapter - runs on the worker threads below, so the SCM sees the service running well within its patience and a slow DNS server cannot fail the boot.
 				ctx.service_status.dwControlsAccepted |= (SERVICE_ACCEPT_STOP | SERVICE_ACCEPT_SHUTDOWN);
 				ctx.service_status.dwCurrentState = SERVICE_RUNNING;
+				ctx.service_status.dwWaitHint = 0;
 				::SetServiceStatus(ctx.service_status_handle, &ctx.service_status);
 
+				io_service.post([&core, &io_service, &ctx, &logger] () {
+					try
+					{
+						// Brings the subsystems up in the background; once it completes, the monitoring web server reports the usual state.
+						core.open();
+					}
+					catch (boost::system::system_error& ex)
+					{
+						logger(fscp::log_level::error) << "Error during startup: " << ex.code() << ":" << ex.code().message() << ":" << ex.what();
+
+						ctx.service_status.dwWin32ExitCode = ex.code().value();
+
+						io_service.stop();
+					}
+					catch (std::exception& ex)
+					{
+						logger(fscp::log_level::error) << "Error during startup: " << ex.what();
+
+						ctx.service_status.dwWin32ExitCode = ERROR_SERVICE_SPECIFIC_ERROR;
+						ctx.service_status.dwServiceSpecificExitCode = 1;
+
+						io_service.stop();
+					}
+				});
+
 				boost::thread_group threads;
 
 				unsigned int thread_count = configuration.thread_count;
@@ -0,0 +1,294 @@
+/**
+ * \file bench.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A microbenchmark harness for the cryptographic primitives.
+ *
+ * Measures, through the cryptoplus wrappers, everything a cipher suite choice
+ * depends on: AES-GCM seal/open throughput and latency across payload sizes,
+ * digest and HMAC rates, ECDHE agreement rate per curve and RSA sign/verify
+ * rates per key size.
+ *
+ * Human-readable progress goes to the standard error; the results go to the
+ * standard output as a single JSON document so runs can be tracked across
+ * OpenSSL upgrades.
+ */
+
+#include <cryptoplus/cryptoplus.hpp>
+#include <cryptoplus/buffer.hpp>
+#include <cryptoplus/cipher/cipher_context.hpp>
+#include <cryptoplus/hash/hmac_context.hpp>
+#include <cryptoplus/hash/message_digest.hpp>
+#include <cryptoplus/hash/message_digest_context.hpp>
+#include <cryptoplus/pkey/ecdhe.hpp>
+#include <cryptoplus/pkey/pkey.hpp>
+#include <cryptoplus/pkey/rsa_key.hpp>
+#include <cryptoplus/random/random.hpp>
+
+#include <kfather/formatter.hpp>
+#include <kfather/value.hpp>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <openssl/evp.h>
+#include <openssl/obj_mac.h>
+#include <openssl/rsa.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const size_t GCM_PAYLOAD_SIZES[] = { 64, 1400, 65536 };
+	const size_t GCM_IV_SIZE = 12;
+	const size_t GCM_TAG_SIZE = 16;
+	const size_t HASH_PAYLOAD_SIZE = 1400;
+	const double MIN_MEASURE_SECONDS = 1.0;
+
+	kfather::array_type g_results;
+
+	boost::posix_time::ptime now()
+	{
+		return boost::posix_time::microsec_clock::universal_time();
+	}
+
+	double elapsed_seconds(const boost::posix_time::ptime& start, const boost::posix_time::ptime& stop)
+	{
+		return static_cast<double>((stop - start).total_microseconds()) / 1000000.0;
+	}
+
+	void add_result(const std::string& name, const std::string& parameter, const std::string& metric, double value, const std::string& unit)
+	{
+		g_results.items.push_back(kfather::object_type {
+			{
+				{"name", name},
+				{"parameter", parameter},
+				{"metric", metric},
+				{"value", value},
+				{"unit", unit}
+			}
+		});
+	}
+
+	/**
+	 * \brief Run op() repeatedly for at least MIN_MEASURE_SECONDS and return the rate, in operations per second.
+	 */
+	template <typename Operation>
+	double measure_rate(Operation op)
+	{
+		size_t iterations = 0;
+		double seconds = 0.0;
+
+		// One untimed call warms the caches and surfaces errors before timing starts.
+		op();
+
+		const boost::posix_time::ptime start = now();
+
+		do
+		{
+			op();
+
+			++iterations;
+			seconds = elapsed_seconds(start, now());
+		}
+		while (seconds < MIN_MEASURE_SECONDS);
+
+		return static_cast<double>(iterations) / seconds;
+	}
+
+	void bench_gcm(const std::string& name, const EVP_CIPHER* cipher)
+	{
+		using cryptoplus::cipher::cipher_context;
+
+		const cryptoplus::cipher::cipher_algorithm algorithm(cipher);
+
+		std::vector<uint8_t> key(algorithm.key_length());
+		uint8_t iv[GCM_IV_SIZE];
+		uint8_t tag[GCM_TAG_SIZE];
+
+		cryptoplus::random::get_random_bytes(&key[0], key.size());
+		cryptoplus::random::get_random_bytes(iv, sizeof(iv));
+
+		for (size_t i = 0; i < sizeof(GCM_PAYLOAD_SIZES) / sizeof(GCM_PAYLOAD_SIZES[0]); ++i)
+		{
+			const size_t payload_size = GCM_PAYLOAD_SIZES[i];
+
+			std::cerr << "Benchmarking " << name << " with " << payload_size << " bytes payloads" << std::endl;
+
+			std::vector<uint8_t> cleartext(payload_size);
+			std::vector<uint8_t> ciphertext(payload_size + algorithm.block_size());
+			std::vector<uint8_t> opened(payload_size + algorithm.block_size());
+
+			cryptoplus::random::get_random_bytes(&cleartext[0], cleartext.size());
+
+			cipher_context seal_ctx;
+			seal_ctx.initialize(algorithm, cipher_context::encrypt, NULL, 0, NULL);
+			seal_ctx.ctrl_set(EVP_CTRL_GCM_SET_IVLEN, static_cast<int>(sizeof(iv)));
+			seal_ctx.initialize(algorithm, cipher_context::unchanged, &key[0], key.size(), NULL);
+
+			const double seal_rate = measure_rate([&]() {
+				seal_ctx.set_iv(iv);
+
+				size_t cnt = seal_ctx.update(&ciphertext[0], ciphertext.size(), &cleartext[0], cleartext.size());
+				cnt += seal_ctx.finalize(&ciphertext[cnt], ciphertext.size() - cnt);
+
+				seal_ctx.ctrl(EVP_CTRL_GCM_GET_TAG, GCM_TAG_SIZE, tag);
+			});
+
+			cipher_context open_ctx;
+			open_ctx.initialize(algorithm, cipher_context::decrypt, NULL, 0, NULL);
+			open_ctx.ctrl_set(EVP_CTRL_GCM_SET_IVLEN, static_cast<int>(sizeof(iv)));
+			open_ctx.initialize(algorithm, cipher_context::unchanged, &key[0], key.size(), NULL);
+
+			const double open_rate = measure_rate([&]() {
+				open_ctx.ctrl(EVP_CTRL_GCM_SET_TAG, GCM_TAG_SIZE, tag);
+				open_ctx.set_iv(iv);
+
+				size_t cnt = open_ctx.update(&opened[0], opened.size(), &ciphertext[0], cleartext.size());
+				cnt += open_ctx.finalize(&opened[cnt], opened.size() - cnt);
+			});
+
+			const std::string parameter = std::to_string(payload_size);
+
+			add_result(name, parameter, "seal_throughput", seal_rate * payload_size / (1024.0 * 1024.0), "MiB/s");
+			add_result(name, parameter, "seal_latency", 1000000.0 / seal_rate, "us");
+			add_result(name, parameter, "open_throughput", open_rate * payload_size / (1024.0 * 1024.0), "MiB/s");
+			add_result(name, parameter, "open_latency", 1000000.0 / open_rate, "us");
+		}
+	}
+
+	void bench_digest(const std::string& name, int nid)
+	{
+		std::cerr << "Benchmarking " << name << std::endl;
+
+		const cryptoplus::hash::message_digest_algorithm algorithm(nid);
+
+		std::vector<uint8_t> data(HASH_PAYLOAD_SIZE);
+		std::vector<uint8_t> digest(algorithm.result_size());
+
+		cryptoplus::random::get_random_bytes(&data[0], data.size());
+
+		const double rate = measure_rate([&]() {
+			cryptoplus::hash::message_digest(&digest[0], digest.size(), &data[0], data.size(), algorithm);
+		});
+
+		add_result(name, std::to_string(HASH_PAYLOAD_SIZE), "digest_throughput", rate * HASH_PAYLOAD_SIZE / (1024.0 * 1024.0), "MiB/s");
+		add_result(name, std::to_string(HASH_PAYLOAD_SIZE), "digest_rate", rate, "op/s");
+	}
+
+	void bench_hmac(const std::string& name, int nid)
+	{
+		std::cerr << "Benchmarking " << name << std::endl;
+
+		const cryptoplus::hash::message_digest_algorithm algorithm(nid);
+
+		std::vector<uint8_t> key(algorithm.result_size());
+		std::vector<uint8_t> data(HASH_PAYLOAD_SIZE);
+		std::vector<uint8_t> mac(algorithm.result_size());
+
+		cryptoplus::random::get_random_bytes(&key[0], key.size());
+		cryptoplus::random::get_random_bytes(&data[0], data.size());
+
+		cryptoplus::hash::hmac_context ctx;
+		ctx.initialize(&key[0], key.size(), &algorithm);
+
+		const double rate = measure_rate([&]() {
+			ctx.compute(&mac[0], mac.size(), &data[0], data.size());
+		});
+
+		add_result(name, std::to_string(HASH_PAYLOAD_SIZE), "hmac_throughput", rate * HASH_PAYLOAD_SIZE / (1024.0 * 1024.0), "MiB/s");
+		add_result(name, std::to_string(HASH_PAYLOAD_SIZE), "hmac_rate", rate, "op/s");
+	}
+
+	void bench_ecdhe(const std::string& name, int nid)
+	{
+		std::cerr << "Benchmarking ECDHE over " << name << std::endl;
+
+		cryptoplus::pkey::ecdhe_context peer_context(nid);
+		const cryptoplus::buffer peer_public_key = peer_context.get_public_key();
+
+		cryptoplus::pkey::ecdhe_context context(nid);
+
+		// One agreement is what a handshake pays: a fresh key pair plus one derivation.
+		const double rate = measure_rate([&]() {
+			context.generate_keys();
+			context.derive_secret_key(peer_public_key);
+		});
+
+		add_result("ecdhe", name, "agreement_rate", rate, "op/s");
+	}
+
+	void bench_rsa(const std::string& name, int bits)
+	{
+		std::cerr << "Benchmarking " << name << " (key generation may take a while)" << std::endl;
+
+		const cryptoplus::pkey::pkey key = cryptoplus::pkey::pkey::from_rsa_key(cryptoplus::pkey::rsa_key::generate_private_key(bits, RSA_F4));
+		const cryptoplus::hash::message_digest_algorithm algorithm(NID_sha256);
+
+		std::vector<uint8_t> data(HASH_PAYLOAD_SIZE);
+
+		cryptoplus::random::get_random_bytes(&data[0], data.size());
+
+		cryptoplus::buffer signature;
+
+		const double sign_rate = measure_rate([&]() {
+			cryptoplus::hash::message_digest_context mdctx;
+
+			mdctx.digest_sign_initialize(algorithm, key);
+			mdctx.digest_sign_update(&data[0], data.size());
+
+			signature = mdctx.digest_sign_finalize();
+		});
+
+		const double verify_rate = measure_rate([&]() {
+			cryptoplus::hash::message_digest_context mdctx;
+
+			mdctx.digest_verify_initialize(algorithm, key);
+			mdctx.digest_verify_update(&data[0], data.size());
+
+			if (!mdctx.digest_verify_finalize(cryptoplus::buffer_cast<const uint8_t*>(signature), cryptoplus::buffer_size(signature)))
+			{
+				throw std::runtime_error("Signature verification failed");
+			}
+		});
+
+		add_result(name, "sha256", "sign_rate", sign_rate, "op/s");
+		add_result(name, "sha256", "verify_rate", verify_rate, "op/s");
+	}
+}
+
+int main()
+{
+	cryptoplus::crypto_initializer crypto_initializer;
+	cryptoplus::algorithms_initializer algorithms_initializer;
+
+	bench_gcm("aes128-gcm", EVP_aes_128_gcm());
+	bench_gcm("aes256-gcm", EVP_aes_256_gcm());
+
+	bench_digest("sha256", NID_sha256);
+	bench_digest("sha384", NID_sha384);
+
+	bench_hmac("hmac-sha256", NID_sha256);
+	bench_hmac("hmac-sha384", NID_sha384);
+
+	bench_ecdhe("sect571k1", NID_sect571k1);
+	bench_ecdhe("secp384r1", NID_secp384r1);
+	bench_ecdhe("secp521r1", NID_secp521r1);
+
+	bench_rsa("rsa2048", 2048);
+	bench_rsa("rsa4096", 4096);
+
+	kfather::compact_formatter().format(
+		std::cout,
+		kfather::object_type {
+			{
+				{"results", g_results}
+			}
+		}
+	);
+
+	std::cout << std::endl;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,155 @@
+/**
+ * \file bench.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A throughput benchmark for the base 64 codec.
+ *
+ * Measures the cryptoplus::base64_encode()/base64_decode() throughput against
+ * the historical OpenSSL BIO filter path over payload sizes that match what
+ * the web client actually shuttles: DER certificates and provisioning bursts.
+ *
+ * Human-readable progress goes to the standard error; one CSV line per
+ * measurement goes to the standard output so the results can be diffed or
+ * charted across revisions.
+ */
+
+#include <cryptoplus/base64.hpp>
+#include <cryptoplus/bio/bio_chain.hpp>
+#include <cryptoplus/bio/bio_ptr.hpp>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <openssl/buffer.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const size_t PAYLOAD_SIZES[] = { 1536, 65536, 1048576 };
+	const size_t BYTES_PER_MEASUREMENT = 256 * 1024 * 1024;
+
+	boost::posix_time::ptime now()
+	{
+		return boost::posix_time::microsec_clock::universal_time();
+	}
+
+	double elapsed_seconds(const boost::posix_time::ptime& start, const boost::posix_time::ptime& stop)
+	{
+		return static_cast<double>((stop - start).total_microseconds()) / 1000000.0;
+	}
+
+	void print_result(const std::string& path, size_t payload_size, const std::string& metric, double value, const std::string& unit)
+	{
+		std::cout << path << "," << payload_size << "," << metric << "," << value << "," << unit << std::endl;
+	}
+
+	/**
+	 * \brief The historical implementation, kept here as the baseline.
+	 */
+	size_t bio_base64_encode(void* output, size_t outputlen, const void* input, size_t inputlen)
+	{
+		using namespace cryptoplus;
+
+		bio::bio_chain bio_chain(BIO_f_base64());
+		bio_chain.first().set_flags(BIO_FLAGS_BASE64_NO_NL);
+		bio_chain.first().push(BIO_new(BIO_s_mem()));
+
+		ptrdiff_t cnt = bio_chain.first().write(input, inputlen);
+
+		if (cnt <= 0)
+		{
+			throw std::runtime_error("Unable to perform base 64 encoding");
+		}
+
+		bio_chain.first().flush();
+
+		BUF_MEM* b64ptr = bio_chain.first().next().get_mem_buf();
+
+		const size_t min_size = std::min(static_cast<size_t>(b64ptr->length), outputlen);
+
+		std::copy(static_cast<const char*>(b64ptr->data), static_cast<const char*>(b64ptr->data) + min_size, static_cast<char*>(output));
+
+		return min_size;
+	}
+
+	/**
+	 * \brief The historical implementation, kept here as the baseline.
+	 */
+	size_t bio_base64_decode(void* output, size_t outputlen, const void* input, size_t inputlen)
+	{
+		using namespace cryptoplus;
+
+		bio::bio_chain bio_chain(BIO_f_base64());
+		bio_chain.first().set_flags(BIO_FLAGS_BASE64_NO_NL);
+		bio_chain.first().push(BIO_new_mem_buf(const_cast<void*>(input), static_cast<int>(inputlen)));
+
+		ptrdiff_t cnt = bio_chain.first().read(output, outputlen);
+
+		if (cnt <= 0)
+		{
+			throw std::runtime_error("Unable to perform base 64 decoding");
+		}
+
+		return static_cast<size_t>(cnt);
+	}
+
+	typedef size_t (*codec_function)(void*, size_t, const void*, size_t);
+
+	double measure(codec_function codec, const std::vector<uint8_t>& input, std::vector<uint8_t>& output, size_t payload_size)
+	{
+		const size_t iterations = std::max<size_t>(1, BYTES_PER_MEASUREMENT / payload_size);
+
+		// Warm up the caches and make sure the codec round-trips before timing it.
+		codec(&output[0], output.size(), &input[0], input.size());
+
+		const boost::posix_time::ptime start = now();
+
+		for (size_t i = 0; i < iterations; ++i)
+		{
+			codec(&output[0], output.size(), &input[0], input.size());
+		}
+
+		const double seconds = elapsed_seconds(start, now());
+
+		return static_cast<double>(iterations) * static_cast<double>(payload_size) / seconds / (1024.0 * 1024.0);
+	}
+
+	void run_payload_size(size_t payload_size)
+	{
+		std::cerr << "Benchmarking payload size: " << payload_size << " bytes" << std::endl;
+
+		std::vector<uint8_t> cleartext(payload_size);
+
+		for (size_t i = 0; i < cleartext.size(); ++i)
+		{
+			cleartext[i] = static_cast<uint8_t>(rand());
+		}
+
+		const std::string encoded = cryptoplus::base64_encode(&cleartext[0], cleartext.size());
+
+		std::vector<uint8_t> encode_output(encoded.size() + 4);
+		std::vector<uint8_t> decode_output(payload_size + 4);
+		std::vector<uint8_t> encoded_input(encoded.begin(), encoded.end());
+
+		print_result("cryptoplus", payload_size, "encode", measure(&cryptoplus::base64_encode, cleartext, encode_output, payload_size), "MiB/s");
+		print_result("bio", payload_size, "encode", measure(&bio_base64_encode, cleartext, encode_output, payload_size), "MiB/s");
+		print_result("cryptoplus", payload_size, "decode", measure(&cryptoplus::base64_decode, encoded_input, decode_output, payload_size), "MiB/s");
+		print_result("bio", payload_size, "decode", measure(&bio_base64_decode, encoded_input, decode_output, payload_size), "MiB/s");
+	}
+}
+
+int main()
+{
+	std::cout << "path,payload_size,metric,value,unit" << std::endl;
+
+	for (size_t i = 0; i < sizeof(PAYLOAD_SIZES) / sizeof(PAYLOAD_SIZES[0]); ++i)
+	{
+		run_payload_size(PAYLOAD_SIZES[i]);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,334 @@
+/**
+ * \file bench.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A forwarding decision microbenchmark for freelan::switch_ and freelan::router.
+ *
+ * Drives both classes in isolation, with synthetic port sets of 10, 100 and
+ * 1000 ports whose write functions only count invocations, so the measured
+ * cost is the forwarding decision itself: MAC learning, unicast lookup and
+ * broadcast fan-out for the switch, and route resolution for the router.
+ * Frames use a realistic distribution: one learned MAC or one /24 route per
+ * port, and uniformly random destinations across ports.
+ *
+ * Human-readable progress goes to the standard error; one CSV line per
+ * measurement goes to the standard output so the results can be diffed or
+ * charted across revisions.
+ */
+
+#include <freelan/switch.hpp>
+#include <freelan/router.hpp>
+#include <freelan/configuration.hpp>
+
+#include <fscp/shared_buffer.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using boost::asio::buffer;
+using boost::asio::buffer_cast;
+using boost::asio::buffer_size;
+
+namespace
+{
+	const size_t OPERATION_COUNT = 200000;
+	const size_t FRAME_SIZE = 64;
+	const size_t ETHERNET_HEADER_SIZE = 14;
+
+	const size_t PORT_COUNTS[] = { 10, 100, 1000 };
+
+	boost::posix_time::ptime now()
+	{
+		return boost::posix_time::microsec_clock::universal_time();
+	}
+
+	double elapsed_seconds(const boost::posix_time::ptime& start, const boost::posix_time::ptime& stop)
+	{
+		return static_cast<double>((stop - start).total_microseconds()) / 1000000.0;
+	}
+
+	void print_result(const std::string& component, const std::string& scenario, size_t port_count, size_t operations, double seconds)
+	{
+		const double rate = (seconds > 0.0) ? (static_cast<double>(operations) / seconds) : 0.0;
+
+		std::cout << component << "," << scenario << "," << port_count << "," << operations << "," << seconds << "," << rate << std::endl;
+	}
+
+	/**
+	 * \brief A counting write target, shared by all the ports of a run.
+	 *
+	 * The write functions must stay trivial: the benchmark measures the
+	 * forwarding decision, not the ports.
+	 */
+	struct write_counter
+	{
+		write_counter() : count(0) {}
+
+		void write(fscp::SharedBuffer, boost::asio::const_buffer, freelan::switch_::port_type::write_handler_type handler)
+		{
+			++count;
+
+			if (handler)
+			{
+				handler(boost::system::error_code());
+			}
+		}
+
+		size_t count;
+	};
+
+	freelan::port_index_type make_synthetic_index(size_t i)
+	{
+		// The endpoint variant is the cheapest port index to synthesize in numbers.
+		return freelan::make_port_index(fscp::server::ep_type(boost::asio::ip::address_v4::loopback(), static_cast<uint16_t>(1000 + i)));
+	}
+
+	/**
+	 * \brief Fill the MAC address of port i.
+	 *
+	 * The addresses are locally administered unicast addresses, spread so
+	 * consecutive ports do not share hash prefixes.
+	 */
+	void make_mac_address(size_t i, uint8_t* mac)
+	{
+		mac[0] = 0x02;
+		mac[1] = static_cast<uint8_t>(i >> 24);
+		mac[2] = static_cast<uint8_t>(i >> 16);
+		mac[3] = 0x5a;
+		mac[4] = static_cast<uint8_t>(i >> 8);
+		mac[5] = static_cast<uint8_t>(i);
+	}
+
+	/**
+	 * \brief Build an ethernet frame in the shared buffer.
+	 * \return The frame payload, sized to FRAME_SIZE.
+	 */
+	boost::asio::const_buffer build_ethernet_frame(fscp::SharedBuffer& frame, const uint8_t* destination, const uint8_t* source)
+	{
+		uint8_t* const data = buffer_cast<uint8_t*>(frame);
+
+		std::memcpy(data, destination, 6);
+		std::memcpy(data + 6, source, 6);
+		data[12] = 0x08;
+		data[13] = 0x00;
+		std::memset(data + ETHERNET_HEADER_SIZE, 0, FRAME_SIZE - ETHERNET_HEADER_SIZE);
+
+		return boost::asio::const_buffer(data, FRAME_SIZE);
+	}
+
+	/**
+	 * \brief Build a minimal IPv4 packet in the shared buffer.
+	 * \return The packet payload, sized to FRAME_SIZE.
+	 */
+	boost::asio::const_buffer build_ipv4_packet(fscp::SharedBuffer& frame, uint32_t destination)
+	{
+		uint8_t* const data = buffer_cast<uint8_t*>(frame);
+
+		std::memset(data, 0, FRAME_SIZE);
+		data[0] = 0x45;
+		data[2] = static_cast<uint8_t>(FRAME_SIZE >> 8);
+		data[3] = static_cast<uint8_t>(FRAME_SIZE);
+		data[8] = 64;
+		data[9] = 17;
+		data[12] = 10;
+		data[13] = 0;
+		data[14] = 0;
+		data[15] = 1;
+		data[16] = static_cast<uint8_t>(destination >> 24);
+		data[17] = static_cast<uint8_t>(destination >> 16);
+		data[18] = static_cast<uint8_t>(destination >> 8);
+		data[19] = static_cast<uint8_t>(destination);
+
+		return boost::asio::const_buffer(data, FRAME_SIZE);
+	}
+
+	void run_switch_benchmarks(size_t port_count, boost::random::mt19937& rng)
+	{
+		std::cerr << "Benchmarking switch_ with " << port_count << " ports..." << std::endl;
+
+		freelan::switch_configuration configuration;
+		configuration.routing_method = freelan::switch_configuration::RM_SWITCH;
+		configuration.relay_mode_enabled = false;
+
+		// The table is sized for the working set, so the learning scenario measures insertions, not evictions.
+		freelan::switch_ test_switch(configuration, static_cast<unsigned int>(port_count + OPERATION_COUNT));
+
+		write_counter counter;
+
+		std::vector<freelan::port_index_type> indices;
+
+		for (size_t i = 0; i < port_count; ++i)
+		{
+			indices.push_back(make_synthetic_index(i));
+			test_switch.register_port(indices[i], freelan::switch_::port_type(boost::bind(&write_counter::write, &counter, _1, _2, _3), static_cast<freelan::switch_::port_group_type>(i)));
+		}
+
+		fscp::SharedBuffer frame(FRAME_SIZE);
+
+		uint8_t source_mac[6];
+		uint8_t destination_mac[6];
+
+		// Teach the switch one MAC address per port, as a stable network would.
+		for (size_t i = 0; i < port_count; ++i)
+		{
+			make_mac_address(i, source_mac);
+			make_mac_address((i + 1) % port_count, destination_mac);
+
+			test_switch.async_write(indices[i], frame, build_ethernet_frame(frame, destination_mac, source_mac), freelan::switch_::multi_write_handler_type());
+		}
+
+		boost::random::uniform_int_distribution<size_t> port_distribution(1, port_count - 1);
+
+		// Unicast lookups: known source, known destination, single target.
+		{
+			make_mac_address(0, source_mac);
+
+			counter.count = 0;
+
+			const boost::posix_time::ptime start = now();
+
+			for (size_t i = 0; i < OPERATION_COUNT; ++i)
+			{
+				make_mac_address(port_distribution(rng), destination_mac);
+
+				test_switch.async_write(indices[0], frame, build_ethernet_frame(frame, destination_mac, source_mac), freelan::switch_::multi_write_handler_type());
+			}
+
+			const double seconds = elapsed_seconds(start, now());
+
+			print_result("switch", "unicast_lookup", port_count, OPERATION_COUNT, seconds);
+
+			if (counter.count != OPERATION_COUNT)
+			{
+				std::cerr << "Warning: expected " << OPERATION_COUNT << " port writes, got " << counter.count << "." << std::endl;
+			}
+		}
+
+		// Learning: every frame carries a source MAC the switch has never seen.
+		{
+			make_mac_address(1, destination_mac);
+
+			const boost::posix_time::ptime start = now();
+
+			for (size_t i = 0; i < OPERATION_COUNT; ++i)
+			{
+				make_mac_address(port_count + i, source_mac);
+
+				test_switch.async_write(indices[port_distribution(rng)], frame, build_ethernet_frame(frame, destination_mac, source_mac), freelan::switch_::multi_write_handler_type());
+			}
+
+			const double seconds = elapsed_seconds(start, now());
+
+			print_result("switch", "learning", port_count, OPERATION_COUNT, seconds);
+		}
+
+		// Broadcast: every frame fans out to all the other ports.
+		{
+			static const uint8_t broadcast_mac[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+			make_mac_address(0, source_mac);
+
+			const size_t broadcast_count = OPERATION_COUNT / port_count + 1;
+
+			counter.count = 0;
+
+			const boost::posix_time::ptime start = now();
+
+			for (size_t i = 0; i < broadcast_count; ++i)
+			{
+				test_switch.async_write(indices[0], frame, build_ethernet_frame(frame, broadcast_mac, source_mac), freelan::switch_::multi_write_handler_type());
+			}
+
+			const double seconds = elapsed_seconds(start, now());
+
+			print_result("switch", "broadcast_frames", port_count, broadcast_count, seconds);
+			print_result("switch", "broadcast_port_writes", port_count, counter.count, seconds);
+		}
+	}
+
+	void run_router_benchmarks(size_t port_count, boost::random::mt19937& rng)
+	{
+		std::cerr << "Benchmarking router with " << port_count << " ports..." << std::endl;
+
+		freelan::router_configuration configuration;
+		configuration.client_routing_enabled = true;
+
+		freelan::router test_router(configuration);
+
+		write_counter counter;
+
+		std::vector<freelan::port_index_type> indices;
+
+		// One /24 per port, carved out of 10.0.0.0/8.
+		for (size_t i = 0; i < port_count; ++i)
+		{
+			indices.push_back(make_synthetic_index(i));
+
+			freelan::router::port_type port(boost::bind(&write_counter::write, &counter, _1, _2, _3), static_cast<freelan::router::port_group_type>(i));
+
+			const boost::asio::ip::address_v4 network(static_cast<uint32_t>(0x0a000000 | (i << 8)));
+
+			asiotap::ip_route_set routes;
+			routes.insert(asiotap::ipv4_route(asiotap::ipv4_network_address(network, 24)));
+
+			port.set_local_routes(routes);
+
+			test_router.register_port(indices[i], port);
+		}
+
+		fscp::SharedBuffer frame(FRAME_SIZE);
+
+		boost::random::uniform_int_distribution<size_t> port_distribution(1, port_count - 1);
+
+		counter.count = 0;
+
+		const boost::posix_time::ptime start = now();
+
+		for (size_t i = 0; i < OPERATION_COUNT; ++i)
+		{
+			const uint32_t destination = static_cast<uint32_t>(0x0a000000 | (port_distribution(rng) << 8) | 1);
+
+			test_router.async_write(indices[0], frame, build_ipv4_packet(frame, destination), freelan::router::port_type::write_handler_type());
+		}
+
+		const double seconds = elapsed_seconds(start, now());
+
+		print_result("router", "route_resolution", port_count, OPERATION_COUNT, seconds);
+
+		if (counter.count != OPERATION_COUNT)
+		{
+			std::cerr << "Warning: expected " << OPERATION_COUNT << " port writes, got " << counter.count << "." << std::endl;
+		}
+	}
+}
+
+int main()
+{
+	try
+	{
+		std::cout << "component,scenario,ports,operations,seconds,ops_per_second" << std::endl;
+
+		boost::random::mt19937 rng(42);
+
+		for (size_t i = 0; i < sizeof(PORT_COUNTS) / sizeof(PORT_COUNTS[0]); ++i)
+		{
+			run_switch_benchmarks(PORT_COUNTS[i], rng);
+			run_router_benchmarks(PORT_COUNTS[i], rng);
+		}
+	}
+	catch (std::exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,417 @@
+/**
+ * \file bench.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A loopback benchmark for libfscp.
+ *
+ * Spins up two fscp::server instances over loopback and measures, for every
+ * supported cipher suite: the handshake rate, the small-packet rate, the bulk
+ * throughput and the round-trip latency distribution.
+ *
+ * Human-readable progress goes to the standard error; one CSV line per
+ * measurement goes to the standard output so the results can be diffed or
+ * charted across revisions.
+ */
+
+#include <fscp/fscp.hpp>
+
+#include <cryptoplus/cryptoplus.hpp>
+#include <cryptoplus/error/error_strings.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using boost::asio::buffer;
+using boost::asio::buffer_cast;
+using boost::asio::buffer_size;
+
+namespace
+{
+	const size_t HANDSHAKE_COUNT = 32;
+	const size_t SMALL_PACKET_COUNT = 20000;
+	const size_t SMALL_PACKET_SIZE = 64;
+	const size_t BULK_PACKET_COUNT = 5000;
+	const size_t BULK_PACKET_SIZE = 1400;
+	const size_t PING_COUNT = 1000;
+	const long WAIT_TIMEOUT_SECONDS = 30;
+
+	/**
+	 * \brief The shared state of one benchmark run.
+	 *
+	 * The counters are updated from the io_service threads and waited upon
+	 * from the main thread.
+	 */
+	struct bench_context
+	{
+		bench_context() :
+			session_count(0),
+			received_count(0),
+			received_bytes(0),
+			last_received_time()
+		{}
+
+		boost::mutex mutex;
+		boost::condition_variable condition;
+		size_t session_count;
+		size_t received_count;
+		size_t received_bytes;
+		boost::posix_time::ptime last_received_time;
+		std::vector<double> rtt_microseconds;
+	};
+
+	boost::posix_time::ptime now()
+	{
+		return boost::posix_time::microsec_clock::universal_time();
+	}
+
+	double elapsed_seconds(const boost::posix_time::ptime& start, const boost::posix_time::ptime& stop)
+	{
+		return static_cast<double>((stop - start).total_microseconds()) / 1000000.0;
+	}
+
+	void print_result(const fscp::cipher_suite_type& suite, const std::string& metric, double value, const std::string& unit)
+	{
+		std::ostringstream oss;
+		oss << suite;
+
+		std::cout << oss.str() << "," << metric << "," << value << "," << unit << std::endl;
+	}
+
+	double percentile(std::vector<double>& values, double fraction)
+	{
+		if (values.empty())
+		{
+			return 0.0;
+		}
+
+		std::sort(values.begin(), values.end());
+
+		size_t index = static_cast<size_t>(fraction * static_cast<double>(values.size()));
+
+		if (index >= values.size())
+		{
+			index = values.size() - 1;
+		}
+
+		return values[index];
+	}
+
+	fscp::identity_store generate_identity(const std::string& common_name)
+	{
+		using namespace cryptoplus;
+
+		// The identity is generated in-process so the benchmark needs no certificate files next to the binary.
+		pkey::pkey private_key = pkey::pkey::from_rsa_key(pkey::rsa_key::generate_private_key(2048, 17));
+
+		x509::certificate certificate = x509::certificate::create();
+
+		certificate.set_version(2);
+		certificate.subject().push_back("CN", MBSTRING_ASC, common_name);
+		certificate.set_issuer(certificate.subject());
+		certificate.set_serial_number(asn1::integer::from_long(1));
+
+		const asn1::utctime not_before = asn1::utctime::from_ptime(boost::posix_time::second_clock::universal_time() - boost::gregorian::days(1));
+		const asn1::utctime not_after = asn1::utctime::from_ptime(boost::posix_time::second_clock::universal_time() + boost::gregorian::days(1));
+
+		certificate.set_not_before(not_before);
+		certificate.set_not_after(not_after);
+
+		certificate.set_public_key(private_key);
+		certificate.sign(private_key, hash::message_digest_algorithm(NID_sha256));
+
+		return fscp::identity_store(certificate, private_key);
+	}
+
+	void on_simple_result(const boost::system::error_code& ec)
+	{
+		if (ec)
+		{
+			std::cerr << "Send error: " << ec.message() << std::endl;
+		}
+	}
+
+	bool on_hello(fscp::server& server, const fscp::server::ep_type& sender, bool default_accept)
+	{
+		server.async_introduce_to(sender, &on_simple_result);
+
+		return default_accept;
+	}
+
+	void on_hello_response(fscp::server& server, const fscp::server::ep_type& sender, const boost::system::error_code& ec, const boost::posix_time::time_duration&)
+	{
+		if (ec)
+		{
+			std::cerr << "No HELLO response from " << sender << ": " << ec.message() << std::endl;
+		}
+		else
+		{
+			server.async_introduce_to(sender, &on_simple_result);
+		}
+	}
+
+	bool on_presentation(fscp::server& server, const fscp::server::ep_type& sender, fscp::server::cert_type, fscp::server::presentation_status_type)
+	{
+		server.async_request_session(sender, &on_simple_result);
+
+		return true;
+	}
+
+	void on_session_established(bench_context& context, const fscp::server::ep_type&, bool, const fscp::cipher_suite_type&, const fscp::elliptic_curve_type&)
+	{
+		boost::mutex::scoped_lock lock(context.mutex);
+
+		context.session_count++;
+		context.condition.notify_all();
+	}
+
+	void on_sink_data(bench_context& context, fscp::server& server, const fscp::server::ep_type& sender, fscp::channel_number_type channel_number, fscp::SharedBuffer, boost::asio::const_buffer data)
+	{
+		if (channel_number == fscp::CHANNEL_NUMBER_1)
+		{
+			// The latency probes are echoed back to the sender, on the same channel.
+			const fscp::SharedBuffer echo_buffer(buffer_size(data));
+			std::memcpy(buffer_cast<uint8_t*>(echo_buffer), buffer_cast<const uint8_t*>(data), buffer_size(data));
+
+			server.async_send_data(sender, fscp::CHANNEL_NUMBER_1, buffer(echo_buffer), boost::bind(&on_simple_result, _1));
+
+			return;
+		}
+
+		boost::mutex::scoped_lock lock(context.mutex);
+
+		context.received_count++;
+		context.received_bytes += buffer_size(data);
+		context.last_received_time = now();
+		context.condition.notify_all();
+	}
+
+	void on_echo_data(bench_context& context, const boost::posix_time::ptime& sent_time, const fscp::server::ep_type&, fscp::channel_number_type channel_number, fscp::SharedBuffer, boost::asio::const_buffer)
+	{
+		if (channel_number != fscp::CHANNEL_NUMBER_1)
+		{
+			return;
+		}
+
+		boost::mutex::scoped_lock lock(context.mutex);
+
+		context.rtt_microseconds.push_back(static_cast<double>((now() - sent_time).total_microseconds()));
+		context.received_count++;
+		context.condition.notify_all();
+	}
+
+	bool wait_for_count(bench_context& context, size_t bench_context::* counter, size_t expected)
+	{
+		boost::mutex::scoped_lock lock(context.mutex);
+
+		const boost::system_time deadline = boost::get_system_time() + boost::posix_time::seconds(WAIT_TIMEOUT_SECONDS);
+
+		while (context.*counter < expected)
+		{
+			if (!context.condition.timed_wait(lock, deadline))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void run_suite(const fscp::cipher_suite_type& suite, const fscp::identity_store& alice_identity, const fscp::identity_store& bob_identity)
+	{
+		std::cerr << "Benchmarking cipher suite: " << suite << std::endl;
+
+		boost::asio::io_service io_service;
+		fscp::logger _logger;
+
+		bench_context context;
+
+		fscp::server alice(io_service, _logger, alice_identity);
+		fscp::server bob(io_service, _logger, bob_identity);
+
+		const fscp::cipher_suite_list_type cipher_suites(1, suite);
+
+		alice.set_cipher_suites(cipher_suites);
+		bob.set_cipher_suites(cipher_suites);
+
+		alice.set_hello_message_received_callback(boost::bind(&on_hello, boost::ref(alice), _1, _2));
+		bob.set_hello_message_received_callback(boost::bind(&on_hello, boost::ref(bob), _1, _2));
+
+		alice.set_presentation_message_received_callback(boost::bind(&on_presentation, boost::ref(alice), _1, _2, _3));
+		bob.set_presentation_message_received_callback(boost::bind(&on_presentation, boost::ref(bob), _1, _2, _3));
+
+		alice.set_session_established_callback(boost::bind(&on_session_established, boost::ref(context), _1, _2, _3, _4));
+
+		bob.set_data_received_callback(boost::bind(&on_sink_data, boost::ref(context), boost::ref(bob), _1, _2, _3, _4));
+
+		alice.open(fscp::server::ep_type(boost::asio::ip::address_v4::loopback(), 0));
+		bob.open(fscp::server::ep_type(boost::asio::ip::address_v4::loopback(), 0));
+
+		const fscp::server::ep_type alice_endpoint = alice.get_socket().local_endpoint();
+		const fscp::server::ep_type bob_endpoint = bob.get_socket().local_endpoint();
+
+		alice.set_presentation(bob_endpoint, bob_identity.signature_certificate());
+		bob.set_presentation(alice_endpoint, alice_identity.signature_certificate());
+
+		boost::thread_group threads;
+
+		const unsigned int THREAD_COUNT = std::max<unsigned int>(2, boost::thread::hardware_concurrency());
+
+		for (unsigned int i = 0; i < THREAD_COUNT; ++i)
+		{
+			threads.create_thread(boost::bind(&boost::asio::io_service::run, &io_service));
+		}
+
+		// Handshake rate: the first handshake runs the full HELLO, PRESENTATION and SESSION exchange; the next ones renegotiate the session.
+		const boost::posix_time::ptime handshake_start = now();
+
+		alice.async_greet(bob_endpoint, boost::bind(&on_hello_response, boost::ref(alice), bob_endpoint, _1, _2));
+
+		if (!wait_for_count(context, &bench_context::session_count, 1))
+		{
+			std::cerr << "Handshake timed out for " << suite << ": skipping." << std::endl;
+			print_result(suite, "handshake_rate", 0.0, "handshakes/s");
+
+			alice.close();
+			bob.close();
+			threads.join_all();
+
+			return;
+		}
+
+		for (size_t i = 1; i < HANDSHAKE_COUNT; ++i)
+		{
+			alice.async_request_session(bob_endpoint, &on_simple_result);
+
+			if (!wait_for_count(context, &bench_context::session_count, i + 1))
+			{
+				break;
+			}
+		}
+
+		const double handshake_elapsed = elapsed_seconds(handshake_start, now());
+
+		print_result(suite, "handshake_rate", static_cast<double>(context.session_count) / handshake_elapsed, "handshakes/s");
+
+		// Small-packet rate: fire-and-forget datagrams, counted on the receiving side. UDP may drop under pressure, so the rate is computed over what actually arrived.
+		const fscp::SharedBuffer small_buffer(SMALL_PACKET_SIZE);
+		std::memset(buffer_cast<uint8_t*>(small_buffer), 0x55, SMALL_PACKET_SIZE);
+
+		context.received_count = 0;
+		context.received_bytes = 0;
+
+		boost::posix_time::ptime send_start = now();
+
+		for (size_t i = 0; i < SMALL_PACKET_COUNT; ++i)
+		{
+			alice.async_send_data(bob_endpoint, fscp::CHANNEL_NUMBER_0, buffer(small_buffer), &on_simple_result);
+		}
+
+		wait_for_count(context, &bench_context::received_count, SMALL_PACKET_COUNT);
+
+		{
+			boost::mutex::scoped_lock lock(context.mutex);
+
+			const double elapsed = elapsed_seconds(send_start, context.last_received_time);
+
+			print_result(suite, "small_packet_rate", (elapsed > 0.0) ? static_cast<double>(context.received_count) / elapsed : 0.0, "packets/s");
+			print_result(suite, "small_packet_loss", static_cast<double>(SMALL_PACKET_COUNT - context.received_count), "packets");
+		}
+
+		// Bulk throughput: same exercise with MTU-sized payloads.
+		const fscp::SharedBuffer bulk_buffer(BULK_PACKET_SIZE);
+		std::memset(buffer_cast<uint8_t*>(bulk_buffer), 0xaa, BULK_PACKET_SIZE);
+
+		context.received_count = 0;
+		context.received_bytes = 0;
+
+		send_start = now();
+
+		for (size_t i = 0; i < BULK_PACKET_COUNT; ++i)
+		{
+			alice.async_send_data(bob_endpoint, fscp::CHANNEL_NUMBER_0, buffer(bulk_buffer), &on_simple_result);
+		}
+
+		wait_for_count(context, &bench_context::received_count, BULK_PACKET_COUNT);
+
+		{
+			boost::mutex::scoped_lock lock(context.mutex);
+
+			const double elapsed = elapsed_seconds(send_start, context.last_received_time);
+
+			print_result(suite, "bulk_throughput", (elapsed > 0.0) ? static_cast<double>(context.received_bytes) * 8.0 / elapsed / 1000000.0 : 0.0, "Mbit/s");
+			print_result(suite, "bulk_packet_loss", static_cast<double>(BULK_PACKET_COUNT - context.received_count), "packets");
+		}
+
+		// Round-trip latency: one probe at a time, echoed back by the peer, so a sample never queues behind another.
+		const fscp::SharedBuffer ping_buffer(SMALL_PACKET_SIZE);
+		std::memset(buffer_cast<uint8_t*>(ping_buffer), 0x42, SMALL_PACKET_SIZE);
+
+		context.received_count = 0;
+
+		for (size_t i = 0; i < PING_COUNT; ++i)
+		{
+			alice.set_data_received_callback(boost::bind(&on_echo_data, boost::ref(context), now(), _1, _2, _3, _4));
+
+			alice.async_send_data(bob_endpoint, fscp::CHANNEL_NUMBER_1, buffer(ping_buffer), &on_simple_result);
+
+			if (!wait_for_count(context, &bench_context::received_count, i + 1))
+			{
+				break;
+			}
+		}
+
+		{
+			boost::mutex::scoped_lock lock(context.mutex);
+
+			print_result(suite, "latency_p50", percentile(context.rtt_microseconds, 0.50), "us");
+			print_result(suite, "latency_p99", percentile(context.rtt_microseconds, 0.99), "us");
+		}
+
+		alice.close();
+		bob.close();
+
+		threads.join_all();
+	}
+}
+
+int main()
+{
+	cryptoplus::crypto_initializer crypto_initializer;
+	cryptoplus::algorithms_initializer algorithms_initializer;
+	cryptoplus::error::error_strings_initializer error_strings_initializer;
+
+	try
+	{
+		std::cerr << "Generating benchmark identities..." << std::endl;
+
+		const fscp::identity_store alice_identity = generate_identity("bench_alice");
+		const fscp::identity_store bob_identity = generate_identity("bench_bob");
+
+		std::cout << "suite,metric,value,unit" << std::endl;
+
+		const fscp::cipher_suite_list_type cipher_suites = fscp::get_default_cipher_suites();
+
+		for (fscp::cipher_suite_list_type::const_iterator suite = cipher_suites.begin(); suite != cipher_suites.end(); ++suite)
+		{
+			run_suite(*suite, alice_identity, bob_identity);
+		}
+	}
+	catch (std::exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,251 @@
+/**
+ * \file bench.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A parse and serialization benchmark for kfather.
+ *
+ * Measures DOM parsing, SAX parsing and compact serialization over three
+ * synthetic documents shaped like the JSON the project actually handles: a
+ * small configuration object, a large peers array as produced by the /stats/
+ * web route, and a flat numeric array.
+ *
+ * Human-readable progress goes to the standard error; the results go to the
+ * standard output as a single JSON document, in the same schema as the crypto
+ * microbenchmark, so runs can be tracked across revisions.
+ */
+
+#include <kfather/parser.hpp>
+#include <kfather/formatter.hpp>
+#include <kfather/value.hpp>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace
+{
+	const double MIN_MEASURE_SECONDS = 1.0;
+
+	kfather::array_type g_results;
+
+	boost::posix_time::ptime now()
+	{
+		return boost::posix_time::microsec_clock::universal_time();
+	}
+
+	double elapsed_seconds(const boost::posix_time::ptime& start, const boost::posix_time::ptime& stop)
+	{
+		return static_cast<double>((stop - start).total_microseconds()) / 1000000.0;
+	}
+
+	void add_result(const std::string& name, const std::string& parameter, const std::string& metric, double value, const std::string& unit)
+	{
+		g_results.items.push_back(kfather::object_type {
+			{
+				{"name", name},
+				{"parameter", parameter},
+				{"metric", metric},
+				{"value", value},
+				{"unit", unit}
+			}
+		});
+	}
+
+	/**
+	 * \brief Run op() repeatedly for at least MIN_MEASURE_SECONDS and return the rate, in operations per second.
+	 */
+	template <typename Operation>
+	double measure_rate(Operation op)
+	{
+		size_t iterations = 0;
+
+		const boost::posix_time::ptime start = now();
+		boost::posix_time::ptime stop = start;
+
+		while (elapsed_seconds(start, stop) < MIN_MEASURE_SECONDS)
+		{
+			op();
+
+			++iterations;
+			stop = now();
+		}
+
+		return static_cast<double>(iterations) / elapsed_seconds(start, stop);
+	}
+
+	/**
+	 * \brief A SAX handler that only counts events, so the measured cost is the parser itself.
+	 */
+	class counting_sax_handler : public kfather::sax_handler
+	{
+		public:
+
+			counting_sax_handler() : m_events(0) {}
+
+			void on_object_start() { ++m_events; }
+			void on_key(const kfather::string_type&) { ++m_events; }
+			void on_object_end() { ++m_events; }
+			void on_array_start() { ++m_events; }
+			void on_array_end() { ++m_events; }
+			void on_string(const kfather::string_type&) { ++m_events; }
+			void on_number(kfather::number_type) { ++m_events; }
+			void on_boolean(kfather::boolean_type) { ++m_events; }
+			void on_null() { ++m_events; }
+
+		private:
+
+			size_t m_events;
+	};
+
+	std::string build_configuration_document()
+	{
+		kfather::object_type document;
+
+		document.items["hostname"] = kfather::string_type("gateway.example.net");
+		document.items["listen_on"] = kfather::string_type("0.0.0.0:12000");
+		document.items["enabled"] = kfather::boolean_type(true);
+		document.items["hello_timeout_ms"] = kfather::number_type(3000);
+
+		kfather::array_type contacts;
+
+		for (size_t i = 0; i < 16; ++i)
+		{
+			contacts.items.push_back(kfather::string_type("peer" + boost::lexical_cast<std::string>(i) + ".example.net:12000"));
+		}
+
+		document.items["contacts"] = contacts;
+
+		std::ostringstream oss;
+		kfather::compact_formatter().format(oss, document);
+
+		return oss.str();
+	}
+
+	std::string build_peers_document(size_t peer_count)
+	{
+		kfather::object_type peers;
+
+		for (size_t i = 0; i < peer_count; ++i)
+		{
+			kfather::object_type entry;
+
+			entry.items["tx_bytes"] = kfather::number_type(static_cast<double>(i * 14982));
+			entry.items["tx_packets"] = kfather::number_type(static_cast<double>(i * 17));
+			entry.items["rx_bytes"] = kfather::number_type(static_cast<double>(i * 13217));
+			entry.items["rx_packets"] = kfather::number_type(static_cast<double>(i * 19));
+
+			peers.items["10.0." + boost::lexical_cast<std::string>(i / 250) + "." + boost::lexical_cast<std::string>(i % 250) + ":12000"] = entry;
+		}
+
+		kfather::object_type document;
+		document.items["peers"] = peers;
+
+		std::ostringstream oss;
+		kfather::compact_formatter().format(oss, document);
+
+		return oss.str();
+	}
+
+	std::string build_numbers_document(size_t count)
+	{
+		kfather::array_type numbers;
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			numbers.items.push_back(kfather::number_type(static_cast<double>(i) * 0.125));
+		}
+
+		std::ostringstream oss;
+		kfather::compact_formatter().format(oss, numbers);
+
+		return oss.str();
+	}
+
+	void bench_document(const std::string& parameter, const std::string& document)
+	{
+		std::cerr << "Benchmarking " << parameter << " (" << document.size() << " bytes)..." << std::endl;
+
+		kfather::parser parser;
+
+		// DOM parsing: the whole document materializes as values.
+		{
+			const double rate = measure_rate([&]() {
+				kfather::value_type value;
+
+				if (!parser.parse(value, document))
+				{
+					throw std::runtime_error("DOM parse failed for " + parameter);
+				}
+			});
+
+			add_result("dom_parse", parameter, "rate", rate, "documents/s");
+			add_result("dom_parse", parameter, "throughput", rate * static_cast<double>(document.size()) / 1000000.0, "MB/s");
+		}
+
+		// SAX parsing: no values are built, so this is the raw scanner cost.
+		{
+			const double rate = measure_rate([&]() {
+				counting_sax_handler handler;
+
+				if (!parser.parse(handler, document))
+				{
+					throw std::runtime_error("SAX parse failed for " + parameter);
+				}
+			});
+
+			add_result("sax_parse", parameter, "rate", rate, "documents/s");
+			add_result("sax_parse", parameter, "throughput", rate * static_cast<double>(document.size()) / 1000000.0, "MB/s");
+		}
+
+		// Serialization: parse once, then format repeatedly.
+		{
+			kfather::value_type value;
+
+			if (!parser.parse(value, document))
+			{
+				throw std::runtime_error("Parse failed for " + parameter);
+			}
+
+			const double rate = measure_rate([&]() {
+				std::ostringstream oss;
+
+				kfather::compact_formatter().format(oss, value);
+			});
+
+			add_result("serialize", parameter, "rate", rate, "documents/s");
+			add_result("serialize", parameter, "throughput", rate * static_cast<double>(document.size()) / 1000000.0, "MB/s");
+		}
+	}
+}
+
+int main()
+{
+	try
+	{
+		bench_document("configuration", build_configuration_document());
+		bench_document("peers_1000", build_peers_document(1000));
+		bench_document("numbers_10000", build_numbers_document(10000));
+
+		kfather::compact_formatter().format(
+			std::cout,
+			kfather::object_type {
+				{
+					{"results", g_results}
+				}
+			}
+		);
+
+		std::cout << std::endl;
+	}
+	catch (std::exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
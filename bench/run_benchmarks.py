@@ -0,0 +1,218 @@
+"""
+The benchmark runner.
+
+Runs the benchmark suite, consolidates every measurement into a single JSON
+report and compares it against the checked-in baseline, failing loudly when a
+metric regressed beyond the tolerance.
+
+The baselines are machine-specific: regenerate them on the reference machine
+with --update-baseline after an intentional performance change.
+"""
+
+from __future__ import print_function
+
+import argparse
+import datetime
+import json
+import os
+import subprocess
+import sys
+
+
+# The benchmarks of the regression suite, in execution order. The CSV ones
+# print a header line followed by one row per measurement; the JSON ones print
+# a single {"results": [{name, parameter, metric, value, unit}]} document.
+BENCHMARKS = [
+    {'name': 'fscp', 'binary': 'bench_fscp', 'format': 'csv'},
+    {'name': 'crypto', 'binary': 'bench_crypto', 'format': 'json'},
+    {'name': 'forwarding', 'binary': 'bench_forwarding', 'format': 'csv'},
+    {'name': 'kfather', 'binary': 'bench_kfather', 'format': 'json'},
+]
+
+# CSV columns that parametrize a run without identifying the metric.
+NON_KEY_COLUMNS = frozenset(['operations', 'seconds', 'frames', 'packets', 'matched'])
+
+# Units where smaller numbers are better. Everything else is a rate.
+LOWER_IS_BETTER_UNITS = frozenset(['ns', 'us', 'ms', 'seconds', 'us/op', 'ns/frame', 'io_cpu_us_per_packet'])
+
+
+def lower_is_better(key, unit):
+    if unit in LOWER_IS_BETTER_UNITS:
+        return True
+
+    return any(marker in key for marker in ['latency', '_ns', '_us', '_ms', 'per_packet', 'per_frame'])
+
+
+def parse_csv_output(name, output, metrics):
+    lines = [line.strip() for line in output.splitlines() if line.strip()]
+
+    if not lines:
+        return
+
+    header = lines[0].split(',')
+
+    for line in lines[1:]:
+        row = line.split(',')
+
+        if len(row) != len(header):
+            continue
+
+        if header[-2:] == ['value', 'unit']:
+            # Schema: <key columns...>,metric,value,unit
+            key = '.'.join([name] + row[:-2])
+            value = float(row[-2])
+            unit = row[-1]
+        else:
+            # Schema: <key columns...>,<counts...>,<value column>
+            key_columns = [row[i] for i in range(len(header) - 1) if header[i] not in NON_KEY_COLUMNS]
+            key = '.'.join([name] + key_columns + [header[-1]])
+            value = float(row[-1])
+            unit = header[-1]
+
+        metrics[key] = {'value': value, 'unit': unit}
+
+
+def parse_json_output(name, output, metrics):
+    document = json.loads(output)
+
+    for result in document.get('results', []):
+        key = '.'.join([name, result['name'], result['parameter'], result['metric']])
+        metrics[key] = {'value': float(result['value']), 'unit': result['unit']}
+
+
+def run_benchmarks(bin_dir):
+    metrics = {}
+
+    for benchmark in BENCHMARKS:
+        binary = os.path.join(bin_dir, benchmark['binary'])
+
+        if not os.path.exists(binary):
+            print('Skipping %s: %s does not exist.' % (benchmark['name'], binary), file=sys.stderr)
+            continue
+
+        print('Running %s...' % binary, file=sys.stderr)
+
+        process = subprocess.Popen([binary], stdout=subprocess.PIPE)
+        output, _ = process.communicate()
+
+        if process.returncode != 0:
+            raise RuntimeError('%s exited with status %d' % (binary, process.returncode))
+
+        output = output.decode('utf-8')
+
+        if benchmark['format'] == 'csv':
+            parse_csv_output(benchmark['name'], output, metrics)
+        else:
+            parse_json_output(benchmark['name'], output, metrics)
+
+    return metrics
+
+
+def compare(metrics, baseline_metrics, tolerance):
+    regressions = []
+    missing = []
+
+    for key, baseline_entry in sorted(baseline_metrics.items()):
+        if key not in metrics:
+            missing.append(key)
+            continue
+
+        value = metrics[key]['value']
+        baseline_value = float(baseline_entry['value'])
+
+        if baseline_value == 0:
+            continue
+
+        if lower_is_better(key, metrics[key]['unit']):
+            regressed = value > baseline_value * (1.0 + tolerance)
+        else:
+            regressed = value < baseline_value * (1.0 - tolerance)
+
+        if regressed:
+            regressions.append({
+                'metric': key,
+                'value': value,
+                'baseline': baseline_value,
+                'unit': metrics[key]['unit'],
+                'change': (value - baseline_value) / baseline_value,
+            })
+
+    return regressions, missing
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Run the benchmark suite and compare it against the baseline.')
+    parser.add_argument('--bin-dir', required=True, help='The directory containing the benchmark binaries.')
+    parser.add_argument('--baseline', default=os.path.join(os.path.dirname(__file__), 'baseline.json'), help='The baseline file.')
+    parser.add_argument('--tolerance', type=float, default=None, help='The relative tolerance. Defaults to the value recorded in the baseline file, or 0.25.')
+    parser.add_argument('--output', default=None, help='Write the consolidated JSON report to this file.')
+    parser.add_argument('--update-baseline', action='store_true', help='Record the measured values as the new baseline instead of comparing.')
+    args = parser.parse_args()
+
+    baseline = {'tolerance': 0.25, 'metrics': {}}
+
+    if os.path.exists(args.baseline):
+        with open(args.baseline) as baseline_file:
+            baseline.update(json.load(baseline_file))
+
+    tolerance = args.tolerance if args.tolerance is not None else float(baseline.get('tolerance', 0.25))
+
+    metrics = run_benchmarks(args.bin_dir)
+
+    if args.update_baseline:
+        baseline['metrics'] = metrics
+
+        with open(args.baseline, 'w') as baseline_file:
+            json.dump(baseline, baseline_file, indent=4, sort_keys=True)
+            baseline_file.write('\n')
+
+        print('Recorded %d metrics into %s.' % (len(metrics), args.baseline), file=sys.stderr)
+        return 0
+
+    regressions, missing = compare(metrics, baseline.get('metrics', {}), tolerance)
+
+    report = {
+        'timestamp': datetime.datetime.utcnow().isoformat() + 'Z',
+        'tolerance': tolerance,
+        'baseline': args.baseline,
+        'metrics': metrics,
+        'regressions': regressions,
+        'missing': missing,
+    }
+
+    if args.output:
+        with open(args.output, 'w') as output_file:
+            json.dump(report, output_file, indent=4, sort_keys=True)
+            output_file.write('\n')
+    else:
+        json.dump(report, sys.stdout, indent=4, sort_keys=True)
+        sys.stdout.write('\n')
+
+    if not baseline.get('metrics'):
+        print('No baseline recorded yet: collected %d metrics without comparing. Run with --update-baseline on the reference machine to record one.' % len(metrics), file=sys.stderr)
+        return 0
+
+    for entry in missing:
+        print('Warning: baseline metric %s was not measured.' % entry, file=sys.stderr)
+
+    if regressions:
+        print('', file=sys.stderr)
+        print('PERFORMANCE REGRESSIONS (tolerance %.0f%%):' % (tolerance * 100.0), file=sys.stderr)
+
+        for regression in regressions:
+            print('  %s: %g %s against a baseline of %g (%+.1f%%)' % (
+                regression['metric'],
+                regression['value'],
+                regression['unit'],
+                regression['baseline'],
+                regression['change'] * 100.0,
+            ), file=sys.stderr)
+
+        return 1
+
+    print('All %d baseline metrics within tolerance.' % len(baseline['metrics']), file=sys.stderr)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
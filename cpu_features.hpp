@@ -0,0 +1,187 @@
+/**
+ * \file cpu_features.hpp
+ * \brief Runtime CPU feature detection, shared by all the libraries.
+ *
+ * The features of the running CPU are probed exactly once, on first use, so call sites can bind a function pointer to the best available kernel and pay no per-call feature check afterwards.
+ *
+ * A kernel is only a candidate when the compiler could emit it: the vectorized implementations stay behind their usual compile-time guards and hand a null pointer to select() when they are not compiled in.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#define CPU_FEATURES_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace cpu_features
+{
+	/**
+	 * \brief The features of the running CPU.
+	 */
+	struct features_type
+	{
+		bool sse2; /**< \brief SSE2 is supported. */
+		bool ssse3; /**< \brief SSSE3 is supported. */
+		bool sse4_1; /**< \brief SSE4.1 is supported. */
+		bool avx; /**< \brief AVX is supported, by both the CPU and the operating system. */
+		bool avx2; /**< \brief AVX2 is supported, by both the CPU and the operating system. */
+		bool neon; /**< \brief NEON is supported. */
+	};
+
+	namespace detail
+	{
+#ifdef CPU_FEATURES_X86
+		/**
+		 * \brief Execute the cpuid instruction.
+		 * \param leaf The leaf.
+		 * \param subleaf The subleaf.
+		 * \param registers A variable whose value after the call is the content of eax, ebx, ecx and edx.
+		 * \return true if the leaf is supported.
+		 */
+		inline bool cpuid(uint32_t leaf, uint32_t subleaf, uint32_t (&registers)[4])
+		{
+#if defined(_MSC_VER)
+			int info[4];
+
+			__cpuid(info, 0);
+
+			if (static_cast<uint32_t>(info[0]) < leaf)
+			{
+				return false;
+			}
+
+			__cpuidex(info, static_cast<int>(leaf), static_cast<int>(subleaf));
+
+			registers[0] = static_cast<uint32_t>(info[0]);
+			registers[1] = static_cast<uint32_t>(info[1]);
+			registers[2] = static_cast<uint32_t>(info[2]);
+			registers[3] = static_cast<uint32_t>(info[3]);
+
+			return true;
+#else
+			if (__get_cpuid_max(0, 0) < leaf)
+			{
+				return false;
+			}
+
+			__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+
+			return true;
+#endif
+		}
+
+		/**
+		 * \brief Read the XCR0 register.
+		 * \return The register value.
+		 *
+		 * Must only be called when cpuid reported OSXSAVE support.
+		 */
+		inline uint64_t xgetbv0()
+		{
+#if defined(_MSC_VER)
+			return _xgetbv(0);
+#else
+			uint32_t eax = 0;
+			uint32_t edx = 0;
+
+			// The xgetbv instruction is emitted as raw bytes so the code assembles even with assemblers that predate the mnemonic.
+			__asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a" (eax), "=d" (edx) : "c" (0));
+
+			return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+		}
+#endif
+
+		/**
+		 * \brief Probe the features of the running CPU.
+		 * \return The features.
+		 */
+		inline features_type probe()
+		{
+			features_type features = {};
+
+#ifdef CPU_FEATURES_X86
+			uint32_t registers[4];
+
+			if (cpuid(1, 0, registers))
+			{
+				features.sse2 = ((registers[3] & (1 << 26)) != 0);
+				features.ssse3 = ((registers[2] & (1 << 9)) != 0);
+				features.sse4_1 = ((registers[2] & (1 << 19)) != 0);
+
+				// AVX requires the operating system to save the extended state: OSXSAVE must be set and XCR0 must report that both the XMM and YMM states are enabled.
+				const bool osxsave = ((registers[2] & (1 << 27)) != 0);
+				const bool avx_supported = ((registers[2] & (1 << 28)) != 0);
+
+				if (osxsave && avx_supported && ((xgetbv0() & 0x6) == 0x6))
+				{
+					features.avx = true;
+
+					if (cpuid(7, 0, registers))
+					{
+						features.avx2 = ((registers[1] & (1 << 5)) != 0);
+					}
+				}
+			}
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+			// On ARM the availability of NEON is a property of the target the binary was built for.
+			features.neon = true;
+#endif
+
+			return features;
+		}
+	}
+
+	/**
+	 * \brief Get the features of the running CPU.
+	 * \return The features, probed on the first call and cached afterwards.
+	 */
+	inline const features_type& get()
+	{
+		static const features_type instance = detail::probe();
+
+		return instance;
+	}
+
+	/**
+	 * \brief Select the best available implementation of a function.
+	 * \param generic The portable implementation. Cannot be null.
+	 * \param sse2 The SSE2 implementation, or null if none was compiled in.
+	 * \param avx2 The AVX2 implementation, or null if none was compiled in.
+	 * \param neon The NEON implementation, or null if none was compiled in.
+	 * \return The most specialized non-null implementation the running CPU supports.
+	 *
+	 * Bind the result once - typically into a namespace-level constant - and call through it: the feature probe then happens at binding time only.
+	 */
+	template <typename FunctionPointerType>
+	inline FunctionPointerType select(FunctionPointerType generic, FunctionPointerType sse2 = FunctionPointerType(), FunctionPointerType avx2 = FunctionPointerType(), FunctionPointerType neon = FunctionPointerType())
+	{
+		const features_type& features = get();
+
+		if ((avx2 != FunctionPointerType()) && features.avx2)
+		{
+			return avx2;
+		}
+
+		if ((sse2 != FunctionPointerType()) && features.sse2)
+		{
+			return sse2;
+		}
+
+		if ((neon != FunctionPointerType()) && features.neon)
+		{
+			return neon;
+		}
+
+		return generic;
+	}
+}
@@ -47,9 +47,11 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <iostream>
 
 #include <boost/asio.hpp>
+#include <boost/optional.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/weak_ptr.hpp>
 #include <boost/function.hpp>
@@ -136,6 +138,13 @@ namespace asiotap
 					{
 					}
 
+					entry_type_impl(base_route_manager& route_manager, const route_type& _route, bool success) :
+						m_route_manager(route_manager),
+						m_route(_route),
+						m_success(success)
+					{
+					}
+
 					base_route_manager& m_route_manager;
 					route_type m_route;
 					bool m_success;
@@ -266,8 +275,192 @@ namespace asiotap
 				return entry;
 			}
 
+			/**
+			 * \brief Get route entries for several routes at once.
+			 * \param routes The routes.
+			 * \return The entries, in the same order as the routes.
+			 *
+			 * The routes that have no live entry yet are applied as a single transaction, which is much faster than requesting the entries one by one when the underlying system supports batched registrations. The transaction is all-or-nothing: if it fails, the failure handler is called for every route of the batch and the returned entries are inert.
+			 */
+			std::vector<entry_type> get_route_entries(const std::vector<route_type>& routes)
+			{
+				std::vector<entry_type> entries;
+				entries.reserve(routes.size());
+
+				std::vector<route_type> missing_routes;
+
+				for (auto&& route : routes)
+				{
+					if (!m_entry_table[route].lock())
+					{
+						missing_routes.push_back(route);
+					}
+				}
+
+				bool success = true;
+
+				try
+				{
+					static_cast<RouteManagerType*>(this)->register_routes(missing_routes);
+
+					if (m_route_registration_success_handler)
+					{
+						for (auto&& route : missing_routes)
+						{
+							m_route_registration_success_handler(route);
+						}
+					}
+				}
+				catch (boost::system::system_error& ex)
+				{
+					success = false;
+
+					if (m_route_registration_failure_handler)
+					{
+						for (auto&& route : missing_routes)
+						{
+							m_route_registration_failure_handler(route, ex);
+						}
+					}
+				}
+
+				for (auto&& route : routes)
+				{
+					entry_type entry = m_entry_table[route].lock();
+
+					if (!entry)
+					{
+						entry = boost::shared_ptr<entry_type_impl>(new entry_type_impl(*this, route, success));
+
+						m_entry_table[route] = entry;
+					}
+
+					entries.push_back(entry);
+				}
+
+				return entries;
+			}
+
+			/**
+			 * \brief Release route entries, unregistering the expiring routes as one batch.
+			 * \param entries The entries to release. The vector is cleared.
+			 *
+			 * Entries that are still referenced elsewhere are simply released. The routes whose last reference was held by entries are unregistered as a single transaction, which is much faster than letting the entries expire one by one when the underlying system supports batched unregistrations.
+			 */
+			void release_route_entries(std::vector<entry_type>& entries)
+			{
+				std::vector<route_type> expiring_routes;
+				expiring_routes.reserve(entries.size());
+
+				for (auto&& entry : entries)
+				{
+					if (entry && entry.unique() && entry->m_success)
+					{
+						// Disarm the entry's destructor: its route is unregistered below, as part of the batch.
+						entry->m_success = false;
+
+						expiring_routes.push_back(entry->m_route);
+					}
+				}
+
+				entries.clear();
+
+				if (expiring_routes.empty())
+				{
+					return;
+				}
+
+				try
+				{
+					static_cast<RouteManagerType*>(this)->unregister_routes(expiring_routes);
+
+					if (m_route_unregistration_success_handler)
+					{
+						for (auto&& route : expiring_routes)
+						{
+							m_route_unregistration_success_handler(route);
+						}
+					}
+				}
+				catch (boost::system::system_error& ex)
+				{
+					if (m_route_unregistration_failure_handler)
+					{
+						for (auto&& route : expiring_routes)
+						{
+							m_route_unregistration_failure_handler(route, ex);
+						}
+					}
+				}
+			}
+
 		protected:
 
+			/**
+			 * \brief Register several routes as one transaction.
+			 * \param routes The routes.
+			 *
+			 * This generic fallback applies the routes one at a time and removes the ones it applied if any registration fails. Derived managers shadow it when the system offers a real batched transaction.
+			 */
+			void register_routes(const std::vector<route_type>& routes)
+			{
+				size_t applied = 0;
+
+				try
+				{
+					for (; applied < routes.size(); ++applied)
+					{
+						static_cast<RouteManagerType*>(this)->register_route(routes[applied]);
+					}
+				}
+				catch (boost::system::system_error&)
+				{
+					while (applied > 0)
+					{
+						try
+						{
+							static_cast<RouteManagerType*>(this)->unregister_route(routes[--applied]);
+						}
+						catch (boost::system::system_error&)
+						{
+						}
+					}
+
+					throw;
+				}
+			}
+
+			/**
+			 * \brief Unregister several routes as one transaction.
+			 * \param routes The routes.
+			 *
+			 * This generic fallback removes the routes one at a time, attempting every one of them; the first error, if any, is rethrown at the end. Derived managers shadow it when the system offers a real batched transaction.
+			 */
+			void unregister_routes(const std::vector<route_type>& routes)
+			{
+				boost::optional<boost::system::system_error> failure;
+
+				for (auto&& route : routes)
+				{
+					try
+					{
+						static_cast<RouteManagerType*>(this)->unregister_route(route);
+					}
+					catch (boost::system::system_error& ex)
+					{
+						if (!failure)
+						{
+							failure = ex;
+						}
+					}
+				}
+
+				if (failure)
+				{
+					throw *failure;
+				}
+			}
+
 			typedef std::map<route_type, boost::weak_ptr<entry_type_impl>> entry_table_type;
 
 		private:
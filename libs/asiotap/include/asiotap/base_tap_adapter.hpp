@@ -202,6 +202,23 @@ namespace asiotap
 				return m_mtu;
 			}
 
+			/**
+			 * \brief Get the recommended per-frame buffer size for reads.
+			 * \return The size, in bytes.
+			 *
+			 * The size is derived from the device MTU, with room for the ethernet framing, so that per-frame buffers match the device instead of assuming the worst case. When the MTU is not known yet (the device is not open), the historical 65536 bytes value applies.
+			 */
+			size_t recommended_frame_size() const
+			{
+				if (m_mtu == 0)
+				{
+					return 65536;
+				}
+
+				// Ethernet header, 802.1Q tag and FCS.
+				return m_mtu + 22;
+			}
+
 			/**
 			 * \brief Get the device ethernet address.
 			 * \return The device ethernet address.
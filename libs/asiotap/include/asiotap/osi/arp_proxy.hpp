@@ -53,6 +53,7 @@
 #include "ethernet_address.hpp"
 
 #include <boost/optional.hpp>
+#include <boost/array.hpp>
 
 #include <map>
 
@@ -125,6 +126,8 @@ namespace asiotap
 				 * \param arp_helper The ARP layer.
 				 * \param response_buffer The buffer to write the response to.
 				 * \return The buffer that contains the answer, if there is one.
+				 *
+				 * The reply for a given address is built only once and then served from a cache, with just the requester-specific fields patched. The callback is therefore expected to answer deterministically for a given address for as long as it is registered.
 				 */
 				boost::optional<boost::asio::const_buffer> process_frame(const_helper<ethernet_frame> ethernet_helper, const_helper<arp_frame> arp_helper, boost::asio::mutable_buffer response_buffer) const;
 
@@ -132,12 +135,32 @@ namespace asiotap
 
 				typedef std::map<boost::asio::ip::address_v4, ethernet_address_type> entry_map_type;
 
+				/**
+				 * \brief A fully-built reply frame, cached for a requested address.
+				 */
+				struct cached_reply_type
+				{
+					cached_reply_type() :
+						frame_size(0)
+					{
+					}
+
+					boost::array<uint8_t, 64> frame_data;
+					size_t frame_size;
+				};
+
+				typedef std::map<boost::asio::ip::address_v4, cached_reply_type> reply_cache_type;
+
 				entry_map_type m_entry_map;
 				arp_request_callback_type m_arp_request_callback;
+				mutable reply_cache_type m_reply_cache;
 		};
 
 		inline bool proxy<arp_frame>::add_entry(const entry_type& entry)
 		{
+			// Any cached reply for this address may be stale now.
+			m_reply_cache.erase(entry.first);
+
 			return m_entry_map.insert(entry).second;
 		}
 
@@ -148,11 +171,16 @@ namespace asiotap
 
 		inline bool proxy<arp_frame>::remove_entry(const boost::asio::ip::address_v4& logical_address)
 		{
+			m_reply_cache.erase(logical_address);
+
 			return (m_entry_map.erase(logical_address) > 0);
 		}
 
 		inline void proxy<arp_frame>::set_arp_request_callback(arp_request_callback_type callback)
 		{
+			// The cached replies may depend on the previous callback's answers.
+			m_reply_cache.clear();
+
 			m_arp_request_callback = callback;
 		}
 	}
@@ -62,6 +62,84 @@ namespace asiotap
 		{
 			typedef void type; /**< Filter type. */
 		};
+
+		/**
+		 * \brief A compile-time fused filter chain.
+		 *
+		 * Unlike complex_filter, which wires the layers together at runtime through stored callbacks, the fused filter instantiates the whole chain as one static parse function: every layer match, validity check and payload extraction is a direct call the compiler can inline, and no handler registration or allocation takes place.
+		 *
+		 * The dynamic filter API remains the right tool when the set of handlers depends on the configuration; the fused chain is for hot paths where the chain is known at compile time.
+		 */
+		template <typename FirstOSIFrameType, typename... InnerOSIFrameTypes>
+		class fused_filter
+		{
+			public:
+
+				/**
+				 * \brief Parse the specified buffer through the whole chain.
+				 * \param buf The buffer to parse.
+				 * \param handler The handler, called with the innermost frame helper when every layer matched and checked out.
+				 * \return true if the handler was called.
+				 */
+				template <typename HandlerType>
+				static bool parse(boost::asio::const_buffer buf, HandlerType&& handler)
+				{
+					try
+					{
+						const_helper<FirstOSIFrameType> helper(buf);
+
+						if (!check_frame(helper))
+						{
+							return false;
+						}
+
+						return fused_filter_parser<FirstOSIFrameType, InnerOSIFrameTypes...>::parse(helper, handler);
+					}
+					catch (std::logic_error&)
+					{
+						return false;
+					}
+				}
+
+			private:
+
+				template <typename OSIFrameType, typename... OSIFrameTypes>
+				struct fused_filter_parser;
+
+				template <typename OSIFrameType>
+				struct fused_filter_parser<OSIFrameType>
+				{
+					template <typename HandlerType>
+					static bool parse(const_helper<OSIFrameType> helper, HandlerType& handler)
+					{
+						handler(helper);
+
+						return true;
+					}
+				};
+
+				template <typename OSIFrameType, typename NextOSIFrameType, typename... OSIFrameTypes>
+				struct fused_filter_parser<OSIFrameType, NextOSIFrameType, OSIFrameTypes...>
+				{
+					template <typename HandlerType>
+					static bool parse(const_helper<OSIFrameType> helper, HandlerType& handler)
+					{
+						if (!frame_parent_match<NextOSIFrameType, OSIFrameType>(helper))
+						{
+							return false;
+						}
+
+						const_helper<NextOSIFrameType> next_helper(helper.payload());
+
+						if (!check_frame(next_helper))
+						{
+							return false;
+						}
+
+						return fused_filter_parser<NextOSIFrameType, OSIFrameTypes...>::parse(next_helper, handler);
+					}
+				};
+		};
 	}
 }
 
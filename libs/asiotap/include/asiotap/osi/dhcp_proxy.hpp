@@ -154,6 +154,8 @@ namespace asiotap
 				 * \param dhcp_helper The DHCP layer.
 				 * \param response_buffer The buffer to write the response to.
 				 * \return The buffer that contains the answer, if there is one.
+				 *
+				 * The reply for a given lease and message type is built only once and then served from a preserialized template, with just the requester-specific fields and the checksums patched in place. Steady-state processing thus performs no allocation.
 				 */
 				boost::optional<boost::asio::const_buffer> process_frame(const_helper<ethernet_frame> ethernet_helper, const_helper<ipv4_frame> ipv4_helper, const_helper<udp_frame> udp_helper, const_helper<bootp_frame> bootp_helper, const_helper<dhcp_frame> dhcp_helper, boost::asio::mutable_buffer response_buffer) const;
 
@@ -161,29 +163,73 @@ namespace asiotap
 
 				typedef std::map<ethernet_address_type, ipv4_address_netmask_type> entry_map_type;
 
+				/**
+				 * \brief The possible kinds of cached replies.
+				 */
+				enum reply_kind_type
+				{
+					reply_kind_offer = 0,
+					reply_kind_acknowledgment = 1,
+					reply_kind_negative_acknowledgment = 2,
+					reply_kind_informational_acknowledgment = 3,
+					reply_kind_count = 4
+				};
+
+				/**
+				 * \brief A fully-built reply frame, cached for a lease.
+				 */
+				struct cached_reply_type
+				{
+					cached_reply_type() :
+						frame_size(0),
+						subnet_mask_requests(0)
+					{
+					}
+
+					boost::array<uint8_t, 384> frame_data;
+					size_t frame_size;
+					size_t subnet_mask_requests;
+				};
+
+				typedef boost::array<cached_reply_type, reply_kind_count> cached_reply_set_type;
+				typedef std::map<ethernet_address_type, cached_reply_set_type> reply_cache_type;
+
 				ethernet_address_type m_hardware_address;
 				boost::asio::ip::address_v4 m_software_address;
 				boost::posix_time::time_duration m_lease_time;
 				entry_map_type m_entry_map;
+				mutable reply_cache_type m_reply_cache;
 		};
 
 		inline void proxy<dhcp_frame>::set_hardware_address(const ethernet_address_type& hardware_address)
 		{
+			// The cached replies embed the hardware address.
+			m_reply_cache.clear();
+
 			m_hardware_address = hardware_address;
 		}
 
 		inline void proxy<dhcp_frame>::set_software_address(const boost::asio::ip::address_v4& software_address)
 		{
+			// The cached replies embed the software address.
+			m_reply_cache.clear();
+
 			m_software_address = software_address;
 		}
 
 		inline void proxy<dhcp_frame>::set_lease_time(boost::posix_time::time_duration lease_time)
 		{
+			// The cached replies embed the lease time.
+			m_reply_cache.clear();
+
 			m_lease_time = lease_time;
 		}
 
 		inline bool proxy<dhcp_frame>::add_entry(const entry_type& entry)
 		{
+			// Any cached reply for this lease may be stale now.
+			m_reply_cache.erase(entry.first);
+
 			return m_entry_map.insert(entry).second;
 		}
 
@@ -196,6 +242,8 @@ namespace asiotap
 
 		inline bool proxy<dhcp_frame>::remove_entry(const ethernet_address_type& hardware_address)
 		{
+			m_reply_cache.erase(hardware_address);
+
 			return (m_entry_map.erase(hardware_address) > 0);
 		}
 	}
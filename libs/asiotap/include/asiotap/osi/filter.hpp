@@ -113,8 +113,36 @@ namespace asiotap
 				 */
 				void clear_last_helper() const;
 
+				/**
+				 * \brief Set whether checksum filters added to this filter verify checksums.
+				 * \param enabled The verification policy.
+				 *
+				 * Verification is enabled by default. Disabling it is meant for frames read from the local TAP device, whose checksums are locally generated or legitimately absent when checksum offloading is enabled; frames received from the network should keep it enabled.
+				 */
+				void set_checksum_verification_enabled(bool enabled)
+				{
+					m_checksum_verification_enabled = enabled;
+				}
+
+				/**
+				 * \brief Check whether checksum filters added to this filter verify checksums.
+				 * \return The verification policy.
+				 */
+				bool checksum_verification_enabled() const
+				{
+					return m_checksum_verification_enabled;
+				}
+
 			protected:
 
+				/**
+				 * \brief Constructor.
+				 */
+				_base_filter() :
+					m_checksum_verification_enabled(true)
+				{
+				}
+
 				/**
 				 * \brief Do the parsing.
 				 * \param buf buffer to parse.
@@ -139,6 +167,7 @@ namespace asiotap
 				std::vector<frame_filter_callback> m_filters;
 				std::vector<frame_handler_callback> m_handlers;
 				mutable boost::optional<const_helper<frame_type> > m_last_helper;
+				bool m_checksum_verification_enabled;
 		};
 
 		/**
@@ -120,7 +120,11 @@ namespace asiotap
 		template <typename ParentFilterType>
 		inline void filter<icmp_frame, ParentFilterType>::add_checksum_filter()
 		{
-			this->add_filter(checksum_filter);
+			const _base_filter<icmp_frame>* const self = this;
+
+			this->add_filter([self] (const_helper<icmp_frame> helper) {
+				return (!self->checksum_verification_enabled() || checksum_filter(helper));
+			});
 		}
 
 		template <>
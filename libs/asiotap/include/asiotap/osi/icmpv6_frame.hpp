@@ -0,0 +1,136 @@
+/*
+ * libasiotap - A portable TAP adapter extension for Boost::ASIO.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libasiotap.
+ *
+ * libasiotap is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libasiotap is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libasiotap in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file icmpv6_frame.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An ICMPv6 neighbor discovery frame structure.
+ */
+
+#ifndef ASIOTAP_OSI_ICMPV6_FRAME_HPP
+#define ASIOTAP_OSI_ICMPV6_FRAME_HPP
+
+#include "frame.hpp"
+
+namespace asiotap
+{
+	namespace osi
+	{
+		/**
+		 * \brief The ICMPv6 protocol.
+		 */
+		const uint8_t ICMPV6_PROTOCOL = 0x3A;
+
+		/**
+		 * \brief The neighbor solicitation message type.
+		 */
+		const uint8_t ICMPV6_ND_NEIGHBOR_SOLICITATION = 0x87;
+
+		/**
+		 * \brief The neighbor advertisement message type.
+		 */
+		const uint8_t ICMPV6_ND_NEIGHBOR_ADVERTISEMENT = 0x88;
+
+		/**
+		 * \brief The source link-layer address option type.
+		 */
+		const uint8_t ICMPV6_ND_OPTION_SOURCE_LINK_LAYER_ADDRESS = 0x01;
+
+		/**
+		 * \brief The target link-layer address option type.
+		 */
+		const uint8_t ICMPV6_ND_OPTION_TARGET_LINK_LAYER_ADDRESS = 0x02;
+
+		/**
+		 * \brief The size of a link-layer address option, for ethernet addresses.
+		 */
+		const size_t ICMPV6_ND_LINK_LAYER_OPTION_SIZE = 8;
+
+		/**
+		 * \brief The router flag.
+		 */
+		const uint32_t ICMPV6_ND_FLAG_ROUTER = 0x80000000;
+
+		/**
+		 * \brief The solicited flag.
+		 */
+		const uint32_t ICMPV6_ND_FLAG_SOLICITED = 0x40000000;
+
+		/**
+		 * \brief The override flag.
+		 */
+		const uint32_t ICMPV6_ND_FLAG_OVERRIDE = 0x20000000;
+
+#ifdef MSV
+#pragma pack(push, 1)
+#endif
+
+		/**
+		 * \brief An ICMPv6 neighbor discovery frame structure.
+		 *
+		 * This is the common layout of the neighbor solicitation and neighbor advertisement messages; the options follow the target address.
+		 */
+		struct icmpv6_frame
+		{
+			uint8_t type; /**< ICMPv6 message type. */
+			uint8_t code; /**< Error code. */
+			uint16_t checksum; /**< The checksum. */
+			uint32_t flags_reserved; /**< The flags and reserved bits. */
+			struct in6_addr target; /**< Target address */
+		} PACKED;
+
+		/**
+		 * \brief The ICMPv6 pseudo-header structure, used for checksum computations.
+		 */
+		struct icmpv6_pseudo_header
+		{
+			struct in6_addr ipv6_source; /**< Source IPv6 address */
+			struct in6_addr ipv6_destination; /**< Destination IPv6 address */
+			uint32_t upper_layer_length; /**< The upper-layer payload length */
+			uint16_t reserved; /**< 16 bits reserved field (must be zero) */
+			uint8_t reserved2; /**< 8 bits reserved field (must be zero) */
+			uint8_t ipv6_next_header; /**< The IPv6 next header */
+		} PACKED;
+
+#ifdef MSV
+#pragma pack(pop)
+#endif
+	}
+}
+
+#endif /* ASIOTAP_OSI_ICMPV6_FRAME_HPP */
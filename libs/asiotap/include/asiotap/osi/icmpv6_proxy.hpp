@@ -0,0 +1,206 @@
+/*
+ * libasiotap - A portable TAP adapter extension for Boost::ASIO.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libasiotap.
+ *
+ * libasiotap is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libasiotap is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libasiotap in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file icmpv6_proxy.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An ICMPv6 neighbor discovery proxy class.
+ */
+
+#ifndef ASIOTAP_OSI_ICMPV6_PROXY_HPP
+#define ASIOTAP_OSI_ICMPV6_PROXY_HPP
+
+#include "proxy.hpp"
+
+#include "ethernet_filter.hpp"
+#include "ipv6_filter.hpp"
+#include "icmpv6_filter.hpp"
+#include "complex_filter.hpp"
+#include "ethernet_address.hpp"
+
+#include <boost/optional.hpp>
+#include <boost/array.hpp>
+
+#include <map>
+
+namespace asiotap
+{
+	namespace osi
+	{
+		/**
+		 * \brief Get the solicited-node multicast address of an IPv6 address.
+		 * \param value The address.
+		 * \return The solicited-node multicast address, that is ff02::1:ff00:0/104 with the last 24 bits of the address.
+		 *
+		 * Neighbor solicitations for a proxied address are sent to its solicited-node multicast group: callers that filter or subscribe to multicast groups should do so for this address.
+		 */
+		inline boost::asio::ip::address_v6 solicited_node_address(const boost::asio::ip::address_v6& value)
+		{
+			const boost::asio::ip::address_v6::bytes_type bytes = value.to_bytes();
+			const boost::asio::ip::address_v6::bytes_type result = {{ 0xff, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xff, bytes[13], bytes[14], bytes[15] }};
+
+			return boost::asio::ip::address_v6(result);
+		}
+
+		/**
+		 * \brief An ICMPv6 neighbor discovery proxy class.
+		 */
+		template <>
+		class proxy<icmpv6_frame> : public _base_proxy<icmpv6_frame>
+		{
+			public:
+
+				/**
+				 * \brief The Ethernet address type.
+				 */
+				typedef ethernet_address ethernet_address_type;
+
+				/**
+				 * \brief The entry type.
+				 */
+				typedef std::pair<boost::asio::ip::address_v6, ethernet_address_type> entry_type;
+
+				/**
+				 * \brief The neighbor solicitation callback type.
+				 */
+				typedef boost::function<bool (const boost::asio::ip::address_v6&, ethernet_address_type&)> neighbor_solicitation_callback_type;
+
+				/**
+				 * \brief Create an ICMPv6 neighbor discovery proxy.
+				 */
+				proxy() :
+					m_neighbor_solicitation_callback(0)
+				{
+				}
+
+				/**
+				 * \brief Add a proxy entry.
+				 * \param entry The entry to add.
+				 * \return If an entry for the specified logical address already exists, nothing is done and the call returns false. Otherwise, the call returns true.
+				 */
+				bool add_entry(const entry_type& entry);
+
+				/**
+				 * \brief Add a proxy entry.
+				 * \param logical_address The logical address.
+				 * \param hardware_address The hardware address.
+				 * \return If an entry for the specified logical address already exists, nothing is done and the call returns false. Otherwise, the call returns true.
+				 */
+				bool add_entry(const boost::asio::ip::address_v6& logical_address, const ethernet_address_type& hardware_address);
+
+				/**
+				 * \brief Delete a proxy entry.
+				 * \param logical_address The logical address.
+				 * \return If an entry was deleted, true is returned. Otherwise, the call returns false.
+				 */
+				bool remove_entry(const boost::asio::ip::address_v6& logical_address);
+
+				/**
+				 * \brief Set the callback function when a neighbor solicitation is received.
+				 * \param callback The callback function.
+				 */
+				void set_neighbor_solicitation_callback(neighbor_solicitation_callback_type callback);
+
+				/**
+				 * \brief Process a frame.
+				 * \param ethernet_helper The ethernet layer.
+				 * \param ipv6_helper The IPv6 layer.
+				 * \param icmpv6_helper The ICMPv6 layer.
+				 * \param response_buffer The buffer to write the response to.
+				 * \return The buffer that contains the answer, if there is one.
+				 *
+				 * Solicitations are matched on the target address they carry, so those sent to the target's solicited-node multicast group are answered just like unicast ones. The advertisement for a given address is built only once and then served from a cache, with just the requester-specific fields patched and the checksum recomputed. The callback is therefore expected to answer deterministically for a given address for as long as it is registered.
+				 */
+				boost::optional<boost::asio::const_buffer> process_frame(const_helper<ethernet_frame> ethernet_helper, const_helper<ipv6_frame> ipv6_helper, const_helper<icmpv6_frame> icmpv6_helper, boost::asio::mutable_buffer response_buffer) const;
+
+			private:
+
+				typedef std::map<boost::asio::ip::address_v6, ethernet_address_type> entry_map_type;
+
+				/**
+				 * \brief A fully-built advertisement frame, cached for a solicited address.
+				 */
+				struct cached_reply_type
+				{
+					cached_reply_type() :
+						frame_size(0)
+					{
+					}
+
+					boost::array<uint8_t, 96> frame_data;
+					size_t frame_size;
+				};
+
+				typedef std::map<boost::asio::ip::address_v6, cached_reply_type> reply_cache_type;
+
+				entry_map_type m_entry_map;
+				neighbor_solicitation_callback_type m_neighbor_solicitation_callback;
+				mutable reply_cache_type m_reply_cache;
+		};
+
+		inline bool proxy<icmpv6_frame>::add_entry(const entry_type& entry)
+		{
+			// Any cached advertisement for this address may be stale now.
+			m_reply_cache.erase(entry.first);
+
+			return m_entry_map.insert(entry).second;
+		}
+
+		inline bool proxy<icmpv6_frame>::add_entry(const boost::asio::ip::address_v6& logical_address, const ethernet_address_type& hardware_address)
+		{
+			return add_entry(std::make_pair(logical_address, hardware_address));
+		}
+
+		inline bool proxy<icmpv6_frame>::remove_entry(const boost::asio::ip::address_v6& logical_address)
+		{
+			m_reply_cache.erase(logical_address);
+
+			return (m_entry_map.erase(logical_address) > 0);
+		}
+
+		inline void proxy<icmpv6_frame>::set_neighbor_solicitation_callback(neighbor_solicitation_callback_type callback)
+		{
+			// The cached advertisements may depend on the previous callback's answers.
+			m_reply_cache.clear();
+
+			m_neighbor_solicitation_callback = callback;
+		}
+	}
+}
+
+#endif /* ASIOTAP_ICMPV6_PROXY_HPP */
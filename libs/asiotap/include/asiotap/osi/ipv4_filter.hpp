@@ -118,7 +118,11 @@ namespace asiotap
 
 		inline void filter<ipv4_frame>::add_checksum_filter()
 		{
-			this->add_filter(check_ipv4_checksum);
+			const _base_filter<ipv4_frame>* const self = this;
+
+			this->add_filter([self] (const_helper<ipv4_frame> helper) {
+				return (!self->checksum_verification_enabled() || check_ipv4_checksum(helper));
+			});
 		}
 
 		template <typename ParentFilterType>
@@ -129,7 +133,11 @@ namespace asiotap
 		template <typename ParentFilterType>
 		inline void filter<ipv4_frame, ParentFilterType>::add_checksum_filter()
 		{
-			this->add_filter(check_ipv4_checksum);
+			const _base_filter<ipv4_frame>* const self = this;
+
+			this->add_filter([self] (const_helper<ipv4_frame> helper) {
+				return (!self->checksum_verification_enabled() || check_ipv4_checksum(helper));
+			});
 		}
 
 		template <>
@@ -121,7 +121,11 @@ namespace asiotap
 		template <typename ParentFilterType>
 		inline void filter<udp_frame, ParentFilterType>::add_checksum_bridge_filter()
 		{
-			this->add_bridge_filter(checksum_bridge_filter);
+			const _base_filter<udp_frame>* const self = this;
+
+			this->add_bridge_filter([self] (const_helper<typename ParentFilterType::frame_type> parent_helper, const_helper<udp_frame> helper) {
+				return (!self->checksum_verification_enabled() || checksum_bridge_filter(parent_helper, helper));
+			});
 		}
 
 		template <>
@@ -0,0 +1,165 @@
+/*
+ * libasiotap - A portable TAP adapter extension for Boost::ASIO.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libasiotap.
+ *
+ * libasiotap is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libasiotap is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libasiotap in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+
+/**
+ * \file posix_io_uring_engine.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An io_uring I/O engine for POSIX descriptors.
+ */
+
+#ifndef ASIOTAP_POSIX_IO_URING_ENGINE_HPP
+#define ASIOTAP_POSIX_IO_URING_ENGINE_HPP
+
+#include <map>
+
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <stdint.h>
+
+namespace asiotap
+{
+	/**
+	 * \brief An io_uring-backed asynchronous I/O engine for a single descriptor.
+	 *
+	 * When the running kernel supports it, reads and writes are submitted to an io_uring instead of going through the reactor, saving one readiness wake-up and one syscall per frame. Completions are signaled through an eventfd registered on the ring, which is watched with the surrounding io_service, so the handlers run on the usual io_service threads and no extra thread is needed.
+	 *
+	 * open() returns false when the kernel or the build lacks io_uring support; the caller is expected to fall back to the plain descriptor path in that case.
+	 */
+	class posix_io_uring_engine
+	{
+		public:
+
+			/**
+			 * \brief The I/O handler type.
+			 */
+			typedef boost::function<void (const boost::system::error_code&, size_t)> io_handler_type;
+
+			/**
+			 * \brief Create a new engine.
+			 * \param _io_service The io_service to attach to.
+			 */
+			posix_io_uring_engine(boost::asio::io_service& _io_service);
+
+			/**
+			 * \brief Destroy the engine.
+			 */
+			~posix_io_uring_engine();
+
+			posix_io_uring_engine(const posix_io_uring_engine&) = delete;
+			posix_io_uring_engine& operator=(const posix_io_uring_engine&) = delete;
+
+			/**
+			 * \brief Set up the ring for the specified descriptor.
+			 * \param fd The descriptor to perform I/O on. Not owned by the engine.
+			 * \param entries The submission queue depth.
+			 * \return true on success, false when io_uring is not available.
+			 */
+			bool open(int fd, unsigned int entries);
+
+			/**
+			 * \brief Check whether the ring is set up.
+			 * \return true if open() succeeded.
+			 */
+			bool is_open() const
+			{
+				return (m_ring_fd >= 0);
+			}
+
+			/**
+			 * \brief Tear the ring down.
+			 *
+			 * Pending operations are failed with boost::asio::error::operation_aborted.
+			 */
+			void close();
+
+			/**
+			 * \brief Submit an asynchronous read.
+			 * \param buffer The buffer to read into. Must stay valid until the handler is called.
+			 * \param handler The handler to call upon completion.
+			 */
+			void async_read(boost::asio::mutable_buffer buffer, io_handler_type handler);
+
+			/**
+			 * \brief Submit an asynchronous write.
+			 * \param buffer The buffer to write from. Must stay valid until the handler is called.
+			 * \param handler The handler to call upon completion.
+			 */
+			void async_write(boost::asio::const_buffer buffer, io_handler_type handler);
+
+		private:
+
+			void submit(uint8_t opcode, const void* addr, unsigned int len, io_handler_type handler);
+			void await_completions();
+			void handle_eventfd_readable(const boost::system::error_code& ec);
+
+			typedef std::map<uint64_t, io_handler_type> pending_operation_map;
+
+			boost::asio::io_service& m_io_service;
+			boost::asio::posix::stream_descriptor m_eventfd;
+			int m_ring_fd;
+			int m_target_fd;
+
+			// The raw ring mappings. The kernel-defined structures only exist in the implementation file, so the pointers are kept untyped here.
+			void* m_sq_ring;
+			size_t m_sq_ring_size;
+			void* m_cq_ring;
+			size_t m_cq_ring_size;
+			void* m_sqes;
+			size_t m_sqes_size;
+
+			// The ring geometry, copied out of the setup parameters.
+			unsigned int m_sq_entries;
+			unsigned int m_sq_mask;
+			uint32_t m_sq_head_offset;
+			uint32_t m_sq_tail_offset;
+			uint32_t m_sq_array_offset;
+			unsigned int m_cq_mask;
+			uint32_t m_cq_head_offset;
+			uint32_t m_cq_tail_offset;
+			uint32_t m_cqes_offset;
+
+			boost::mutex m_mutex;
+			uint64_t m_next_operation_id;
+			pending_operation_map m_pending_operations;
+	};
+}
+
+#endif /* ASIOTAP_POSIX_IO_URING_ENGINE_HPP */
@@ -87,7 +87,9 @@ namespace asiotap
 		protected:
 
 			void register_route(const route_type& route);
+			void register_routes(const std::vector<route_type>& routes);
 			void unregister_route(const route_type& route);
+			void unregister_routes(const std::vector<route_type>& routes);
 
 		friend class base_route_manager<posix_route_manager, posix_routing_table_entry>;
 
@@ -48,9 +48,13 @@
 #include "../base_tap_adapter.hpp"
 
 #include "posix_route_manager.hpp"
+#include "posix_io_uring_engine.hpp"
 
 #include <map>
 #include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
 
 namespace asiotap
 {
@@ -72,7 +76,11 @@ namespace asiotap
 			 */
 			posix_tap_adapter(boost::asio::io_service& _io_service, tap_adapter_layer _layer) :
 				base_tap_adapter(_io_service, _layer),
-				m_route_manager(_io_service)
+				m_route_manager(_io_service),
+				m_io_uring_enabled(true),
+				m_offload_enabled(false),
+				m_vnet_header_length(0),
+				m_queue_count(1)
 			{}
 
 			/**
@@ -124,11 +132,170 @@ namespace asiotap
 			 */
 			void open(const std::string& name = "");
 
+			/**
+			 * \brief Enable or disable the io_uring I/O backend.
+			 * \param enabled The enabled state. Must be set before open() to take effect.
+			 *
+			 * The backend is enabled by default, but is only used when open() finds kernel support for it: otherwise the plain descriptor path applies.
+			 */
+			void set_io_uring_enabled(bool enabled)
+			{
+				m_io_uring_enabled = enabled;
+			}
+
+			/**
+			 * \brief Check whether the io_uring I/O backend is in use.
+			 * \return true if the I/O goes through an io_uring.
+			 */
+			bool io_uring_active() const
+			{
+				return static_cast<bool>(m_io_engine);
+			}
+
+			/**
+			 * \brief Enable or disable segmentation offload negotiation.
+			 * \param enabled The enabled state. Must be set before open() to take effect.
+			 *
+			 * When enabled, open() tries to negotiate TUNSETOFFLOAD with the device so the kernel hands over large coalesced segments prefixed with a virtio-net header instead of MTU-sized frames. Disabled by default.
+			 */
+			void set_offload_enabled(bool enabled)
+			{
+				m_offload_enabled = enabled;
+			}
+
+			/**
+			 * \brief Get the length of the virtio-net header that prefixes every frame.
+			 * \return The header length, in bytes, or 0 if no offload was negotiated.
+			 */
+			size_t vnet_header_length() const
+			{
+				return m_vnet_header_length;
+			}
+
+			/**
+			 * \brief Set the count of device queues to open.
+			 * \param count The queue count. Must be set before open() to take effect.
+			 *
+			 * On Linux, counts above one request IFF_MULTI_QUEUE: the device exposes one file descriptor per queue and the kernel steers flows between them, so reads and writes scale across threads. On other systems, or when the kernel has no multi-queue support, a single queue is opened.
+			 */
+			void set_queue_count(size_t count)
+			{
+				m_queue_count = (count > 0) ? count : 1;
+			}
+
+			/**
+			 * \brief Get the count of queues that were actually opened.
+			 * \return The queue count. Valid once open() succeeded.
+			 */
+			size_t queue_count() const
+			{
+				return m_extra_queues.size() + 1;
+			}
+
+			/**
+			 * \brief Get the recommended per-frame buffer size for reads.
+			 * \return The size, in bytes.
+			 *
+			 * When segmentation offload is negotiated the kernel may hand over coalesced frames of up to 64 KiB regardless of the MTU, so the full historical size is kept in that case.
+			 */
+			size_t recommended_frame_size() const
+			{
+				if (m_vnet_header_length > 0)
+				{
+					return 65536;
+				}
+
+				return base_tap_adapter::recommended_frame_size();
+			}
+
+			/**
+			 * \brief Read some data from the tap adapter.
+			 * \param buffers The buffers into which the data will be read.
+			 * \param handler The handler to be called when the read operation completes.
+			 */
+			template <typename ReadHandler>
+			void async_read(const boost::asio::mutable_buffers_1& buffers, ReadHandler handler)
+			{
+				if (m_io_engine)
+				{
+					m_io_engine->async_read(*buffers.begin(), handler);
+				}
+				else
+				{
+					base_tap_adapter::async_read(buffers, handler);
+				}
+			}
+
+			/**
+			 * \brief Write some data to the tap adapter.
+			 * \param buffers One or more buffers to be written to the tap adapter.
+			 * \param handler The handler to be called when the write operation completes.
+			 */
+			template <typename WriteHandler>
+			void async_write(const boost::asio::const_buffers_1& buffers, WriteHandler handler)
+			{
+				if (m_io_engine)
+				{
+					m_io_engine->async_write(*buffers.begin(), handler);
+				}
+				else
+				{
+					base_tap_adapter::async_write(buffers, handler);
+				}
+			}
+
+			/**
+			 * \brief Read some data from the specified queue.
+			 * \param queue The queue index, below queue_count(). Queue 0 is the main descriptor.
+			 * \param buffers The buffers into which the data will be read.
+			 * \param handler The handler to be called when the read operation completes.
+			 */
+			template <typename ReadHandler>
+			void async_read_queue(size_t queue, const boost::asio::mutable_buffers_1& buffers, ReadHandler handler)
+			{
+				if ((queue == 0) || (queue > m_extra_queues.size()))
+				{
+					async_read(buffers, handler);
+				}
+				else
+				{
+					m_extra_queues[queue - 1]->async_read_some(buffers, handler);
+				}
+			}
+
+			/**
+			 * \brief Write some data to the specified queue.
+			 * \param queue The queue index, below queue_count(). Queue 0 is the main descriptor.
+			 * \param buffers One or more buffers to be written to the tap adapter.
+			 * \param handler The handler to be called when the write operation completes.
+			 */
+			template <typename WriteHandler>
+			void async_write_queue(size_t queue, const boost::asio::const_buffers_1& buffers, WriteHandler handler)
+			{
+				if ((queue == 0) || (queue > m_extra_queues.size()))
+				{
+					async_write(buffers, handler);
+				}
+				else
+				{
+					m_extra_queues[queue - 1]->async_write_some(buffers, handler);
+				}
+			}
+
 			/**
 			 * \brief Close the associated descriptor.
 			 */
 			void close()
 			{
+				if (m_io_engine)
+				{
+					m_io_engine->close();
+					m_io_engine.reset();
+				}
+
+				m_extra_queues.clear();
+				m_vnet_header_length = 0;
+
 				boost::system::error_code ec;
 
 				destroy_device(ec);
@@ -144,6 +311,15 @@ namespace asiotap
 			 */
 			boost::system::error_code close(boost::system::error_code& ec)
 			{
+				if (m_io_engine)
+				{
+					m_io_engine->close();
+					m_io_engine.reset();
+				}
+
+				m_extra_queues.clear();
+				m_vnet_header_length = 0;
+
 				destroy_device(ec);
 
 				base_tap_adapter::close(ec);
@@ -163,6 +339,12 @@ namespace asiotap
 			 */
 			ip_network_address_list get_ip_addresses();
 
+			/**
+			 * \brief Get the count of frames the device dropped because reads did not keep up.
+			 * \return The dropped frame count, or 0 when the system does not expose it.
+			 */
+			size_t get_dropped_frame_count() const;
+
 			/**
 			 * \brief Configure the tap adapter.
 			 * \param configuration The IP configuration.
@@ -192,6 +374,12 @@ namespace asiotap
 			void destroy_device(boost::system::error_code& ec);
 
 			posix_route_manager m_route_manager;
+			boost::shared_ptr<posix_io_uring_engine> m_io_engine;
+			bool m_io_uring_enabled;
+			bool m_offload_enabled;
+			size_t m_vnet_header_length;
+			size_t m_queue_count;
+			std::vector<boost::shared_ptr<boost::asio::posix::stream_descriptor> > m_extra_queues;
 	};
 }
 
@@ -0,0 +1,296 @@
+/*
+ * libasiotap - A portable TAP adapter extension for Boost::ASIO.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libasiotap.
+ *
+ * libasiotap is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libasiotap is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libasiotap in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file cached_endpoint_resolver.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An asynchronous endpoint resolver with positive and negative caching.
+ */
+
+#ifndef ASIOTAP_CACHED_ENDPOINT_RESOLVER_HPP
+#define ASIOTAP_CACHED_ENDPOINT_RESOLVER_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/function.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/ref.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/variant.hpp>
+
+#include "endpoint.hpp"
+
+namespace asiotap
+{
+	/**
+	 * \brief An asynchronous endpoint resolver with positive and negative caching.
+	 *
+	 * Hostname resolutions are cached for a configurable delay, for failures as well as successes, so callers that resolve the same endpoints periodically pay the resolver latency once per delay instead of once per call. Concurrent resolutions of the same name are coalesced into a single query. IP endpoints resolve locally and are never cached.
+	 */
+	class cached_endpoint_resolver
+	{
+		public:
+
+			/**
+			 * \brief The resolver type.
+			 */
+			typedef boost::asio::ip::udp::resolver resolver_type;
+
+			/**
+			 * \brief The handler type.
+			 */
+			typedef boost::function<void (const boost::system::error_code&, resolver_type::iterator)> handler_type;
+
+			/**
+			 * \brief The default delay during which a successful resolution is served from the cache.
+			 */
+			static const unsigned int DEFAULT_POSITIVE_TTL_SECONDS = 300;
+
+			/**
+			 * \brief The default delay during which a failed resolution is served from the cache.
+			 */
+			static const unsigned int DEFAULT_NEGATIVE_TTL_SECONDS = 15;
+
+			/**
+			 * \brief Create a cached endpoint resolver.
+			 * \param io_service_ The io_service to use.
+			 * \param positive_ttl_seconds The delay during which a successful resolution is served from the cache.
+			 * \param negative_ttl_seconds The delay during which a failed resolution is served from the cache.
+			 */
+			explicit cached_endpoint_resolver(boost::asio::io_service& io_service_, unsigned int positive_ttl_seconds = DEFAULT_POSITIVE_TTL_SECONDS, unsigned int negative_ttl_seconds = DEFAULT_NEGATIVE_TTL_SECONDS) :
+				m_io_service(io_service_),
+				m_positive_ttl(boost::posix_time::seconds(positive_ttl_seconds)),
+				m_negative_ttl(boost::posix_time::seconds(negative_ttl_seconds))
+			{
+			}
+
+			cached_endpoint_resolver(const cached_endpoint_resolver&) = delete;
+			cached_endpoint_resolver& operator=(const cached_endpoint_resolver&) = delete;
+
+			/**
+			 * \brief Resolve an endpoint asynchronously.
+			 * \param ep The endpoint to resolve.
+			 * \param protocol The protocol to use.
+			 * \param flags The flags to use for the resolution.
+			 * \param default_service The default service to use.
+			 * \param handler The handler. It is called on the io_service, with either the cached outcome or the fresh one.
+			 */
+			void async_resolve(const endpoint& ep, resolver_type::query::protocol_type protocol, resolver_type::query::flags flags, const std::string& default_service, handler_type handler)
+			{
+				boost::apply_visitor(resolve_visitor(*this, protocol, flags, default_service, handler), ep);
+			}
+
+			/**
+			 * \brief Clear the resolution cache.
+			 */
+			void clear_cache()
+			{
+				boost::mutex::scoped_lock lock(m_mutex);
+
+				m_cache.clear();
+			}
+
+		private:
+
+			struct cache_entry_type
+			{
+				boost::system::error_code error;
+				boost::asio::ip::udp::endpoint host;
+				boost::posix_time::ptime expiry;
+			};
+
+			typedef std::map<std::string, cache_entry_type> cache_type;
+			typedef std::map<std::string, std::vector<handler_type> > pending_type;
+
+			class resolve_visitor : public boost::static_visitor<>
+			{
+				public:
+
+					resolve_visitor(cached_endpoint_resolver& resolver, resolver_type::query::protocol_type protocol, resolver_type::query::flags flags, const std::string& default_service, handler_type handler) :
+						m_resolver(resolver),
+						m_protocol(protocol),
+						m_flags(flags),
+						m_default_service(default_service),
+						m_handler(handler)
+					{
+					}
+
+					template <typename AddressType>
+					void operator()(const ip_endpoint<AddressType>& ep) const
+					{
+						// IP endpoints resolve locally: there is nothing worth caching.
+						m_resolver.complete_ip_endpoint(ep, m_default_service, m_handler);
+					}
+
+					void operator()(const hostname_endpoint& ep) const
+					{
+						m_resolver.resolve_hostname(ep, m_protocol, m_flags, m_default_service, m_handler);
+					}
+
+				private:
+
+					cached_endpoint_resolver& m_resolver;
+					resolver_type::query::protocol_type m_protocol;
+					resolver_type::query::flags m_flags;
+					std::string m_default_service;
+					handler_type m_handler;
+			};
+
+			template <typename AddressType>
+			void complete_ip_endpoint(const ip_endpoint<AddressType>& ep, const std::string& default_service, handler_type handler)
+			{
+				try
+				{
+					const boost::asio::ip::udp::endpoint host(ep.address(), ep.has_port() ? ep.port() : boost::lexical_cast<uint16_t>(default_service));
+					const resolver_type::iterator it = resolver_type::iterator::create(host, host.address().to_string(), boost::lexical_cast<std::string>(host.port()));
+
+					m_io_service.post(boost::bind(handler, boost::system::error_code(), it));
+				}
+				catch (boost::system::system_error& ex)
+				{
+					m_io_service.post(boost::bind(handler, ex.code(), resolver_type::iterator()));
+				}
+			}
+
+			void resolve_hostname(const hostname_endpoint& ep, resolver_type::query::protocol_type protocol, resolver_type::query::flags flags, const std::string& default_service, handler_type handler)
+			{
+				const std::string service = ep.service().empty() ? default_service : ep.service();
+				const std::string key = ep.hostname() + ':' + service;
+				const boost::posix_time::ptime now = boost::posix_time::second_clock::universal_time();
+
+				{
+					boost::mutex::scoped_lock lock(m_mutex);
+
+					const cache_type::iterator entry = m_cache.find(key);
+
+					if (entry != m_cache.end())
+					{
+						if (now < entry->second.expiry)
+						{
+							// Either a cached success or a cached failure: both are served without a query.
+							const cache_entry_type cached = entry->second;
+
+							lock.unlock();
+
+							complete_from_cache(cached, ep.hostname(), service, handler);
+
+							return;
+						}
+
+						m_cache.erase(entry);
+					}
+
+					const pending_type::iterator pending = m_pending.find(key);
+
+					if (pending != m_pending.end())
+					{
+						// A query for this name is already in flight: it will answer for us too.
+						pending->second.push_back(handler);
+
+						return;
+					}
+
+					m_pending[key].push_back(handler);
+				}
+
+				const boost::shared_ptr<resolver_type> resolver = boost::make_shared<resolver_type>(boost::ref(m_io_service));
+				const resolver_type::query query(protocol, ep.hostname(), service, flags);
+
+				resolver->async_resolve(query, boost::bind(&cached_endpoint_resolver::handle_resolution, this, resolver, key, _1, _2));
+			}
+
+			void complete_from_cache(const cache_entry_type& cached, const std::string& hostname, const std::string& service, handler_type handler)
+			{
+				if (cached.error)
+				{
+					m_io_service.post(boost::bind(handler, cached.error, resolver_type::iterator()));
+				}
+				else
+				{
+					m_io_service.post(boost::bind(handler, boost::system::error_code(), resolver_type::iterator::create(cached.host, hostname, service)));
+				}
+			}
+
+			void handle_resolution(boost::shared_ptr<resolver_type> resolver, const std::string& key, const boost::system::error_code& ec, resolver_type::iterator it)
+			{
+				static_cast<void>(resolver);
+
+				cache_entry_type entry;
+				entry.error = ec;
+
+				if (!ec)
+				{
+					entry.host = *it;
+				}
+
+				entry.expiry = boost::posix_time::second_clock::universal_time() + (ec ? m_negative_ttl : m_positive_ttl);
+
+				std::vector<handler_type> handlers;
+
+				{
+					boost::mutex::scoped_lock lock(m_mutex);
+
+					m_cache[key] = entry;
+
+					handlers.swap(m_pending[key]);
+					m_pending.erase(key);
+				}
+
+				for (std::vector<handler_type>::const_iterator handler = handlers.begin(); handler != handlers.end(); ++handler)
+				{
+					(*handler)(ec, it);
+				}
+			}
+
+			boost::asio::io_service& m_io_service;
+			boost::posix_time::time_duration m_positive_ttl;
+			boost::posix_time::time_duration m_negative_ttl;
+			boost::mutex m_mutex;
+			cache_type m_cache;
+			pending_type m_pending;
+	};
+}
+
+#endif /* ASIOTAP_CACHED_ENDPOINT_RESOLVER_HPP */
@@ -0,0 +1,552 @@
+/*
+ * libasiotap - A portable TAP adapter extension for Boost::ASIO.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libasiotap.
+ *
+ * libasiotap is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libasiotap is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libasiotap in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file compact_ip_route.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief Compact POD forms of the IP network address and IP route types.
+ */
+
+#ifndef ASIOTAP_COMPACT_IP_ROUTE_HPP
+#define ASIOTAP_COMPACT_IP_ROUTE_HPP
+
+#include "ip_route.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include <boost/array.hpp>
+
+namespace asiotap
+{
+	/**
+	 * \brief The compact address family tags.
+	 */
+	enum compact_ip_family : uint8_t
+	{
+		compact_ip_family_v4 = 4,
+		compact_ip_family_v6 = 6
+	};
+
+	/**
+	 * \brief A compact POD form of ip_network_address.
+	 *
+	 * The address is stored as zero-padded big-endian bytes so that comparisons and prefix matches reduce to memory compares, without any visitor dispatch. The ordering matches the one of ip_network_address, so converted sets iterate in the same order.
+	 */
+	struct compact_ip_network_address
+	{
+		uint8_t family;
+		uint8_t prefix_length;
+		boost::array<uint8_t, 16> address;
+	};
+
+	/**
+	 * \brief A compact POD form of ip_route.
+	 *
+	 * The ordering matches the one of ip_route.
+	 */
+	struct compact_ip_route
+	{
+		compact_ip_network_address network_address;
+		uint8_t has_gateway;
+		boost::array<uint8_t, 16> gateway;
+	};
+
+	/**
+	 * \brief Convert a network address to its compact form.
+	 * \param ina The network address.
+	 * \return The compact form.
+	 */
+	template <typename AddressType>
+	inline compact_ip_network_address to_compact(const base_ip_network_address<AddressType>& ina)
+	{
+		const typename AddressType::bytes_type bytes = ina.address().to_bytes();
+
+		compact_ip_network_address result;
+		result.family = (bytes.size() == 4) ? compact_ip_family_v4 : compact_ip_family_v6;
+		result.prefix_length = static_cast<uint8_t>(ina.prefix_length());
+		std::memset(result.address.data(), 0x00, result.address.size());
+		std::memcpy(result.address.data(), bytes.data(), bytes.size());
+
+		return result;
+	}
+
+	/**
+	 * \brief A visitor that converts an ip_network_address to its compact form.
+	 */
+	class ip_network_address_to_compact_visitor : public boost::static_visitor<compact_ip_network_address>
+	{
+		public:
+
+			/**
+			 * \brief Convert the specified network address.
+			 * \param ina The network address.
+			 * \return The compact form.
+			 */
+			template <typename AddressType>
+			result_type operator()(const base_ip_network_address<AddressType>& ina) const
+			{
+				return to_compact(ina);
+			}
+	};
+
+	/**
+	 * \brief Convert an ip_network_address to its compact form.
+	 * \param ina The network address.
+	 * \return The compact form.
+	 */
+	inline compact_ip_network_address to_compact(const ip_network_address& ina)
+	{
+		return boost::apply_visitor(ip_network_address_to_compact_visitor(), ina);
+	}
+
+	/**
+	 * \brief Convert a route to its compact form.
+	 * \param route The route.
+	 * \return The compact form.
+	 */
+	template <typename AddressType>
+	inline compact_ip_route to_compact(const base_ip_route<AddressType>& route)
+	{
+		compact_ip_route result;
+		result.network_address = to_compact(route.network_address());
+		std::memset(result.gateway.data(), 0x00, result.gateway.size());
+
+		if (route.gateway())
+		{
+			const typename AddressType::bytes_type bytes = route.gateway()->to_bytes();
+
+			result.has_gateway = 1;
+			std::memcpy(result.gateway.data(), bytes.data(), bytes.size());
+		}
+		else
+		{
+			result.has_gateway = 0;
+		}
+
+		return result;
+	}
+
+	/**
+	 * \brief A visitor that converts an ip_route to its compact form.
+	 */
+	class ip_route_to_compact_visitor : public boost::static_visitor<compact_ip_route>
+	{
+		public:
+
+			/**
+			 * \brief Convert the specified route.
+			 * \param route The route.
+			 * \return The compact form.
+			 */
+			template <typename AddressType>
+			result_type operator()(const base_ip_route<AddressType>& route) const
+			{
+				return to_compact(route);
+			}
+	};
+
+	/**
+	 * \brief Convert an ip_route to its compact form.
+	 * \param route The route.
+	 * \return The compact form.
+	 */
+	inline compact_ip_route to_compact(const ip_route& route)
+	{
+		return boost::apply_visitor(ip_route_to_compact_visitor(), route);
+	}
+
+	/**
+	 * \brief Convert a compact network address back to an ip_network_address.
+	 * \param ina The compact form.
+	 * \return The network address.
+	 */
+	inline ip_network_address from_compact(const compact_ip_network_address& ina)
+	{
+		if (ina.family == compact_ip_family_v4)
+		{
+			boost::asio::ip::address_v4::bytes_type bytes;
+			std::memcpy(bytes.data(), ina.address.data(), bytes.size());
+
+			return ipv4_network_address(boost::asio::ip::address_v4(bytes), ina.prefix_length);
+		}
+		else
+		{
+			boost::asio::ip::address_v6::bytes_type bytes;
+			std::memcpy(bytes.data(), ina.address.data(), bytes.size());
+
+			return ipv6_network_address(boost::asio::ip::address_v6(bytes), ina.prefix_length);
+		}
+	}
+
+	/**
+	 * \brief Convert a compact route back to an ip_route.
+	 * \param route The compact form.
+	 * \return The route.
+	 */
+	inline ip_route from_compact(const compact_ip_route& route)
+	{
+		if (route.network_address.family == compact_ip_family_v4)
+		{
+			boost::asio::ip::address_v4::bytes_type bytes;
+			std::memcpy(bytes.data(), route.network_address.address.data(), bytes.size());
+
+			const ipv4_network_address ina(boost::asio::ip::address_v4(bytes), route.network_address.prefix_length);
+
+			boost::optional<boost::asio::ip::address_v4> gateway;
+
+			if (route.has_gateway)
+			{
+				boost::asio::ip::address_v4::bytes_type gateway_bytes;
+				std::memcpy(gateway_bytes.data(), route.gateway.data(), gateway_bytes.size());
+
+				gateway = boost::asio::ip::address_v4(gateway_bytes);
+			}
+
+			return ipv4_route(ina, gateway);
+		}
+		else
+		{
+			boost::asio::ip::address_v6::bytes_type bytes;
+			std::memcpy(bytes.data(), route.network_address.address.data(), bytes.size());
+
+			const ipv6_network_address ina(boost::asio::ip::address_v6(bytes), route.network_address.prefix_length);
+
+			boost::optional<boost::asio::ip::address_v6> gateway;
+
+			if (route.has_gateway)
+			{
+				boost::asio::ip::address_v6::bytes_type gateway_bytes;
+				std::memcpy(gateway_bytes.data(), route.gateway.data(), gateway_bytes.size());
+
+				gateway = boost::asio::ip::address_v6(gateway_bytes);
+			}
+
+			return ipv6_route(ina, gateway);
+		}
+	}
+
+	inline bool operator==(const compact_ip_network_address& lhs, const compact_ip_network_address& rhs)
+	{
+		return (lhs.family == rhs.family) && (lhs.prefix_length == rhs.prefix_length) && (std::memcmp(lhs.address.data(), rhs.address.data(), lhs.address.size()) == 0);
+	}
+
+	inline bool operator!=(const compact_ip_network_address& lhs, const compact_ip_network_address& rhs)
+	{
+		return !(lhs == rhs);
+	}
+
+	inline bool operator<(const compact_ip_network_address& lhs, const compact_ip_network_address& rhs)
+	{
+		if (lhs.family != rhs.family)
+		{
+			return (lhs.family < rhs.family);
+		}
+
+		if (lhs.prefix_length != rhs.prefix_length)
+		{
+			// More specific means a higher prefix length.
+			return (lhs.prefix_length > rhs.prefix_length);
+		}
+
+		return (std::memcmp(lhs.address.data(), rhs.address.data(), lhs.address.size()) < 0);
+	}
+
+	inline bool operator==(const compact_ip_route& lhs, const compact_ip_route& rhs)
+	{
+		return (lhs.network_address == rhs.network_address) && (lhs.has_gateway == rhs.has_gateway) && (std::memcmp(lhs.gateway.data(), rhs.gateway.data(), lhs.gateway.size()) == 0);
+	}
+
+	inline bool operator!=(const compact_ip_route& lhs, const compact_ip_route& rhs)
+	{
+		return !(lhs == rhs);
+	}
+
+	inline bool operator<(const compact_ip_route& lhs, const compact_ip_route& rhs)
+	{
+		if (lhs.network_address != rhs.network_address)
+		{
+			return (lhs.network_address < rhs.network_address);
+		}
+
+		if (lhs.has_gateway != rhs.has_gateway)
+		{
+			// An absent gateway compares before a present one, like boost::optional.
+			return (lhs.has_gateway < rhs.has_gateway);
+		}
+
+		return (std::memcmp(lhs.gateway.data(), rhs.gateway.data(), lhs.gateway.size()) < 0);
+	}
+
+	/**
+	 * \brief Check if a compact network address contains an address given as zero-padded bytes.
+	 * \param ina The compact network address.
+	 * \param address The address bytes.
+	 * \return true if the first prefix_length bits match.
+	 */
+	inline bool has_address(const compact_ip_network_address& ina, const boost::array<uint8_t, 16>& address)
+	{
+		const size_t whole_bytes = ina.prefix_length / 8;
+
+		if (std::memcmp(ina.address.data(), address.data(), whole_bytes) != 0)
+		{
+			return false;
+		}
+
+		const unsigned int remaining_bits = ina.prefix_length % 8;
+
+		if (remaining_bits == 0)
+		{
+			return true;
+		}
+
+		const uint8_t mask = static_cast<uint8_t>(0xFF << (8 - remaining_bits));
+
+		return (((ina.address[whole_bytes] ^ address[whole_bytes]) & mask) == 0);
+	}
+
+	/**
+	 * \brief Check if a compact network address contains a network.
+	 * \param ina The compact network address.
+	 * \param addr The compact network address to check.
+	 * \return true if addr is a subnet of ina.
+	 */
+	inline bool has_network(const compact_ip_network_address& ina, const compact_ip_network_address& addr)
+	{
+		if (ina.family != addr.family)
+		{
+			return false;
+		}
+
+		// If the network address has a prefix length that is more or equally inclusive to ours: it can't be a subnet.
+		if (addr.prefix_length <= ina.prefix_length)
+		{
+			return false;
+		}
+
+		// Only the first ina.prefix_length bits are compared and addr is more specific, so masking addr by its own prefix would not change the outcome.
+		return has_address(ina, addr.address);
+	}
+
+	/**
+	 * \brief Check if a compact route represents an unicast address.
+	 * \param route The compact route.
+	 * \return true if the route represents an unicast address.
+	 */
+	inline bool is_unicast(const compact_ip_route& route)
+	{
+		return (route.network_address.prefix_length == ((route.network_address.family == compact_ip_family_v4) ? 32 : 128));
+	}
+
+	/**
+	 * \brief Check if a compact route has a gateway.
+	 * \param route The compact route.
+	 * \return true if the route has a gateway.
+	 */
+	inline bool has_gateway(const compact_ip_route& route)
+	{
+		return (route.has_gateway != 0);
+	}
+
+	/**
+	 * \brief A sorted array of compact routes.
+	 *
+	 * Since the compact ordering matches the one of ip_route_set, converting a set yields a sorted array for free, and the set operations below are single merge passes over contiguous memory instead of per-route scans with visitor dispatch.
+	 */
+	typedef std::vector<compact_ip_route> compact_ip_route_list;
+
+	/**
+	 * \brief A sorted array of compact network addresses.
+	 */
+	typedef std::vector<compact_ip_network_address> compact_ip_network_address_list;
+
+	/**
+	 * \brief Convert a route set to a sorted array of compact routes.
+	 * \param routes The route set.
+	 * \return The sorted array.
+	 */
+	inline compact_ip_route_list to_compact(const ip_route_set& routes)
+	{
+		compact_ip_route_list result;
+		result.reserve(routes.size());
+
+		for (ip_route_set::const_iterator route = routes.begin(); route != routes.end(); ++route)
+		{
+			result.push_back(to_compact(*route));
+		}
+
+		return result;
+	}
+
+	/**
+	 * \brief Convert a sorted array of compact routes back to a route set.
+	 * \param routes The sorted array.
+	 * \return The route set.
+	 */
+	inline ip_route_set from_compact(const compact_ip_route_list& routes)
+	{
+		ip_route_set result;
+
+		for (compact_ip_route_list::const_iterator route = routes.begin(); route != routes.end(); ++route)
+		{
+			// The orderings match, so the insertion point is always at the end.
+			result.insert(result.end(), from_compact(*route));
+		}
+
+		return result;
+	}
+
+	/**
+	 * \brief Check if a sorted array of compact routes contains a route.
+	 * \param routes The sorted array.
+	 * \param route The route to look for.
+	 * \return true if the route is present.
+	 */
+	inline bool contains(const compact_ip_route_list& routes, const compact_ip_route& route)
+	{
+		return std::binary_search(routes.begin(), routes.end(), route);
+	}
+
+	/**
+	 * \brief Check if one sorted array of compact routes is a subset of another.
+	 * \param routes The candidate subset.
+	 * \param reference The reference array.
+	 * \return true if every route of routes is in reference.
+	 */
+	inline bool is_subset_of(const compact_ip_route_list& routes, const compact_ip_route_list& reference)
+	{
+		return std::includes(reference.begin(), reference.end(), routes.begin(), routes.end());
+	}
+
+	/**
+	 * \brief Compute the intersection of two sorted arrays of compact routes.
+	 * \param lhs The first array.
+	 * \param rhs The second array.
+	 * \return The sorted intersection.
+	 */
+	inline compact_ip_route_list intersection(const compact_ip_route_list& lhs, const compact_ip_route_list& rhs)
+	{
+		compact_ip_route_list result;
+
+		std::set_intersection(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), std::back_inserter(result));
+
+		return result;
+	}
+
+	/**
+	 * \brief Compute the difference of two sorted arrays of compact routes.
+	 * \param lhs The array to subtract from.
+	 * \param rhs The array to subtract.
+	 * \return The sorted difference.
+	 */
+	inline compact_ip_route_list difference(const compact_ip_route_list& lhs, const compact_ip_route_list& rhs)
+	{
+		compact_ip_route_list result;
+
+		std::set_difference(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), std::back_inserter(result));
+
+		return result;
+	}
+
+	/**
+	 * \brief Check if any of the given network addresses covers the specified one.
+	 * \param inas The network addresses.
+	 * \param addr The network address to check.
+	 * \return true if addr is a subnet of one of inas.
+	 */
+	inline bool is_covered_by_any(const compact_ip_network_address_list& inas, const compact_ip_network_address& addr)
+	{
+		for (compact_ip_network_address_list::const_iterator ina = inas.begin(); ina != inas.end(); ++ina)
+		{
+			if (has_network(*ina, addr))
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/**
+	 * \brief Keep the routes that are covered by one of the given network addresses.
+	 * \param routes The sorted array of routes.
+	 * \param inas The network addresses.
+	 * \return The sorted array of covered routes.
+	 *
+	 * This is a single pass over the routes: each one is checked against the (typically very short) address list, instead of rescanning the whole route set once per address.
+	 */
+	inline compact_ip_route_list covered_by(const compact_ip_route_list& routes, const compact_ip_network_address_list& inas)
+	{
+		compact_ip_route_list result;
+
+		for (compact_ip_route_list::const_iterator route = routes.begin(); route != routes.end(); ++route)
+		{
+			if (is_covered_by_any(inas, route->network_address))
+			{
+				result.push_back(*route);
+			}
+		}
+
+		return result;
+	}
+
+	/**
+	 * \brief Keep the routes that are covered by none of the given network addresses.
+	 * \param routes The sorted array of routes.
+	 * \param inas The network addresses.
+	 * \return The sorted array of uncovered routes.
+	 */
+	inline compact_ip_route_list not_covered_by(const compact_ip_route_list& routes, const compact_ip_network_address_list& inas)
+	{
+		compact_ip_route_list result;
+
+		for (compact_ip_route_list::const_iterator route = routes.begin(); route != routes.end(); ++route)
+		{
+			if (!is_covered_by_any(inas, route->network_address))
+			{
+				result.push_back(*route);
+			}
+		}
+
+		return result;
+	}
+}
+
+#endif /* ASIOTAP_COMPACT_IP_ROUTE_HPP */
@@ -52,6 +52,8 @@
 #include <boost/asio.hpp>
 #include <boost/variant.hpp>
 
+#include "stream_operations.hpp"
+
 namespace asiotap
 {
 	/**
@@ -206,6 +208,19 @@ namespace asiotap
 	template <typename AddressType>
 	std::istream& operator>>(std::istream& is, base_ip_network_address<AddressType>& value);
 
+	/**
+	 * \brief Read a network address from a character range.
+	 * \tparam AddressType The address type.
+	 * \param begin The first character.
+	 * \param end One past the last character.
+	 * \param value The result network address.
+	 * \return The position past the token, or nullptr on failure.
+	 *
+	 * Unlike the stream extraction operator, this performs no allocation.
+	 */
+	template <typename AddressType>
+	const char* read_ip_network_address(const char* begin, const char* end, base_ip_network_address<AddressType>& value);
+
 	/**
 	 * \brief The IPv4 instantiation.
 	 */
@@ -221,6 +236,15 @@ namespace asiotap
 	 */
 	typedef boost::variant<ipv4_network_address, ipv6_network_address> ip_network_address;
 
+	/**
+	 * \brief Read an ip_network_address from a character range.
+	 * \param begin The first character.
+	 * \param end One past the last character.
+	 * \param value The result network address.
+	 * \return The position past the token, or nullptr on failure.
+	 */
+	const char* read_ip_network_address(const char* begin, const char* end, ip_network_address& value);
+
 	/**
 	 * \brief An IPv4 network list type.
 	 */
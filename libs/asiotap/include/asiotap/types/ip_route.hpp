@@ -203,6 +203,19 @@ namespace asiotap
 	template <typename AddressType>
 	std::istream& operator>>(std::istream& is, base_ip_route<AddressType>& value);
 
+	/**
+	 * \brief Read a route from a character range.
+	 * \tparam AddressType The address type.
+	 * \param begin The first character.
+	 * \param end One past the last character.
+	 * \param value The result route.
+	 * \return The position past the token, or nullptr on failure.
+	 *
+	 * Unlike the stream extraction operator, this performs no allocation.
+	 */
+	template <typename AddressType>
+	const char* read_ip_route(const char* begin, const char* end, base_ip_route<AddressType>& value);
+
 	/**
 	 * \brief The IPv4 instantiation.
 	 */
@@ -218,6 +231,15 @@ namespace asiotap
 	 */
 	typedef boost::variant<ipv4_route, ipv6_route> ip_route;
 
+	/**
+	 * \brief Read an ip_route from a character range.
+	 * \param begin The first character.
+	 * \param end One past the last character.
+	 * \param value The result route.
+	 * \return The position past the token, or nullptr on failure.
+	 */
+	const char* read_ip_route(const char* begin, const char* end, ip_route& value);
+
 	/**
 	 * \brief An IPv4 route list type.
 	 */
@@ -124,6 +124,121 @@ namespace asiotap
 	 */
 	template <typename AddressType>
 	std::istream& read_ip_address_prefix_length_gateway(std::istream& is, std::string& ip_address, std::string& prefix_length, std::string& gateway);
+
+	/**
+	 * \brief A lightweight non-owning character range.
+	 *
+	 * The range parsers below mirror the stream based ones but operate on in-place character ranges, without istream machinery or temporary strings. On success they return the position one past the consumed token; on failure they return nullptr and the input is left untouched.
+	 */
+	struct string_range
+	{
+		const char* first; /**< The first character of the range. */
+		const char* last; /**< One past the last character of the range. */
+	};
+
+	/**
+	 * \brief Get the size of a string range.
+	 * \param range The range.
+	 * \return The size, in characters.
+	 */
+	inline size_t string_range_size(const string_range& range)
+	{
+		return static_cast<size_t>(range.last - range.first);
+	}
+
+	/**
+	 * \brief Convert a string range to a string.
+	 * \param range The range.
+	 * \return The string.
+	 */
+	inline std::string to_string(const string_range& range)
+	{
+		return std::string(range.first, range.last);
+	}
+
+	/**
+	 * \brief Convert a string range to an address, without any allocation.
+	 * \tparam AddressType The address type.
+	 * \param range The range.
+	 * \param value The result address.
+	 * \return true if the range is a valid address representation.
+	 */
+	template <typename AddressType>
+	bool string_range_to_address(const string_range& range, AddressType& value);
+
+	/**
+	 * \brief Read an IP address from a character range.
+	 * \tparam AddressType The address type.
+	 * \param begin The first character.
+	 * \param end One past the last character.
+	 * \param ip_address The result address range.
+	 * \return The position past the token, or nullptr on failure.
+	 */
+	template <typename AddressType>
+	const char* read_ip_address(const char* begin, const char* end, string_range& ip_address);
+
+	/**
+	 * \brief Read a port number from a character range.
+	 * \param begin The first character.
+	 * \param end One past the last character.
+	 * \param port The result port range.
+	 * \return The position past the token, or nullptr on failure.
+	 */
+	const char* read_port(const char* begin, const char* end, string_range& port);
+
+	/**
+	 * \brief Read a prefix length from a character range.
+	 * \tparam AddressType The address type.
+	 * \param begin The first character.
+	 * \param end One past the last character.
+	 * \param prefix_length The result prefix length range.
+	 * \return The position past the token, or nullptr on failure.
+	 */
+	template <typename AddressType>
+	const char* read_prefix_length(const char* begin, const char* end, string_range& prefix_length);
+
+	/**
+	 * \brief Read a hostname from a character range.
+	 * \param begin The first character.
+	 * \param end One past the last character.
+	 * \param hostname The result hostname range.
+	 * \return The position past the token, or nullptr on failure.
+	 */
+	const char* read_hostname(const char* begin, const char* end, string_range& hostname);
+
+	/**
+	 * \brief Read a service string from a character range.
+	 * \param begin The first character.
+	 * \param end One past the last character.
+	 * \param service The result service range.
+	 * \return The position past the token, or nullptr on failure.
+	 */
+	const char* read_service(const char* begin, const char* end, string_range& service);
+
+	/**
+	 * \brief Read an IP address and a prefix length from a character range.
+	 * \tparam AddressType The address type.
+	 * \param begin The first character.
+	 * \param end One past the last character.
+	 * \param ip_address The result address range.
+	 * \param prefix_length The result prefix length range. Empty if no prefix length was specified.
+	 * \return The position past the token, or nullptr on failure.
+	 */
+	template <typename AddressType>
+	const char* read_ip_address_prefix_length(const char* begin, const char* end, string_range& ip_address, string_range& prefix_length);
+
+	/**
+	 * \brief Read an IP address, a prefix length and a gateway from a character range.
+	 * \tparam AddressType The address type.
+	 * \param begin The first character.
+	 * \param end One past the last character.
+	 * \param ip_address The result address range.
+	 * \param prefix_length The result prefix length range. Empty if no prefix length was specified.
+	 * \param gateway The result gateway range. Empty if no gateway was specified.
+	 * \return The position past the token, or nullptr on failure.
+	 */
+	template <typename AddressType>
+	const char* read_ip_address_prefix_length_gateway(const char* begin, const char* end, string_range& ip_address, string_range& prefix_length, string_range& gateway);
 }
 
 #endif /* ASIOTAP_STREAM_OPERATIONS_HPP */
@@ -49,8 +49,13 @@
 
 #include "windows_route_manager.hpp"
 
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+
+#include <deque>
 #include <map>
 #include <string>
+#include <vector>
 
 #include <ifdef.h>
 
@@ -77,7 +82,10 @@ namespace asiotap
 				m_route_manager(_io_service),
 				m_display_name(),
 				m_interface_index(),
-				m_interface_luid()
+				m_interface_luid(),
+				m_io_strand(_io_service),
+				m_free_read_slots(),
+				m_write_in_flight(false)
 			{}
 
 			windows_tap_adapter(const windows_tap_adapter&) = delete;
@@ -132,6 +140,51 @@ namespace asiotap
 			 */
 			ip_network_address_list get_ip_addresses();
 
+			/**
+			 * \brief Get the count of frames the device dropped because reads did not keep up.
+			 * \return Always 0: the Windows TAP driver does not expose this counter.
+			 */
+			size_t get_dropped_frame_count() const
+			{
+				return 0;
+			}
+
+			/**
+			 * \brief Enable or disable segmentation offload negotiation.
+			 *
+			 * The Windows TAP driver has no equivalent of TUNSETOFFLOAD, so this is a no-op.
+			 */
+			void set_offload_enabled(bool)
+			{
+			}
+
+			/**
+			 * \brief Get the length of the virtio-net header that prefixes every frame.
+			 * \return Always 0: no offload is ever negotiated on Windows.
+			 */
+			size_t vnet_header_length() const
+			{
+				return 0;
+			}
+
+			/**
+			 * \brief Set the count of device queues to open.
+			 *
+			 * The Windows TAP driver has no multi-queue support, so this is a no-op.
+			 */
+			void set_queue_count(size_t)
+			{
+			}
+
+			/**
+			 * \brief Get the count of queues that were actually opened.
+			 * \return Always 1.
+			 */
+			size_t queue_count() const
+			{
+				return 1;
+			}
+
 			/**
 			 * \brief Configure the tap adapter.
 			 * \param configuration The IP configuration.
@@ -155,6 +208,54 @@ namespace asiotap
 			 */
 			void set_metric(unsigned int metric);
 
+			/**
+			 * \brief Read a frame from the tap adapter.
+			 * \param buffers The buffers to read into.
+			 * \param handler The handler to call upon completion.
+			 *
+			 * Unlike the base implementation, several overlapped reads are kept pending against the driver at all times, into buffers that live as long as the adapter: each frame no longer costs a full completion-port round trip before the next read is armed.
+			 */
+			template <typename MutableBufferSequence, typename ReadHandler>
+			void async_read(const MutableBufferSequence& buffers, ReadHandler handler)
+			{
+				m_io_strand.post(boost::bind(&windows_tap_adapter::queue_read, this, boost::asio::mutable_buffer(*buffers.begin()), io_handler_type(handler)));
+			}
+
+			/**
+			 * \brief Write a frame to the tap adapter.
+			 * \param buffers The buffers to write from. They must remain valid until the handler is called.
+			 * \param handler The handler to call upon completion.
+			 *
+			 * Writes are queued inside the adapter: as soon as one overlapped write completes the next one is issued from the completion handler, so back-to-back frames do not wait for their callers to be rescheduled.
+			 */
+			template <typename ConstBufferSequence, typename WriteHandler>
+			void async_write(const ConstBufferSequence& buffers, WriteHandler handler)
+			{
+				m_io_strand.post(boost::bind(&windows_tap_adapter::queue_write, this, boost::asio::const_buffer(*buffers.begin()), io_handler_type(handler)));
+			}
+
+			/**
+			 * \brief Read a frame from the specified queue.
+			 *
+			 * There is always exactly one queue on Windows: the index is ignored.
+			 */
+			template <typename MutableBufferSequence, typename ReadHandler>
+			void async_read_queue(size_t, const MutableBufferSequence& buffers, ReadHandler handler)
+			{
+				async_read(buffers, handler);
+			}
+
+			/**
+			 * \brief Write a frame to the specified queue.
+			 *
+			 * There is always exactly one queue on Windows: the index is ignored.
+			 */
+			template <typename ConstBufferSequence, typename WriteHandler>
+			void async_write_queue(size_t, const ConstBufferSequence& buffers, WriteHandler handler)
+			{
+				async_write(buffers, handler);
+			}
+
 		private:
 
 			windows_route_manager m_route_manager;
@@ -162,6 +263,57 @@ namespace asiotap
 			NET_IFINDEX m_interface_index;
 			NET_LUID m_interface_luid;
 
+			/**
+			 * \brief The count of overlapped reads kept pending against the driver.
+			 */
+			static const size_t PENDING_READ_COUNT = 8;
+
+			/**
+			 * \brief The size of each read buffer.
+			 *
+			 * The driver delivers one frame per read: this covers the largest transfer the TAP driver can make, whatever the configured MTU.
+			 */
+			static const size_t READ_BUFFER_SIZE = 65536;
+
+			typedef boost::function<void (const boost::system::error_code&, size_t)> io_handler_type;
+
+			struct completed_read_type
+			{
+				size_t slot;
+				boost::system::error_code error;
+				size_t length;
+			};
+
+			struct read_request_type
+			{
+				boost::asio::mutable_buffer buffer;
+				io_handler_type handler;
+			};
+
+			struct write_request_type
+			{
+				boost::asio::const_buffer buffer;
+				io_handler_type handler;
+			};
+
+			void start_read_pipeline();
+			void start_pending_reads();
+			void handle_slot_read(size_t slot, const boost::system::error_code& ec, size_t length);
+			void queue_read(boost::asio::mutable_buffer buffer, io_handler_type handler);
+			void deliver_reads();
+			void queue_write(boost::asio::const_buffer buffer, io_handler_type handler);
+			void start_next_write();
+			void handle_write(const boost::system::error_code& ec, size_t length);
+
+			// All the state below is only ever touched from m_io_strand.
+			boost::asio::io_service::strand m_io_strand;
+			std::vector<std::vector<uint8_t> > m_read_buffers;
+			std::vector<size_t> m_free_read_slots;
+			std::deque<completed_read_type> m_completed_reads;
+			std::deque<read_request_type> m_read_requests;
+			std::deque<write_request_type> m_write_requests;
+			bool m_write_in_flight;
+
 			friend std::ostream& operator<<(std::ostream& os, const windows_tap_adapter& value)
 			{
 				return os << value.display_name();
@@ -50,6 +50,8 @@
 #include "osi/ethernet_builder.hpp"
 #include "osi/arp_builder.hpp"
 
+#include <cstring>
+
 namespace asiotap
 {
 	namespace osi
@@ -79,6 +81,28 @@ namespace asiotap
 
 				if (should_answer)
 				{
+					cached_reply_type& cached_reply = m_reply_cache[arp_helper.target_logical_address()];
+
+					if (cached_reply.frame_size > 0)
+					{
+						// The reply frame was built before: copy it and patch only the requester-specific fields.
+						const boost::asio::mutable_buffer reply = response_buffer + (boost::asio::buffer_size(response_buffer) - cached_reply.frame_size);
+
+						std::memcpy(boost::asio::buffer_cast<uint8_t*>(reply), cached_reply.frame_data.data(), cached_reply.frame_size);
+
+						mutable_helper<ethernet_frame> ethernet_reply_helper(reply);
+
+						boost::asio::buffer_copy(ethernet_reply_helper.target(), ethernet_helper.sender());
+						boost::asio::buffer_copy(ethernet_reply_helper.sender(), ethernet_helper.target());
+
+						mutable_helper<arp_frame> arp_reply_helper(ethernet_reply_helper.payload());
+
+						boost::asio::buffer_copy(arp_reply_helper.target_hardware_address(), arp_helper.sender_hardware_address());
+						arp_reply_helper.set_target_logical_address(arp_helper.sender_logical_address());
+
+						return boost::make_optional<boost::asio::const_buffer>(reply);
+					}
+
 					size_t payload_size;
 
 					builder<arp_frame> arp_builder(response_buffer);
@@ -99,7 +123,16 @@ namespace asiotap
 					                   ethernet_helper.protocol()
 					               );
 
-					return boost::make_optional<boost::asio::const_buffer>(response_buffer + (boost::asio::buffer_size(response_buffer) - payload_size));
+					const boost::asio::const_buffer reply = response_buffer + (boost::asio::buffer_size(response_buffer) - payload_size);
+
+					if (payload_size <= cached_reply.frame_data.size())
+					{
+						// Remember the built frame so the next request for this address only patches it.
+						std::memcpy(cached_reply.frame_data.data(), boost::asio::buffer_cast<const uint8_t*>(reply), payload_size);
+						cached_reply.frame_size = payload_size;
+					}
+
+					return boost::make_optional<boost::asio::const_buffer>(boost::asio::const_buffer(reply));
 				}
 			}
 
@@ -44,10 +44,118 @@
 
 #include "osi/checksum_helper.hpp"
 
+#include <algorithm>
+#include <cstring>
+
+#include <cpu_features.hpp>
+
+#if defined(__SSE2__) || (defined(_MSC_VER) && (defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))))
+#define ASIOTAP_CHECKSUM_USE_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace asiotap
 {
 	namespace osi
 	{
+		namespace
+		{
+			/**
+			 * \brief Fold a wide one's complement accumulator down to 16 bits.
+			 * \param sum The accumulator.
+			 * \return The folded value.
+			 *
+			 * Since 2^16 is congruent to 1 modulo 0xFFFF, folding preserves the one's complement sum whatever the accumulation width, so the wide kernels below compute exactly the same checksum as a plain 16-bit word loop.
+			 */
+			inline uint32_t fold_checksum(uint64_t sum)
+			{
+				while (sum >> 16)
+				{
+					sum = (sum & 0xFFFF) + (sum >> 16);
+				}
+
+				return static_cast<uint32_t>(sum);
+			}
+
+			/**
+			 * \brief Sum as many whole words as possible from a buffer, advancing it.
+			 * \param buf The buffer. Advanced past the consumed words.
+			 * \param buf_len The buffer length, in bytes. Decremented accordingly.
+			 * \return The folded partial sum.
+			 */
+			uint32_t sum_bulk_plain(const uint16_t*& buf, size_t& buf_len)
+			{
+				// One's complement addition over 64-bit words: the end-around carry is re-injected after every add.
+				uint64_t sum = 0;
+
+				while (buf_len >= sizeof(uint64_t))
+				{
+					uint64_t word;
+					std::memcpy(&word, buf, sizeof(word));
+
+					buf += sizeof(uint64_t) / sizeof(uint16_t);
+					buf_len -= sizeof(uint64_t);
+
+					sum += word;
+
+					if (sum < word)
+					{
+						++sum;
+					}
+				}
+
+				return fold_checksum(sum);
+			}
+
+#ifdef ASIOTAP_CHECKSUM_USE_SSE2
+			uint32_t sum_bulk_sse2(const uint16_t*& buf, size_t& buf_len)
+			{
+				uint64_t total = 0;
+
+				// The vectorized kernel widens the 16-bit words to 32-bit lanes and sums 32 bytes per iteration. The lanes grow by at most 2^18 per iteration, so the accumulator is drained long before a lane can overflow.
+				while (buf_len >= 32)
+				{
+					const __m128i zero = _mm_setzero_si128();
+					__m128i acc = zero;
+
+					size_t iterations = std::min<size_t>(buf_len / 32, 8192);
+					buf_len -= iterations * 32;
+
+					for (; iterations > 0; --iterations)
+					{
+						const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf));
+						const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 8));
+
+						buf += 16;
+
+						acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(low, zero));
+						acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(low, zero));
+						acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(high, zero));
+						acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(high, zero));
+					}
+
+					uint32_t lanes[4];
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+
+					total += fold_checksum(static_cast<uint64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3]);
+				}
+
+				// The remaining words are too few for the vectorized loop.
+				return fold_checksum(total + sum_bulk_plain(buf, buf_len));
+			}
+#endif
+
+			typedef uint32_t (*sum_bulk_function_type)(const uint16_t*&, size_t&);
+
+			// The kernel is bound once from the features of the running CPU, so update() pays no per-call feature check.
+			const sum_bulk_function_type sum_bulk = cpu_features::select<sum_bulk_function_type>(
+				&sum_bulk_plain
+#ifdef ASIOTAP_CHECKSUM_USE_SSE2
+				, &sum_bulk_sse2
+#endif
+			);
+		}
+
 		void checksum_helper::update(const uint16_t* buf, size_t buf_len)
 		{
 			if (buf_len > 0)
@@ -59,6 +167,11 @@ namespace asiotap
 					m_left = 0;
 				}
 
+				if (buf_len >= sizeof(uint64_t))
+				{
+					m_checksum += sum_bulk(buf, buf_len);
+				}
+
 				while (buf_len > 1)
 				{
 					m_checksum += *buf++;
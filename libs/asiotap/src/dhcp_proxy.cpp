@@ -58,6 +58,8 @@
 
 #include <boost/foreach.hpp>
 
+#include <cstring>
+
 namespace asiotap
 {
 	namespace osi
@@ -131,17 +133,15 @@ namespace asiotap
 					if (message_type_option != dhcp_helper.end())
 					{
 						bool info = false;
+						bool known_kind = true;
+						reply_kind_type kind = reply_kind_offer;
 
 						const_helper<dhcp_frame>::const_iterator requested_ip_address_option = dhcp_helper.find(dhcp_option::requested_ip_address);
 
-						size_t payload_size;
-
-						builder<dhcp_frame> dhcp_builder(response_buffer);
-
 						switch (message_type_option->value_as<uint8_t>())
 						{
 							case DHCP_DISCOVER_MESSAGE:
-								dhcp_builder.add_option(dhcp_option::dhcp_message_type, DHCP_OFFER_MESSAGE);
+								kind = reply_kind_offer;
 								break;
 
 							case DHCP_REQUEST_MESSAGE:
@@ -151,33 +151,33 @@ namespace asiotap
 
 									if (requested_ip_address != entry->second.address)
 									{
-										dhcp_builder.add_option(dhcp_option::dhcp_message_type, DHCP_NEGATIVE_ACKNOWLEDGMENT_MESSAGE);
+										kind = reply_kind_negative_acknowledgment;
 									}
 									else
 									{
-										dhcp_builder.add_option(dhcp_option::dhcp_message_type, DHCP_ACKNOWLEDGMENT_MESSAGE);
+										kind = reply_kind_acknowledgment;
 									}
 								}
 								else
 								{
-									dhcp_builder.add_option(dhcp_option::dhcp_message_type, DHCP_NEGATIVE_ACKNOWLEDGMENT_MESSAGE);
+									kind = reply_kind_negative_acknowledgment;
 								}
 								break;
 
 							case DHCP_INFORMATIONAL_MESSAGE:
-								dhcp_builder.add_option(dhcp_option::dhcp_message_type, DHCP_ACKNOWLEDGMENT_MESSAGE);
+								kind = reply_kind_informational_acknowledgment;
 								info = true;
 								break;
-						}
-
-						dhcp_builder.add_option(dhcp_option::server_identifier, boost::asio::buffer(m_software_address.to_bytes()));
 
-						if (!info)
-						{
-							const uint32_t lease_time = htonl(m_lease_time.total_seconds());
-							dhcp_builder.add_option(dhcp_option::ip_address_lease_time, &lease_time, sizeof(lease_time));
+							default:
+								// The original request is answered anyway, but its reply is not worth a template.
+								known_kind = false;
+								break;
 						}
 
+						// The count of subnet mask requests determines the shape of the reply, so it is part of the template identity.
+						size_t subnet_mask_requests = 0;
+
 						BOOST_FOREACH(dhcp_option_helper<const_helper_tag>& dhcp_option_helper, dhcp_helper)
 						{
 							switch (dhcp_option_helper.tag())
@@ -193,7 +193,7 @@ namespace asiotap
 											switch (static_cast<dhcp_option::dhcp_option_tag>(options[i]))
 											{
 												case dhcp_option::subnet_mask:
-													dhcp_builder.add_option(dhcp_option::subnet_mask, boost::asio::buffer(prefix_length_to_netmask_v4(entry->second.prefix_length).to_bytes()));
+													++subnet_mask_requests;
 													break;
 
 												default:
@@ -208,6 +208,93 @@ namespace asiotap
 							}
 						}
 
+						cached_reply_set_type* const cached_replies = known_kind ? &m_reply_cache[ethernet_address_source] : nullptr;
+
+						if (cached_replies)
+						{
+							const cached_reply_type& cached_reply = (*cached_replies)[kind];
+
+							if ((cached_reply.frame_size > 0) && (cached_reply.subnet_mask_requests == subnet_mask_requests))
+							{
+								// A template exists for this lease and message type: copy it at the end of the response buffer and patch the requester-specific fields in place.
+								uint8_t* const frame = boost::asio::buffer_cast<uint8_t*>(response_buffer) + (boost::asio::buffer_size(response_buffer) - cached_reply.frame_size);
+
+								std::memcpy(frame, cached_reply.frame_data.data(), cached_reply.frame_size);
+
+								const boost::asio::mutable_buffer reply = response_buffer + (boost::asio::buffer_size(response_buffer) - cached_reply.frame_size);
+
+								mutable_helper<ethernet_frame> ethernet_reply_helper(reply);
+
+								boost::asio::buffer_copy(ethernet_reply_helper.target(), ethernet_helper.sender());
+
+								mutable_helper<ipv4_frame> ipv4_reply_helper(ethernet_reply_helper.payload());
+
+								ipv4_reply_helper.set_tos(ipv4_helper.tos());
+								ipv4_reply_helper.set_identification(ipv4_helper.identification());
+								ipv4_reply_helper.set_flags(ipv4_helper.flags());
+								ipv4_reply_helper.set_position_fragment(ipv4_helper.position_fragment());
+								ipv4_reply_helper.set_ttl(ipv4_helper.ttl());
+								ipv4_reply_helper.set_destination(ipv4_helper.source());
+								ipv4_reply_helper.set_checksum(0x0000);
+								ipv4_reply_helper.set_checksum(ipv4_reply_helper.compute_checksum());
+
+								mutable_helper<udp_frame> udp_reply_helper(ipv4_reply_helper.payload());
+
+								udp_reply_helper.set_source(udp_helper.destination());
+								udp_reply_helper.set_destination(udp_helper.source());
+
+								mutable_helper<bootp_frame> bootp_reply_helper(udp_reply_helper.payload());
+
+								bootp_reply_helper.set_xid(bootp_helper.xid());
+								bootp_reply_helper.set_seconds(bootp_helper.seconds());
+								bootp_reply_helper.set_flags(bootp_helper.flags());
+
+								udp_reply_helper.set_checksum(0x0000);
+								udp_reply_helper.set_checksum(udp_reply_helper.compute_checksum(const_helper<ipv4_frame>(ethernet_reply_helper.payload())));
+
+								return boost::make_optional<boost::asio::const_buffer>(boost::asio::const_buffer(reply));
+							}
+						}
+
+						size_t payload_size;
+
+						builder<dhcp_frame> dhcp_builder(response_buffer);
+
+						if (known_kind)
+						{
+							switch (kind)
+							{
+								case reply_kind_offer:
+									dhcp_builder.add_option(dhcp_option::dhcp_message_type, DHCP_OFFER_MESSAGE);
+									break;
+
+								case reply_kind_acknowledgment:
+								case reply_kind_informational_acknowledgment:
+									dhcp_builder.add_option(dhcp_option::dhcp_message_type, DHCP_ACKNOWLEDGMENT_MESSAGE);
+									break;
+
+								case reply_kind_negative_acknowledgment:
+									dhcp_builder.add_option(dhcp_option::dhcp_message_type, DHCP_NEGATIVE_ACKNOWLEDGMENT_MESSAGE);
+									break;
+
+								default:
+									break;
+							}
+						}
+
+						dhcp_builder.add_option(dhcp_option::server_identifier, boost::asio::buffer(m_software_address.to_bytes()));
+
+						if (!info)
+						{
+							const uint32_t lease_time = htonl(m_lease_time.total_seconds());
+							dhcp_builder.add_option(dhcp_option::ip_address_lease_time, &lease_time, sizeof(lease_time));
+						}
+
+						for (size_t i = 0; i < subnet_mask_requests; ++i)
+						{
+							dhcp_builder.add_option(dhcp_option::subnet_mask, boost::asio::buffer(prefix_length_to_netmask_v4(entry->second.prefix_length).to_bytes()));
+						}
+
 						dhcp_builder.add_option(dhcp_option::end);
 						dhcp_builder.complete_padding(60);
 						payload_size = dhcp_builder.write();
@@ -254,7 +341,18 @@ namespace asiotap
 
 						payload_size = ethernet_builder.write(ethernet_helper.sender(), boost::asio::buffer(m_hardware_address), ethernet_helper.protocol());
 
-						return boost::make_optional<boost::asio::const_buffer>(response_buffer + (boost::asio::buffer_size(response_buffer) - payload_size));
+						const boost::asio::const_buffer reply = response_buffer + (boost::asio::buffer_size(response_buffer) - payload_size);
+
+						if (cached_replies && (payload_size <= (*cached_replies)[kind].frame_data.size()))
+						{
+							cached_reply_type& cached_reply = (*cached_replies)[kind];
+
+							std::memcpy(cached_reply.frame_data.data(), boost::asio::buffer_cast<const uint8_t*>(reply), payload_size);
+							cached_reply.frame_size = payload_size;
+							cached_reply.subnet_mask_requests = subnet_mask_requests;
+						}
+
+						return boost::make_optional<boost::asio::const_buffer>(boost::asio::const_buffer(reply));
 					}
 				}
 			}
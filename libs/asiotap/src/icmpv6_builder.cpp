@@ -0,0 +1,85 @@
+/*
+ * libasiotap - A portable TAP adapter extension for Boost::ASIO.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libasiotap.
+ *
+ * libasiotap is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libasiotap is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libasiotap in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file icmpv6_builder.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An ICMPv6 neighbor discovery frame builder class.
+ */
+
+#include "osi/icmpv6_builder.hpp"
+
+#include "osi/icmpv6_helper.hpp"
+#include "osi/ethernet_frame.hpp"
+
+#include <cassert>
+#include <cstring>
+
+namespace asiotap
+{
+	namespace osi
+	{
+		size_t builder<icmpv6_frame>::write(
+		    uint8_t type,
+		    uint32_t flags,
+		    const boost::asio::ip::address_v6& target,
+		    boost::asio::const_buffer link_layer_address
+		) const
+		{
+			assert(boost::asio::buffer_size(payload()) >= ICMPV6_ND_LINK_LAYER_OPTION_SIZE);
+			assert(boost::asio::buffer_size(link_layer_address) == ETHERNET_ADDRESS_SIZE);
+
+			helper_type helper = get_helper();
+
+			helper.set_type(type);
+			helper.set_code(0x00);
+			helper.set_flags(flags);
+			helper.set_target(target);
+			helper.set_checksum(0x0000);
+
+			uint8_t* const option = boost::asio::buffer_cast<uint8_t*>(payload());
+
+			option[0] = (type == ICMPV6_ND_NEIGHBOR_SOLICITATION) ? ICMPV6_ND_OPTION_SOURCE_LINK_LAYER_ADDRESS : ICMPV6_ND_OPTION_TARGET_LINK_LAYER_ADDRESS;
+			option[1] = 0x01;
+
+			std::memcpy(&option[2], boost::asio::buffer_cast<const uint8_t*>(link_layer_address), ETHERNET_ADDRESS_SIZE);
+
+			return sizeof(frame_type) + boost::asio::buffer_size(payload());
+		}
+	}
+}
@@ -0,0 +1,80 @@
+/*
+ * libasiotap - A portable TAP adapter extension for Boost::ASIO.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libasiotap.
+ *
+ * libasiotap is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libasiotap is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libasiotap in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file icmpv6_helper.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An ICMPv6 neighbor discovery helper class.
+ */
+
+#include "osi/icmpv6_helper.hpp"
+
+#include "osi/checksum_helper.hpp"
+
+#include <cstring>
+
+namespace asiotap
+{
+	namespace osi
+	{
+		template <class HelperTag>
+		uint16_t _base_helper_impl<HelperTag, icmpv6_frame>::compute_checksum(const_helper<ipv6_frame> parent_frame) const
+		{
+			const uint16_t* buf = boost::asio::buffer_cast<const uint16_t*>(this->buffer());
+			const size_t buf_len = boost::asio::buffer_size(this->buffer());
+
+			icmpv6_pseudo_header pseudo_header;
+			std::memset(&pseudo_header, 0x00, sizeof(pseudo_header));
+
+			pseudo_header.ipv6_source = parent_frame.frame().source;
+			pseudo_header.ipv6_destination = parent_frame.frame().destination;
+			pseudo_header.upper_layer_length = htonl(static_cast<uint32_t>(buf_len));
+			pseudo_header.ipv6_next_header = ICMPV6_PROTOCOL;
+
+			checksum_helper chk;
+
+			chk.update(reinterpret_cast<const uint16_t*>(&pseudo_header), sizeof(pseudo_header));
+			chk.update(buf, buf_len);
+
+			return chk.compute();
+		}
+
+		template uint16_t _base_helper_impl<const_helper_tag, icmpv6_frame>::compute_checksum(const_helper<ipv6_frame>) const;
+		template uint16_t _base_helper_impl<mutable_helper_tag, icmpv6_frame>::compute_checksum(const_helper<ipv6_frame>) const;
+	}
+}
@@ -0,0 +1,185 @@
+/*
+ * libasiotap - A portable TAP adapter extension for Boost::ASIO.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libasiotap.
+ *
+ * libasiotap is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libasiotap is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libasiotap in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file icmpv6_proxy.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An ICMPv6 neighbor discovery proxy class.
+ */
+
+#include "osi/icmpv6_proxy.hpp"
+
+#include "osi/ethernet_helper.hpp"
+#include "osi/ipv6_helper.hpp"
+#include "osi/icmpv6_helper.hpp"
+
+#include "osi/ethernet_builder.hpp"
+#include "osi/ipv6_builder.hpp"
+#include "osi/icmpv6_builder.hpp"
+
+#include <cstring>
+
+namespace asiotap
+{
+	namespace osi
+	{
+		namespace
+		{
+			/**
+			 * \brief The hop limit all neighbor discovery messages must carry.
+			 */
+			const uint8_t ND_HOP_LIMIT = 255;
+
+			boost::asio::ip::address_v6 all_nodes_address()
+			{
+				const boost::asio::ip::address_v6::bytes_type bytes = {{ 0xff, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01 }};
+
+				return boost::asio::ip::address_v6(bytes);
+			}
+		}
+
+		boost::optional<boost::asio::const_buffer> proxy<icmpv6_frame>::process_frame(const_helper<ethernet_frame> ethernet_helper, const_helper<ipv6_frame> ipv6_helper, const_helper<icmpv6_frame> icmpv6_helper, boost::asio::mutable_buffer response_buffer) const
+		{
+			if (icmpv6_helper.type() == ICMPV6_ND_NEIGHBOR_SOLICITATION)
+			{
+				const boost::asio::ip::address_v6 target = icmpv6_helper.target();
+
+				const entry_map_type::const_iterator entry_it = m_entry_map.find(target);
+
+				ethernet_address_type eth_addr;
+
+				bool should_answer = false;
+
+				if (entry_it != m_entry_map.end())
+				{
+					eth_addr = entry_it->second;
+					should_answer = true;
+				}
+				else
+				{
+					if (m_neighbor_solicitation_callback)
+					{
+						should_answer = m_neighbor_solicitation_callback(target, eth_addr);
+					}
+				}
+
+				if (should_answer)
+				{
+					// A solicitation from an unspecified source is part of duplicate address detection: the advertisement goes to all nodes and must not claim to be solicited.
+					const bool unspecified_sender = ipv6_helper.source().is_unspecified();
+					const boost::asio::ip::address_v6 destination = unspecified_sender ? all_nodes_address() : ipv6_helper.source();
+					const uint32_t flags = unspecified_sender ? ICMPV6_ND_FLAG_OVERRIDE : (ICMPV6_ND_FLAG_SOLICITED | ICMPV6_ND_FLAG_OVERRIDE);
+
+					cached_reply_type& cached_reply = m_reply_cache[target];
+
+					if (cached_reply.frame_size > 0)
+					{
+						// The advertisement frame was built before: copy it and patch only the requester-specific fields.
+						const boost::asio::mutable_buffer reply = response_buffer + (boost::asio::buffer_size(response_buffer) - cached_reply.frame_size);
+
+						std::memcpy(boost::asio::buffer_cast<uint8_t*>(reply), cached_reply.frame_data.data(), cached_reply.frame_size);
+
+						mutable_helper<ethernet_frame> ethernet_reply_helper(reply);
+
+						boost::asio::buffer_copy(ethernet_reply_helper.target(), ethernet_helper.sender());
+
+						mutable_helper<ipv6_frame> ipv6_reply_helper(ethernet_reply_helper.payload());
+
+						ipv6_reply_helper.set_destination(destination);
+
+						mutable_helper<icmpv6_frame> icmpv6_reply_helper(ipv6_reply_helper.payload());
+
+						icmpv6_reply_helper.set_flags(flags);
+						icmpv6_reply_helper.set_checksum(0x0000);
+						icmpv6_reply_helper.set_checksum(icmpv6_reply_helper.compute_checksum(const_helper<ipv6_frame>(ipv6_reply_helper)));
+
+						return boost::make_optional<boost::asio::const_buffer>(reply);
+					}
+
+					size_t payload_size;
+
+					builder<icmpv6_frame> icmpv6_builder(response_buffer, ICMPV6_ND_LINK_LAYER_OPTION_SIZE);
+
+					payload_size = icmpv6_builder.write(
+					                   ICMPV6_ND_NEIGHBOR_ADVERTISEMENT,
+					                   flags,
+					                   target,
+					                   boost::asio::buffer(eth_addr.data())
+					               );
+
+					builder<ipv6_frame> ipv6_builder(response_buffer, payload_size);
+
+					payload_size = ipv6_builder.write(
+					                   ICMPV6_PROTOCOL,
+					                   ND_HOP_LIMIT,
+					                   target,
+					                   destination
+					               );
+
+					builder<ethernet_frame> ethernet_builder(response_buffer, payload_size);
+
+					payload_size = ethernet_builder.write(
+					                   ethernet_helper.sender(),
+					                   boost::asio::buffer(eth_addr.data()),
+					                   IPV6_PROTOCOL
+					               );
+
+					const boost::asio::mutable_buffer reply = response_buffer + (boost::asio::buffer_size(response_buffer) - payload_size);
+
+					// The builders leave the checksum zeroed: it depends on the IPv6 header, which only exists now.
+					mutable_helper<ethernet_frame> ethernet_reply_helper(reply);
+					mutable_helper<ipv6_frame> ipv6_reply_helper(ethernet_reply_helper.payload());
+					mutable_helper<icmpv6_frame> icmpv6_reply_helper(ipv6_reply_helper.payload());
+
+					icmpv6_reply_helper.set_checksum(icmpv6_reply_helper.compute_checksum(const_helper<ipv6_frame>(ipv6_reply_helper)));
+
+					if (payload_size <= cached_reply.frame_data.size())
+					{
+						// Remember the built frame so the next solicitation for this address only patches it.
+						std::memcpy(cached_reply.frame_data.data(), boost::asio::buffer_cast<const uint8_t*>(reply), payload_size);
+						cached_reply.frame_size = payload_size;
+					}
+
+					return boost::make_optional<boost::asio::const_buffer>(boost::asio::const_buffer(reply));
+				}
+			}
+
+			return boost::optional<boost::asio::const_buffer>();
+		}
+	}
+}
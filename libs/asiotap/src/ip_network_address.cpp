@@ -154,6 +154,71 @@ namespace asiotap
 	template std::istream& operator>>(std::istream& is, ipv4_network_address& value);
 	template std::istream& operator>>(std::istream& is, ipv6_network_address& value);
 
+	template <typename AddressType>
+	const char* read_ip_network_address(const char* begin, const char* end, base_ip_network_address<AddressType>& value)
+	{
+		string_range ip_address;
+		string_range prefix_length;
+
+		const char* pos = read_ip_address_prefix_length<AddressType>(begin, end, ip_address, prefix_length);
+
+		if (!pos)
+		{
+			return nullptr;
+		}
+
+		AddressType address;
+
+		if (!string_range_to_address(ip_address, address))
+		{
+			return nullptr;
+		}
+
+		if (string_range_size(prefix_length) == 0)
+		{
+			value = base_ip_network_address<AddressType>(address);
+		}
+		else
+		{
+			unsigned int num_prefix_length = 0;
+
+			for (const char* p = prefix_length.first; p != prefix_length.last; ++p)
+			{
+				num_prefix_length = num_prefix_length * 10 + static_cast<unsigned int>(*p - '0');
+			}
+
+			value = base_ip_network_address<AddressType>(address, num_prefix_length);
+		}
+
+		return pos;
+	}
+
+	template const char* read_ip_network_address<boost::asio::ip::address_v4>(const char* begin, const char* end, ipv4_network_address& value);
+	template const char* read_ip_network_address<boost::asio::ip::address_v6>(const char* begin, const char* end, ipv6_network_address& value);
+
+	const char* read_ip_network_address(const char* begin, const char* end, ip_network_address& value)
+	{
+		ipv6_network_address ina6;
+
+		if (const char* pos = read_ip_network_address(begin, end, ina6))
+		{
+			value = ina6;
+
+			return pos;
+		}
+
+		ipv4_network_address ina4;
+
+		if (const char* pos = read_ip_network_address(begin, end, ina4))
+		{
+			value = ina4;
+
+			return pos;
+		}
+
+		return nullptr;
+	}
+
 	template <typename AddressType>
 	std::ostream& operator<<(std::ostream& os, const base_ip_network_address<AddressType>& value)
 	{
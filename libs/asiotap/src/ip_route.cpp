@@ -86,6 +86,67 @@ namespace asiotap
 	template std::istream& operator>>(std::istream& is, ipv4_route& value);
 	template std::istream& operator>>(std::istream& is, ipv6_route& value);
 
+	template <typename AddressType>
+	const char* read_ip_route(const char* begin, const char* end, base_ip_route<AddressType>& value)
+	{
+		string_range ip_address;
+		string_range prefix_length;
+		string_range gateway;
+
+		const char* pos = read_ip_address_prefix_length_gateway<AddressType>(begin, end, ip_address, prefix_length, gateway);
+
+		if (!pos)
+		{
+			return nullptr;
+		}
+
+		AddressType address;
+
+		if (!string_range_to_address(ip_address, address))
+		{
+			return nullptr;
+		}
+
+		base_ip_network_address<AddressType> ina;
+
+		if (string_range_size(prefix_length) == 0)
+		{
+			ina = base_ip_network_address<AddressType>(address);
+		}
+		else
+		{
+			unsigned int num_prefix_length = 0;
+
+			for (const char* p = prefix_length.first; p != prefix_length.last; ++p)
+			{
+				num_prefix_length = num_prefix_length * 10 + static_cast<unsigned int>(*p - '0');
+			}
+
+			ina = base_ip_network_address<AddressType>(address, num_prefix_length);
+		}
+
+		if (string_range_size(gateway) == 0)
+		{
+			value = base_ip_route<AddressType>(ina);
+		}
+		else
+		{
+			AddressType gateway_address;
+
+			if (!string_range_to_address(gateway, gateway_address))
+			{
+				return nullptr;
+			}
+
+			value = base_ip_route<AddressType>(ina, boost::optional<AddressType>(gateway_address));
+		}
+
+		return pos;
+	}
+
+	template const char* read_ip_route<boost::asio::ip::address_v4>(const char* begin, const char* end, ipv4_route& value);
+	template const char* read_ip_route<boost::asio::ip::address_v6>(const char* begin, const char* end, ipv6_route& value);
+
 	template <typename AddressType>
 	std::ostream& operator<<(std::ostream& os, const base_ip_route<AddressType>& value)
 	{
@@ -133,6 +194,29 @@ namespace asiotap
 		return is;
 	}
 
+	const char* read_ip_route(const char* begin, const char* end, ip_route& value)
+	{
+		ipv6_route ir6;
+
+		if (const char* pos = read_ip_route(begin, end, ir6))
+		{
+			value = ir6;
+
+			return pos;
+		}
+
+		ipv4_route ir4;
+
+		if (const char* pos = read_ip_route(begin, end, ir4))
+		{
+			value = ir4;
+
+			return pos;
+		}
+
+		return nullptr;
+	}
+
 	std::ostream& operator<<(std::ostream& os, const ip_route_set& routes)
 	{
 		if (routes.size() > 0)
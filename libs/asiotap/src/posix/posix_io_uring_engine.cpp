@@ -0,0 +1,471 @@
+/*
+ * libasiotap - A portable TAP adapter extension for Boost::ASIO.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libasiotap.
+ *
+ * libasiotap is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libasiotap is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libasiotap in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+
+/**
+ * \file posix_io_uring_engine.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An io_uring I/O engine for POSIX descriptors.
+ */
+
+#include "posix/posix_io_uring_engine.hpp"
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <boost/bind.hpp>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define ASIOTAP_HAS_IO_URING
+#endif
+#endif
+
+#ifdef ASIOTAP_HAS_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+
+#ifndef __NR_io_uring_register
+#define __NR_io_uring_register 427
+#endif
+
+#endif
+
+namespace asiotap
+{
+#ifdef ASIOTAP_HAS_IO_URING
+	namespace
+	{
+		int io_uring_setup(unsigned int entries, struct io_uring_params* params)
+		{
+			return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+		}
+
+		int io_uring_enter(int ring_fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+		{
+			return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0));
+		}
+
+		int io_uring_register(int ring_fd, unsigned int opcode, const void* arg, unsigned int nr_args)
+		{
+			return static_cast<int>(::syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args));
+		}
+
+		template <typename Type>
+		Type* ring_pointer(void* ring, uint32_t offset)
+		{
+			return reinterpret_cast<Type*>(static_cast<uint8_t*>(ring) + offset);
+		}
+	}
+#endif
+
+	posix_io_uring_engine::posix_io_uring_engine(boost::asio::io_service& _io_service) :
+		m_io_service(_io_service),
+		m_eventfd(_io_service),
+		m_ring_fd(-1),
+		m_target_fd(-1),
+		m_sq_ring(NULL),
+		m_sq_ring_size(0),
+		m_cq_ring(NULL),
+		m_cq_ring_size(0),
+		m_sqes(NULL),
+		m_sqes_size(0),
+		m_sq_entries(0),
+		m_sq_mask(0),
+		m_sq_head_offset(0),
+		m_sq_tail_offset(0),
+		m_sq_array_offset(0),
+		m_cq_mask(0),
+		m_cq_head_offset(0),
+		m_cq_tail_offset(0),
+		m_cqes_offset(0),
+		m_next_operation_id(1)
+	{
+	}
+
+	posix_io_uring_engine::~posix_io_uring_engine()
+	{
+		close();
+	}
+
+#ifdef ASIOTAP_HAS_IO_URING
+
+	bool posix_io_uring_engine::open(int fd, unsigned int entries)
+	{
+		if (is_open())
+		{
+			return true;
+		}
+
+		struct io_uring_params params;
+		std::memset(&params, 0, sizeof(params));
+
+		const int ring_fd = io_uring_setup(entries, &params);
+
+		if (ring_fd < 0)
+		{
+			// The kernel has no io_uring support (or it is administratively disabled).
+			return false;
+		}
+
+		size_t sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+		size_t cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+		{
+			sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+		}
+
+		void* const sq_ring = ::mmap(NULL, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+
+		if (sq_ring == MAP_FAILED)
+		{
+			::close(ring_fd);
+
+			return false;
+		}
+
+		void* cq_ring = sq_ring;
+
+		if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+		{
+			cq_ring = ::mmap(NULL, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+
+			if (cq_ring == MAP_FAILED)
+			{
+				::munmap(sq_ring, sq_ring_size);
+				::close(ring_fd);
+
+				return false;
+			}
+		}
+
+		const size_t sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+		void* const sqes = ::mmap(NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+
+		const int event_fd = (sqes != MAP_FAILED) ? ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) : -1;
+
+		if ((sqes == MAP_FAILED) || (event_fd < 0) || (io_uring_register(ring_fd, IORING_REGISTER_EVENTFD, &event_fd, 1) != 0))
+		{
+			if (event_fd >= 0)
+			{
+				::close(event_fd);
+			}
+
+			if (sqes != MAP_FAILED)
+			{
+				::munmap(sqes, sqes_size);
+			}
+
+			if (cq_ring != sq_ring)
+			{
+				::munmap(cq_ring, cq_ring_size);
+			}
+
+			::munmap(sq_ring, sq_ring_size);
+			::close(ring_fd);
+
+			return false;
+		}
+
+		m_ring_fd = ring_fd;
+		m_target_fd = fd;
+		m_sq_ring = sq_ring;
+		m_sq_ring_size = sq_ring_size;
+		m_cq_ring = cq_ring;
+		m_cq_ring_size = cq_ring_size;
+		m_sqes = sqes;
+		m_sqes_size = sqes_size;
+		m_sq_entries = params.sq_entries;
+		m_sq_mask = *ring_pointer<unsigned int>(sq_ring, params.sq_off.ring_mask);
+		m_sq_head_offset = params.sq_off.head;
+		m_sq_tail_offset = params.sq_off.tail;
+		m_sq_array_offset = params.sq_off.array;
+		m_cq_mask = *ring_pointer<unsigned int>(cq_ring, params.cq_off.ring_mask);
+		m_cq_head_offset = params.cq_off.head;
+		m_cq_tail_offset = params.cq_off.tail;
+		m_cqes_offset = params.cq_off.cqes;
+
+		m_eventfd.assign(event_fd);
+
+		await_completions();
+
+		return true;
+	}
+
+	void posix_io_uring_engine::close()
+	{
+		pending_operation_map pending_operations;
+
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			if (!is_open())
+			{
+				return;
+			}
+
+			pending_operations.swap(m_pending_operations);
+
+			boost::system::error_code ignored_ec;
+
+			// This cancels the completion wait and closes the eventfd.
+			m_eventfd.close(ignored_ec);
+
+			::munmap(m_sqes, m_sqes_size);
+
+			if (m_cq_ring != m_sq_ring)
+			{
+				::munmap(m_cq_ring, m_cq_ring_size);
+			}
+
+			::munmap(m_sq_ring, m_sq_ring_size);
+			::close(m_ring_fd);
+
+			m_ring_fd = -1;
+			m_target_fd = -1;
+			m_sq_ring = m_cq_ring = m_sqes = NULL;
+		}
+
+		// The in-flight operations die with the ring: their handlers are failed from here.
+		for (pending_operation_map::const_iterator operation = pending_operations.begin(); operation != pending_operations.end(); ++operation)
+		{
+			m_io_service.post(boost::bind(operation->second, boost::asio::error::operation_aborted, static_cast<size_t>(0)));
+		}
+	}
+
+	void posix_io_uring_engine::async_read(boost::asio::mutable_buffer buffer, io_handler_type handler)
+	{
+		submit(IORING_OP_READ, boost::asio::buffer_cast<void*>(buffer), static_cast<unsigned int>(boost::asio::buffer_size(buffer)), handler);
+	}
+
+	void posix_io_uring_engine::async_write(boost::asio::const_buffer buffer, io_handler_type handler)
+	{
+		submit(IORING_OP_WRITE, boost::asio::buffer_cast<const void*>(buffer), static_cast<unsigned int>(boost::asio::buffer_size(buffer)), handler);
+	}
+
+	void posix_io_uring_engine::submit(uint8_t opcode, const void* addr, unsigned int len, io_handler_type handler)
+	{
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			if (!is_open())
+			{
+				m_io_service.post(boost::bind(handler, boost::asio::error::operation_aborted, static_cast<size_t>(0)));
+
+				return;
+			}
+
+			unsigned int* const sq_head = ring_pointer<unsigned int>(m_sq_ring, m_sq_head_offset);
+			unsigned int* const sq_tail = ring_pointer<unsigned int>(m_sq_ring, m_sq_tail_offset);
+			unsigned int* const sq_array = ring_pointer<unsigned int>(m_sq_ring, m_sq_array_offset);
+
+			const unsigned int tail = __atomic_load_n(sq_tail, __ATOMIC_ACQUIRE);
+			const unsigned int head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+
+			if (tail - head >= m_sq_entries)
+			{
+				// The submission queue is full. This should not happen with a properly sized ring.
+				m_io_service.post(boost::bind(handler, boost::system::error_code(boost::asio::error::try_again), static_cast<size_t>(0)));
+
+				return;
+			}
+
+			const unsigned int index = tail & m_sq_mask;
+
+			struct io_uring_sqe* const sqe = &static_cast<struct io_uring_sqe*>(m_sqes)[index];
+
+			std::memset(sqe, 0, sizeof(*sqe));
+
+			sqe->opcode = opcode;
+			sqe->fd = m_target_fd;
+			sqe->addr = reinterpret_cast<uint64_t>(addr);
+			sqe->len = len;
+
+			const uint64_t operation_id = m_next_operation_id++;
+
+			sqe->user_data = operation_id;
+			sq_array[index] = index;
+
+			__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+			m_pending_operations[operation_id] = handler;
+
+			if (io_uring_enter(m_ring_fd, 1, 0, 0) >= 0)
+			{
+				return;
+			}
+
+			const int error = errno;
+
+			m_pending_operations.erase(operation_id);
+
+			m_io_service.post(boost::bind(handler, boost::system::error_code(error, boost::system::system_category()), static_cast<size_t>(0)));
+		}
+	}
+
+	void posix_io_uring_engine::await_completions()
+	{
+		m_eventfd.async_read_some(
+			boost::asio::null_buffers(),
+			boost::bind(
+				&posix_io_uring_engine::handle_eventfd_readable,
+				this,
+				boost::asio::placeholders::error
+			)
+		);
+	}
+
+	void posix_io_uring_engine::handle_eventfd_readable(const boost::system::error_code& ec)
+	{
+		if (ec)
+		{
+			// The engine is being torn down.
+			return;
+		}
+
+		{
+			uint64_t event_count = 0;
+
+			const ssize_t read_result = ::read(m_eventfd.native_handle(), &event_count, sizeof(event_count));
+
+			// The count itself is meaningless: the completion queue below is authoritative.
+			static_cast<void>(read_result);
+		}
+
+		// The completions are collected under the lock, so a concurrent close() cannot unmap the ring under our feet, but the handlers run unlocked since they may submit new operations.
+		std::vector<std::pair<io_handler_type, int32_t> > completions;
+
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			if (!is_open())
+			{
+				return;
+			}
+
+			unsigned int* const cq_head = ring_pointer<unsigned int>(m_cq_ring, m_cq_head_offset);
+			unsigned int* const cq_tail = ring_pointer<unsigned int>(m_cq_ring, m_cq_tail_offset);
+			struct io_uring_cqe* const cqes = ring_pointer<struct io_uring_cqe>(m_cq_ring, m_cqes_offset);
+
+			unsigned int head = __atomic_load_n(cq_head, __ATOMIC_ACQUIRE);
+
+			while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+			{
+				const struct io_uring_cqe& cqe = cqes[head & m_cq_mask];
+
+				const pending_operation_map::iterator operation = m_pending_operations.find(cqe.user_data);
+
+				if (operation != m_pending_operations.end())
+				{
+					completions.push_back(std::make_pair(operation->second, cqe.res));
+
+					m_pending_operations.erase(operation);
+				}
+
+				++head;
+
+				__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+			}
+		}
+
+		for (std::vector<std::pair<io_handler_type, int32_t> >::const_iterator completion = completions.begin(); completion != completions.end(); ++completion)
+		{
+			if (completion->second < 0)
+			{
+				completion->first(boost::system::error_code(-completion->second, boost::system::system_category()), 0);
+			}
+			else
+			{
+				completion->first(boost::system::error_code(), static_cast<size_t>(completion->second));
+			}
+		}
+
+		await_completions();
+	}
+
+#else
+
+	bool posix_io_uring_engine::open(int, unsigned int)
+	{
+		return false;
+	}
+
+	void posix_io_uring_engine::close()
+	{
+	}
+
+	void posix_io_uring_engine::async_read(boost::asio::mutable_buffer, io_handler_type handler)
+	{
+		m_io_service.post(boost::bind(handler, boost::asio::error::operation_not_supported, static_cast<size_t>(0)));
+	}
+
+	void posix_io_uring_engine::async_write(boost::asio::const_buffer, io_handler_type handler)
+	{
+		m_io_service.post(boost::bind(handler, boost::asio::error::operation_not_supported, static_cast<size_t>(0)));
+	}
+
+	void posix_io_uring_engine::submit(uint8_t, const void*, unsigned int, io_handler_type)
+	{
+	}
+
+	void posix_io_uring_engine::await_completions()
+	{
+	}
+
+	void posix_io_uring_engine::handle_eventfd_readable(const boost::system::error_code&)
+	{
+	}
+
+#endif
+}
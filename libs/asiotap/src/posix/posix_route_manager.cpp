@@ -255,6 +255,32 @@ namespace asiotap
 		}
 	}
 
+	void posix_route_manager::register_routes(const std::vector<route_type>& routes)
+	{
+#if defined(MACINTOSH) || defined(FREELAN_DISABLE_NETLINK)
+		// There is no batched transaction on those systems: fall back to the generic one-at-a-time application.
+		base_route_manager<posix_route_manager, posix_routing_table_entry>::register_routes(routes);
+#else
+		std::vector<netlinkplus::route_specification> specifications;
+		specifications.reserve(routes.size());
+
+		for (auto&& route_entry : routes)
+		{
+			const auto ina = network_address(route_entry.route);
+
+			netlinkplus::route_specification specification;
+			specification.interface = netlinkplus::interface_entry(route_entry.interface);
+			specification.destination = ip_address(ina);
+			specification.destination_length = prefix_length(ina);
+			specification.gateway = gateway(route_entry.route);
+
+			specifications.push_back(specification);
+		}
+
+		m_netlink_manager.add_routes(specifications);
+#endif
+	}
+
 	void posix_route_manager::unregister_route(const route_type& route_entry)
 	{
 		const auto _gateway = gateway(route_entry.route);
@@ -269,4 +295,30 @@ namespace asiotap
 				set_route(route_action::remove, route_entry.interface, ina);
 		}
 	}
+
+	void posix_route_manager::unregister_routes(const std::vector<route_type>& routes)
+	{
+#if defined(MACINTOSH) || defined(FREELAN_DISABLE_NETLINK)
+		// There is no batched transaction on those systems: fall back to the generic one-at-a-time removal.
+		base_route_manager<posix_route_manager, posix_routing_table_entry>::unregister_routes(routes);
+#else
+		std::vector<netlinkplus::route_specification> specifications;
+		specifications.reserve(routes.size());
+
+		for (auto&& route_entry : routes)
+		{
+			const auto ina = network_address(route_entry.route);
+
+			netlinkplus::route_specification specification;
+			specification.interface = netlinkplus::interface_entry(route_entry.interface);
+			specification.destination = ip_address(ina);
+			specification.destination_length = prefix_length(ina);
+			specification.gateway = gateway(route_entry.route);
+
+			specifications.push_back(specification);
+		}
+
+		m_netlink_manager.remove_routes(specifications);
+#endif
+	}
 }
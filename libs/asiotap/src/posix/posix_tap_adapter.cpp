@@ -45,6 +45,10 @@
 #include "posix/posix_tap_adapter.hpp"
 
 #include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/ref.hpp>
+
+#include <fstream>
 
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -263,9 +267,19 @@ namespace asiotap
 
 		ifr.ifr_flags = IFF_NO_PI;
 
+#if defined(IFF_MULTI_QUEUE)
+		if (m_queue_count > 1)
+		{
+			// One file descriptor per queue: the kernel steers flows between them so the device stops being a single serialization point.
+			ifr.ifr_flags |= IFF_MULTI_QUEUE;
+		}
+		else
+#endif
+		{
 #if defined(IFF_ONE_QUEUE) && defined(SIOCSIFTXQLEN)
-		ifr.ifr_flags |= IFF_ONE_QUEUE;
+			ifr.ifr_flags |= IFF_ONE_QUEUE;
 #endif
+		}
 
 		if (layer() == tap_adapter_layer::ethernet)
 		{
@@ -276,6 +290,13 @@ namespace asiotap
 			ifr.ifr_flags |= IFF_TUN;
 		}
 
+#if defined(IFF_VNET_HDR) && defined(TUNSETOFFLOAD)
+		if (m_offload_enabled)
+		{
+			ifr.ifr_flags |= IFF_VNET_HDR;
+		}
+#endif
+
 		if (!_name.empty())
 		{
 			strncpy(ifr.ifr_name, _name.c_str(), IFNAMSIZ);
@@ -284,11 +305,85 @@ namespace asiotap
 		// Set the parameters on the tun device.
 		if (::ioctl(device.native_handle(), TUNSETIFF, (void *)&ifr) < 0)
 		{
-			ec = boost::system::error_code(errno, boost::system::system_category());
+#if defined(IFF_MULTI_QUEUE)
+			if ((ifr.ifr_flags & IFF_MULTI_QUEUE) != 0)
+			{
+				// The kernel may be too old to know about multi-queue devices: fall back to a single queue.
+				ifr.ifr_flags &= ~IFF_MULTI_QUEUE;
+				m_queue_count = 1;
 
-			return;
+				if (::ioctl(device.native_handle(), TUNSETIFF, (void *)&ifr) < 0)
+				{
+					ec = boost::system::error_code(errno, boost::system::system_category());
+
+					return;
+				}
+			}
+			else
+#endif
+#if defined(IFF_VNET_HDR) && defined(TUNSETOFFLOAD)
+			if ((ifr.ifr_flags & IFF_VNET_HDR) != 0)
+			{
+				// The kernel may be too old to know about virtio-net headers: try again without them.
+				ifr.ifr_flags &= ~IFF_VNET_HDR;
+
+				if (::ioctl(device.native_handle(), TUNSETIFF, (void *)&ifr) < 0)
+				{
+					ec = boost::system::error_code(errno, boost::system::system_category());
+
+					return;
+				}
+			}
+			else
+#endif
+			{
+				ec = boost::system::error_code(errno, boost::system::system_category());
+
+				return;
+			}
 		}
 
+#if defined(IFF_VNET_HDR) && defined(TUNSETOFFLOAD)
+		if ((ifr.ifr_flags & IFF_VNET_HDR) != 0)
+		{
+			// Every read and write now carries a virtio-net header, whether or not the offloads below get accepted. The length is that of struct virtio_net_hdr, which is part of the kernel ABI. We cannot include linux/virtio_net.h to get it since that header declares a member named "class".
+			m_vnet_header_length = 10;
+
+			if (::ioctl(device.native_handle(), TUNSETOFFLOAD, TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6) < 0)
+			{
+				// TSO may be unsupported: checksum offload alone is still worth having.
+				::ioctl(device.native_handle(), TUNSETOFFLOAD, TUN_F_CSUM);
+			}
+		}
+#endif
+
+		m_extra_queues.clear();
+
+#if defined(IFF_MULTI_QUEUE)
+		if ((ifr.ifr_flags & IFF_MULTI_QUEUE) != 0)
+		{
+			// The remaining queues attach to the interface the first TUNSETIFF just created: each one gets its own file descriptor.
+			for (size_t queue = 1; queue < m_queue_count; ++queue)
+			{
+				descriptor_handler queue_device = open_device(dev_name, ec);
+
+				if (!queue_device.valid())
+				{
+					return;
+				}
+
+				if (::ioctl(queue_device.native_handle(), TUNSETIFF, (void *)&ifr) < 0)
+				{
+					ec = boost::system::error_code(errno, boost::system::system_category());
+
+					return;
+				}
+
+				m_extra_queues.push_back(boost::make_shared<boost::asio::posix::stream_descriptor>(boost::ref(get_io_service()), queue_device.release()));
+			}
+		}
+#endif
+
 		descriptor_handler socket = open_socket(AF_INET, ec);
 
 		if (!socket.valid())
@@ -442,6 +537,17 @@ namespace asiotap
 		{
 			return;
 		}
+
+		if (m_io_uring_enabled)
+		{
+			// When the kernel supports it, the device I/O goes through an io_uring instead of the reactor. A setup failure is not an error: the plain descriptor path applies.
+			const boost::shared_ptr<posix_io_uring_engine> io_engine(new posix_io_uring_engine(get_io_service()));
+
+			if (io_engine->open(descriptor().native_handle(), 64))
+			{
+				m_io_engine = io_engine;
+			}
+		}
 	}
 
 	void posix_tap_adapter::open(const std::string& _name)
@@ -456,6 +562,23 @@ namespace asiotap
 		}
 	}
 
+	size_t posix_tap_adapter::get_dropped_frame_count() const
+	{
+#ifdef LINUX
+		// Frames the kernel could not queue towards us in time are accounted as transmit drops on the device.
+		std::ifstream file(("/sys/class/net/" + name() + "/statistics/tx_dropped").c_str());
+
+		size_t count = 0;
+
+		if (file >> count)
+		{
+			return count;
+		}
+#endif
+
+		return 0;
+	}
+
 	void posix_tap_adapter::destroy_device()
 	{
 		boost::system::error_code ec;
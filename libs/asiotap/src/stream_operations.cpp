@@ -45,6 +45,7 @@
 #include "types/stream_operations.hpp"
 
 #include <algorithm>
+#include <cstring>
 
 #include <boost/asio.hpp>
 #include <boost/lexical_cast.hpp>
@@ -469,4 +470,314 @@ namespace asiotap
 
 	template std::istream& read_ip_address_prefix_length_gateway<boost::asio::ip::address_v4>(std::istream& is, std::string& ip_address, std::string& prefix_length, std::string& gateway);
 	template std::istream& read_ip_address_prefix_length_gateway<boost::asio::ip::address_v6>(std::istream& is, std::string& ip_address, std::string& prefix_length, std::string& gateway);
+
+	template <typename AddressType>
+	bool string_range_to_address(const string_range& range, AddressType& value)
+	{
+		// The longest valid representation is well below the buffer size: longer tokens cannot be addresses.
+		char buffer[64];
+
+		const size_t size = string_range_size(range);
+
+		if ((size == 0) || (size >= sizeof(buffer)))
+		{
+			return false;
+		}
+
+		std::memcpy(buffer, range.first, size);
+		buffer[size] = '\0';
+
+		boost::system::error_code ec;
+
+		value = AddressType::from_string(buffer, ec);
+
+		return !ec;
+	}
+
+	template bool string_range_to_address<boost::asio::ip::address_v4>(const string_range& range, boost::asio::ip::address_v4& value);
+	template bool string_range_to_address<boost::asio::ip::address_v6>(const string_range& range, boost::asio::ip::address_v6& value);
+
+	template <typename AddressType>
+	const char* read_ip_address(const char* begin, const char* end, string_range& ip_address)
+	{
+		const char* pos = begin;
+
+		while ((pos != end) && is_ip_address_character<AddressType>(*pos))
+		{
+			++pos;
+		}
+
+		if (pos == begin)
+		{
+			return nullptr;
+		}
+
+		const string_range candidate = { begin, pos };
+
+		AddressType address;
+
+		if (!string_range_to_address(candidate, address))
+		{
+			return nullptr;
+		}
+
+		ip_address = candidate;
+
+		return pos;
+	}
+
+	template const char* read_ip_address<boost::asio::ip::address_v4>(const char* begin, const char* end, string_range& ip_address);
+	template const char* read_ip_address<boost::asio::ip::address_v6>(const char* begin, const char* end, string_range& ip_address);
+
+	const char* read_port(const char* begin, const char* end, string_range& port)
+	{
+		const char* pos = begin;
+		unsigned int value = 0;
+
+		while ((pos != end) && std::isdigit(static_cast<unsigned char>(*pos)))
+		{
+			value = value * 10 + static_cast<unsigned int>(*pos - '0');
+
+			if (value > 65535)
+			{
+				return nullptr;
+			}
+
+			++pos;
+		}
+
+		if (pos == begin)
+		{
+			return nullptr;
+		}
+
+		port.first = begin;
+		port.last = pos;
+
+		return pos;
+	}
+
+	template <typename AddressType>
+	const char* read_prefix_length(const char* begin, const char* end, string_range& prefix_length)
+	{
+		const char* pos = begin;
+		unsigned int value = 0;
+
+		while ((pos != end) && std::isdigit(static_cast<unsigned char>(*pos)))
+		{
+			value = value * 10 + static_cast<unsigned int>(*pos - '0');
+
+			if (value > 128)
+			{
+				return nullptr;
+			}
+
+			++pos;
+		}
+
+		if ((pos == begin) || !check_prefix_length<AddressType>(value))
+		{
+			return nullptr;
+		}
+
+		prefix_length.first = begin;
+		prefix_length.last = pos;
+
+		return pos;
+	}
+
+	template const char* read_prefix_length<boost::asio::ip::address_v4>(const char* begin, const char* end, string_range& prefix_length);
+	template const char* read_prefix_length<boost::asio::ip::address_v6>(const char* begin, const char* end, string_range& prefix_length);
+
+	const char* read_hostname_label(const char* begin, const char* end, string_range& label)
+	{
+		// Parse hostname labels according to RFC1123
+
+		if ((begin == end) || !is_hostname_label_regular_character(*begin))
+		{
+			return nullptr;
+		}
+
+		const char* pos = begin;
+		bool only_digits = true;
+
+		while ((pos != end) && is_hostname_label_character(*pos))
+		{
+			only_digits = only_digits && (std::isdigit(static_cast<unsigned char>(*pos)) != 0);
+
+			++pos;
+		}
+
+		// Check if the label is too long, if the last character is not a regular character or if it contains only digits
+		if ((static_cast<size_t>(pos - begin) > HOSTNAME_LABEL_MAX_SIZE) || (!is_hostname_label_regular_character(*(pos - 1))) || only_digits)
+		{
+			return nullptr;
+		}
+
+		label.first = begin;
+		label.last = pos;
+
+		return pos;
+	}
+
+	const char* read_hostname(const char* begin, const char* end, string_range& hostname)
+	{
+		// Parse hostnames labels according to RFC952 and RFC1123
+
+		string_range label;
+
+		const char* pos = read_hostname_label(begin, end, label);
+
+		if (!pos)
+		{
+			return nullptr;
+		}
+
+		while ((pos != end) && (*pos == '.'))
+		{
+			pos = read_hostname_label(pos + 1, end, label);
+
+			if (!pos)
+			{
+				return nullptr;
+			}
+		}
+
+		if (static_cast<size_t>(pos - begin) > HOSTNAME_MAX_SIZE)
+		{
+			return nullptr;
+		}
+
+		hostname.first = begin;
+		hostname.last = pos;
+
+		return pos;
+	}
+
+	const char* read_service(const char* begin, const char* end, string_range& service)
+	{
+		const char* pos = begin;
+		bool only_digits = true;
+		bool overflow = false;
+		unsigned int value = 0;
+
+		while ((pos != end) && std::isalnum(static_cast<unsigned char>(*pos)))
+		{
+			if (std::isdigit(static_cast<unsigned char>(*pos)))
+			{
+				if (!overflow)
+				{
+					value = value * 10 + static_cast<unsigned int>(*pos - '0');
+					overflow = (value > 65535);
+				}
+			}
+			else
+			{
+				only_digits = false;
+			}
+
+			++pos;
+		}
+
+		if (pos == begin)
+		{
+			return nullptr;
+		}
+
+		// A numeric service must fit a port number.
+		if (only_digits && overflow)
+		{
+			return nullptr;
+		}
+
+		service.first = begin;
+		service.last = pos;
+
+		return pos;
+	}
+
+	template <typename AddressType>
+	const char* read_ip_address_prefix_length(const char* begin, const char* end, string_range& ip_address, string_range& prefix_length)
+	{
+		const char* pos = read_ip_address<AddressType>(begin, end, ip_address);
+
+		if (!pos)
+		{
+			return nullptr;
+		}
+
+		if ((pos != end) && (*pos == '/'))
+		{
+			pos = read_prefix_length<AddressType>(pos + 1, end, prefix_length);
+
+			if (!pos)
+			{
+				return nullptr;
+			}
+		}
+		else
+		{
+			prefix_length.first = pos;
+			prefix_length.last = pos;
+		}
+
+		return pos;
+	}
+
+	template const char* read_ip_address_prefix_length<boost::asio::ip::address_v4>(const char* begin, const char* end, string_range& ip_address, string_range& prefix_length);
+	template const char* read_ip_address_prefix_length<boost::asio::ip::address_v6>(const char* begin, const char* end, string_range& ip_address, string_range& prefix_length);
+
+	template <typename AddressType>
+	const char* read_ip_address_prefix_length_gateway(const char* begin, const char* end, string_range& ip_address, string_range& prefix_length, string_range& gateway)
+	{
+		const char* pos = read_ip_address_prefix_length<AddressType>(begin, end, ip_address, prefix_length);
+
+		if (!pos)
+		{
+			return nullptr;
+		}
+
+		gateway.first = pos;
+		gateway.last = pos;
+
+		if (pos == end)
+		{
+			return pos;
+		}
+
+		while ((pos != end) && std::isblank(static_cast<unsigned char>(*pos)))
+		{
+			++pos;
+		}
+
+		if ((pos == end) || (*pos != '='))
+		{
+			return nullptr;
+		}
+
+		++pos;
+
+		if ((pos == end) || (*pos != '>'))
+		{
+			return nullptr;
+		}
+
+		++pos;
+
+		while ((pos != end) && std::isblank(static_cast<unsigned char>(*pos)))
+		{
+			++pos;
+		}
+
+		// Like the stream version, a dangling separator at the end of the input yields an empty gateway.
+		if (pos == end)
+		{
+			return pos;
+		}
+
+		return read_ip_address<AddressType>(pos, end, gateway);
+	}
+
+	template const char* read_ip_address_prefix_length_gateway<boost::asio::ip::address_v4>(const char* begin, const char* end, string_range& ip_address, string_range& prefix_length, string_range& gateway);
+	template const char* read_ip_address_prefix_length_gateway<boost::asio::ip::address_v6>(const char* begin, const char* end, string_range& ip_address, string_range& prefix_length, string_range& gateway);
 }
@@ -46,6 +46,7 @@
 
 #include "registry.hpp"
 
+#include <boost/bind.hpp>
 #include <boost/optional.hpp>
 
 #include <vector>
@@ -308,7 +309,11 @@ namespace asiotap
 		if (!is_open())
 		{
 			ec = make_error_code(asiotap_error::no_such_tap_adapter);
+
+			return;
 		}
+
+		m_io_strand.post(boost::bind(&windows_tap_adapter::start_read_pipeline, this));
 	}
 
 	void windows_tap_adapter::open(const std::string& _name)
@@ -513,4 +518,130 @@ namespace asiotap
 		}
 	}
 
+	void windows_tap_adapter::start_read_pipeline()
+	{
+		// All the pipeline methods are called in m_io_strand so the following is thread-safe.
+		m_read_buffers.resize(PENDING_READ_COUNT);
+		m_free_read_slots.clear();
+		m_completed_reads.clear();
+
+		for (size_t slot = 0; slot < PENDING_READ_COUNT; ++slot)
+		{
+			m_read_buffers[slot].resize(READ_BUFFER_SIZE);
+			m_free_read_slots.push_back(slot);
+		}
+
+		start_pending_reads();
+	}
+
+	void windows_tap_adapter::start_pending_reads()
+	{
+		if (!is_open())
+		{
+			return;
+		}
+
+		while (!m_free_read_slots.empty())
+		{
+			const size_t slot = m_free_read_slots.back();
+			m_free_read_slots.pop_back();
+
+			descriptor().async_read_some(
+				boost::asio::buffer(m_read_buffers[slot]),
+				m_io_strand.wrap(boost::bind(&windows_tap_adapter::handle_slot_read, this, slot, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred))
+			);
+		}
+	}
+
+	void windows_tap_adapter::handle_slot_read(size_t slot, const boost::system::error_code& ec, size_t length)
+	{
+		if (ec == boost::asio::error::operation_aborted)
+		{
+			// The adapter is being closed: the slot is parked until a new open() rebuilds the pipeline.
+			m_free_read_slots.push_back(slot);
+
+			return;
+		}
+
+		const completed_read_type completed_read = { slot, ec, length };
+
+		// The slot is not rearmed until its frame was consumed, so at most PENDING_READ_COUNT frames are ever buffered here.
+		m_completed_reads.push_back(completed_read);
+
+		deliver_reads();
+	}
+
+	void windows_tap_adapter::queue_read(boost::asio::mutable_buffer buffer, io_handler_type handler)
+	{
+		const read_request_type read_request = { buffer, handler };
+
+		m_read_requests.push_back(read_request);
+
+		deliver_reads();
+	}
+
+	void windows_tap_adapter::deliver_reads()
+	{
+		while (!m_read_requests.empty() && !m_completed_reads.empty())
+		{
+			const completed_read_type completed_read = m_completed_reads.front();
+			m_completed_reads.pop_front();
+
+			const read_request_type read_request = m_read_requests.front();
+			m_read_requests.pop_front();
+
+			size_t length = 0;
+
+			if (!completed_read.error)
+			{
+				length = boost::asio::buffer_copy(read_request.buffer, boost::asio::buffer(m_read_buffers[completed_read.slot], completed_read.length));
+			}
+
+			m_free_read_slots.push_back(completed_read.slot);
+
+			read_request.handler(completed_read.error, length);
+		}
+
+		start_pending_reads();
+	}
+
+	void windows_tap_adapter::queue_write(boost::asio::const_buffer buffer, io_handler_type handler)
+	{
+		const write_request_type write_request = { buffer, handler };
+
+		m_write_requests.push_back(write_request);
+
+		if (!m_write_in_flight)
+		{
+			start_next_write();
+		}
+	}
+
+	void windows_tap_adapter::start_next_write()
+	{
+		if (m_write_requests.empty() || !is_open())
+		{
+			m_write_in_flight = false;
+
+			return;
+		}
+
+		m_write_in_flight = true;
+
+		descriptor().async_write_some(
+			boost::asio::buffer(m_write_requests.front().buffer),
+			m_io_strand.wrap(boost::bind(&windows_tap_adapter::handle_write, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred))
+		);
+	}
+
+	void windows_tap_adapter::handle_write(const boost::system::error_code& ec, size_t length)
+	{
+		const write_request_type write_request = m_write_requests.front();
+		m_write_requests.pop_front();
+
+		write_request.handler(ec, length);
+
+		// The driver takes exactly one frame per write: issuing the next one straight from the completion handler is as close to coalescing as it allows, and spares the caller rescheduling between frames.
+		start_next_write();
+	}
 }
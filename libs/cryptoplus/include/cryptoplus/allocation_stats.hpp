@@ -0,0 +1,229 @@
+/*
+ * libcryptoplus - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libcryptoplus.
+ *
+ * libcryptoplus is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libcryptoplus is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libcryptoplus in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file allocation_stats.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief Opt-in allocation accounting, per subsystem tag.
+ */
+
+#ifndef CRYPTOPLUS_ALLOCATION_STATS_HPP
+#define CRYPTOPLUS_ALLOCATION_STATS_HPP
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include <boost/atomic.hpp>
+
+#include <stdint.h>
+
+namespace cryptoplus
+{
+	/**
+	 * \brief Accounting of heap allocations, grouped by subsystem tag.
+	 *
+	 * The buffer classes call record_allocation()/record_release() at their heap choke points; the accounting tracks, per tag, the count of allocations, the bytes allocated over time, the bytes currently live and the live-byte high-water mark.
+	 *
+	 * The accounting is opt-in: when disabled (the default), the record functions cost a single relaxed load. The counters are relaxed atomics, so a scrape may observe a slightly torn view, which is fine for sizing pools.
+	 */
+	class allocation_stats
+	{
+		public:
+
+			/**
+			 * \brief The subsystem tags.
+			 */
+			enum allocation_tag
+			{
+				ALLOCATION_TAG_CRYPTOPLUS_BUFFER = 0, /**< Heap storage of cryptoplus::buffer, past its inline capacity. */
+				ALLOCATION_TAG_SHARED_BUFFER, /**< Heap storage of fscp::SharedBuffer, past its pool. */
+				ALLOCATION_TAG_MESSAGE, /**< Scratch storage of message builders. */
+				ALLOCATION_TAG_COUNT /**< The count of tags. Not a tag. */
+			};
+
+			/**
+			 * \brief The accounting of one tag.
+			 */
+			struct tag_statistics
+			{
+				uint64_t allocation_count; /**< The count of heap allocations. */
+				uint64_t allocated_bytes; /**< The bytes allocated, cumulated over time. */
+				uint64_t current_bytes; /**< The bytes currently live. */
+				uint64_t peak_bytes; /**< The highest value current_bytes ever reached. */
+			};
+
+			/**
+			 * \brief Enable or disable the accounting.
+			 * \param enabled The new state.
+			 *
+			 * Allocations recorded while the accounting is disabled are lost: a release can then be observed without its allocation, so enable the accounting before the instrumented subsystems start, or reset() right after enabling.
+			 */
+			static void set_enabled(bool enabled);
+
+			/**
+			 * \brief Check whether the accounting is enabled.
+			 * \return The state.
+			 */
+			static bool enabled()
+			{
+				return s_enabled.load(boost::memory_order_relaxed);
+			}
+
+			/**
+			 * \brief Record a heap allocation.
+			 * \param tag The subsystem tag.
+			 * \param bytes The size of the allocation.
+			 */
+			static void record_allocation(allocation_tag tag, size_t bytes)
+			{
+				if (enabled())
+				{
+					do_record_allocation(tag, bytes);
+				}
+			}
+
+			/**
+			 * \brief Record the release of a recorded allocation.
+			 * \param tag The subsystem tag.
+			 * \param bytes The size of the allocation.
+			 */
+			static void record_release(allocation_tag tag, size_t bytes)
+			{
+				if (enabled())
+				{
+					do_record_release(tag, bytes);
+				}
+			}
+
+			/**
+			 * \brief Get the accounting of every tag, keyed by tag name.
+			 * \return The statistics.
+			 */
+			static std::map<std::string, tag_statistics> statistics();
+
+			/**
+			 * \brief Reset the accounting of every tag to zero.
+			 */
+			static void reset();
+
+		private:
+
+			struct tag_slot
+			{
+				boost::atomic<uint64_t> allocation_count;
+				boost::atomic<uint64_t> allocated_bytes;
+				boost::atomic<uint64_t> current_bytes;
+				boost::atomic<uint64_t> peak_bytes;
+				uint8_t padding[64 - (sizeof(boost::atomic<uint64_t>) * 4) % 64];
+			};
+
+			static void do_record_allocation(allocation_tag tag, size_t bytes);
+			static void do_record_release(allocation_tag tag, size_t bytes);
+
+			static boost::atomic<bool> s_enabled;
+			static tag_slot s_slots[ALLOCATION_TAG_COUNT];
+
+			allocation_stats();
+	};
+
+	/**
+	 * \brief A standard allocator that records its heap usage against a tag.
+	 * \tparam T The value type.
+	 * \tparam Tag The subsystem tag.
+	 *
+	 * A drop-in replacement for std::allocator in the containers used as scratch space, so every allocation and release they make is accounted without touching the call sites.
+	 */
+	template <typename T, allocation_stats::allocation_tag Tag>
+	class accounting_allocator : public std::allocator<T>
+	{
+		public:
+
+			/**
+			 * \brief The rebinding structure.
+			 * \tparam U The new value type.
+			 */
+			template <typename U>
+			struct rebind
+			{
+				typedef accounting_allocator<U, Tag> other;
+			};
+
+			/**
+			 * \brief Create an allocator.
+			 */
+			accounting_allocator()
+			{
+			}
+
+			/**
+			 * \brief Create an allocator from a rebound allocator.
+			 * \tparam U The other value type.
+			 */
+			template <typename U>
+			accounting_allocator(const accounting_allocator<U, Tag>&)
+			{
+			}
+
+			/**
+			 * \brief Allocate elements.
+			 * \param n The count of elements.
+			 * \return The allocation.
+			 */
+			T* allocate(size_t n)
+			{
+				allocation_stats::record_allocation(Tag, n * sizeof(T));
+
+				return std::allocator<T>::allocate(n);
+			}
+
+			/**
+			 * \brief Release an allocation.
+			 * \param p The allocation.
+			 * \param n The count of elements, as passed to allocate().
+			 */
+			void deallocate(T* p, size_t n)
+			{
+				allocation_stats::record_release(Tag, n * sizeof(T));
+
+				std::allocator<T>::deallocate(p, n);
+			}
+	};
+}
+
+#endif /* CRYPTOPLUS_ALLOCATION_STATS_HPP */
@@ -45,12 +45,370 @@
 #ifndef CRYPTOPLUS_BUFFER_HPP
 #define CRYPTOPLUS_BUFFER_HPP
 
-#include <vector>
+#include "allocation_stats.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
 #include <stdint.h>
 #include <iostream>
 
 namespace cryptoplus
 {
+	/**
+	 * \brief The storage of a buffer.
+	 *
+	 * Behaves like a std::vector<uint8_t> for the operations the library needs, but keeps payloads of up to inline_capacity bytes in internal storage: most crypto results (GCM tags, digests, session hashes) fit and never touch the allocator.
+	 */
+	class buffer_storage
+	{
+		public:
+
+			/**
+			 * \brief The value type.
+			 */
+			typedef uint8_t value_type;
+
+			/**
+			 * \brief The size type.
+			 */
+			typedef size_t size_type;
+
+			/**
+			 * \brief The iterator type.
+			 */
+			typedef uint8_t* iterator;
+
+			/**
+			 * \brief The const iterator type.
+			 */
+			typedef const uint8_t* const_iterator;
+
+			/**
+			 * \brief The count of bytes that can be held without a heap allocation.
+			 */
+			static const size_t inline_capacity = 64;
+
+			/**
+			 * \brief Create an empty storage.
+			 */
+			buffer_storage() :
+				m_ptr(m_inline),
+				m_size(0),
+				m_capacity(inline_capacity)
+			{
+			}
+
+			/**
+			 * \brief Create a zero-filled storage of the specified size.
+			 * \param _size The size.
+			 */
+			explicit buffer_storage(size_t _size) :
+				m_ptr(m_inline),
+				m_size(0),
+				m_capacity(inline_capacity)
+			{
+				resize(_size);
+			}
+
+			/**
+			 * \brief Create a storage from two iterators.
+			 * \tparam Iterator The iterator type.
+			 * \param _begin An iterator to the first element.
+			 * \param _end An iterator past the last element.
+			 */
+			template <typename Iterator>
+			buffer_storage(Iterator _begin, Iterator _end) :
+				m_ptr(m_inline),
+				m_size(0),
+				m_capacity(inline_capacity)
+			{
+				resize(static_cast<size_t>(std::distance(_begin, _end)));
+
+				std::copy(_begin, _end, m_ptr);
+			}
+
+			/**
+			 * \brief Copy a storage.
+			 * \param other The storage to copy.
+			 */
+			buffer_storage(const buffer_storage& other) :
+				m_ptr(m_inline),
+				m_size(0),
+				m_capacity(inline_capacity)
+			{
+				resize(other.m_size);
+
+				std::memcpy(m_ptr, other.m_ptr, other.m_size);
+			}
+
+			/**
+			 * \brief Move a storage.
+			 * \param other The storage to move from. It is left empty.
+			 *
+			 * Heap-allocated contents are stolen; inline contents are copied, which is the whole point of the inline storage.
+			 */
+			buffer_storage(buffer_storage&& other) :
+				m_ptr(m_inline),
+				m_size(other.m_size),
+				m_capacity(inline_capacity)
+			{
+				if (other.m_ptr != other.m_inline)
+				{
+					m_ptr = other.m_ptr;
+					m_capacity = other.m_capacity;
+
+					other.m_ptr = other.m_inline;
+					other.m_capacity = inline_capacity;
+				}
+				else
+				{
+					std::memcpy(m_inline, other.m_inline, other.m_size);
+				}
+
+				other.m_size = 0;
+			}
+
+			/**
+			 * \brief Copy a storage.
+			 * \param other The storage to copy.
+			 * \return *this.
+			 */
+			buffer_storage& operator=(const buffer_storage& other)
+			{
+				if (this != &other)
+				{
+					m_size = 0;
+
+					resize(other.m_size);
+
+					std::memcpy(m_ptr, other.m_ptr, other.m_size);
+				}
+
+				return *this;
+			}
+
+			/**
+			 * \brief Move a storage.
+			 * \param other The storage to move from. It is left empty.
+			 * \return *this.
+			 */
+			buffer_storage& operator=(buffer_storage&& other)
+			{
+				if (this != &other)
+				{
+					if (m_ptr != m_inline)
+					{
+						delete[] m_ptr;
+
+						allocation_stats::record_release(allocation_stats::ALLOCATION_TAG_CRYPTOPLUS_BUFFER, m_capacity);
+
+						m_ptr = m_inline;
+						m_capacity = inline_capacity;
+					}
+
+					if (other.m_ptr != other.m_inline)
+					{
+						m_ptr = other.m_ptr;
+						m_capacity = other.m_capacity;
+
+						other.m_ptr = other.m_inline;
+						other.m_capacity = inline_capacity;
+					}
+					else
+					{
+						std::memcpy(m_inline, other.m_inline, other.m_size);
+					}
+
+					m_size = other.m_size;
+					other.m_size = 0;
+				}
+
+				return *this;
+			}
+
+			/**
+			 * \brief Destroy the storage.
+			 */
+			~buffer_storage()
+			{
+				if (m_ptr != m_inline)
+				{
+					delete[] m_ptr;
+
+					allocation_stats::record_release(allocation_stats::ALLOCATION_TAG_CRYPTOPLUS_BUFFER, m_capacity);
+				}
+			}
+
+			/**
+			 * \brief Get the size.
+			 * \return The size.
+			 */
+			size_t size() const
+			{
+				return m_size;
+			}
+
+			/**
+			 * \brief Check if the storage is empty.
+			 * \return true if the storage is empty.
+			 */
+			bool empty() const
+			{
+				return (m_size == 0);
+			}
+
+			/**
+			 * \brief Resize the storage.
+			 * \param _size The new size.
+			 *
+			 * As with std::vector, existing bytes are preserved and any added bytes are zeroed.
+			 */
+			void resize(size_t _size)
+			{
+				if (_size > m_capacity)
+				{
+					const size_t new_capacity = std::max(_size, m_capacity * 2);
+					uint8_t* const new_ptr = new uint8_t[new_capacity];
+
+					allocation_stats::record_allocation(allocation_stats::ALLOCATION_TAG_CRYPTOPLUS_BUFFER, new_capacity);
+
+					std::memcpy(new_ptr, m_ptr, m_size);
+
+					if (m_ptr != m_inline)
+					{
+						delete[] m_ptr;
+
+						allocation_stats::record_release(allocation_stats::ALLOCATION_TAG_CRYPTOPLUS_BUFFER, m_capacity);
+					}
+
+					m_ptr = new_ptr;
+					m_capacity = new_capacity;
+				}
+
+				if (_size > m_size)
+				{
+					std::memset(m_ptr + m_size, 0x00, _size - m_size);
+				}
+
+				m_size = _size;
+			}
+
+			/**
+			 * \brief Get a pointer to the bytes.
+			 * \return The pointer.
+			 */
+			uint8_t* data()
+			{
+				return m_ptr;
+			}
+
+			/**
+			 * \brief Get a pointer to the bytes.
+			 * \return The pointer.
+			 */
+			const uint8_t* data() const
+			{
+				return m_ptr;
+			}
+
+			/**
+			 * \brief Get an iterator to the first byte.
+			 * \return The iterator.
+			 */
+			iterator begin()
+			{
+				return m_ptr;
+			}
+
+			/**
+			 * \brief Get an iterator past the last byte.
+			 * \return The iterator.
+			 */
+			iterator end()
+			{
+				return m_ptr + m_size;
+			}
+
+			/**
+			 * \brief Get an iterator to the first byte.
+			 * \return The iterator.
+			 */
+			const_iterator begin() const
+			{
+				return m_ptr;
+			}
+
+			/**
+			 * \brief Get an iterator past the last byte.
+			 * \return The iterator.
+			 */
+			const_iterator end() const
+			{
+				return m_ptr + m_size;
+			}
+
+			/**
+			 * \brief Access a byte.
+			 * \param index The index of the byte.
+			 * \return A reference to the byte.
+			 */
+			uint8_t& operator[](size_t index)
+			{
+				return m_ptr[index];
+			}
+
+			/**
+			 * \brief Access a byte.
+			 * \param index The index of the byte.
+			 * \return A reference to the byte.
+			 */
+			const uint8_t& operator[](size_t index) const
+			{
+				return m_ptr[index];
+			}
+
+		private:
+
+			uint8_t m_inline[inline_capacity];
+			uint8_t* m_ptr;
+			size_t m_size;
+			size_t m_capacity;
+	};
+
+	/**
+	 * \brief Compare two storages for equality.
+	 * \param lhs The left argument.
+	 * \param rhs The right argument.
+	 * \return true if the two storages have the exact same content.
+	 */
+	inline bool operator==(const buffer_storage& lhs, const buffer_storage& rhs)
+	{
+		return (lhs.size() == rhs.size()) && (std::memcmp(lhs.data(), rhs.data(), lhs.size()) == 0);
+	}
+
+	/**
+	 * \brief Compare two storages for non-equality.
+	 * \param lhs The left argument.
+	 * \param rhs The right argument.
+	 * \return true if the two storages have different contents.
+	 */
+	inline bool operator!=(const buffer_storage& lhs, const buffer_storage& rhs)
+	{
+		return !(lhs == rhs);
+	}
+
+	/**
+	 * \brief Compare two storages for ordering.
+	 * \param lhs The left argument.
+	 * \param rhs The right argument.
+	 * \return true if lhs is "smaller" than rhs.
+	 */
+	inline bool operator<(const buffer_storage& lhs, const buffer_storage& rhs)
+	{
+		return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+	}
+
 	/**
 	 * \brief A buffer type.
 	 */
@@ -61,7 +419,7 @@ namespace cryptoplus
 			/**
 			 * \brief The underlying storage type.
 			 */
-			typedef std::vector<uint8_t> storage_type;
+			typedef buffer_storage storage_type;
 
 			/**
 			 * \brief Create an empty buffer.
@@ -135,9 +493,14 @@ namespace cryptoplus
 				return std::string(m_data.begin(), m_data.end());
 			}
 
+			buffer(const buffer&) = default;
+			buffer& operator=(const buffer&) = default;
+			buffer(buffer&&) = default;
+			buffer& operator=(buffer&&) = default;
+
 		private:
 
-			std::vector<uint8_t> m_data;
+			storage_type m_data;
 	};
 
 	/**
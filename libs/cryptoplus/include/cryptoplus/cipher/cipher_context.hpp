@@ -51,8 +51,6 @@
 
 #include <openssl/evp.h>
 
-#include <boost/noncopyable.hpp>
-
 #include <vector>
 #include <string>
 #include <cstring>
@@ -73,9 +71,9 @@ namespace cryptoplus
 		 *
 		 * The list of the available cipher methods depends on the version of OpenSSL and can be found on the man page of EVP_EncryptInit().
 		 *
-		 * cipher_context is noncopyable by design.
+		 * cipher_context is noncopyable by design, but it can be moved.
 		 */
-		class cipher_context : public boost::noncopyable
+		class cipher_context
 		{
 			public:
 
@@ -101,6 +99,34 @@ namespace cryptoplus
 				 */
 				~cipher_context();
 
+				cipher_context(const cipher_context&) = delete;
+				cipher_context& operator=(const cipher_context&) = delete;
+
+				/**
+				 * \brief Move a cipher_context.
+				 * \param other The cipher_context to take the state from. It is left in a freshly-constructed state.
+				 */
+				cipher_context(cipher_context&& other);
+
+				/**
+				 * \brief Move a cipher_context.
+				 * \param other The cipher_context to take the state from. It is left in a freshly-constructed state.
+				 * \return The cipher_context.
+				 */
+				cipher_context& operator=(cipher_context&& other);
+
+				/**
+				 * \brief Get a cipher_context cached in thread-local storage for the specified algorithm and direction.
+				 * \param algorithm The cipher algorithm.
+				 * \param direction The direction of the cipher_context. Must be either cipher_direction::encrypt or cipher_direction::decrypt.
+				 * \return A cipher_context already initialized for algorithm and direction: only the key and the IV remain to be set.
+				 *
+				 * The returned cipher_context keeps its EVP_CIPHER_CTX allocation across calls, so callers that cannot hold a long-lived context still avoid the construction and algorithm setup cost on every operation.
+				 *
+				 * The reference is only valid on the calling thread and until the next call with the same parameters.
+				 */
+				static cipher_context& thread_local_context(const cipher_algorithm& algorithm, cipher_direction direction);
+
 				/**
 				 * \brief Initialize the cipher_context.
 				 * \param algorithm The cipher algorithm to use.
@@ -117,6 +143,14 @@ namespace cryptoplus
 				 */
 				void initialize(const cipher_algorithm& algorithm, cipher_direction direction, const void* key, size_t key_len, const void* iv, ENGINE* impl = NULL);
 
+				/**
+				 * \brief Reinitialize the cipher_context with a new IV, keeping the current algorithm, direction and key.
+				 * \param iv The IV to use.
+				 *
+				 * Unlike initialize(), this skips the key expansion entirely: it is the cheapest way to reuse a keyed cipher_context from one operation to the next.
+				 */
+				void set_iv(const void* iv);
+
 				/**
 				 * \brief Initialize the cipher_context for envelope sealing.
 				 * \param algorithm The cipher algorithm to use.
@@ -355,6 +389,27 @@ namespace cryptoplus
 			EVP_CIPHER_CTX_cleanup(&m_ctx);
 		}
 
+		inline cipher_context::cipher_context(cipher_context&& other)
+		{
+			m_ctx = other.m_ctx;
+
+			EVP_CIPHER_CTX_init(&other.m_ctx);
+		}
+
+		inline cipher_context& cipher_context::operator=(cipher_context&& other)
+		{
+			if (this != &other)
+			{
+				EVP_CIPHER_CTX_cleanup(&m_ctx);
+
+				m_ctx = other.m_ctx;
+
+				EVP_CIPHER_CTX_init(&other.m_ctx);
+			}
+
+			return *this;
+		}
+
 		template <typename T>
 		inline std::vector<buffer> cipher_context::seal_initialize(const cipher_algorithm& _algorithm, void* iv, T pkeys_begin, T pkeys_end)
 		{
@@ -0,0 +1,88 @@
+/*
+ * libcryptoplus - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libcryptoplus.
+ *
+ * libcryptoplus is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libcryptoplus is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libcryptoplus in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+
+/**
+ * \file engine.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief OpenSSL engine selection functions.
+ */
+
+#ifndef CRYPTOPLUS_ENGINE_HPP
+#define CRYPTOPLUS_ENGINE_HPP
+
+#include <openssl/engine.h>
+
+#include <string>
+
+namespace cryptoplus
+{
+	namespace engine
+	{
+		/**
+		 * \brief Select an OpenSSL engine for the symmetric data path.
+		 * \param id The engine identifier, as known to OpenSSL (for instance "afalg" for the Linux AF_ALG engine).
+		 * \return true when the engine was found, initialized and supports ciphers.
+		 *
+		 * The engine is loaded, initialized and kept referenced for the lifetime of the process. It is not registered as the OpenSSL-wide default: callers engage it explicitly, typically only for payloads large enough to amortize the engine's per-request cost.
+		 * \warning The first call to this function is *NOT* thread-safe in C++03.
+		 */
+		bool select(const std::string& id);
+
+		/**
+		 * \brief Get the selected engine.
+		 * \return The engine, or NULL when none was selected. Suitable as the impl argument of cipher_context::initialize().
+		 */
+		ENGINE* selected();
+
+		/**
+		 * \brief Set the payload size under which the selected engine is not worth engaging.
+		 * \param bytes The threshold, in bytes.
+		 */
+		void set_threshold(size_t bytes);
+
+		/**
+		 * \brief Get the engine to use for a payload of the given size.
+		 * \param size The payload size, in bytes.
+		 * \return The selected engine when one is selected and size reaches the threshold; NULL otherwise.
+		 */
+		ENGINE* for_size(size_t size);
+	}
+}
+
+#endif /* CRYPTOPLUS_ENGINE_HPP */
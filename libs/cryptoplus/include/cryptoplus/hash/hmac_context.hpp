@@ -117,6 +117,18 @@ namespace cryptoplus
 				 */
 				buffer finalize();
 
+				/**
+				 * \brief Compute a HMAC in one call, reusing the key set by a previous call to initialize().
+				 * \param out The output buffer. Must be at least as big as the message digest algorithm result size.
+				 * \param out_len The output buffer length.
+				 * \param data The data buffer.
+				 * \param len The data length.
+				 * \return The count of bytes written to out.
+				 *
+				 * A keyed hmac_context acts as a precomputed key schedule: compute() restarts it without redoing the key setup, so it can be called repeatedly with no per-call allocation.
+				 */
+				size_t compute(void* out, size_t out_len, const void* data, size_t len);
+
 				/**
 				 * \brief Get the underlying context.
 				 * \return The underlying context.
@@ -161,6 +173,14 @@ namespace cryptoplus
 #endif
 		}
 
+		inline size_t hmac_context::compute(void* out, size_t out_len, const void* data, size_t len)
+		{
+			initialize(NULL, 0, NULL);
+			update(data, len);
+
+			return finalize(out, out_len);
+		}
+
 		inline buffer hmac_context::finalize()
 		{
 			buffer result(algorithm().result_size());
@@ -60,6 +60,15 @@ namespace cryptoplus
 {
 	namespace pkey
 	{
+		/**
+		 * \brief Get the cached EC parameters for the specified elliptic curve NID.
+		 * \param nid The elliptic curve NID. See <openssl/obj_mac.h> for a list of possible NIDs.
+		 * \return The parameters.
+		 *
+		 * The parameters for a given curve are built once, get their generator multiplication tables precomputed, and are then shared immutably across all threads and contexts: repeated ephemeral key generations no longer rebuild the EC group on every call.
+		 */
+		pkey get_ecdhe_parameters(int nid);
+
 		class ecdhe_context
 		{
 			public:
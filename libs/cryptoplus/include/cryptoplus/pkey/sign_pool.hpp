@@ -0,0 +1,150 @@
+/*
+ * libcryptoplus - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libcryptoplus.
+ *
+ * libcryptoplus is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libcryptoplus is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libcryptoplus in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file sign_pool.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An asynchronous signing worker pool.
+ */
+
+#ifndef CRYPTOPLUS_PKEY_SIGN_POOL_HPP
+#define CRYPTOPLUS_PKEY_SIGN_POOL_HPP
+
+#include "../buffer.hpp"
+#include "../hash/message_digest_algorithm.hpp"
+#include "pkey.hpp"
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <deque>
+#include <exception>
+
+namespace cryptoplus
+{
+	namespace pkey
+	{
+		/**
+		 * \brief An asynchronous signing worker pool.
+		 *
+		 * sign_pool runs signature computations and verifications on a set of dedicated worker threads and reports completion through a callback, so callers that sign on a latency-sensitive thread can parallelize the public key operations across cores instead of serializing them.
+		 *
+		 * Handlers are invoked on a worker thread: callers that have threading constraints must repost to their own context from within the handler.
+		 *
+		 * sign_pool is noncopyable by design.
+		 */
+		class sign_pool : public boost::noncopyable
+		{
+			public:
+
+				/**
+				 * \brief A generic task.
+				 */
+				typedef boost::function<void ()> task_type;
+
+				/**
+				 * \brief A signature completion handler.
+				 *
+				 * On success, signature holds the signature and error is null. On failure, signature is empty and error holds the exception that the synchronous computation would have thrown.
+				 */
+				typedef boost::function<void (const buffer& signature, const std::exception_ptr& error)> sign_handler_type;
+
+				/**
+				 * \brief A verification completion handler.
+				 *
+				 * On success, valid tells whether the signature matches and error is null. On failure, error holds the exception that the synchronous computation would have thrown.
+				 */
+				typedef boost::function<void (bool valid, const std::exception_ptr& error)> verify_handler_type;
+
+				/**
+				 * \brief Create a sign_pool and start its workers.
+				 * \param worker_count The count of worker threads to spawn. Must be greater than zero.
+				 */
+				explicit sign_pool(size_t worker_count);
+
+				/**
+				 * \brief Destroy the sign_pool.
+				 *
+				 * Pending tasks are completed before the workers are joined.
+				 */
+				~sign_pool();
+
+				/**
+				 * \brief Sign the specified data on a worker thread.
+				 * \param key The private key to sign with.
+				 * \param algorithm The message digest algorithm to use.
+				 * \param data The data to sign. The buffer is copied by value, so it may be released right away.
+				 * \param handler The handler to call upon completion, from a worker thread.
+				 */
+				void async_sign(pkey key, hash::message_digest_algorithm algorithm, const buffer& data, sign_handler_type handler);
+
+				/**
+				 * \brief Verify the specified signature on a worker thread.
+				 * \param key The public key to verify with.
+				 * \param algorithm The message digest algorithm to use.
+				 * \param data The signed data. The buffer is copied by value, so it may be released right away.
+				 * \param signature The signature to check.
+				 * \param handler The handler to call upon completion, from a worker thread.
+				 */
+				void async_verify(pkey key, hash::message_digest_algorithm algorithm, const buffer& data, const buffer& signature, verify_handler_type handler);
+
+				/**
+				 * \brief Run an arbitrary task on a worker thread.
+				 * \param task The task.
+				 *
+				 * This is the escape hatch for callers whose signing is interleaved with message serialization and cannot be expressed as a detached async_sign() call.
+				 */
+				void post(const task_type& task);
+
+			private:
+
+				void run();
+
+				boost::mutex m_mutex;
+				boost::condition_variable m_condition;
+				std::deque<task_type> m_tasks;
+				bool m_stopping;
+				boost::thread_group m_threads;
+		};
+	}
+}
+
+#endif /* CRYPTOPLUS_PKEY_SIGN_POOL_HPP */
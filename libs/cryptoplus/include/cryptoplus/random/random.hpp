@@ -73,6 +73,8 @@ namespace cryptoplus
 		 * \see get_pseudo_random_bytes
 		 *
 		 * If the PRNG was not seeded with enough randomness, the call fails and an exception is thrown.
+		 *
+		 * Small requests are served from a per-thread pool that refills from the underlying PRNG in large chunks, so frequent callers do not contend on the OpenSSL PRNG lock. The pool is discarded and refilled after a fork.
 		 */
 		void get_random_bytes(void* buf, size_t buf_len);
 
@@ -211,11 +213,6 @@ namespace cryptoplus
 			throw_error_if_not(RAND_set_rand_engine(engine) != 0);
 		}
 
-		inline void get_random_bytes(void* buf, size_t buf_len)
-		{
-			throw_error_if_not(RAND_bytes(static_cast<unsigned char*>(buf), static_cast<int>(buf_len)) == 1);
-		}
-
 		inline buffer get_random_bytes(size_t cnt)
 		{
 			buffer result(cnt);
@@ -60,6 +60,8 @@
 #include <openssl/x509.h>
 #include <openssl/pem.h>
 
+#include <stdexcept>
+
 namespace cryptoplus
 {
 	namespace x509
@@ -380,6 +382,36 @@ namespace cryptoplus
 				 */
 				buffer write_der() const;
 
+				/**
+				 * \brief Compute the fingerprint of the certificate.
+				 * \param buf The buffer to write the fingerprint to. Must be at least algorithm.result_size() bytes long.
+				 * \param buf_len The length of buf.
+				 * \param algorithm The message digest algorithm to use.
+				 * \return The count of bytes written to buf.
+				 */
+				size_t fingerprint(void* buf, size_t buf_len, hash::message_digest_algorithm algorithm) const;
+
+				/**
+				 * \brief Compute the fingerprint of the certificate.
+				 * \param algorithm The message digest algorithm to use.
+				 * \return The fingerprint.
+				 */
+				buffer fingerprint(hash::message_digest_algorithm algorithm) const;
+
+				/**
+				 * \brief Get the DER representation of the certificate, serialized at most once.
+				 * \return A reference to the cached DER buffer. The reference stays valid as long as the underlying X509 structure lives and the cache is not invalidated.
+				 *
+				 * The cache lives on the underlying X509 structure, so it is shared by every certificate instance that wraps it. The mutating methods of this class drop the cache; mutations done through handles obtained from accessors (like subject() or an extension iterator) cannot be tracked, so such callers must call invalidate_cached_der() themselves.
+				 */
+				const buffer& cached_der() const;
+
+				/**
+				 * \brief Drop the cached DER representation, if any.
+				 * \see cached_der
+				 */
+				void invalidate_cached_der() const;
+
 				/**
 				 * \brief Clone the certificate instance.
 				 * \return The clone.
@@ -1010,6 +1042,27 @@ namespace cryptoplus
 
 			return result;
 		}
+		inline size_t certificate::fingerprint(void* buf, size_t buf_len, hash::message_digest_algorithm algorithm) const
+		{
+			if (buf_len < algorithm.result_size())
+			{
+				throw std::invalid_argument("buf_len");
+			}
+
+			unsigned int len = static_cast<unsigned int>(buf_len);
+
+			throw_error_if_not(X509_digest(ptr().get(), algorithm.raw(), static_cast<unsigned char*>(buf), &len) != 0);
+
+			return len;
+		}
+		inline buffer certificate::fingerprint(hash::message_digest_algorithm algorithm) const
+		{
+			buffer result(algorithm.result_size());
+
+			result.data().resize(fingerprint(buffer_cast<uint8_t*>(result), buffer_size(result), algorithm));
+
+			return result;
+		}
 		inline certificate certificate::clone() const
 		{
 			return certificate(X509_dup(ptr().get()));
@@ -1060,12 +1113,16 @@ namespace cryptoplus
 		}
 		inline certificate::const_iterator certificate::erase(const_iterator it) const
 		{
+			invalidate_cached_der();
+
 			wrapped_value_type::take_ownership(X509_delete_ext(it.m_owner->ptr().get(), it.m_index));
 
 			return it;
 		}
 		inline certificate::iterator certificate::erase(iterator it)
 		{
+			invalidate_cached_der();
+
 			wrapped_value_type::take_ownership(X509_delete_ext(it.m_owner->ptr().get(), it.m_index));
 
 			return it;
@@ -1162,12 +1219,16 @@ namespace cryptoplus
 		}
 		inline void certificate::push_back(wrapped_value_type ext) const
 		{
+			invalidate_cached_der();
+
 			throw_error_if_not(X509_add_ext(ptr().get(), ext.raw(), -1) != 0);
 		}
 		inline certificate::const_iterator certificate::insert(const_iterator position, wrapped_value_type ext) const
 		{
 			assert(position.m_owner == this);
 
+			invalidate_cached_der();
+
 			throw_error_if_not(X509_add_ext(ptr().get(), ext.raw(), position.m_index) != 0);
 
 			return position;
@@ -1176,6 +1237,8 @@ namespace cryptoplus
 		{
 			assert(position.m_owner == this);
 
+			invalidate_cached_der();
+
 			throw_error_if_not(X509_add_ext(ptr().get(), ext.raw(), position.m_index) != 0);
 
 			return position;
@@ -1186,6 +1249,8 @@ namespace cryptoplus
 		}
 		inline void certificate::set_public_key(pkey::pkey pkey) const
 		{
+			invalidate_cached_der();
+
 			throw_error_if_not(X509_set_pubkey(ptr().get(), pkey.raw()) != 0);
 		}
 		inline name certificate::subject() const
@@ -1194,6 +1259,8 @@ namespace cryptoplus
 		}
 		inline void certificate::set_subject(name _name) const
 		{
+			invalidate_cached_der();
+
 			throw_error_if_not(X509_set_subject_name(ptr().get(), _name.raw()) != 0);
 		}
 		inline name certificate::issuer() const
@@ -1202,6 +1269,8 @@ namespace cryptoplus
 		}
 		inline void certificate::set_issuer(name _name) const
 		{
+			invalidate_cached_der();
+
 			throw_error_if_not(X509_set_issuer_name(ptr().get(), _name.raw()) != 0);
 		}
 		inline long certificate::version() const
@@ -1210,6 +1279,8 @@ namespace cryptoplus
 		}
 		inline void certificate::set_version(long _version) const
 		{
+			invalidate_cached_der();
+
 			throw_error_if_not(X509_set_version(ptr().get(), _version) != 0);
 		}
 		inline asn1::integer certificate::serial_number() const
@@ -1218,6 +1289,8 @@ namespace cryptoplus
 		}
 		inline void certificate::set_serial_number(asn1::integer _serial_number) const
 		{
+			invalidate_cached_der();
+
 			throw_error_if_not(X509_set_serialNumber(ptr().get(), _serial_number.raw()) != 0);
 		}
 		inline asn1::utctime certificate::not_before() const
@@ -1226,6 +1299,8 @@ namespace cryptoplus
 		}
 		inline void certificate::set_not_before(asn1::utctime _not_before) const
 		{
+			invalidate_cached_der();
+
 			throw_error_if_not(X509_set_notBefore(ptr().get(), _not_before.raw()) != 0);
 		}
 		inline asn1::utctime certificate::not_after() const
@@ -1234,6 +1309,8 @@ namespace cryptoplus
 		}
 		inline void certificate::set_not_after(asn1::utctime _not_after) const
 		{
+			invalidate_cached_der();
+
 			throw_error_if_not(X509_set_notAfter(ptr().get(), _not_after.raw()) != 0);
 		}
 		inline bool certificate::verify_public_key(pkey::pkey pkey) const
@@ -1242,6 +1319,8 @@ namespace cryptoplus
 		}
 		inline void certificate::sign(pkey::pkey pkey, hash::message_digest_algorithm algorithm) const
 		{
+			invalidate_cached_der();
+
 			throw_error_if_not(X509_sign(ptr().get(), pkey.raw(), algorithm.raw()) != 0);
 		}
 		inline bool certificate::verify_private_key(pkey::pkey pkey) const
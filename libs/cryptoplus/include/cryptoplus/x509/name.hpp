@@ -295,6 +295,8 @@ namespace cryptoplus
 				/**
 				 * \brief Get a complete string representation of the name.
 				 * \return The string representation.
+				 *
+				 * The representation is memoized process-wide, keyed by the DER encoding of the name (which OpenSSL maintains and invalidates itself when the name is modified): printing the same name repeatedly - as the logs do for certificate subjects - costs one lookup instead of a full BIO printing pass.
 				 */
 				std::string to_string() const;
 
@@ -0,0 +1,117 @@
+/*
+ * libcryptoplus - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libcryptoplus.
+ *
+ * libcryptoplus is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libcryptoplus is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libcryptoplus in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file revocation_index.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A X509 certificate revocation index class.
+ */
+
+#ifndef CRYPTOPLUS_X509_REVOCATION_INDEX_HPP
+#define CRYPTOPLUS_X509_REVOCATION_INDEX_HPP
+
+#include "certificate.hpp"
+#include "certificate_revocation_list.hpp"
+
+#include <string>
+#include <vector>
+
+namespace cryptoplus
+{
+	namespace x509
+	{
+		/**
+		 * \brief A X509 certificate revocation index.
+		 *
+		 * revocation_index extracts the revoked serial numbers out of one or more certificate revocation lists into a sorted array, so that asking whether a certificate is revoked is a binary search over contiguous memory instead of a walk through the CRL structures.
+		 *
+		 * Build the index by calling add() for every relevant certificate revocation list, then seal() once: the serial numbers are parsed exactly once, at build time. A sealed index is immutable, so it can be shared between threads without locking - publish a fresh instance to replace it.
+		 *
+		 * \warning The index only knows serial numbers: it does not check CRL signatures, validity periods or issuers. It is meant as a fast pre-filter in front of a full store verification, not as a replacement for one.
+		 */
+		class revocation_index
+		{
+			public:
+
+				/**
+				 * \brief Create an empty revocation_index.
+				 */
+				revocation_index() :
+					m_sealed(false)
+				{}
+
+				/**
+				 * \brief Add the revoked serial numbers of the specified certificate revocation list to the index.
+				 * \param crl The certificate revocation list.
+				 *
+				 * Must not be called on a sealed index.
+				 */
+				void add(certificate_revocation_list crl);
+
+				/**
+				 * \brief Seal the index, making it ready for lookups.
+				 *
+				 * The serial numbers are sorted and deduplicated. After seal() the index is immutable.
+				 */
+				void seal();
+
+				/**
+				 * \brief Check whether the specified certificate is listed in the index.
+				 * \param cert The certificate.
+				 * \return true if the serial number of the certificate belongs to one of the added certificate revocation lists.
+				 */
+				bool is_revoked(certificate cert) const;
+
+				/**
+				 * \brief Get the count of indexed serial numbers.
+				 * \return The count.
+				 */
+				size_t size() const
+				{
+					return m_serials.size();
+				}
+
+			private:
+
+				std::vector<std::string> m_serials;
+				bool m_sealed;
+		};
+	}
+}
+
+#endif /* CRYPTOPLUS_X509_REVOCATION_INDEX_HPP */
@@ -0,0 +1,145 @@
+/*
+ * libcryptoplus - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libcryptoplus.
+ *
+ * libcryptoplus is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libcryptoplus is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libcryptoplus in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file verification_cache.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A X509 certificate verification cache class.
+ */
+
+#ifndef CRYPTOPLUS_X509_VERIFICATION_CACHE_HPP
+#define CRYPTOPLUS_X509_VERIFICATION_CACHE_HPP
+
+#include "../buffer.hpp"
+#include "../hash/message_digest_algorithm.hpp"
+#include "certificate.hpp"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/optional.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+#include <string>
+
+namespace cryptoplus
+{
+	namespace x509
+	{
+		/**
+		 * \brief A X509 certificate verification cache.
+		 *
+		 * verification_cache remembers the verdict of a full chain verification, keyed by the certificate fingerprint, so that re-verifying a recently seen certificate does not have to walk the chain again.
+		 *
+		 * Entries expire after a caller-chosen validity period. The cache knows nothing about the store it shadows: callers must call clear() whenever the certificate store or its revocation lists change.
+		 *
+		 * verification_cache is thread-safe.
+		 */
+		class verification_cache
+		{
+			public:
+
+				/**
+				 * \brief Create a verification_cache.
+				 * \param validity The duration for which a cached verdict remains valid.
+				 * \param max_size The maximum count of entries. When full, the cache is emptied before the next insertion.
+				 */
+				explicit verification_cache(const boost::posix_time::time_duration& validity = boost::posix_time::minutes(5), size_t max_size = 4096) :
+					m_validity(validity),
+					m_max_size(max_size)
+				{}
+
+				/**
+				 * \brief Get the cached verdict for the specified certificate, if any.
+				 * \param cert The certificate.
+				 * \return The verdict, or boost::none if the certificate has no unexpired entry.
+				 */
+				boost::optional<bool> get(certificate cert) const;
+
+				/**
+				 * \brief Remember the verdict for the specified certificate.
+				 * \param cert The certificate.
+				 * \param verdict The verdict.
+				 */
+				void put(certificate cert, bool verdict);
+
+				/**
+				 * \brief Forget all cached verdicts.
+				 *
+				 * Must be called whenever the certificate store or its revocation lists change, as the cached verdicts were issued against the previous store.
+				 */
+				void clear();
+
+				/**
+				 * \brief Load persisted verdicts from a file.
+				 * \param filename The file to load from.
+				 * \return The count of verdicts loaded.
+				 *
+				 * Expired entries and entries the cache already holds are skipped. A missing, truncated or foreign file loads nothing: the cache is only a cache and is rebuilt by verification as needed.
+				 */
+				size_t load(const std::string& filename);
+
+				/**
+				 * \brief Persist the unexpired verdicts to a file.
+				 * \param filename The file to save to.
+				 * \return The count of verdicts saved.
+				 *
+				 * The file holds fixed-layout records (fingerprint, verdict, expiry) in host byte order: it is a node-local cache, not an interchange format. Entries keep their expiry, so a stale file cannot extend a verdict's lifetime.
+				 */
+				size_t save(const std::string& filename) const;
+
+			private:
+
+				struct entry_type
+				{
+					bool verdict;
+					boost::posix_time::ptime expiry;
+				};
+
+				typedef std::map<buffer, entry_type> entry_map_type;
+
+				buffer get_fingerprint(certificate cert) const;
+
+				boost::posix_time::time_duration m_validity;
+				size_t m_max_size;
+				mutable boost::mutex m_mutex;
+				mutable entry_map_type m_entries;
+		};
+	}
+}
+
+#endif /* CRYPTOPLUS_X509_VERIFICATION_CACHE_HPP */
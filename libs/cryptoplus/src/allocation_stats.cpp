@@ -0,0 +1,128 @@
+/*
+ * libcryptoplus - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libcryptoplus.
+ *
+ * libcryptoplus is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libcryptoplus is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libcryptoplus in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file allocation_stats.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief Opt-in allocation accounting, per subsystem tag.
+ */
+
+#include "allocation_stats.hpp"
+
+namespace cryptoplus
+{
+	namespace
+	{
+		const char* const TAG_NAMES[allocation_stats::ALLOCATION_TAG_COUNT] = {
+			"cryptoplus_buffer",
+			"shared_buffer",
+			"message"
+		};
+	}
+
+	boost::atomic<bool> allocation_stats::s_enabled(false);
+	allocation_stats::tag_slot allocation_stats::s_slots[ALLOCATION_TAG_COUNT];
+
+	void allocation_stats::set_enabled(bool enabled)
+	{
+		s_enabled.store(enabled, boost::memory_order_relaxed);
+	}
+
+	std::map<std::string, allocation_stats::tag_statistics> allocation_stats::statistics()
+	{
+		std::map<std::string, tag_statistics> result;
+
+		for (size_t tag = 0; tag < ALLOCATION_TAG_COUNT; ++tag)
+		{
+			const tag_slot& slot = s_slots[tag];
+
+			tag_statistics stats;
+
+			stats.allocation_count = slot.allocation_count.load(boost::memory_order_relaxed);
+			stats.allocated_bytes = slot.allocated_bytes.load(boost::memory_order_relaxed);
+			stats.current_bytes = slot.current_bytes.load(boost::memory_order_relaxed);
+			stats.peak_bytes = slot.peak_bytes.load(boost::memory_order_relaxed);
+
+			result[TAG_NAMES[tag]] = stats;
+		}
+
+		return result;
+	}
+
+	void allocation_stats::reset()
+	{
+		for (size_t tag = 0; tag < ALLOCATION_TAG_COUNT; ++tag)
+		{
+			tag_slot& slot = s_slots[tag];
+
+			slot.allocation_count.store(0, boost::memory_order_relaxed);
+			slot.allocated_bytes.store(0, boost::memory_order_relaxed);
+			slot.current_bytes.store(0, boost::memory_order_relaxed);
+			slot.peak_bytes.store(0, boost::memory_order_relaxed);
+		}
+	}
+
+	void allocation_stats::do_record_allocation(allocation_tag tag, size_t bytes)
+	{
+		tag_slot& slot = s_slots[tag];
+
+		slot.allocation_count.fetch_add(1, boost::memory_order_relaxed);
+		slot.allocated_bytes.fetch_add(bytes, boost::memory_order_relaxed);
+
+		const uint64_t current = slot.current_bytes.fetch_add(bytes, boost::memory_order_relaxed) + bytes;
+
+		// Raise the high-water mark. Concurrent raises may interleave, but the mark never goes down.
+		uint64_t peak = slot.peak_bytes.load(boost::memory_order_relaxed);
+
+		while ((current > peak) && !slot.peak_bytes.compare_exchange_weak(peak, current, boost::memory_order_relaxed))
+		{
+		}
+	}
+
+	void allocation_stats::do_record_release(allocation_tag tag, size_t bytes)
+	{
+		tag_slot& slot = s_slots[tag];
+
+		// A release recorded without its allocation (accounting enabled mid-run, then no reset) could underflow: saturate at zero instead.
+		uint64_t current = slot.current_bytes.load(boost::memory_order_relaxed);
+
+		while (!slot.current_bytes.compare_exchange_weak(current, (current > bytes) ? (current - bytes) : 0, boost::memory_order_relaxed))
+		{
+		}
+	}
+}
@@ -44,50 +44,301 @@
 
 #include "base64.hpp"
 
-#include "bio/bio_chain.hpp"
-#include "bio/bio_ptr.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
 
-#include <openssl/buffer.h>
+#if defined(__SSSE3__) || (defined(_MSC_VER) && defined(__AVX__))
+#define CRYPTOPLUS_BASE64_USE_SSSE3
+#include <tmmintrin.h>
+#endif
 
 namespace cryptoplus
 {
-	size_t base64_encode(void* output, size_t outputlen, const void* input, size_t inputlen)
+	namespace
 	{
-		bio::bio_chain bio_chain(BIO_f_base64());
-		bio_chain.first().set_flags(BIO_FLAGS_BASE64_NO_NL);
-		bio_chain.first().push(BIO_new(BIO_s_mem()));
+		const char ENCODE_TABLE[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+		/**
+		 * \brief The base 64 character to value table.
+		 *
+		 * 0xFF marks an invalid character; '=' is invalid here and is handled explicitly when decoding the final quantum.
+		 */
+		const uint8_t DECODE_TABLE[256] = {
+			0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+			0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+			0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+			0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+			0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+			0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+			0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+			0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+			0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+			0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+			0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+			0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+			0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+			0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+			0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+			0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+		};
+
+#ifdef CRYPTOPLUS_BASE64_USE_SSSE3
+		/**
+		 * \brief Encode 12 input bytes into 16 base 64 characters.
+		 *
+		 * This is the classic lookup-shuffle kernel: the 6-bit groups are aligned with a shuffle and two 16-bit multiplications, then translated to ASCII by adding a per-range offset selected with another shuffle.
+		 */
+		inline __m128i encode_block(const __m128i in)
+		{
+			const __m128i shuffled = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+			const __m128i t0 = _mm_and_si128(shuffled, _mm_set1_epi32(0x0FC0FC00));
+			const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+			const __m128i t2 = _mm_and_si128(shuffled, _mm_set1_epi32(0x003F03F0));
+			const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+
+			const __m128i indices = _mm_or_si128(t1, t3);
+
+			__m128i offset_indices = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+			const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+			offset_indices = _mm_or_si128(offset_indices, _mm_and_si128(less, _mm_set1_epi8(13)));
+
+			const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+			return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, offset_indices));
+		}
+
+		/**
+		 * \brief Decode 16 base 64 characters into 12 output bytes.
+		 * \return false if any of the 16 characters is not a regular base 64 character, in which case nothing is written.
+		 *
+		 * The character class is derived from the two nibbles through shuffled lookup tables, which both validates the block and selects the offset that maps ASCII back to the 6-bit value.
+		 */
+		inline bool decode_block(const uint8_t* in, uint8_t* out)
+		{
+			const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+			const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+			const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+
+			const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+
+			const __m128i mask_0f = _mm_set1_epi8(0x0F);
+			const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(block, 4), mask_0f);
+			const __m128i lo_nibbles = _mm_and_si128(block, mask_0f);
+
+			const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+			const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+
+			if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0)
+			{
+				return false;
+			}
+
+			const __m128i eq_2f = _mm_cmpeq_epi8(block, _mm_set1_epi8(0x2F));
+			const __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+
+			const __m128i values = _mm_add_epi8(block, roll);
 
-		ptrdiff_t cnt = bio_chain.first().write(input, inputlen);
+			const __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+			const __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+			const __m128i bytes = _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
 
-		if (cnt <= 0)
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out), bytes);
+
+			const uint32_t tail = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(bytes, 8)));
+			std::memcpy(out + 8, &tail, sizeof(tail));
+
+			return true;
+		}
+#endif
+	}
+
+	size_t base64_encode(void* output, size_t outputlen, const void* input, size_t inputlen)
+	{
+		const uint8_t* in = static_cast<const uint8_t*>(input);
+		char* out = static_cast<char*>(output);
+
+		if (inputlen == 0)
 		{
 			throw std::runtime_error("Unable to perform base 64 encoding");
 		}
 
-		bio_chain.first().flush();
+		size_t i = 0;
+		size_t cnt = 0;
+
+#ifdef CRYPTOPLUS_BASE64_USE_SSSE3
+		// The kernel reads 16 input bytes but only consumes 12, so the last block is left to the scalar loop.
+		while ((inputlen - i >= 16) && (outputlen - cnt >= 16))
+		{
+			const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + cnt), encode_block(block));
+
+			i += 12;
+			cnt += 16;
+		}
+#endif
+
+		while ((inputlen - i >= 3) && (outputlen - cnt >= 4))
+		{
+			const uint32_t quantum = (static_cast<uint32_t>(in[i]) << 16) | (static_cast<uint32_t>(in[i + 1]) << 8) | in[i + 2];
+
+			out[cnt] = ENCODE_TABLE[quantum >> 18];
+			out[cnt + 1] = ENCODE_TABLE[(quantum >> 12) & 0x3F];
+			out[cnt + 2] = ENCODE_TABLE[(quantum >> 6) & 0x3F];
+			out[cnt + 3] = ENCODE_TABLE[quantum & 0x3F];
+
+			i += 3;
+			cnt += 4;
+		}
+
+		// The remaining input is either a final partial quantum or whatever could not fit: like the historical BIO implementation, a too small output buffer truncates the result.
+		while (i < inputlen)
+		{
+			const size_t remaining = inputlen - i;
+
+			char quantum_chars[4] = { '=', '=', '=', '=' };
+
+			uint32_t quantum = static_cast<uint32_t>(in[i]) << 16;
+
+			if (remaining >= 2)
+			{
+				quantum |= static_cast<uint32_t>(in[i + 1]) << 8;
+			}
+
+			if (remaining >= 3)
+			{
+				quantum |= in[i + 2];
+			}
+
+			quantum_chars[0] = ENCODE_TABLE[quantum >> 18];
+			quantum_chars[1] = ENCODE_TABLE[(quantum >> 12) & 0x3F];
+
+			if (remaining >= 2)
+			{
+				quantum_chars[2] = ENCODE_TABLE[(quantum >> 6) & 0x3F];
+			}
+
+			if (remaining >= 3)
+			{
+				quantum_chars[3] = ENCODE_TABLE[quantum & 0x3F];
+			}
 
-		BUF_MEM* b64ptr = bio_chain.first().next().get_mem_buf();
+			const size_t copied = std::min<size_t>(4, outputlen - cnt);
 
-		const size_t min_size = std::min(static_cast<size_t>(b64ptr->length), outputlen);
+			std::memcpy(out + cnt, quantum_chars, copied);
 
-		std::copy(static_cast<const char*>(b64ptr->data), static_cast<const char*>(b64ptr->data) + min_size, static_cast<char*>(output));
+			cnt += copied;
+			i += std::min<size_t>(3, remaining);
 
-		return min_size;
+			if (copied < 4)
+			{
+				break;
+			}
+		}
+
+		return cnt;
 	}
 
 	size_t base64_decode(void* output, size_t outputlen, const void* input, size_t inputlen)
 	{
-		bio::bio_chain bio_chain(BIO_f_base64());
-		bio_chain.first().set_flags(BIO_FLAGS_BASE64_NO_NL);
-		bio_chain.first().push(BIO_new_mem_buf(const_cast<void*>(input), static_cast<int>(inputlen)));
+		const uint8_t* in = static_cast<const uint8_t*>(input);
+		uint8_t* out = static_cast<uint8_t*>(output);
+
+		if ((inputlen == 0) || (inputlen % 4 != 0))
+		{
+			throw std::runtime_error("Unable to perform base 64 decoding");
+		}
+
+		size_t i = 0;
+		size_t cnt = 0;
+
+#ifdef CRYPTOPLUS_BASE64_USE_SSSE3
+		// The last block is left to the scalar loop, which is the only one that accepts padding characters.
+		while ((inputlen - i > 16) && (outputlen - cnt >= 12))
+		{
+			if (!decode_block(in + i, out + cnt))
+			{
+				break;
+			}
 
-		ptrdiff_t cnt = bio_chain.first().read(output, outputlen);
+			i += 16;
+			cnt += 12;
+		}
+#endif
+
+		while (i < inputlen)
+		{
+			const bool final_quantum = (inputlen - i == 4);
+
+			const uint8_t v0 = DECODE_TABLE[in[i]];
+			const uint8_t v1 = DECODE_TABLE[in[i + 1]];
+
+			if ((v0 == 0xFF) || (v1 == 0xFF))
+			{
+				throw std::runtime_error("Unable to perform base 64 decoding");
+			}
+
+			uint8_t v2 = 0;
+			uint8_t v3 = 0;
+			size_t quantum_size = 3;
+
+			if (final_quantum && (in[i + 2] == '='))
+			{
+				if (in[i + 3] != '=')
+				{
+					throw std::runtime_error("Unable to perform base 64 decoding");
+				}
+
+				quantum_size = 1;
+			}
+			else if (final_quantum && (in[i + 3] == '='))
+			{
+				v2 = DECODE_TABLE[in[i + 2]];
+
+				if (v2 == 0xFF)
+				{
+					throw std::runtime_error("Unable to perform base 64 decoding");
+				}
+
+				quantum_size = 2;
+			}
+			else
+			{
+				v2 = DECODE_TABLE[in[i + 2]];
+				v3 = DECODE_TABLE[in[i + 3]];
+
+				if ((v2 == 0xFF) || (v3 == 0xFF))
+				{
+					throw std::runtime_error("Unable to perform base 64 decoding");
+				}
+			}
+
+			uint8_t quantum_bytes[3];
+
+			quantum_bytes[0] = static_cast<uint8_t>((v0 << 2) | (v1 >> 4));
+			quantum_bytes[1] = static_cast<uint8_t>((v1 << 4) | (v2 >> 2));
+			quantum_bytes[2] = static_cast<uint8_t>((v2 << 6) | v3);
+
+			const size_t copied = std::min(quantum_size, outputlen - cnt);
+
+			std::memcpy(out + cnt, quantum_bytes, copied);
+
+			cnt += copied;
+			i += 4;
+
+			if (copied < quantum_size)
+			{
+				break;
+			}
+		}
 
-		if (cnt <= 0)
+		if (cnt == 0)
 		{
 			throw std::runtime_error("Unable to perform base 64 decoding");
 		}
 
-		return static_cast<size_t>(cnt);
+		return cnt;
 	}
 }
@@ -46,6 +46,8 @@
 
 #include "bio/bio_chain.hpp"
 
+#include <boost/thread/mutex.hpp>
+
 #include <cassert>
 
 namespace cryptoplus
@@ -61,6 +63,60 @@ namespace cryptoplus
 			{
 				return bio::bio_chain(BIO_new_mem_buf(const_cast<void*>(buf), static_cast<int>(buf_len)));
 			}
+
+			// The cached DER buffer is attached to the X509 structure itself so every wrapper instance shares it; the free callback releases it along with the structure. X509_dup() goes through a full reserialization and so never copies the attachment.
+			void free_cached_der(void*, void* ptr, CRYPTO_EX_DATA*, int, long, void*)
+			{
+				delete static_cast<buffer*>(ptr);
+			}
+
+			int cached_der_index()
+			{
+				static const int index = X509_get_ex_new_index(0, NULL, NULL, NULL, &free_cached_der);
+
+				return index;
+			}
+
+			boost::mutex cached_der_mutex;
+		}
+
+		const buffer& certificate::cached_der() const
+		{
+			boost::mutex::scoped_lock lock(cached_der_mutex);
+
+			buffer* cached = static_cast<buffer*>(X509_get_ex_data(ptr().get(), cached_der_index()));
+
+			if (!cached)
+			{
+				cached = new buffer(write_der());
+
+				try
+				{
+					throw_error_if_not(X509_set_ex_data(ptr().get(), cached_der_index(), cached) != 0);
+				}
+				catch (...)
+				{
+					delete cached;
+
+					throw;
+				}
+			}
+
+			return *cached;
+		}
+
+		void certificate::invalidate_cached_der() const
+		{
+			boost::mutex::scoped_lock lock(cached_der_mutex);
+
+			buffer* const cached = static_cast<buffer*>(X509_get_ex_data(ptr().get(), cached_der_index()));
+
+			if (cached)
+			{
+				delete cached;
+
+				X509_set_ex_data(ptr().get(), cached_der_index(), NULL);
+			}
 		}
 
 		certificate certificate::from_certificate(const void* buf, size_t buf_len, pem_passphrase_callback_type callback, void* callback_arg)
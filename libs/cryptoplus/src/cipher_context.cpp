@@ -47,7 +47,12 @@
 #include "pkey/pkey.hpp"
 #include "random/random.hpp"
 
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/tss.hpp>
+
 #include <cassert>
+#include <map>
+#include <utility>
 
 namespace cryptoplus
 {
@@ -100,6 +105,30 @@ namespace cryptoplus
 			}
 		}
 
+		cipher_context& cipher_context::thread_local_context(const cipher_algorithm& _algorithm, cipher_direction direction)
+		{
+			assert(direction != unchanged);
+
+			typedef std::map<std::pair<const EVP_CIPHER*, int>, boost::shared_ptr<cipher_context> > context_map_type;
+
+			static boost::thread_specific_ptr<context_map_type> context_map;
+
+			if (!context_map.get())
+			{
+				context_map.reset(new context_map_type());
+			}
+
+			boost::shared_ptr<cipher_context>& context = (*context_map)[std::make_pair(_algorithm.raw(), static_cast<int>(direction))];
+
+			if (!context)
+			{
+				context.reset(new cipher_context());
+				context->initialize(_algorithm, direction, NULL, 0, NULL);
+			}
+
+			return *context;
+		}
+
 		void cipher_context::initialize(const cipher_algorithm& _algorithm, cipher_context::cipher_direction direction, const void* key, size_t key_len, const void* iv, ENGINE* impl)
 		{
 			if (key && _algorithm)
@@ -115,6 +144,11 @@ namespace cryptoplus
 			throw_error_if_not(EVP_CipherInit_ex(&m_ctx, _algorithm.raw(), impl, static_cast<const unsigned char*>(key), static_cast<const unsigned char*>(iv), static_cast<int>(direction)) != 0);
 		}
 
+		void cipher_context::set_iv(const void* iv)
+		{
+			throw_error_if_not(EVP_CipherInit_ex(&m_ctx, NULL, NULL, NULL, static_cast<const unsigned char*>(iv), static_cast<int>(unchanged)) != 0);
+		}
+
 		buffer cipher_context::seal_initialize(const cipher_algorithm& _algorithm, void* iv, pkey::pkey pkey)
 		{
 			return seal_initialize(_algorithm, iv, &pkey, &pkey + sizeof(&pkey))[0];
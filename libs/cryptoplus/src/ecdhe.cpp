@@ -45,6 +45,9 @@
 #include "pkey/ecdhe.hpp"
 
 #include <cassert>
+#include <map>
+
+#include <boost/thread/mutex.hpp>
 
 #include "bio/bio_chain.hpp"
 
@@ -66,25 +69,55 @@ namespace cryptoplus
 			};
 
 			typedef std::unique_ptr<EVP_PKEY_CTX, universal_deleter> evp_pkey_context_type;
-		}
 
-		ecdhe_context::ecdhe_context(int nid) :
-			m_nid(nid)
-		{
+			boost::mutex ecdhe_parameters_mutex;
+			std::map<int, pkey> ecdhe_parameters_cache;
 		}
 
-		void ecdhe_context::generate_keys()
+		pkey get_ecdhe_parameters(int nid)
 		{
+			boost::mutex::scoped_lock lock(ecdhe_parameters_mutex);
+
+			const std::map<int, pkey>::const_iterator it = ecdhe_parameters_cache.find(nid);
+
+			if (it != ecdhe_parameters_cache.end())
+			{
+				return it->second;
+			}
+
 			evp_pkey_context_type parameters_context(EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL));
 
 			throw_error_if_not(parameters_context.get());
 			throw_error_if(EVP_PKEY_paramgen_init(parameters_context.get()) != 1);
-			throw_error_if(EVP_PKEY_CTX_set_ec_paramgen_curve_nid(parameters_context.get(), m_nid) != 1);
+			throw_error_if(EVP_PKEY_CTX_set_ec_paramgen_curve_nid(parameters_context.get(), nid) != 1);
 
 			EVP_PKEY* cparameters = nullptr;
 			throw_error_if_not(EVP_PKEY_paramgen(parameters_context.get(), &cparameters) == 1);
 			pkey parameters = pkey::take_ownership(cparameters);
 
+			// Precompute the generator multiplication tables once: the group (tables included) is copied into every key generated from these parameters.
+			EC_KEY* const ec_key = EVP_PKEY_get1_EC_KEY(parameters.raw());
+
+			if (ec_key)
+			{
+				EC_KEY_precompute_mult(ec_key, NULL);
+				EC_KEY_free(ec_key);
+			}
+
+			ecdhe_parameters_cache[nid] = parameters;
+
+			return parameters;
+		}
+
+		ecdhe_context::ecdhe_context(int nid) :
+			m_nid(nid)
+		{
+		}
+
+		void ecdhe_context::generate_keys()
+		{
+			pkey parameters = get_ecdhe_parameters(m_nid);
+
 			evp_pkey_context_type key_generation_context(EVP_PKEY_CTX_new(parameters.raw(), NULL));
 
 			throw_error_if_not(key_generation_context.get());
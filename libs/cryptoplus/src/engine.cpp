@@ -0,0 +1,105 @@
+/*
+ * libcryptoplus - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libcryptoplus.
+ *
+ * libcryptoplus is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libcryptoplus is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libcryptoplus in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+
+/**
+ * \file engine.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief OpenSSL engine selection functions.
+ */
+
+#include "engine.hpp"
+
+namespace cryptoplus
+{
+	namespace engine
+	{
+		namespace
+		{
+			ENGINE* selected_engine = NULL;
+			size_t engine_threshold = 0;
+		}
+
+		bool select(const std::string& id)
+		{
+			ENGINE_load_builtin_engines();
+
+			ENGINE* const result = ENGINE_by_id(id.c_str());
+
+			if (!result)
+			{
+				return false;
+			}
+
+			if (ENGINE_init(result) != 1)
+			{
+				ENGINE_free(result);
+
+				return false;
+			}
+
+			if (!ENGINE_get_ciphers(result))
+			{
+				ENGINE_finish(result);
+				ENGINE_free(result);
+
+				return false;
+			}
+
+			// The structural and functional references are kept forever: the engine must outlive every cipher context that was initialized with it.
+			selected_engine = result;
+
+			return true;
+		}
+
+		ENGINE* selected()
+		{
+			return selected_engine;
+		}
+
+		void set_threshold(size_t bytes)
+		{
+			engine_threshold = bytes;
+		}
+
+		ENGINE* for_size(size_t size)
+		{
+			return (selected_engine && (size >= engine_threshold)) ? selected_engine : NULL;
+		}
+	}
+}
@@ -45,6 +45,8 @@
 #include "hash/hmac.hpp"
 #include "hash/hmac_context.hpp"
 
+#include <boost/thread/tss.hpp>
+
 #include <cassert>
 
 namespace cryptoplus
@@ -57,10 +59,17 @@ namespace cryptoplus
 			assert(key);
 			assert(data);
 
-			hmac_context ctx;
-			ctx.initialize(key, key_len, &algorithm, impl);
-			ctx.update(data, len);
-			return ctx.finalize(out, out_len);
+			// The context lives in thread-local storage so repeated one-shot computations do not pay the construction and cleanup cost of a fresh context.
+			static boost::thread_specific_ptr<hmac_context> ctx;
+
+			if (!ctx.get())
+			{
+				ctx.reset(new hmac_context());
+			}
+
+			ctx->initialize(key, key_len, &algorithm, impl);
+			ctx->update(data, len);
+			return ctx->finalize(out, out_len);
 		}
 	}
 }
@@ -45,6 +45,8 @@
 #include "hash/message_digest.hpp"
 #include "hash/message_digest_context.hpp"
 
+#include <boost/thread/tss.hpp>
+
 #include <cassert>
 
 namespace cryptoplus
@@ -56,10 +58,17 @@ namespace cryptoplus
 			assert(out);
 			assert(data);
 
-			message_digest_context ctx;
-			ctx.initialize(algorithm, impl);
-			ctx.update(data, len);
-			return ctx.finalize(out, out_len);
+			// The context lives in thread-local storage so repeated one-shot computations do not pay the construction and cleanup cost of a fresh context. Reinitializing with the same algorithm also keeps the digest state allocation.
+			static boost::thread_specific_ptr<message_digest_context> ctx;
+
+			if (!ctx.get())
+			{
+				ctx.reset(new message_digest_context());
+			}
+
+			ctx->initialize(algorithm, impl);
+			ctx->update(data, len);
+			return ctx->finalize(out, out_len);
 		}
 	}
 }
@@ -44,7 +44,10 @@
 
 #include "x509/name.hpp"
 
+#include <boost/thread/mutex.hpp>
+
 #include <cassert>
+#include <map>
 
 namespace cryptoplus
 {
@@ -60,15 +63,63 @@ namespace cryptoplus
 			return name(_ptr, deleter);
 		}
 
+		namespace
+		{
+			std::string print_to_string(const name& _name)
+			{
+				bio::bio_ptr bio(BIO_new(BIO_s_mem()));
+
+				_name.print(bio);
+
+				BUF_MEM* const str = bio.get_mem_buf();
+
+				return std::string(str->data, str->length);
+			}
+
+			// The memoized representations. Keyed by the DER encoding, which i2d_X509_NAME() takes from the cache OpenSSL keeps inside the X509_NAME whenever the name was not modified, so the key itself is cheap to obtain and goes stale with the name.
+			const size_t string_cache_max_size = 1024;
+			boost::mutex string_cache_mutex;
+			std::map<std::string, std::string> string_cache;
+		}
+
 		std::string name::to_string() const
 		{
-			bio::bio_ptr bio(BIO_new(BIO_s_mem()));
+			unsigned char* der = NULL;
+
+			const int der_len = i2d_X509_NAME(ptr().get(), &der);
+
+			if (der_len <= 0)
+			{
+				return print_to_string(*this);
+			}
+
+			const std::string key(reinterpret_cast<const char*>(der), static_cast<size_t>(der_len));
+
+			OPENSSL_free(der);
+
+			{
+				boost::mutex::scoped_lock lock(string_cache_mutex);
+
+				const std::map<std::string, std::string>::const_iterator entry = string_cache.find(key);
+
+				if (entry != string_cache.end())
+				{
+					return entry->second;
+				}
+			}
+
+			const std::string result = print_to_string(*this);
+
+			boost::mutex::scoped_lock lock(string_cache_mutex);
 
-			this->print(bio);
+			if (string_cache.size() >= string_cache_max_size)
+			{
+				string_cache.clear();
+			}
 
-			BUF_MEM* const str = bio.get_mem_buf();
+			string_cache[key] = result;
 
-			return std::string(str->data, str->length);
+			return result;
 		}
 	}
 }
@@ -44,17 +44,83 @@
 
 #include "random/random.hpp"
 
-#ifdef MSV
-// Avoid LNK4221: no public symbols found; archive member will be inacessible
-namespace
-{
-	char not_empty;
-}
+#include <boost/thread/tss.hpp>
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <unistd.h>
 #endif
 
 namespace cryptoplus
 {
 	namespace random
 	{
+		namespace
+		{
+			const size_t RANDOM_POOL_SIZE = 4096;
+
+			/**
+			 * \brief The per-thread pool of buffered random bytes.
+			 */
+			struct random_pool
+			{
+				random_pool() :
+					offset(RANDOM_POOL_SIZE)
+#ifndef _WIN32
+					, pid(::getpid())
+#endif
+				{}
+
+				uint8_t bytes[RANDOM_POOL_SIZE];
+				size_t offset;
+#ifndef _WIN32
+				pid_t pid;
+#endif
+			};
+		}
+
+		void get_random_bytes(void* buf, size_t buf_len)
+		{
+			// Large requests would drain the pool immediately: serve them directly.
+			if (buf_len >= RANDOM_POOL_SIZE)
+			{
+				throw_error_if_not(RAND_bytes(static_cast<unsigned char*>(buf), static_cast<int>(buf_len)) == 1);
+
+				return;
+			}
+
+			static boost::thread_specific_ptr<random_pool> pool;
+
+			if (!pool.get())
+			{
+				pool.reset(new random_pool());
+			}
+
+			random_pool& _pool = *pool;
+
+#ifndef _WIN32
+			// After a fork, the child must not replay bytes that were buffered in the parent.
+			if (_pool.pid != ::getpid())
+			{
+				_pool.pid = ::getpid();
+				_pool.offset = RANDOM_POOL_SIZE;
+			}
+#endif
+
+			if (RANDOM_POOL_SIZE - _pool.offset < buf_len)
+			{
+				throw_error_if_not(RAND_bytes(_pool.bytes, RANDOM_POOL_SIZE) == 1);
+
+				_pool.offset = 0;
+			}
+
+			std::memcpy(buf, _pool.bytes + _pool.offset, buf_len);
+
+			// Wipe the handed-out bytes so the pool never retains randomness that is in use elsewhere.
+			std::memset(_pool.bytes + _pool.offset, 0, buf_len);
+
+			_pool.offset += buf_len;
+		}
 	}
 }
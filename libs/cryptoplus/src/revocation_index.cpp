@@ -0,0 +1,104 @@
+/*
+ * libcryptoplus - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libcryptoplus.
+ *
+ * libcryptoplus is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libcryptoplus is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libcryptoplus in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file revocation_index.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A X509 certificate revocation index class.
+ */
+
+#include "x509/revocation_index.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace cryptoplus
+{
+	namespace x509
+	{
+		namespace
+		{
+			std::string to_serial_key(const ASN1_INTEGER* serial)
+			{
+				if (!serial || (serial->length <= 0))
+				{
+					return std::string();
+				}
+
+				return std::string(reinterpret_cast<const char*>(serial->data), static_cast<size_t>(serial->length));
+			}
+		}
+
+		void revocation_index::add(certificate_revocation_list crl)
+		{
+			assert(!m_sealed);
+
+			STACK_OF(X509_REVOKED)* revoked_entries = X509_CRL_get_REVOKED(crl.raw());
+
+			const int count = sk_X509_REVOKED_num(revoked_entries);
+
+			for (int i = 0; i < count; ++i)
+			{
+				const X509_REVOKED* revoked = sk_X509_REVOKED_value(revoked_entries, i);
+
+				m_serials.push_back(to_serial_key(revoked->serialNumber));
+			}
+		}
+
+		void revocation_index::seal()
+		{
+			std::sort(m_serials.begin(), m_serials.end());
+			m_serials.erase(std::unique(m_serials.begin(), m_serials.end()), m_serials.end());
+
+			m_sealed = true;
+		}
+
+		bool revocation_index::is_revoked(certificate cert) const
+		{
+			const std::string serial_key = to_serial_key(cert.serial_number().raw());
+
+			if (!m_sealed)
+			{
+				// An unsealed index is not sorted yet: fall back to a linear scan rather than give a wrong answer.
+				return std::find(m_serials.begin(), m_serials.end(), serial_key) != m_serials.end();
+			}
+
+			return std::binary_search(m_serials.begin(), m_serials.end(), serial_key);
+		}
+	}
+}
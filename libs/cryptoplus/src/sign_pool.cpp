@@ -0,0 +1,166 @@
+/*
+ * libcryptoplus - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libcryptoplus.
+ *
+ * libcryptoplus is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libcryptoplus is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libcryptoplus in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file sign_pool.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An asynchronous signing worker pool.
+ */
+
+#include "pkey/sign_pool.hpp"
+
+#include "hash/message_digest_context.hpp"
+
+#include <boost/bind.hpp>
+
+#include <cassert>
+
+namespace cryptoplus
+{
+	namespace pkey
+	{
+		namespace
+		{
+			void do_sign(pkey key, hash::message_digest_algorithm algorithm, buffer data, sign_pool::sign_handler_type handler)
+			{
+				try
+				{
+					hash::message_digest_context mdctx;
+
+					mdctx.digest_sign_initialize(algorithm, key);
+					mdctx.digest_sign_update(data);
+
+					handler(mdctx.digest_sign_finalize(), std::exception_ptr());
+				}
+				catch (...)
+				{
+					handler(buffer(), std::current_exception());
+				}
+			}
+
+			void do_verify(pkey key, hash::message_digest_algorithm algorithm, buffer data, buffer signature, sign_pool::verify_handler_type handler)
+			{
+				try
+				{
+					hash::message_digest_context mdctx;
+
+					mdctx.digest_verify_initialize(algorithm, key);
+					mdctx.digest_verify_update(data);
+
+					handler(mdctx.digest_verify_finalize(buffer_cast<const uint8_t*>(signature), buffer_size(signature)), std::exception_ptr());
+				}
+				catch (...)
+				{
+					handler(false, std::current_exception());
+				}
+			}
+		}
+
+		sign_pool::sign_pool(size_t worker_count) :
+			m_stopping(false)
+		{
+			assert(worker_count > 0);
+
+			for (size_t i = 0; i < worker_count; ++i)
+			{
+				m_threads.create_thread(boost::bind(&sign_pool::run, this));
+			}
+		}
+
+		sign_pool::~sign_pool()
+		{
+			{
+				boost::mutex::scoped_lock lock(m_mutex);
+
+				m_stopping = true;
+			}
+
+			m_condition.notify_all();
+
+			m_threads.join_all();
+		}
+
+		void sign_pool::async_sign(pkey key, hash::message_digest_algorithm algorithm, const buffer& data, sign_handler_type handler)
+		{
+			post(boost::bind(&do_sign, key, algorithm, data, handler));
+		}
+
+		void sign_pool::async_verify(pkey key, hash::message_digest_algorithm algorithm, const buffer& data, const buffer& signature, verify_handler_type handler)
+		{
+			post(boost::bind(&do_verify, key, algorithm, data, signature, handler));
+		}
+
+		void sign_pool::post(const task_type& task)
+		{
+			{
+				boost::mutex::scoped_lock lock(m_mutex);
+
+				m_tasks.push_back(task);
+			}
+
+			m_condition.notify_one();
+		}
+
+		void sign_pool::run()
+		{
+			for (;;)
+			{
+				task_type task;
+
+				{
+					boost::mutex::scoped_lock lock(m_mutex);
+
+					while (m_tasks.empty() && !m_stopping)
+					{
+						m_condition.wait(lock);
+					}
+
+					if (m_tasks.empty())
+					{
+						return;
+					}
+
+					task = m_tasks.front();
+					m_tasks.pop_front();
+				}
+
+				task();
+			}
+		}
+	}
+}
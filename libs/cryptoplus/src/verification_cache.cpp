@@ -0,0 +1,236 @@
+/*
+ * libcryptoplus - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libcryptoplus.
+ *
+ * libcryptoplus is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libcryptoplus is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libcryptoplus in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file verification_cache.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A X509 certificate verification cache class.
+ */
+
+#include "x509/verification_cache.hpp"
+
+#include <openssl/objects.h>
+
+#include <fstream>
+
+#include <stdint.h>
+
+namespace cryptoplus
+{
+	namespace x509
+	{
+		boost::optional<bool> verification_cache::get(certificate cert) const
+		{
+			const buffer fingerprint = get_fingerprint(cert);
+
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			const entry_map_type::iterator entry = m_entries.find(fingerprint);
+
+			if (entry == m_entries.end())
+			{
+				return boost::none;
+			}
+
+			if (boost::posix_time::microsec_clock::universal_time() >= entry->second.expiry)
+			{
+				m_entries.erase(entry);
+
+				return boost::none;
+			}
+
+			return entry->second.verdict;
+		}
+
+		void verification_cache::put(certificate cert, bool verdict)
+		{
+			const buffer fingerprint = get_fingerprint(cert);
+
+			const entry_type entry = { verdict, boost::posix_time::microsec_clock::universal_time() + m_validity };
+
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			if ((m_entries.size() >= m_max_size) && (m_entries.find(fingerprint) == m_entries.end()))
+			{
+				// Expired entries go first; if none expired, everything goes. Verdicts are cheap to recompute compared to tracking an eviction order.
+				const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+				for (entry_map_type::iterator it = m_entries.begin(); it != m_entries.end();)
+				{
+					if (now >= it->second.expiry)
+					{
+						m_entries.erase(it++);
+					}
+					else
+					{
+						++it;
+					}
+				}
+
+				if (m_entries.size() >= m_max_size)
+				{
+					m_entries.clear();
+				}
+			}
+
+			m_entries[fingerprint] = entry;
+		}
+
+		void verification_cache::clear()
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			m_entries.clear();
+		}
+
+		namespace
+		{
+			const char VERIFICATION_CACHE_MAGIC[8] = { 'F', 'L', 'V', 'C', 'A', 'C', 'H', '1' };
+
+			const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+		}
+
+		size_t verification_cache::load(const std::string& filename)
+		{
+			std::ifstream file(filename.c_str(), std::ios::binary);
+
+			if (!file)
+			{
+				return 0;
+			}
+
+			char magic[sizeof(VERIFICATION_CACHE_MAGIC)];
+
+			if (!file.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), VERIFICATION_CACHE_MAGIC))
+			{
+				return 0;
+			}
+
+			const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+			size_t result = 0;
+
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			while (m_entries.size() < m_max_size)
+			{
+				uint8_t fingerprint_size = 0;
+
+				if (!file.read(reinterpret_cast<char*>(&fingerprint_size), sizeof(fingerprint_size)))
+				{
+					break;
+				}
+
+				uint8_t fingerprint_data[255];
+				uint8_t verdict = 0;
+				int64_t expiry_seconds = 0;
+
+				if (!file.read(reinterpret_cast<char*>(fingerprint_data), fingerprint_size) || !file.read(reinterpret_cast<char*>(&verdict), sizeof(verdict)) || !file.read(reinterpret_cast<char*>(&expiry_seconds), sizeof(expiry_seconds)))
+				{
+					break;
+				}
+
+				const boost::posix_time::ptime expiry = epoch + boost::posix_time::seconds(static_cast<long>(expiry_seconds));
+
+				if (now >= expiry)
+				{
+					continue;
+				}
+
+				const buffer fingerprint(fingerprint_data, fingerprint_size);
+
+				if (m_entries.find(fingerprint) != m_entries.end())
+				{
+					continue;
+				}
+
+				const entry_type entry = { (verdict != 0), expiry };
+
+				m_entries[fingerprint] = entry;
+				++result;
+			}
+
+			return result;
+		}
+
+		size_t verification_cache::save(const std::string& filename) const
+		{
+			std::ofstream file(filename.c_str(), std::ios::binary | std::ios::trunc);
+
+			if (!file)
+			{
+				return 0;
+			}
+
+			file.write(VERIFICATION_CACHE_MAGIC, sizeof(VERIFICATION_CACHE_MAGIC));
+
+			const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+			size_t result = 0;
+
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			for (entry_map_type::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+			{
+				if (now >= it->second.expiry)
+				{
+					continue;
+				}
+
+				const uint8_t fingerprint_size = static_cast<uint8_t>(it->first.data().size());
+				const uint8_t verdict = it->second.verdict ? 1 : 0;
+				const int64_t expiry_seconds = (it->second.expiry - epoch).total_seconds();
+
+				file.write(reinterpret_cast<const char*>(&fingerprint_size), sizeof(fingerprint_size));
+				file.write(reinterpret_cast<const char*>(it->first.data().begin()), fingerprint_size);
+				file.write(reinterpret_cast<const char*>(&verdict), sizeof(verdict));
+				file.write(reinterpret_cast<const char*>(&expiry_seconds), sizeof(expiry_seconds));
+
+				++result;
+			}
+
+			return result;
+		}
+
+		buffer verification_cache::get_fingerprint(certificate cert) const
+		{
+			// The fingerprint only keys the cache, so the digest algorithm is not negotiable: SHA-256 is collision-resistant and cheap.
+			return cert.fingerprint(hash::message_digest_algorithm(NID_sha256));
+		}
+	}
+}
@@ -51,15 +51,66 @@
 #include <vector>
 #include <map>
 #include <string>
+#include <functional>
+#include <memory>
 
 #include <boost/system/system_error.hpp>
+#include <boost/asio.hpp>
 
 namespace executeplus
 {
+	/**
+	 * \brief A handler for asynchronous executions, called with the error code and the child exit status.
+	 */
+	typedef std::function<void (const boost::system::error_code&, int)> execute_handler_type;
+
 	std::map<std::string, std::string> get_current_environment();
+
+	/**
+	 * \brief An immutable snapshot of the process environment, prepared for spawning.
+	 *
+	 * The variables are kept both parsed and flattened into their final "KEY=VALUE" layout, so executions that start from a snapshot only lay out their per-execution variables.
+	 */
+	struct environment_snapshot
+	{
+		std::map<std::string, std::string> variables;
+		std::vector<char> buffer;
+		std::vector<const char*> pointers;
+	};
+
+	/**
+	 * \brief Get the shared snapshot of the current environment.
+	 * \return The snapshot. It is built on the first call and shared across executions afterwards.
+	 *
+	 * The returned snapshot is immutable: callers keep a consistent view even when the snapshot is refreshed concurrently.
+	 */
+	std::shared_ptr<const environment_snapshot> get_environment_snapshot();
+
+	/**
+	 * \brief Rebuild the shared environment snapshot from the current environment.
+	 *
+	 * Executions that already hold the previous snapshot are unaffected.
+	 */
+	void refresh_environment_snapshot();
+
 	int execute(const std::vector<std::string>& args, const std::map<std::string, std::string>& env, boost::system::error_code& ec, std::ostream* output = nullptr);
 	int execute(const std::vector<std::string>& args, const std::map<std::string, std::string>& env, std::ostream* output = nullptr);
 	void checked_execute(const std::vector<std::string>& args, const std::map<std::string, std::string>& env, std::ostream* output = nullptr);
+
+	/**
+	 * \brief Execute a command in an environment built from a shared snapshot.
+	 *
+	 * The child environment is the snapshot plus extra_env. When no extra variable overrides a snapshot variable - the usual case - the snapshot's flattened strings are referenced in place and only extra_env is laid out.
+	 */
+	int execute(const std::vector<std::string>& args, const std::shared_ptr<const environment_snapshot>& env, const std::map<std::string, std::string>& extra_env, boost::system::error_code& ec, std::ostream* output = nullptr);
+	int execute(const std::vector<std::string>& args, const std::shared_ptr<const environment_snapshot>& env, const std::map<std::string, std::string>& extra_env, std::ostream* output = nullptr);
+
+	/**
+	 * \brief Execute a command without blocking the calling thread.
+	 *
+	 * The command is spawned immediately; its output streams through an asio descriptor on the given io_service and the handler is posted with the exit status once the child is done. When output is null the child's output is drained and discarded.
+	 */
+	void async_execute(boost::asio::io_service& io_service, const std::vector<std::string>& args, const std::map<std::string, std::string>& env, execute_handler_type handler, std::ostream* output = nullptr);
 }
 
 #endif
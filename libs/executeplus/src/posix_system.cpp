@@ -52,11 +52,16 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include <spawn.h>
+#include <dirent.h>
 
 #include <iostream>
 #include <sstream>
+#include <array>
+#include <mutex>
 
 #include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/iostreams/device/file_descriptor.hpp>
 #include <boost/iostreams/stream.hpp>
 
@@ -64,246 +69,299 @@ extern char** environ;
 
 namespace executeplus
 {
-	std::map<std::string, std::string> get_current_environment()
+	namespace
 	{
-		std::map<std::string, std::string> result;
-
-		for (size_t count = 0; environ[count]; ++count)
+		std::vector<int> get_open_descriptors()
 		{
-			const std::string line = std::string(environ[count]);
-			const auto pos = line.find('=');
+			std::vector<int> result;
 
-			if (pos == std::string::npos)
+#ifdef LINUX
+			DIR* const dir = ::opendir("/proc/self/fd");
+
+			if (dir)
 			{
-				result[line] = std::string();
+				const int dir_fd = ::dirfd(dir);
+
+				for (struct dirent* entry = ::readdir(dir); entry; entry = ::readdir(dir))
+				{
+					if ((entry->d_name[0] >= '0') && (entry->d_name[0] <= '9'))
+					{
+						const int n = ::atoi(entry->d_name);
+
+						if (n != dir_fd)
+						{
+							result.push_back(n);
+						}
+					}
+				}
+
+				::closedir(dir);
+
+				return result;
 			}
-			else
+#endif
+
+			const int fdlimit = static_cast<int>(::sysconf(_SC_OPEN_MAX));
+
+			for (int n = 0; n < fdlimit; ++n)
 			{
-				const std::string key = line.substr(0, pos);
-				const std::string value = line.substr(pos + 1);
-				result[key] = value;
+				if (::fcntl(n, F_GETFD) != -1)
+				{
+					result.push_back(n);
+				}
 			}
+
+			return result;
 		}
 
-		return result;
-	}
+		void build_envp(const std::map<std::string, std::string>& env, std::vector<char>& envp_buffer, std::vector<const char*>& envp)
+		{
+			// Estimate the required size for the envp buffer. One null-terminated byte per entry.
+			size_t buffer_size = env.size();
 
-	int execute(const std::vector<std::string>& args, const std::map<std::string, std::string>& env, boost::system::error_code& ec, std::ostream* output)
-	{
-#if FREELAN_DEBUG
-		std::cout << "Executing:";
+			for (auto&& pair : env)
+			{
+				buffer_size += pair.first.size() + 1 + pair.second.size();
+			}
 
-		for (auto&& arg : args)
-		{
-			std::cout << " " << arg;
-		}
+			envp_buffer.resize(buffer_size, 0x00);
+			envp.reserve(env.size() + 1);
+			auto offset = envp_buffer.begin();
 
-		std::cout << std::endl;
+			for (auto&& pair : env)
+			{
+				envp.push_back(&*offset);
+				offset = std::copy(pair.first.begin(), pair.first.end(), offset);
+				*(offset++) = '=';
+				offset = std::copy(pair.second.begin(), pair.second.end(), offset);
+				*(offset++) = '\0';
+			}
 
-		std::cout << "Environment starts:" << std::endl;
+			envp.push_back(nullptr);
+		}
 
-		for (auto&& pair : env)
+		pid_t spawn_process(const std::vector<std::string>& args, const std::vector<const char*>& envp, int output_write_fd, boost::system::error_code& ec)
 		{
-			std::cout << pair.first << "=" << pair.second << std::endl;
-		}
+			// Build the argv buffer up front: with posix_spawn() no code runs in the child, so everything must be ready before spawning.
 
-		std::cout << "Environment ends." << std::endl;
-#endif
+			// Estimate the required size for the argv buffer.
+			std::vector<char> argv_buffer;
+			std::vector<char*> argv(args.size() + 1, nullptr);
 
-		int fd[2] = {0, 0};
+			{
+				// One null-terminated byte per arg.
+				size_t buffer_size = args.size();
 
-		if (::pipe(fd) < 0)
-		{
-			ec = boost::system::error_code(errno, boost::system::system_category());
+				for (auto&& arg : args)
+				{
+					buffer_size += arg.size();
+				}
 
-			return -1;
-		}
+				argv_buffer.resize(buffer_size, 0x00);
+				auto offset = argv_buffer.begin();
 
-		int output_fd[2] = {0, 0};
+				for (size_t i = 0; i != args.size(); ++i)
+				{
+					const auto& arg = args[i];
 
-		if (output)
-		{
-			if (::pipe(output_fd) < 0)
+					argv[i] = &*offset;
+					offset = std::copy(arg.begin(), arg.end(), offset);
+					*(offset++) = '\0';
+				}
+			}
+
+			// The scripts must not inherit any of the daemon's descriptors: enumerate the open ones and schedule their closing in the file actions.
+			const std::vector<int> open_fds = get_open_descriptors();
+
+			posix_spawn_file_actions_t file_actions;
+			::posix_spawn_file_actions_init(&file_actions);
+
+			if (output_write_fd >= 0)
 			{
-				ec = boost::system::error_code(errno, boost::system::system_category());
+				::posix_spawn_file_actions_adddup2(&file_actions, output_write_fd, STDOUT_FILENO);
+				::posix_spawn_file_actions_adddup2(&file_actions, output_write_fd, STDERR_FILENO);
+			}
+
+			for (auto&& n : open_fds)
+			{
+				if ((output_write_fd < 0) || ((n != STDOUT_FILENO) && (n != STDERR_FILENO)))
+				{
+					::posix_spawn_file_actions_addclose(&file_actions, n);
+				}
+			}
+
+			pid_t pid = 0;
+			const int spawn_errno = ::posix_spawn(&pid, argv[0], &file_actions, nullptr, &argv[0], const_cast<char* const*>(&envp[0]));
+
+			::posix_spawn_file_actions_destroy(&file_actions);
+
+			if (spawn_errno != 0)
+			{
+				ec = boost::system::error_code(spawn_errno, boost::system::system_category());
 
 				return -1;
 			}
-		}
 
-		const pid_t pid = fork();
+			return pid;
+		}
 
-		switch (pid)
+		int execute_with_envp(const std::vector<std::string>& args, const std::vector<const char*>& envp, boost::system::error_code& ec, std::ostream* output)
 		{
-			case -1:
-				{
-					// fork() failed.
-					if (output)
-					{
-						::close(output_fd[0]);
-						::close(output_fd[1]);
-					}
-
-					::close(fd[0]);
-					::close(fd[1]);
+			int output_fd[2] = {0, 0};
 
+			if (output)
+			{
+				if (::pipe(output_fd) < 0)
+				{
 					ec = boost::system::error_code(errno, boost::system::system_category());
 
 					return -1;
 				}
-			case 0:
-				{
-					// Child process
-					const int fdlimit = ::sysconf(_SC_OPEN_MAX);
+			}
 
-					if (output)
-					{
-						::dup2(output_fd[1], STDOUT_FILENO);
-						::dup2(output_fd[1], STDERR_FILENO);
-						::close(output_fd[1]);
-					}
+			const pid_t pid = spawn_process(args, envp, output ? output_fd[1] : -1, ec);
 
-					for (int n = 0; n < fdlimit; ++n)
-					{
-						if ((n != fd[1]) && (!output || ((n != STDOUT_FILENO) && (n != STDERR_FILENO))))
-						{
-							::close(n);
-						}
-					}
+			if (output)
+			{
+				::close(output_fd[1]);
+			}
 
-					fcntl(fd[1], F_SETFD, FD_CLOEXEC);
+			if (pid < 0)
+			{
+				if (output)
+				{
+					::close(output_fd[0]);
+				}
 
-					// Estimate the required size for the argv buffer.
-					std::vector<char> argv_buffer;
-					std::vector<char*> argv(args.size() + 1, nullptr);
+				return -1;
+			}
 
-					{
-						// One null-terminated byte per arg.
-						size_t buffer_size = args.size();
+			if (output)
+			{
+				// This will take ownership of the file descriptor.
+				boost::iostreams::file_descriptor_source output_src(output_fd[0], boost::iostreams::close_handle);
+				boost::iostreams::stream<boost::iostreams::file_descriptor_source> output_is(output_src);
 
-						for (auto&& arg : args)
-						{
-							buffer_size += arg.size();
-						}
+				(*output) << output_is.rdbuf();
+			}
 
-						argv_buffer.resize(buffer_size, 0x00);
-						auto offset = argv_buffer.begin();
+			int status = 0;
 
-						for (size_t i = 0; i != args.size(); ++i)
-						{
-							const auto& arg = args[i];
+			if (::waitpid(pid, &status, 0) != pid)
+			{
+				ec = boost::system::error_code(errno, boost::system::system_category());
 
-							argv[i] = &*offset;
-							offset = std::copy(arg.begin(), arg.end(), offset);
-							*(offset++) = '\0';
-						}
-					}
+				return -1;
+			}
 
-					// Estimate the required size for the envp buffer.
-					std::vector<char> envp_buffer;
-					std::vector<char*> envp(env.size() + 1, nullptr);
+			if (WIFEXITED(status))
+			{
+				const int result = WEXITSTATUS(status);
 
-					{
-						// One null-terminated byte per arg.
-						size_t buffer_size = env.size();
+	#if FREELAN_DEBUG
+				std::cout << "Exit status: " << result << std::endl;
+	#endif
 
-						for (auto&& pair : env)
-						{
-							buffer_size += pair.first.size() + 1 + pair.second.size();
-						}
+				return result;
+			}
 
-						envp_buffer.resize(buffer_size, 0x00);
-						auto offset = envp_buffer.begin();
+			return EXIT_FAILURE;
+		}
+	}
 
-						for (size_t i = 0; i != env.size(); ++i)
-						{
-							auto it = env.begin();
-							std::advance(it, i);
-							const auto& pair = *it;
-
-							envp[i] = &*offset;
-							offset = std::copy(pair.first.begin(), pair.first.end(), offset);
-							*(offset++) = '=';
-							offset = std::copy(pair.second.begin(), pair.second.end(), offset);
-							*(offset++) = '\0';
-						}
-					}
+	std::map<std::string, std::string> get_current_environment()
+	{
+		std::map<std::string, std::string> result;
 
-					// Execute the file specified
-					::execve(argv[0], &argv[0], &envp[0]);
+		for (size_t count = 0; environ[count]; ++count)
+		{
+			const std::string line = std::string(environ[count]);
+			const auto pos = line.find('=');
 
-					// Something went wrong. Sending back errno to parent process then exiting.
-					if (::write(fd[1], &errno, sizeof(errno))) {}
+			if (pos == std::string::npos)
+			{
+				result[line] = std::string();
+			}
+			else
+			{
+				const std::string key = line.substr(0, pos);
+				const std::string value = line.substr(pos + 1);
+				result[key] = value;
+			}
+		}
 
-					_exit(127);
+		return result;
+	}
 
-					break;
-				}
-			default:
-				{
-					// Parent process
-					::close(fd[1]);
+	namespace
+	{
+		std::mutex environment_snapshot_mutex;
+		std::shared_ptr<const environment_snapshot> shared_environment_snapshot;
 
-					if (output)
-					{
-						::close(output_fd[1]);
-					}
+		std::shared_ptr<const environment_snapshot> make_environment_snapshot()
+		{
+			const auto snapshot = std::make_shared<environment_snapshot>();
 
-					int child_errno = 0;
+			snapshot->variables = get_current_environment();
 
-					if (output)
-					{
-						// This will take ownership of the file descriptor.
-						boost::iostreams::file_descriptor_source output_src(output_fd[0], boost::iostreams::close_handle);
-						boost::iostreams::stream<boost::iostreams::file_descriptor_source> output_is(output_src);
+			std::vector<const char*> pointers;
+			build_envp(snapshot->variables, snapshot->buffer, pointers);
 
-						(*output) << output_is.rdbuf();
-					}
+			// build_envp() terminates the list: the snapshot keeps one pointer per variable.
+			pointers.pop_back();
+			snapshot->pointers = pointers;
 
-					const ssize_t readcnt = ::read(fd[0], &child_errno, sizeof(child_errno));
+			return snapshot;
+		}
+	}
 
-					::close(fd[0]);
+	std::shared_ptr<const environment_snapshot> get_environment_snapshot()
+	{
+		std::lock_guard<std::mutex> lock(environment_snapshot_mutex);
 
-					if (readcnt < 0)
-					{
-						ec = boost::system::error_code(errno, boost::system::system_category());
+		if (!shared_environment_snapshot)
+		{
+			shared_environment_snapshot = make_environment_snapshot();
+		}
 
-						return -1;
-					}
-					else if (readcnt == sizeof(child_errno))
-					{
-						ec = boost::system::error_code(child_errno, boost::system::system_category());
+		return shared_environment_snapshot;
+	}
 
-						return -1;
-					}
+	void refresh_environment_snapshot()
+	{
+		const auto snapshot = make_environment_snapshot();
 
-					int status = 0;
+		std::lock_guard<std::mutex> lock(environment_snapshot_mutex);
+		shared_environment_snapshot = snapshot;
+	}
 
-					if (::waitpid(pid, &status, 0) != pid)
-					{
-						ec = boost::system::error_code(child_errno, boost::system::system_category());
+	int execute(const std::vector<std::string>& args, const std::map<std::string, std::string>& env, boost::system::error_code& ec, std::ostream* output)
+	{
+#if FREELAN_DEBUG
+		std::cout << "Executing:";
 
-						return -1;
-					}
-					else
-					{
-						if (WIFEXITED(status))
-						{
-							const int result = WEXITSTATUS(status);
+		for (auto&& arg : args)
+		{
+			std::cout << " " << arg;
+		}
 
-#if FREELAN_DEBUG
-							std::cout << "Exit status: " << result << std::endl;
-#endif
+		std::cout << std::endl;
 
-							return result;
-						}
-					}
+		std::cout << "Environment starts:" << std::endl;
 
-					break;
-				}
+		for (auto&& pair : env)
+		{
+			std::cout << pair.first << "=" << pair.second << std::endl;
 		}
 
-		return EXIT_FAILURE;
+		std::cout << "Environment ends." << std::endl;
+#endif
+
+		std::vector<char> envp_buffer;
+		std::vector<const char*> envp;
+		build_envp(env, envp_buffer, envp);
+
+		return execute_with_envp(args, envp, ec, output);
 	}
 
 	int execute(const std::vector<std::string>& args, const std::map<std::string, std::string>& env, std::ostream* output)
@@ -327,6 +385,138 @@ namespace executeplus
 			throw boost::system::system_error(make_error_code(executeplus_error::external_process_failed));
 		}
 	}
+
+	int execute(const std::vector<std::string>& args, const std::shared_ptr<const environment_snapshot>& env, const std::map<std::string, std::string>& extra_env, boost::system::error_code& ec, std::ostream* output)
+	{
+		bool overridden = false;
+
+		for (auto&& pair : extra_env)
+		{
+			if (env->variables.count(pair.first) > 0)
+			{
+				overridden = true;
+
+				break;
+			}
+		}
+
+		if (overridden)
+		{
+			// An extra variable overrides a snapshot variable: merge the maps, so the environment holds no duplicate keys.
+			auto merged = env->variables;
+
+			for (auto&& pair : extra_env)
+			{
+				merged[pair.first] = pair.second;
+			}
+
+			return execute(args, merged, ec, output);
+		}
+
+		// The usual case: the snapshot's flattened strings are referenced in place and only the per-execution variables are laid out.
+		std::vector<char> extra_buffer;
+		std::vector<const char*> envp;
+		build_envp(extra_env, extra_buffer, envp);
+		envp.insert(envp.begin(), env->pointers.begin(), env->pointers.end());
+
+		return execute_with_envp(args, envp, ec, output);
+	}
+
+	int execute(const std::vector<std::string>& args, const std::shared_ptr<const environment_snapshot>& env, const std::map<std::string, std::string>& extra_env, std::ostream* output)
+	{
+		boost::system::error_code ec;
+
+		const auto result = execute(args, env, extra_env, ec, output);
+
+		if (result < 0)
+		{
+			throw boost::system::system_error(ec);
+		}
+
+		return result;
+	}
+
+	namespace
+	{
+		void async_read_output(boost::shared_ptr<boost::asio::posix::stream_descriptor> descriptor, boost::shared_ptr<std::array<char, 4096>> buffer, std::ostream* output, pid_t pid, execute_handler_type handler)
+		{
+			descriptor->async_read_some(boost::asio::buffer(*buffer), [descriptor, buffer, output, pid, handler] (const boost::system::error_code& ec, size_t cnt) {
+				if (!ec)
+				{
+					if (output && (cnt > 0))
+					{
+						output->write(buffer->data(), cnt);
+					}
+
+					async_read_output(descriptor, buffer, output, pid, handler);
+
+					return;
+				}
+
+				// End-of-file: the child closed its output, which is our cue that it is done. Any other read error also ends the stream, so reap the child either way.
+				boost::system::error_code close_ec;
+				descriptor->close(close_ec);
+
+				int status = 0;
+
+				if (::waitpid(pid, &status, 0) != pid)
+				{
+					handler(boost::system::error_code(errno, boost::system::system_category()), -1);
+				}
+				else if (WIFEXITED(status))
+				{
+					handler(boost::system::error_code(), WEXITSTATUS(status));
+				}
+				else
+				{
+					handler(boost::system::error_code(), EXIT_FAILURE);
+				}
+			});
+		}
+	}
+
+	void async_execute(boost::asio::io_service& io_service, const std::vector<std::string>& args, const std::map<std::string, std::string>& env, execute_handler_type handler, std::ostream* output)
+	{
+		int output_fd[2] = {0, 0};
+
+		if (::pipe(output_fd) < 0)
+		{
+			const boost::system::error_code ec(errno, boost::system::system_category());
+
+			io_service.post([handler, ec] () {
+				handler(ec, -1);
+			});
+
+			return;
+		}
+
+		boost::system::error_code ec;
+
+		// The child always gets its output redirected to the pipe: its end-of-file doubles as the exit notification, so no thread has to sit in waitpid().
+		std::vector<char> envp_buffer;
+		std::vector<const char*> envp;
+		build_envp(env, envp_buffer, envp);
+
+		const pid_t pid = spawn_process(args, envp, output_fd[1], ec);
+
+		::close(output_fd[1]);
+
+		if (pid < 0)
+		{
+			::close(output_fd[0]);
+
+			io_service.post([handler, ec] () {
+				handler(ec, -1);
+			});
+
+			return;
+		}
+
+		const auto descriptor = boost::make_shared<boost::asio::posix::stream_descriptor>(io_service, output_fd[0]);
+		const auto buffer = boost::make_shared<std::array<char, 4096>>();
+
+		async_read_output(descriptor, buffer, output, pid, handler);
+	}
 }
 
 #endif
@@ -0,0 +1,206 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file capture_ring.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A lock-free ring buffer for datapath frame capture.
+ */
+
+#ifndef FREELAN_CAPTURE_RING_HPP
+#define FREELAN_CAPTURE_RING_HPP
+
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace freelan
+{
+	/**
+	 * \brief A lock-free ring buffer for datapath frame capture.
+	 *
+	 * A tcpdump on the tap device only shows the cleartext ends of the
+	 * pipeline: this ring lets the datapath snapshot frames at its internal
+	 * stages too, so the pre-encryption and post-decryption views can be
+	 * compared against the device views when an overlay misbehaves.
+	 *
+	 * The datapath pushes truncated frame copies from any thread without
+	 * taking a lock, exactly like log_ring_buffer pushes log records: a
+	 * producer owns the slot whose sequence number matches its claimed
+	 * position, and when the consumer lags the frame is dropped and counted
+	 * instead of blocking the caller. When the capture is disabled - the
+	 * default - capture() is a single relaxed load and a branch.
+	 *
+	 * Frames longer than SNAP_LENGTH are truncated; the original length is
+	 * kept so the truncation stays visible in the drained records.
+	 */
+	class capture_ring
+	{
+		public:
+
+			/**
+			 * \brief The pipeline stage a frame was captured at.
+			 */
+			enum stage_type
+			{
+				STAGE_TAP_IN = 0, /**< \brief Read from the tap device, before any processing. */
+				STAGE_PRE_ENCRYPT = 1, /**< \brief About to be handed to FSCP for encryption. */
+				STAGE_POST_DECRYPT = 2, /**< \brief Received from FSCP, after decryption. */
+				STAGE_TAP_OUT = 3 /**< \brief About to be written to the tap device. */
+			};
+
+			/**
+			 * \brief The count of pipeline stages.
+			 */
+			static const size_t STAGE_COUNT = 4;
+
+			/**
+			 * \brief The default capacity, in frames.
+			 */
+			static const size_t DEFAULT_CAPACITY = 1024;
+
+			/**
+			 * \brief The snapshot length: captured frames are truncated to this many bytes.
+			 */
+			static const size_t SNAP_LENGTH = 256;
+
+			/**
+			 * \brief A drained frame.
+			 */
+			struct frame_type
+			{
+				stage_type stage; /**< \brief The pipeline stage. */
+				uint64_t timestamp_us; /**< \brief The capture time, in microseconds since the Unix epoch. */
+				uint32_t original_length; /**< \brief The frame length on the wire, in bytes. */
+				std::vector<uint8_t> data; /**< \brief The captured bytes, at most SNAP_LENGTH of them. */
+			};
+
+			/**
+			 * \brief Get the name of a stage.
+			 * \param stage The stage.
+			 * \return A static name, like "tap-in".
+			 */
+			static const char* stage_name(stage_type stage);
+
+			/**
+			 * \brief Create a new capture ring.
+			 * \param capacity The capacity, in frames. It is rounded up to the next power of two.
+			 *
+			 * The ring starts disabled.
+			 */
+			explicit capture_ring(size_t capacity = DEFAULT_CAPACITY);
+
+			/**
+			 * \brief Enable or disable the capture.
+			 * \param enabled The new state.
+			 */
+			void set_enabled(bool enabled)
+			{
+				m_enabled.store(enabled, boost::memory_order_relaxed);
+			}
+
+			/**
+			 * \brief Check whether the capture is enabled.
+			 * \return The current state.
+			 */
+			bool enabled() const
+			{
+				return m_enabled.load(boost::memory_order_relaxed);
+			}
+
+			/**
+			 * \brief Capture a frame, if the capture is enabled.
+			 * \param stage The pipeline stage.
+			 * \param buf The frame bytes. At most SNAP_LENGTH of them are copied.
+			 * \param size The frame size, in bytes.
+			 *
+			 * This method is lock-free and can be called from any thread. If the buffer is full the frame is dropped.
+			 */
+			void capture(stage_type stage, const void* buf, size_t size)
+			{
+				if (enabled())
+				{
+					do_capture(stage, buf, size);
+				}
+			}
+
+			/**
+			 * \brief Drain the captured frames.
+			 * \param frames The container that receives the frames, in capture order.
+			 * \return The count of drained frames.
+			 * \warning Only one thread at a time may call drain().
+			 */
+			size_t drain(std::vector<frame_type>& frames);
+
+			/**
+			 * \brief Get the count of frames dropped because the buffer was full.
+			 * \return The count of dropped frames.
+			 */
+			size_t dropped() const
+			{
+				return m_dropped.load(boost::memory_order_relaxed);
+			}
+
+		private:
+
+			void do_capture(stage_type stage, const void* buf, size_t size);
+
+			struct record_type
+			{
+				boost::atomic<size_t> sequence;
+				uint8_t stage;
+				uint64_t timestamp_us;
+				uint32_t original_length;
+				uint16_t size;
+				uint8_t data[SNAP_LENGTH];
+			};
+
+			boost::scoped_array<record_type> m_records;
+			size_t m_mask;
+			boost::atomic<size_t> m_head;
+			size_t m_tail;
+			boost::atomic<bool> m_enabled;
+			boost::atomic<size_t> m_dropped;
+	};
+}
+
+#endif /* FREELAN_CAPTURE_RING_HPP */
@@ -314,6 +314,118 @@ namespace freelan
 		 * \brief The list of allowed elliptic curves.
 		 */
 		fscp::elliptic_curve_list_type elliptic_curve_capabilities;
+
+		/**
+		 * \brief Whether to trace the packet-path latencies.
+		 *
+		 * When enabled, a sampled subset of frames is timestamped at the pipeline stages and per-stage latency histograms show up in the metrics. Cheap enough to stay on in production.
+		 */
+		bool latency_tracing;
+
+		/**
+		 * \brief Whether to probe the path MTU of every peer.
+		 *
+		 * When enabled, each established session is probed to find the largest payload its path actually delivers; frames beyond the discovered limit are dropped at the source instead of being blackholed down the path, and the value shows per peer in the /stats/ output.
+		 */
+		bool path_mtu_discovery;
+
+		/**
+		 * \brief Whether to use every known path of a peer.
+		 *
+		 * A peer reachable over several endpoints (a dual-homed rack, a LAN and a WAN address) holds one session per endpoint. When enabled, the round-trip time and loss of every path are probed and data flows over the fastest healthy one, failing over without renegotiating session keys.
+		 */
+		bool multipath;
+
+		/**
+		 * \brief Whether to spray bulk sends across all the healthy paths of a peer.
+		 *
+		 * Only meaningful when multipath is enabled. Trades per-flow ordering stability for aggregate throughput.
+		 */
+		bool multipath_spray;
+
+		/**
+		 * \brief Whether to resume sessions across connectivity blips.
+		 *
+		 * When a session is established both hosts derive a shared resumption secret. On reconnect within the validity window, a single HMAC-authenticated round-trip re-keys from the cached secret, skipping the certificate exchange and verification entirely.
+		 */
+		bool session_resumption;
+
+		/**
+		 * \brief The peer state file.
+		 *
+		 * When set, the known peers (endpoint and presentation) are saved to this file on shutdown and contacted with direct session requests on the next start. An empty path disables the mechanism.
+		 */
+		boost::filesystem::path state_file;
+
+		/**
+		 * \brief The requested kernel receive buffer size of the FSCP sockets, in bytes.
+		 *
+		 * The kernel clamps the request to its configured maximum; the granted size shows in the /stats/ output. A value of 0 keeps the kernel default.
+		 */
+		size_t receive_buffer_size;
+
+		/**
+		 * \brief The requested kernel send buffer size of the FSCP sockets, in bytes.
+		 *
+		 * The kernel clamps the request to its configured maximum; the granted size shows in the /stats/ output. A value of 0 keeps the kernel default.
+		 */
+		size_t send_buffer_size;
+
+		/**
+		 * \brief The socket busy-poll budget, in microseconds.
+		 *
+		 * When set, the kernel spins on the device queue for up to the budget before sleeping, trading CPU for receive latency on fast links. A value of 0 disables busy polling. Has no effect on platforms without SO_BUSY_POLL support.
+		 */
+		unsigned int busy_poll;
+
+		/**
+		 * \brief The IP TOS byte of data traffic, or a negative value to keep the kernel default.
+		 *
+		 * The DSCP is the upper six bits of the TOS byte, so a DSCP value must be shifted left by two.
+		 */
+		int data_tos;
+
+		/**
+		 * \brief The IP TOS byte of control traffic, or a negative value to mark control traffic like data traffic.
+		 *
+		 * Handshake, keep-alive and contact datagrams are re-marked with this value so underlay QoS can prioritize tunnel control traffic over the bulk frames.
+		 */
+		int control_tos;
+
+		/**
+		 * \brief The outer TOS byte of encapsulated frames, keyed by the inner DSCP value.
+		 *
+		 * Frames whose inner IP header carries a listed DSCP leave through a dedicated egress class, scheduled ahead of the unmapped frames and marked with the mapped TOS byte, so the underlay QoS keeps distinguishing the flows the tunnel carries. Unlisted DSCP values keep the data marking. An empty mapping (the default) disables the classing.
+		 */
+		std::map<unsigned int, int> dscp_mapping;
+
+		/**
+		 * \brief The per-source handshake rate limit.
+		 *
+		 * The maximum count of handshake datagrams accepted per source address and per 10 seconds window. A value of 0 (the default) means no limit.
+		 */
+		size_t handshake_rate_limit;
+
+		/**
+		 * \brief Whether to probe idle sessions on a decaying schedule.
+		 *
+		 * In a large mesh most sessions are idle, yet each is probed at the full keep-alive rate, so the background load grows with the square of the node count. When enabled, sessions that carried real data recently keep the full rate while idle sessions are probed less and less often; the first data message restores the full rate. Disabled by default.
+		 */
+		bool lazy_keep_alive;
+
+		/**
+		 * \brief The OpenSSL engine to encrypt and decrypt data messages with.
+		 *
+		 * The engine identifier, as known to OpenSSL (for instance "afalg" for the Linux AF_ALG engine), to engage a hardware crypto accelerator on the data path. An empty value (the default) keeps the software implementation.
+		 */
+		std::string cipher_engine;
+
+		/**
+		 * \brief The payload size under which the cipher engine is not engaged.
+		 *
+		 * Hardware engines pay a per-request cost (a system call, for AF_ALG) that only amortizes on large payloads: smaller messages keep the software implementation. 0 engages the engine for every size.
+		 */
+		size_t cipher_engine_threshold;
 	};
 
 	/**
@@ -394,6 +506,20 @@ namespace freelan
 		 * \brief The certificate revocation lists.
 		 */
 		crl_list_type certificate_revocation_list_list;
+
+		/**
+		 * \brief The files the certificate revocation lists were loaded from.
+		 *
+		 * Kept so the lists can be re-read periodically at run time. Empty when the lists did not come from files.
+		 */
+		std::vector<boost::filesystem::path> certificate_revocation_list_files;
+
+		/**
+		 * \brief The file the certificate verification cache is persisted to.
+		 *
+		 * When set, cached verification verdicts survive a restart so a restarted node re-establishes its sessions without re-verifying unchanged peer certificates. Empty disables persistence.
+		 */
+		boost::filesystem::path certificate_verification_cache_file;
 	};
 
 	/**
@@ -445,6 +571,30 @@ namespace freelan
 		 */
 		metric_type metric;
 
+		/**
+		 * \brief The count of reads to keep pending on the tap adapter.
+		 */
+		unsigned int read_ring_size;
+
+		/**
+		 * \brief The count of device queues to open.
+		 *
+		 * Counts above one require Linux multi-queue tun/tap support: each queue gets its own file descriptor and read loop.
+		 */
+		unsigned int queue_count;
+
+		/**
+		 * \brief Whether to negotiate segmentation offload with the tap adapter.
+		 */
+		bool offload;
+
+		/**
+		 * \brief Whether to service the tap adapter from a dedicated I/O thread.
+		 *
+		 * When enabled, the device reads and writes run on their own thread and only the frame processing is handed to the worker pool, so a crypto-heavy burst can no longer delay the device and make its queue drop frames.
+		 */
+		bool dedicated_io_thread;
+
 		/**
 		 * \brief The IPv4 tap adapter address.
 		 */
@@ -524,6 +674,13 @@ namespace freelan
 		 * \brief Whether to enable the relay mode.
 		 */
 		bool relay_mode_enabled;
+
+		/**
+		 * \brief Whether to enable IGMP/MLD snooping.
+		 *
+		 * When enabled, multicast frames are only sent to the ports that subscribed to their group instead of being flooded to the whole network.
+		 */
+		bool multicast_snooping_enabled;
 	};
 
 	/**
@@ -593,6 +750,37 @@ namespace freelan
 		unsigned int maximum_routes_limit;
 	};
 
+	/**
+	 * \brief The traffic limits related options type.
+	 */
+	struct limits_configuration
+	{
+		/**
+		 * \brief Constructor.
+		 */
+		limits_configuration();
+
+		/**
+		 * \brief The per-peer rate, in bytes per second, applied to each direction of every overlay peer. 0 means unlimited.
+		 */
+		uint64_t peer_rate;
+
+		/**
+		 * \brief The per-peer burst, in bytes. 0 means one second worth of the rate.
+		 */
+		uint64_t peer_burst;
+
+		/**
+		 * \brief The aggregate rate of all the overlay peers together, in bytes per second, applied to each direction. 0 means unlimited.
+		 */
+		uint64_t endpoints_rate;
+
+		/**
+		 * \brief The aggregate burst, in bytes. 0 means one second worth of the rate.
+		 */
+		uint64_t endpoints_burst;
+	};
+
 	/**
 	 * \brief The configuration structure.
 	 */
@@ -633,6 +821,11 @@ namespace freelan
 		 */
 		freelan::router_configuration router;
 
+		/**
+		 * \brief The traffic limits related options.
+		 */
+		freelan::limits_configuration limits;
+
 		/**
 		 * \brief The constructor.
 		 */
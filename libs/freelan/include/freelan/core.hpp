@@ -51,6 +51,10 @@
 #include "router.hpp"
 #include "message.hpp"
 #include "routes_message.hpp"
+#include "capture_ring.hpp"
+#include "rate_limiter.hpp"
+#include "establishment_history.hpp"
+#include "maintenance_scheduler.hpp"
 
 #include <fscp/fscp.hpp>
 #include <fscp/logger.hpp>
@@ -60,15 +64,19 @@
 #include <asiotap/osi/arp_proxy.hpp>
 #include <asiotap/osi/dhcp_proxy.hpp>
 #include <asiotap/osi/complex_filter.hpp>
+#include <asiotap/types/cached_endpoint_resolver.hpp>
 #include <asiotap/route_manager.hpp>
 #include <asiotap/types/ip_route.hpp>
 
 #include <cryptoplus/x509/store.hpp>
+#include <cryptoplus/x509/verification_cache.hpp>
+#include <cryptoplus/x509/revocation_index.hpp>
 #include <cryptoplus/x509/store_context.hpp>
 
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/weak_ptr.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/thread.hpp>
@@ -79,6 +87,7 @@
 namespace freelan
 {
 	class routes_request_message;
+	class routes_caps_message;
 	class web_server;
 	class web_client;
 
@@ -297,6 +306,11 @@ namespace freelan
 			 */
 			static const std::string DEFAULT_SERVICE;
 
+			/**
+			 * \brief The maximum count of resolved endpoints raced in parallel when contacting a host.
+			 */
+			static const size_t CONTACT_BURST_SIZE;
+
 			// Public methods
 
 			/**
@@ -440,13 +454,37 @@ namespace freelan
 			 */
 			void close();
 
+			/**
+			 * \brief Update the locally advertised routes.
+			 * \param routes The new route set.
+			 *
+			 * The difference with the currently advertised routes is computed and sent to all the connected hosts as a delta, so a single route change does not re-announce the whole set.
+			 */
+			void async_update_local_routes(const asiotap::ip_route_set& routes);
+
+			/**
+			 * \brief Reload parts of the configuration without restarting.
+			 * \param new_configuration The new configuration.
+			 *
+			 * Only the settings that can change without a teardown are applied in place: the contact lists (static, dynamic and never-contact) and the contact acceptance flags. A contact round runs right after the reload so new contacts are tried immediately. Settings that would require reopening the FSCP server or the tap adapter are detected, logged and left untouched until the next restart.
+			 */
+			void async_reload_configuration(const configuration& new_configuration);
+
 		private:
 
+			void do_reload_configuration(configuration);
+
 			boost::asio::io_service& m_io_service;
 			freelan::configuration m_configuration;
 			boost::asio::strand m_logger_strand;
 			fscp::logger m_logger;
 
+			// Serializes the periodic contact handlers with the configuration reloads, so the contact lists can be swapped without racing their readers.
+			boost::asio::strand m_configuration_strand;
+
+			// The never-contact list snapshot, loaded atomically by is_banned() which runs on arbitrary io_service threads. Reloads publish a new snapshot instead of mutating the list in place.
+			boost::shared_ptr<const asiotap::ip_network_address_list> m_never_contact_list;
+
 		private: /* Callbacks */
 
 			void do_handle_log(fscp::log_level, const std::string&, const boost::posix_time::ptime&);
@@ -463,6 +501,53 @@ namespace freelan
 			tap_adapter_handler_type m_tap_adapter_up_callback;
 			tap_adapter_handler_type m_tap_adapter_down_callback;
 
+		public: /* Link measurement */
+
+			/**
+			 * \brief The result of an on-demand link measurement.
+			 */
+			struct link_measurement_result
+			{
+				link_measurement_result() :
+					completed(false),
+					sent(0),
+					received(0),
+					reordered(0),
+					duration_ms(0.0),
+					goodput_mbps(0.0),
+					rtt_min_ms(0.0),
+					rtt_median_ms(0.0),
+					rtt_p90_ms(0.0),
+					rtt_p99_ms(0.0),
+					rtt_max_ms(0.0)
+				{}
+
+				bool completed;
+				size_t sent;
+				size_t received;
+				size_t reordered;
+				double duration_ms;
+				double goodput_mbps;
+				double rtt_min_ms;
+				double rtt_median_ms;
+				double rtt_p90_ms;
+				double rtt_p99_ms;
+				double rtt_max_ms;
+			};
+
+			/**
+			 * \brief Measure the link to an established peer.
+			 * \param host The peer to measure the link to. A session must be established with it.
+			 * \param packet_count The count of probes to send. Clamped to [1, 10000].
+			 * \param packet_size The size of each probe, in bytes. Clamped to [32, 1400].
+			 * \return The measured goodput, loss, reordering and round-trip statistics.
+			 *
+			 * The probes travel on the measurement channel of the real encrypted path, so the figures include the crypto and queueing costs. The peer echoes every probe header; completed is true when all the echoes came back.
+			 *
+			 * This call blocks until the measurement settles, up to a few seconds: it must never be made from an io_service thread. Only one measurement can run at a time; a std::runtime_error is thrown if another one is in progress.
+			 */
+			link_measurement_result measure_link(const ep_type& host, size_t packet_count, size_t packet_size);
+
 		private: /* General purpose */
 
 			bool is_banned(const boost::asio::ip::address& address) const;
@@ -471,6 +556,8 @@ namespace freelan
 
 			void open_fscp_server();
 			void close_fscp_server();
+			void load_peer_state();
+			void save_peer_state();
 
 			void async_contact(const endpoint& target, duration_handler_type handler);
 			void async_contact(const endpoint& target);
@@ -483,25 +570,35 @@ namespace freelan
 			void async_request_session(const ep_type&, simple_handler_type);
 			void async_request_session(const ep_type&);
 			void async_handle_routes_request(const ep_type&, const routes_request_message&);
-			void async_handle_routes(const ep_type&, const routes_message&);
+			void async_handle_routes(const ep_type&, routes_message&);
+			void async_handle_routes_delta(const ep_type&, routes_message&);
+			void async_handle_routes_digest(const ep_type&, const routes_message&);
+			void async_handle_routes_caps(const ep_type&, const routes_caps_message&);
 			void async_send_routes_request(const ep_type&, simple_handler_type);
 			void async_send_routes_request(const ep_type&);
 			void async_send_routes_request_to_all(multiple_endpoints_handler_type);
 			void async_send_routes_request_to_all();
-			void async_send_routes(const ep_type&, routes_message::version_type, const asiotap::ip_route_set&, simple_handler_type);
+			void async_send_routes(const ep_type&, routes_message::version_type, const asiotap::ip_route_set&, bool compact, simple_handler_type);
+			void async_send_routes_caps(const ep_type&);
+			void async_send_routes_delta_to_all(routes_message::version_type, routes_message::checksum_type, const asiotap::ip_route_set&, const asiotap::ip_route_set&, multiple_endpoints_handler_type);
+			void async_send_routes_delta_to_all(routes_message::version_type, routes_message::checksum_type, const asiotap::ip_route_set&, const asiotap::ip_route_set&);
+			void async_send_routes_digest_to_all(routes_message::version_type, routes_message::checksum_type, multiple_endpoints_handler_type);
+			void async_send_routes_digest_to_all(routes_message::version_type, routes_message::checksum_type);
 
-			void do_contact(const ep_type&, duration_handler_type);
+			void do_contact(const ep_type&, duration_handler_type, uint64_t resolve_duration_us = 0);
 
 			void do_handle_contact(const endpoint&, const ep_type&, const boost::system::error_code&, const boost::posix_time::time_duration&);
-			void do_handle_periodic_contact(const boost::system::error_code&);
-			void do_handle_periodic_dynamic_contact(const boost::system::error_code&);
-			void do_handle_periodic_routes_request(const boost::system::error_code&);
 			void do_handle_send_contact_request(const ep_type&, const boost::system::error_code&);
 			void do_handle_send_contact_request_to_all(const std::map<ep_type, boost::system::error_code>&);
 			void do_handle_introduce_to(const ep_type&, const boost::system::error_code&);
 			void do_handle_request_session(const ep_type&, const boost::system::error_code&);
 			void do_handle_send_routes_request(const ep_type&, const boost::system::error_code&);
 			void do_handle_send_routes_request_to_all(const std::map<ep_type, boost::system::error_code>&);
+			void do_handle_send_routes_delta_to_all(const std::map<ep_type, boost::system::error_code>&);
+			void do_handle_send_routes_digest_to_all(const std::map<ep_type, boost::system::error_code>&);
+			void do_send_periodic_routes_digest();
+
+			bool is_busy() const;
 
 			bool do_handle_hello_received(const ep_type&, bool);
 			bool do_handle_contact_request_received(const ep_type&, cert_type, hash_type, const ep_type&);
@@ -513,15 +610,59 @@ namespace freelan
 			void do_handle_session_error(const ep_type&, bool, const std::exception&);
 			void do_handle_session_established(const ep_type&, bool, const fscp::cipher_suite_type&, const fscp::elliptic_curve_type&);
 			void do_handle_session_lost(const ep_type&, fscp::server::session_loss_reason);
+			void do_handle_path_mtu_changed(const ep_type&, size_t);
 			void do_handle_data_received(const ep_type&, fscp::channel_number_type, fscp::SharedBuffer, boost::asio::const_buffer);
+			void do_handle_probe_data(const ep_type&, fscp::SharedBuffer, boost::asio::const_buffer);
 			void do_handle_message(const ep_type&, fscp::SharedBuffer, const message&);
 			void do_handle_routes_request(const ep_type&);
 			void do_handle_routes(const asiotap::ip_network_address_list&, const ep_type&, routes_message::version_type, const asiotap::ip_route_set&);
+			void do_handle_routes_delta(const asiotap::ip_network_address_list&, const ep_type&, routes_message::version_type, routes_message::checksum_type, const asiotap::ip_route_set&, const asiotap::ip_route_set&);
+			void do_handle_routes_digest(const ep_type&, routes_message::version_type, routes_message::checksum_type);
+			void do_handle_routes_caps(const ep_type&, uint8_t);
+			void do_update_local_routes(const asiotap::ip_route_set&);
+
+			/**
+			 * \brief The state of the running link measurement, if any.
+			 *
+			 * Written by the io_service threads as the echoes arrive and waited upon by the measuring thread.
+			 */
+			struct link_measurement_context
+			{
+				link_measurement_context() :
+					active(false),
+					target(),
+					expected(0),
+					received(0),
+					reordered(0),
+					highest_sequence(0)
+				{}
+
+				bool active;
+				ep_type target;
+				size_t expected;
+				size_t received;
+				size_t reordered;
+				uint32_t highest_sequence;
+				std::vector<bool> received_flags;
+				std::vector<double> rtts_ms;
+				boost::posix_time::ptime last_reply_time;
+			};
 
 			boost::shared_ptr<fscp::server> m_fscp_server;
-			boost::asio::deadline_timer m_contact_timer;
-			boost::asio::deadline_timer m_dynamic_contact_timer;
-			boost::asio::deadline_timer m_routes_request_timer;
+			std::map<ep_type, cert_type> m_peer_state_map;
+			boost::mutex m_peer_state_mutex;
+			std::map<ep_type, size_t> m_path_mtu_map;
+			boost::mutex m_path_mtu_mutex;
+
+			/**
+			 * \brief The per-stage establishment timelines, kept so a slow tunnel-up can be attributed after the fact.
+			 */
+			establishment_history m_establishment_history;
+			link_measurement_context m_link_measurement;
+			boost::mutex m_link_measurement_mutex;
+			boost::condition_variable m_link_measurement_condition;
+			asiotap::cached_endpoint_resolver m_endpoint_resolver;
+			maintenance_scheduler m_maintenance_scheduler;
 
 		private: /* Certificate validation */
 
@@ -534,13 +675,20 @@ namespace freelan
 				always
 			};
 
+			static const boost::posix_time::time_duration CRL_REFRESH_PERIOD;
+
 			void build_ca_store(build_ca_store_when);
 			bool certificate_validation_method(bool, cryptoplus::x509::store_context);
 			bool certificate_is_valid(cert_type);
+			void refresh_certificate_revocation_lists();
 
 			cryptoplus::x509::store m_ca_store;
+			cryptoplus::x509::verification_cache m_certificate_verification_cache;
 			boost::mutex m_ca_store_mutex;
 
+			// Atomically loaded snapshot: the verification path reads it on any thread while a refresh publishes a new one.
+			boost::shared_ptr<const cryptoplus::x509::revocation_index> m_revocation_index;
+
 		private: /* TAP adapter */
 
 			typedef asiotap::osi::filter<asiotap::osi::ethernet_frame> ethernet_filter_type;
@@ -558,7 +706,7 @@ namespace freelan
 			void close_tap_adapter();
 
 			void async_get_tap_addresses(ip_network_address_list_handler_type);
-			void async_read_tap();
+			void async_read_tap(size_t queue = 0);
 
 			template <typename ConstBufferSequence, typename WriteHandler>
 			void async_write_tap(const ConstBufferSequence& data, WriteHandler handler)
@@ -569,21 +717,42 @@ namespace freelan
 			}
 
 			void push_tap_write(void_handler_type);
-			void pop_tap_write();
+			void flush_tap_writes();
 
-			void do_read_tap();
+			void do_read_tap(size_t queue);
 
-			void do_handle_tap_adapter_read(fscp::SharedBuffer, const boost::system::error_code&, size_t);
+			void do_handle_tap_adapter_read(size_t, fscp::SharedBuffer, const boost::system::error_code&, size_t);
+			void do_process_tap_frame(fscp::SharedBuffer, size_t);
+			void do_handle_peer_congestion(const ep_type&, bool);
 			void do_handle_tap_adapter_write(const boost::system::error_code&);
 			void do_handle_arp_frame(const arp_helper_type&);
 			void do_handle_dhcp_frame(const dhcp_helper_type&);
 			bool do_handle_arp_request(const boost::asio::ip::address_v4&, ethernet_address_type&);
 
 			boost::shared_ptr<asiotap::tap_adapter> m_tap_adapter;
+
+			// The optional dedicated device reactor: when tap_adapter.dedicated_io_thread is set, m_tap_adapter and m_tap_adapter_strand live on this io_service, serviced by m_tap_io_thread only.
+			boost::asio::io_service m_tap_io_service;
+			boost::scoped_ptr<boost::asio::io_service::work> m_tap_io_work;
+			boost::thread m_tap_io_thread;
+
 			boost::asio::strand m_tap_adapter_strand;
+			size_t m_congested_peer_count;
+			std::vector<size_t> m_deferred_tap_reads;
+			size_t m_tap_vnet_header_length;
 			boost::asio::strand m_proxies_strand;
 			std::queue<void_handler_type> m_tap_write_queue;
 			boost::asio::strand m_tap_write_queue_strand;
+			fscp::metrics_registry::counter& m_tap_frames_in_counter;
+			fscp::metrics_registry::counter& m_tap_frames_out_counter;
+			fscp::metrics_registry::histogram& m_tap_write_queue_depth_histogram;
+			fscp::metrics_registry::histogram& m_trace_send_tap_histogram;
+			fscp::metrics_registry::histogram& m_trace_send_fscp_histogram;
+			fscp::metrics_registry::histogram& m_trace_receive_histogram;
+			fscp::metrics_registry::counter& m_oversize_frames_dropped_counter;
+
+			// The diagnostic packet capture: disabled until a web server client starts it.
+			capture_ring m_capture_ring;
 
 			ethernet_filter_type m_ethernet_filter;
 			arp_filter_type m_arp_filter;
@@ -603,6 +772,8 @@ namespace freelan
 			{
 				client_router_info_type() :
 					version(),
+					supports_compact(false),
+					supports_qos_channels(false),
 					system_route_entries(),
 					saved_system_route()
 				{}
@@ -613,11 +784,203 @@ namespace freelan
 				}
 
 				boost::optional<routes_message::version_type> version;
+				bool supports_compact;
+				bool supports_qos_channels;
+				asiotap::ip_route_set advertised_routes;
+				boost::optional<routes_message::checksum_type> checksum;
+				boost::optional<routes_message::version_type> resync_requested_version;
 				std::vector<asiotap::route_manager::entry_type> system_route_entries;
 				asiotap::route_manager::entry_type saved_system_route;
 			};
 
-			typedef std::map<ep_type, client_router_info_type> client_router_info_map_type;
+			/**
+			 * \brief The per-client route state, sharded by endpoint hash with epoch-stamped entries and batched lazy cleanup.
+			 *
+			 * All access happens within m_router_strand: the sharding is not about locking but about keeping the per-shard tables small, so churn-time rehashes and sweeps touch a fraction of the peers. A cleared entry is tombstoned rather than erased and its shard is swept in one pass once enough tombstones accumulate, keeping route state maintenance proportional to the changed peers rather than to all of them.
+			 */
+			class client_router_info_map_type
+			{
+				public:
+
+					/**
+					 * \brief The count of shards.
+					 */
+					static const size_t SHARD_COUNT = 16;
+
+					/**
+					 * \brief The count of tombstones a shard accumulates before it is swept.
+					 */
+					static const size_t SWEEP_THRESHOLD = 64;
+
+					client_router_info_map_type() :
+						m_epoch(1)
+					{}
+
+					/**
+					 * \brief Get or create the entry of a host, reviving its tombstone if needed.
+					 * \param host The host.
+					 * \return The entry, stamped with the current epoch.
+					 */
+					client_router_info_type& operator[](const ep_type& host)
+					{
+						shard_type& shard = shard_for(host);
+						slot_type& slot = shard.entries[host];
+
+						if (slot.dead)
+						{
+							slot.dead = false;
+							slot.info = client_router_info_type();
+							shard.dead_count--;
+						}
+
+						slot.epoch = m_epoch;
+
+						return slot.info;
+					}
+
+					/**
+					 * \brief Find the entry of a host, without creating it.
+					 * \param host The host.
+					 * \return The entry, or a null pointer if the host has no live entry.
+					 */
+					const client_router_info_type* find(const ep_type& host) const
+					{
+						const shard_type& shard = shard_for(host);
+						const shard_map_type::const_iterator entry = shard.entries.find(host);
+
+						if ((entry == shard.entries.end()) || entry->second.dead)
+						{
+							return nullptr;
+						}
+
+						return &entry->second.info;
+					}
+
+					/**
+					 * \brief Remove the entry of a host.
+					 * \param host The host.
+					 * \param info A variable whose value after the call is the removed entry, so the caller can release its route entries.
+					 * \return true if an entry existed.
+					 *
+					 * The node itself is only tombstoned: it is reclaimed by the next batched sweep of its shard.
+					 */
+					bool take(const ep_type& host, client_router_info_type& info)
+					{
+						shard_type& shard = shard_for(host);
+						const shard_map_type::iterator entry = shard.entries.find(host);
+
+						if ((entry == shard.entries.end()) || entry->second.dead)
+						{
+							return false;
+						}
+
+						info = entry->second.info;
+
+						entry->second.info = client_router_info_type();
+						entry->second.dead = true;
+						entry->second.epoch = m_epoch++;
+						shard.dead_count++;
+
+						if (shard.dead_count >= SWEEP_THRESHOLD)
+						{
+							sweep(shard);
+						}
+
+						return true;
+					}
+
+					/**
+					 * \brief Call a function on every live entry.
+					 * \param function The function.
+					 */
+					template <typename Function>
+					void for_each(Function function)
+					{
+						for (size_t i = 0; i < SHARD_COUNT; ++i)
+						{
+							for (shard_map_type::iterator entry = m_shards[i].entries.begin(); entry != m_shards[i].entries.end(); ++entry)
+							{
+								if (!entry->second.dead)
+								{
+									function(entry->first, entry->second.info);
+								}
+							}
+						}
+					}
+
+					/**
+					 * \brief Remove every entry, tombstoned or not.
+					 */
+					void clear()
+					{
+						for (size_t i = 0; i < SHARD_COUNT; ++i)
+						{
+							m_shards[i].entries.clear();
+							m_shards[i].dead_count = 0;
+						}
+
+						m_epoch++;
+					}
+
+				private:
+
+					struct slot_type
+					{
+						slot_type() :
+							info(),
+							epoch(0),
+							dead(false)
+						{}
+
+						client_router_info_type info;
+						uint64_t epoch;
+						bool dead;
+					};
+
+					typedef boost::unordered_map<ep_type, slot_type, fscp::endpoint_hash> shard_map_type;
+
+					struct shard_type
+					{
+						shard_type() :
+							entries(),
+							dead_count(0)
+						{}
+
+						shard_map_type entries;
+						size_t dead_count;
+					};
+
+					shard_type& shard_for(const ep_type& host)
+					{
+						return m_shards[fscp::endpoint_hash()(host) % SHARD_COUNT];
+					}
+
+					const shard_type& shard_for(const ep_type& host) const
+					{
+						return m_shards[fscp::endpoint_hash()(host) % SHARD_COUNT];
+					}
+
+					void sweep(shard_type& shard)
+					{
+						// One pass over a single shard, amortized over the SWEEP_THRESHOLD removals that triggered it. Only tombstones from a past epoch are dropped: an entry revived since then carries the current epoch and is live again.
+						for (shard_map_type::iterator entry = shard.entries.begin(); entry != shard.entries.end();)
+						{
+							if (entry->second.dead && (entry->second.epoch < m_epoch))
+							{
+								entry = shard.entries.erase(entry);
+							}
+							else
+							{
+								++entry;
+							}
+						}
+
+						shard.dead_count = 0;
+					}
+
+					shard_type m_shards[SHARD_COUNT];
+					uint64_t m_epoch;
+			};
 
 			void async_register_switch_port(const ep_type& host, void_handler_type handler)
 			{
@@ -650,34 +1013,51 @@ namespace freelan
 			}
 
 			template <typename WriteHandler>
-			void async_write_switch(const port_index_type& index, boost::asio::const_buffer data, WriteHandler handler)
+			void async_write_switch(const port_index_type& index, fscp::SharedBuffer frame, boost::asio::const_buffer data, WriteHandler handler)
 			{
-				m_router_strand.post(boost::bind(&core::do_write_switch, this, index, data, handler));
+				m_router_strand.post(boost::bind(&core::do_write_switch, this, index, frame, data, handler));
 			}
 
 			template <typename WriteHandler>
-			void async_write_router(const port_index_type& index, boost::asio::const_buffer data, WriteHandler handler)
+			void async_write_router(const port_index_type& index, fscp::SharedBuffer frame, boost::asio::const_buffer data, WriteHandler handler)
 			{
-				m_router_strand.post(boost::bind(&core::do_write_router, this, index, data, handler));
+				// The forwarding snapshot is immutable and loaded atomically, so the data path does not go through m_router_strand. The strand only serializes the calls that publish new snapshots.
+				m_router.get_forwarding_snapshot()->async_write(index, frame, data, handler);
 			}
 
 			void do_register_switch_port(const ep_type&, void_handler_type);
 			void do_register_router_port(const ep_type&, void_handler_type);
+			void do_write_port_data(fscp::metrics_registry::counter&, const ep_type&, fscp::SharedBuffer, boost::asio::const_buffer, fscp::server::simple_handler_type);
 			void do_unregister_switch_port(const ep_type&, void_handler_type);
 			void do_unregister_router_port(const ep_type&, void_handler_type);
 			void do_save_system_route(const ep_type&, const route_type&, void_handler_type);
 			void do_clear_client_router_info(const ep_type&, void_handler_type);
-			void do_write_switch(const port_index_type&, boost::asio::const_buffer, switch_::multi_write_handler_type);
-			void do_write_router(const port_index_type&, boost::asio::const_buffer, router::port_type::write_handler_type);
+			void do_write_switch(const port_index_type&, fscp::SharedBuffer, boost::asio::const_buffer, switch_::multi_write_handler_type);
 
 			boost::asio::strand m_router_strand;
 
 			switch_ m_switch;
 			router m_router;
+
+			/**
+			 * \brief The traffic limiter: frames are accounted around the switch and router writes, in both directions.
+			 */
+			rate_limiter m_rate_limiter;
 			asiotap::route_manager m_route_manager;
 			boost::optional<routes_message::version_type> m_local_routes_version;
+			asiotap::ip_route_set m_local_routes;
 			client_router_info_map_type m_client_router_info_map;
 
+			/**
+			 * \brief Whether a DSCP mapping is configured: frames leave through per-class channels towards the peers that support them.
+			 */
+			bool m_dscp_qos_enabled;
+
+			/**
+			 * \brief The egress channel of every inner DSCP value. Unmapped values point at the default data channel.
+			 */
+			fscp::channel_number_type m_dscp_channel_table[64];
+
 		private:
 
 			void open_web_server();
@@ -0,0 +1,194 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file establishment_history.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A bounded history of per-stage session establishment timings.
+ */
+
+#ifndef FREELAN_ESTABLISHMENT_HISTORY_HPP
+#define FREELAN_ESTABLISHMENT_HISTORY_HPP
+
+#include <boost/asio.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace freelan
+{
+	/**
+	 * \brief A bounded history of per-stage session establishment timings.
+	 *
+	 * A tunnel that takes long to come up blurs very different causes
+	 * together: slow DNS, a lossy path eating the HELLO exchange, an
+	 * expensive certificate verification, a slow ECDHE on the remote, or
+	 * a dragging route exchange. This history splits the timeline of
+	 * every establishment into those stages, so a slow connect can be
+	 * attributed after the fact.
+	 *
+	 * The stage events arrive from different strands: a mutex guards the
+	 * state, which is acceptable as establishments are rare compared to
+	 * the data path. Completed timelines are kept in a bounded queue,
+	 * oldest evicted first.
+	 */
+	class establishment_history
+	{
+		public:
+
+			/**
+			 * \brief The endpoint type.
+			 */
+			typedef boost::asio::ip::udp::endpoint endpoint_type;
+
+			/**
+			 * \brief The count of completed timelines kept.
+			 */
+			static const size_t HISTORY_SIZE = 64;
+
+			/**
+			 * \brief The timeline of one establishment. Durations are 0 when the stage did not occur (yet).
+			 */
+			struct record_type
+			{
+				record_type() :
+					started_at_us(0),
+					resolve_us(0),
+					hello_us(0),
+					presentation_us(0),
+					handshake_us(0),
+					routes_us(0),
+					total_us(0),
+					state("pending")
+				{}
+
+				std::string endpoint;
+				uint64_t started_at_us; /**< \brief The start of the timeline, in microseconds since the Unix epoch. */
+				uint64_t resolve_us; /**< \brief The DNS resolution of the contact's hostname. */
+				uint64_t hello_us; /**< \brief The HELLO round-trip. 0 on the responding side. */
+				uint64_t presentation_us; /**< \brief Presentation sent until the peer's SESSION message arrived: covers the certificate exchange and its verification on both ends. */
+				uint64_t handshake_us; /**< \brief SESSION message until the session was established: the key exchange. */
+				uint64_t routes_us; /**< \brief Establishment until the first routes message was processed. */
+				uint64_t total_us; /**< \brief The whole timeline, up to its last recorded stage. */
+				std::string state; /**< \brief "pending", "completed" or "failed". */
+			};
+
+			/**
+			 * \brief Record that a HELLO was sent, starting a timeline.
+			 * \param host The contacted host.
+			 * \param resolve_us The preceding DNS resolution duration, in microseconds, or 0.
+			 *
+			 * A still-pending timeline for the same host is replaced.
+			 */
+			void hello_sent(const endpoint_type& host, uint64_t resolve_us);
+
+			/**
+			 * \brief Record that the HELLO was answered.
+			 * \param host The host.
+			 * \param rtt_us The round-trip, in microseconds, as measured by the greet machinery.
+			 */
+			void hello_answered(const endpoint_type& host, uint64_t rtt_us);
+
+			/**
+			 * \brief Record that the presentation was sent. Starts a timeline on the responding side, where no HELLO was sent.
+			 * \param host The host.
+			 */
+			void presentation_sent(const endpoint_type& host);
+
+			/**
+			 * \brief Record that the peer's SESSION message arrived.
+			 * \param host The host.
+			 */
+			void session_received(const endpoint_type& host);
+
+			/**
+			 * \brief Record that the session was established.
+			 * \param host The host.
+			 */
+			void session_established(const endpoint_type& host);
+
+			/**
+			 * \brief Record that a routes message was processed, completing a pending timeline.
+			 * \param host The host.
+			 *
+			 * Routes messages from long-established peers find no pending timeline and are ignored.
+			 */
+			void routes_received(const endpoint_type& host);
+
+			/**
+			 * \brief Record that the establishment failed, completing a pending timeline.
+			 * \param host The host.
+			 */
+			void session_failed(const endpoint_type& host);
+
+			/**
+			 * \brief Get the recorded timelines.
+			 * \return The completed timelines, oldest first, followed by the still-pending ones.
+			 */
+			std::vector<record_type> history() const;
+
+		private:
+
+			struct pending_type
+			{
+				pending_type() :
+					last_stage_at_us(0)
+				{}
+
+				record_type record;
+				uint64_t last_stage_at_us;
+			};
+
+			typedef std::map<endpoint_type, pending_type> pending_map_type;
+
+			uint64_t advance(pending_type& pending);
+			void complete(pending_map_type::iterator pending, const char* state);
+
+			mutable boost::mutex m_mutex;
+			pending_map_type m_pending;
+			std::deque<record_type> m_completed;
+	};
+}
+
+#endif /* FREELAN_ESTABLISHMENT_HISTORY_HPP */
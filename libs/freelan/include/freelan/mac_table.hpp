@@ -0,0 +1,225 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file mac_table.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A MAC learning table class.
+ */
+
+#ifndef MAC_TABLE_HPP
+#define MAC_TABLE_HPP
+
+#include <vector>
+
+#include <ctime>
+#include <stdint.h>
+
+#include <asiotap/osi/ethernet_address.hpp>
+
+#include "port_index.hpp"
+
+namespace freelan
+{
+	/**
+	 * \brief A MAC learning table.
+	 *
+	 * An open-addressing hash table keyed on the 6-byte ethernet address, with
+	 * linear probing: a lookup reads one or two consecutive cache lines instead
+	 * of chasing a tree node per level. Entries age out after a configurable
+	 * delay and the least recently used entry is evicted in O(1) when the table
+	 * is full.
+	 *
+	 * This class is not thread-safe: the caller must serialize accesses, as it
+	 * did with the std::map this class replaces.
+	 */
+	class mac_table
+	{
+		public:
+
+			/**
+			 * \brief The ethernet address type.
+			 */
+			typedef asiotap::osi::ethernet_address ethernet_address_type;
+
+			/**
+			 * \brief The default entry aging delay, in seconds.
+			 */
+			static const unsigned int DEFAULT_MAX_AGE_SECONDS = 300;
+
+			/**
+			 * \brief The table statistics.
+			 */
+			struct statistics_type
+			{
+				statistics_type() :
+					hits(0),
+					misses(0),
+					evictions(0)
+				{}
+
+				uint64_t hits; /**< \brief The count of lookups that resolved an entry. */
+				uint64_t misses; /**< \brief The count of lookups that found no entry, including expired ones. */
+				uint64_t evictions; /**< \brief The count of entries evicted to make room. */
+			};
+
+			/**
+			 * \brief The observable state of one learned entry.
+			 */
+			struct entry_info_type
+			{
+				ethernet_address_type address; /**< \brief The learned ethernet address. */
+				port_index_type port; /**< \brief The port the address was last seen on. */
+				uint64_t hits; /**< \brief The count of lookups this entry resolved. */
+				std::time_t last_seen; /**< \brief When the entry was last learned or refreshed. */
+			};
+
+			/**
+			 * \brief Create a new MAC table.
+			 * \param max_entries The maximum count of entries.
+			 * \param max_age_seconds The delay after which an entry that was not relearned is considered stale.
+			 */
+			explicit mac_table(size_t max_entries, unsigned int max_age_seconds = DEFAULT_MAX_AGE_SECONDS);
+
+			/**
+			 * \brief Learn or refresh an address.
+			 * \param address The ethernet address.
+			 * \param port The port the address was seen on.
+			 *
+			 * If the table is full, the least recently used entry is evicted.
+			 */
+			void learn(const ethernet_address_type& address, const port_index_type& port);
+
+			/**
+			 * \brief Look up an address.
+			 * \param address The ethernet address.
+			 * \param port Receives the port the address was learned on, on success.
+			 * \return true if a fresh entry exists. Stale entries are removed and count as misses.
+			 */
+			bool lookup(const ethernet_address_type& address, port_index_type& port);
+
+			/**
+			 * \brief Remove an address.
+			 * \param address The ethernet address.
+			 *
+			 * If no such entry exists, nothing is done.
+			 */
+			void erase(const ethernet_address_type& address);
+
+			/**
+			 * \brief Get the count of entries.
+			 * \return The count of entries.
+			 */
+			size_t size() const
+			{
+				return m_size;
+			}
+
+			/**
+			 * \brief Get the table statistics.
+			 * \return The statistics.
+			 */
+			const statistics_type& statistics() const
+			{
+				return m_statistics;
+			}
+
+			/**
+			 * \brief Get a snapshot of the learned entries, most recently used first.
+			 * \return The entries.
+			 *
+			 * The order combined with the hit counters and last-seen timestamps shows which addresses churn through the table: the entries near the tail with few hits are the ones eviction keeps recycling.
+			 */
+			std::vector<entry_info_type> entries() const;
+
+			/**
+			 * \brief Get the table generation.
+			 * \return A counter incremented whenever an entry is added, removed or remapped to another port.
+			 *
+			 * Refreshing an existing entry does not change the generation, so cached forwarding decisions stay valid across refreshes.
+			 */
+			uint64_t generation() const
+			{
+				return m_generation;
+			}
+
+		private:
+
+			static const uint32_t NO_ENTRY = 0xffffffff;
+
+			struct entry_type
+			{
+				entry_type() :
+					used(false),
+					hits(0),
+					last_seen(0),
+					lru_prev(NO_ENTRY),
+					lru_next(NO_ENTRY)
+				{}
+
+				ethernet_address_type address;
+				port_index_type port;
+				bool used;
+				uint64_t hits;
+				std::time_t last_seen;
+				uint32_t lru_prev;
+				uint32_t lru_next;
+			};
+
+			static size_t hash(const ethernet_address_type&);
+
+			uint32_t find_slot(const ethernet_address_type&) const;
+			void lru_unlink(uint32_t index);
+			void lru_push_front(uint32_t index);
+			void lru_replace(uint32_t old_index, uint32_t new_index);
+			void remove_slot(uint32_t index);
+
+			size_t m_max_entries;
+			std::time_t m_max_age;
+			size_t m_mask;
+			size_t m_size;
+			uint32_t m_lru_head;
+			uint32_t m_lru_tail;
+			std::vector<entry_type> m_slots;
+			statistics_type m_statistics;
+			uint64_t m_generation;
+	};
+}
+
+#endif /* MAC_TABLE_HPP */
@@ -0,0 +1,167 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file maintenance_scheduler.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A budget-aware scheduler for the periodic maintenance tasks.
+ */
+
+#ifndef MAINTENANCE_SCHEDULER_HPP
+#define MAINTENANCE_SCHEDULER_HPP
+
+#include <fscp/logger.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <string>
+#include <vector>
+
+namespace freelan
+{
+	/**
+	 * \brief A budget-aware scheduler for the periodic maintenance tasks.
+	 *
+	 * With one independent timer per maintenance task, the timers
+	 * occasionally fire together and stack their work on the io_service
+	 * threads, which shows up as a forwarding latency spike. The
+	 * scheduler runs all the tasks from a single one-second tick
+	 * instead: due tasks run one after another under a per-tick time
+	 * budget, at most one expensive task per tick, and while the
+	 * datapath is busy every task is deferred to the next lull - up to
+	 * a bounded factor of its period, so maintenance still happens
+	 * under sustained load.
+	 */
+	class maintenance_scheduler : public boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief The cost class of a task.
+			 */
+			enum task_cost_type
+			{
+				TASK_COST_LIGHT, /**< A few sends or a small computation: several may run in one tick. */
+				TASK_COST_HEAVY /**< File reads, parsing or store rebuilds: at most one runs per tick. */
+			};
+
+			/**
+			 * \brief A task callback.
+			 */
+			typedef boost::function<void ()> task_type;
+
+			/**
+			 * \brief A load probe callback. Must be cheap: it is called on every tick.
+			 */
+			typedef boost::function<bool ()> load_probe_type;
+
+			/**
+			 * \brief Create a maintenance scheduler.
+			 * \param io_service The io_service to run the ticks on.
+			 * \param _logger The logger to use.
+			 */
+			maintenance_scheduler(boost::asio::io_service& io_service, fscp::logger& _logger);
+
+			/**
+			 * \brief Set the load probe.
+			 * \param probe The probe. Called on every tick; when it returns true, due tasks are deferred.
+			 */
+			void set_load_probe(load_probe_type probe);
+
+			/**
+			 * \brief Register a task.
+			 * \param name The task name, used in the logs. Registering a name again replaces the previous task.
+			 * \param cost The cost class.
+			 * \param period The period. The first run happens one period after registration (or after start(), whichever is later).
+			 * \param task The task. Must not call back into the scheduler.
+			 */
+			void register_task(const std::string& name, task_cost_type cost, const boost::posix_time::time_duration& period, task_type task);
+
+			/**
+			 * \brief Unregister a task.
+			 * \param name The task name. Unknown names are ignored.
+			 */
+			void unregister_task(const std::string& name);
+
+			/**
+			 * \brief Start the ticks. Does nothing when already started.
+			 */
+			void start();
+
+			/**
+			 * \brief Stop the ticks. Registered tasks are kept.
+			 */
+			void stop();
+
+		private:
+
+			// A tick either runs due tasks or costs a single timer wake-up: one second keeps the idle overhead negligible while staying well under every task period.
+			static const boost::posix_time::time_duration TICK_PERIOD;
+
+			// Once this much time was spent in one tick, the remaining due tasks wait for the next tick.
+			static const boost::posix_time::time_duration TICK_BUDGET;
+
+			// A busy datapath defers a task by at most this many of its own periods before it runs anyway.
+			static const unsigned int MAX_DEFERRAL_FACTOR = 4;
+
+			struct task_context_type
+			{
+				std::string name;
+				task_cost_type cost;
+				boost::posix_time::time_duration period;
+				task_type task;
+				boost::posix_time::ptime next_run;
+			};
+
+			void do_tick(const boost::system::error_code&);
+
+			boost::asio::deadline_timer m_timer;
+			fscp::logger& m_logger;
+			load_probe_type m_load_probe;
+			std::vector<task_context_type> m_tasks;
+			bool m_running;
+			boost::mutex m_mutex;
+	};
+}
+
+#endif /* MAINTENANCE_SCHEDULER_HPP */
@@ -68,7 +68,11 @@ namespace freelan
 			enum message_type
 			{
 				MT_ROUTES_REQUEST = 0x01,
-				MT_ROUTES = 0x02
+				MT_ROUTES = 0x02,
+				MT_ROUTES_DELTA = 0x03,
+				MT_ROUTES_DIGEST = 0x04,
+				MT_ROUTES_COMPACT = 0x05,
+				MT_ROUTES_CAPS = 0x06
 			};
 
 			/**
@@ -0,0 +1,291 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file rate_limiter.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A hierarchical token-bucket rate limiter for the datapath.
+ */
+
+#ifndef FREELAN_RATE_LIMITER_HPP
+#define FREELAN_RATE_LIMITER_HPP
+
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace freelan
+{
+	/**
+	 * \brief A lock-free token bucket.
+	 *
+	 * Tokens are bytes: the bucket refills at the configured rate up to
+	 * the configured burst, and a frame passes when it can take its size
+	 * out of the bucket. The accounting is done with atomics so the
+	 * datapath threads never serialize on a lock to account a frame; at
+	 * most one thread at a time credits the elapsed refill.
+	 *
+	 * A zero rate means unlimited: consume() then always passes without
+	 * touching the atomics.
+	 */
+	class token_bucket
+	{
+		public:
+
+			/**
+			 * \brief The observed counters of a bucket.
+			 */
+			struct statistics_type
+			{
+				statistics_type() :
+					passed_packets(0),
+					passed_bytes(0),
+					dropped_packets(0),
+					dropped_bytes(0)
+				{}
+
+				uint64_t passed_packets;
+				uint64_t passed_bytes;
+				uint64_t dropped_packets;
+				uint64_t dropped_bytes;
+			};
+
+			/**
+			 * \brief Create a new token bucket.
+			 * \param rate The refill rate, in bytes per second. 0 means unlimited.
+			 * \param burst The bucket capacity, in bytes. 0 means one second worth of the rate.
+			 *
+			 * The bucket starts full.
+			 */
+			explicit token_bucket(uint64_t rate = 0, uint64_t burst = 0);
+
+			/**
+			 * \brief Check whether the bucket limits anything.
+			 * \return true when a rate is configured.
+			 */
+			bool limited() const
+			{
+				return (m_rate != 0);
+			}
+
+			/**
+			 * \brief Try to take a frame's worth of tokens out of the bucket.
+			 * \param size The frame size, in bytes.
+			 * \return true if the frame passes, false if it must be dropped.
+			 *
+			 * This method is lock-free and can be called from any thread.
+			 */
+			bool consume(size_t size);
+
+			/**
+			 * \brief Get the observed counters.
+			 * \return The counters. The reads are relaxed: a concurrent snapshot may be slightly stale.
+			 */
+			statistics_type statistics() const;
+
+		private:
+
+			void refill();
+
+			uint64_t m_rate;
+			int64_t m_burst;
+			boost::atomic<int64_t> m_tokens;
+			boost::atomic<uint64_t> m_last_refill_us;
+			boost::atomic<uint64_t> m_passed_packets;
+			boost::atomic<uint64_t> m_passed_bytes;
+			boost::atomic<uint64_t> m_dropped_packets;
+			boost::atomic<uint64_t> m_dropped_bytes;
+	};
+
+	/**
+	 * \brief A hierarchical rate limiter for the switch and router ports.
+	 *
+	 * Two levels of token buckets are enforced: a bucket per port group,
+	 * shared by every port of the group, and a bucket pair per overlay
+	 * peer. A frame passes only when both its group bucket and its peer
+	 * bucket have room; each direction of a peer is accounted separately,
+	 * so what a peer pushes into the gateway and what it pulls out of it
+	 * are capped independently.
+	 *
+	 * The per-frame accounting is lock-free. A mutex only guards the peer
+	 * bucket map, which changes at port registration time, and is held
+	 * just long enough to grab a shared pointer to the buckets.
+	 */
+	class rate_limiter
+	{
+		public:
+
+			/**
+			 * \brief The endpoint type.
+			 */
+			typedef boost::asio::ip::udp::endpoint endpoint_type;
+
+			/**
+			 * \brief The accounted direction, seen from the local host.
+			 */
+			enum direction_type
+			{
+				DIRECTION_IN = 0, /**< \brief The frame was received from the peer. */
+				DIRECTION_OUT = 1 /**< \brief The frame is about to be sent to the peer. */
+			};
+
+			/**
+			 * \brief A rate and burst pair.
+			 */
+			struct limit_type
+			{
+				limit_type() :
+					rate(0),
+					burst(0)
+				{}
+
+				limit_type(uint64_t _rate, uint64_t _burst) :
+					rate(_rate),
+					burst(_burst)
+				{}
+
+				uint64_t rate; /**< \brief The rate, in bytes per second. 0 means unlimited. */
+				uint64_t burst; /**< \brief The burst, in bytes. 0 means one second worth of the rate. */
+			};
+
+			/**
+			 * \brief The observed counters of a named bucket pair.
+			 */
+			struct entry_statistics_type
+			{
+				std::string name; /**< \brief The bucket name: "group:<n>" or the peer endpoint. */
+				token_bucket::statistics_type in; /**< \brief The inbound counters. */
+				token_bucket::statistics_type out; /**< \brief The outbound counters. */
+			};
+
+			rate_limiter() :
+				m_enabled(false)
+			{}
+
+			/**
+			 * \brief Set the per-peer limit, applied to each direction of every registered peer.
+			 * \param limit The limit.
+			 * \warning This method must be called before any peer is registered.
+			 */
+			void set_peer_limit(const limit_type& limit);
+
+			/**
+			 * \brief Set the limit of a port group, applied to each direction of the group as a whole.
+			 * \param group The port group.
+			 * \param limit The limit.
+			 * \warning This method must be called before any frame is accounted.
+			 */
+			void set_group_limit(unsigned int group, const limit_type& limit);
+
+			/**
+			 * \brief Check whether any limit is configured.
+			 * \return true when at least one limit is set.
+			 */
+			bool enabled() const
+			{
+				return m_enabled;
+			}
+
+			/**
+			 * \brief Create the buckets of a peer.
+			 * \param peer The peer.
+			 */
+			void register_peer(const endpoint_type& peer);
+
+			/**
+			 * \brief Discard the buckets of a peer.
+			 * \param peer The peer.
+			 */
+			void unregister_peer(const endpoint_type& peer);
+
+			/**
+			 * \brief Account a frame against the group and peer buckets.
+			 * \param direction The direction.
+			 * \param group The port group the peer belongs to.
+			 * \param peer The peer.
+			 * \param size The frame size, in bytes.
+			 * \return true if the frame passes, false if it must be dropped.
+			 *
+			 * When no limit is configured this is a single branch.
+			 */
+			bool account(direction_type direction, unsigned int group, const endpoint_type& peer, size_t size);
+
+			/**
+			 * \brief Get the observed counters of every limited bucket.
+			 * \return The counters, groups first.
+			 */
+			std::vector<entry_statistics_type> statistics() const;
+
+		private:
+
+			struct bucket_pair_type
+			{
+				bucket_pair_type(const limit_type& limit) :
+					in(limit.rate, limit.burst),
+					out(limit.rate, limit.burst)
+				{}
+
+				token_bucket in;
+				token_bucket out;
+
+				token_bucket& direction(direction_type _direction)
+				{
+					return (_direction == DIRECTION_IN) ? in : out;
+				}
+			};
+
+			typedef std::map<unsigned int, boost::shared_ptr<bucket_pair_type> > group_map_type;
+			typedef std::map<endpoint_type, boost::shared_ptr<bucket_pair_type> > peer_map_type;
+
+			bool m_enabled;
+			limit_type m_peer_limit;
+			group_map_type m_group_buckets;
+			mutable boost::mutex m_peer_buckets_mutex;
+			peer_map_type m_peer_buckets;
+	};
+}
+
+#endif /* FREELAN_RATE_LIMITER_HPP */
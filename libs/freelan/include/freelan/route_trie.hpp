@@ -0,0 +1,157 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file route_trie.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A longest-prefix-match routing trie.
+ */
+
+#ifndef ROUTE_TRIE_HPP
+#define ROUTE_TRIE_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/array.hpp>
+#include <boost/cstdint.hpp>
+
+#include <asiotap/types/ip_route.hpp>
+
+#include "port_index.hpp"
+
+namespace freelan
+{
+	/**
+	 * \brief A longest-prefix-match routing table.
+	 *
+	 * Routes are stored in one binary trie per address family. The trie nodes
+	 * live in a contiguous pool so a lookup only follows small indexes, never
+	 * heap pointers, and visits at most one node per prefix bit.
+	 *
+	 * This class is not thread-safe: the caller must serialize all accesses.
+	 */
+	class route_trie
+	{
+		public:
+
+			/**
+			 * \brief A list of port indexes.
+			 */
+			typedef std::vector<port_index_type> port_index_list_type;
+
+			/**
+			 * \brief Create an empty routing trie.
+			 */
+			route_trie()
+			{
+				clear();
+			}
+
+			/**
+			 * \brief Remove all the routes.
+			 */
+			void clear();
+
+			/**
+			 * \brief Add a route.
+			 * \param route The route.
+			 * \param port The port the route belongs to.
+			 *
+			 * Several ports may share the exact same prefix.
+			 */
+			void add_route(const asiotap::ip_route& route, const port_index_type& port);
+
+			/**
+			 * \brief Add an IPv4 route.
+			 * \param route The route.
+			 * \param port The port the route belongs to.
+			 */
+			void add_route(const asiotap::ipv4_route& route, const port_index_type& port);
+
+			/**
+			 * \brief Add an IPv6 route.
+			 * \param route The route.
+			 * \param port The port the route belongs to.
+			 */
+			void add_route(const asiotap::ipv6_route& route, const port_index_type& port);
+
+			/**
+			 * \brief Find the ports whose routes contain the specified address.
+			 * \param address The destination address.
+			 * \param result The matching ports, ordered from the most specific prefix to the least specific one.
+			 */
+			void find(const boost::asio::ip::address_v4& address, port_index_list_type& result) const;
+
+			/**
+			 * \brief Find the ports whose routes contain the specified address.
+			 * \param address The destination address.
+			 * \param result The matching ports, ordered from the most specific prefix to the least specific one.
+			 */
+			void find(const boost::asio::ip::address_v6& address, port_index_list_type& result) const;
+
+		private:
+
+			struct node_type
+			{
+				node_type()
+				{
+					children[0] = 0;
+					children[1] = 0;
+					ports = -1;
+				}
+
+				// A zero child index means "no child" since the root can never be a child.
+				uint32_t children[2];
+				int32_t ports;
+			};
+
+			typedef std::vector<node_type> node_pool_type;
+
+			void insert(node_pool_type& nodes, const uint8_t* prefix, size_t prefix_length, const port_index_type& port);
+			void find_in(const node_pool_type& nodes, const uint8_t* address, size_t address_length, port_index_list_type& result) const;
+
+			node_pool_type m_ipv4_nodes;
+			node_pool_type m_ipv6_nodes;
+			std::vector<port_index_list_type> m_port_lists;
+	};
+}
+
+#endif /* ROUTE_TRIE_HPP */
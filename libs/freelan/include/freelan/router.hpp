@@ -54,15 +54,15 @@
 #include <boost/array.hpp>
 #include <boost/optional.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
 
-#include <asiotap/osi/ipv4_filter.hpp>
-#include <asiotap/osi/ipv6_filter.hpp>
-#include <asiotap/osi/ipv4_frame.hpp>
-#include <asiotap/osi/ipv6_frame.hpp>
 #include <asiotap/types/ip_network_address.hpp>
 
+#include <fscp/shared_buffer.hpp>
+
 #include "configuration.hpp"
 #include "port_index.hpp"
+#include "route_trie.hpp"
 #include "routes_message.hpp"
 
 namespace freelan
@@ -93,8 +93,10 @@ namespace freelan
 
 					/**
 					 * \brief A write function type.
+					 *
+					 * frame is the buffer that holds data, when the port is its only consumer. It is empty when the port must not modify the data.
 					 */
-					typedef boost::function<void (boost::asio::const_buffer data, write_handler_type handler)> write_function_type;
+					typedef boost::function<void (fscp::SharedBuffer frame, boost::asio::const_buffer data, write_handler_type handler)> write_function_type;
 
 					/**
 					 * \brief Create a new default port.
@@ -155,12 +157,13 @@ namespace freelan
 
 					/**
 					 * \brief Write data to the port.
+					 * \param frame The buffer that holds data, if the port may take ownership of it. Can be empty.
 					 * \param data The data to write.
 					 * \param handler The handler to call when the write is complete.
 					 */
-					void async_write(boost::asio::const_buffer data, write_handler_type handler) const
+					void async_write(fscp::SharedBuffer frame, boost::asio::const_buffer data, write_handler_type handler) const
 					{
-						m_write_function(data, handler);
+						m_write_function(frame, data, handler);
 					}
 
 					const asiotap::ip_route_set& local_routes() const
@@ -218,20 +221,82 @@ namespace freelan
 			 */
 			typedef std::map<port_index_type, port_type> port_list_type;
 
+			/**
+			 * \brief An immutable snapshot of the forwarding state.
+			 *
+			 * A snapshot is published atomically whenever the ports or their routes change and is never modified afterwards, so any thread may resolve targets and write through it without holding a lock or going through a strand.
+			 */
+			class forwarding_snapshot
+			{
+				public:
+
+					/**
+					 * \brief Receive data trough the specified port.
+					 * \param index The port from which the data comes.
+					 * \param frame The buffer that holds data. It is handed over to the target port, which may consume it.
+					 * \param data The data to write.
+					 * \param handler The handler to call when the write is complete.
+					 */
+					void async_write(port_index_type index, fscp::SharedBuffer frame, boost::asio::const_buffer data, port_type::write_handler_type handler) const;
+
+				private:
+
+					forwarding_snapshot(const router_configuration& configuration, size_t parse_offset, const port_list_type& ports);
+
+					template <typename AddressType>
+					const port_type* get_target_for(port_list_type::const_iterator, const AddressType&) const;
+
+					bool m_client_routing_enabled;
+					size_t m_parse_offset;
+					port_list_type m_ports;
+					route_trie m_fib;
+
+					/**
+					 * \brief The unique generation of this snapshot, used to invalidate the per-thread decision caches: a cached decision is only reusable while the snapshot that produced it is the published one.
+					 */
+					uint64_t m_generation;
+
+					friend class router;
+			};
+
+			/**
+			 * \brief A pointer to an immutable forwarding snapshot.
+			 */
+			typedef boost::shared_ptr<const forwarding_snapshot> forwarding_snapshot_pointer;
+
 			/**
 			 * \brief Create a new router.
 			 * \param configuration The router configuration.
 			 */
 			router(const router_configuration& configuration) :
-				m_configuration(configuration)
-			{}
+				m_configuration(configuration),
+				m_parse_offset(0)
+			{
+				// This publishes the initial, empty forwarding snapshot.
+				invalidate_routes();
+			}
 
 			/**
-			 * \brief Invalidate the routes cache.
+			 * \brief Rebuild and publish the forwarding snapshot.
+			 *
+			 * This is invoked automatically by the ports whenever they or their routes change. Like every other mutation, it must be serialized with respect to the other non-const calls.
 			 */
 			void invalidate_routes()
 			{
-				m_routes = boost::none;
+				boost::atomic_store(&m_snapshot, forwarding_snapshot_pointer(new forwarding_snapshot(m_configuration, m_parse_offset, m_ports)));
+			}
+
+			/**
+			 * \brief Set the count of bytes to skip before the IP header of every frame.
+			 * \param parse_offset The offset, in bytes. Typically the length of a virtio-net header, or 0.
+			 *
+			 * Like every other mutation, this must be serialized with respect to the other non-const calls.
+			 */
+			void set_parse_offset(size_t parse_offset)
+			{
+				m_parse_offset = parse_offset;
+
+				invalidate_routes();
 			}
 
 			/**
@@ -256,6 +321,9 @@ namespace freelan
 			void unregister_port(port_index_type index)
 			{
 				m_ports.erase(index);
+
+				// The erased port republishes the snapshot from its destructor, but whether that happens before or after the removal from the map is unspecified, so we republish explicitly.
+				invalidate_routes();
 			}
 
 			/**
@@ -288,29 +356,32 @@ namespace freelan
 			/**
 			 * \brief Receive data trough the specified port.
 			 * \param index The port from which the data comes.
+			 * \param frame The buffer that holds data. It is handed over to the target port, which may consume it.
 			 * \param data The data to write.
 			 * \param handler The handler to call when the write is complete.
 			 */
-			void async_write(port_index_type index, boost::asio::const_buffer data, port_type::write_handler_type handler);
-
-		private:
+			void async_write(port_index_type index, fscp::SharedBuffer frame, boost::asio::const_buffer data, port_type::write_handler_type handler);
 
-			port_list_type::const_iterator get_target_for(port_index_type, boost::asio::const_buffer);
+			/**
+			 * \brief Get the current forwarding snapshot.
+			 * \return The snapshot. Never null.
+			 *
+			 * This performs an atomic load only and may be called from any thread, concurrently with the mutating calls.
+			 */
+			forwarding_snapshot_pointer get_forwarding_snapshot() const
+			{
+				return boost::atomic_load(&m_snapshot);
+			}
 
-			template <typename AddressType>
-			port_list_type::const_iterator get_target_for(port_index_type, const AddressType&);
+		private:
 
 			router_configuration m_configuration;
 
-			port_list_type m_ports;
-
-			asiotap::osi::filter<asiotap::osi::ipv4_frame> m_ipv4_filter;
-			asiotap::osi::filter<asiotap::osi::ipv6_frame> m_ipv6_filter;
+			size_t m_parse_offset;
 
-			typedef std::multimap<asiotap::ip_route, port_index_type> routes_port_type;
+			port_list_type m_ports;
 
-			const routes_port_type& routes() const;
-			mutable boost::optional<routes_port_type> m_routes;
+			forwarding_snapshot_pointer m_snapshot;
 	};
 }
 
@@ -0,0 +1,123 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file routes_caps_message.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief The routes capabilities messages exchanged by the peers.
+ */
+
+#ifndef FREELAN_ROUTES_CAPS_MESSAGE_HPP
+#define FREELAN_ROUTES_CAPS_MESSAGE_HPP
+
+#include "message.hpp"
+
+namespace freelan
+{
+	/**
+	 * \brief A routes capabilities message.
+	 *
+	 * Announces which optional routes channel features the sender understands,
+	 * so peers can use them without breaking older releases: a peer that does
+	 * not know the message type ignores it and keeps getting the historical
+	 * formats.
+	 */
+	class routes_caps_message : public message
+	{
+		public:
+
+			/**
+			 * \brief The capability flags typedef.
+			 */
+			typedef uint8_t flags_type;
+
+			/**
+			 * \brief The sender accepts compact-encoded routes messages.
+			 */
+			static const flags_type FLAG_COMPACT_ROUTES = 0x01;
+
+			/**
+			 * \brief The sender accepts data frames on the QoS channels (3 to 6), in addition to the default channel.
+			 */
+			static const flags_type FLAG_QOS_CHANNELS = 0x02;
+
+			/**
+			 * \brief Get the size of a routes capabilities message, in bytes.
+			 * \return The exact count of bytes write() will produce.
+			 */
+			static size_t required_size();
+
+			/**
+			 * \brief Write a routes capabilities message to a buffer.
+			 * \param buf The buffer to write to.
+			 * \param buf_len The length of buf.
+			 * \param flags The capability flags.
+			 * \return The count of bytes written.
+			 */
+			static size_t write(void* buf, size_t buf_len, flags_type flags);
+
+			/**
+			 * \brief Get the capability flags.
+			 * \return The flags. Unknown bits must be ignored.
+			 */
+			flags_type flags() const;
+
+			/**
+			 * \brief Create a routes_caps_message and map it on a buffer.
+			 * \param buf The buffer.
+			 * \param buf_len The buffer length.
+			 *
+			 * If the mapping fails, a std::runtime_error is thrown.
+			 */
+			routes_caps_message(const void* buf, size_t buf_len);
+
+			/**
+			 * \brief Create a routes_caps_message from a message.
+			 * \param message The message.
+			 */
+			routes_caps_message(const message& message);
+	};
+
+	inline routes_caps_message::flags_type routes_caps_message::flags() const
+	{
+		return fscp::buffer_tools::get<uint8_t>(payload(), 0);
+	}
+}
+
+#endif /* FREELAN_ROUTES_CAPS_MESSAGE_HPP */
@@ -66,6 +66,48 @@ namespace freelan
 			 */
 			typedef uint32_t version_type;
 
+			/**
+			 * \brief The checksum typedef.
+			 */
+			typedef uint32_t checksum_type;
+
+			/**
+			 * \brief Compute the checksum of a route set.
+			 * \param routes The routes.
+			 * \return The checksum of the serialized representation of the routes.
+			 *
+			 * The checksum only depends on the set contents, so two peers that hold the same routes compute the same value.
+			 */
+			static checksum_type compute_checksum(const asiotap::ip_route_set& routes);
+
+			/**
+			 * \brief Get the size of a routes message, in bytes.
+			 * \param routes The routes.
+			 * \return The exact count of bytes write() will produce, so the buffer can be sized without guessing.
+			 */
+			static size_t required_size(const asiotap::ip_route_set& routes);
+
+			/**
+			 * \brief Get the size of a compact routes message, in bytes.
+			 * \param routes The routes.
+			 * \return The exact count of bytes write_compact() will produce.
+			 */
+			static size_t required_size_compact(const asiotap::ip_route_set& routes);
+
+			/**
+			 * \brief Get the size of a routes delta message, in bytes.
+			 * \param added The added routes.
+			 * \param removed The removed routes.
+			 * \return The exact count of bytes write_delta() will produce.
+			 */
+			static size_t required_size_delta(const asiotap::ip_route_set& added, const asiotap::ip_route_set& removed);
+
+			/**
+			 * \brief Get the size of a routes digest message, in bytes.
+			 * \return The exact count of bytes write_digest() will produce.
+			 */
+			static size_t required_size_digest();
+
 			/**
 			 * \brief Write a routes message to a buffer.
 			 * \param buf The buffer to write to.
@@ -76,6 +118,42 @@ namespace freelan
 			 */
 			static size_t write(void* buf, size_t buf_len, version_type version, const asiotap::ip_route_set& routes);
 
+			/**
+			 * \brief Write a compact routes message to a buffer.
+			 * \param buf The buffer to write to.
+			 * \param buf_len The length of buf.
+			 * \param version The version.
+			 * \param routes The routes.
+			 * \return The count of bytes written.
+			 *
+			 * Entries are encoded against the sorted order of the set: each one only carries the address bytes that differ from the previous entry and precede the trailing zeros, which shrinks real route tables severalfold. Only send this form to peers that announced FLAG_COMPACT_ROUTES: older releases do not know the message type.
+			 */
+			static size_t write_compact(void* buf, size_t buf_len, version_type version, const asiotap::ip_route_set& routes);
+
+			/**
+			 * \brief Write a routes delta message to a buffer.
+			 * \param buf The buffer to write to.
+			 * \param buf_len The length of buf.
+			 * \param version The version the delta brings the route set to.
+			 * \param checksum The checksum of the full route set at that version.
+			 * \param added The added routes.
+			 * \param removed The removed routes.
+			 * \return The count of bytes written.
+			 */
+			static size_t write_delta(void* buf, size_t buf_len, version_type version, checksum_type checksum, const asiotap::ip_route_set& added, const asiotap::ip_route_set& removed);
+
+			/**
+			 * \brief Write a routes digest message to a buffer.
+			 * \param buf The buffer to write to.
+			 * \param buf_len The length of buf.
+			 * \param version The version of the announced route set.
+			 * \param checksum The checksum of the full route set at that version.
+			 * \return The count of bytes written.
+			 *
+			 * A digest carries no routes: it only announces the version and checksum of the sender's set, so peers can detect that they diverged and request a full set.
+			 */
+			static size_t write_digest(void* buf, size_t buf_len, version_type version, checksum_type checksum);
+
 			/**
 			 * \brief Get the version.
 			 * \return The version.
@@ -88,6 +166,49 @@ namespace freelan
 			 */
 			const asiotap::ip_route_set& routes() const;
 
+			/**
+			 * \brief Take the routes out of the message.
+			 * \return The routes, moved out of the parse cache.
+			 *
+			 * Avoids a copy of the set when the message is about to be discarded. The routes() accessor is invalidated.
+			 */
+			asiotap::ip_route_set take_routes();
+
+			/**
+			 * \brief Get the checksum of the full route set announced by a delta or digest message.
+			 * \return The checksum.
+			 * \warning Only valid on MT_ROUTES_DELTA and MT_ROUTES_DIGEST messages.
+			 */
+			checksum_type checksum() const;
+
+			/**
+			 * \brief Get the added routes of a delta message.
+			 * \return The added routes.
+			 * \warning Only valid on MT_ROUTES_DELTA messages.
+			 */
+			const asiotap::ip_route_set& added_routes() const;
+
+			/**
+			 * \brief Get the removed routes of a delta message.
+			 * \return The removed routes.
+			 * \warning Only valid on MT_ROUTES_DELTA messages.
+			 */
+			const asiotap::ip_route_set& removed_routes() const;
+
+			/**
+			 * \brief Take the added routes out of a delta message.
+			 * \return The added routes, moved out of the parse cache.
+			 * \warning Only valid on MT_ROUTES_DELTA messages. The added_routes() accessor is invalidated.
+			 */
+			asiotap::ip_route_set take_added_routes();
+
+			/**
+			 * \brief Take the removed routes out of a delta message.
+			 * \return The removed routes, moved out of the parse cache.
+			 * \warning Only valid on MT_ROUTES_DELTA messages. The removed_routes() accessor is invalidated.
+			 */
+			asiotap::ip_route_set take_removed_routes();
+
 			/**
 			 * \brief Create a routes_message and map it on a buffer.
 			 * \param buf The buffer.
@@ -105,7 +226,13 @@ namespace freelan
 
 		private:
 
+			void parse_compact() const;
+			void parse_delta() const;
+			void check_digest() const;
+
 			mutable boost::optional<asiotap::ip_route_set> m_routes_cache;
+			mutable boost::optional<asiotap::ip_route_set> m_added_routes_cache;
+			mutable boost::optional<asiotap::ip_route_set> m_removed_routes_cache;
 	};
 }
 
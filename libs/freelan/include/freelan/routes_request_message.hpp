@@ -57,6 +57,12 @@ namespace freelan
 	{
 		public:
 
+			/**
+			 * \brief Get the size of a routes request message, in bytes.
+			 * \return The exact count of bytes write() will produce.
+			 */
+			static size_t required_size();
+
 			/**
 			 * \brief Write a routes request message to a buffer.
 			 * \param buf The buffer to write to.
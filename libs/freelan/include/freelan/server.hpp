@@ -47,8 +47,11 @@
 
 #include "os.hpp"
 #include "configuration.hpp"
+#include "capture_ring.hpp"
+#include "establishment_history.hpp"
 
 #include <map>
+#include <vector>
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 
@@ -66,7 +69,141 @@ namespace freelan
 		public:
 			typedef boost::function<bool (const std::string& username, const std::string& password, const std::string& remote_host, uint16_t remote_post)> authentication_handler_type;
 
-			web_server(fscp::logger& _logger, const freelan::server_configuration& configuration, authentication_handler_type authentication_handler);
+			/**
+			 * \brief The traffic statistics for one peer.
+			 */
+			struct statistics_peer_entry
+			{
+				statistics_peer_entry() : tx_bytes(0), tx_packets(0), rx_bytes(0), rx_packets(0), path_mtu(0), path_rtt_us(0), path_loss_percent(0) {}
+
+				std::string endpoint;
+				uint64_t tx_bytes;
+				uint64_t tx_packets;
+				uint64_t rx_bytes;
+				uint64_t rx_packets;
+				uint64_t path_mtu; /**< \brief The discovered path MTU, in payload bytes. 0 when unknown. */
+				uint64_t path_rtt_us; /**< \brief The smoothed path round-trip time, in microseconds. 0 when unknown. */
+				uint64_t path_loss_percent; /**< \brief The smoothed path probe loss, in percent. */
+			};
+
+			/**
+			 * \brief The state of one learned MAC entry.
+			 */
+			struct statistics_mac_entry
+			{
+				statistics_mac_entry() : hits(0), age_seconds(0) {}
+
+				std::string address;
+				std::string port;
+				uint64_t hits;
+				uint64_t age_seconds; /**< \brief The time elapsed since the entry was last learned or refreshed. */
+			};
+
+			/**
+			 * \brief The observed counters of a rate limiter bucket pair.
+			 */
+			struct statistics_rate_limit_entry
+			{
+				statistics_rate_limit_entry() : in_passed_packets(0), in_passed_bytes(0), in_dropped_packets(0), in_dropped_bytes(0), out_passed_packets(0), out_passed_bytes(0), out_dropped_packets(0), out_dropped_bytes(0) {}
+
+				std::string name;
+				uint64_t in_passed_packets;
+				uint64_t in_passed_bytes;
+				uint64_t in_dropped_packets;
+				uint64_t in_dropped_bytes;
+				uint64_t out_passed_packets;
+				uint64_t out_passed_bytes;
+				uint64_t out_dropped_packets;
+				uint64_t out_dropped_bytes;
+			};
+
+			/**
+			 * \brief The runtime statistics exposed on the /stats/ route.
+			 */
+			struct statistics_type
+			{
+				statistics_type() : session_count(0), mac_table_size(0), mac_table_hits(0), mac_table_misses(0), mac_table_evictions(0), socket_receive_queue_bytes(0), socket_receive_buffer_size(0), socket_send_buffer_size(0), socket_kernel_drops(0) {}
+
+				std::vector<statistics_peer_entry> peers;
+				size_t session_count;
+				size_t mac_table_size;
+				uint64_t mac_table_hits;
+				uint64_t mac_table_misses;
+				uint64_t mac_table_evictions;
+				std::vector<statistics_mac_entry> mac_entries; /**< \brief The learned entries, most recently used first. */
+				std::vector<statistics_rate_limit_entry> rate_limit_entries; /**< \brief The limited buckets, groups first. */
+				std::map<std::string, uint32_t> strand_pending;
+				uint64_t socket_receive_queue_bytes;
+				uint64_t socket_receive_buffer_size;
+				uint64_t socket_send_buffer_size;
+				uint64_t socket_kernel_drops;
+			};
+
+			/**
+			 * \brief The statistics gathering callback type.
+			 */
+			typedef boost::function<statistics_type ()> statistics_handler_type;
+
+			/**
+			 * \brief The result of an on-demand link measurement, as reported on the /measure/ route.
+			 */
+			struct link_measurement_type
+			{
+				link_measurement_type() :
+					completed(false),
+					sent(0),
+					received(0),
+					reordered(0),
+					duration_ms(0.0),
+					goodput_mbps(0.0),
+					rtt_min_ms(0.0),
+					rtt_median_ms(0.0),
+					rtt_p90_ms(0.0),
+					rtt_p99_ms(0.0),
+					rtt_max_ms(0.0)
+				{}
+
+				std::string error;
+				bool completed;
+				size_t sent;
+				size_t received;
+				size_t reordered;
+				double duration_ms;
+				double goodput_mbps;
+				double rtt_min_ms;
+				double rtt_median_ms;
+				double rtt_p90_ms;
+				double rtt_p99_ms;
+				double rtt_max_ms;
+			};
+
+			/**
+			 * \brief The link measurement callback type.
+			 *
+			 * The callback blocks until the measurement settles, so it must only be called from the web server's own thread.
+			 */
+			typedef boost::function<link_measurement_type (const std::string& host, size_t packet_count, size_t packet_size)> measurement_handler_type;
+
+			/**
+			 * \brief The capture drain callback type.
+			 *
+			 * Returns the frames captured since the previous drain, in capture order.
+			 */
+			typedef boost::function<std::vector<capture_ring::frame_type> ()> capture_handler_type;
+
+			/**
+			 * \brief The capture control callback type.
+			 */
+			typedef boost::function<void (bool enabled)> capture_control_handler_type;
+
+			/**
+			 * \brief The establishment history callback type.
+			 *
+			 * Returns the recorded establishment timelines, completed ones first.
+			 */
+			typedef boost::function<std::vector<establishment_history::record_type> ()> establishment_handler_type;
+
+			web_server(fscp::logger& _logger, const freelan::server_configuration& configuration, authentication_handler_type authentication_handler, statistics_handler_type statistics_handler = statistics_handler_type(), measurement_handler_type measurement_handler = measurement_handler_type(), capture_handler_type capture_handler = capture_handler_type(), capture_control_handler_type capture_control_handler = capture_control_handler_type(), establishment_handler_type establishment_handler = establishment_handler_type());
 
 		protected:
 			route_type& register_authenticated_route(route_type&& route);
@@ -104,9 +241,48 @@ namespace freelan
 
 			client_information_type* get_client_information(mongooseplus::request&);
 
+			/**
+			 * \brief A serialized response body, stamped with the registry generation it was built from.
+			 */
+			struct cached_response_type
+			{
+				uint64_t generation;
+				std::string etag;
+				std::string body;
+			};
+
+			/**
+			 * \brief Record a change to the client information registry.
+			 *
+			 * Invalidates all cached response bodies: they were built from a previous generation.
+			 */
+			void bump_registry_generation()
+			{
+				++m_registry_generation;
+				m_response_cache.clear();
+			}
+
+			/**
+			 * \brief Send a JSON response, caching the serialized body per registry generation.
+			 * \param req The request.
+			 * \param cache_key A key that identifies the response content. Requests with the same key get the same body until the registry changes.
+			 * \param build The callback that builds the JSON document. Only called when no body for the current generation is cached under cache_key.
+			 * \return The request result.
+			 *
+			 * Responses carry an ETag derived from the registry generation; conditional requests whose If-None-Match header still matches are answered with a bodiless 304.
+			 */
+			request_result send_json_cached(mongooseplus::request& req, const std::string& cache_key, const std::function<kfather::object_type ()>& build);
+
 			fscp::logger& m_logger;
 			authentication_handler_type m_authentication_handler;
+			statistics_handler_type m_statistics_handler;
+			measurement_handler_type m_measurement_handler;
+			capture_handler_type m_capture_handler;
+			capture_control_handler_type m_capture_control_handler;
+			establishment_handler_type m_establishment_handler;
 			std::map<std::string, client_information_type> m_client_information_map;
+			uint64_t m_registry_generation;
+			std::map<std::string, cached_response_type> m_response_cache;
 	};
 
 }
@@ -48,13 +48,17 @@
 
 #include <algorithm>
 #include <map>
+#include <vector>
 #include <set>
 
 #include <boost/asio.hpp>
 #include <boost/array.hpp>
 
+#include <fscp/shared_buffer.hpp>
+
 #include "configuration.hpp"
 #include "port_index.hpp"
+#include "mac_table.hpp"
 
 namespace freelan
 {
@@ -82,9 +86,21 @@ namespace freelan
 
 			/**
 			 * \brief The write handler type.
+			 *
+			 * The handler may be null, in which case no per-port results are gathered and the fan-out performs no allocation.
 			 */
 			typedef boost::function<void (const multi_write_result_type&)> multi_write_handler_type;
 
+			/**
+			 * \brief A bound write call, ready to be executed.
+			 */
+			typedef boost::function<void ()> write_call_type;
+
+			/**
+			 * \brief A function used to scatter multi-target write calls across threads.
+			 */
+			typedef boost::function<void (const write_call_type&)> post_function_type;
+
 			/**
 			 * \brief A switch port type.
 			 */
@@ -99,8 +115,10 @@ namespace freelan
 
 					/**
 					 * \brief A write function type.
+					 *
+					 * frame is the buffer that holds data, when the port is its only consumer. It is empty when the same data is written to several ports, in which case the port must not modify the data.
 					 */
-					typedef boost::function<void (boost::asio::const_buffer data, write_handler_type handler)> write_function_type;
+					typedef boost::function<void (fscp::SharedBuffer frame, boost::asio::const_buffer data, write_handler_type handler)> write_function_type;
 
 					/**
 					 * \brief Create a new default port.
@@ -122,12 +140,13 @@ namespace freelan
 
 					/**
 					 * \brief Write data to the port.
+					 * \param frame The buffer that holds data, if the port may take ownership of it. Can be empty.
 					 * \param data The data to write.
 					 * \param handler The handler to call when the write is complete.
 					 */
-					void async_write(boost::asio::const_buffer data, write_handler_type handler)
+					void async_write(fscp::SharedBuffer frame, boost::asio::const_buffer data, write_handler_type handler)
 					{
-						m_write_function(data, handler);
+						m_write_function(frame, data, handler);
 					}
 
 					port_group_type group() const
@@ -153,9 +172,32 @@ namespace freelan
 			 */
 			switch_(const switch_configuration& configuration, const unsigned int max_entries = MAX_ENTRIES_DEFAULT) :
 				m_configuration(configuration),
-				m_max_entries(max_entries)
+				m_max_entries(max_entries),
+				m_parse_offset(0),
+				m_mac_table(max_entries),
+				m_ports_generation(1)
 			{}
 
+			/**
+			 * \brief Set the count of bytes to skip before the ethernet header of every frame.
+			 * \param parse_offset The offset, in bytes. Typically the length of a virtio-net header, or 0.
+			 */
+			void set_parse_offset(size_t parse_offset)
+			{
+				m_parse_offset = parse_offset;
+			}
+
+			/**
+			 * \brief Set the function used to scatter multi-target writes.
+			 * \param post_function The post function. Can be null, in which case multi-target writes happen in the caller's context.
+			 *
+			 * Each scattered call carries its own copy of the port, so ports can safely be registered or unregistered while the calls execute, as long as all accesses to the switch itself remain serialized.
+			 */
+			void set_post_function(post_function_type post_function)
+			{
+				m_post_function = post_function;
+			}
+
 			/**
 			 * \brief Register a switch port.
 			 * \param index The index of the port.
@@ -163,7 +205,16 @@ namespace freelan
 			 */
 			void register_port(port_index_type index, port_type port)
 			{
+				const port_list_type::iterator port_entry = m_ports.find(index);
+
+				if (port_entry != m_ports.end())
+				{
+					remove_port_from_group(index, port_entry->second.group());
+				}
+
 				m_ports[index] = port;
+				m_group_members[port.group()].push_back(index);
+				m_ports_generation++;
 			}
 
 			/**
@@ -174,7 +225,17 @@ namespace freelan
 			 */
 			void unregister_port(port_index_type index)
 			{
-				m_ports.erase(index);
+				const port_list_type::iterator port_entry = m_ports.find(index);
+
+				if (port_entry != m_ports.end())
+				{
+					remove_port_from_group(index, port_entry->second.group());
+					m_ports.erase(port_entry);
+				}
+
+				m_forwarding_cache.erase(index);
+				remove_port_subscriptions(index);
+				m_ports_generation++;
 			}
 
 			/**
@@ -190,28 +251,120 @@ namespace freelan
 			/**
 			 * \brief Receive data trough the specified port.
 			 * \param index The port from which the data comes.
+			 * \param frame The buffer that holds data. It is handed over to the target port only when there is exactly one, since a port may consume it.
 			 * \param data The data to write.
-			 * \param handler The handler to call when the write is complete.
+			 * \param handler The handler to call when the write is complete. Can be null if the caller does not care about the results.
+			 */
+			void async_write(port_index_type index, fscp::SharedBuffer frame, boost::asio::const_buffer data, multi_write_handler_type handler);
+
+			/**
+			 * \brief Get the MAC learning table statistics.
+			 * \return The hit, miss and eviction counters.
 			 */
-			void async_write(port_index_type index, boost::asio::const_buffer data, multi_write_handler_type handler);
+			const mac_table::statistics_type& mac_table_statistics() const
+			{
+				return m_mac_table.statistics();
+			}
+
+			/**
+			 * \brief Get a snapshot of the learned MAC entries, most recently used first.
+			 * \return The entries.
+			 */
+			std::vector<mac_table::entry_info_type> mac_table_entries() const
+			{
+				return m_mac_table.entries();
+			}
+
+			/**
+			 * \brief Get the current MAC learning table occupancy.
+			 * \return The count of learned entries.
+			 */
+			size_t mac_table_size() const
+			{
+				return m_mac_table.size();
+			}
 
 		private:
 
-			std::set<port_index_type> get_targets_for(port_index_type, boost::asio::const_buffer);
-			std::set<port_index_type> get_targets_for(port_list_type::const_iterator);
+			/**
+			 * \brief The target list type.
+			 *
+			 * A flat vector reused across frames, so resolving the targets does not allocate in steady state.
+			 */
+			typedef std::vector<port_index_type> target_list_type;
+
+			void get_targets_for(port_index_type, boost::asio::const_buffer, target_list_type&);
+			void get_targets_for(port_list_type::const_iterator, target_list_type&);
+			bool get_multicast_targets_for(port_list_type::const_iterator, const mac_table::ethernet_address_type&, target_list_type&);
 
 			switch_configuration m_configuration;
 			unsigned int m_max_entries;
+			size_t m_parse_offset;
 
 			port_list_type m_ports;
 
-			typedef boost::array<uint8_t, 6> ethernet_address_type;
-			typedef std::map<ethernet_address_type, port_index_type> ethernet_address_map_type;
+			typedef mac_table::ethernet_address_type ethernet_address_type;
 
 			static ethernet_address_type to_ethernet_address(boost::asio::const_buffer);
 			static bool is_multicast_address(const ethernet_address_type&);
 
-			ethernet_address_map_type m_ethernet_address_map;
+			mac_table m_mac_table;
+			target_list_type m_targets;
+			post_function_type m_post_function;
+
+			/**
+			 * \brief The per-group membership lists.
+			 *
+			 * Maintained at registration time, so a group-scoped broadcast iterates exactly its target ports as contiguous arrays instead of filtering the whole port list for every frame.
+			 */
+			typedef std::map<port_group_type, target_list_type> group_members_type;
+
+			void remove_port_from_group(port_index_type, port_group_type);
+
+			group_members_type m_group_members;
+
+			/**
+			 * \brief The multicast membership table, as learned by IGMP/MLD snooping.
+			 *
+			 * Each entry maps a multicast ethernet address to its subscribed ports, along with the date of their last membership report so silent subscribers age out.
+			 */
+			typedef std::map<port_index_type, std::time_t> multicast_members_type;
+			typedef std::map<ethernet_address_type, multicast_members_type> multicast_table_type;
+
+			static ethernet_address_type ipv4_multicast_to_ethernet(const uint8_t*);
+			static ethernet_address_type ipv6_multicast_to_ethernet(const uint8_t*);
+
+			void snoop_multicast(port_index_type, boost::asio::const_buffer);
+			void multicast_join(const ethernet_address_type&, port_index_type, std::time_t);
+			void multicast_leave(const ethernet_address_type&, port_index_type);
+			void remove_port_subscriptions(port_index_type);
+
+			multicast_table_type m_multicast_table;
+
+			/**
+			 * \brief A cached forwarding decision for a source port.
+			 *
+			 * The entry is only honored while both generation stamps are current, so any port registration change or MAC table mutation invalidates it. A zero ports generation marks a never-filled entry.
+			 */
+			struct forwarding_cache_entry_type
+			{
+				forwarding_cache_entry_type() :
+					ports_generation(0),
+					mac_generation(0),
+					last_learn(0)
+				{}
+
+				uint64_t ports_generation;
+				uint64_t mac_generation;
+				ethernet_address_type target_address;
+				port_index_type target;
+				std::time_t last_learn;
+			};
+
+			typedef std::map<port_index_type, forwarding_cache_entry_type> forwarding_cache_type;
+
+			forwarding_cache_type m_forwarding_cache;
+			uint64_t m_ports_generation;
 	};
 }
 
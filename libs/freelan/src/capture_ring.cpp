@@ -0,0 +1,179 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file capture_ring.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A lock-free ring buffer for datapath frame capture.
+ */
+
+#include "capture_ring.hpp"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace freelan
+{
+	namespace
+	{
+		uint64_t timestamp_now_us()
+		{
+			static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+
+			return static_cast<uint64_t>((boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds());
+		}
+	}
+
+	const char* capture_ring::stage_name(stage_type stage)
+	{
+		switch (stage)
+		{
+			case STAGE_TAP_IN:
+				return "tap-in";
+			case STAGE_PRE_ENCRYPT:
+				return "pre-encrypt";
+			case STAGE_POST_DECRYPT:
+				return "post-decrypt";
+			case STAGE_TAP_OUT:
+				return "tap-out";
+		}
+
+		return "unknown";
+	}
+
+	capture_ring::capture_ring(size_t capacity) :
+		m_records(),
+		m_mask(0),
+		m_head(0),
+		m_tail(0),
+		m_enabled(false),
+		m_dropped(0)
+	{
+		size_t real_capacity = 1;
+
+		while (real_capacity < capacity)
+		{
+			real_capacity <<= 1;
+		}
+
+		m_records.reset(new record_type[real_capacity]);
+		m_mask = real_capacity - 1;
+
+		for (size_t i = 0; i < real_capacity; ++i)
+		{
+			m_records[i].sequence.store(i, boost::memory_order_relaxed);
+		}
+	}
+
+	void capture_ring::do_capture(stage_type stage, const void* buf, size_t size)
+	{
+		// Bounded multi-producer queue: a producer owns the slot whose sequence number matches its claimed position.
+		size_t pos = m_head.load(boost::memory_order_relaxed);
+
+		for (;;)
+		{
+			record_type& record = m_records[pos & m_mask];
+			const size_t sequence = record.sequence.load(boost::memory_order_acquire);
+			const ptrdiff_t difference = static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(pos);
+
+			if (difference == 0)
+			{
+				if (m_head.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed))
+				{
+					record.stage = static_cast<uint8_t>(stage);
+					record.timestamp_us = timestamp_now_us();
+					record.original_length = static_cast<uint32_t>(size);
+					record.size = static_cast<uint16_t>(std::min(size, SNAP_LENGTH));
+					std::memcpy(record.data, buf, record.size);
+
+					record.sequence.store(pos + 1, boost::memory_order_release);
+
+					return;
+				}
+			}
+			else if (difference < 0)
+			{
+				// The consumer has not freed this slot yet: the buffer is full.
+				m_dropped.fetch_add(1, boost::memory_order_relaxed);
+
+				return;
+			}
+			else
+			{
+				// Another producer claimed this position: retry at the new head.
+				pos = m_head.load(boost::memory_order_relaxed);
+			}
+		}
+	}
+
+	size_t capture_ring::drain(std::vector<frame_type>& frames)
+	{
+		size_t count = 0;
+
+		for (;;)
+		{
+			record_type& record = m_records[m_tail & m_mask];
+			const size_t sequence = record.sequence.load(boost::memory_order_acquire);
+
+			if (sequence != m_tail + 1)
+			{
+				// The next record is not published yet.
+				break;
+			}
+
+			frame_type frame;
+			frame.stage = static_cast<stage_type>(record.stage);
+			frame.timestamp_us = record.timestamp_us;
+			frame.original_length = record.original_length;
+			frame.data.assign(record.data, record.data + record.size);
+
+			frames.push_back(frame);
+
+			// Free the slot for the producers, one lap ahead.
+			record.sequence.store(m_tail + m_mask + 1, boost::memory_order_release);
+
+			++m_tail;
+			++count;
+		}
+
+		return count;
+	}
+}
@@ -201,7 +201,7 @@ namespace freelan
 		const auto data = certificate_request.write_der();
 
 		request->set_http_header("content-type", "application/octet-stream");
-		request->set_copy_post_fields(boost::asio::buffer(data.data()));
+		request->set_copy_post_fields(boost::asio::buffer(data.data().data(), data.data().size()));
 
 		const auto buffer = SharedBuffer(8192);
 		const boost::shared_ptr<size_t> count(new size_t(0));
@@ -315,7 +315,7 @@ namespace freelan
 		const auto data = certificate.write_der();
 
 		request->set_http_header("content-type", "application/x-x509-cert");
-		request->set_copy_post_fields(boost::asio::buffer(data.data()));
+		request->set_copy_post_fields(boost::asio::buffer(data.data().data(), data.data().size()));
 
 		const auto buffer = SharedBuffer(8192);
 		const boost::shared_ptr<size_t> count(new size_t(0));
@@ -593,10 +593,58 @@ namespace freelan
 
 	web_client::web_client(boost::asio::io_service& io_service, fscp::logger& _logger, const freelan::client_configuration& configuration) :
 		m_curl_multi_asio(curl_multi_asio::create(io_service)),
+		m_curl_share(boost::make_shared<curl_share>()),
 		m_logger(_logger),
 		m_configuration(configuration),
-		m_url_prefix(boost::lexical_cast<std::string>(m_configuration.protocol) + "://" + boost::lexical_cast<std::string>(m_configuration.server_endpoint))
+		m_url_prefix(boost::lexical_cast<std::string>(m_configuration.protocol) + "://" + boost::lexical_cast<std::string>(m_configuration.server_endpoint)),
+		m_server_host(),
+		m_server_port(0),
+		m_server_address(boost::make_shared<std::string>())
 	{
+		// A few established connections are kept alive and reused by the periodic synchronizations, while a burst of concurrent requests is capped before it piles sockets up on the server.
+		m_curl_multi_asio->set_max_connections(8);
+		m_curl_multi_asio->set_max_host_connections(4);
+
+		const asiotap::hostname_endpoint* const hostname = boost::get<asiotap::hostname_endpoint>(&m_configuration.server_endpoint);
+
+		if (hostname)
+		{
+			const std::string default_service = (m_configuration.protocol == client_configuration::client_protocol_type::https) ? "443" : "80";
+			const std::string service = hostname->service().empty() ? default_service : hostname->service();
+
+			try
+			{
+				m_server_port = boost::lexical_cast<uint16_t>(service);
+			}
+			catch (boost::bad_lexical_cast&)
+			{
+				// A symbolic service name cannot be matched against the URL: the requests will resolve through the DNS cache instead.
+			}
+
+			if (m_server_port != 0)
+			{
+				if (!curl::has_asynchronous_dns())
+				{
+					m_logger(fscp::log_level::debug) << "libcurl resolves host names synchronously: pre-resolving the server host so that requests do not block on DNS.";
+				}
+
+				// Resolve the server host once, up front: requests then connect straight to the address and a degraded DNS server cannot stall the thread that drives the transfers.
+				m_server_host = hostname->hostname();
+
+				const auto resolver = boost::make_shared<boost::asio::ip::udp::resolver>(io_service);
+				const auto server_address = m_server_address;
+
+				const boost::asio::ip::udp::resolver::query query(m_server_host, service, boost::asio::ip::udp::resolver::query::address_configured);
+
+				resolver->async_resolve(query, [resolver, server_address] (const boost::system::error_code& ec, boost::asio::ip::udp::resolver::iterator it) {
+					if (!ec && (it != boost::asio::ip::udp::resolver::iterator()))
+					{
+						*server_address = it->endpoint().address().to_string();
+					}
+				});
+			}
+		}
+
 		if (m_configuration.protocol == client_configuration::client_protocol_type::http)
 		{
 			m_logger(fscp::log_level::warning) << "Web client not configured to use HTTPS: your username and password will be readable by anyone !";
@@ -622,6 +670,18 @@ namespace freelan
 		request->set_url(m_url_prefix + path);
 		request->enable_cookie_support();
 
+		// Resolutions stay usable across several synchronization periods, and the pre-resolved server address, when available, removes the resolver from the request path entirely.
+		request->set_dns_cache_timeout(boost::posix_time::minutes(5));
+
+		if (!m_server_address->empty())
+		{
+			request->add_dns_resolution(m_server_host, m_server_port, *m_server_address);
+		}
+
+		// All requests share the same cookie, DNS and TLS session caches: periodic synchronizations reuse the authenticated session and resume TLS instead of re-handshaking, and independent requests can still run concurrently over the multi handle.
+		request->set_share(m_curl_share);
+		request->enable_tcp_keep_alive();
+
 		if (m_configuration.disable_peer_verification)
 		{
 			request->set_ssl_peer_verification(false);
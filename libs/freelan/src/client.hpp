@@ -129,8 +129,14 @@ namespace freelan
 			boost::shared_ptr<curl> make_request(const std::string& path) const;
 
 			boost::shared_ptr<curl_multi_asio> m_curl_multi_asio;
+			boost::shared_ptr<curl_share> m_curl_share;
 			fscp::logger& m_logger;
 			freelan::client_configuration m_configuration;
 			std::string m_url_prefix;
+			std::string m_server_host;
+			uint16_t m_server_port;
+
+			// Filled asynchronously by the resolution started in the constructor. Shared with the completion handler so a short-lived web_client cannot leave it dangling.
+			boost::shared_ptr<std::string> m_server_address;
 	};
 }
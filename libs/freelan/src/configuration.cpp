@@ -79,7 +79,22 @@ namespace freelan
 		accept_contact_requests(true),
 		accept_contacts(true),
 		hostname_resolution_protocol(HRP_IPV4),
-		hello_timeout(boost::posix_time::seconds(3))
+		hello_timeout(boost::posix_time::seconds(3)),
+		latency_tracing(false),
+		path_mtu_discovery(false),
+		multipath(false),
+		multipath_spray(false),
+		session_resumption(false),
+		receive_buffer_size(0),
+		send_buffer_size(0),
+		busy_poll(0),
+		data_tos(-1),
+		control_tos(-1),
+		dscp_mapping(),
+		handshake_rate_limit(0),
+		lazy_keep_alive(false),
+		cipher_engine(),
+		cipher_engine_threshold(0)
 	{
 	}
 
@@ -89,13 +104,19 @@ namespace freelan
 		certificate_validation_script(),
 		certificate_authority_list(),
 		certificate_revocation_validation_method(CRVM_NONE),
-		certificate_revocation_list_list()
+		certificate_revocation_list_list(),
+		certificate_revocation_list_files(),
+		certificate_verification_cache_file()
 	{
 	}
 
 	tap_adapter_configuration::tap_adapter_configuration() :
 		enabled(true),
 		type(tap_adapter_type::tap),
+		read_ring_size(4),
+		queue_count(1),
+		offload(false),
+		dedicated_io_thread(false),
 		ipv4_address_prefix_length(),
 		ipv6_address_prefix_length(),
 		arp_proxy_enabled(false),
@@ -110,7 +131,8 @@ namespace freelan
 
 	switch_configuration::switch_configuration() :
 		routing_method(RM_SWITCH),
-		relay_mode_enabled(false)
+		relay_mode_enabled(false),
+		multicast_snooping_enabled(false)
 	{
 	}
 
@@ -124,13 +146,22 @@ namespace freelan
 	{
 	}
 
+	limits_configuration::limits_configuration() :
+		peer_rate(0),
+		peer_burst(0),
+		endpoints_rate(0),
+		endpoints_burst(0)
+	{
+	}
+
 	configuration::configuration() :
 		server(),
 		fscp(),
 		security(),
 		tap_adapter(),
 		switch_(),
-		router()
+		router(),
+		limits()
 	{
 	}
 
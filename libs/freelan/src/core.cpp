@@ -48,14 +48,21 @@
 #include "tools.hpp"
 #include "client.hpp"
 #include "routes_request_message.hpp"
+#include "routes_caps_message.hpp"
 #include "routes_message.hpp"
 
 #include "server.hpp"
 #include "client.hpp"
 
 #include <fscp/server_error.hpp>
+#include <fscp/data_message.hpp>
+#include <fscp/latency_trace.hpp>
+
+#include <cryptoplus/base64.hpp>
+#include <cryptoplus/engine.hpp>
 
 #include <asiotap/types/ip_network_address.hpp>
+#include <asiotap/types/compact_ip_route.hpp>
 
 #ifdef WINDOWS
 #include <executeplus/windows_system.hpp>
@@ -66,10 +73,14 @@
 #include <boost/make_shared.hpp>
 #include <boost/foreach.hpp>
 #include <boost/thread/future.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/iterator/transform_iterator.hpp>
 #include <boost/date_time/c_local_time_adjustor.hpp>
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <fstream>
 
 namespace freelan
 {
@@ -87,270 +98,424 @@ namespace freelan
 		{
 		}
 
-		void null_switch_write_handler(const switch_::multi_write_result_type&)
-		{
-		}
-
 		void null_router_write_handler(const boost::system::error_code&)
 		{
 		}
 
-		asiotap::endpoint to_endpoint(const core::ep_type& host)
+		/**
+		 * \brief The shared outcome of a burst of parallel contact attempts.
+		 *
+		 * Every raced candidate reports its greet outcome here: the first success settles the race and the answers of the remaining candidates are discarded, while a failure only settles it if no candidate is left to answer.
+		 */
+		class contact_race
 		{
-			if (host.address().is_v4())
+			public:
+
+				contact_race(size_t pending) :
+					m_settled(false),
+					m_pending(pending)
+				{
+				}
+
+				bool settle(bool success)
+				{
+					boost::mutex::scoped_lock lock(m_mutex);
+
+					const size_t left = --m_pending;
+
+					if (m_settled)
+					{
+						return false;
+					}
+
+					if (success || (left == 0))
+					{
+						m_settled = true;
+
+						return true;
+					}
+
+					return false;
+				}
+
+			private:
+
+				boost::mutex m_mutex;
+				bool m_settled;
+				size_t m_pending;
+		};
+
+		/**
+		 * \brief Check whether a frame can possibly interest the ARP or DHCP proxy.
+		 * \param data The frame, without its virtio-net header.
+		 * \param want_arp Whether the ARP proxy is active.
+		 * \param want_dhcp Whether the DHCP proxy is active.
+		 * \return true if the frame must go through the full filter stack.
+		 *
+		 * The proxies only ever match ARP frames and BOOTP/DHCP datagrams (UDP ports 67 and 68 over IPv4): a couple of field compares against the ethertype, the IP protocol and the UDP ports weed out everything else, so the bulk flows skip the filter instantiation entirely. The check errs on the inclusive side - a candidate that the filters end up rejecting only costs the parse it would have paid anyway.
+		 */
+		bool is_proxy_candidate_frame(boost::asio::const_buffer data, bool want_arp, bool want_dhcp)
+		{
+			const uint8_t* const bytes = boost::asio::buffer_cast<const uint8_t*>(data);
+			const size_t size = boost::asio::buffer_size(data);
+
+			if (size < 14)
 			{
-				return asiotap::ipv4_endpoint(host.address().to_v4(), host.port());
+				return false;
 			}
-			else
+
+			const uint16_t ethertype = static_cast<uint16_t>((bytes[12] << 8) | bytes[13]);
+
+			if (want_arp && (ethertype == 0x0806))
 			{
-				return asiotap::ipv6_endpoint(host.address().to_v6(), host.port());
+				return true;
 			}
-		}
 
-		template <typename Handler, typename CausalHandler>
-		class causal_handler
-		{
-			private:
+			if (want_dhcp && (ethertype == 0x0800))
+			{
+				const uint8_t* const ip = bytes + 14;
+				const size_t remaining = size - 14;
 
-				class automatic_caller : public boost::noncopyable
+				if ((remaining < 20) || ((ip[0] >> 4) != 4))
 				{
-					public:
+					return false;
+				}
 
-						automatic_caller(CausalHandler& _handler) :
-							m_auto_handler(_handler)
-						{
-						}
+				const size_t ip_header_size = static_cast<size_t>(ip[0] & 0x0f) * 4;
 
-						~automatic_caller()
-						{
-							m_auto_handler();
-						}
+				// Only UDP with both ports visible can be BOOTP.
+				if ((ip[9] != 17) || (remaining < ip_header_size + 4))
+				{
+					return false;
+				}
 
-					private:
+				const uint16_t source_port = static_cast<uint16_t>((ip[ip_header_size] << 8) | ip[ip_header_size + 1]);
+				const uint16_t destination_port = static_cast<uint16_t>((ip[ip_header_size + 2] << 8) | ip[ip_header_size + 3]);
 
-						CausalHandler& m_auto_handler;
-				};
+				return (source_port == 67) || (source_port == 68) || (destination_port == 67) || (destination_port == 68);
+			}
 
-			public:
+			return false;
+		}
 
-				typedef void result_type;
+		/**
+		 * \brief Extract the DSCP value of a frame's inner IP header.
+		 * \param data The frame.
+		 * \param has_ethernet_header Whether the frame starts with an ethernet header (tap mode) or an IP header (tun mode).
+		 * \param parse_offset The count of bytes to skip before the frame, for the virtio-net header of offloaded adapters.
+		 * \return The DSCP value, or 0 for non-IP frames and frames too short to carry one.
+		 */
+		unsigned int extract_frame_dscp(boost::asio::const_buffer data, bool has_ethernet_header, size_t parse_offset)
+		{
+			const uint8_t* bytes = boost::asio::buffer_cast<const uint8_t*>(data);
+			size_t size = boost::asio::buffer_size(data);
 
-				causal_handler(Handler _handler, CausalHandler _causal_handler) :
-					m_handler(_handler),
-					m_causal_handler(_causal_handler)
-				{}
+			if (size < parse_offset)
+			{
+				return 0;
+			}
 
-				result_type operator()()
-				{
-					automatic_caller ac(m_causal_handler);
+			bytes += parse_offset;
+			size -= parse_offset;
 
-					m_handler();
+			if (has_ethernet_header)
+			{
+				if (size < 14)
+				{
+					return 0;
 				}
 
-				template <typename Arg1>
-				result_type operator()(Arg1 arg1)
+				uint16_t ethertype = static_cast<uint16_t>((bytes[12] << 8) | bytes[13]);
+				size_t header_size = 14;
+
+				if (ethertype == 0x8100)
 				{
-					automatic_caller ac(m_causal_handler);
+					// 802.1Q tagged frame: the real ethertype follows the tag.
+					if (size < 18)
+					{
+						return 0;
+					}
 
-					m_handler(arg1);
+					ethertype = static_cast<uint16_t>((bytes[16] << 8) | bytes[17]);
+					header_size = 18;
 				}
 
-				template <typename Arg1, typename Arg2>
-				result_type operator()(Arg1 arg1, Arg2 arg2)
+				if ((ethertype != 0x0800) && (ethertype != 0x86dd))
 				{
-					automatic_caller ac(m_causal_handler);
-
-					m_handler(arg1, arg2);
+					return 0;
 				}
 
-			private:
+				bytes += header_size;
+				size -= header_size;
+			}
 
-				Handler m_handler;
-				CausalHandler m_causal_handler;
-		};
+			if (size < 2)
+			{
+				return 0;
+			}
+
+			const unsigned int version = bytes[0] >> 4;
+
+			if (version == 4)
+			{
+				return bytes[1] >> 2;
+			}
+			else if (version == 6)
+			{
+				// The traffic class straddles the first two bytes.
+				return static_cast<unsigned int>(((bytes[0] & 0x0f) << 2) | (bytes[1] >> 6));
+			}
+
+			return 0;
+		}
+
+		// The wire format of the link measurement probes exchanged on the measurement channel: a version, a type, a big-endian sequence number and the sender's timestamp, followed by padding up to the requested probe size. The timestamp is opaque to the receiver, which echoes the header verbatim.
+		const uint8_t LINK_PROBE_VERSION = 1;
+		const uint8_t LINK_PROBE_REQUEST = 1;
+		const uint8_t LINK_PROBE_REPLY = 2;
+		const size_t LINK_PROBE_HEADER_SIZE = 14;
+		const size_t LINK_PROBE_MIN_SIZE = 32;
+		const size_t LINK_PROBE_MAX_SIZE = 1400;
+		const size_t LINK_PROBE_MAX_COUNT = 10000;
 
-		template <typename Handler, typename CausalHandler>
-		inline causal_handler<Handler, CausalHandler> make_causal_handler(Handler _handler, CausalHandler _causal_handler)
+		uint64_t link_probe_now_us()
 		{
-			return causal_handler<Handler, CausalHandler>(_handler, _causal_handler);
+			static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+
+			return static_cast<uint64_t>((boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds());
 		}
 
-		unsigned int get_auto_mtu_value()
+		uint64_t establishment_history_now_us()
 		{
-			const unsigned int default_mtu_value = 1500;
-			const size_t static_payload_size = 20 + 8 + 4 + 22; // IP + UDP + FSCP HEADER + FSCP DATA HEADER
+			return link_probe_now_us();
+		}
 
-			return default_mtu_value - static_payload_size;
+		void write_link_probe(uint8_t* buf, uint8_t type, uint32_t sequence, uint64_t timestamp)
+		{
+			buf[0] = LINK_PROBE_VERSION;
+			buf[1] = type;
+			buf[2] = static_cast<uint8_t>(sequence >> 24);
+			buf[3] = static_cast<uint8_t>(sequence >> 16);
+			buf[4] = static_cast<uint8_t>(sequence >> 8);
+			buf[5] = static_cast<uint8_t>(sequence);
+
+			for (size_t i = 0; i < 8; ++i)
+			{
+				buf[6 + i] = static_cast<uint8_t>(timestamp >> (56 - 8 * i));
+			}
 		}
 
-		static const unsigned int TAP_ADAPTERS_GROUP = 0;
-		static const unsigned int ENDPOINTS_GROUP = 1;
+		bool parse_link_probe(const uint8_t* buf, size_t buf_len, uint8_t& type, uint32_t& sequence, uint64_t& timestamp)
+		{
+			if ((buf_len < LINK_PROBE_HEADER_SIZE) || (buf[0] != LINK_PROBE_VERSION))
+			{
+				return false;
+			}
+
+			type = buf[1];
+			sequence = (static_cast<uint32_t>(buf[2]) << 24) | (static_cast<uint32_t>(buf[3]) << 16) | (static_cast<uint32_t>(buf[4]) << 8) | static_cast<uint32_t>(buf[5]);
+			timestamp = 0;
+
+			for (size_t i = 0; i < 8; ++i)
+			{
+				timestamp = (timestamp << 8) | buf[6 + i];
+			}
 
-		asiotap::ip_route_set filter_routes(const asiotap::ip_route_set& routes, router_configuration::internal_route_scope_type scope, unsigned int limit, const asiotap::ip_network_address_list& network_addresses)
+			return true;
+		}
+
+		asiotap::endpoint to_endpoint(const core::ep_type& host)
+		{
+			if (host.address().is_v4())
+			{
+				return asiotap::ipv4_endpoint(host.address().to_v4(), host.port());
+			}
+			else
+			{
+				return asiotap::ipv6_endpoint(host.address().to_v6(), host.port());
+			}
+		}
+
+		boost::posix_time::time_duration renewal_jitter(cryptoplus::x509::certificate certificate, const boost::posix_time::time_duration& window)
 		{
-			asiotap::ip_route_set result;
-			auto ipv4_limit = limit;
-			auto ipv6_limit = limit;
+			// A fleet signed in one batch expires in one batch: with a fixed
+			// warning period every node would renew at the very same instant.
+			// Hashing the certificate serial spreads the nodes evenly over the
+			// window, and deterministically so - a node always picks the same
+			// renewal instant for a given certificate, restarts included.
+			const ASN1_INTEGER* const serial = certificate.serial_number().raw();
 
-			auto check_limit = [limit, &ipv4_limit, &ipv6_limit](const asiotap::ip_route& route) {
+			uint64_t hash = 14695981039346656037ULL;
 
-				if (limit == 0)
+			if (serial)
+			{
+				for (int i = 0; i < serial->length; ++i)
 				{
-					return true;
+					hash = (hash ^ serial->data[i]) * 1099511628211ULL;
 				}
+			}
 
-				const bool is_ipv4 = get_network_address(network_address(route)).is_v4();
+			const long window_seconds = window.total_seconds();
 
-				if (is_ipv4 ? ipv4_limit : ipv6_limit > 0)
-				{
-					(is_ipv4 ? ipv4_limit : ipv6_limit)--;
+			if (window_seconds <= 0)
+			{
+				return boost::posix_time::seconds(0);
+			}
 
-					return true;
-				}
+			return boost::posix_time::seconds(static_cast<long>(hash % static_cast<uint64_t>(window_seconds)));
+		}
 
-				return false;
-			};
+		unsigned int get_auto_mtu_value()
+		{
+			const unsigned int default_mtu_value = 1500;
+			const size_t static_payload_size = 20 + 8 + 4 + 22; // IP + UDP + FSCP HEADER + FSCP DATA HEADER
 
-			switch (scope)
-			{
-				case router_configuration::internal_route_scope_type::none:
-					break;
-				case router_configuration::internal_route_scope_type::unicast_in_network:
-				{
-					for (auto&& ina: network_addresses)
-					{
-						for (auto&& route : routes)
-						{
-							if (is_unicast(route) && has_network(ina, network_address(route)))
-							{
-								if (check_limit(route))
-								{
-									result.insert(route);
-								}
-							}
-						}
-					}
+			return default_mtu_value - static_payload_size;
+		}
 
-					break;
-				}
-				case router_configuration::internal_route_scope_type::unicast:
+		static const unsigned int TAP_ADAPTERS_GROUP = 0;
+		static const unsigned int ENDPOINTS_GROUP = 1;
+
+		class route_scope_filter
+		{
+			public:
+
+				/**
+				 * \brief Compile an internal route acceptance policy into a predicate.
+				 *
+				 * The scope enum is looked at once, here: applying the filter then runs a single flag-test loop per route instead of a branch cascade, and the local networks are converted to their compact form once instead of per covering test.
+				 */
+				static route_scope_filter compile(router_configuration::internal_route_scope_type scope, unsigned int limit, const asiotap::ip_network_address_list& network_addresses)
 				{
-					for (auto&& route : routes)
+					route_scope_filter result(limit);
+
+					switch (scope)
 					{
-						if (is_unicast(route))
-						{
-							if (check_limit(route))
-							{
-								result.insert(route);
-							}
-						}
+						case router_configuration::internal_route_scope_type::none:
+							break;
+						case router_configuration::internal_route_scope_type::unicast_in_network:
+							result.m_flags = FLAG_ACCEPT | FLAG_REQUIRE_UNICAST | FLAG_REQUIRE_COVERED;
+							break;
+						case router_configuration::internal_route_scope_type::unicast:
+							result.m_flags = FLAG_ACCEPT | FLAG_REQUIRE_UNICAST;
+							break;
+						case router_configuration::internal_route_scope_type::subnet:
+							result.m_flags = FLAG_ACCEPT | FLAG_REQUIRE_COVERED;
+							break;
+						case router_configuration::internal_route_scope_type::any:
+							result.m_flags = FLAG_ACCEPT;
+							break;
 					}
 
-					break;
-				}
-				case router_configuration::internal_route_scope_type::subnet:
-				{
-					for (auto&& ina : network_addresses)
+					if (result.m_flags & FLAG_REQUIRE_COVERED)
 					{
-						for (auto&& route : routes)
+						result.m_networks.reserve(network_addresses.size());
+
+						for (auto&& ina : network_addresses)
 						{
-							if (has_network(ina, network_address(route)))
-							{
-								if (check_limit(route))
-								{
-									result.insert(route);
-								}
-							}
+							result.m_networks.push_back(asiotap::to_compact(ina));
 						}
 					}
 
-					break;
+					return result;
 				}
-				case router_configuration::internal_route_scope_type::any:
+
+				/**
+				 * \brief Compile a system route acceptance policy into a predicate.
+				 */
+				static route_scope_filter compile(router_configuration::system_route_scope_type scope, unsigned int limit)
 				{
-					for (auto&& route : routes)
+					route_scope_filter result(limit);
+
+					switch (scope)
 					{
-						if (check_limit(route))
-						{
-							result.insert(route);
-						}
+						case router_configuration::system_route_scope_type::none:
+							break;
+						case router_configuration::system_route_scope_type::unicast:
+							result.m_flags = FLAG_ACCEPT | FLAG_REQUIRE_UNICAST | FLAG_REJECT_GATEWAY;
+							break;
+						case router_configuration::system_route_scope_type::unicast_with_gateway:
+							result.m_flags = FLAG_ACCEPT | FLAG_REQUIRE_UNICAST;
+							break;
+						case router_configuration::system_route_scope_type::any:
+							result.m_flags = FLAG_ACCEPT | FLAG_REJECT_GATEWAY;
+							break;
+						case router_configuration::system_route_scope_type::any_with_gateway:
+							result.m_flags = FLAG_ACCEPT;
+							break;
 					}
 
-					break;
+					return result;
 				}
-			}
-
-			return result;
-		}
-
-		asiotap::ip_route_set filter_routes(const asiotap::ip_route_set& routes, router_configuration::system_route_scope_type scope, unsigned int limit)
-		{
-			asiotap::ip_route_set result;
-			auto ipv4_limit = limit;
-			auto ipv6_limit = limit;
-
-			auto check_limit = [limit, &ipv4_limit, &ipv6_limit](const asiotap::ip_route& route) {
 
-				if (limit == 0)
+				asiotap::ip_route_set apply(const asiotap::ip_route_set& routes) const
 				{
-					return true;
-				}
-
-				const bool is_ipv4 = get_network_address(network_address(route)).is_v4();
+					asiotap::ip_route_set result;
 
-				if (is_ipv4 ? ipv4_limit : ipv6_limit > 0)
-				{
-					(is_ipv4 ? ipv4_limit : ipv6_limit)--;
+					if (!(m_flags & FLAG_ACCEPT))
+					{
+						return result;
+					}
 
-					return true;
-				}
+					// The compact forms keep the whole filter pass free of visitor dispatch, and the sorted array comes for free since the orderings match.
+					const asiotap::compact_ip_route_list compact_routes = asiotap::to_compact(routes);
 
-				return false;
-			};
+					auto ipv4_limit = m_limit;
+					auto ipv6_limit = m_limit;
 
-			switch (scope)
-			{
-				case router_configuration::system_route_scope_type::none:
-					break;
-				case router_configuration::system_route_scope_type::unicast:
-				case router_configuration::system_route_scope_type::unicast_with_gateway:
-				{
-					for (auto&& route : routes)
+					for (auto&& route : compact_routes)
 					{
-						if (is_unicast(route))
+						if ((m_flags & FLAG_REQUIRE_UNICAST) && !is_unicast(route))
 						{
-							if ((scope == router_configuration::system_route_scope_type::unicast_with_gateway) || !has_gateway(route))
-							{
-								if (check_limit(route))
-								{
-									result.insert(route);
-								}
-							}
+							continue;
 						}
-					}
 
-					break;
-				}
-				case router_configuration::system_route_scope_type::any:
-				case router_configuration::system_route_scope_type::any_with_gateway:
-				{
-					for (auto&& route : routes)
-					{
-						if ((scope == router_configuration::system_route_scope_type::any_with_gateway) || !has_gateway(route))
+						if ((m_flags & FLAG_REJECT_GATEWAY) && has_gateway(route))
+						{
+							continue;
+						}
+
+						if ((m_flags & FLAG_REQUIRE_COVERED) && !is_covered_by_any(m_networks, route.network_address))
+						{
+							continue;
+						}
+
+						if (m_limit != 0)
 						{
-							if (check_limit(route))
+							auto& family_limit = (route.network_address.family == asiotap::compact_ip_family_v4) ? ipv4_limit : ipv6_limit;
+
+							if (family_limit == 0)
 							{
-								result.insert(route);
+								continue;
 							}
+
+							family_limit--;
 						}
+
+						// The compact ordering matches the set ordering, so the insertion point is always at the end.
+						result.insert(result.end(), asiotap::from_compact(route));
 					}
 
-					break;
+					return result;
 				}
-			}
 
-			return result;
-		}
+			private:
+
+				static const uint32_t FLAG_ACCEPT = 0x01;
+				static const uint32_t FLAG_REQUIRE_UNICAST = 0x02;
+				static const uint32_t FLAG_REQUIRE_COVERED = 0x04;
+				static const uint32_t FLAG_REJECT_GATEWAY = 0x08;
+
+				explicit route_scope_filter(unsigned int limit) :
+					m_flags(0),
+					m_limit(limit),
+					m_networks()
+				{}
+
+				uint32_t m_flags;
+				unsigned int m_limit;
+				asiotap::compact_ip_network_address_list m_networks;
+		};
 	}
 
 	typedef boost::asio::ip::udp::resolver::query resolver_query;
@@ -370,13 +535,18 @@ namespace freelan
 	const boost::posix_time::time_duration core::GET_CONTACT_INFORMATION_RETRY_PERIOD = boost::posix_time::seconds(35);
 	const boost::posix_time::time_duration core::GET_CONTACT_INFORMATION_UPDATE_PERIOD = boost::posix_time::minutes(5);
 
+	const boost::posix_time::time_duration core::CRL_REFRESH_PERIOD = boost::posix_time::minutes(15);
+
 	const std::string core::DEFAULT_SERVICE = "12000";
+	const size_t core::CONTACT_BURST_SIZE = 4;
 
 	core::core(boost::asio::io_service& io_service, const freelan::configuration& _configuration) :
 		m_io_service(io_service),
 		m_configuration(_configuration),
 		m_logger_strand(m_io_service),
 		m_logger(m_logger_strand.wrap(boost::bind(&core::do_handle_log, this, _1, _2, _3))),
+		m_configuration_strand(m_io_service),
+		m_never_contact_list(boost::make_shared<asiotap::ip_network_address_list>(m_configuration.fscp.never_contact_list)),
 		m_log_callback(),
 		m_core_opened_callback(),
 		m_core_closed_callback(),
@@ -389,12 +559,23 @@ namespace freelan
 		m_tap_adapter_up_callback(),
 		m_tap_adapter_down_callback(),
 		m_fscp_server(),
-		m_contact_timer(m_io_service, CONTACT_PERIOD),
-		m_dynamic_contact_timer(m_io_service, DYNAMIC_CONTACT_PERIOD),
-		m_routes_request_timer(m_io_service, ROUTES_REQUEST_PERIOD),
-		m_tap_adapter_strand(m_io_service),
+		m_endpoint_resolver(m_io_service),
+		m_maintenance_scheduler(m_io_service, m_logger),
+		m_tap_io_service(),
+		// The tap strand follows the device: with a dedicated I/O thread both live on the device reactor, otherwise everything stays on the shared io_service as before.
+		m_tap_adapter_strand(m_configuration.tap_adapter.dedicated_io_thread ? m_tap_io_service : m_io_service),
+		m_congested_peer_count(0),
+		m_deferred_tap_reads(),
+		m_tap_vnet_header_length(0),
 		m_proxies_strand(m_io_service),
 		m_tap_write_queue_strand(m_io_service),
+		m_tap_frames_in_counter(fscp::metrics_registry::get_default_instance().get_counter("core.port.tap.frames_in")),
+		m_tap_frames_out_counter(fscp::metrics_registry::get_default_instance().get_counter("core.port.tap.frames_out")),
+		m_tap_write_queue_depth_histogram(fscp::metrics_registry::get_default_instance().get_histogram("core.tap.write_queue_depth")),
+		m_trace_send_tap_histogram(fscp::metrics_registry::get_default_instance().get_histogram("core.trace.send.tap_to_switch_ns")),
+		m_trace_send_fscp_histogram(fscp::metrics_registry::get_default_instance().get_histogram("core.trace.send.fscp_send_ns")),
+		m_trace_receive_histogram(fscp::metrics_registry::get_default_instance().get_histogram("core.trace.receive.fscp_to_switch_ns")),
+		m_oversize_frames_dropped_counter(fscp::metrics_registry::get_default_instance().get_counter("core.port.fscp.frames_dropped_oversize")),
 		m_arp_filter(m_ethernet_filter),
 		m_ipv4_filter(m_ethernet_filter),
 		m_udp_filter(m_ipv4_filter),
@@ -404,6 +585,8 @@ namespace freelan
 		m_switch(m_configuration.switch_),
 		m_router(m_configuration.router),
 		m_route_manager(m_io_service),
+		m_dscp_qos_enabled(false),
+		m_dscp_channel_table(),
 		m_request_certificate_timer(m_io_service, REQUEST_CERTIFICATE_PERIOD),
 		m_request_ca_certificate_timer(m_io_service, REQUEST_CA_CERTIFICATE_PERIOD),
 		m_renew_certificate_timer(m_io_service),
@@ -411,9 +594,22 @@ namespace freelan
 		m_set_contact_information_retry_timer(m_io_service),
 		m_get_contact_information_retry_timer(m_io_service)
 	{
+		m_ipv4_filter.add_checksum_filter();
+		m_udp_filter.add_checksum_bridge_filter();
+
+		// This filter stack only parses frames read from our own TAP device: their checksums are locally generated, or legitimately absent when checksum offloading is enabled, so verifying them would be redundant work per frame.
+		m_ipv4_filter.set_checksum_verification_enabled(false);
+		m_udp_filter.set_checksum_verification_enabled(false);
+
 		m_arp_filter.add_handler(boost::bind(&core::do_handle_arp_frame, this, _1));
 		m_dhcp_filter.add_handler(boost::bind(&core::do_handle_dhcp_frame, this, _1));
 
+		// Scatter broadcast writes across the io_service threads: each scattered call owns a copy
+		// of its port, so m_router_strand only has to serialize target resolution and registration.
+		m_switch.set_post_function([this](const switch_::write_call_type& call){
+			m_io_service.post(call);
+		});
+
 		// Setup the route manager.
 		auto route_registration_success_handler = [this](const asiotap::route_manager::route_type& route){
 			m_logger(fscp::log_level::information) << "Added system route: " << route;
@@ -435,6 +631,8 @@ namespace freelan
 	{
 		m_logger(fscp::log_level::debug) << "Opening core...";
 
+		fscp::latency_trace::set_enabled(m_configuration.fscp.latency_tracing);
+
 		open_web_client();
 
 		if (m_configuration.security.identity || !m_configuration.client.enabled)
@@ -445,6 +643,26 @@ namespace freelan
 		open_tap_adapter();
 		open_web_server();
 
+		if (!m_configuration.security.certificate_revocation_list_files.empty() && (m_configuration.security.certificate_revocation_validation_method != security_configuration::CRVM_NONE))
+		{
+			// File reads, PEM parsing and a CA store rebuild: kept off the ticks that carry traffic.
+			m_maintenance_scheduler.register_task("crl_refresh", maintenance_scheduler::TASK_COST_HEAVY, CRL_REFRESH_PERIOD, boost::bind(&core::refresh_certificate_revocation_lists, this));
+		}
+
+		m_maintenance_scheduler.set_load_probe(boost::bind(&core::is_busy, this));
+		m_maintenance_scheduler.start();
+
+		if (!m_configuration.security.certificate_verification_cache_file.empty() && (m_configuration.security.certificate_validation_method == security_configuration::CVM_DEFAULT))
+		{
+			// Verdicts carry their expiry with them, so a warm restart picks up exactly where it left off: unchanged peer certificates re-establish without a single chain walk.
+			const size_t count = m_certificate_verification_cache.load(m_configuration.security.certificate_verification_cache_file.string());
+
+			if (count > 0)
+			{
+				m_logger(fscp::log_level::information) << "Loaded " << count << " certificate verification verdict(s) from " << m_configuration.security.certificate_verification_cache_file << ".";
+			}
+		}
+
 		m_logger(fscp::log_level::debug) << "Core opened.";
 	}
 
@@ -452,6 +670,15 @@ namespace freelan
 	{
 		m_logger(fscp::log_level::debug) << "Closing core...";
 
+		m_maintenance_scheduler.stop();
+
+		if (!m_configuration.security.certificate_verification_cache_file.empty() && (m_configuration.security.certificate_validation_method == security_configuration::CVM_DEFAULT))
+		{
+			const size_t count = m_certificate_verification_cache.save(m_configuration.security.certificate_verification_cache_file.string());
+
+			m_logger(fscp::log_level::information) << "Saved " << count << " certificate verification verdict(s) to " << m_configuration.security.certificate_verification_cache_file << ".";
+		}
+
 		close_web_server();
 		close_tap_adapter();
 		close_fscp_server();
@@ -473,37 +700,96 @@ namespace freelan
 
 	bool core::is_banned(const boost::asio::ip::address& address) const
 	{
-		return has_address(m_configuration.fscp.never_contact_list.begin(), m_configuration.fscp.never_contact_list.end(), address);
+		// The snapshot is immutable and loaded atomically, so this can run on any io_service thread while a reload publishes a new one.
+		const boost::shared_ptr<const asiotap::ip_network_address_list> never_contact_list = boost::atomic_load(&m_never_contact_list);
+
+		return has_address(never_contact_list->begin(), never_contact_list->end(), address);
 	}
 
-	void core::open_fscp_server()
+	void core::async_reload_configuration(const configuration& new_configuration)
 	{
-		if (!m_configuration.security.identity)
-		{
-			m_logger(fscp::log_level::warning) << "No user certificate or private key set. Generating temporary ones...";
+		m_configuration_strand.post(boost::bind(&core::do_reload_configuration, this, new_configuration));
+	}
 
-			const auto private_key = generate_private_key();
-			const auto certificate = generate_self_signed_certificate(private_key);
+	void core::do_reload_configuration(configuration new_configuration)
+	{
+		// All calls to do_reload_configuration() are done within the m_configuration_strand, so the contact list swaps below cannot interleave with the periodic contact handlers.
+		m_logger(fscp::log_level::information) << "Reloading configuration...";
 
-			m_configuration.security.identity = fscp::identity_store(certificate, private_key);
+		std::vector<std::string> deferred_settings;
 
-			m_logger(fscp::log_level::warning) << "Using a generated temporary certificate (" << certificate.subject() << ") prevents reliable authentication ! Generate and specify a static certificate/key pair for use in production.";
+		if (!(m_configuration.fscp.listen_on == new_configuration.fscp.listen_on))
+		{
+			deferred_settings.push_back("fscp.listen_on");
 		}
 
-		m_logger(fscp::log_level::information) << "Starting FSCP server...";
+		if (m_configuration.fscp.cipher_suite_capabilities != new_configuration.fscp.cipher_suite_capabilities)
+		{
+			deferred_settings.push_back("fscp.cipher_suite_capability");
+		}
 
-		m_fscp_server = boost::make_shared<fscp::server>(boost::ref(m_io_service), boost::ref(m_logger), boost::cref(*m_configuration.security.identity));
+		if (m_configuration.fscp.elliptic_curve_capabilities != new_configuration.fscp.elliptic_curve_capabilities)
+		{
+			deferred_settings.push_back("fscp.elliptic_curve_capability");
+		}
 
-		try
+		if ((m_configuration.tap_adapter.type != new_configuration.tap_adapter.type) || (m_configuration.tap_adapter.name != new_configuration.tap_adapter.name) || (m_configuration.tap_adapter.mtu != new_configuration.tap_adapter.mtu))
 		{
-			m_fscp_server->set_cipher_suites(m_configuration.fscp.cipher_suite_capabilities);
-			m_fscp_server->set_elliptic_curves(m_configuration.fscp.elliptic_curve_capabilities);
+			deferred_settings.push_back("tap_adapter.*");
+		}
 
-			m_fscp_server->set_hello_message_received_callback(boost::bind(&core::do_handle_hello_received, this, _1, _2));
-			m_fscp_server->set_contact_request_received_callback(boost::bind(&core::do_handle_contact_request_received, this, _1, _2, _3, _4));
-			m_fscp_server->set_contact_received_callback(boost::bind(&core::do_handle_contact_received, this, _1, _2, _3));
-			m_fscp_server->set_presentation_message_received_callback(boost::bind(&core::do_handle_presentation_received, this, _1, _2, _3, _4));
-			m_fscp_server->set_session_request_message_received_callback(boost::bind(&core::do_handle_session_request_received, this, _1, _2, _3, _4));
+		for (auto&& setting : deferred_settings)
+		{
+			m_logger(fscp::log_level::warning) << "Configuration reload: \"" << setting << "\" changed but cannot be applied without a restart. Keeping the running value.";
+		}
+
+		m_configuration.fscp.contact_list = new_configuration.fscp.contact_list;
+		m_configuration.fscp.dynamic_contact_list = new_configuration.fscp.dynamic_contact_list;
+		m_configuration.fscp.accept_contact_requests = new_configuration.fscp.accept_contact_requests;
+		m_configuration.fscp.accept_contacts = new_configuration.fscp.accept_contacts;
+		m_configuration.fscp.hello_timeout = new_configuration.fscp.hello_timeout;
+
+		m_configuration.fscp.never_contact_list = new_configuration.fscp.never_contact_list;
+		boost::atomic_store(&m_never_contact_list, boost::shared_ptr<const asiotap::ip_network_address_list>(boost::make_shared<asiotap::ip_network_address_list>(new_configuration.fscp.never_contact_list)));
+
+		if (m_fscp_server)
+		{
+			// Try the (possibly new) contacts right away rather than waiting for the next periodic round.
+			async_contact_all();
+			async_dynamic_contact_all();
+		}
+
+		m_logger(fscp::log_level::important) << "Configuration reloaded.";
+	}
+
+	void core::open_fscp_server()
+	{
+		if (!m_configuration.security.identity)
+		{
+			m_logger(fscp::log_level::warning) << "No user certificate or private key set. Generating temporary ones...";
+
+			const auto private_key = generate_private_key();
+			const auto certificate = generate_self_signed_certificate(private_key);
+
+			m_configuration.security.identity = fscp::identity_store(certificate, private_key);
+
+			m_logger(fscp::log_level::warning) << "Using a generated temporary certificate (" << certificate.subject() << ") prevents reliable authentication ! Generate and specify a static certificate/key pair for use in production.";
+		}
+
+		m_logger(fscp::log_level::information) << "Starting FSCP server...";
+
+		m_fscp_server = boost::make_shared<fscp::server>(boost::ref(m_io_service), boost::ref(m_logger), boost::cref(*m_configuration.security.identity));
+
+		try
+		{
+			m_fscp_server->set_cipher_suites(m_configuration.fscp.cipher_suite_capabilities);
+			m_fscp_server->set_elliptic_curves(m_configuration.fscp.elliptic_curve_capabilities);
+
+			m_fscp_server->set_hello_message_received_callback(boost::bind(&core::do_handle_hello_received, this, _1, _2));
+			m_fscp_server->set_contact_request_received_callback(boost::bind(&core::do_handle_contact_request_received, this, _1, _2, _3, _4));
+			m_fscp_server->set_contact_received_callback(boost::bind(&core::do_handle_contact_received, this, _1, _2, _3));
+			m_fscp_server->set_presentation_message_received_callback(boost::bind(&core::do_handle_presentation_received, this, _1, _2, _3, _4));
+			m_fscp_server->set_session_request_message_received_callback(boost::bind(&core::do_handle_session_request_received, this, _1, _2, _3, _4));
 			m_fscp_server->set_session_message_received_callback(boost::bind(&core::do_handle_session_received, this, _1, _2, _3, _4));
 			m_fscp_server->set_session_failed_callback(boost::bind(&core::do_handle_session_failed, this, _1, _2));
 			m_fscp_server->set_session_error_callback(boost::bind(&core::do_handle_session_error, this, _1, _2, _3));
@@ -511,6 +797,92 @@ namespace freelan
 			m_fscp_server->set_session_lost_callback(boost::bind(&core::do_handle_session_lost, this, _1, _2));
 			m_fscp_server->set_data_received_callback(boost::bind(&core::do_handle_data_received, this, _1, _2, _3, _4));
 
+			// Messages (routes, certificate requests) travel on channel 1: give them priority over the bulk frames on channel 0 so routing keeps converging when the tunnel is saturated.
+			m_fscp_server->set_channel_priority(fscp::CHANNEL_NUMBER_1, 0);
+
+			// Bound the per-peer egress queues and pause the TAP reads while a peer is congested: backpressure then propagates to the host network stack instead of growing our memory.
+			m_fscp_server->set_peer_send_queue_depth(256);
+			m_fscp_server->set_peer_congestion_callback(m_tap_adapter_strand.wrap(boost::bind(&core::do_handle_peer_congestion, this, _1, _2)));
+
+			// Probe each peer's real path MTU and clamp what we send accordingly: stacked tunnels otherwise blackhole the large frames until someone hand-tunes the mtu setting.
+			m_fscp_server->set_path_mtu_discovery(m_configuration.fscp.path_mtu_discovery);
+
+			if (m_configuration.fscp.path_mtu_discovery)
+			{
+				m_fscp_server->set_path_mtu_changed_callback(boost::bind(&core::do_handle_path_mtu_changed, this, _1, _2));
+			}
+
+			// A dual-homed peer holds one session per endpoint: let the server steer data over the fastest healthy path instead of whichever handshook first.
+			m_fscp_server->set_multipath(m_configuration.fscp.multipath);
+			m_fscp_server->set_multipath_spray(m_configuration.fscp.multipath_spray);
+			m_fscp_server->set_session_resumption(m_configuration.fscp.session_resumption);
+
+			// Socket tuning: all of it must land before open(), and the effective buffer sizes show in the /stats/ output so a clamped request is visible.
+			m_fscp_server->set_receive_buffer_size(m_configuration.fscp.receive_buffer_size);
+			m_fscp_server->set_send_buffer_size(m_configuration.fscp.send_buffer_size);
+			m_fscp_server->set_busy_poll(m_configuration.fscp.busy_poll);
+			m_fscp_server->set_data_tos(m_configuration.fscp.data_tos);
+			m_fscp_server->set_control_tos(m_configuration.fscp.control_tos);
+			m_fscp_server->set_handshake_rate_limit(m_configuration.fscp.handshake_rate_limit);
+			m_fscp_server->set_lazy_keep_alive(m_configuration.fscp.lazy_keep_alive);
+
+			if (!m_configuration.fscp.cipher_engine.empty())
+			{
+				// The configuration asked for hardware: failing over to software silently would hide a 4x throughput regression, so a missing engine is an error.
+				if (!cryptoplus::engine::select(m_configuration.fscp.cipher_engine))
+				{
+					throw std::runtime_error("Unable to load the cipher engine: " + m_configuration.fscp.cipher_engine);
+				}
+
+				cryptoplus::engine::set_threshold(m_configuration.fscp.cipher_engine_threshold);
+
+				m_logger(fscp::log_level::information) << "Using the \"" << m_configuration.fscp.cipher_engine << "\" cipher engine for data messages" << ((m_configuration.fscp.cipher_engine_threshold > 0) ? " above the size threshold." : ".");
+			}
+
+			// The traffic limits: the endpoints group bucket caps the gateway as a whole and the peer buckets cap each overlay peer, in both directions.
+			m_rate_limiter.set_peer_limit(rate_limiter::limit_type(m_configuration.limits.peer_rate, m_configuration.limits.peer_burst));
+			m_rate_limiter.set_group_limit(ENDPOINTS_GROUP, rate_limiter::limit_type(m_configuration.limits.endpoints_rate, m_configuration.limits.endpoints_burst));
+
+			// Each distinct outer TOS byte of the DSCP mapping gets its own egress channel: classed frames are scheduled ahead of the bulk frames and keep their marking on the underlay. Channels 3 to 6 are used, so at most 4 classes besides the default.
+			m_dscp_qos_enabled = !m_configuration.fscp.dscp_mapping.empty();
+
+			if (m_dscp_qos_enabled)
+			{
+				for (size_t i = 0; i < sizeof(m_dscp_channel_table) / sizeof(m_dscp_channel_table[0]); ++i)
+				{
+					m_dscp_channel_table[i] = fscp::CHANNEL_NUMBER_0;
+				}
+
+				std::map<int, fscp::channel_number_type> channel_of_tos;
+				fscp::channel_number_type next_channel = fscp::CHANNEL_NUMBER_3;
+
+				for (auto&& entry : m_configuration.fscp.dscp_mapping)
+				{
+					const auto channel = channel_of_tos.find(entry.second);
+
+					if (channel != channel_of_tos.end())
+					{
+						m_dscp_channel_table[entry.first] = channel->second;
+
+						continue;
+					}
+
+					if (next_channel > fscp::CHANNEL_NUMBER_6)
+					{
+						m_logger(fscp::log_level::warning) << "The DSCP mapping lists more than 4 distinct TOS bytes: ignoring DSCP " << entry.first << ".";
+
+						continue;
+					}
+
+					m_fscp_server->set_channel_priority(next_channel, 0);
+					m_fscp_server->set_channel_tos(next_channel, entry.second);
+
+					channel_of_tos[entry.second] = next_channel;
+					m_dscp_channel_table[entry.first] = next_channel;
+					next_channel = static_cast<fscp::channel_number_type>(next_channel + 1);
+				}
+			}
+
 			resolver_type resolver(m_io_service);
 
 			const ep_type listen_endpoint = boost::apply_visitor(
@@ -554,12 +926,16 @@ namespace freelan
 			}
 #endif
 
+			// Go straight for sessions with the peers we knew before the last shutdown.
+			load_peer_state();
+
 			// We start the contact loop.
 			async_contact_all();
 
-			m_contact_timer.async_wait(boost::bind(&core::do_handle_periodic_contact, this, boost::asio::placeholders::error));
-			m_dynamic_contact_timer.async_wait(boost::bind(&core::do_handle_periodic_dynamic_contact, this, boost::asio::placeholders::error));
-			m_routes_request_timer.async_wait(boost::bind(&core::do_handle_periodic_routes_request, this, boost::asio::placeholders::error));
+			// The periodic loops run through the maintenance scheduler, which spreads them over separate ticks and defers them while the datapath is busy.
+			m_maintenance_scheduler.register_task("contact", maintenance_scheduler::TASK_COST_LIGHT, CONTACT_PERIOD, m_configuration_strand.wrap(boost::bind(&core::async_contact_all, this)));
+			m_maintenance_scheduler.register_task("dynamic_contact", maintenance_scheduler::TASK_COST_LIGHT, DYNAMIC_CONTACT_PERIOD, m_configuration_strand.wrap(boost::bind(&core::async_dynamic_contact_all, this)));
+			m_maintenance_scheduler.register_task("routes_digest", maintenance_scheduler::TASK_COST_LIGHT, ROUTES_REQUEST_PERIOD, m_router_strand.wrap(boost::bind(&core::do_send_periodic_routes_digest, this)));
 
 			m_logger(fscp::log_level::information) << "FSCP server started.";
 		}
@@ -579,10 +955,12 @@ namespace freelan
 		{
 			m_logger(fscp::log_level::information) << "Closing FSCP server...";
 
-			// Stop the contact loop timers.
-			m_routes_request_timer.cancel();
-			m_dynamic_contact_timer.cancel();
-			m_contact_timer.cancel();
+			// Stop the contact loops.
+			m_maintenance_scheduler.unregister_task("routes_digest");
+			m_maintenance_scheduler.unregister_task("dynamic_contact");
+			m_maintenance_scheduler.unregister_task("contact");
+
+			save_peer_state();
 
 			m_fscp_server->close();
 
@@ -590,6 +968,275 @@ namespace freelan
 		}
 	}
 
+	void core::load_peer_state()
+	{
+		if (m_configuration.fscp.state_file.empty())
+		{
+			return;
+		}
+
+		std::ifstream state_file(m_configuration.fscp.state_file.string().c_str());
+
+		if (!state_file)
+		{
+			return;
+		}
+
+		size_t count = 0;
+		std::string address;
+		unsigned short port = 0;
+		std::string certificate;
+
+		while (state_file >> address >> port >> certificate)
+		{
+			try
+			{
+				boost::system::error_code address_ec;
+				const auto addr = boost::asio::ip::address::from_string(address, address_ec);
+
+				if (address_ec)
+				{
+					continue;
+				}
+
+				const ep_type host(addr, port);
+
+				if (is_banned(host.address()))
+				{
+					continue;
+				}
+
+				const auto sig_cert = cert_type::from_der(cryptoplus::base64_decode(certificate));
+
+				// The certificate was valid when it was saved, but the authority list or the CRLs may have changed since.
+				if (!certificate_is_valid(sig_cert))
+				{
+					continue;
+				}
+
+				// Seed the presentation and skip straight to the session request: no HELLO/PRESENTATION round-trips needed.
+				m_fscp_server->set_presentation(host, sig_cert);
+				async_request_session(host);
+
+				{
+					boost::mutex::scoped_lock lock(m_peer_state_mutex);
+
+					m_peer_state_map[host] = sig_cert;
+				}
+
+				++count;
+			}
+			catch (const std::exception&)
+			{
+				// A corrupted entry is not worth aborting the startup for.
+				continue;
+			}
+		}
+
+		if (count > 0)
+		{
+			m_logger(fscp::log_level::information) << "Requesting sessions with " << count << " known peer(s) from the last run.";
+		}
+	}
+
+	void core::save_peer_state()
+	{
+		if (m_configuration.fscp.state_file.empty())
+		{
+			return;
+		}
+
+		std::map<ep_type, cert_type> peer_state_map;
+
+		{
+			boost::mutex::scoped_lock lock(m_peer_state_mutex);
+
+			peer_state_map = m_peer_state_map;
+		}
+
+		std::ofstream state_file(m_configuration.fscp.state_file.string().c_str());
+
+		if (!state_file)
+		{
+			m_logger(fscp::log_level::warning) << "Unable to write the peer state file at " << m_configuration.fscp.state_file << ".";
+
+			return;
+		}
+
+		for (auto&& pair : peer_state_map)
+		{
+			const auto der = pair.second.write_der();
+
+			state_file << pair.first.address().to_string() << " " << pair.first.port() << " " << cryptoplus::base64_encode(cryptoplus::buffer_cast<const uint8_t*>(der), cryptoplus::buffer_size(der)) << "\n";
+		}
+
+		m_logger(fscp::log_level::information) << "Saved " << peer_state_map.size() << " known peer(s) to " << m_configuration.fscp.state_file << ".";
+	}
+
+	void core::do_handle_probe_data(const ep_type& sender, fscp::SharedBuffer, boost::asio::const_buffer data)
+	{
+		uint8_t type;
+		uint32_t sequence;
+		uint64_t timestamp;
+
+		if (!parse_link_probe(buffer_cast<const uint8_t*>(data), buffer_size(data), type, sequence, timestamp))
+		{
+			m_logger(fscp::log_level::warning) << "Received a malformed link measurement probe from " << sender << ".";
+
+			return;
+		}
+
+		if (type == LINK_PROBE_REQUEST)
+		{
+			// Echo the header only: the reverse path must stay light so the measurement reflects the forward direction.
+			const auto reply_buffer = SharedBuffer(LINK_PROBE_HEADER_SIZE);
+
+			write_link_probe(buffer_cast<uint8_t*>(reply_buffer), LINK_PROBE_REPLY, sequence, timestamp);
+
+			m_fscp_server->async_send_data(
+				sender,
+				fscp::CHANNEL_NUMBER_2,
+				buffer(reply_buffer, LINK_PROBE_HEADER_SIZE),
+				make_shared_buffer_handler(
+					reply_buffer,
+					&null_simple_write_handler
+				)
+			);
+		}
+		else if (type == LINK_PROBE_REPLY)
+		{
+			const uint64_t now_us = link_probe_now_us();
+
+			boost::mutex::scoped_lock lock(m_link_measurement_mutex);
+
+			link_measurement_context& context = m_link_measurement;
+
+			if (!context.active || (sender != context.target) || (sequence >= context.expected))
+			{
+				return;
+			}
+
+			if (context.received_flags[sequence])
+			{
+				// A duplicate: the first echo already counted.
+				return;
+			}
+
+			context.received_flags[sequence] = true;
+			context.received++;
+			context.rtts_ms.push_back(static_cast<double>(now_us - timestamp) / 1000.0);
+			context.last_reply_time = boost::posix_time::microsec_clock::universal_time();
+
+			if (context.received > 1 && sequence < context.highest_sequence)
+			{
+				context.reordered++;
+			}
+			else
+			{
+				context.highest_sequence = sequence;
+			}
+
+			if (context.received == context.expected)
+			{
+				m_link_measurement_condition.notify_all();
+			}
+		}
+	}
+
+	core::link_measurement_result core::measure_link(const ep_type& host, size_t packet_count, size_t packet_size)
+	{
+		assert(m_fscp_server);
+
+		packet_count = std::max<size_t>(1, std::min(packet_count, LINK_PROBE_MAX_COUNT));
+		packet_size = std::max(LINK_PROBE_MIN_SIZE, std::min(packet_size, LINK_PROBE_MAX_SIZE));
+
+		{
+			boost::mutex::scoped_lock lock(m_link_measurement_mutex);
+
+			if (m_link_measurement.active)
+			{
+				throw std::runtime_error("A link measurement is already in progress");
+			}
+
+			m_link_measurement = link_measurement_context();
+			m_link_measurement.active = true;
+			m_link_measurement.target = host;
+			m_link_measurement.expected = packet_count;
+			m_link_measurement.received_flags.resize(packet_count, false);
+			m_link_measurement.rtts_ms.reserve(packet_count);
+		}
+
+		m_logger(fscp::log_level::information) << "Measuring the link to " << host << " with " << packet_count << " probe(s) of " << packet_size << " byte(s)...";
+
+		const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+		for (size_t sequence = 0; sequence < packet_count; ++sequence)
+		{
+			const auto probe_buffer = SharedBuffer(packet_size);
+
+			std::memset(buffer_cast<uint8_t*>(probe_buffer), 0, packet_size);
+			write_link_probe(buffer_cast<uint8_t*>(probe_buffer), LINK_PROBE_REQUEST, static_cast<uint32_t>(sequence), link_probe_now_us());
+
+			m_fscp_server->async_send_data(
+				host,
+				fscp::CHANNEL_NUMBER_2,
+				buffer(probe_buffer, packet_size),
+				make_shared_buffer_handler(
+					probe_buffer,
+					&null_simple_write_handler
+				)
+			);
+		}
+
+		link_measurement_result result;
+
+		{
+			boost::mutex::scoped_lock lock(m_link_measurement_mutex);
+
+			// Wait for the last echo, up to a fixed deadline: lost probes would otherwise block forever.
+			const boost::system_time deadline = boost::get_system_time() + boost::posix_time::seconds(3);
+
+			while (m_link_measurement.received < m_link_measurement.expected)
+			{
+				if (!m_link_measurement_condition.timed_wait(lock, deadline))
+				{
+					break;
+				}
+			}
+
+			link_measurement_context& context = m_link_measurement;
+
+			result.sent = context.expected;
+			result.received = context.received;
+			result.reordered = context.reordered;
+			result.completed = (context.received == context.expected);
+
+			if (context.received > 0)
+			{
+				result.duration_ms = static_cast<double>((context.last_reply_time - start).total_microseconds()) / 1000.0;
+
+				if (result.duration_ms > 0.0)
+				{
+					result.goodput_mbps = static_cast<double>(context.received * packet_size) * 8.0 / (result.duration_ms * 1000.0);
+				}
+
+				std::sort(context.rtts_ms.begin(), context.rtts_ms.end());
+
+				result.rtt_min_ms = context.rtts_ms.front();
+				result.rtt_median_ms = context.rtts_ms[context.rtts_ms.size() / 2];
+				result.rtt_p90_ms = context.rtts_ms[std::min(context.rtts_ms.size() - 1, context.rtts_ms.size() * 90 / 100)];
+				result.rtt_p99_ms = context.rtts_ms[std::min(context.rtts_ms.size() - 1, context.rtts_ms.size() * 99 / 100)];
+				result.rtt_max_ms = context.rtts_ms.back();
+			}
+
+			context = link_measurement_context();
+		}
+
+		m_logger(fscp::log_level::information) << "Link measurement to " << host << " done: " << result.received << "/" << result.sent << " probe(s) echoed.";
+
+		return result;
+	}
+
 	void core::async_contact(const endpoint& target, duration_handler_type handler)
 	{
 		m_logger(fscp::log_level::debug) << "Resolving " << target << " for potential contact...";
@@ -597,32 +1244,58 @@ namespace freelan
 		// This is a ugly workaround for a bug in Boost::Variant (<1.55)
 		endpoint target1 = target;
 
-		const auto resolve_handler = [this, handler, target1] (const boost::system::error_code& ec, boost::asio::ip::udp::resolver::iterator it)
+		const uint64_t resolve_started_at = establishment_history_now_us();
+
+		const auto resolve_handler = [this, handler, target1, resolve_started_at] (const boost::system::error_code& ec, boost::asio::ip::udp::resolver::iterator it)
 		{
+			const uint64_t resolve_duration_us = establishment_history_now_us() - resolve_started_at;
+
 			if (!ec)
 			{
-				const ep_type host = *it;
+				// We race up to CONTACT_BURST_SIZE of the resolved endpoints in parallel: the first one that answers our HELLO settles the contact and the late answers of the others are discarded, so traversal costs about one round-trip instead of one greet timeout per unresponsive candidate.
+				std::vector<ep_type> candidates;
+
+				for (; (it != boost::asio::ip::udp::resolver::iterator()) && (candidates.size() < CONTACT_BURST_SIZE); ++it)
+				{
+					candidates.push_back(*it);
+				}
 
-				// This is a ugly workaround for a bug in Boost::Variant (<1.55)
-				endpoint target2 = target1;
+				const auto race = boost::make_shared<contact_race>(candidates.size());
 
-				// The host was resolved: we first make sure no session exist with that host before doing anything else.
-				m_fscp_server->async_has_session_with_endpoint(
-					host,
-					[this, handler, host, target2] (bool has_session)
+				const auto race_handler = [handler, race] (const ep_type& host, const boost::system::error_code& ec2, const boost::posix_time::time_duration& duration)
+				{
+					if (race->settle(!ec2))
 					{
-						if (!has_session)
-						{
-							m_logger(fscp::log_level::debug) << "No session exists with " << target2 << " (at " << host << "). Contacting...";
+						handler(host, ec2, duration);
+					}
+				};
 
-							do_contact(host, handler);
-						}
-						else
+				for (auto&& host : candidates)
+				{
+					// This is a ugly workaround for a bug in Boost::Variant (<1.55)
+					endpoint target2 = target1;
+
+					// The host was resolved: we first make sure no session exist with that host before doing anything else.
+					m_fscp_server->async_has_session_with_endpoint(
+						host,
+						[this, race, race_handler, host, target2, resolve_duration_us] (bool has_session)
 						{
-							m_logger(fscp::log_level::debug) << "A session already exists with " << target2 << " (at " << host << "). Not contacting again.";
+							if (!has_session)
+							{
+								m_logger(fscp::log_level::debug) << "No session exists with " << target2 << " (at " << host << "). Contacting...";
+
+								do_contact(host, race_handler, resolve_duration_us);
+							}
+							else
+							{
+								m_logger(fscp::log_level::debug) << "A session already exists with " << target2 << " (at " << host << "). Not contacting again.";
+
+								// The candidate withdraws from the race without surfacing an outcome, as no contact is needed.
+								race->settle(false);
+							}
 						}
-					}
-				);
+					);
+				}
 			}
 			else
 			{
@@ -630,15 +1303,13 @@ namespace freelan
 			}
 		};
 
-		boost::apply_visitor(
-			asiotap::endpoint_async_resolve_visitor(
-				boost::make_shared<resolver_type>(boost::ref(m_io_service)),
-				to_protocol(m_configuration.fscp.hostname_resolution_protocol),
-				resolver_query::address_configured,
-				DEFAULT_SERVICE,
-				resolve_handler
-			),
-			target
+		// The cached resolver spares a DNS round-trip per contact cycle for names that resolved recently, and backs off quickly but not perpetually on names that did not.
+		m_endpoint_resolver.async_resolve(
+			target,
+			to_protocol(m_configuration.fscp.hostname_resolution_protocol),
+			resolver_query::address_configured,
+			DEFAULT_SERVICE,
+			resolve_handler
 		);
 	}
 
@@ -668,7 +1339,8 @@ namespace freelan
 
 	void core::async_send_contact_request_to_all(const hash_list_type& hash_list, multiple_endpoints_handler_type handler)
 	{
-		m_fscp_server->async_send_contact_request_to_all(hash_list, handler);
+		// Periodic dynamic-contact maintenance is paced so it never competes with the data plane in bursts.
+		m_fscp_server->async_send_contact_request_to_all(hash_list, handler, fscp::DEFAULT_PACING_WINDOW);
 	}
 
 	void core::async_send_contact_request_to_all(const hash_list_type& hash_list)
@@ -716,35 +1388,140 @@ namespace freelan
 		);
 	}
 
-	void core::async_handle_routes(const ep_type& sender, const routes_message& msg)
+	void core::async_handle_routes(const ep_type& sender, routes_message& msg)
 	{
 		const auto version = msg.version();
-		const auto routes = msg.routes();
+
+		// The set is parsed once, moved out of the message and shared across the
+		// handler chain: no further copies are made on the way to the strand.
+		const auto routes = boost::make_shared<asiotap::ip_route_set>(msg.take_routes());
 
 		async_get_tap_addresses([this, sender, version, routes](const asiotap::ip_network_address_list& ip_addresses){
-			m_router_strand.post(
-				boost::bind(
-					&core::do_handle_routes,
-					this,
-					ip_addresses,
-					sender,
-					version,
-					routes
-				)
-			);
+			m_router_strand.post([this, ip_addresses, sender, version, routes](){
+				do_handle_routes(ip_addresses, sender, version, *routes);
+			});
 		});
 	}
 
-	void core::async_send_routes_request(const ep_type& target, simple_handler_type handler)
+	void core::async_handle_routes_delta(const ep_type& sender, routes_message& msg)
+	{
+		const auto version = msg.version();
+		const auto checksum = msg.checksum();
+
+		// Same single-parse scheme as async_handle_routes().
+		const auto added = boost::make_shared<asiotap::ip_route_set>(msg.take_added_routes());
+		const auto removed = boost::make_shared<asiotap::ip_route_set>(msg.take_removed_routes());
+
+		async_get_tap_addresses([this, sender, version, checksum, added, removed](const asiotap::ip_network_address_list& ip_addresses){
+			m_router_strand.post([this, ip_addresses, sender, version, checksum, added, removed](){
+				do_handle_routes_delta(ip_addresses, sender, version, checksum, *added, *removed);
+			});
+		});
+	}
+
+	void core::async_handle_routes_caps(const ep_type& sender, const routes_caps_message& msg)
+	{
+		const auto flags = msg.flags();
+
+		m_router_strand.post(
+			boost::bind(
+				&core::do_handle_routes_caps,
+				this,
+				sender,
+				flags
+			)
+		);
+	}
+
+	void core::async_handle_routes_digest(const ep_type& sender, const routes_message& msg)
+	{
+		const auto version = msg.version();
+		const auto checksum = msg.checksum();
+
+		m_router_strand.post(
+			boost::bind(
+				&core::do_handle_routes_digest,
+				this,
+				sender,
+				version,
+				checksum
+			)
+		);
+	}
+
+	void core::async_send_routes_request(const ep_type& target, simple_handler_type handler)
+	{
+		assert(m_fscp_server);
+
+		m_logger(fscp::log_level::debug) << "Sending routes request to " << target << ".";
+
+		const auto data_buffer = SharedBuffer(routes_request_message::required_size());
+		const size_t size = routes_request_message::write(
+			buffer_cast<uint8_t*>(data_buffer),
+			buffer_size(data_buffer)
+		);
+
+		m_fscp_server->async_send_data(
+			target,
+			fscp::CHANNEL_NUMBER_1,
+			buffer(data_buffer, size),
+			make_shared_buffer_handler(
+				data_buffer,
+				handler
+			)
+		);
+	}
+
+	void core::async_send_routes_request(const ep_type& target)
+	{
+		async_send_routes_request(target, boost::bind(&core::do_handle_send_routes_request, this, target, _1));
+	}
+
+	void core::async_send_routes_request_to_all(multiple_endpoints_handler_type handler)
+	{
+		assert(m_fscp_server);
+
+		m_logger(fscp::log_level::debug) << "Sending routes request to all hosts.";
+
+		const auto data_buffer = SharedBuffer(routes_request_message::required_size());
+		const size_t size = routes_request_message::write(
+			buffer_cast<uint8_t*>(data_buffer),
+			buffer_size(data_buffer)
+		);
+
+		m_fscp_server->async_send_data_to_all(
+			fscp::CHANNEL_NUMBER_1,
+			buffer(data_buffer, size),
+			make_shared_buffer_handler(
+				data_buffer,
+				handler
+			)
+		);
+	}
+
+	void core::async_send_routes_request_to_all()
+	{
+		async_send_routes_request_to_all(boost::bind(&core::do_handle_send_routes_request_to_all, this, _1));
+	}
+
+	void core::async_send_routes(const ep_type& target, routes_message::version_type version, const asiotap::ip_route_set& routes, bool compact, simple_handler_type handler)
 	{
 		assert(m_fscp_server);
 
-		m_logger(fscp::log_level::debug) << "Sending routes request to " << target << ".";
+		m_logger(fscp::log_level::debug) << "Sending routes to " << target << ": version " << version << (compact ? " (compact)" : "") << " (" << routes << ").";
 
-		const auto data_buffer = SharedBuffer(2048);
-		const size_t size = routes_request_message::write(
+		// Sizing from the set itself keeps large route sets from overflowing a guessed buffer.
+		const auto data_buffer = SharedBuffer(compact ? routes_message::required_size_compact(routes) : routes_message::required_size(routes));
+		const size_t size = compact ? routes_message::write_compact(
 			buffer_cast<uint8_t*>(data_buffer),
-			buffer_size(data_buffer)
+			buffer_size(data_buffer),
+			version,
+			routes
+		) : routes_message::write(
+			buffer_cast<uint8_t*>(data_buffer),
+			buffer_size(data_buffer),
+			version,
+			routes
 		);
 
 		m_fscp_server->async_send_data(
@@ -758,21 +1535,44 @@ namespace freelan
 		);
 	}
 
-	void core::async_send_routes_request(const ep_type& target)
+	void core::async_send_routes_caps(const ep_type& target)
 	{
-		async_send_routes_request(target, boost::bind(&core::do_handle_send_routes_request, this, target, _1));
+		assert(m_fscp_server);
+
+		m_logger(fscp::log_level::debug) << "Sending routes capabilities to " << target << ".";
+
+		const auto data_buffer = SharedBuffer(routes_caps_message::required_size());
+		const size_t size = routes_caps_message::write(
+			buffer_cast<uint8_t*>(data_buffer),
+			buffer_size(data_buffer),
+			routes_caps_message::FLAG_COMPACT_ROUTES | routes_caps_message::FLAG_QOS_CHANNELS
+		);
+
+		m_fscp_server->async_send_data(
+			target,
+			fscp::CHANNEL_NUMBER_1,
+			buffer(data_buffer, size),
+			make_shared_buffer_handler(
+				data_buffer,
+				&null_simple_write_handler
+			)
+		);
 	}
 
-	void core::async_send_routes_request_to_all(multiple_endpoints_handler_type handler)
+	void core::async_send_routes_delta_to_all(routes_message::version_type version, routes_message::checksum_type checksum, const asiotap::ip_route_set& added, const asiotap::ip_route_set& removed, multiple_endpoints_handler_type handler)
 	{
 		assert(m_fscp_server);
 
-		m_logger(fscp::log_level::debug) << "Sending routes request to all hosts.";
+		m_logger(fscp::log_level::debug) << "Sending routes delta to all hosts: version " << version << " (added: " << added << ", removed: " << removed << ").";
 
-		const auto data_buffer = SharedBuffer(2048);
-		const size_t size = routes_request_message::write(
+		const auto data_buffer = SharedBuffer(routes_message::required_size_delta(added, removed));
+		const size_t size = routes_message::write_delta(
 			buffer_cast<uint8_t*>(data_buffer),
-			buffer_size(data_buffer)
+			buffer_size(data_buffer),
+			version,
+			checksum,
+			added,
+			removed
 		);
 
 		m_fscp_server->async_send_data_to_all(
@@ -785,27 +1585,26 @@ namespace freelan
 		);
 	}
 
-	void core::async_send_routes_request_to_all()
+	void core::async_send_routes_delta_to_all(routes_message::version_type version, routes_message::checksum_type checksum, const asiotap::ip_route_set& added, const asiotap::ip_route_set& removed)
 	{
-		async_send_routes_request_to_all(boost::bind(&core::do_handle_send_routes_request_to_all, this, _1));
+		async_send_routes_delta_to_all(version, checksum, added, removed, boost::bind(&core::do_handle_send_routes_delta_to_all, this, _1));
 	}
 
-	void core::async_send_routes(const ep_type& target, routes_message::version_type version, const asiotap::ip_route_set& routes, simple_handler_type handler)
+	void core::async_send_routes_digest_to_all(routes_message::version_type version, routes_message::checksum_type checksum, multiple_endpoints_handler_type handler)
 	{
 		assert(m_fscp_server);
 
-		m_logger(fscp::log_level::debug) << "Sending routes to " << target << ": version " << version << " (" << routes << ").";
+		m_logger(fscp::log_level::debug) << "Sending routes digest to all hosts: version " << version << ".";
 
-		const auto data_buffer = SharedBuffer(8192);
-		const size_t size = routes_message::write(
+		const auto data_buffer = SharedBuffer(routes_message::required_size_digest());
+		const size_t size = routes_message::write_digest(
 			buffer_cast<uint8_t*>(data_buffer),
 			buffer_size(data_buffer),
 			version,
-			routes
+			checksum
 		);
 
-		m_fscp_server->async_send_data(
-			target,
+		m_fscp_server->async_send_data_to_all(
 			fscp::CHANNEL_NUMBER_1,
 			buffer(data_buffer, size),
 			make_shared_buffer_handler(
@@ -815,12 +1614,24 @@ namespace freelan
 		);
 	}
 
-	void core::do_contact(const ep_type& address, duration_handler_type handler)
+	void core::async_send_routes_digest_to_all(routes_message::version_type version, routes_message::checksum_type checksum)
+	{
+		async_send_routes_digest_to_all(version, checksum, boost::bind(&core::do_handle_send_routes_digest_to_all, this, _1));
+	}
+
+	void core::async_update_local_routes(const asiotap::ip_route_set& routes)
+	{
+		m_router_strand.post(boost::bind(&core::do_update_local_routes, this, routes));
+	}
+
+	void core::do_contact(const ep_type& address, duration_handler_type handler, uint64_t resolve_duration_us)
 	{
 		assert(m_fscp_server);
 
 		m_logger(fscp::log_level::debug) << "Sending HELLO to " << address;
 
+		m_establishment_history.hello_sent(address, resolve_duration_us);
+
 		m_fscp_server->async_greet(address, boost::bind(handler, address, _1, _2));
 	}
 
@@ -830,6 +1641,9 @@ namespace freelan
 		{
 			m_logger(fscp::log_level::debug) << "Received HELLO_RESPONSE from " << host << " at " << address << ". Latency: " << duration << "";
 
+			m_establishment_history.hello_answered(address, static_cast<uint64_t>(duration.total_microseconds()));
+			m_establishment_history.presentation_sent(address);
+
 			async_introduce_to(address);
 		}
 		else
@@ -845,37 +1659,37 @@ namespace freelan
 		}
 	}
 
-	void core::do_handle_periodic_contact(const boost::system::error_code& ec)
+	void core::do_send_periodic_routes_digest()
 	{
-		if (ec != boost::asio::error::operation_aborted)
+		// All calls to do_send_periodic_routes_digest() are done within the m_router_strand, so the following is safe.
+		if (!m_fscp_server)
 		{
-			async_contact_all();
-
-			m_contact_timer.expires_from_now(CONTACT_PERIOD);
-			m_contact_timer.async_wait(boost::bind(&core::do_handle_periodic_contact, this, boost::asio::placeholders::error));
+			return;
 		}
-	}
 
-	void core::do_handle_periodic_dynamic_contact(const boost::system::error_code& ec)
-	{
-		if (ec != boost::asio::error::operation_aborted)
+		if (m_local_routes_version.is_initialized())
 		{
-			async_dynamic_contact_all();
-
-			m_dynamic_contact_timer.expires_from_now(DYNAMIC_CONTACT_PERIOD);
-			m_dynamic_contact_timer.async_wait(boost::bind(&core::do_handle_periodic_dynamic_contact, this, boost::asio::placeholders::error));
+			// A few bytes per peer per period: the peers compare the digest against the state they hold and request exactly one full set when they diverged, so the full announcements themselves can stay rare.
+			async_send_routes_digest_to_all(*m_local_routes_version, routes_message::compute_checksum(m_local_routes));
+		}
+		else
+		{
+			// Nothing is advertised yet, so there is no digest to send: keep polling the peers for their sets, as before.
+			async_send_routes_request_to_all();
 		}
 	}
 
-	void core::do_handle_periodic_routes_request(const boost::system::error_code& ec)
+	bool core::is_busy() const
 	{
-		if (ec != boost::asio::error::operation_aborted)
+		if (!m_fscp_server)
 		{
-			async_send_routes_request_to_all();
-
-			m_routes_request_timer.expires_from_now(ROUTES_REQUEST_PERIOD);
-			m_routes_request_timer.async_wait(boost::bind(&core::do_handle_periodic_routes_request, this, boost::asio::placeholders::error));
+			return false;
 		}
+
+		// The datapath strands drain within microseconds when idle: any pending handler - or bytes waiting in the kernel receive queues - means traffic is being forwarded right now.
+		const fscp::server::queue_statistics_type queue_statistics = m_fscp_server->get_queue_statistics();
+
+		return ((queue_statistics.socket_strand_pending + queue_statistics.data_strand_pending + queue_statistics.write_queue_strand_pending + queue_statistics.crypto_strands_pending) > 0) || (queue_statistics.socket_receive_queue_bytes > 0);
 	}
 
 	void core::do_handle_send_contact_request(const ep_type& target, const boost::system::error_code& ec)
@@ -926,6 +1740,28 @@ namespace freelan
 		}
 	}
 
+	void core::do_handle_send_routes_delta_to_all(const std::map<ep_type, boost::system::error_code>& results)
+	{
+		for (std::map<ep_type, boost::system::error_code>::const_iterator result = results.begin(); result != results.end(); ++result)
+		{
+			if (result->second)
+			{
+				m_logger(fscp::log_level::warning) << "Error sending routes delta to " << result->first << ": " << result->second.message();
+			}
+		}
+	}
+
+	void core::do_handle_send_routes_digest_to_all(const std::map<ep_type, boost::system::error_code>& results)
+	{
+		for (std::map<ep_type, boost::system::error_code>::const_iterator result = results.begin(); result != results.end(); ++result)
+		{
+			if (result->second)
+			{
+				m_logger(fscp::log_level::warning) << "Error sending routes digest to " << result->first << ": " << result->second.message();
+			}
+		}
+	}
+
 	bool core::do_handle_hello_received(const ep_type& sender, bool default_accept)
 	{
 		m_logger(fscp::log_level::debug) << "Received HELLO_REQUEST from " << sender << ".";
@@ -939,6 +1775,8 @@ namespace freelan
 
 		if (default_accept)
 		{
+			m_establishment_history.presentation_sent(sender);
+
 			async_introduce_to(sender);
 		}
 
@@ -1007,6 +1845,12 @@ namespace freelan
 
 		m_logger(fscp::log_level::information) << "Accepting PRESENTATION from " << sender << " (" << sig_cert.subject() << "): " << status << ".";
 
+		{
+			boost::mutex::scoped_lock lock(m_peer_state_mutex);
+
+			m_peer_state_map[sender] = sig_cert;
+		}
+
 		async_request_session(sender);
 
 		return true;
@@ -1043,6 +1887,8 @@ namespace freelan
 	bool core::do_handle_session_received(const ep_type& sender, fscp::cipher_suite_type cs, fscp::elliptic_curve_type ec, bool default_accept)
 	{
 		m_logger(fscp::log_level::debug) << "Received SESSION from " << sender << " (default: " << (default_accept ? std::string("accept") : std::string("deny")) << ").";
+
+		m_establishment_history.session_received(sender);
 		m_logger(fscp::log_level::debug) << "Cipher suite: " << cs;
 		m_logger(fscp::log_level::debug) << "Elliptic curve: " << ec;
 
@@ -1054,6 +1900,8 @@ namespace freelan
 		if (is_new)
 		{
 			m_logger(fscp::log_level::warning) << "Session establishment with " << host << " failed.";
+
+			m_establishment_history.session_failed(host);
 		}
 		else
 		{
@@ -1088,6 +1936,8 @@ namespace freelan
 		if (is_new)
 		{
 			m_logger(fscp::log_level::important) << "Session established with " << host << ".";
+
+			m_establishment_history.session_established(host);
 		}
 		else
 		{
@@ -1105,6 +1955,9 @@ namespace freelan
 			}
 			else
 			{
+				// Announcing our capabilities first lets the peer answer the request below with the compact format.
+				async_send_routes_caps(host);
+
 				// We register the router port without any routes, at first.
 				async_register_router_port(host, boost::bind(&core::async_send_routes_request, this, host));
 			}
@@ -1138,29 +1991,65 @@ namespace freelan
 		}
 
 		async_clear_client_router_info(host, void_handler_type());
+
+		{
+			boost::mutex::scoped_lock lock(m_path_mtu_mutex);
+
+			m_path_mtu_map.erase(host);
+		}
+	}
+
+	void core::do_handle_path_mtu_changed(const ep_type& host, size_t path_mtu)
+	{
+		m_logger(fscp::log_level::information) << "The path to " << host << " delivers payloads of up to " << path_mtu << " byte(s).";
+
+		boost::mutex::scoped_lock lock(m_path_mtu_mutex);
+
+		m_path_mtu_map[host] = path_mtu;
 	}
 
 	void core::do_handle_data_received(const ep_type& sender, fscp::channel_number_type channel_number, fscp::SharedBuffer buffer, boost::asio::const_buffer data)
 	{
 		switch (channel_number)
 		{
-			// Channel 0 contains ethernet/ip frames
+			// Channels 0 and 3 to 6 contain ethernet/ip frames: 3 to 6 carry the QoS-classed frames of peers with a DSCP mapping.
+			case fscp::CHANNEL_NUMBER_3:
+			case fscp::CHANNEL_NUMBER_4:
+			case fscp::CHANNEL_NUMBER_5:
+			case fscp::CHANNEL_NUMBER_6:
 			case fscp::CHANNEL_NUMBER_0:
+				m_capture_ring.capture(capture_ring::STAGE_POST_DECRYPT, buffer_cast<const uint8_t*>(data), buffer_size(data));
+
+				if (!m_rate_limiter.account(rate_limiter::DIRECTION_IN, ENDPOINTS_GROUP, sender, buffer_size(data)))
+				{
+					// The peer pushed past its limits: the frame is dropped and counted in the limiter statistics.
+					break;
+				}
+
 				if (m_configuration.tap_adapter.type == tap_adapter_configuration::tap_adapter_type::tap)
 				{
+					const uint64_t trace_start = fscp::latency_trace::sample_start();
+					switch_::multi_write_handler_type write_handler;
+
+					if (trace_start != 0)
+					{
+						write_handler = [this, trace_start](const switch_::multi_write_result_type&) {
+							fscp::latency_trace::record(m_trace_receive_histogram, trace_start);
+						};
+					}
+
 					async_write_switch(
 						make_port_index(sender),
+						buffer,
 						data,
-						make_shared_buffer_handler(
-							buffer,
-							&null_switch_write_handler
-						)
+						write_handler
 					);
 				}
 				else
 				{
 					async_write_router(
 						make_port_index(sender),
+						buffer,
 						data,
 						make_shared_buffer_handler(
 							buffer,
@@ -1183,6 +2072,11 @@ namespace freelan
 					m_logger(fscp::log_level::warning) << "Received incorrectly formatted message from " << sender << ". Error was: " << ex.what();
 				}
 
+				break;
+			// Channel 2 carries the link measurement probes
+			case fscp::CHANNEL_NUMBER_2:
+				do_handle_probe_data(sender, buffer, data);
+
 				break;
 			default:
 				m_logger(fscp::log_level::warning) << "Received unhandled " << buffer_size(data) << " byte(s) of data on FSCP channel #" << static_cast<int>(channel_number);
@@ -1204,6 +2098,7 @@ namespace freelan
 				}
 
 			case message::MT_ROUTES:
+			case message::MT_ROUTES_COMPACT:
 				{
 					routes_message r_msg(msg);
 
@@ -1212,6 +2107,33 @@ namespace freelan
 					break;
 				}
 
+			case message::MT_ROUTES_DELTA:
+				{
+					routes_message rd_msg(msg);
+
+					async_handle_routes_delta(sender, rd_msg);
+
+					break;
+				}
+
+			case message::MT_ROUTES_DIGEST:
+				{
+					routes_message rg_msg(msg);
+
+					async_handle_routes_digest(sender, rg_msg);
+
+					break;
+				}
+
+			case message::MT_ROUTES_CAPS:
+				{
+					routes_caps_message rc_msg(msg);
+
+					async_handle_routes_caps(sender, rc_msg);
+
+					break;
+				}
+
 			default:
 				m_logger(fscp::log_level::warning) << "Received unhandled message of type " << static_cast<int>(msg.type()) << " on the message channel";
 				break;
@@ -1227,6 +2149,9 @@ namespace freelan
 		}
 		else
 		{
+			// The compact form is only used once the peer has announced support for it.
+			const bool compact = m_client_router_info_map[sender].supports_compact;
+
 			if (m_tap_adapter && (m_tap_adapter->layer() == asiotap::tap_adapter_layer::ip))
 			{
 				const auto local_port = m_router.get_port(make_port_index(m_tap_adapter));
@@ -1237,7 +2162,7 @@ namespace freelan
 
 					m_logger(fscp::log_level::debug) << "Received routes request from " << sender << ". Replying with version " << *m_local_routes_version << ": " << routes;
 
-					async_send_routes(sender, *m_local_routes_version, routes, &null_simple_write_handler);
+					async_send_routes(sender, *m_local_routes_version, routes, compact, &null_simple_write_handler);
 				}
 				else
 				{
@@ -1251,15 +2176,32 @@ namespace freelan
 
 				m_logger(fscp::log_level::debug) << "Received routes request from " << sender << ". Replying with version " << version << ": " << routes;
 
-				async_send_routes(sender, version, routes, &null_simple_write_handler);
+				async_send_routes(sender, version, routes, compact, &null_simple_write_handler);
 			}
 		}
 	}
 
+	void core::do_handle_routes_caps(const ep_type& sender, uint8_t flags)
+	{
+		// All calls to do_handle_routes_caps() are done within the m_router_strand, so the following is safe.
+		if (flags & routes_caps_message::FLAG_COMPACT_ROUTES)
+		{
+			m_client_router_info_map[sender].supports_compact = true;
+		}
+
+		if (flags & routes_caps_message::FLAG_QOS_CHANNELS)
+		{
+			m_client_router_info_map[sender].supports_qos_channels = true;
+		}
+	}
+
 	void core::do_handle_routes(const asiotap::ip_network_address_list& tap_addresses, const ep_type& sender, routes_message::version_type version, const asiotap::ip_route_set& routes)
 	{
 		// All calls to do_handle_routes() are done within the m_router_strand, so the following is safe.
 
+		// Routes messages from long-established peers find no pending timeline: this only completes fresh establishments.
+		m_establishment_history.routes_received(sender);
+
 		client_router_info_type& client_router_info = m_client_router_info_map[sender];
 
 		if (!client_router_info.is_older_than(version))
@@ -1289,7 +2231,7 @@ namespace freelan
 
 			const auto port = m_router.get_port(make_port_index(sender));
 
-			filtered_routes = filter_routes(routes, m_configuration.router.internal_route_acceptance_policy, m_configuration.router.maximum_routes_limit, tap_addresses);
+			filtered_routes = route_scope_filter::compile(m_configuration.router.internal_route_acceptance_policy, m_configuration.router.maximum_routes_limit, tap_addresses).apply(routes);
 
 			if (filtered_routes != routes)
 			{
@@ -1332,20 +2274,18 @@ namespace freelan
 		}
 
 		// Silently filter out routes that are already covered by the default interface routing table entries (aka. routes that belong to the interface's network).
-		asiotap::ip_route_set filtered_system_routes;
+		asiotap::compact_ip_network_address_list compact_tap_addresses;
+		compact_tap_addresses.reserve(tap_addresses.size());
 
 		for (auto&& ina: tap_addresses)
 		{
-			for (auto&& route : filtered_routes)
-			{
-				if (!has_network(ina, network_address(route)))
-				{
-					filtered_system_routes.insert(route);
-				}
-			}
+			compact_tap_addresses.push_back(asiotap::to_compact(ina));
 		}
 
-		const auto system_routes = filter_routes(filtered_system_routes, m_configuration.router.system_route_acceptance_policy, m_configuration.router.maximum_routes_limit);
+		// One merge pass over the sorted routes, without any visitor dispatch. A route is excluded as soon as any interface address covers it.
+		const asiotap::ip_route_set filtered_system_routes = asiotap::from_compact(asiotap::not_covered_by(asiotap::to_compact(filtered_routes), compact_tap_addresses));
+
+		const auto system_routes = route_scope_filter::compile(m_configuration.router.system_route_acceptance_policy, m_configuration.router.maximum_routes_limit).apply(filtered_system_routes);
 
 		if (system_routes != filtered_system_routes)
 		{
@@ -1366,16 +2306,131 @@ namespace freelan
 
 		client_router_info_type new_client_router_info;
 		new_client_router_info.saved_system_route = client_router_info.saved_system_route;
-		new_client_router_info.version = client_router_info.version;
+		new_client_router_info.version = version;
+		new_client_router_info.advertised_routes = routes;
+		new_client_router_info.checksum = routes_message::compute_checksum(routes);
+
+		// The routes are applied as one batched transaction, which keeps the convergence time flat even when a gateway advertises thousands of them.
+		std::vector<asiotap::route_manager::route_type> system_routes_to_apply;
+		system_routes_to_apply.reserve(filtered_system_routes.size());
 
 		for (auto&& route : filtered_system_routes)
 		{
-			new_client_router_info.system_route_entries.push_back(m_route_manager.get_route_entry(m_tap_adapter->get_route(route)));
+			system_routes_to_apply.push_back(m_tap_adapter->get_route(route));
 		}
 
+		for (auto&& entry : m_route_manager.get_route_entries(system_routes_to_apply))
+		{
+			new_client_router_info.system_route_entries.push_back(entry);
+		}
+
+		// The routes that are no longer needed are unregistered as one batch; the ones shared with the new set stay referenced and are left alone.
+		m_route_manager.release_route_entries(client_router_info.system_route_entries);
+
 		client_router_info = new_client_router_info;
 	}
 
+	void core::do_handle_routes_delta(const asiotap::ip_network_address_list& tap_addresses, const ep_type& sender, routes_message::version_type version, routes_message::checksum_type checksum, const asiotap::ip_route_set& added, const asiotap::ip_route_set& removed)
+	{
+		// All calls to do_handle_routes_delta() are done within the m_router_strand, so the following is safe.
+		client_router_info_type& client_router_info = m_client_router_info_map[sender];
+
+		if (!client_router_info.version || (*client_router_info.version + 1 != version))
+		{
+			// A delta can only be applied right on top of the version we know: anything else means we missed an update.
+			m_logger(fscp::log_level::information) << "Received routes delta version " << version << " from " << sender << " but it does not follow the known state: requesting a full set.";
+
+			async_send_routes_request(sender);
+
+			return;
+		}
+
+		asiotap::ip_route_set routes = client_router_info.advertised_routes;
+
+		for (auto&& route : removed)
+		{
+			routes.erase(route);
+		}
+
+		for (auto&& route : added)
+		{
+			routes.insert(route);
+		}
+
+		if (routes_message::compute_checksum(routes) != checksum)
+		{
+			m_logger(fscp::log_level::warning) << "Routes delta version " << version << " from " << sender << " does not match its announced checksum: requesting a full set.";
+
+			async_send_routes_request(sender);
+
+			return;
+		}
+
+		// The reconstructed set goes through the exact same acceptance pipeline as a full routes message.
+		do_handle_routes(tap_addresses, sender, version, routes);
+	}
+
+	void core::do_handle_routes_digest(const ep_type& sender, routes_message::version_type version, routes_message::checksum_type checksum)
+	{
+		// All calls to do_handle_routes_digest() are done within the m_router_strand, so the following is safe.
+		client_router_info_type& client_router_info = m_client_router_info_map[sender];
+
+		if (client_router_info.version && (*client_router_info.version == version) && client_router_info.checksum && (*client_router_info.checksum == checksum))
+		{
+			// The digest matches the state we hold: nothing to do.
+			return;
+		}
+
+		if (client_router_info.resync_requested_version && (*client_router_info.resync_requested_version == version))
+		{
+			// The full set for this exact version was already requested: wait for it instead of asking again on every digest.
+			return;
+		}
+
+		client_router_info.resync_requested_version = version;
+
+		m_logger(fscp::log_level::information) << "Routes digest from " << sender << " (version " << version << ") does not match the state we hold: requesting a full set.";
+
+		async_send_routes_request(sender);
+	}
+
+	void core::do_update_local_routes(const asiotap::ip_route_set& routes)
+	{
+		// All calls to do_update_local_routes() are done within the m_router_strand, so the following is safe.
+		if (!m_tap_adapter || !m_local_routes_version.is_initialized())
+		{
+			m_logger(fscp::log_level::debug) << "Ignoring local routes update as no routes are currently advertised.";
+
+			return;
+		}
+
+		if (routes == m_local_routes)
+		{
+			return;
+		}
+
+		asiotap::ip_route_set added;
+		asiotap::ip_route_set removed;
+
+		std::set_difference(routes.begin(), routes.end(), m_local_routes.begin(), m_local_routes.end(), std::inserter(added, added.end()));
+		std::set_difference(m_local_routes.begin(), m_local_routes.end(), routes.begin(), routes.end(), std::inserter(removed, removed.end()));
+
+		m_local_routes = routes;
+		*m_local_routes_version += 1;
+
+		const auto port = m_router.get_port(make_port_index(m_tap_adapter));
+
+		if (port)
+		{
+			port->set_local_routes(routes);
+		}
+
+		m_logger(fscp::log_level::information) << "Local routes updated to version " << *m_local_routes_version << " (added: " << added << ", removed: " << removed << ").";
+
+		// Only the difference goes on the wire; peers that miss it fall back to a full routes request.
+		async_send_routes_delta_to_all(*m_local_routes_version, routes_message::compute_checksum(routes), added, removed);
+	}
+
 	int core::certificate_validation_callback(int ok, X509_STORE_CTX* ctx)
 	{
 		cryptoplus::x509::store_context store_context(ctx);
@@ -1387,58 +2442,131 @@ namespace freelan
 
 	void core::build_ca_store(build_ca_store_when condition)
 	{
-		// We can't easily ensure m_ca_store is used only in one strand, so we protect it with a mutex instead.
-		boost::mutex::scoped_lock lock(m_ca_store_mutex);
+		// The inputs are snapshotted under the mutex and the store is built aside:
+		// concurrent verifications keep using the previous store until the swap at
+		// the end, so a rebuild - CRL parsing included - never stalls a handshake
+		// or a certificate rotation.
+		cert_list_type certificates;
+		security_configuration::crl_list_type crls;
+		security_configuration::certificate_revocation_validation_method_type revocation_validation_method = security_configuration::CRVM_NONE;
+
+		{
+			// We can't easily ensure m_ca_store is used only in one strand, so we protect it with a mutex instead.
+			boost::mutex::scoped_lock lock(m_ca_store_mutex);
+
+			if (!!m_ca_store)
+			{
+				if (condition == build_ca_store_when::it_doesnt_exist)
+				{
+					return;
+				}
+
+				m_logger(fscp::log_level::information) << "Rebuilding CA store...";
+			}
+			else
+			{
+				m_logger(fscp::log_level::information) << "Building CA store...";
+			}
+
+			certificates = m_configuration.security.certificate_authority_list;
+			certificates.insert(certificates.end(), m_client_certificate_authority_list.begin(), m_client_certificate_authority_list.end());
+			crls = m_configuration.security.certificate_revocation_list_list;
+			revocation_validation_method = m_configuration.security.certificate_revocation_validation_method;
+		}
+
+		cryptoplus::x509::store new_store = cryptoplus::x509::store::create();
+
+		for (const cert_type& cert : certificates)
+		{
+			new_store.add_certificate(cert);
+		}
+
+		for (const crl_type& crl : crls)
+		{
+			new_store.add_certificate_revocation_list(crl);
+		}
 
-		if (!!m_ca_store)
+		switch (revocation_validation_method)
 		{
-			if (condition == build_ca_store_when::it_doesnt_exist)
+			case security_configuration::CRVM_LAST:
+				{
+					new_store.set_verification_flags(X509_V_FLAG_CRL_CHECK);
+					break;
+				}
+			case security_configuration::CRVM_ALL:
+				{
+					new_store.set_verification_flags(X509_V_FLAG_CRL_CHECK | X509_V_FLAG_CRL_CHECK_ALL);
+					break;
+				}
+			case security_configuration::CRVM_NONE:
+				{
+					break;
+				}
+		}
+
+		// The revoked serial numbers are parsed once here, into a sorted index: the verification path then answers "is this serial revoked?" with a binary search instead of re-walking multi-megabyte CRLs during handshake storms.
+		if (revocation_validation_method != security_configuration::CRVM_NONE)
+		{
+			const boost::shared_ptr<cryptoplus::x509::revocation_index> revocation_index = boost::make_shared<cryptoplus::x509::revocation_index>();
+
+			for (const crl_type& crl : crls)
 			{
-				return;
+				revocation_index->add(crl);
 			}
 
-			m_logger(fscp::log_level::information) << "Rebuilding CA store...";
+			revocation_index->seal();
+
+			boost::atomic_store(&m_revocation_index, boost::shared_ptr<const cryptoplus::x509::revocation_index>(revocation_index));
 		}
 		else
 		{
-			m_logger(fscp::log_level::information) << "Building CA store...";
+			boost::atomic_store(&m_revocation_index, boost::shared_ptr<const cryptoplus::x509::revocation_index>());
 		}
 
-		m_ca_store = cryptoplus::x509::store::create();
-
-		for (const cert_type& cert : m_configuration.security.certificate_authority_list)
 		{
-			m_ca_store.add_certificate(cert);
-		}
+			boost::mutex::scoped_lock lock(m_ca_store_mutex);
 
-		for (const cert_type& cert : m_client_certificate_authority_list)
-		{
-			m_ca_store.add_certificate(cert);
+			m_ca_store = new_store;
+
+			// The cached verdicts were issued against the previous store.
+			m_certificate_verification_cache.clear();
 		}
+	}
+
+	void core::refresh_certificate_revocation_lists()
+	{
+		security_configuration::crl_list_type crl_list;
 
-		for (const crl_type& crl : m_configuration.security.certificate_revocation_list_list)
+		for (const boost::filesystem::path& crl_file : m_configuration.security.certificate_revocation_list_files)
 		{
-			m_ca_store.add_certificate_revocation_list(crl);
+			try
+			{
+				const cryptoplus::file crl_file_handle = cryptoplus::file::open(crl_file.native());
+
+				crl_list.push_back(crl_type::from_certificate_revocation_list(crl_file_handle));
+			}
+			catch (const std::exception& ex)
+			{
+				m_logger(fscp::log_level::warning) << "Unable to reload the certificate revocation list at \"" << crl_file.string() << "\": " << ex.what() << ". Keeping the current lists.";
+
+				return;
+			}
 		}
 
-		switch (m_configuration.security.certificate_revocation_validation_method)
 		{
-			case security_configuration::CRVM_LAST:
-				{
-					m_ca_store.set_verification_flags(X509_V_FLAG_CRL_CHECK);
-					break;
-				}
-			case security_configuration::CRVM_ALL:
-				{
-					m_ca_store.set_verification_flags(X509_V_FLAG_CRL_CHECK | X509_V_FLAG_CRL_CHECK_ALL);
-					break;
-				}
-			case security_configuration::CRVM_NONE:
-				{
-					break;
-				}
+			// build_ca_store() reads the list under the same mutex.
+			boost::mutex::scoped_lock lock(m_ca_store_mutex);
+
+			m_configuration.security.certificate_revocation_list_list = crl_list;
 		}
+
+		build_ca_store(build_ca_store_when::always);
+
+		const boost::shared_ptr<const cryptoplus::x509::revocation_index> revocation_index = boost::atomic_load(&m_revocation_index);
+
+		m_logger(fscp::log_level::information) << "Certificate revocation lists refreshed (" << (revocation_index ? revocation_index->size() : 0) << " serial numbers indexed).";
 	}
+
 	bool core::certificate_validation_method(bool ok, cryptoplus::x509::store_context store_context)
 	{
 		cert_type cert = store_context.get_current_certificate();
@@ -1463,6 +2591,31 @@ namespace freelan
 				{
 					using namespace cryptoplus;
 
+					// Revoked certificates are rejected from the serial index before anything else: the index was built when the CA store was, so the CRLs are never parsed on the verification path.
+					const boost::shared_ptr<const x509::revocation_index> revocation_index = boost::atomic_load(&m_revocation_index);
+
+					if (revocation_index && revocation_index->is_revoked(cert))
+					{
+						m_logger(fscp::log_level::warning) << "Rejecting " << cert.subject() << ": its serial number is revoked.";
+
+						m_certificate_verification_cache.put(cert, false);
+
+						return false;
+					}
+
+					// A certificate that went through the full chain walk recently keeps its verdict until the cache entry expires or the CA store is rebuilt.
+					const boost::optional<bool> cached_verdict = m_certificate_verification_cache.get(cert);
+
+					if (cached_verdict)
+					{
+						if (!*cached_verdict)
+						{
+							return false;
+						}
+
+						break;
+					}
+
 					// We can't easily ensure m_ca_store is used only in one strand, so we protect it with a mutex instead.
 					boost::mutex::scoped_lock lock(m_ca_store_mutex);
 
@@ -1479,9 +2632,13 @@ namespace freelan
 
 					if (!store_context.verify())
 					{
+						m_certificate_verification_cache.put(cert, false);
+
 						return false;
 					}
 
+					m_certificate_verification_cache.put(cert, true);
+
 					break;
 				}
 			case security_configuration::CVM_NONE:
@@ -1504,16 +2661,61 @@ namespace freelan
 		{
 			const asiotap::tap_adapter_layer tap_adapter_type = (m_configuration.tap_adapter.type == tap_adapter_configuration::tap_adapter_type::tap) ? asiotap::tap_adapter_layer::ethernet : asiotap::tap_adapter_layer::ip;
 
-			m_tap_adapter = boost::make_shared<asiotap::tap_adapter>(boost::ref(m_io_service), tap_adapter_type);
+			if (m_configuration.tap_adapter.dedicated_io_thread)
+			{
+				// The device gets its own reactor thread: a crypto-heavy burst on the worker pool can no longer delay the device reads, so its queue stops dropping frames. The strand handoffs between the two io_services act as the queues between the threads.
+				m_tap_io_service.reset();
+				m_tap_io_work.reset(new boost::asio::io_service::work(m_tap_io_service));
+				m_tap_io_thread = boost::thread(boost::bind(&boost::asio::io_service::run, &m_tap_io_service));
+			}
+
+			boost::asio::io_service& tap_io_service = m_configuration.tap_adapter.dedicated_io_thread ? m_tap_io_service : m_io_service;
+
+			m_tap_adapter = boost::make_shared<asiotap::tap_adapter>(boost::ref(tap_io_service), tap_adapter_type);
+
+			const auto write_func = [this] (SharedBuffer, boost::asio::const_buffer data, simple_handler_type handler) {
+				m_capture_ring.capture(capture_ring::STAGE_TAP_OUT, buffer_cast<const uint8_t*>(data), buffer_size(data));
 
-			const auto write_func = [this] (boost::asio::const_buffer data, simple_handler_type handler) {
 				async_write_tap(buffer(data), [handler](const boost::system::error_code& ec, size_t) {
 					handler(ec);
 				});
 			};
 
+			// Offload negotiation must happen before the device is opened.
+			m_tap_adapter->set_offload_enabled(m_configuration.tap_adapter.offload);
+
+			// So must the queue count.
+			m_tap_adapter->set_queue_count(m_configuration.tap_adapter.queue_count);
+
 			m_tap_adapter->open(m_configuration.tap_adapter.name);
 
+			if (m_tap_adapter->queue_count() > 1)
+			{
+				m_logger(fscp::log_level::information) << "Tap adapter opened with " << m_tap_adapter->queue_count() << " queues.";
+			}
+			else if (m_configuration.tap_adapter.queue_count > 1)
+			{
+				m_logger(fscp::log_level::warning) << "Multi-queue was requested but is not supported here: the tap adapter runs with a single queue.";
+			}
+
+			m_tap_vnet_header_length = m_tap_adapter->vnet_header_length();
+
+			if (m_configuration.tap_adapter.offload)
+			{
+				if (m_tap_vnet_header_length > 0)
+				{
+					m_logger(fscp::log_level::important) << "Segmentation offload negotiated: frames carry a " << m_tap_vnet_header_length << " byte(s) virtio-net header. All the nodes of the network must have tap_adapter.offload enabled.";
+				}
+				else
+				{
+					m_logger(fscp::log_level::warning) << "Segmentation offload was requested but could not be negotiated: falling back to regular frames.";
+				}
+			}
+
+			// The routing decisions have to skip the virtio-net header, if any.
+			m_switch.set_parse_offset(m_tap_vnet_header_length);
+			m_router.set_parse_offset(m_tap_vnet_header_length);
+
 			asiotap::tap_adapter_configuration tap_config;
 
 			// The device MTU.
@@ -1643,6 +2845,7 @@ namespace freelan
 				}
 
 				m_local_routes_version = routes_message::version_type();
+				m_local_routes = local_routes;
 				m_router.get_port(make_port_index(m_tap_adapter))->set_local_routes(local_routes);
 
 				if (local_routes.empty())
@@ -1664,7 +2867,16 @@ namespace freelan
 				m_tap_adapter_up_callback(*m_tap_adapter);
 			}
 
-			async_read_tap();
+			// Keep several reads pending on each queue so the driver can hand us frames back-to-back during bursts, and so each queue has its own read loop.
+			const size_t read_ring_size = std::max<size_t>(m_configuration.tap_adapter.read_ring_size, 1);
+
+			for (size_t queue = 0; queue < m_tap_adapter->queue_count(); ++queue)
+			{
+				for (size_t i = 0; i < read_ring_size; ++i)
+				{
+					async_read_tap(queue);
+				}
+			}
 		}
 		else
 		{
@@ -1676,6 +2888,10 @@ namespace freelan
 	{
 		// Clear the endpoint routes, if any.
 		m_router_strand.post([this](){
+			m_client_router_info_map.for_each([this](const ep_type&, client_router_info_type& client_router_info){
+				m_route_manager.release_route_entries(client_router_info.system_route_entries);
+			});
+
 			m_client_router_info_map.clear();
 		});
 
@@ -1684,6 +2900,13 @@ namespace freelan
 
 		if (m_tap_adapter)
 		{
+			const size_t dropped_frame_count = m_tap_adapter->get_dropped_frame_count();
+
+			if (dropped_frame_count > 0)
+			{
+				m_logger(fscp::log_level::important) << "The device dropped " << dropped_frame_count << " frame(s) on " << m_tap_adapter->name() << " because reads could not keep up.";
+			}
+
 			if (m_tap_adapter_down_callback)
 			{
 				m_tap_adapter_down_callback(*m_tap_adapter);
@@ -1699,6 +2922,13 @@ namespace freelan
 
 			m_tap_adapter->close();
 		}
+
+		if (m_configuration.tap_adapter.dedicated_io_thread && m_tap_io_work)
+		{
+			// Dropping the work object lets the device reactor drain its remaining handlers and return.
+			m_tap_io_work.reset();
+			m_tap_io_thread.join();
+		}
 	}
 
 	void core::async_get_tap_addresses(ip_network_address_list_handler_type handler)
@@ -1715,47 +2945,78 @@ namespace freelan
 		}
 	}
 
-	void core::async_read_tap()
+	void core::async_read_tap(size_t queue)
 	{
-		m_tap_adapter_strand.post(boost::bind(&core::do_read_tap, this));
+		m_tap_adapter_strand.post(boost::bind(&core::do_read_tap, this, queue));
 	}
 
 	void core::push_tap_write(void_handler_type handler)
 	{
-		// All push_write() calls are done in the same strand so the following is thread-safe.
-		if (m_tap_write_queue.empty())
+		// All push_tap_write() calls are done in the same strand so the following is thread-safe.
+		m_tap_write_queue.push(handler);
+
+		m_tap_frames_out_counter.increment();
+		m_tap_write_queue_depth_histogram.record(m_tap_write_queue.size());
+
+		if (m_tap_write_queue.size() == 1)
 		{
-			// Nothing is being written, lets start the write immediately.
-			m_tap_adapter_strand.post(make_causal_handler(handler, m_tap_write_queue_strand.wrap(boost::bind(&core::pop_tap_write, this))));
+			// No flush is scheduled yet: schedule one. It is posted behind the writes already
+			// queued in this strand, so every frame of the current burst lands in the same batch.
+			m_tap_write_queue_strand.post(boost::bind(&core::flush_tap_writes, this));
 		}
-
-		m_tap_write_queue.push(handler);
 	}
 
-	void core::pop_tap_write()
+	void core::flush_tap_writes()
 	{
-		// All pop_write() calls are done in the same strand so the following is thread-safe.
-		m_tap_write_queue.pop();
+		// All flush_tap_writes() calls are done in the same strand so the following is thread-safe.
+		const auto batch = boost::make_shared<std::vector<void_handler_type> >();
 
-		if (!m_tap_write_queue.empty())
+		batch->reserve(m_tap_write_queue.size());
+
+		while (!m_tap_write_queue.empty())
 		{
-			m_tap_adapter_strand.post(make_causal_handler(m_tap_write_queue.front(), m_tap_write_queue_strand.wrap(boost::bind(&core::pop_tap_write, this))));
+			batch->push_back(m_tap_write_queue.front());
+
+			m_tap_write_queue.pop();
 		}
+
+		// The whole burst is handed to the descriptor in one dispatch: the operations are queued
+		// back-to-back and performed in a single event loop iteration instead of paying a strand
+		// round-trip per frame. A single vectored write cannot be used here as tap devices treat
+		// each write as exactly one frame, whatever the buffer count.
+		m_tap_adapter_strand.post([this, batch](){
+			for (auto&& write_call : *batch)
+			{
+				write_call();
+			}
+		});
 	}
 
-	void core::do_read_tap()
+	void core::do_read_tap(size_t queue)
 	{
 		// All calls to do_read_tap() are done within the m_tap_adapter_strand, so the following is safe.
 		assert(m_tap_adapter);
 
-		const auto receive_buffer = SharedBuffer(65536);
+		if (m_congested_peer_count > 0)
+		{
+			// Some destination cannot keep up: the reads resume from do_handle_peer_congestion() once the congestion clears.
+			m_deferred_tap_reads.push_back(queue);
+
+			return;
+		}
 
-		m_tap_adapter->async_read(
-			buffer(receive_buffer),
-			m_proxies_strand.wrap(
+		// The buffer is sized from the device MTU rather than the worst case, so the pool serves small buffers on standard deployments while jumbo MTU devices still get full-sized frames.
+		const auto receive_buffer = SharedBuffer(fscp::data_message::DATA_PAYLOAD_OFFSET + m_tap_adapter->recommended_frame_size());
+
+		// The frame is read past the FSCP data message header offset, so that single-target sends can build the datagram in place around it, without a copy.
+		m_tap_adapter->async_read_queue(
+			queue,
+			boost::asio::buffer(buffer(receive_buffer) + fscp::data_message::DATA_PAYLOAD_OFFSET),
+			m_tap_adapter_strand.wrap(
 				boost::bind(
 					&core::do_handle_tap_adapter_read,
 					this,
+					queue,
 					receive_buffer,
 					boost::asio::placeholders::error,
 					boost::asio::placeholders::bytes_transferred
@@ -1764,18 +3025,35 @@ namespace freelan
 		);
 	}
 
-	void core::do_handle_tap_adapter_read(SharedBuffer receive_buffer, const boost::system::error_code& ec, size_t count)
+	void core::do_handle_tap_adapter_read(size_t queue, SharedBuffer receive_buffer, const boost::system::error_code& ec, size_t count)
 	{
-		// All calls to do_read_tap() are done within the m_proxies_strand, so the following is safe.
+		// All calls to do_handle_tap_adapter_read() are done within the m_tap_adapter_strand, so the following is safe.
 		if (ec != boost::asio::error::operation_aborted)
 		{
-			// We try to read again, as soon as possible.
-			async_read_tap();
+			// The read is re-armed before the frame is processed: with a dedicated I/O thread the device is serviced again immediately, whatever the worker pool is busy with.
+			do_read_tap(queue);
 		}
 
 		if (!ec)
 		{
-			const boost::asio::const_buffer data = buffer(receive_buffer, count);
+			m_tap_frames_in_counter.increment();
+
+			// The frame processing (filters, switch and router lookups, sends) is handed to the worker pool: the SharedBuffer travels with the handler and keeps the frame alive.
+			m_proxies_strand.post(boost::bind(&core::do_process_tap_frame, this, receive_buffer, count));
+		}
+		else if (ec != boost::asio::error::operation_aborted)
+		{
+			m_logger(fscp::log_level::error) << "Read failed on " << m_tap_adapter->name() << ". Error: " << ec.message();
+		}
+	}
+
+	void core::do_process_tap_frame(SharedBuffer receive_buffer, size_t count)
+	{
+		// All calls to do_process_tap_frame() are done within the m_proxies_strand, so the use of the filters below is safe.
+		{
+			const boost::asio::const_buffer data = boost::asio::buffer(buffer(receive_buffer) + fscp::data_message::DATA_PAYLOAD_OFFSET, count);
+
+			m_capture_ring.capture(capture_ring::STAGE_TAP_IN, buffer_cast<const uint8_t*>(data), buffer_size(data));
 
 #ifdef FREELAN_DEBUG
 			std::cerr << "Read " << buffer_size(data) << " byte(s) on " << *m_tap_adapter << std::endl;
@@ -1785,10 +3063,10 @@ namespace freelan
 			{
 				bool handled = false;
 
-				if (m_arp_proxy || m_dhcp_proxy)
+				if ((m_arp_proxy || m_dhcp_proxy) && is_proxy_candidate_frame(data + m_tap_vnet_header_length, static_cast<bool>(m_arp_proxy), static_cast<bool>(m_dhcp_proxy)))
 				{
-					// This line will eventually call the filters callbacks.
-					m_ethernet_filter.parse(data);
+					// This line will eventually call the filters callbacks. The proxies see the frames without the virtio-net header, if any.
+					m_ethernet_filter.parse(data + m_tap_vnet_header_length);
 
 					if (m_arp_proxy && m_arp_filter.get_last_helper())
 					{
@@ -1805,13 +3083,21 @@ namespace freelan
 
 				if (!handled)
 				{
+					const uint64_t trace_start = fscp::latency_trace::sample_start();
+					switch_::multi_write_handler_type write_handler;
+
+					if (trace_start != 0)
+					{
+						write_handler = [this, trace_start](const switch_::multi_write_result_type&) {
+							fscp::latency_trace::record(m_trace_send_tap_histogram, trace_start);
+						};
+					}
+
 					async_write_switch(
 						make_port_index(m_tap_adapter),
+						receive_buffer,
 						data,
-						make_shared_buffer_handler(
-							receive_buffer,
-							&null_switch_write_handler
-						)
+						write_handler
 					);
 				}
 			}
@@ -1820,6 +3106,7 @@ namespace freelan
 				// This is a TUN interface. We receive either IPv4 or IPv6 frames.
 				async_write_router(
 					make_port_index(m_tap_adapter),
+					receive_buffer,
 					data,
 					make_shared_buffer_handler(
 						receive_buffer,
@@ -1828,9 +3115,37 @@ namespace freelan
 				);
 			}
 		}
-		else if (ec != boost::asio::error::operation_aborted)
+	}
+
+	void core::do_handle_peer_congestion(const ep_type& host, bool congested)
+	{
+		// All calls to do_handle_peer_congestion() are done within the m_tap_adapter_strand, so the following is safe.
+		if (congested)
 		{
-			m_logger(fscp::log_level::error) << "Read failed on " << m_tap_adapter->name() << ". Error: " << ec.message();
+			m_congested_peer_count++;
+
+			m_logger(fscp::log_level::debug) << "Pausing TAP adapter reads: sends to " << host << " are congested.";
+		}
+		else if (m_congested_peer_count > 0)
+		{
+			m_congested_peer_count--;
+
+			if ((m_congested_peer_count == 0) && !m_deferred_tap_reads.empty())
+			{
+				std::vector<size_t> deferred;
+
+				deferred.swap(m_deferred_tap_reads);
+
+				m_logger(fscp::log_level::debug) << "Resuming TAP adapter reads: congestion cleared.";
+
+				if (m_tap_adapter)
+				{
+					for (auto&& queue : deferred)
+					{
+						do_read_tap(queue);
+					}
+				}
+			}
 		}
 	}
 
@@ -1853,13 +3168,21 @@ namespace freelan
 			const boost::optional<boost::asio::const_buffer> data = m_arp_proxy->process_frame(
 				*m_arp_filter.parent().get_last_helper(),
 				helper,
-				buffer(response_buffer)
+				buffer(response_buffer) + m_tap_vnet_header_length
 			);
 
 			if (data)
 			{
+				if (m_tap_vnet_header_length > 0)
+				{
+					// The device expects a virtio-net header in front of every frame: an all-zero one means no offload for this frame.
+					std::memset(buffer_cast<void*>(buffer(response_buffer)), 0x00, m_tap_vnet_header_length);
+				}
+
+				const boost::asio::const_buffer response = buffer(response_buffer, m_tap_vnet_header_length + buffer_size(*data));
+
 				async_write_tap(
-					buffer(*data),
+					buffer(response),
 					make_shared_buffer_handler(
 						response_buffer,
 						boost::bind(
@@ -1884,13 +3207,21 @@ namespace freelan
 				*m_dhcp_filter.parent().parent().get_last_helper(),
 				*m_dhcp_filter.parent().get_last_helper(),
 				helper,
-				buffer(response_buffer)
+				buffer(response_buffer) + m_tap_vnet_header_length
 			);
 
 			if (data)
 			{
+				if (m_tap_vnet_header_length > 0)
+				{
+					// The device expects a virtio-net header in front of every frame: an all-zero one means no offload for this frame.
+					std::memset(buffer_cast<void*>(buffer(response_buffer)), 0x00, m_tap_vnet_header_length);
+				}
+
+				const boost::asio::const_buffer response = buffer(response_buffer, m_tap_vnet_header_length + buffer_size(*data));
+
 				async_write_tap(
-					buffer(*data),
+					buffer(response),
 					make_shared_buffer_handler(
 						response_buffer,
 						boost::bind(
@@ -1922,7 +3253,10 @@ namespace freelan
 	void core::do_register_switch_port(const ep_type& host, void_handler_type handler)
 	{
 		// All calls to do_register_switch_port() are done within the m_router_strand, so the following is safe.
-		m_switch.register_port(make_port_index(host), switch_::port_type(boost::bind(&fscp::server::async_send_data, m_fscp_server, host, fscp::CHANNEL_NUMBER_0, _1, _2), ENDPOINTS_GROUP));
+		fscp::metrics_registry::counter& frames_out_counter = fscp::metrics_registry::get_default_instance().get_counter("core.port." + boost::lexical_cast<std::string>(host) + ".frames_out");
+
+		m_rate_limiter.register_peer(host);
+		m_switch.register_port(make_port_index(host), switch_::port_type(boost::bind(&core::do_write_port_data, this, boost::ref(frames_out_counter), host, _1, _2, _3), ENDPOINTS_GROUP));
 
 		if (handler)
 		{
@@ -1934,6 +3268,7 @@ namespace freelan
 	{
 		// All calls to do_unregister_switch_port() are done within the m_router_strand, so the following is safe.
 		m_switch.unregister_port(make_port_index(host));
+		m_rate_limiter.unregister_peer(host);
 
 		if (handler)
 		{
@@ -1944,7 +3279,10 @@ namespace freelan
 	void core::do_register_router_port(const ep_type& host, void_handler_type handler)
 	{
 		// All calls to do_register_router_port() are done within the m_router_strand, so the following is safe.
-		m_router.register_port(make_port_index(host), router::port_type(boost::bind(&fscp::server::async_send_data, m_fscp_server, host, fscp::CHANNEL_NUMBER_0, _1, _2), ENDPOINTS_GROUP));
+		fscp::metrics_registry::counter& frames_out_counter = fscp::metrics_registry::get_default_instance().get_counter("core.port." + boost::lexical_cast<std::string>(host) + ".frames_out");
+
+		m_rate_limiter.register_peer(host);
+		m_router.register_port(make_port_index(host), router::port_type(boost::bind(&core::do_write_port_data, this, boost::ref(frames_out_counter), host, _1, _2, _3), ENDPOINTS_GROUP));
 
 		if (handler)
 		{
@@ -1952,10 +3290,83 @@ namespace freelan
 		}
 	}
 
+	void core::do_write_port_data(fscp::metrics_registry::counter& frames_out_counter, const ep_type& host, fscp::SharedBuffer frame, boost::asio::const_buffer data, fscp::server::simple_handler_type handler)
+	{
+		// The counter reference stays valid for the whole process lifetime, as the registry never discards a metric.
+		frames_out_counter.increment();
+
+		{
+			// A frame larger than the discovered path MTU would be silently blackholed down the path: dropping it here keeps the loss visible in the metrics.
+			boost::mutex::scoped_lock lock(m_path_mtu_mutex);
+
+			const auto path_mtu = m_path_mtu_map.find(host);
+
+			if ((path_mtu != m_path_mtu_map.end()) && (buffer_size(data) > path_mtu->second))
+			{
+				m_oversize_frames_dropped_counter.increment();
+
+				if (handler)
+				{
+					handler(boost::asio::error::message_size);
+				}
+
+				return;
+			}
+		}
+
+		if (!m_rate_limiter.account(rate_limiter::DIRECTION_OUT, ENDPOINTS_GROUP, host, buffer_size(data)))
+		{
+			// The peer pulls past its limits: the frame is dropped and counted in the limiter statistics.
+			if (handler)
+			{
+				handler(boost::asio::error::no_buffer_space);
+			}
+
+			return;
+		}
+
+		m_capture_ring.capture(capture_ring::STAGE_PRE_ENCRYPT, buffer_cast<const uint8_t*>(data), buffer_size(data));
+
+		// All calls to do_write_port_data() are done within the m_router_strand, so looking up the peer capabilities is safe.
+		fscp::channel_number_type channel_number = fscp::CHANNEL_NUMBER_0;
+
+		if (m_dscp_qos_enabled)
+		{
+			// Classed frames travel on a different wire channel: only peers that advertised the capability get them, the others keep receiving everything on the default channel.
+			const client_router_info_type* const client_router_info = m_client_router_info_map.find(host);
+
+			if (client_router_info && client_router_info->supports_qos_channels)
+			{
+				const bool has_ethernet_header = (m_configuration.tap_adapter.type == tap_adapter_configuration::tap_adapter_type::tap);
+
+				channel_number = m_dscp_channel_table[extract_frame_dscp(data, has_ethernet_header, m_tap_vnet_header_length)];
+			}
+		}
+
+		const uint64_t trace_start = fscp::latency_trace::sample_start();
+
+		if (trace_start != 0)
+		{
+			const fscp::server::simple_handler_type original_handler = handler;
+
+			handler = [this, trace_start, original_handler](const boost::system::error_code& handler_ec) {
+				fscp::latency_trace::record(m_trace_send_fscp_histogram, trace_start);
+
+				if (original_handler)
+				{
+					original_handler(handler_ec);
+				}
+			};
+		}
+
+		m_fscp_server->async_send_data_in_place(host, channel_number, frame, data, handler);
+	}
+
 	void core::do_unregister_router_port(const ep_type& host, void_handler_type handler)
 	{
 		// All calls to do_unregister_router_port() are done within the m_router_strand, so the following is safe.
 		m_router.unregister_port(make_port_index(host));
+		m_rate_limiter.unregister_peer(host);
 
 		if (handler)
 		{
@@ -1979,8 +3390,13 @@ namespace freelan
 	{
 		// All calls to do_clear_client_router_info() are done within the m_router_strand, so the following is safe.
 
-		// This clears the routes, if any.
-		m_client_router_info_map.erase(host);
+		// This clears the routes, if any. Releasing the entries first lets the expiring routes be unregistered as one batch. The map node itself is only tombstoned and reclaimed by the next batched sweep of its shard.
+		client_router_info_type client_router_info;
+
+		if (m_client_router_info_map.take(host, client_router_info))
+		{
+			m_route_manager.release_route_entries(client_router_info.system_route_entries);
+		}
 
 		if (handler)
 		{
@@ -1988,16 +3404,10 @@ namespace freelan
 		}
 	}
 
-	void core::do_write_switch(const port_index_type& index, boost::asio::const_buffer data, switch_::multi_write_handler_type handler)
+	void core::do_write_switch(const port_index_type& index, SharedBuffer frame, boost::asio::const_buffer data, switch_::multi_write_handler_type handler)
 	{
 		// All calls to do_write_switch() are done within the m_router_strand, so the following is safe.
-		m_switch.async_write(index, data, handler);
-	}
-
-	void core::do_write_router(const port_index_type& index, boost::asio::const_buffer data, router::port_type::write_handler_type handler)
-	{
-		// All calls to do_write_router() are done within the m_router_strand, so the following is safe.
-		m_router.async_write(index, data, handler);
+		m_switch.async_write(index, frame, data, handler);
 	}
 
 	void core::open_web_server()
@@ -2056,7 +3466,171 @@ namespace freelan
 				}
 			}
 
-			m_web_server = boost::make_shared<web_server>(m_logger, m_configuration.server, m_authentication_callback);
+			// The handler runs on the web server's own thread: it may only call thread-safe accessors.
+			const web_server::statistics_handler_type statistics_handler = [this]() {
+				web_server::statistics_type statistics;
+
+				if (m_fscp_server)
+				{
+					for (auto&& pair : m_fscp_server->get_peer_statistics())
+					{
+						web_server::statistics_peer_entry entry;
+
+						entry.endpoint = boost::lexical_cast<std::string>(pair.first);
+						entry.tx_bytes = pair.second.tx_bytes;
+						entry.tx_packets = pair.second.tx_packets;
+						entry.rx_bytes = pair.second.rx_bytes;
+						entry.rx_packets = pair.second.rx_packets;
+						entry.path_mtu = pair.second.path_mtu;
+						entry.path_rtt_us = pair.second.path_rtt_us;
+						entry.path_loss_percent = pair.second.path_loss_percent;
+
+						statistics.peers.push_back(entry);
+					}
+
+					// A snapshot read: a monitoring scrape storm never posts work into - or blocks on - the session strand.
+				statistics.session_count = m_fscp_server->get_session_endpoints_snapshot().size();
+
+					const fscp::server::queue_statistics_type queue_statistics = m_fscp_server->get_queue_statistics();
+
+					statistics.strand_pending["socket"] = queue_statistics.socket_strand_pending;
+					statistics.strand_pending["write_queue"] = queue_statistics.write_queue_strand_pending;
+					statistics.strand_pending["greet"] = queue_statistics.greet_strand_pending;
+					statistics.strand_pending["presentation"] = queue_statistics.presentation_strand_pending;
+					statistics.strand_pending["session"] = queue_statistics.session_strand_pending;
+					statistics.strand_pending["data"] = queue_statistics.data_strand_pending;
+					statistics.strand_pending["contact"] = queue_statistics.contact_strand_pending;
+					statistics.strand_pending["crypto"] = queue_statistics.crypto_strands_pending;
+					statistics.socket_receive_queue_bytes = queue_statistics.socket_receive_queue_bytes;
+					statistics.socket_receive_buffer_size = queue_statistics.socket_receive_buffer_size;
+					statistics.socket_send_buffer_size = queue_statistics.socket_send_buffer_size;
+					statistics.socket_kernel_drops = queue_statistics.socket_kernel_drops;
+				}
+
+				// The counters are only written from the io_service threads: a torn read here merely yields slightly stale values.
+				statistics.mac_table_size = m_switch.mac_table_size();
+				statistics.mac_table_hits = m_switch.mac_table_statistics().hits;
+				statistics.mac_table_misses = m_switch.mac_table_statistics().misses;
+				statistics.mac_table_evictions = m_switch.mac_table_statistics().evictions;
+
+				const std::time_t statistics_now = std::time(NULL);
+
+				for (auto&& mac_entry : m_switch.mac_table_entries())
+				{
+					web_server::statistics_mac_entry entry;
+
+					entry.address = boost::lexical_cast<std::string>(mac_entry.address);
+					entry.port = boost::lexical_cast<std::string>(mac_entry.port);
+					entry.hits = mac_entry.hits;
+					entry.age_seconds = (statistics_now > mac_entry.last_seen) ? static_cast<uint64_t>(statistics_now - mac_entry.last_seen) : 0;
+
+					statistics.mac_entries.push_back(entry);
+				}
+
+				for (auto&& rate_limit_entry : m_rate_limiter.statistics())
+				{
+					web_server::statistics_rate_limit_entry entry;
+
+					entry.name = rate_limit_entry.name;
+					entry.in_passed_packets = rate_limit_entry.in.passed_packets;
+					entry.in_passed_bytes = rate_limit_entry.in.passed_bytes;
+					entry.in_dropped_packets = rate_limit_entry.in.dropped_packets;
+					entry.in_dropped_bytes = rate_limit_entry.in.dropped_bytes;
+					entry.out_passed_packets = rate_limit_entry.out.passed_packets;
+					entry.out_passed_bytes = rate_limit_entry.out.passed_bytes;
+					entry.out_dropped_packets = rate_limit_entry.out.dropped_packets;
+					entry.out_dropped_bytes = rate_limit_entry.out.dropped_bytes;
+
+					statistics.rate_limit_entries.push_back(entry);
+				}
+
+				return statistics;
+			};
+
+			// The handler runs on the web server's thread and blocks for the duration of the measurement; the io threads keep running underneath.
+			const web_server::measurement_handler_type measurement_handler = [this](const std::string& host, size_t packet_count, size_t packet_size) {
+				web_server::link_measurement_type result;
+
+				if (!m_fscp_server)
+				{
+					result.error = "The FSCP server is not running";
+
+					return result;
+				}
+
+				// The requested host is matched against the established sessions, so only real peers ever get probed.
+				boost::optional<ep_type> target;
+
+				for (auto&& ep : m_fscp_server->get_session_endpoints_snapshot())
+				{
+					if (boost::lexical_cast<std::string>(ep) == host)
+					{
+						target = ep;
+
+						break;
+					}
+				}
+
+				if (!target)
+				{
+					result.error = "No established session with " + host;
+
+					return result;
+				}
+
+				try
+				{
+					const link_measurement_result measurement = measure_link(*target, packet_count, packet_size);
+
+					result.completed = measurement.completed;
+					result.sent = measurement.sent;
+					result.received = measurement.received;
+					result.reordered = measurement.reordered;
+					result.duration_ms = measurement.duration_ms;
+					result.goodput_mbps = measurement.goodput_mbps;
+					result.rtt_min_ms = measurement.rtt_min_ms;
+					result.rtt_median_ms = measurement.rtt_median_ms;
+					result.rtt_p90_ms = measurement.rtt_p90_ms;
+					result.rtt_p99_ms = measurement.rtt_p99_ms;
+					result.rtt_max_ms = measurement.rtt_max_ms;
+				}
+				catch (std::runtime_error& ex)
+				{
+					result.error = ex.what();
+				}
+
+				return result;
+			};
+
+			const web_server::capture_handler_type capture_handler = [this]() {
+				std::vector<capture_ring::frame_type> frames;
+
+				m_capture_ring.drain(frames);
+
+				return frames;
+			};
+
+			const web_server::capture_control_handler_type capture_control_handler = [this](bool enabled) {
+				m_capture_ring.set_enabled(enabled);
+
+				if (!enabled)
+				{
+					return;
+				}
+
+				const size_t dropped = m_capture_ring.dropped();
+
+				if (dropped > 0)
+				{
+					m_logger(fscp::log_level::information) << "Packet capture started. " << dropped << " frame(s) were dropped during previous captures.";
+				}
+			};
+
+			const web_server::establishment_handler_type establishment_handler = [this]() {
+				return m_establishment_history.history();
+			};
+
+			m_web_server = boost::make_shared<web_server>(m_logger, m_configuration.server, m_authentication_callback, statistics_handler, measurement_handler, capture_handler, capture_control_handler, establishment_handler);
 
 			m_logger(fscp::log_level::information) << "Starting " << m_configuration.server.protocol << " web server on " << m_configuration.server.listen_on << "...";
 
@@ -2161,7 +3735,8 @@ namespace freelan
 					open_fscp_server();
 				}
 
-				const auto renew_timestamp = certificate.not_after().to_ptime() - RENEW_CERTIFICATE_WARNING_PERIOD;
+				// Renew somewhere in the first half of the warning period: the jitter de-synchronizes fleet renewals while the remaining half still leaves ample time for retries.
+				const auto renew_timestamp = certificate.not_after().to_ptime() - RENEW_CERTIFICATE_WARNING_PERIOD + renewal_jitter(certificate, RENEW_CERTIFICATE_WARNING_PERIOD / 2);
 
 				m_logger(fscp::log_level::information) << "Certificate expires on " << local_adjustor::utc_to_local(certificate.not_after().to_ptime()) << ". Renewing on " << local_adjustor::utc_to_local(renew_timestamp) << ".";
 
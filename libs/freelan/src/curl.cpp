@@ -72,6 +72,14 @@ namespace freelan
 				throw boost::system::system_error(make_error_code(errorcode));
 			}
 		}
+
+		void throw_if_curlsh_error(CURLSHcode errorcode)
+		{
+			if (errorcode != CURLSHE_OK)
+			{
+				throw std::runtime_error(curl_share_strerror(errorcode));
+			}
+		}
 	}
 
 	curl_list::curl_list() :
@@ -101,6 +109,38 @@ namespace freelan
 		return m_slist.get();
 	}
 
+	curl_share::curl_share() :
+		m_curlsh(curl_share_init(), [] (CURLSH* p) { if (p) curl_share_cleanup(p); })
+	{
+		if (!m_curlsh)
+		{
+			throw std::runtime_error("Unable to allocate a CURLSH structure");
+		}
+
+		throw_if_curlsh_error(curl_share_setopt(m_curlsh.get(), CURLSHOPT_LOCKFUNC, &curl_share::lock_function));
+		throw_if_curlsh_error(curl_share_setopt(m_curlsh.get(), CURLSHOPT_UNLOCKFUNC, &curl_share::unlock_function));
+		throw_if_curlsh_error(curl_share_setopt(m_curlsh.get(), CURLSHOPT_USERDATA, static_cast<void*>(this)));
+
+		enable_share(CURL_LOCK_DATA_COOKIE);
+		enable_share(CURL_LOCK_DATA_DNS);
+		enable_share(CURL_LOCK_DATA_SSL_SESSION);
+	}
+
+	void curl_share::enable_share(curl_lock_data data)
+	{
+		throw_if_curlsh_error(curl_share_setopt(m_curlsh.get(), CURLSHOPT_SHARE, data));
+	}
+
+	void curl_share::lock_function(CURL*, curl_lock_data, curl_lock_access, void* userptr)
+	{
+		static_cast<curl_share*>(userptr)->m_mutex.lock();
+	}
+
+	void curl_share::unlock_function(CURL*, curl_lock_data, void* userptr)
+	{
+		static_cast<curl_share*>(userptr)->m_mutex.unlock();
+	}
+
 	curl::curl() :
 		m_curl(curl_easy_init(), [] (CURL* p) { if (p) curl_easy_cleanup(p); }),
 		m_debug_function()
@@ -230,6 +270,25 @@ namespace freelan
 		set_option(CURLOPT_TIMEOUT_MS, static_cast<long>(timeout.total_milliseconds()));
 	}
 
+	void curl::set_dns_cache_timeout(const boost::posix_time::time_duration& timeout)
+	{
+		set_option(CURLOPT_DNS_CACHE_TIMEOUT, static_cast<long>(timeout.total_seconds()));
+	}
+
+	void curl::add_dns_resolution(const std::string& host, uint16_t port, const std::string& address)
+	{
+		m_dns_resolutions.append(host + ":" + boost::lexical_cast<std::string>(port) + ":" + address);
+
+		set_option(CURLOPT_RESOLVE, static_cast<const void*>(m_dns_resolutions.raw()));
+	}
+
+	bool curl::has_asynchronous_dns()
+	{
+		const curl_version_info_data* const version_info = ::curl_version_info(CURLVERSION_NOW);
+
+		return ((version_info->features & CURL_VERSION_ASYNCHDNS) != 0);
+	}
+
 	void curl::set_http_header(const std::string& header, const std::string& value)
 	{
 		m_http_headers.append(header + ": " + value);
@@ -273,6 +332,18 @@ namespace freelan
 		set_option(CURLOPT_COPYPOSTFIELDS, boost::asio::buffer_cast<const void*>(buf));
 	}
 
+	void curl::set_share(boost::shared_ptr<curl_share> share)
+	{
+		m_share = share;
+
+		set_option(CURLOPT_SHARE, static_cast<const void*>(m_share ? m_share->raw() : nullptr));
+	}
+
+	void curl::enable_tcp_keep_alive()
+	{
+		set_option(CURLOPT_TCP_KEEPALIVE, 1L);
+	}
+
 	void curl::set_cookie_file(const std::string& file)
 	{
 		set_option(CURLOPT_COOKIEFILE, file.c_str());
@@ -457,7 +528,7 @@ namespace freelan
 
 	void curl_multi::set_option(CURLMoption option, long int value)
 	{
-		set_option(option, &value);
+		throw_if_curlm_error(curl_multi_setopt(m_curlm.get(), option, value));
 	}
 
 	void curl_multi::set_option(CURLMoption option, curl_multi_timer_callback value)
@@ -470,6 +541,20 @@ namespace freelan
 		throw_if_curlm_error(curl_multi_setopt(m_curlm.get(), option, value));
 	}
 
+	void curl_multi::set_max_connections(long count)
+	{
+		set_option(CURLMOPT_MAXCONNECTS, count);
+	}
+
+	void curl_multi::set_max_host_connections(long count)
+	{
+#if LIBCURL_VERSION_NUM >= 0x071e00
+		set_option(CURLMOPT_MAX_HOST_CONNECTIONS, count);
+#else
+		static_cast<void>(count);
+#endif
+	}
+
 	void curl_multi::socket_action(curl_socket_t sockfd, int ev_bitmask, int* running_handles)
 	{
 		throw_if_curlm_error(curl_multi_socket_action(m_curlm.get(), sockfd, ev_bitmask, running_handles));
@@ -774,6 +859,9 @@ namespace freelan
 		set_option(CURLMOPT_TIMERDATA, this);
 		set_option(CURLMOPT_SOCKETFUNCTION, &curl_multi_asio::static_socket_callback);
 		set_option(CURLMOPT_SOCKETDATA, this);
+
+		// Keep established connections around between request sequences instead of the default per-handle sizing, so periodic synchronizations reuse them.
+		set_option(CURLMOPT_MAXCONNECTS, 8L);
 	}
 
 	void curl_multi_asio::timer_callback(const boost::system::error_code& ec)
@@ -50,6 +50,7 @@
 
 #include <boost/asio.hpp>
 #include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/enable_shared_from_this.hpp>
@@ -118,6 +119,49 @@ namespace freelan
 	typedef curl_socket_t (*curl_open_socket_callback)(void*, curlsocktype, struct curl_sockaddr*);
 	typedef int (*curl_close_socket_callback)(void*, curl_socket_t);
 
+	/**
+	 * \brief A CURLSH wrapper class.
+	 *
+	 * The share holds the caches that make connection reuse effective across several easy handles: cookies (so the server-side session survives from one request to the next), SSL session identifiers (so new connections resume the TLS session with an abbreviated handshake instead of a full one) and DNS entries.
+	 */
+	class curl_share
+	{
+		public:
+
+			/**
+			 * \brief Create a CURL share with cookie, DNS and SSL session sharing enabled.
+			 */
+			curl_share();
+
+			curl_share(const curl_share&) = delete;
+			curl_share& operator=(const curl_share&) = delete;
+
+			/**
+			 * \brief Get the raw pointer.
+			 * \return The raw pointer.
+			 */
+			CURLSH* raw() const
+			{
+				return m_curlsh.get();
+			}
+
+			/**
+			 * \brief Share the specified data between the easy handles attached to this share.
+			 * \param data The data to share.
+			 *
+			 * On error, a std::runtime_error is raised.
+			 */
+			void enable_share(curl_lock_data data);
+
+		private:
+
+			static void lock_function(CURL*, curl_lock_data, curl_lock_access, void*);
+			static void unlock_function(CURL*, curl_lock_data, void*);
+
+			std::unique_ptr<CURLSH, void (*)(CURLSH*)> m_curlsh;
+			boost::mutex m_mutex;
+	};
+
 	/**
 	 * \brief A CURL wrapper class.
 	 */
@@ -276,6 +320,32 @@ namespace freelan
 			 */
 			void set_connect_timeout(const boost::posix_time::time_duration& timeout);
 
+			/**
+			 * \brief Set how long resolved host names stay usable.
+			 * \param timeout The timeout.
+			 *
+			 * The default of 60 seconds is shorter than most synchronization periods: raising it lets periodic requests reuse the cached resolution - notably the one held by the share set with set_share() - instead of resolving again.
+			 */
+			void set_dns_cache_timeout(const boost::posix_time::time_duration& timeout);
+
+			/**
+			 * \brief Pre-populate the DNS cache for a host.
+			 * \param host The host, as it appears in the URL.
+			 * \param port The port the transfer connects to.
+			 * \param address The address to connect to, as a literal.
+			 *
+			 * The transfer connects to the given address directly instead of calling the resolver, which - unless has_asynchronous_dns() - blocks the calling thread for as long as the DNS server takes to answer.
+			 */
+			void add_dns_resolution(const std::string& host, uint16_t port, const std::string& address);
+
+			/**
+			 * \brief Check whether libcurl resolves host names asynchronously.
+			 * \return true if libcurl was built with an asynchronous resolver backend (c-ares or its threaded resolver).
+			 *
+			 * The backend is chosen when libcurl is built and cannot be selected at runtime: when this is false, every resolution that misses the cache blocks the thread driving the transfer.
+			 */
+			static bool has_asynchronous_dns();
+
 			/**
 			* \brief Set the timeout.
 			* \param timeout The timeout.
@@ -328,6 +398,19 @@ namespace freelan
 			 */
 			void set_copy_post_fields(boost::asio::const_buffer buf);
 
+			/**
+			 * \brief Attach this handle to the specified share.
+			 * \param share The share. It is kept alive for as long as this handle exists.
+			 */
+			void set_share(boost::shared_ptr<curl_share> share);
+
+			/**
+			 * \brief Enable TCP keep-alive probing on the connection.
+			 *
+			 * Keeps idle pooled connections from being dropped silently by NAT gateways between two request sequences.
+			 */
+			void enable_tcp_keep_alive();
+
 			/**
 			 * \brief Set the cookie file.
 			 * \param file The file.
@@ -414,7 +497,9 @@ namespace freelan
 			static size_t write_function(char*, size_t, size_t, void*);
 
 			std::unique_ptr<CURL, void (*)(CURL*)> m_curl;
+			boost::shared_ptr<curl_share> m_share;
 			curl_list m_http_headers;
+			curl_list m_dns_resolutions;
 			debug_function_t m_debug_function;
 			write_function_t m_write_function;
 
@@ -530,6 +615,20 @@ namespace freelan
 			 */
 			CURLMsg* info_read(int* count_left = nullptr);
 
+			/**
+			 * \brief Set the size of the connection cache.
+			 * \param count The count of established connections to keep alive for reuse.
+			 */
+			void set_max_connections(long count);
+
+			/**
+			 * \brief Set the maximum count of simultaneous connections to a single host.
+			 * \param count The count.
+			 *
+			 * On libcurl versions that predate CURLMOPT_MAX_HOST_CONNECTIONS, this does nothing.
+			 */
+			void set_max_host_connections(long count);
+
 		protected:
 			curl_multi();
 
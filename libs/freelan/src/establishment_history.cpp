@@ -0,0 +1,199 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file establishment_history.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A bounded history of per-stage session establishment timings.
+ */
+
+#include "establishment_history.hpp"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/lexical_cast.hpp>
+
+namespace freelan
+{
+	namespace
+	{
+		uint64_t establishment_now_us()
+		{
+			static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+
+			return static_cast<uint64_t>((boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds());
+		}
+	}
+
+	void establishment_history::hello_sent(const endpoint_type& host, uint64_t resolve_us)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		pending_type& pending = m_pending[host];
+
+		pending.record = record_type();
+		pending.record.endpoint = boost::lexical_cast<std::string>(host);
+		pending.record.started_at_us = establishment_now_us();
+		pending.record.resolve_us = resolve_us;
+		pending.last_stage_at_us = pending.record.started_at_us;
+	}
+
+	void establishment_history::hello_answered(const endpoint_type& host, uint64_t rtt_us)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		const pending_map_type::iterator pending = m_pending.find(host);
+
+		if (pending != m_pending.end())
+		{
+			// The greet machinery measured the round-trip itself: its figure is more precise than our wall-clock difference.
+			pending->second.record.hello_us = rtt_us;
+			pending->second.last_stage_at_us = establishment_now_us();
+		}
+	}
+
+	void establishment_history::presentation_sent(const endpoint_type& host)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		pending_map_type::iterator pending = m_pending.find(host);
+
+		if (pending == m_pending.end())
+		{
+			// The responding side never sent a HELLO: its timeline starts here.
+			pending = m_pending.insert(std::make_pair(host, pending_type())).first;
+			pending->second.record.endpoint = boost::lexical_cast<std::string>(host);
+			pending->second.record.started_at_us = establishment_now_us();
+			pending->second.last_stage_at_us = pending->second.record.started_at_us;
+		}
+	}
+
+	void establishment_history::session_received(const endpoint_type& host)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		const pending_map_type::iterator pending = m_pending.find(host);
+
+		if (pending != m_pending.end())
+		{
+			pending->second.record.presentation_us = advance(pending->second);
+		}
+	}
+
+	void establishment_history::session_established(const endpoint_type& host)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		const pending_map_type::iterator pending = m_pending.find(host);
+
+		if (pending != m_pending.end())
+		{
+			pending->second.record.handshake_us = advance(pending->second);
+		}
+	}
+
+	void establishment_history::routes_received(const endpoint_type& host)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		const pending_map_type::iterator pending = m_pending.find(host);
+
+		if (pending != m_pending.end())
+		{
+			pending->second.record.routes_us = advance(pending->second);
+
+			complete(pending, "completed");
+		}
+	}
+
+	void establishment_history::session_failed(const endpoint_type& host)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		const pending_map_type::iterator pending = m_pending.find(host);
+
+		if (pending != m_pending.end())
+		{
+			advance(pending->second);
+
+			complete(pending, "failed");
+		}
+	}
+
+	std::vector<establishment_history::record_type> establishment_history::history() const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		std::vector<record_type> result(m_completed.begin(), m_completed.end());
+
+		for (pending_map_type::const_iterator pending = m_pending.begin(); pending != m_pending.end(); ++pending)
+		{
+			record_type record = pending->second.record;
+			record.total_us = pending->second.last_stage_at_us - record.started_at_us;
+
+			result.push_back(record);
+		}
+
+		return result;
+	}
+
+	uint64_t establishment_history::advance(pending_type& pending)
+	{
+		const uint64_t now = establishment_now_us();
+		const uint64_t duration = now - pending.last_stage_at_us;
+
+		pending.last_stage_at_us = now;
+
+		return duration;
+	}
+
+	void establishment_history::complete(pending_map_type::iterator pending, const char* state)
+	{
+		pending->second.record.state = state;
+		pending->second.record.total_us = pending->second.last_stage_at_us - pending->second.record.started_at_us;
+
+		m_completed.push_back(pending->second.record);
+
+		while (m_completed.size() > HISTORY_SIZE)
+		{
+			m_completed.pop_front();
+		}
+
+		m_pending.erase(pending);
+	}
+}
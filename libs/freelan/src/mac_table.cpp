@@ -0,0 +1,317 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file mac_table.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A MAC learning table class.
+ */
+
+#include "mac_table.hpp"
+
+#include <cassert>
+#include <cstring>
+
+namespace freelan
+{
+	namespace
+	{
+		size_t next_power_of_two(size_t value)
+		{
+			size_t result = 1;
+
+			while (result < value)
+			{
+				result <<= 1;
+			}
+
+			return result;
+		}
+	}
+
+	mac_table::mac_table(size_t max_entries, unsigned int max_age_seconds) :
+		m_max_entries(max_entries),
+		m_max_age(static_cast<std::time_t>(max_age_seconds)),
+		m_mask(next_power_of_two(max_entries * 2) - 1),
+		m_size(0),
+		m_lru_head(NO_ENTRY),
+		m_lru_tail(NO_ENTRY),
+		m_slots(m_mask + 1),
+		m_generation(0)
+	{
+		assert(max_entries > 0);
+	}
+
+	size_t mac_table::hash(const ethernet_address_type& address)
+	{
+		return asiotap::osi::hash_value(address);
+	}
+
+	uint32_t mac_table::find_slot(const ethernet_address_type& address) const
+	{
+		size_t index = hash(address) & m_mask;
+
+		while (m_slots[index].used)
+		{
+			if (m_slots[index].address == address)
+			{
+				return static_cast<uint32_t>(index);
+			}
+
+			index = (index + 1) & m_mask;
+		}
+
+		return NO_ENTRY;
+	}
+
+	void mac_table::lru_unlink(uint32_t index)
+	{
+		entry_type& entry = m_slots[index];
+
+		if (entry.lru_prev != NO_ENTRY)
+		{
+			m_slots[entry.lru_prev].lru_next = entry.lru_next;
+		}
+		else
+		{
+			m_lru_head = entry.lru_next;
+		}
+
+		if (entry.lru_next != NO_ENTRY)
+		{
+			m_slots[entry.lru_next].lru_prev = entry.lru_prev;
+		}
+		else
+		{
+			m_lru_tail = entry.lru_prev;
+		}
+
+		entry.lru_prev = NO_ENTRY;
+		entry.lru_next = NO_ENTRY;
+	}
+
+	void mac_table::lru_push_front(uint32_t index)
+	{
+		entry_type& entry = m_slots[index];
+
+		entry.lru_prev = NO_ENTRY;
+		entry.lru_next = m_lru_head;
+
+		if (m_lru_head != NO_ENTRY)
+		{
+			m_slots[m_lru_head].lru_prev = index;
+		}
+
+		m_lru_head = index;
+
+		if (m_lru_tail == NO_ENTRY)
+		{
+			m_lru_tail = index;
+		}
+	}
+
+	void mac_table::lru_replace(uint32_t old_index, uint32_t new_index)
+	{
+		// The entry moved to another slot: its list neighbors must point at the new location.
+		const entry_type& entry = m_slots[new_index];
+
+		if (entry.lru_prev != NO_ENTRY)
+		{
+			m_slots[entry.lru_prev].lru_next = new_index;
+		}
+
+		if (entry.lru_next != NO_ENTRY)
+		{
+			m_slots[entry.lru_next].lru_prev = new_index;
+		}
+
+		if (m_lru_head == old_index)
+		{
+			m_lru_head = new_index;
+		}
+
+		if (m_lru_tail == old_index)
+		{
+			m_lru_tail = new_index;
+		}
+	}
+
+	void mac_table::remove_slot(uint32_t index)
+	{
+		lru_unlink(index);
+
+		m_slots[index].used = false;
+		m_size--;
+		m_generation++;
+
+		// Backward-shift deletion: the entries that probed past the hole are moved back so lookups never need tombstones.
+		size_t hole = index;
+		size_t current = (hole + 1) & m_mask;
+
+		while (m_slots[current].used)
+		{
+			const size_t home = hash(m_slots[current].address) & m_mask;
+
+			if (((current - home) & m_mask) >= ((current - hole) & m_mask))
+			{
+				m_slots[hole] = m_slots[current];
+				m_slots[current].used = false;
+
+				lru_replace(static_cast<uint32_t>(current), static_cast<uint32_t>(hole));
+
+				hole = current;
+			}
+
+			current = (current + 1) & m_mask;
+		}
+	}
+
+	void mac_table::learn(const ethernet_address_type& address, const port_index_type& port)
+	{
+		const std::time_t now = std::time(NULL);
+
+		const uint32_t existing = find_slot(address);
+
+		if (existing != NO_ENTRY)
+		{
+			entry_type& entry = m_slots[existing];
+
+			if (!(entry.port == port))
+			{
+				// The address moved to another port: cached decisions must be invalidated.
+				m_generation++;
+			}
+
+			entry.port = port;
+			entry.last_seen = now;
+
+			lru_unlink(existing);
+			lru_push_front(existing);
+
+			return;
+		}
+
+		if (m_size >= m_max_entries)
+		{
+			remove_slot(m_lru_tail);
+
+			m_statistics.evictions++;
+		}
+
+		size_t index = hash(address) & m_mask;
+
+		while (m_slots[index].used)
+		{
+			index = (index + 1) & m_mask;
+		}
+
+		entry_type& entry = m_slots[index];
+
+		entry.address = address;
+		entry.port = port;
+		entry.used = true;
+		entry.hits = 0;
+		entry.last_seen = now;
+
+		lru_push_front(static_cast<uint32_t>(index));
+
+		m_size++;
+		m_generation++;
+	}
+
+	bool mac_table::lookup(const ethernet_address_type& address, port_index_type& port)
+	{
+		const uint32_t index = find_slot(address);
+
+		if (index == NO_ENTRY)
+		{
+			m_statistics.misses++;
+
+			return false;
+		}
+
+		if (std::time(NULL) - m_slots[index].last_seen > m_max_age)
+		{
+			// The entry aged out: it is removed and the lookup counts as a miss.
+			remove_slot(index);
+
+			m_statistics.misses++;
+
+			return false;
+		}
+
+		port = m_slots[index].port;
+
+		lru_unlink(index);
+		lru_push_front(index);
+
+		m_slots[index].hits++;
+		m_statistics.hits++;
+
+		return true;
+	}
+
+	std::vector<mac_table::entry_info_type> mac_table::entries() const
+	{
+		std::vector<entry_info_type> result;
+		result.reserve(m_size);
+
+		// Walking the LRU list yields the entries most recently used first.
+		for (uint32_t index = m_lru_head; index != NO_ENTRY; index = m_slots[index].lru_next)
+		{
+			const entry_type& entry = m_slots[index];
+
+			const entry_info_type info = { entry.address, entry.port, entry.hits, entry.last_seen };
+
+			result.push_back(info);
+		}
+
+		return result;
+	}
+
+	void mac_table::erase(const ethernet_address_type& address)
+	{
+		const uint32_t index = find_slot(address);
+
+		if (index != NO_ENTRY)
+		{
+			remove_slot(index);
+		}
+	}
+}
@@ -0,0 +1,220 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file maintenance_scheduler.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A budget-aware scheduler for the periodic maintenance tasks.
+ */
+
+#include "maintenance_scheduler.hpp"
+
+#include <boost/bind.hpp>
+
+namespace freelan
+{
+	const boost::posix_time::time_duration maintenance_scheduler::TICK_PERIOD = boost::posix_time::seconds(1);
+	const boost::posix_time::time_duration maintenance_scheduler::TICK_BUDGET = boost::posix_time::milliseconds(25);
+
+	maintenance_scheduler::maintenance_scheduler(boost::asio::io_service& io_service, fscp::logger& _logger) :
+		m_timer(io_service),
+		m_logger(_logger),
+		m_running(false)
+	{
+	}
+
+	void maintenance_scheduler::set_load_probe(load_probe_type probe)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		m_load_probe = probe;
+	}
+
+	void maintenance_scheduler::register_task(const std::string& name, task_cost_type cost, const boost::posix_time::time_duration& period, task_type task)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		task_context_type context;
+
+		context.name = name;
+		context.cost = cost;
+		context.period = period;
+		context.task = task;
+		context.next_run = boost::posix_time::microsec_clock::local_time() + period;
+
+		for (std::vector<task_context_type>::iterator it = m_tasks.begin(); it != m_tasks.end(); ++it)
+		{
+			if (it->name == name)
+			{
+				*it = context;
+
+				return;
+			}
+		}
+
+		m_tasks.push_back(context);
+	}
+
+	void maintenance_scheduler::unregister_task(const std::string& name)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		for (std::vector<task_context_type>::iterator it = m_tasks.begin(); it != m_tasks.end(); ++it)
+		{
+			if (it->name == name)
+			{
+				m_tasks.erase(it);
+
+				return;
+			}
+		}
+	}
+
+	void maintenance_scheduler::start()
+	{
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			if (m_running)
+			{
+				return;
+			}
+
+			m_running = true;
+
+			// Tasks registered before start() wait a full period from now, like the dedicated timers did.
+			const boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
+
+			for (std::vector<task_context_type>::iterator it = m_tasks.begin(); it != m_tasks.end(); ++it)
+			{
+				it->next_run = now + it->period;
+			}
+		}
+
+		m_timer.expires_from_now(TICK_PERIOD);
+		m_timer.async_wait(boost::bind(&maintenance_scheduler::do_tick, this, boost::asio::placeholders::error));
+	}
+
+	void maintenance_scheduler::stop()
+	{
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			m_running = false;
+		}
+
+		m_timer.cancel();
+	}
+
+	void maintenance_scheduler::do_tick(const boost::system::error_code& ec)
+	{
+		if (ec == boost::asio::error::operation_aborted)
+		{
+			return;
+		}
+
+		// The probe is read before the task loop: one verdict per tick, so a task's own cost cannot defer the tasks after it.
+		const bool busy = m_load_probe ? m_load_probe() : false;
+		const boost::posix_time::ptime tick_start = boost::posix_time::microsec_clock::local_time();
+
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			if (!m_running)
+			{
+				return;
+			}
+
+			bool ran_heavy = false;
+
+			for (std::vector<task_context_type>::iterator it = m_tasks.begin(); it != m_tasks.end(); ++it)
+			{
+				const boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
+
+				if (now < it->next_run)
+				{
+					continue;
+				}
+
+				if ((now - tick_start) >= TICK_BUDGET)
+				{
+					// The budget is spent: the remaining due tasks stay due and run on the next tick.
+					break;
+				}
+
+				// A busy datapath defers due tasks - but not forever: a task overdue by enough of its own periods runs even under load.
+				if (busy && (now < (it->next_run + (it->period * (MAX_DEFERRAL_FACTOR - 1)))))
+				{
+					continue;
+				}
+
+				if (it->cost == TASK_COST_HEAVY)
+				{
+					if (ran_heavy)
+					{
+						continue;
+					}
+
+					ran_heavy = true;
+				}
+
+				try
+				{
+					it->task();
+				}
+				catch (const std::exception& ex)
+				{
+					m_logger(fscp::log_level::error) << "Error running the " << it->name << " maintenance task: " << ex.what();
+				}
+
+				const boost::posix_time::ptime done = boost::posix_time::microsec_clock::local_time();
+
+				if ((done - now) >= TICK_BUDGET)
+				{
+					m_logger(fscp::log_level::debug) << "The " << it->name << " maintenance task ran for " << (done - now) << ".";
+				}
+
+				it->next_run = done + it->period;
+			}
+		}
+
+		m_timer.expires_from_now(TICK_PERIOD);
+		m_timer.async_wait(boost::bind(&maintenance_scheduler::do_tick, this, boost::asio::placeholders::error));
+	}
+}
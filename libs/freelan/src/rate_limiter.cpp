@@ -0,0 +1,257 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file rate_limiter.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A hierarchical token-bucket rate limiter for the datapath.
+ */
+
+#include "rate_limiter.hpp"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+
+namespace freelan
+{
+	namespace
+	{
+		uint64_t rate_limiter_now_us()
+		{
+			static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+
+			return static_cast<uint64_t>((boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds());
+		}
+	}
+
+	token_bucket::token_bucket(uint64_t rate, uint64_t burst) :
+		m_rate(rate),
+		m_burst(static_cast<int64_t>((burst != 0) ? burst : rate)),
+		m_tokens(static_cast<int64_t>((burst != 0) ? burst : rate)),
+		m_last_refill_us(rate_limiter_now_us()),
+		m_passed_packets(0),
+		m_passed_bytes(0),
+		m_dropped_packets(0),
+		m_dropped_bytes(0)
+	{
+	}
+
+	bool token_bucket::consume(size_t size)
+	{
+		if (m_rate == 0)
+		{
+			return true;
+		}
+
+		refill();
+
+		const int64_t needed = static_cast<int64_t>(size);
+		int64_t current = m_tokens.load(boost::memory_order_relaxed);
+
+		while (current >= needed)
+		{
+			if (m_tokens.compare_exchange_weak(current, current - needed, boost::memory_order_relaxed))
+			{
+				m_passed_packets.fetch_add(1, boost::memory_order_relaxed);
+				m_passed_bytes.fetch_add(size, boost::memory_order_relaxed);
+
+				return true;
+			}
+		}
+
+		m_dropped_packets.fetch_add(1, boost::memory_order_relaxed);
+		m_dropped_bytes.fetch_add(size, boost::memory_order_relaxed);
+
+		return false;
+	}
+
+	void token_bucket::refill()
+	{
+		const uint64_t now = rate_limiter_now_us();
+		uint64_t last = m_last_refill_us.load(boost::memory_order_relaxed);
+
+		if (now <= last)
+		{
+			return;
+		}
+
+		const int64_t credit = static_cast<int64_t>(((now - last) * m_rate) / 1000000);
+
+		if (credit == 0)
+		{
+			// Not even one byte accrued: the timestamp is left alone so the fraction keeps accumulating.
+			return;
+		}
+
+		if (!m_last_refill_us.compare_exchange_strong(last, now, boost::memory_order_relaxed))
+		{
+			// Another thread credited this interval.
+			return;
+		}
+
+		int64_t current = m_tokens.load(boost::memory_order_relaxed);
+		int64_t next;
+
+		do
+		{
+			next = std::min(current + credit, m_burst);
+		}
+		while (!m_tokens.compare_exchange_weak(current, next, boost::memory_order_relaxed));
+	}
+
+	token_bucket::statistics_type token_bucket::statistics() const
+	{
+		statistics_type result;
+
+		result.passed_packets = m_passed_packets.load(boost::memory_order_relaxed);
+		result.passed_bytes = m_passed_bytes.load(boost::memory_order_relaxed);
+		result.dropped_packets = m_dropped_packets.load(boost::memory_order_relaxed);
+		result.dropped_bytes = m_dropped_bytes.load(boost::memory_order_relaxed);
+
+		return result;
+	}
+
+	void rate_limiter::set_peer_limit(const limit_type& limit)
+	{
+		m_peer_limit = limit;
+		m_enabled = m_enabled || (limit.rate != 0);
+	}
+
+	void rate_limiter::set_group_limit(unsigned int group, const limit_type& limit)
+	{
+		if (limit.rate != 0)
+		{
+			m_group_buckets[group] = boost::make_shared<bucket_pair_type>(limit);
+			m_enabled = true;
+		}
+		else
+		{
+			m_group_buckets.erase(group);
+		}
+	}
+
+	void rate_limiter::register_peer(const endpoint_type& peer)
+	{
+		if (m_peer_limit.rate == 0)
+		{
+			return;
+		}
+
+		boost::mutex::scoped_lock lock(m_peer_buckets_mutex);
+
+		m_peer_buckets[peer] = boost::make_shared<bucket_pair_type>(m_peer_limit);
+	}
+
+	void rate_limiter::unregister_peer(const endpoint_type& peer)
+	{
+		boost::mutex::scoped_lock lock(m_peer_buckets_mutex);
+
+		m_peer_buckets.erase(peer);
+	}
+
+	bool rate_limiter::account(direction_type direction, unsigned int group, const endpoint_type& peer, size_t size)
+	{
+		if (!m_enabled)
+		{
+			return true;
+		}
+
+		// The group is checked first: a frame dropped at the group level never burns the peer's own budget.
+		const group_map_type::const_iterator group_buckets = m_group_buckets.find(group);
+
+		if ((group_buckets != m_group_buckets.end()) && !group_buckets->second->direction(direction).consume(size))
+		{
+			return false;
+		}
+
+		boost::shared_ptr<bucket_pair_type> peer_buckets;
+
+		{
+			boost::mutex::scoped_lock lock(m_peer_buckets_mutex);
+
+			const peer_map_type::const_iterator entry = m_peer_buckets.find(peer);
+
+			if (entry != m_peer_buckets.end())
+			{
+				peer_buckets = entry->second;
+			}
+		}
+
+		if (peer_buckets && !peer_buckets->direction(direction).consume(size))
+		{
+			return false;
+		}
+
+		return true;
+	}
+
+	std::vector<rate_limiter::entry_statistics_type> rate_limiter::statistics() const
+	{
+		std::vector<entry_statistics_type> result;
+
+		for (group_map_type::const_iterator group = m_group_buckets.begin(); group != m_group_buckets.end(); ++group)
+		{
+			entry_statistics_type entry;
+
+			entry.name = "group:" + boost::lexical_cast<std::string>(group->first);
+			entry.in = group->second->in.statistics();
+			entry.out = group->second->out.statistics();
+
+			result.push_back(entry);
+		}
+
+		boost::mutex::scoped_lock lock(m_peer_buckets_mutex);
+
+		for (peer_map_type::const_iterator peer = m_peer_buckets.begin(); peer != m_peer_buckets.end(); ++peer)
+		{
+			entry_statistics_type entry;
+
+			entry.name = boost::lexical_cast<std::string>(peer->first);
+			entry.in = peer->second->in.statistics();
+			entry.out = peer->second->out.statistics();
+
+			result.push_back(entry);
+		}
+
+		return result;
+	}
+}
@@ -0,0 +1,196 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file route_trie.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A longest-prefix-match routing trie.
+ */
+
+#include "route_trie.hpp"
+
+#include <boost/variant/static_visitor.hpp>
+#include <boost/variant/apply_visitor.hpp>
+
+namespace freelan
+{
+	namespace
+	{
+		class add_route_visitor : public boost::static_visitor<>
+		{
+			public:
+
+				add_route_visitor(route_trie& trie, const port_index_type& port) :
+					m_trie(trie),
+					m_port(port)
+				{
+				}
+
+				template <typename RouteType>
+				void operator()(const RouteType& route) const
+				{
+					m_trie.add_route(route, m_port);
+				}
+
+			private:
+
+				route_trie& m_trie;
+				const port_index_type& m_port;
+		};
+	}
+
+	void route_trie::clear()
+	{
+		m_ipv4_nodes.assign(1, node_type());
+		m_ipv6_nodes.assign(1, node_type());
+		m_port_lists.clear();
+	}
+
+	void route_trie::add_route(const asiotap::ip_route& route, const port_index_type& port)
+	{
+		boost::apply_visitor(add_route_visitor(*this, port), route);
+	}
+
+	void route_trie::add_route(const asiotap::ipv4_route& route, const port_index_type& port)
+	{
+		const boost::asio::ip::address_v4::bytes_type bytes = route.network_address().address().to_bytes();
+
+		insert(m_ipv4_nodes, &bytes[0], route.network_address().prefix_length(), port);
+	}
+
+	void route_trie::add_route(const asiotap::ipv6_route& route, const port_index_type& port)
+	{
+		const boost::asio::ip::address_v6::bytes_type bytes = route.network_address().address().to_bytes();
+
+		insert(m_ipv6_nodes, &bytes[0], route.network_address().prefix_length(), port);
+	}
+
+	void route_trie::find(const boost::asio::ip::address_v4& address, port_index_list_type& result) const
+	{
+		const boost::asio::ip::address_v4::bytes_type bytes = address.to_bytes();
+
+		find_in(m_ipv4_nodes, &bytes[0], 32, result);
+	}
+
+	void route_trie::find(const boost::asio::ip::address_v6& address, port_index_list_type& result) const
+	{
+		const boost::asio::ip::address_v6::bytes_type bytes = address.to_bytes();
+
+		find_in(m_ipv6_nodes, &bytes[0], 128, result);
+	}
+
+	void route_trie::insert(node_pool_type& nodes, const uint8_t* prefix, size_t prefix_length, const port_index_type& port)
+	{
+		uint32_t current = 0;
+
+		for (size_t bit = 0; bit < prefix_length; ++bit)
+		{
+			const size_t branch = (prefix[bit / 8] >> (7 - (bit % 8))) & 1;
+
+			uint32_t child = nodes[current].children[branch];
+
+			if (child == 0)
+			{
+				child = static_cast<uint32_t>(nodes.size());
+				nodes.push_back(node_type());
+				nodes[current].children[branch] = child;
+			}
+
+			current = child;
+		}
+
+		node_type& node = nodes[current];
+
+		if (node.ports < 0)
+		{
+			node.ports = static_cast<int32_t>(m_port_lists.size());
+			m_port_lists.push_back(port_index_list_type());
+		}
+
+		port_index_list_type& ports = m_port_lists[node.ports];
+
+		if (std::find(ports.begin(), ports.end(), port) == ports.end())
+		{
+			ports.push_back(port);
+		}
+	}
+
+	void route_trie::find_in(const node_pool_type& nodes, const uint8_t* address, size_t address_length, port_index_list_type& result) const
+	{
+		result.clear();
+
+		// An IPv6 address can match at most 129 prefixes (lengths 0 through 128).
+		boost::array<int32_t, 129> matches;
+		size_t match_count = 0;
+
+		uint32_t current = 0;
+
+		for (size_t bit = 0;; ++bit)
+		{
+			const node_type& node = nodes[current];
+
+			if (node.ports >= 0)
+			{
+				matches[match_count++] = node.ports;
+			}
+
+			if (bit >= address_length)
+			{
+				break;
+			}
+
+			const uint32_t child = node.children[(address[bit / 8] >> (7 - (bit % 8))) & 1];
+
+			if (child == 0)
+			{
+				break;
+			}
+
+			current = child;
+		}
+
+		// Report the matches from the most specific prefix to the least specific one.
+		while (match_count > 0)
+		{
+			const port_index_list_type& ports = m_port_lists[matches[--match_count]];
+
+			result.insert(result.end(), ports.begin(), ports.end());
+		}
+	}
+}
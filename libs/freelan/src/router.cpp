@@ -46,115 +46,239 @@
 #include "router.hpp"
 
 #include <cassert>
+#include <cstring>
 
+#include <boost/atomic.hpp>
 #include <boost/foreach.hpp>
 
+#include <asiotap/osi/ipv4_filter.hpp>
+#include <asiotap/osi/ipv6_filter.hpp>
 #include <asiotap/osi/ipv4_helper.hpp>
 #include <asiotap/osi/ipv6_helper.hpp>
 
 namespace freelan
 {
-	void router::async_write(port_index_type index, boost::asio::const_buffer data, port_type::write_handler_type handler)
+	namespace
 	{
-		const port_list_type::const_iterator port_entry = get_target_for(index, data);
+		// The parsing below is stateless on purpose: a forwarding snapshot is read by several threads at once, so it cannot rely on the stateful osi::filter instances.
 
-#if FREELAN_DEBUG
-		if (port_entry != m_ports.end())
+		boost::optional<boost::asio::ip::address_v4> get_ipv4_destination(boost::asio::const_buffer data)
 		{
-			std::cerr << "Routing " << buffer_size(data) << " byte(s) of data from " << index << " to " << port_entry->first << std::endl;
+			try
+			{
+				const asiotap::osi::const_helper<asiotap::osi::ipv4_frame> helper(data);
+
+				if (asiotap::osi::check_frame(helper))
+				{
+					return helper.destination();
+				}
+			}
+			catch (std::logic_error&)
+			{
+			}
+
+			return boost::none;
 		}
-		else
+
+		boost::optional<boost::asio::ip::address_v6> get_ipv6_destination(boost::asio::const_buffer data)
 		{
-			std::cerr << "Routing " << buffer_size(data) << " byte(s) of data from " << index << ": no route." << std::endl;
+			try
+			{
+				const asiotap::osi::const_helper<asiotap::osi::ipv6_frame> helper(data);
+
+				if (asiotap::osi::check_frame(helper))
+				{
+					return helper.destination();
+				}
+			}
+			catch (std::logic_error&)
+			{
+			}
+
+			return boost::none;
 		}
-#endif
 
-		if (port_entry != m_ports.end())
+		// Real traffic has massive destination locality: a small per-thread direct-mapped cache takes the common-case routing decision to a couple of loads instead of a trie walk. An entry is only reused while the snapshot that produced it is the published one - any route change publishes a new snapshot with a fresh generation, which invalidates every cached decision at once without touching the caches.
+		const size_t ROUTE_CACHE_SIZE = 256;
+
+		struct route_cache_entry
 		{
-			port_entry->second.async_write(data, handler);
-		}
-	}
+			uint64_t generation; /* 0 means the entry is empty. */
+			unsigned int source_group;
+			uint8_t family;
+			uint8_t address[16];
+			const void* target; /* The resolved port, or nullptr for a cached "no route" decision. */
+		};
 
-	router::port_list_type::const_iterator router::get_target_for(port_index_type index, boost::asio::const_buffer data)
-	{
-		// Try IPv4 first because it is more likely.
+		thread_local route_cache_entry route_cache[ROUTE_CACHE_SIZE];
 
-		m_ipv4_filter.parse(data);
+		boost::atomic<uint64_t> next_snapshot_generation(1);
 
-		if (m_ipv4_filter.get_last_helper())
+		template <typename AddressType>
+		struct address_family;
+
+		template <>
+		struct address_family<boost::asio::ip::address_v4>
 		{
-			const boost::asio::ip::address_v4 destination = m_ipv4_filter.get_last_helper()->destination();
+			static const uint8_t value = 4;
+		};
 
-			m_ipv4_filter.clear_last_helper();
+		template <>
+		struct address_family<boost::asio::ip::address_v6>
+		{
+			static const uint8_t value = 6;
+		};
 
-			return get_target_for(index, destination);
-		}
-		else
+		template <typename AddressType>
+		route_cache_entry& route_cache_slot(const AddressType& address)
 		{
-			m_ipv6_filter.parse(data);
+			const auto bytes = address.to_bytes();
+			size_t hash = static_cast<size_t>(address_family<AddressType>::value);
 
-			if (m_ipv6_filter.get_last_helper())
+			for (size_t i = 0; i < bytes.size(); ++i)
 			{
-				const boost::asio::ip::address_v6 destination = m_ipv6_filter.get_last_helper()->destination();
+				hash = hash * 31 + bytes[i];
+			}
 
-				m_ipv6_filter.clear_last_helper();
+			return route_cache[hash & (ROUTE_CACHE_SIZE - 1)];
+		}
 
-				return get_target_for(index, destination);
+		template <typename AddressType>
+		bool route_cache_matches(const route_cache_entry& entry, uint64_t generation, unsigned int source_group, const AddressType& address)
+		{
+			if ((entry.generation != generation) || (entry.source_group != source_group) || (entry.family != address_family<AddressType>::value))
+			{
+				return false;
 			}
+
+			const auto bytes = address.to_bytes();
+
+			return (std::memcmp(entry.address, bytes.data(), bytes.size()) == 0);
 		}
 
-		// Frame of other types than IPv4 or IPv6 are silently dropped.
-		return m_ports.end();
+		template <typename AddressType>
+		void route_cache_store(route_cache_entry& entry, uint64_t generation, unsigned int source_group, const AddressType& address, const void* target)
+		{
+			const auto bytes = address.to_bytes();
+
+			entry.generation = generation;
+			entry.source_group = source_group;
+			entry.family = address_family<AddressType>::value;
+			std::memset(entry.address, 0, sizeof(entry.address));
+			std::memcpy(entry.address, bytes.data(), bytes.size());
+			entry.target = target;
+		}
 	}
 
-	template <typename AddressType>
-	router::port_list_type::const_iterator router::get_target_for(port_index_type index, const AddressType& dest_addr)
+	router::forwarding_snapshot::forwarding_snapshot(const router_configuration& configuration, size_t parse_offset, const port_list_type& ports) :
+		m_client_routing_enabled(configuration.client_routing_enabled),
+		m_parse_offset(parse_offset),
+		m_ports(ports),
+		m_fib(),
+		m_generation(next_snapshot_generation.fetch_add(1, boost::memory_order_relaxed))
 	{
-		const router::port_list_type::const_iterator source_port_entry = m_ports.find(index);
+		// We compile all the port routes into the lookup trie.
+		for (port_list_type::const_iterator port = m_ports.begin(); port != m_ports.end(); ++port)
+		{
+			const auto& local_routes = port->second.local_routes();
+
+			for (auto&& route : local_routes)
+			{
+				m_fib.add_route(route, port->first);
+			}
+		}
+	}
+
+	void router::forwarding_snapshot::async_write(port_index_type index, fscp::SharedBuffer frame, boost::asio::const_buffer data, port_type::write_handler_type handler) const
+	{
+		const port_list_type::const_iterator source_port_entry = m_ports.find(index);
+
+		const port_type* target_port = nullptr;
 
 		if (source_port_entry != m_ports.end())
 		{
-			const auto& routes_ports = routes();
+			// The frames may carry a fixed prefix (such as a virtio-net header) which the routing decision must skip.
+			const boost::asio::const_buffer payload = data + m_parse_offset;
+
+			// Try IPv4 first because it is more likely.
+
+			const auto ipv4_destination = get_ipv4_destination(payload);
 
-			for (auto&& route_port : routes_ports)
+			if (ipv4_destination)
 			{
-				if (has_address(route_port.first, dest_addr))
-				{
-					const port_list_type::const_iterator port_entry = m_ports.find(route_port.second);
+				target_port = get_target_for(source_port_entry, *ipv4_destination);
+			}
+			else
+			{
+				const auto ipv6_destination = get_ipv6_destination(payload);
 
-					if (m_configuration.client_routing_enabled || (source_port_entry->second.group() != port_entry->second.group()))
-					{
-						return port_entry;
-					}
+				if (ipv6_destination)
+				{
+					target_port = get_target_for(source_port_entry, *ipv6_destination);
 				}
+
+				// Frame of other types than IPv4 or IPv6 are silently dropped.
 			}
 		}
 
-		// No route for the current frame so we return an invalid iterator.
-		return m_ports.end();
+#if FREELAN_DEBUG
+		if (target_port)
+		{
+			std::cerr << "Routing " << buffer_size(data) << " byte(s) of data from " << index << std::endl;
+		}
+		else
+		{
+			std::cerr << "Routing " << buffer_size(data) << " byte(s) of data from " << index << ": no route." << std::endl;
+		}
+#endif
+
+		if (target_port)
+		{
+			// Routing always resolves to a single port, so the frame can safely be handed over.
+			target_port->async_write(frame, data, handler);
+		}
 	}
 
-	const router::routes_port_type& router::routes() const
+	template <typename AddressType>
+	const router::port_type* router::forwarding_snapshot::get_target_for(port_list_type::const_iterator source_port_entry, const AddressType& dest_addr) const
 	{
-		if (!m_routes)
+		const unsigned int source_group = source_port_entry->second.group();
+		route_cache_entry& cache_entry = route_cache_slot(dest_addr);
+
+		if (route_cache_matches(cache_entry, m_generation, source_group, dest_addr))
 		{
-			// The routes were invalidated, we recompile them.
+			// The cached port belongs to this very snapshot, which the caller keeps alive for the duration of the write.
+			return static_cast<const port_type*>(cache_entry.target);
+		}
+
+		// The snapshot is shared between threads, so the matches buffer has to live on the caller's stack.
+		route_trie::port_index_list_type matches;
 
-			m_routes = routes_port_type();
+		// The matches are ordered from the most specific prefix to the least specific one.
+		m_fib.find(dest_addr, matches);
 
-			// We add all the port routes to the routes list.
-			// These are sorted automatically by the container.
-			for (port_list_type::const_iterator port = m_ports.begin(); port != m_ports.end(); ++port)
+		const port_type* target_port = nullptr;
+
+		for (auto&& target : matches)
+		{
+			const port_list_type::const_iterator port_entry = m_ports.find(target);
+
+			if (m_client_routing_enabled || (source_group != port_entry->second.group()))
 			{
-				const auto& local_routes = port->second.local_routes();
+				target_port = &port_entry->second;
 
-				for (auto&& route : local_routes)
-				{
-					m_routes->insert(std::make_pair(route, port->first));
-				}
+				break;
 			}
 		}
 
-		return *m_routes;
+		// "No route" decisions are cached too: a flow towards an unreachable destination would otherwise walk the trie for every frame.
+		route_cache_store(cache_entry, m_generation, source_group, dest_addr, target_port);
+
+		return target_port;
+	}
+
+	void router::async_write(port_index_type index, fscp::SharedBuffer frame, boost::asio::const_buffer data, port_type::write_handler_type handler)
+	{
+		get_forwarding_snapshot()->async_write(index, frame, data, handler);
 	}
 }
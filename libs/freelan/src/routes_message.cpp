@@ -46,6 +46,7 @@
 #include "routes_message.hpp"
 
 #include <cassert>
+#include <utility>
 
 namespace freelan
 {
@@ -74,6 +75,227 @@ namespace freelan
 			return has_gateway ? INAT_IPV6_GATEWAY : INAT_IPV6;
 		}
 
+		/**
+		 * \brief The wire-independent fields of a route, extracted once so the compact encoder can work on plain bytes.
+		 */
+		struct route_fields_type
+		{
+			ip_network_address_type type;
+			uint8_t prefix_length;
+			size_t address_size;
+			uint8_t address[16];
+			bool has_gateway;
+			uint8_t gateway[16];
+		};
+
+		/**
+		 * \brief A visitor that extracts the fields of a route.
+		 */
+		class route_fields_extractor : public boost::static_visitor<route_fields_type>
+		{
+			public:
+
+				/**
+				 * \brief Extract the fields of the route.
+				 * \param ir The ip_route.
+				 * \return The fields.
+				 */
+				template <typename AddressType>
+				result_type operator()(const asiotap::base_ip_route<AddressType>& ir) const
+				{
+					route_fields_type result;
+
+					const auto ina = ir.network_address();
+					const auto _gateway = ir.gateway();
+					const auto bytes = ina.address().to_bytes();
+
+					result.type = get_address_type<AddressType>(static_cast<bool>(_gateway));
+					result.prefix_length = static_cast<uint8_t>(ina.prefix_length());
+					result.address_size = bytes.size();
+					std::copy(bytes.begin(), bytes.end(), result.address);
+					result.has_gateway = static_cast<bool>(_gateway);
+
+					if (_gateway)
+					{
+						const auto gateway_bytes = _gateway->to_bytes();
+						std::copy(gateway_bytes.begin(), gateway_bytes.end(), result.gateway);
+					}
+
+					return result;
+				}
+		};
+
+		/**
+		 * \brief Compute the geometry of a compact entry.
+		 * \param fields The fields of the route.
+		 * \param prev The address bytes of the previous entry.
+		 * \param prev_size The count of bytes in prev.
+		 * \param shared The count of leading bytes shared with prev.
+		 * \param emitted The count of address bytes the entry must carry.
+		 *
+		 * The decoder rebuilds the address as prev[0, shared) + the emitted bytes + zeros, so emitted extends from the shared prefix to the last non-zero byte.
+		 */
+		void compact_entry_geometry(const route_fields_type& fields, const uint8_t* prev, size_t prev_size, size_t& shared, size_t& emitted)
+		{
+			shared = 0;
+
+			if (prev_size == fields.address_size)
+			{
+				while ((shared < fields.address_size) && (prev[shared] == fields.address[shared]))
+				{
+					++shared;
+				}
+			}
+
+			size_t significant = fields.address_size;
+
+			while ((significant > 0) && (fields.address[significant - 1] == 0))
+			{
+				--significant;
+			}
+
+			emitted = (significant > shared) ? (significant - shared) : 0;
+		}
+
+		/**
+		 * \brief A reader for compact-encoded route entries.
+		 */
+		class compact_route_reader
+		{
+			public:
+
+				/**
+				 * \brief Create a new compact_route_reader.
+				 * \param buf The buffer to read from.
+				 * \param buf_len The length of buf.
+				 */
+				compact_route_reader(const uint8_t* buf, size_t buf_len) :
+					m_buf(buf),
+					m_buf_len(buf_len),
+					m_prev_size(0)
+				{}
+
+				/**
+				 * \brief Read the next compact route contained in the buffer.
+				 * \param ir The route to read.
+				 * \return True if a route was read.
+				 */
+				bool read_next_ip_route(asiotap::ip_route& ir)
+				{
+					if (m_buf_len == 0)
+					{
+						return false;
+					}
+
+					if (m_buf_len < 3)
+					{
+						throw std::runtime_error("Not enough bytes for the expected compact route header");
+					}
+
+					const uint8_t tag = m_buf[0];
+					const uint8_t _type = tag & 0x07;
+					const size_t shared = tag >> 3;
+					const unsigned int prefix_length = m_buf[1];
+					const size_t emitted = m_buf[2];
+
+					m_buf += 3;
+					m_buf_len -= 3;
+
+					switch (_type)
+					{
+						case INAT_IPV4:
+						case INAT_IPV4_GATEWAY:
+							ir = read_route<boost::asio::ip::address_v4>(prefix_length, shared, emitted, (_type == INAT_IPV4_GATEWAY));
+
+							break;
+						case INAT_IPV6:
+						case INAT_IPV6_GATEWAY:
+							ir = read_route<boost::asio::ip::address_v6>(prefix_length, shared, emitted, (_type == INAT_IPV6_GATEWAY));
+
+							break;
+						default:
+							throw std::runtime_error("Unknown route type in compact message");
+					}
+
+					return true;
+				}
+
+			private:
+
+				template <typename AddressType>
+				asiotap::base_ip_route<AddressType> read_route(unsigned int prefix_length, size_t shared, size_t emitted, bool has_gateway)
+				{
+					typename AddressType::bytes_type bytes;
+
+					if ((shared + emitted > bytes.size()) || (shared > m_prev_size))
+					{
+						throw std::runtime_error("Invalid compact route geometry");
+					}
+
+					if (m_buf_len < emitted)
+					{
+						throw std::runtime_error("Not enough bytes for the expected compact route");
+					}
+
+					std::copy(m_prev, m_prev + shared, bytes.begin());
+					std::copy(m_buf, m_buf + emitted, bytes.begin() + shared);
+					std::fill(bytes.begin() + shared + emitted, bytes.end(), 0);
+
+					m_buf += emitted;
+					m_buf_len -= emitted;
+
+					std::copy(bytes.begin(), bytes.end(), m_prev);
+					m_prev_size = bytes.size();
+
+					if (has_gateway)
+					{
+						typename AddressType::bytes_type gateway_bytes;
+
+						if (m_buf_len < gateway_bytes.size())
+						{
+							throw std::runtime_error("Not enough bytes for the expected IP address");
+						}
+
+						std::copy(m_buf, m_buf + gateway_bytes.size(), gateway_bytes.begin());
+
+						m_buf += gateway_bytes.size();
+						m_buf_len -= gateway_bytes.size();
+
+						return asiotap::base_ip_route<AddressType>(asiotap::base_ip_network_address<AddressType>(AddressType(bytes), prefix_length), AddressType(gateway_bytes));
+					}
+					else
+					{
+						return asiotap::base_ip_route<AddressType>(asiotap::base_ip_network_address<AddressType>(AddressType(bytes), prefix_length));
+					}
+				}
+
+				const uint8_t* m_buf;
+				size_t m_buf_len;
+				uint8_t m_prev[16];
+				size_t m_prev_size;
+		};
+
+		/**
+		 * \brief A visitor that computes the representation size of a network address without writing it.
+		 */
+		class ip_network_address_representation_size : public boost::static_visitor<size_t>
+		{
+			public:
+
+				/**
+				 * \brief Get the representation size of the route.
+				 * \param ir The ip_route.
+				 * \return The representation size.
+				 */
+				template <typename AddressType>
+				result_type operator()(const asiotap::base_ip_route<AddressType>& ir) const
+				{
+					const size_t address_size = sizeof(typename AddressType::bytes_type);
+
+					return 2 + address_size + (ir.gateway() ? address_size : 0);
+				}
+		};
+
 		/**
 		 * \brief A visitor that writes the representation of a network address to a buffer.
 		 */
@@ -231,6 +453,123 @@ namespace freelan
 		};
 	}
 
+	size_t routes_message::required_size(const asiotap::ip_route_set& routes)
+	{
+		size_t result = HEADER_LENGTH + sizeof(uint32_t);
+
+		for (auto&& route : routes)
+		{
+			result += boost::apply_visitor(ip_network_address_representation_size(), route);
+		}
+
+		return result;
+	}
+
+	size_t routes_message::required_size_compact(const asiotap::ip_route_set& routes)
+	{
+		size_t result = HEADER_LENGTH + sizeof(uint32_t);
+
+		uint8_t prev[16];
+		size_t prev_size = 0;
+
+		for (auto&& route : routes)
+		{
+			const route_fields_type fields = boost::apply_visitor(route_fields_extractor(), route);
+
+			size_t shared = 0;
+			size_t emitted = 0;
+
+			compact_entry_geometry(fields, prev, prev_size, shared, emitted);
+
+			result += 3 + emitted + (fields.has_gateway ? fields.address_size : 0);
+
+			std::copy(fields.address, fields.address + fields.address_size, prev);
+			prev_size = fields.address_size;
+		}
+
+		return result;
+	}
+
+	size_t routes_message::write_compact(void* buf, size_t buf_len, version_type _version, const asiotap::ip_route_set& routes)
+	{
+		if (buf_len < HEADER_LENGTH + sizeof(uint32_t))
+		{
+			throw std::runtime_error("buf_len");
+		}
+
+		size_t required_size = 0;
+		uint8_t* pbuf = static_cast<uint8_t*>(buf) + HEADER_LENGTH;
+		size_t pbuf_len = buf_len - HEADER_LENGTH;
+
+		fscp::buffer_tools::set<uint32_t>(pbuf, 0, htonl(static_cast<uint32_t>(_version)));
+
+		required_size += sizeof(uint32_t);
+		pbuf += sizeof(uint32_t);
+		pbuf_len -= sizeof(uint32_t);
+
+		uint8_t prev[16];
+		size_t prev_size = 0;
+
+		for (auto&& route : routes)
+		{
+			const route_fields_type fields = boost::apply_visitor(route_fields_extractor(), route);
+
+			size_t shared = 0;
+			size_t emitted = 0;
+
+			compact_entry_geometry(fields, prev, prev_size, shared, emitted);
+
+			const size_t count = 3 + emitted + (fields.has_gateway ? fields.address_size : 0);
+
+			if (pbuf_len < count)
+			{
+				throw std::runtime_error("buf_len");
+			}
+
+			pbuf[0] = static_cast<uint8_t>(fields.type) | static_cast<uint8_t>(shared << 3);
+			pbuf[1] = fields.prefix_length;
+			pbuf[2] = static_cast<uint8_t>(emitted);
+
+			std::copy(fields.address + shared, fields.address + shared + emitted, pbuf + 3);
+
+			if (fields.has_gateway)
+			{
+				std::copy(fields.gateway, fields.gateway + fields.address_size, pbuf + 3 + emitted);
+			}
+
+			required_size += count;
+			pbuf += count;
+			pbuf_len -= count;
+
+			std::copy(fields.address, fields.address + fields.address_size, prev);
+			prev_size = fields.address_size;
+		}
+
+		return message::write(buf, buf_len, MT_ROUTES_COMPACT, required_size);
+	}
+
+	size_t routes_message::required_size_delta(const asiotap::ip_route_set& added, const asiotap::ip_route_set& removed)
+	{
+		size_t result = HEADER_LENGTH + 2 * sizeof(uint32_t) + 2 * sizeof(uint16_t);
+
+		for (auto&& route : added)
+		{
+			result += boost::apply_visitor(ip_network_address_representation_size(), route);
+		}
+
+		for (auto&& route : removed)
+		{
+			result += boost::apply_visitor(ip_network_address_representation_size(), route);
+		}
+
+		return result;
+	}
+
+	size_t routes_message::required_size_digest()
+	{
+		return HEADER_LENGTH + 2 * sizeof(uint32_t);
+	}
+
 	size_t routes_message::write(void* buf, size_t buf_len, version_type _version, const asiotap::ip_route_set& routes)
 	{
 		if (buf_len < HEADER_LENGTH)
@@ -260,15 +599,158 @@ namespace freelan
 		return message::write(buf, buf_len, MT_ROUTES, required_size);
 	}
 
+	routes_message::checksum_type routes_message::compute_checksum(const asiotap::ip_route_set& routes)
+	{
+		// FNV-1a over the serialized representation of every route. The set is ordered, so
+		// two peers holding the same routes always fold them in the same order.
+		uint32_t result = 2166136261UL;
+
+		for (auto&& route : routes)
+		{
+			uint8_t entry[2 + 2 * 16];
+
+			const size_t count = boost::apply_visitor(ip_network_address_representation<uint8_t*>(entry, sizeof(entry)), route);
+
+			for (size_t i = 0; i < count; ++i)
+			{
+				result = (result ^ entry[i]) * 16777619UL;
+			}
+		}
+
+		return static_cast<checksum_type>(result);
+	}
+
+	size_t routes_message::write_delta(void* buf, size_t buf_len, version_type _version, checksum_type _checksum, const asiotap::ip_route_set& added, const asiotap::ip_route_set& removed)
+	{
+		if ((added.size() > 0xffff) || (removed.size() > 0xffff))
+		{
+			throw std::runtime_error("route count");
+		}
+
+		if (buf_len < HEADER_LENGTH + 2 * sizeof(uint32_t) + 2 * sizeof(uint16_t))
+		{
+			throw std::runtime_error("buf_len");
+		}
+
+		size_t required_size = 0;
+		uint8_t* pbuf = static_cast<uint8_t*>(buf) + HEADER_LENGTH;
+		size_t pbuf_len = buf_len - HEADER_LENGTH;
+
+		fscp::buffer_tools::set<uint32_t>(pbuf, 0, htonl(static_cast<uint32_t>(_version)));
+		fscp::buffer_tools::set<uint32_t>(pbuf, sizeof(uint32_t), htonl(static_cast<uint32_t>(_checksum)));
+		fscp::buffer_tools::set<uint16_t>(pbuf, 2 * sizeof(uint32_t), htons(static_cast<uint16_t>(added.size())));
+		fscp::buffer_tools::set<uint16_t>(pbuf, 2 * sizeof(uint32_t) + sizeof(uint16_t), htons(static_cast<uint16_t>(removed.size())));
+
+		required_size += 2 * sizeof(uint32_t) + 2 * sizeof(uint16_t);
+		pbuf += 2 * sizeof(uint32_t) + 2 * sizeof(uint16_t);
+		pbuf_len -= 2 * sizeof(uint32_t) + 2 * sizeof(uint16_t);
+
+		for (auto&& route : added)
+		{
+			const size_t count = boost::apply_visitor(ip_network_address_representation<uint8_t*>(pbuf, pbuf_len), route);
+
+			required_size += count;
+			pbuf += count;
+			pbuf_len -= count;
+		}
+
+		for (auto&& route : removed)
+		{
+			const size_t count = boost::apply_visitor(ip_network_address_representation<uint8_t*>(pbuf, pbuf_len), route);
+
+			required_size += count;
+			pbuf += count;
+			pbuf_len -= count;
+		}
+
+		return message::write(buf, buf_len, MT_ROUTES_DELTA, required_size);
+	}
+
+	size_t routes_message::write_digest(void* buf, size_t buf_len, version_type _version, checksum_type _checksum)
+	{
+		if (buf_len < HEADER_LENGTH + 2 * sizeof(uint32_t))
+		{
+			throw std::runtime_error("buf_len");
+		}
+
+		uint8_t* pbuf = static_cast<uint8_t*>(buf) + HEADER_LENGTH;
+
+		fscp::buffer_tools::set<uint32_t>(pbuf, 0, htonl(static_cast<uint32_t>(_version)));
+		fscp::buffer_tools::set<uint32_t>(pbuf, sizeof(uint32_t), htonl(static_cast<uint32_t>(_checksum)));
+
+		return message::write(buf, buf_len, MT_ROUTES_DIGEST, 2 * sizeof(uint32_t));
+	}
+
 	routes_message::version_type routes_message::version() const
 	{
 		return ntohl(static_cast<version_type>(fscp::buffer_tools::get<uint32_t>(payload(), 0)));
 	}
 
+	asiotap::ip_route_set routes_message::take_routes()
+	{
+		routes();
+
+		asiotap::ip_route_set result = std::move(*m_routes_cache);
+		m_routes_cache = boost::none;
+
+		return result;
+	}
+
+	asiotap::ip_route_set routes_message::take_added_routes()
+	{
+		parse_delta();
+
+		asiotap::ip_route_set result = std::move(*m_added_routes_cache);
+		m_added_routes_cache = boost::none;
+
+		return result;
+	}
+
+	asiotap::ip_route_set routes_message::take_removed_routes()
+	{
+		parse_delta();
+
+		asiotap::ip_route_set result = std::move(*m_removed_routes_cache);
+		m_removed_routes_cache = boost::none;
+
+		return result;
+	}
+
+	void routes_message::parse_compact() const
+	{
+		if (length() < sizeof(uint32_t))
+		{
+			throw std::runtime_error("Not enough bytes for the compact routes header");
+		}
+
+		asiotap::ip_route_set result;
+
+		const uint8_t* pbuf = payload() + sizeof(uint32_t);
+		size_t pbuf_len = length() - sizeof(uint32_t);
+
+		compact_route_reader reader(pbuf, pbuf_len);
+
+		asiotap::ip_route ir;
+
+		while (reader.read_next_ip_route(ir))
+		{
+			result.insert(ir);
+		}
+
+		m_routes_cache = result;
+	}
+
 	const asiotap::ip_route_set& routes_message::routes() const
 	{
 		if (!m_routes_cache)
 		{
+			if (type() == MT_ROUTES_COMPACT)
+			{
+				parse_compact();
+
+				return *m_routes_cache;
+			}
+
 			asiotap::ip_route_set result;
 
 			const uint8_t* pbuf = payload() + sizeof(uint32_t);
@@ -289,15 +771,112 @@ namespace freelan
 		return *m_routes_cache;
 	}
 
+	routes_message::checksum_type routes_message::checksum() const
+	{
+		return ntohl(static_cast<checksum_type>(fscp::buffer_tools::get<uint32_t>(payload(), sizeof(uint32_t))));
+	}
+
+	const asiotap::ip_route_set& routes_message::added_routes() const
+	{
+		parse_delta();
+
+		return *m_added_routes_cache;
+	}
+
+	const asiotap::ip_route_set& routes_message::removed_routes() const
+	{
+		parse_delta();
+
+		return *m_removed_routes_cache;
+	}
+
+	void routes_message::parse_delta() const
+	{
+		if (m_added_routes_cache)
+		{
+			return;
+		}
+
+		if (length() < 2 * sizeof(uint32_t) + 2 * sizeof(uint16_t))
+		{
+			throw std::runtime_error("Not enough bytes for the routes delta header");
+		}
+
+		const size_t added_count = ntohs(fscp::buffer_tools::get<uint16_t>(payload(), 2 * sizeof(uint32_t)));
+		const size_t removed_count = ntohs(fscp::buffer_tools::get<uint16_t>(payload(), 2 * sizeof(uint32_t) + sizeof(uint16_t)));
+
+		const uint8_t* pbuf = payload() + 2 * sizeof(uint32_t) + 2 * sizeof(uint16_t);
+		size_t pbuf_len = length() - 2 * sizeof(uint32_t) - 2 * sizeof(uint16_t);
+
+		ip_network_address_representation<const uint8_t*> deserializer(pbuf, pbuf_len);
+
+		asiotap::ip_route_set added;
+		asiotap::ip_route_set removed;
+		asiotap::ip_route ir;
+
+		for (size_t i = 0; i < added_count; ++i)
+		{
+			if (!deserializer.read_next_ip_route(ir))
+			{
+				throw std::runtime_error("Truncated routes delta message");
+			}
+
+			added.insert(ir);
+		}
+
+		for (size_t i = 0; i < removed_count; ++i)
+		{
+			if (!deserializer.read_next_ip_route(ir))
+			{
+				throw std::runtime_error("Truncated routes delta message");
+			}
+
+			removed.insert(ir);
+		}
+
+		m_added_routes_cache = added;
+		m_removed_routes_cache = removed;
+	}
+
+	void routes_message::check_digest() const
+	{
+		if (length() < 2 * sizeof(uint32_t))
+		{
+			throw std::runtime_error("Not enough bytes for the routes digest");
+		}
+	}
+
 	routes_message::routes_message(const void* buf, size_t buf_len) :
 		message(buf, buf_len)
 	{
-		routes();
+		if (type() == MT_ROUTES_DELTA)
+		{
+			parse_delta();
+		}
+		else if (type() == MT_ROUTES_DIGEST)
+		{
+			check_digest();
+		}
+		else
+		{
+			routes();
+		}
 	}
 
 	routes_message::routes_message(const message& _message) :
 		message(_message)
 	{
-		routes();
+		if (type() == MT_ROUTES_DELTA)
+		{
+			parse_delta();
+		}
+		else if (type() == MT_ROUTES_DIGEST)
+		{
+			check_digest();
+		}
+		else
+		{
+			routes();
+		}
 	}
 }
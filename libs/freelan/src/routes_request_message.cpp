@@ -49,6 +49,11 @@
 
 namespace freelan
 {
+	size_t routes_request_message::required_size()
+	{
+		return HEADER_LENGTH;
+	}
+
 	size_t routes_request_message::write(void* buf, size_t buf_len)
 	{
 		return message::write(buf, buf_len, MT_ROUTES_REQUEST, 0);
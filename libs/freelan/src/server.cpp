@@ -54,8 +54,15 @@
 #include <boost/date_time/c_local_time_adjustor.hpp>
 
 #include <kfather/formatter.hpp>
+#include <kfather/serializer.hpp>
+
+#include <fscp/metrics.hpp>
+#include <fscp/buffer_pool.hpp>
+
+#include <cryptoplus/allocation_stats.hpp>
 
 #include <cassert>
+#include <cstring>
 
 namespace freelan
 {
@@ -146,11 +153,93 @@ namespace freelan
 
 			return result;
 		}
+
+		template <typename Type>
+		void pcapng_append(std::string& out, Type value)
+		{
+			// pcapng is written in the writer's byte order: the section header magic lets readers detect it.
+			out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+		}
+
+		void pcapng_append_padded(std::string& out, const void* buf, size_t size)
+		{
+			out.append(static_cast<const char*>(buf), size);
+
+			while ((out.size() % 4) != 0)
+			{
+				out.push_back('\0');
+			}
+		}
+
+		std::string to_pcapng(const std::vector<freelan::capture_ring::frame_type>& frames)
+		{
+			std::string out;
+
+			// The section header block.
+			pcapng_append<uint32_t>(out, 0x0a0d0d0a);
+			pcapng_append<uint32_t>(out, 28);
+			pcapng_append<uint32_t>(out, 0x1a2b3c4d);
+			pcapng_append<uint16_t>(out, 1);
+			pcapng_append<uint16_t>(out, 0);
+			pcapng_append<uint64_t>(out, 0xffffffffffffffffULL);
+			pcapng_append<uint32_t>(out, 28);
+
+			// One interface per pipeline stage, so the stage tags survive in any pcapng reader: the interface identifier of a packet block is its capture_ring::stage_type value.
+			for (size_t stage = 0; stage < freelan::capture_ring::STAGE_COUNT; ++stage)
+			{
+				const char* const name = freelan::capture_ring::stage_name(static_cast<freelan::capture_ring::stage_type>(stage));
+				const size_t name_size = std::strlen(name);
+				const size_t padded_name_size = (name_size + 3) & ~static_cast<size_t>(3);
+				const uint32_t block_length = static_cast<uint32_t>(20 + 4 + padded_name_size + 4);
+
+				pcapng_append<uint32_t>(out, 1);
+				pcapng_append<uint32_t>(out, block_length);
+				pcapng_append<uint16_t>(out, 1); // LINKTYPE_ETHERNET
+				pcapng_append<uint16_t>(out, 0);
+				pcapng_append<uint32_t>(out, freelan::capture_ring::SNAP_LENGTH);
+
+				// The if_name option.
+				pcapng_append<uint16_t>(out, 2);
+				pcapng_append<uint16_t>(out, static_cast<uint16_t>(name_size));
+				pcapng_append_padded(out, name, name_size);
+
+				// The opt_endofopt option.
+				pcapng_append<uint16_t>(out, 0);
+				pcapng_append<uint16_t>(out, 0);
+
+				pcapng_append<uint32_t>(out, block_length);
+			}
+
+			for (auto&& frame : frames)
+			{
+				const size_t padded_data_size = (frame.data.size() + 3) & ~static_cast<size_t>(3);
+				const uint32_t block_length = static_cast<uint32_t>(32 + padded_data_size);
+
+				// An enhanced packet block. The default timestamp resolution is microseconds, which is what the ring records.
+				pcapng_append<uint32_t>(out, 6);
+				pcapng_append<uint32_t>(out, block_length);
+				pcapng_append<uint32_t>(out, static_cast<uint32_t>(frame.stage));
+				pcapng_append<uint32_t>(out, static_cast<uint32_t>(frame.timestamp_us >> 32));
+				pcapng_append<uint32_t>(out, static_cast<uint32_t>(frame.timestamp_us));
+				pcapng_append<uint32_t>(out, static_cast<uint32_t>(frame.data.size()));
+				pcapng_append<uint32_t>(out, frame.original_length);
+				pcapng_append_padded(out, frame.data.empty() ? "" : reinterpret_cast<const char*>(&frame.data[0]), frame.data.size());
+				pcapng_append<uint32_t>(out, block_length);
+			}
+
+			return out;
+		}
 	}
 
-	web_server::web_server(fscp::logger& _logger, const freelan::server_configuration& configuration, authentication_handler_type authentication_handler) :
+	web_server::web_server(fscp::logger& _logger, const freelan::server_configuration& configuration, authentication_handler_type authentication_handler, statistics_handler_type statistics_handler, measurement_handler_type measurement_handler, capture_handler_type capture_handler, capture_control_handler_type capture_control_handler, establishment_handler_type establishment_handler) :
 		m_logger(_logger),
-		m_authentication_handler(authentication_handler)
+		m_authentication_handler(authentication_handler),
+		m_statistics_handler(statistics_handler),
+		m_measurement_handler(measurement_handler),
+		m_capture_handler(capture_handler),
+		m_capture_control_handler(capture_control_handler),
+		m_establishment_handler(establishment_handler),
+		m_registry_generation(0)
 	{
 		m_logger(fscp::log_level::debug) << "Web server's listen endpoint set to " << configuration.listen_on << ".";
 		set_option("listening_port", boost::lexical_cast<std::string>(configuration.listen_on));
@@ -158,8 +247,14 @@ namespace freelan
 		if (configuration.protocol == server_configuration::server_protocol_type::https)
 		{
 			set_certificate_and_private_key(configuration.server_certificate, configuration.server_private_key);
+
+			// Monitoring agents reconnect every few seconds: with a session cache those reconnections are abbreviated handshakes instead of full key exchanges.
+			set_tls_session_cache(1024, 300);
 		}
 
+		// Keep-alive clients that stopped polling should not hold their descriptors forever.
+		set_connection_idle_timeout(60);
+
 		register_authenticated_route("/request_certificate/", [this, configuration](mongooseplus::request& req) {
 			const auto session = req.get_session<session_type>();
 
@@ -209,6 +304,8 @@ namespace freelan
 			cinfop->presentation = fscp::presentation_store(cert);
 			cinfop->expires_from_now(configuration.registration_validity_duration);
 
+			bump_registry_generation();
+
 			typedef boost::date_time::c_local_adjustor<boost::posix_time::ptime> local_adjustor;
 
 			if (registered)
@@ -238,6 +335,8 @@ namespace freelan
 				m_logger(fscp::log_level::information) << session->username() << " (" << req.remote() << ") asked to be unregistered.";
 
 				m_client_information_map.erase(session->username());
+
+				bump_registry_generation();
 			}
 			else
 			{
@@ -310,6 +409,8 @@ namespace freelan
 					m_logger(fscp::log_level::information) << session->username() << " (" << req.remote() << ") set his contact information and can be joined at: " << oss.str().substr(2);
 				}
 
+				bump_registry_generation();
+
 				kfather::object_type result;
 				result.items["accepted_endpoints"] = to_json(cinfop->endpoints);
 				result.items["rejected_endpoints"] = to_json(rejected_endpoints);
@@ -332,83 +433,494 @@ namespace freelan
 			}
 			else
 			{
-				auto info = req.json();
+				// The response only depends on the registry state, the requester and the requested subset: cache the serialized body until one of them changes.
+				const std::string content(req.content(), req.content() ? req.content_size() : 0);
+				const std::string cache_key = "get_contact_information|" + session->username() + "|" + content;
 
-				m_logger(fscp::log_level::debug) << "Raw client information: " << kfather::inline_formatter().format(info);
+				return send_json_cached(req, cache_key, [this, session, &req]() {
+					auto info = req.json();
 
-				std::set<fscp::hash_type> requested_contacts;
+					m_logger(fscp::log_level::debug) << "Raw client information: " << kfather::inline_formatter().format(info);
 
-				for(auto&& hash_obj : kfather::value_cast<kfather::object_type>(info).get<kfather::array_type>("requested_contacts").items)
-				{
-					const std::string hash_b64 = kfather::value_cast<std::string>(hash_obj);
+					std::set<fscp::hash_type> requested_contacts;
 
-					try
+					for(auto&& hash_obj : kfather::value_cast<kfather::object_type>(info).get<kfather::array_type>("requested_contacts").items)
 					{
-						const auto hash_buf = cryptoplus::base64_decode(hash_b64);
+						const std::string hash_b64 = kfather::value_cast<std::string>(hash_obj);
 
-						if (hash_buf.data().size() != sizeof(fscp::hash_type))
+						try
 						{
-							throw std::runtime_error("Invalid hash size");
-						}
+							const auto hash_buf = cryptoplus::base64_decode(hash_b64);
 
-						fscp::hash_type hash;
-						std::copy_n(hash_buf.data().begin(), sizeof(hash.data), hash.data.begin());
-						requested_contacts.insert(hash);
+							if (hash_buf.data().size() != sizeof(fscp::hash_type))
+							{
+								throw std::runtime_error("Invalid hash size");
+							}
+
+							fscp::hash_type hash;
+							std::copy_n(hash_buf.data().begin(), sizeof(hash.data), hash.data.begin());
+							requested_contacts.insert(hash);
+						}
+						catch (std::exception& ex)
+						{
+							m_logger(fscp::log_level::warning) << "Unable to read base 64 encoded DER certificate hash from \"" << hash_b64 << "\": " << ex.what();
+						}
 					}
-					catch (std::exception& ex)
+
+					std::map<fscp::hash_type, std::set<asiotap::endpoint>> contacts;
+
+					if (requested_contacts.empty())
 					{
-						m_logger(fscp::log_level::warning) << "Unable to read base 64 encoded DER certificate hash from \"" << hash_b64 << "\": " << ex.what();
+						m_logger(fscp::log_level::information) << session->username() << " (" << req.remote() << ") requested all contact information.";
+
+						for (auto&& cinfo_pair : m_client_information_map)
+						{
+							if (cinfo_pair.first != session->username())
+							{
+								const auto& hash = cinfo_pair.second.presentation.signature_certificate_hash();
+								contacts[hash] = cinfo_pair.second.endpoints;
+							}
+						}
 					}
-				}
+					else
+					{
+						std::ostringstream oss;
 
-				std::map<fscp::hash_type, std::set<asiotap::endpoint>> contacts;
+						for (auto&& hash : requested_contacts)
+						{
+							oss << ", " << hash;
+						}
 
-				if (requested_contacts.empty())
-				{
-					m_logger(fscp::log_level::information) << session->username() << " (" << req.remote() << ") requested all contact information.";
+						m_logger(fscp::log_level::information) << session->username() << " (" << req.remote() << ") requested contact information for: " << oss.str().substr(2);
 
-					for (auto&& cinfo_pair : m_client_information_map)
-					{
-						if (cinfo_pair.first != session->username())
+						for (auto&& cinfo_pair : m_client_information_map)
 						{
-							const auto& hash = cinfo_pair.second.presentation.signature_certificate_hash();
-							contacts[hash] = cinfo_pair.second.endpoints;
+							if (cinfo_pair.first != session->username())
+							{
+								const auto& hash = cinfo_pair.second.presentation.signature_certificate_hash();
+								if (requested_contacts.find(hash) != requested_contacts.end())
+								{
+									contacts[hash] = cinfo_pair.second.endpoints;
+								}
+							}
 						}
 					}
+
+					kfather::object_type result;
+
+					result.items["contacts"] = to_json(contacts);
+
+					return result;
+				});
+			}
+		});
+
+		register_authenticated_route("/metrics/", [this](mongooseplus::request& req) {
+			const auto session = req.get_session<session_type>();
+
+			m_logger(fscp::log_level::debug) << session->username() << " (" << req.remote() << ") requested the metrics.";
+
+			const fscp::metrics_registry& registry = fscp::metrics_registry::get_default_instance();
+
+			kfather::object_type counters;
+
+			for (auto&& item : registry.counter_values())
+			{
+				counters.items[item.first] = kfather::number_type(item.second);
+			}
+
+			kfather::object_type histograms;
+
+			for (auto&& item : registry.histogram_values())
+			{
+				kfather::object_type histogram;
+
+				histogram.items["count"] = kfather::number_type(item.second.count);
+				histogram.items["sum"] = kfather::number_type(item.second.sum);
+
+				kfather::array_type buckets;
+
+				for (auto&& bucket : item.second.buckets)
+				{
+					buckets.items.push_back(kfather::number_type(bucket));
 				}
-				else
+
+				histogram.items["buckets"] = buckets;
+
+				histograms.items[item.first] = histogram;
+			}
+
+			kfather::object_type result;
+
+			result.items["counters"] = counters;
+			result.items["histograms"] = histograms;
+
+			req.send_json(result);
+
+			return request_result::handled;
+		});
+
+		if (m_statistics_handler)
+		{
+			register_authenticated_route("/stats/", [this](mongooseplus::request& req) {
+				const auto session = req.get_session<session_type>();
+
+				m_logger(fscp::log_level::debug) << session->username() << " (" << req.remote() << ") requested the statistics.";
+
+				const statistics_type statistics = m_statistics_handler();
+
+				kfather::object_type peers;
+
+				for (auto&& peer : statistics.peers)
 				{
-					std::ostringstream oss;
+					kfather::object_type entry;
 
-					for (auto&& hash : requested_contacts)
-					{
-						oss << ", " << hash;
-					}
+					entry.items["tx_bytes"] = kfather::number_type(peer.tx_bytes);
+					entry.items["tx_packets"] = kfather::number_type(peer.tx_packets);
+					entry.items["rx_bytes"] = kfather::number_type(peer.rx_bytes);
+					entry.items["rx_packets"] = kfather::number_type(peer.rx_packets);
+					entry.items["path_mtu"] = kfather::number_type(peer.path_mtu);
+					entry.items["path_rtt_us"] = kfather::number_type(peer.path_rtt_us);
+					entry.items["path_loss_percent"] = kfather::number_type(peer.path_loss_percent);
+
+					peers.items[peer.endpoint] = entry;
+				}
+
+				kfather::object_type sessions;
+
+				sessions.items["count"] = kfather::number_type(statistics.session_count);
+
+				const fscp::metrics_registry& registry = fscp::metrics_registry::get_default_instance();
+				const auto histogram_values = registry.histogram_values();
+				const auto handshake_durations = histogram_values.find("fscp.session.handshake_duration_ms");
+
+				if (handshake_durations != histogram_values.end())
+				{
+					sessions.items["handshake_count"] = kfather::number_type(handshake_durations->second.count);
+					sessions.items["handshake_duration_ms_sum"] = kfather::number_type(handshake_durations->second.sum);
+				}
+
+				kfather::object_type switch_table;
+
+				switch_table.items["mac_table_size"] = kfather::number_type(statistics.mac_table_size);
+				switch_table.items["mac_table_hits"] = kfather::number_type(statistics.mac_table_hits);
+				switch_table.items["mac_table_misses"] = kfather::number_type(statistics.mac_table_misses);
+				switch_table.items["mac_table_evictions"] = kfather::number_type(statistics.mac_table_evictions);
+
+				kfather::object_type mac_entries;
+
+				for (auto&& mac_entry : statistics.mac_entries)
+				{
+					kfather::object_type entry;
+
+					entry.items["port"] = kfather::string_type(mac_entry.port);
+					entry.items["hits"] = kfather::number_type(mac_entry.hits);
+					entry.items["age_seconds"] = kfather::number_type(mac_entry.age_seconds);
+
+					mac_entries.items[mac_entry.address] = entry;
+				}
+
+				switch_table.items["entries"] = mac_entries;
+
+				kfather::object_type rate_limits;
+
+				for (auto&& rate_limit_entry : statistics.rate_limit_entries)
+				{
+					kfather::object_type in;
+
+					in.items["passed_packets"] = kfather::number_type(rate_limit_entry.in_passed_packets);
+					in.items["passed_bytes"] = kfather::number_type(rate_limit_entry.in_passed_bytes);
+					in.items["dropped_packets"] = kfather::number_type(rate_limit_entry.in_dropped_packets);
+					in.items["dropped_bytes"] = kfather::number_type(rate_limit_entry.in_dropped_bytes);
+
+					kfather::object_type out;
+
+					out.items["passed_packets"] = kfather::number_type(rate_limit_entry.out_passed_packets);
+					out.items["passed_bytes"] = kfather::number_type(rate_limit_entry.out_passed_bytes);
+					out.items["dropped_packets"] = kfather::number_type(rate_limit_entry.out_dropped_packets);
+					out.items["dropped_bytes"] = kfather::number_type(rate_limit_entry.out_dropped_bytes);
+
+					kfather::object_type entry;
 
-					m_logger(fscp::log_level::information) << session->username() << " (" << req.remote() << ") requested contact information for: " << oss.str().substr(2);
+					entry.items["in"] = in;
+					entry.items["out"] = out;
 
-					for (auto&& cinfo_pair : m_client_information_map)
+					rate_limits.items[rate_limit_entry.name] = entry;
+				}
+
+				const fscp::buffer_pool::statistics_type buffer_statistics = fscp::buffer_pool::instance().statistics();
+
+				kfather::object_type buffers;
+
+				buffers.items["allocation_count"] = kfather::number_type(buffer_statistics.allocation_count);
+				buffers.items["reuse_count"] = kfather::number_type(buffer_statistics.reuse_count);
+				buffers.items["pooled_buffer_count"] = kfather::number_type(buffer_statistics.pooled_buffer_count);
+				buffers.items["pooled_bytes"] = kfather::number_type(buffer_statistics.pooled_bytes);
+				buffers.items["arena_size"] = kfather::number_type(buffer_statistics.arena_size);
+				buffers.items["arena_used_bytes"] = kfather::number_type(buffer_statistics.arena_used_bytes);
+				buffers.items["budget_bytes"] = kfather::number_type(buffer_statistics.budget_bytes);
+				buffers.items["outstanding_bytes"] = kfather::number_type(buffer_statistics.outstanding_bytes);
+				buffers.items["pressure"] = kfather::number_type(buffer_statistics.pressure);
+
+				kfather::array_type size_classes;
+
+				for (auto&& size_class : buffer_statistics.size_classes)
+				{
+					kfather::object_type entry;
+
+					entry.items["capacity"] = kfather::number_type(size_class.capacity);
+					entry.items["acquisition_count"] = kfather::number_type(size_class.acquisition_count);
+					entry.items["pooled_count"] = kfather::number_type(size_class.pooled_count);
+					entry.items["pooled_cap"] = kfather::number_type(size_class.pooled_cap);
+
+					size_classes.items.push_back(entry);
+				}
+
+				buffers.items["size_classes"] = size_classes;
+
+				kfather::object_type sockets;
+
+				const auto counter_values = registry.counter_values();
+				const auto socket_errors = counter_values.find("fscp.socket.errors");
+
+				sockets.items["errors"] = kfather::number_type(socket_errors != counter_values.end() ? socket_errors->second : 0);
+
+				kfather::object_type queues;
+				kfather::object_type strands;
+
+				for (auto&& strand : statistics.strand_pending)
+				{
+					strands.items[strand.first] = kfather::number_type(strand.second);
+				}
+
+				queues.items["strand_pending"] = strands;
+				queues.items["socket_receive_queue_bytes"] = kfather::number_type(statistics.socket_receive_queue_bytes);
+				queues.items["socket_receive_buffer_size"] = kfather::number_type(statistics.socket_receive_buffer_size);
+				queues.items["socket_send_buffer_size"] = kfather::number_type(statistics.socket_send_buffer_size);
+				queues.items["socket_kernel_drops"] = kfather::number_type(statistics.socket_kernel_drops);
+
+				kfather::object_type drops;
+
+				for (auto&& counter : counter_values)
+				{
+					// The drop counters share the "fscp.drop." prefix; export them all so new drop points need no route change.
+					if (counter.first.compare(0, 10, "fscp.drop.") == 0)
 					{
-						if (cinfo_pair.first != session->username())
-						{
-							const auto& hash = cinfo_pair.second.presentation.signature_certificate_hash();
-							if (requested_contacts.find(hash) != requested_contacts.end())
-							{
-								contacts[hash] = cinfo_pair.second.endpoints;
-							}
-						}
+						drops.items[counter.first.substr(10)] = kfather::number_type(counter.second);
 					}
 				}
 
+				kfather::object_type allocations;
+
+				allocations.items["enabled"] = kfather::boolean_type(cryptoplus::allocation_stats::enabled());
+
+				for (auto&& tag : cryptoplus::allocation_stats::statistics())
+				{
+					kfather::object_type entry;
+
+					entry.items["allocation_count"] = kfather::number_type(tag.second.allocation_count);
+					entry.items["allocated_bytes"] = kfather::number_type(tag.second.allocated_bytes);
+					entry.items["current_bytes"] = kfather::number_type(tag.second.current_bytes);
+					entry.items["peak_bytes"] = kfather::number_type(tag.second.peak_bytes);
+
+					allocations.items[tag.first] = entry;
+				}
+
 				kfather::object_type result;
 
-				result.items["contacts"] = to_json(contacts);
+				result.items["peers"] = peers;
+				result.items["sessions"] = sessions;
+				result.items["switch"] = switch_table;
+				result.items["rate_limits"] = rate_limits;
+				result.items["buffers"] = buffers;
+				result.items["sockets"] = sockets;
+				result.items["queues"] = queues;
+				result.items["drops"] = drops;
+				result.items["allocations"] = allocations;
 
 				req.send_json(result);
 
 				return request_result::handled;
+			});
+		}
+
+		if (m_measurement_handler)
+		{
+			register_authenticated_route("/measure/", [this](mongooseplus::request& req) {
+				const auto session = req.get_session<session_type>();
+
+				const auto info = kfather::value_cast<kfather::object_type>(req.json());
+
+				const std::string host = info.get<kfather::string_type>("host");
+				const size_t packet_count = static_cast<size_t>(info.get<kfather::number_type>("packet_count", kfather::number_type(100)));
+				const size_t packet_size = static_cast<size_t>(info.get<kfather::number_type>("packet_size", kfather::number_type(1000)));
+
+				if (host.empty())
+				{
+					throw mongooseplus::http_error(mongooseplus::mongooseplus_error::http_400_bad_request) << mongooseplus::error_content_error_info("No host specified");
+				}
+
+				m_logger(fscp::log_level::information) << session->username() << " (" << req.remote() << ") requested a link measurement to " << host << ".";
+
+				const link_measurement_type measurement = m_measurement_handler(host, packet_count, packet_size);
+
+				if (!measurement.error.empty())
+				{
+					throw mongooseplus::http_error(mongooseplus::mongooseplus_error::http_400_bad_request) << mongooseplus::error_content_error_info(measurement.error);
+				}
+
+				kfather::object_type rtt;
+
+				rtt.items["min_ms"] = kfather::number_type(measurement.rtt_min_ms);
+				rtt.items["median_ms"] = kfather::number_type(measurement.rtt_median_ms);
+				rtt.items["p90_ms"] = kfather::number_type(measurement.rtt_p90_ms);
+				rtt.items["p99_ms"] = kfather::number_type(measurement.rtt_p99_ms);
+				rtt.items["max_ms"] = kfather::number_type(measurement.rtt_max_ms);
+
+				kfather::object_type result;
+
+				result.items["host"] = kfather::string_type(host);
+				result.items["completed"] = kfather::boolean_type(measurement.completed);
+				result.items["sent"] = kfather::number_type(measurement.sent);
+				result.items["received"] = kfather::number_type(measurement.received);
+				result.items["lost"] = kfather::number_type(measurement.sent - measurement.received);
+				result.items["reordered"] = kfather::number_type(measurement.reordered);
+				result.items["duration_ms"] = kfather::number_type(measurement.duration_ms);
+				result.items["goodput_mbps"] = kfather::number_type(measurement.goodput_mbps);
+				result.items["rtt"] = rtt;
+
+				req.send_json(result);
+
+				return request_result::handled;
+			});
+		}
+
+		if (m_capture_handler)
+		{
+			register_authenticated_route("/capture/", [this](mongooseplus::request& req) {
+				const auto session = req.get_session<session_type>();
+
+				m_logger(fscp::log_level::debug) << session->username() << " (" << req.remote() << ") drained the packet capture.";
+
+				const std::vector<freelan::capture_ring::frame_type> frames = m_capture_handler();
+
+				const std::string body = to_pcapng(frames);
+
+				req.send_header("content-type", "application/octet-stream");
+				req.send_header("content-disposition", "attachment; filename=\"freelan.pcapng\"");
+				req.send_data(body);
+
+				return request_result::handled;
+			});
+
+			if (m_capture_control_handler)
+			{
+				register_authenticated_route("/capture/start/", [this](mongooseplus::request& req) {
+					const auto session = req.get_session<session_type>();
+
+					m_logger(fscp::log_level::information) << session->username() << " (" << req.remote() << ") started the packet capture.";
+
+					m_capture_control_handler(true);
+
+					kfather::object_type result;
+
+					result.items["capturing"] = kfather::boolean_type(true);
+
+					req.send_json(result);
+
+					return request_result::handled;
+				});
+
+				register_authenticated_route("/capture/stop/", [this](mongooseplus::request& req) {
+					const auto session = req.get_session<session_type>();
+
+					m_logger(fscp::log_level::information) << session->username() << " (" << req.remote() << ") stopped the packet capture.";
+
+					m_capture_control_handler(false);
+
+					kfather::object_type result;
+
+					result.items["capturing"] = kfather::boolean_type(false);
+
+					req.send_json(result);
+
+					return request_result::handled;
+				});
 			}
-		});
+		}
+
+		if (m_establishment_handler)
+		{
+			register_authenticated_route("/establishments/", [this](mongooseplus::request& req) {
+				const auto session = req.get_session<session_type>();
+
+				m_logger(fscp::log_level::debug) << session->username() << " (" << req.remote() << ") requested the establishment history.";
+
+				kfather::array_type establishments;
+
+				for (auto&& record : m_establishment_handler())
+				{
+					kfather::object_type entry;
+
+					entry.items["endpoint"] = kfather::string_type(record.endpoint);
+					entry.items["started_at_us"] = kfather::number_type(record.started_at_us);
+					entry.items["resolve_us"] = kfather::number_type(record.resolve_us);
+					entry.items["hello_us"] = kfather::number_type(record.hello_us);
+					entry.items["presentation_us"] = kfather::number_type(record.presentation_us);
+					entry.items["handshake_us"] = kfather::number_type(record.handshake_us);
+					entry.items["routes_us"] = kfather::number_type(record.routes_us);
+					entry.items["total_us"] = kfather::number_type(record.total_us);
+					entry.items["state"] = kfather::string_type(record.state);
+
+					establishments.items.push_back(entry);
+				}
+
+				kfather::object_type result;
+
+				result.items["establishments"] = establishments;
+
+				req.send_json(result);
+
+				return request_result::handled;
+			});
+		}
+	}
+
+	web_server::request_result web_server::send_json_cached(mongooseplus::request& req, const std::string& cache_key, const std::function<kfather::object_type ()>& build)
+	{
+		cached_response_type& entry = m_response_cache[cache_key];
+
+		if (entry.etag.empty())
+		{
+			entry.generation = m_registry_generation;
+			entry.body = kfather::serializer().serialize(build());
+
+			std::ostringstream oss;
+			oss << '"' << entry.generation << '-' << std::hash<std::string>()(cache_key) << '"';
+
+			entry.etag = oss.str();
+		}
+		else
+		{
+			m_logger(fscp::log_level::debug) << "Serving response to " << req.remote() << " from the generation " << entry.generation << " cache.";
+		}
+
+		const auto if_none_match = req.get_header("if-none-match");
+
+		if (if_none_match && (if_none_match->value() == entry.etag))
+		{
+			req.send_status_code(304);
+			req.send_header("etag", entry.etag);
+			req.send_data("", 0);
+
+			return request_result::handled;
+		}
+
+		req.send_header("content-type", "application/json");
+		req.send_header("etag", entry.etag);
+		req.send_data(entry.body);
+
+		return request_result::handled;
 	}
 
 	web_server::route_type& web_server::register_authenticated_route(route_type&& route)
@@ -452,6 +964,8 @@ namespace freelan
 			{
 				m_client_information_map.erase(cinfop);
 
+				bump_registry_generation();
+
 				m_logger(fscp::log_level::warning) << "Registration for " << req.remote() << " (" << session->username() << ") just expired.";
 			}
 			else
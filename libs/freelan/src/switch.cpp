@@ -46,23 +46,15 @@
 #include "switch.hpp"
 
 #include <cassert>
+#include <ctime>
 
 #include <boost/foreach.hpp>
-#include <boost/random/mersenne_twister.hpp>
-
-#include <boost/version.hpp>
-
-#if BOOST_VERSION >= 104700
-#include <boost/random/uniform_int_distribution.hpp>
-#else
-#include <boost/random/uniform_int.hpp>
-#include <boost/random/variate_generator.hpp>
-#endif
-
 #include <boost/thread/mutex.hpp>
 #include <boost/make_shared.hpp>
 
 #include <asiotap/osi/ethernet_helper.hpp>
+#include <asiotap/osi/ipv4_frame.hpp>
+#include <asiotap/osi/ipv6_frame.hpp>
 
 namespace freelan
 {
@@ -110,20 +102,31 @@ namespace freelan
 				set_type m_keys;
 				map_type m_results;
 		};
+
+		void null_port_write_handler(fscp::SharedBuffer, boost::system::error_code)
+		{
+		}
+
+		// The delay after which a port that stopped sending membership reports is considered unsubscribed. This matches the IGMPv2 group membership interval (robustness * query interval + query response interval).
+		const std::time_t MULTICAST_MEMBERSHIP_TIMEOUT = 260;
 	}
 
 	const unsigned int switch_::MAX_ENTRIES_DEFAULT = 1024;
 
-	void switch_::async_write(port_index_type index, boost::asio::const_buffer data, multi_write_handler_type handler)
+	void switch_::async_write(port_index_type index, fscp::SharedBuffer frame, boost::asio::const_buffer data, multi_write_handler_type handler)
 	{
 		typedef results_gatherer<port_index_type, boost::system::error_code, multi_write_handler_type> results_gatherer_type;
 
-		const auto targets = get_targets_for(index, data);
+		m_targets.clear();
+		get_targets_for(index, data, m_targets);
+
+		// A port may consume the frame, typically by encrypting it in place: only hand it over when there is exactly one target.
+		const fscp::SharedBuffer port_frame = (m_targets.size() == 1) ? frame : fscp::SharedBuffer();
 
 #if FREELAN_DEBUG
-		if (!targets.empty())
+		if (!m_targets.empty())
 		{
-			std::cerr << "Switching " << buffer_size(data) << " byte(s) of data from " << index << " to " << targets.size() << " host(s)." << std::endl;
+			std::cerr << "Switching " << buffer_size(data) << " byte(s) of data from " << index << " to " << m_targets.size() << " host(s)." << std::endl;
 		}
 		else
 		{
@@ -131,19 +134,59 @@ namespace freelan
 		}
 #endif
 
-		boost::shared_ptr<results_gatherer_type> rg = boost::make_shared<results_gatherer_type>(handler, targets);
+		// Multi-target writes are scattered through the post function when one is set: each call carries its own
+		// copy of the port, so only the target resolution above needs to be serialized with registration changes.
+		const bool scatter = m_post_function && (m_targets.size() > 1);
 
-		for (auto&& target : targets)
+		if (!handler)
+		{
+			// The caller does not want the per-port results: skip the results gatherer and its per-frame containers entirely.
+			// The frame is bound into every port handler so it outlives all the writes, as the gatherer's handler used to.
+			for (auto&& target : m_targets)
+			{
+#if FREELAN_DEBUG
+				std::cerr << index << "-> " << target << std::endl;
+#endif
+
+				const port_type::write_handler_type port_handler = boost::bind(&null_port_write_handler, frame, _1);
+
+				if (scatter)
+				{
+					m_post_function(boost::bind(&port_type::async_write, m_ports[target], port_frame, data, port_handler));
+				}
+				else
+				{
+					m_ports[target].async_write(port_frame, data, port_handler);
+				}
+			}
+
+			return;
+		}
+
+		const std::set<port_index_type> keys(m_targets.begin(), m_targets.end());
+
+		boost::shared_ptr<results_gatherer_type> rg = boost::make_shared<results_gatherer_type>(handler, keys);
+
+		for (auto&& target : m_targets)
 		{
 #if FREELAN_DEBUG
 			std::cerr << index << "-> " << target << std::endl;
 #endif
 
-			m_ports[target].async_write(data, boost::bind(&results_gatherer_type::gather, rg, target, _1));
+			const port_type::write_handler_type port_handler = boost::bind(&results_gatherer_type::gather, rg, target, _1);
+
+			if (scatter)
+			{
+				m_post_function(boost::bind(&port_type::async_write, m_ports[target], port_frame, data, port_handler));
+			}
+			else
+			{
+				m_ports[target].async_write(port_frame, data, port_handler);
+			}
 		}
 	}
 
-	std::set<port_index_type> switch_::get_targets_for(port_index_type index, boost::asio::const_buffer data)
+	void switch_::get_targets_for(port_index_type index, boost::asio::const_buffer data, target_list_type& targets)
 	{
 		const port_list_type::iterator source_port_entry = m_ports.find(index);
 
@@ -153,105 +196,459 @@ namespace freelan
 			{
 				case switch_configuration::RM_HUB:
 				{
-					return get_targets_for(source_port_entry);
+					get_targets_for(source_port_entry, targets);
+
+					return;
 				}
 				case switch_configuration::RM_SWITCH:
 				{
-					asiotap::osi::const_helper<asiotap::osi::ethernet_frame> ethernet_helper(data);
+					// The frames may carry a fixed prefix (such as a virtio-net header) which has to be skipped before the ethernet header.
+					asiotap::osi::const_helper<asiotap::osi::ethernet_frame> ethernet_helper(data + m_parse_offset);
 
 					const ethernet_address_type target_address = to_ethernet_address(ethernet_helper.target());
 
 					if (is_multicast_address(target_address))
 					{
-						return get_targets_for(source_port_entry);
+						if (m_configuration.multicast_snooping_enabled)
+						{
+							snoop_multicast(index, data + m_parse_offset);
+
+							// When the group is known, only its subscribed ports get the frame. Unknown (and link-local control) groups are flooded, as before.
+							if (get_multicast_targets_for(source_port_entry, target_address, targets))
+							{
+								return;
+							}
+						}
+
+						get_targets_for(source_port_entry, targets);
 					}
 					else
 					{
-						m_ethernet_address_map[to_ethernet_address(ethernet_helper.sender())] = index;
+						forwarding_cache_entry_type& cache_entry = m_forwarding_cache[index];
 
-						// We exceeded the maximum count for entries: we delete random entries to fix it.
-						while (m_ethernet_address_map.size() > m_max_entries)
+						if ((cache_entry.ports_generation == m_ports_generation) && (cache_entry.mac_generation == m_mac_table.generation()) && (cache_entry.target_address == target_address))
 						{
-							ethernet_address_map_type::iterator entry = m_ethernet_address_map.begin();
+							// Same source, same destination, nothing changed since the decision was
+							// made: the frame is forwarded without any table lookup. The sender is
+							// still relearned once per second to keep its own entry fresh.
+							const std::time_t now = std::time(NULL);
 
-#if BOOST_VERSION >= 104700
-							boost::random::mt19937 gen;
+							if (now != cache_entry.last_learn)
+							{
+								m_mac_table.learn(to_ethernet_address(ethernet_helper.sender()), index);
 
-							std::advance(entry, boost::random::uniform_int_distribution<>(0, static_cast<int>(m_ethernet_address_map.size()) - 1)(gen));
-#else
-							boost::mt19937 gen;
+								cache_entry.last_learn = now;
+								cache_entry.mac_generation = m_mac_table.generation();
+							}
 
-							boost::variate_generator<boost::mt19937&, boost::uniform_int<> > vgen(gen, boost::uniform_int<>(0, m_ethernet_address_map.size() - 1));
-							std::advance(entry, vgen());
-#endif
+							targets.push_back(cache_entry.target);
 
-							m_ethernet_address_map.erase(entry);
+							return;
 						}
 
-						// We look in the ethernet address map
+						// The table ages stale entries out and evicts the least recently used one when full: no random purge is needed anymore.
+						m_mac_table.learn(to_ethernet_address(ethernet_helper.sender()), index);
 
-						const ethernet_address_map_type::iterator target_entry = m_ethernet_address_map.find(target_address);
+						port_index_type target_port_index;
 
-						if (target_entry == m_ethernet_address_map.end())
+						if (!m_mac_table.lookup(target_address, target_port_index))
 						{
 							// No target entry: we send the message to everybody.
-							return get_targets_for(source_port_entry);
+							get_targets_for(source_port_entry, targets);
 						}
-
-						const port_index_type target_port_index = target_entry->second;
-
-						if (!is_registered(target_port_index))
+						else if (!is_registered(target_port_index))
 						{
 							// The port does not exist: we delete the entry and send to everybody.
-							m_ethernet_address_map.erase(target_entry);
+							m_mac_table.erase(target_address);
 
-							return get_targets_for(source_port_entry);
+							get_targets_for(source_port_entry, targets);
 						}
+						else
+						{
+							// Remember the decision so the next frames of this flow skip the lookups.
+							cache_entry.ports_generation = m_ports_generation;
+							cache_entry.mac_generation = m_mac_table.generation();
+							cache_entry.target_address = target_address;
+							cache_entry.target = target_port_index;
+							cache_entry.last_learn = std::time(NULL);
+
+							targets.push_back(target_port_index);
+						}
+					}
 
-						std::set<port_index_type> targets;
+					return;
+				}
+			}
+		}
+	}
 
-						targets.insert(target_port_index);
+	void switch_::get_targets_for(port_list_type::const_iterator source_port_entry, target_list_type& targets)
+	{
+		if (m_configuration.relay_mode_enabled)
+		{
+			for (group_members_type::const_iterator group_entry = m_group_members.begin(); group_entry != m_group_members.end(); ++group_entry)
+			{
+				for (target_list_type::const_iterator member = group_entry->second.begin(); member != group_entry->second.end(); ++member)
+				{
+					if (*member != source_port_entry->first)
+					{
+						targets.push_back(*member);
+					}
+				}
+			}
+		}
+		else
+		{
+			const port_group_type source_group = source_port_entry->second.group();
+
+			for (group_members_type::const_iterator group_entry = m_group_members.begin(); group_entry != m_group_members.end(); ++group_entry)
+			{
+				// Ports never relay to their own group, so the source's group - and thus the source itself - is skipped as a whole and the other lists are copied without any per-port check.
+				if (group_entry->first != source_group)
+				{
+					targets.insert(targets.end(), group_entry->second.begin(), group_entry->second.end());
+				}
+			}
+		}
+	}
+
+	bool switch_::get_multicast_targets_for(port_list_type::const_iterator source_port_entry, const mac_table::ethernet_address_type& target_address, target_list_type& targets)
+	{
+		// Link-local control groups (224.0.0.0/24 and the low ff02:: groups) carry routing and membership traffic whose listeners never report: those are always flooded.
+		const ethernet_address_type::data_type& bytes = target_address.data();
+
+		if ((bytes[0] == 0x01) && (bytes[1] == 0x00) && (bytes[2] == 0x5e) && (bytes[3] == 0x00) && (bytes[4] == 0x00))
+		{
+			return false;
+		}
+
+		if ((bytes[0] == 0x33) && (bytes[1] == 0x33) && (bytes[2] == 0x00) && (bytes[3] == 0x00) && (bytes[4] == 0x00))
+		{
+			return false;
+		}
+
+		const multicast_table_type::iterator entry = m_multicast_table.find(target_address);
+
+		if (entry == m_multicast_table.end())
+		{
+			return false;
+		}
+
+		const std::time_t now = std::time(NULL);
+
+		for (multicast_members_type::iterator member = entry->second.begin(); member != entry->second.end();)
+		{
+			if (now - member->second > MULTICAST_MEMBERSHIP_TIMEOUT)
+			{
+				entry->second.erase(member++);
+			}
+			else
+			{
+				const port_list_type::const_iterator port_entry = m_ports.find(member->first);
 
-						return targets;
+				if ((port_entry != m_ports.end()) && (port_entry != source_port_entry))
+				{
+					if (m_configuration.relay_mode_enabled || (source_port_entry->second.group() != port_entry->second.group()))
+					{
+						targets.push_back(member->first);
 					}
 				}
+
+				++member;
+			}
+		}
+
+		if (entry->second.empty())
+		{
+			m_multicast_table.erase(entry);
+
+			return false;
+		}
+
+		return true;
+	}
+
+	void switch_::remove_port_from_group(port_index_type index, port_group_type group)
+	{
+		const group_members_type::iterator group_entry = m_group_members.find(group);
+
+		if (group_entry != m_group_members.end())
+		{
+			// The lists are unordered: the removed member is swapped with the last one so removal stays cheap.
+			const target_list_type::iterator member = std::find(group_entry->second.begin(), group_entry->second.end(), index);
+
+			if (member != group_entry->second.end())
+			{
+				*member = group_entry->second.back();
+				group_entry->second.pop_back();
+			}
+
+			if (group_entry->second.empty())
+			{
+				m_group_members.erase(group_entry);
 			}
 		}
+	}
+
+	switch_::ethernet_address_type switch_::ipv4_multicast_to_ethernet(const uint8_t* address)
+	{
+		ethernet_address_type::data_type data;
+
+		data[0] = 0x01;
+		data[1] = 0x00;
+		data[2] = 0x5e;
+		data[3] = address[1] & 0x7f;
+		data[4] = address[2];
+		data[5] = address[3];
+
+		return ethernet_address_type(data);
+	}
 
-		return std::set<port_index_type>();
+	switch_::ethernet_address_type switch_::ipv6_multicast_to_ethernet(const uint8_t* address)
+	{
+		ethernet_address_type::data_type data;
+
+		data[0] = 0x33;
+		data[1] = 0x33;
+		data[2] = address[12];
+		data[3] = address[13];
+		data[4] = address[14];
+		data[5] = address[15];
+
+		return ethernet_address_type(data);
 	}
 
-	std::set<port_index_type> switch_::get_targets_for(port_list_type::const_iterator source_port_entry)
+	void switch_::snoop_multicast(port_index_type index, boost::asio::const_buffer frame)
 	{
-		std::set<port_index_type> targets;
+		const uint8_t* const data = boost::asio::buffer_cast<const uint8_t*>(frame);
+		const size_t data_len = boost::asio::buffer_size(frame);
+		const std::time_t now = std::time(NULL);
+
+		if (data_len < sizeof(asiotap::osi::ethernet_frame))
+		{
+			return;
+		}
+
+		const uint16_t protocol = static_cast<uint16_t>((data[12] << 8) | data[13]);
 
-		for (port_list_type::const_iterator port_entry = m_ports.begin(); port_entry != m_ports.end(); ++port_entry)
+		if (protocol == asiotap::osi::IP_PROTOCOL)
 		{
-			if (source_port_entry != port_entry)
+			// IGMP rides directly over IPv4, as protocol 2.
+			const uint8_t* const ip = data + sizeof(asiotap::osi::ethernet_frame);
+
+			if ((data_len < sizeof(asiotap::osi::ethernet_frame) + 20) || ((ip[0] >> 4) != asiotap::osi::IP_PROTOCOL_VERSION_4))
 			{
-				if (m_configuration.relay_mode_enabled || (source_port_entry->second.group() != port_entry->second.group()))
+				return;
+			}
+
+			const size_t ip_header_len = static_cast<size_t>(ip[0] & 0x0f) * 4;
+
+			if ((ip_header_len < 20) || (data_len < sizeof(asiotap::osi::ethernet_frame) + ip_header_len + 8) || (ip[9] != 2))
+			{
+				return;
+			}
+
+			const uint8_t* const igmp = ip + ip_header_len;
+			const size_t igmp_len = data_len - sizeof(asiotap::osi::ethernet_frame) - ip_header_len;
+
+			switch (igmp[0])
+			{
+				case 0x12: // IGMPv1 membership report.
+				case 0x16: // IGMPv2 membership report.
 				{
-					targets.insert(port_entry->first);
+					multicast_join(ipv4_multicast_to_ethernet(igmp + 4), index, now);
+
+					break;
+				}
+				case 0x17: // IGMPv2 leave group.
+				{
+					multicast_leave(ipv4_multicast_to_ethernet(igmp + 4), index);
+
+					break;
+				}
+				case 0x22: // IGMPv3 membership report.
+				{
+					size_t record_count = static_cast<size_t>((igmp[6] << 8) | igmp[7]);
+					size_t offset = 8;
+
+					while (record_count-- > 0)
+					{
+						if (igmp_len < offset + 8)
+						{
+							return;
+						}
+
+						const uint8_t record_type = igmp[offset];
+						const size_t aux_len = static_cast<size_t>(igmp[offset + 1]) * 4;
+						const size_t source_count = static_cast<size_t>((igmp[offset + 2] << 8) | igmp[offset + 3]);
+
+						if (igmp_len < offset + 8 + source_count * 4 + aux_len)
+						{
+							return;
+						}
+
+						// MODE_IS_INCLUDE and CHANGE_TO_INCLUDE with no sources mean the port left the group: every other record type means it wants the traffic. We do not track per-source filters - the port simply gets the whole group.
+						if (((record_type == 1) || (record_type == 3)) && (source_count == 0))
+						{
+							multicast_leave(ipv4_multicast_to_ethernet(igmp + offset + 4), index);
+						}
+						else
+						{
+							multicast_join(ipv4_multicast_to_ethernet(igmp + offset + 4), index, now);
+						}
+
+						offset += 8 + source_count * 4 + aux_len;
+					}
+
+					break;
 				}
 			}
 		}
+		else if (protocol == asiotap::osi::IPV6_PROTOCOL)
+		{
+			// MLD is ICMPv6, always preceded by a hop-by-hop extension header carrying the router alert option.
+			const uint8_t* const ip = data + sizeof(asiotap::osi::ethernet_frame);
 
-		return targets;
+			if ((data_len < sizeof(asiotap::osi::ethernet_frame) + 40) || ((ip[0] >> 4) != asiotap::osi::IP_PROTOCOL_VERSION_6))
+			{
+				return;
+			}
+
+			uint8_t next_header = ip[6];
+			size_t offset = sizeof(asiotap::osi::ethernet_frame) + 40;
+
+			if (next_header == 0)
+			{
+				if (data_len < offset + 8)
+				{
+					return;
+				}
+
+				next_header = data[offset];
+				offset += (static_cast<size_t>(data[offset + 1]) + 1) * 8;
+			}
+
+			if ((next_header != 58) || (data_len < offset + 24))
+			{
+				return;
+			}
+
+			const uint8_t* const icmp = data + offset;
+			const size_t icmp_len = data_len - offset;
+
+			switch (icmp[0])
+			{
+				case 131: // MLDv1 multicast listener report.
+				{
+					multicast_join(ipv6_multicast_to_ethernet(icmp + 8), index, now);
+
+					break;
+				}
+				case 132: // MLDv1 multicast listener done.
+				{
+					multicast_leave(ipv6_multicast_to_ethernet(icmp + 8), index);
+
+					break;
+				}
+				case 143: // MLDv2 multicast listener report.
+				{
+					size_t record_count = static_cast<size_t>((icmp[6] << 8) | icmp[7]);
+					size_t record_offset = 8;
+
+					while (record_count-- > 0)
+					{
+						if (icmp_len < record_offset + 20)
+						{
+							return;
+						}
+
+						const uint8_t record_type = icmp[record_offset];
+						const size_t aux_len = static_cast<size_t>(icmp[record_offset + 1]) * 4;
+						const size_t source_count = static_cast<size_t>((icmp[record_offset + 2] << 8) | icmp[record_offset + 3]);
+
+						if (icmp_len < record_offset + 20 + source_count * 16 + aux_len)
+						{
+							return;
+						}
+
+						if (((record_type == 1) || (record_type == 3)) && (source_count == 0))
+						{
+							multicast_leave(ipv6_multicast_to_ethernet(icmp + record_offset + 4), index);
+						}
+						else
+						{
+							multicast_join(ipv6_multicast_to_ethernet(icmp + record_offset + 4), index, now);
+						}
+
+						record_offset += 20 + source_count * 16 + aux_len;
+					}
+
+					break;
+				}
+			}
+		}
+	}
+
+	void switch_::multicast_join(const ethernet_address_type& address, port_index_type index, std::time_t now)
+	{
+		const multicast_table_type::iterator entry = m_multicast_table.find(address);
+
+		if (entry != m_multicast_table.end())
+		{
+			entry->second[index] = now;
+		}
+		else if (m_multicast_table.size() < m_max_entries)
+		{
+			// The table is bounded like the MAC table, so a misbehaving port cannot grow it without limit. Dropped groups simply keep being flooded.
+			m_multicast_table[address][index] = now;
+		}
+	}
+
+	void switch_::multicast_leave(const ethernet_address_type& address, port_index_type index)
+	{
+		const multicast_table_type::iterator entry = m_multicast_table.find(address);
+
+		if (entry != m_multicast_table.end())
+		{
+			entry->second.erase(index);
+
+			if (entry->second.empty())
+			{
+				m_multicast_table.erase(entry);
+			}
+		}
+	}
+
+	void switch_::remove_port_subscriptions(port_index_type index)
+	{
+		for (multicast_table_type::iterator entry = m_multicast_table.begin(); entry != m_multicast_table.end();)
+		{
+			entry->second.erase(index);
+
+			if (entry->second.empty())
+			{
+				m_multicast_table.erase(entry++);
+			}
+			else
+			{
+				++entry;
+			}
+		}
 	}
 
 	switch_::ethernet_address_type switch_::to_ethernet_address(boost::asio::const_buffer buf)
 	{
-		assert(boost::asio::buffer_size(buf) == ethernet_address_type::static_size);
+		assert(boost::asio::buffer_size(buf) == ethernet_address_type::data_type::static_size);
 
 		ethernet_address_type result;
 
-		std::memcpy(result.c_array(), boost::asio::buffer_cast<const ethernet_address_type::value_type*>(buf), result.size());
+		std::memcpy(result.data().c_array(), boost::asio::buffer_cast<const uint8_t*>(buf), result.data().size());
 
 		return result;
 	}
 
 	bool switch_::is_multicast_address(const switch_::ethernet_address_type& address)
 	{
-		return ((address[0] & 0x01) != 0x00);
+		return ((address.data()[0] & 0x01) != 0x00);
 	}
 }
@@ -0,0 +1,221 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file buffer_pool.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A size-classed buffer pool.
+ */
+
+#ifndef FSCP_BUFFER_POOL_HPP
+#define FSCP_BUFFER_POOL_HPP
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <vector>
+
+#include <stdint.h>
+
+namespace fscp
+{
+	/**
+	 * \brief A size-classed, thread-safe pool of raw buffers.
+	 *
+	 * Buffers are handed out in power-of-two size classes and returned to the
+	 * pool on release so that sustained traffic does not hit the heap
+	 * allocator once per packet.
+	 *
+	 * The pool keeps a frame-size histogram of the acquisitions it serves and
+	 * periodically adapts each class's spare cap to the observed distribution:
+	 * on the usual bimodal traffic (small control frames and full-MTU data),
+	 * only the two busy classes keep a deep spare stock while the others are
+	 * trimmed to a small floor, so the steady-state packet-buffer memory
+	 * matches what the traffic actually uses.
+	 */
+	class buffer_pool : public boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief The memory pressure levels, in shedding order.
+			 *
+			 * As the outstanding buffer bytes approach the configured budget, load is shed in a defined order: broadcast amplification first (one frame fanned out to N peers multiplies its footprint), then handshakes with not-yet-established peers, and finally bulk egress queueing. Established unicast traffic is the last to degrade.
+			 */
+			enum pressure_level_type
+			{
+				PRESSURE_NONE = 0, /**< Below the budget thresholds, or no budget configured. */
+				PRESSURE_SHED_BROADCASTS = 1, /**< At least 70% of the budget is outstanding. */
+				PRESSURE_SHED_HANDSHAKES = 2, /**< At least 85% of the budget is outstanding. */
+				PRESSURE_SHED_BULK = 3 /**< At least 95% of the budget is outstanding. */
+			};
+
+			/**
+			 * \brief The occupancy statistics of one size class.
+			 */
+			struct size_class_statistics_type
+			{
+				size_t capacity; /**< The buffer capacity of the class, in bytes. */
+				size_t acquisition_count; /**< The count of acquisitions served in this class. */
+				size_t pooled_count; /**< The count of spare buffers currently held for the class. */
+				size_t pooled_cap; /**< The current cap on the class's heap-backed spares. */
+			};
+
+			/**
+			 * \brief The pool occupancy statistics.
+			 */
+			struct statistics_type
+			{
+				size_t allocation_count; /**< The count of buffers allocated from the heap. */
+				size_t reuse_count; /**< The count of acquisitions served from the pool. */
+				size_t pooled_buffer_count; /**< The count of buffers currently held by the pool. */
+				size_t pooled_bytes; /**< The byte total of the buffers currently held by the pool. */
+				size_t arena_size; /**< The size of the reserved arena, in bytes. Zero when no arena was reserved. */
+				size_t arena_used_bytes; /**< The byte total of the arena slots carved out so far. */
+				size_t budget_bytes; /**< The configured buffer budget, in bytes. Zero when no budget was configured. */
+				size_t outstanding_bytes; /**< The byte total of the buffers currently handed out. */
+				int pressure; /**< The current pressure level. */
+				std::vector<size_class_statistics_type> size_classes; /**< The per-class occupancy, smallest class first. */
+			};
+
+			/**
+			 * \brief Get the global pool instance.
+			 * \return The pool.
+			 * \warning The first invocation of this function is *NOT* thread-safe in C++03.
+			 */
+			static buffer_pool& instance();
+
+			/**
+			 * \brief Acquire a buffer of at least the specified size.
+			 * \param size The requested size. Updated to the real capacity of the returned buffer.
+			 * \return The buffer. Never null.
+			 */
+			uint8_t* acquire(size_t& size);
+
+			/**
+			 * \brief Return a buffer to the pool.
+			 * \param data The buffer, as returned by acquire().
+			 * \param capacity The capacity, as updated by acquire().
+			 */
+			void release(uint8_t* data, size_t capacity);
+
+			/**
+			 * \brief Get the pool occupancy statistics.
+			 * \return The statistics.
+			 */
+			statistics_type statistics() const;
+
+			/**
+			 * \brief Reserve a contiguous arena that the pool carves its buffers from.
+			 * \param bytes The arena size, in bytes.
+			 * \param huge_pages Whether to try to back the arena with huge pages.
+			 * \return true if the arena was reserved.
+			 *
+			 * A single region keeps every frame slot - tap reads, protocol messages,
+			 * socket sends - within a few pages (or, with huge pages, a few TLB
+			 * entries), and its size bounds the pooled packet memory: acquisitions
+			 * that do not fit fall back to the heap and are freed on release.
+			 *
+			 * At most one arena can be reserved, and only before the first
+			 * acquisition. When huge pages are requested but none are available, a
+			 * regular mapping is used and marked for transparent huge pages where
+			 * the system supports it.
+			 */
+			bool reserve_arena(size_t bytes, bool huge_pages);
+
+			/**
+			 * \brief Set the buffer budget.
+			 * \param bytes The budget, in bytes. Zero (the default) disables the pressure levels.
+			 *
+			 * The budget is not a hard allocation limit: acquisitions always succeed. It drives the pressure levels that the consumers use to shed load before the gateway reaches its actual memory bound.
+			 * \warning This method must be called before the first acquisition.
+			 */
+			void set_budget(size_t bytes)
+			{
+				m_budget = bytes;
+			}
+
+			/**
+			 * \brief Get the current pressure level.
+			 * \return The level. A single atomic load: cheap enough for per-datagram checks.
+			 */
+			pressure_level_type pressure_level() const
+			{
+				return static_cast<pressure_level_type>(m_pressure.load(boost::memory_order_relaxed));
+			}
+
+		private:
+
+			// Size classes go from 2^8 (256) to 2^16 (65536) bytes.
+			static const size_t MIN_SIZE_CLASS_BITS = 8;
+			static const size_t MAX_SIZE_CLASS_BITS = 16;
+			static const size_t SIZE_CLASS_COUNT = MAX_SIZE_CLASS_BITS - MIN_SIZE_CLASS_BITS + 1;
+
+			// The spare caps adapt to the observed frame-size histogram, between these bounds, and are recomputed every ADAPTATION_PERIOD classed acquisitions.
+			static const size_t MAX_POOLED_BUFFERS_PER_CLASS = 1024;
+			static const size_t MIN_POOLED_BUFFERS_PER_CLASS = 16;
+			static const size_t ADAPTATION_PERIOD = 4096;
+
+			static bool size_class(size_t size, size_t& result);
+
+			buffer_pool();
+			~buffer_pool();
+
+			bool from_arena(const uint8_t* data) const;
+			void update_pressure(size_t outstanding);
+			void adapt_caps();
+
+			mutable boost::mutex m_mutex;
+			std::vector<uint8_t*> m_free_lists[SIZE_CLASS_COUNT];
+			size_t m_class_acquisitions[SIZE_CLASS_COUNT];
+			size_t m_class_recent_acquisitions[SIZE_CLASS_COUNT];
+			size_t m_class_caps[SIZE_CLASS_COUNT];
+			size_t m_adaptation_countdown;
+			size_t m_allocation_count;
+			size_t m_reuse_count;
+			size_t m_budget;
+			boost::atomic<size_t> m_outstanding_bytes;
+			boost::atomic<int> m_pressure;
+			uint8_t* m_arena;
+			size_t m_arena_size;
+			size_t m_arena_offset;
+	};
+}
+
+#endif /* FSCP_BUFFER_POOL_HPP */
@@ -58,6 +58,7 @@
 #include <boost/utility/enable_if.hpp>
 
 #include <stdint.h>
+#include <cstring>
 #include <set>
 #include <vector>
 #include <map>
@@ -179,6 +180,23 @@ namespace fscp
 		}
 	};
 
+	/**
+	 * \brief A hash functor for hash_type.
+	 *
+	 * Suitable as the hash of an unordered container. The value already is a uniform cryptographic hash: its first bytes are used verbatim.
+	 */
+	struct hash_type_hash
+	{
+		size_t operator()(const hash_type& hash) const
+		{
+			size_t result = 0;
+
+			std::memcpy(&result, hash.data.data(), sizeof(result));
+
+			return result;
+		}
+	};
+
 	/**
 	 * \brief The host identifier type.
 	 */
@@ -201,8 +219,15 @@ namespace fscp
 
 	/**
 	 * \brief The current protocol version.
+	 *
+	 * Version 4 adds the compression algorithm capability list to the SESSION_REQUEST message. The extended layout is only sent to hosts that were seen speaking version 4 themselves: version 3 hosts receive (and are sent) the version 3 layout, so mixed deployments keep establishing sessions.
+	 */
+	const unsigned char CURRENT_PROTOCOL_VERSION = 4;
+
+	/**
+	 * \brief The protocol version that introduced the SESSION_REQUEST compression capability list.
 	 */
-	const unsigned char CURRENT_PROTOCOL_VERSION = 3;
+	const unsigned char COMPRESSION_PROTOCOL_VERSION = 4;
 
 	/**
 	 * \brief The length of the GCM tag.
@@ -224,6 +249,8 @@ namespace fscp
 		MESSAGE_TYPE_PRESENTATION = 0x02,
 		MESSAGE_TYPE_SESSION_REQUEST = 0x03,
 		MESSAGE_TYPE_SESSION = 0x04,
+		MESSAGE_TYPE_SESSION_RESUMPTION_REQUEST = 0x05,
+		MESSAGE_TYPE_SESSION_RESUMPTION = 0x06,
 		MESSAGE_TYPE_DATA_0 = 0x70,
 		MESSAGE_TYPE_DATA_1 = 0x71,
 		MESSAGE_TYPE_DATA_2 = 0x72,
@@ -268,6 +295,18 @@ namespace fscp
 		CHANNEL_NUMBER_15 = 15
 	};
 
+	/**
+	 * \brief The count of available channels.
+	 */
+	const size_t CHANNEL_NUMBER_COUNT = 16;
+
+	/**
+	 * \brief The channel reserved for path MTU probes.
+	 *
+	 * When path MTU discovery is enabled, probe frames and their acknowledgments travel on this channel; it is handled inside the server, never delivered to the application and never compressed, so the probe padding hits the wire at its nominal size.
+	 */
+	const channel_number_type CHANNEL_NUMBER_PMTU = CHANNEL_NUMBER_15;
+
 	/**
 	 * \brief The endpoint type type.
 	 */
@@ -287,6 +326,7 @@ namespace fscp
 			static const value_type unsupported;
 			static const value_type ecdhe_rsa_aes128_gcm_sha256;
 			static const value_type ecdhe_rsa_aes256_gcm_sha384;
+			static const value_type ecdhe_rsa_chacha20_poly1305_sha256;
 
 			cipher_suite_type() {}
 			cipher_suite_type(value_type _value) : enumeration_type(_value) {}
@@ -297,7 +337,7 @@ namespace fscp
 			 */
 			bool is_valid() const
 			{
-				if ((value() == unsupported) || (value() == ecdhe_rsa_aes128_gcm_sha256) || value() == ecdhe_rsa_aes256_gcm_sha384)
+				if ((value() == unsupported) || (value() == ecdhe_rsa_aes128_gcm_sha256) || (value() == ecdhe_rsa_aes256_gcm_sha384) || (value() == ecdhe_rsa_chacha20_poly1305_sha256))
 				{
 					return true;
 				}
@@ -323,6 +363,10 @@ namespace fscp
 				{
 					return ecdhe_rsa_aes256_gcm_sha384_string;
 				}
+				else if (value() == ecdhe_rsa_chacha20_poly1305_sha256)
+				{
+					return ecdhe_rsa_chacha20_poly1305_sha256_string;
+				}
 
 				throw std::invalid_argument("Invalid cipher suite value: " + boost::lexical_cast<std::string>(static_cast<int>(value())));
 			}
@@ -342,6 +386,10 @@ namespace fscp
 				{
 					return ecdhe_rsa_aes256_gcm_sha384;
 				}
+				else if (str == ecdhe_rsa_chacha20_poly1305_sha256_string)
+				{
+					return ecdhe_rsa_chacha20_poly1305_sha256;
+				}
 
 				throw std::invalid_argument("Invalid cipher suite string representation: " + str);
 			}
@@ -364,6 +412,10 @@ namespace fscp
 				{
 					return cryptoplus::hash::message_digest_algorithm(NID_sha384);
 				}
+				else if (value() == ecdhe_rsa_chacha20_poly1305_sha256)
+				{
+					return cryptoplus::hash::message_digest_algorithm(NID_sha256);
+				}
 
 				throw std::invalid_argument("Invalid cipher suite value: " + boost::lexical_cast<std::string>(static_cast<int>(value())));
 			}
@@ -388,6 +440,15 @@ namespace fscp
 				{
 					return cryptoplus::cipher::cipher_algorithm(NID_aes_256_gcm);
 				}
+				else if (value() == ecdhe_rsa_chacha20_poly1305_sha256)
+				{
+#ifdef NID_chacha20_poly1305
+					// ChaCha20-Poly1305 takes a fixed 12-byte nonce, which is exactly our nonce prefix followed by the sequence number. The tag is 16 bytes, like GCM, and goes through the same EVP AEAD controls.
+					return cryptoplus::cipher::cipher_algorithm(NID_chacha20_poly1305);
+#else
+					throw std::runtime_error("The linked OpenSSL does not support ChaCha20-Poly1305");
+#endif
+				}
 
 				throw std::invalid_argument("Invalid cipher suite value: " + boost::lexical_cast<std::string>(static_cast<int>(value())));
 			}
@@ -396,6 +457,7 @@ namespace fscp
 
 			static const std::string ecdhe_rsa_aes128_gcm_sha256_string;
 			static const std::string ecdhe_rsa_aes256_gcm_sha384_string;
+			static const std::string ecdhe_rsa_chacha20_poly1305_sha256_string;
 	};
 
 	/**
@@ -511,6 +573,76 @@ namespace fscp
 			static const std::string secp521r1_string;
 	};
 
+	/**
+	 * \brief The compression algorithm type.
+	 */
+	class compression_algorithm_type : public enumeration_type
+	{
+		public:
+
+			static const value_type none;
+			static const value_type lz4;
+
+			compression_algorithm_type() {}
+			compression_algorithm_type(value_type _value) : enumeration_type(_value) {}
+
+			/**
+			 * \brief Check whether the instance is a valid compression algorithm.
+			 * \return true if the compression algorithm is valid.
+			 */
+			bool is_valid() const
+			{
+				if ((value() == none) || (value() == lz4))
+				{
+					return true;
+				}
+
+				return false;
+			}
+
+			/**
+			 * \brief Get a string representation of the compression algorithm.
+			 * \return A string representation.
+			 */
+			std::string to_string() const
+			{
+				if (value() == none)
+				{
+					return none_string;
+				}
+				else if (value() == lz4)
+				{
+					return lz4_string;
+				}
+
+				throw std::invalid_argument("Invalid compression algorithm value: " + boost::lexical_cast<std::string>(static_cast<int>(value())));
+			}
+
+			/**
+			 * \brief Get a compression algorithm from its string representation.
+			 * \param str The string representation.
+			 * \return The compression algorithm.
+			 */
+			static compression_algorithm_type from_string(const std::string& str)
+			{
+				if (str == none_string)
+				{
+					return none;
+				}
+				else if (str == lz4_string)
+				{
+					return lz4;
+				}
+
+				throw std::invalid_argument("Invalid compression algorithm string representation: " + str);
+			}
+
+		private:
+
+			static const std::string none_string;
+			static const std::string lz4_string;
+	};
+
 	/**
 	 * \brief The cipher suite list type.
 	 */
@@ -521,6 +653,11 @@ namespace fscp
 	 */
 	typedef std::vector<elliptic_curve_type> elliptic_curve_list_type;
 
+	/**
+	 * \brief The compression algorithm list type.
+	 */
+	typedef std::vector<compression_algorithm_type> compression_algorithm_list_type;
+
 	/**
 	 * \brief The default cipher suite list.
 	 */
@@ -543,6 +680,25 @@ namespace fscp
 		};
 	}
 
+	/**
+	 * \brief The default compression algorithm list.
+	 *
+	 * Compression is off unless explicitly enabled: "none" is always advertised so two hosts can complete the handshake regardless of their compression settings.
+	 */
+	inline const compression_algorithm_list_type get_default_compression_algorithms()
+	{
+		return {
+			compression_algorithm_type::none
+		};
+	}
+
+	/**
+	 * \brief The cleartext size below which data payloads are never compressed.
+	 *
+	 * Small payloads rarely compress and the attempt would cost more than the bytes it saves.
+	 */
+	const size_t COMPRESSION_THRESHOLD = 128;
+
 	/**
 	 * \brief The certificate digest algorithm.
 	 *
@@ -565,6 +721,83 @@ namespace fscp
 	 */
 	const size_t SESSION_KEEP_ALIVE_DATA_SIZE = 32;
 
+	/**
+	 * \brief The default window over which the paced *_to_all operations spread their sends.
+	 */
+	const boost::posix_time::time_duration DEFAULT_PACING_WINDOW = boost::posix_time::seconds(10);
+
+	/**
+	 * \brief The longest session keep-alive interval the adaptive probing may reach.
+	 */
+	const boost::posix_time::time_duration SESSION_KEEP_ALIVE_MAX_PERIOD = boost::posix_time::seconds(120);
+
+	/**
+	 * \brief The count of quiet keep-alive intervals after which the interval is stretched.
+	 */
+	const unsigned int SESSION_KEEP_ALIVE_STRETCH_THRESHOLD = 3;
+
+	/**
+	 * \brief The longest probing interval an idle session may decay to in the lazy keep-alive mode.
+	 */
+	const boost::posix_time::time_duration SESSION_LAZY_KEEP_ALIVE_MAX_PERIOD = boost::posix_time::seconds(600);
+
+	/**
+	 * \brief The maximum count of contact answers per CONTACT message.
+	 *
+	 * Larger contact maps are split across several messages so each one fits a single datagram and no strand handler processes an unbounded batch.
+	 */
+	const size_t CONTACT_BATCH_SIZE = 32;
+
+	/**
+	 * \brief The size of the nonces exchanged during a session resumption, in bytes.
+	 */
+	const size_t SESSION_RESUMPTION_NONCE_SIZE = 16;
+
+	/**
+	 * \brief How long a cached resumption secret remains usable after the session that produced it was established.
+	 */
+	const boost::posix_time::time_duration SESSION_RESUMPTION_VALIDITY = boost::posix_time::minutes(10);
+
+	/**
+	 * \brief The socket queue telemetry sampling period.
+	 */
+	const boost::posix_time::time_duration SOCKET_TELEMETRY_PERIOD = boost::posix_time::seconds(2);
+
+	/**
+	 * \brief The path MTU discovery tick period.
+	 */
+	const boost::posix_time::time_duration PATH_MTU_PROBE_PERIOD = boost::posix_time::seconds(2);
+
+	/**
+	 * \brief The time after which an unanswered path MTU probe is resent.
+	 */
+	const boost::posix_time::time_duration PATH_MTU_PROBE_TIMEOUT = boost::posix_time::seconds(4);
+
+	/**
+	 * \brief The count of resends before a probe size is considered undeliverable.
+	 */
+	const size_t PATH_MTU_PROBE_RETRIES = 2;
+
+	/**
+	 * \brief The smallest probed data payload, assumed deliverable on any sane path.
+	 */
+	const size_t PATH_MTU_MIN_PAYLOAD = 500;
+
+	/**
+	 * \brief The largest probed data payload.
+	 */
+	const size_t PATH_MTU_MAX_PAYLOAD = 9000;
+
+	/**
+	 * \brief The binary search convergence margin, in bytes.
+	 */
+	const size_t PATH_MTU_CONVERGENCE = 16;
+
+	/**
+	 * \brief The delay before a converged path is probed again, to catch MTU changes.
+	 */
+	const boost::posix_time::time_duration PATH_MTU_REPROBE_PERIOD = boost::posix_time::minutes(5);
+
 	/**
 	 * \brief Check if a message type is a DATA type message.
 	 * \param type The message type.
@@ -0,0 +1,144 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file counted_strand.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A strand that keeps a gauge of its pending handlers.
+ */
+
+#ifndef FSCP_COUNTED_STRAND_HPP
+#define FSCP_COUNTED_STRAND_HPP
+
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <utility>
+
+#include <stdint.h>
+
+namespace fscp
+{
+	/**
+	 * \brief A strand that keeps a gauge of its pending handlers.
+	 *
+	 * Handlers submitted through post() and dispatch() raise the gauge until they start running, so a scrape can tell which strand the work is piling up in. Several strands can share one gauge, which is how the per-host crypto strands are aggregated.
+	 *
+	 * wrap() delegates to the underlying strand without touching the gauge: a wrapped completion handler is not queued until its asynchronous operation completes, so there is no pending period to measure.
+	 */
+	class counted_strand : public boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief Create a counted strand.
+			 * \param io_service The io_service to use.
+			 * \param pending The gauge to account the pending handlers in. Must outlive the strand.
+			 */
+			counted_strand(boost::asio::io_service& io_service, boost::atomic<uint32_t>& pending) :
+				m_strand(io_service),
+				m_pending(pending)
+			{
+			}
+
+			/**
+			 * \brief Post a handler into the strand.
+			 * \param handler The handler.
+			 */
+			template <typename Handler>
+			void post(Handler handler)
+			{
+				m_pending.fetch_add(1, boost::memory_order_relaxed);
+
+				m_strand.post(counted_handler<Handler>(m_pending, handler));
+			}
+
+			/**
+			 * \brief Dispatch a handler through the strand.
+			 * \param handler The handler.
+			 */
+			template <typename Handler>
+			void dispatch(Handler handler)
+			{
+				m_pending.fetch_add(1, boost::memory_order_relaxed);
+
+				m_strand.dispatch(counted_handler<Handler>(m_pending, handler));
+			}
+
+			/**
+			 * \brief Wrap a handler so it executes through the strand.
+			 * \param handler The handler.
+			 * \return The wrapped handler. It is not part of the pending gauge.
+			 */
+			template <typename Handler>
+			auto wrap(Handler handler) -> decltype(std::declval<boost::asio::io_service::strand&>().wrap(handler))
+			{
+				return m_strand.wrap(handler);
+			}
+
+		private:
+
+			template <typename Handler>
+			struct counted_handler
+			{
+				typedef void result_type;
+
+				counted_handler(boost::atomic<uint32_t>& pending, Handler handler) :
+					m_pending(&pending),
+					m_handler(handler)
+				{
+				}
+
+				void operator()()
+				{
+					m_pending->fetch_sub(1, boost::memory_order_relaxed);
+
+					m_handler();
+				}
+
+				boost::atomic<uint32_t>* m_pending;
+				Handler m_handler;
+			};
+
+			boost::asio::io_service::strand m_strand;
+			boost::atomic<uint32_t>& m_pending;
+	};
+}
+
+#endif /* FSCP_COUNTED_STRAND_HPP */
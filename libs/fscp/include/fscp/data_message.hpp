@@ -51,6 +51,14 @@
 
 #include <cryptoplus/pkey/pkey.hpp>
 
+namespace cryptoplus
+{
+	namespace cipher
+	{
+		class cipher_context;
+	}
+}
+
 namespace fscp
 {
 	/**
@@ -65,6 +73,13 @@ namespace fscp
 			 */
 			typedef cryptoplus::cipher::cipher_algorithm calg_t;
 
+			/**
+			 * \brief The offset, within a data message, at which the ciphertext is written.
+			 *
+			 * A caller that places the cleartext at this offset inside the destination buffer allows write() to encrypt in place, since AES-GCM runs in counter mode and supports overlapping source and destination.
+			 */
+			static const size_t DATA_PAYLOAD_OFFSET = HEADER_LENGTH + sizeof(sequence_number_type) + GCM_TAG_LENGTH + sizeof(uint16_t);
+
 			/**
 			 * \brief Write a data message to a buffer.
 			 * \param buf The buffer to write to.
@@ -78,9 +93,48 @@ namespace fscp
 			 * \param enc_key_len The encryption key length.
 			 * \param nonce_prefix The nonce prefix.
 			 * \param nonce_prefix_len The nonce prefix length.
+			 * \param compression The negotiated compression algorithm. When it is not "none", the cleartext is framed with a marker byte and, above COMPRESSION_THRESHOLD, compressed before encryption.
 			 * \return The count of bytes written.
 			 */
-			static size_t write(void* buf, size_t buf_len, channel_number_type channel_number, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, const void* cleartext, size_t cleartext_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len);
+			static size_t write(void* buf, size_t buf_len, channel_number_type channel_number, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, const void* cleartext, size_t cleartext_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, compression_algorithm_type compression = compression_algorithm_type::none);
+
+			/**
+			 * \brief Write a data message to a buffer, using a prepared cipher context.
+			 * \param buf The buffer to write to.
+			 * \param buf_len The length of buf.
+			 * \param channel_number The channel number.
+			 * \param sequence_number The sequence number.
+			 * \param cipher_context A cipher context that already holds the session key schedule. Only the IV is re-seeded.
+			 * \param cleartext The cleartext data.
+			 * \param cleartext_len The data length.
+			 * \param nonce_prefix The nonce prefix.
+			 * \param nonce_prefix_len The nonce prefix length.
+			 * \param compression The negotiated compression algorithm. When it is not "none", the cleartext is framed with a marker byte and, above COMPRESSION_THRESHOLD, compressed before encryption.
+			 * \return The count of bytes written.
+			 */
+			static size_t write(void* buf, size_t buf_len, channel_number_type channel_number, sequence_number_type sequence_number, cryptoplus::cipher::cipher_context& cipher_context, const void* cleartext, size_t cleartext_len, const void* nonce_prefix, size_t nonce_prefix_len, compression_algorithm_type compression = compression_algorithm_type::none);
+
+			/**
+			 * \brief The frame marker of an uncompressed data payload, on sessions that negotiated compression.
+			 */
+			static const uint8_t DATA_FRAME_RAW = 0x00;
+
+			/**
+			 * \brief The frame marker of an LZ4-compressed data payload. The marker is followed by the original size, as an unsigned 16-bits big-endian integer, and the LZ4 block.
+			 */
+			static const uint8_t DATA_FRAME_LZ4 = 0x01;
+
+			/**
+			 * \brief Decompress a framed data payload.
+			 * \param dst The buffer that receives the original cleartext.
+			 * \param dst_capacity The size of dst.
+			 * \param framed The framed payload. Its first byte must be DATA_FRAME_LZ4.
+			 * \param framed_len The framed payload size.
+			 * \return The original cleartext size.
+			 *
+			 * If the frame is malformed, a std::runtime_error is thrown.
+			 */
+			static size_t uncompress_cleartext(void* dst, size_t dst_capacity, const void* framed, size_t framed_len);
 
 			/**
 			 * \brief Write a contact-request message to a buffer.
@@ -97,6 +151,19 @@ namespace fscp
 			 */
 			static size_t write_contact_request(void* buf, size_t buf_len, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, const hash_list_type& hash_list, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len);
 
+			/**
+			 * \brief Write a contact-request message to a buffer, using a prepared cipher context.
+			 * \param buf The buffer to write to.
+			 * \param buf_len The length of buf.
+			 * \param sequence_number The sequence number.
+			 * \param cipher_context A cipher context that already holds the session key schedule.
+			 * \param hash_list The hash list.
+			 * \param nonce_prefix The nonce prefix.
+			 * \param nonce_prefix_len The nonce prefix length.
+			 * \return The count of bytes written.
+			 */
+			static size_t write_contact_request(void* buf, size_t buf_len, sequence_number_type sequence_number, cryptoplus::cipher::cipher_context& cipher_context, const hash_list_type& hash_list, const void* nonce_prefix, size_t nonce_prefix_len);
+
 			/**
 			 * \brief Write a contact message to a buffer.
 			 * \param buf The buffer to write to.
@@ -112,6 +179,19 @@ namespace fscp
 			 */
 			static size_t write_contact(void* buf, size_t buf_len, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, const contact_map_type& contact_map, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len);
 
+			/**
+			 * \brief Write a contact message to a buffer, using a prepared cipher context.
+			 * \param buf The buffer to write to.
+			 * \param buf_len The length of buf.
+			 * \param sequence_number The sequence number.
+			 * \param cipher_context A cipher context that already holds the session key schedule.
+			 * \param contact_map The contact map.
+			 * \param nonce_prefix The nonce prefix.
+			 * \param nonce_prefix_len The nonce prefix length.
+			 * \return The count of bytes written.
+			 */
+			static size_t write_contact(void* buf, size_t buf_len, sequence_number_type sequence_number, cryptoplus::cipher::cipher_context& cipher_context, const contact_map_type& contact_map, const void* nonce_prefix, size_t nonce_prefix_len);
+
 			/**
 			 * \brief Write a keep-alive message to a buffer.
 			 * \param buf The buffer to write to.
@@ -127,6 +207,19 @@ namespace fscp
 			 */
 			static size_t write_keep_alive(void* buf, size_t buf_len, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, size_t random_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len);
 
+			/**
+			 * \brief Write a keep-alive message to a buffer, using a prepared cipher context.
+			 * \param buf The buffer to write to.
+			 * \param buf_len The length of buf.
+			 * \param sequence_number The sequence number.
+			 * \param cipher_context A cipher context that already holds the session key schedule.
+			 * \param random_len The length of the random content to send.
+			 * \param nonce_prefix The nonce prefix.
+			 * \param nonce_prefix_len The nonce prefix length.
+			 * \return The count of bytes written.
+			 */
+			static size_t write_keep_alive(void* buf, size_t buf_len, sequence_number_type sequence_number, cryptoplus::cipher::cipher_context& cipher_context, size_t random_len, const void* nonce_prefix, size_t nonce_prefix_len);
+
 			/**
 			 * \brief Parse the hash list.
 			 * \param buf The buffer to parse.
@@ -201,6 +294,30 @@ namespace fscp
 			 */
 			size_t get_cleartext(void* buf, size_t buf_len, data_message::calg_t cipher_algorithm, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len) const;
 
+			/**
+			 * \brief Get the clear text data, using a prepared cipher context.
+			 * \param buf The buffer that must receive the data. If buf is NULL, the function returns the expected size of buf.
+			 * \param buf_len The length of buf.
+			 * \param cipher_context A cipher context that already holds the session key schedule. Only the IV and the tag are re-seeded.
+			 * \param nonce_prefix The nonce prefix.
+			 * \param nonce_prefix_len The nonce prefix length.
+			 * \return The count of bytes deciphered.
+			 */
+			size_t get_cleartext(void* buf, size_t buf_len, cryptoplus::cipher::cipher_context& cipher_context, const void* nonce_prefix, size_t nonce_prefix_len) const;
+
+			/**
+			 * \brief Decipher the payload in place, over the received datagram bytes.
+			 * \param buf A writable pointer to the same bytes this instance maps.
+			 * \param buf_len The length of buf.
+			 * \param cipher_context A cipher context that already holds the session key schedule. Only the IV and the tag are re-seeded.
+			 * \param nonce_prefix The nonce prefix.
+			 * \param nonce_prefix_len The nonce prefix length.
+			 * \return The count of bytes deciphered.
+			 *
+			 * AES-GCM runs in counter mode and supports identical source and destination: the cleartext is written over the ciphertext, at DATA_PAYLOAD_OFFSET within buf, so the receive path needs no per-packet cleartext buffer.
+			 */
+			size_t open_in_place(void* buf, size_t buf_len, cryptoplus::cipher::cipher_context& cipher_context, const void* nonce_prefix, size_t nonce_prefix_len) const;
+
 		protected:
 
 			/**
@@ -225,6 +342,21 @@ namespace fscp
 			 */
 			static size_t raw_write(void* buf, size_t buf_len, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, const void* cleartext, size_t cleartext_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, message_type type);
 
+			/**
+			 * \brief Write a data message to a buffer, using a prepared cipher context.
+			 * \param buf The buffer to write to.
+			 * \param buf_len The length of buf.
+			 * \param sequence_number The sequence number.
+			 * \param cipher_context A cipher context that already holds the session key schedule. Only the IV is re-seeded.
+			 * \param cleartext The cleartext data.
+			 * \param cleartext_len The data length.
+			 * \param nonce_prefix The nonce prefix.
+			 * \param nonce_prefix_len The nonce prefix length.
+			 * \param type The message type.
+			 * \return The count of bytes written.
+			 */
+			static size_t raw_write(void* buf, size_t buf_len, sequence_number_type sequence_number, cryptoplus::cipher::cipher_context& cipher_context, const void* cleartext, size_t cleartext_len, const void* nonce_prefix, size_t nonce_prefix_len, message_type type);
+
 		private:
 
 			void check_format() const;
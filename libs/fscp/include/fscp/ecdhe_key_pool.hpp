@@ -0,0 +1,126 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file ecdhe_key_pool.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A pool of precomputed ephemeral ECDHE keys.
+ */
+
+#ifndef FSCP_ECDHE_KEY_POOL_HPP
+#define FSCP_ECDHE_KEY_POOL_HPP
+
+#include "constants.hpp"
+
+#include <cryptoplus/pkey/ecdhe.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+#include <vector>
+
+namespace fscp
+{
+	/**
+	 * \brief A pool of precomputed ephemeral ECDHE keys.
+	 *
+	 * Generating an ephemeral key pair on the handshake path delays session
+	 * establishment, which adds up quickly when many peers reconnect at
+	 * once. The pool keeps a few ready-to-use contexts per elliptic curve
+	 * and refills itself in the background, so handshakes only consume a
+	 * precomputed key and derive the shared secret.
+	 */
+	class ecdhe_key_pool
+	{
+		public:
+
+			/**
+			 * \brief The ECDHE context pointer type.
+			 */
+			typedef boost::shared_ptr<cryptoplus::pkey::ecdhe_context> ecdhe_context_ptr;
+
+			/**
+			 * \brief The default count of precomputed keys kept per elliptic curve.
+			 */
+			static const size_t DEFAULT_KEYS_PER_CURVE = 8;
+
+			/**
+			 * \brief Create a new pool.
+			 * \param io_service The io_service the background refills are posted to.
+			 */
+			explicit ecdhe_key_pool(boost::asio::io_service& io_service) :
+				m_io_service(io_service),
+				m_keys_per_curve(DEFAULT_KEYS_PER_CURVE)
+			{}
+
+			/**
+			 * \brief Set the count of precomputed keys kept per elliptic curve.
+			 * \param count The count of keys. A value of 0 disables the pool and every acquire() generates a key inline.
+			 * \warning This method is *NOT* thread-safe and should be called before the pool is used.
+			 */
+			void set_keys_per_curve(size_t count)
+			{
+				m_keys_per_curve = count;
+			}
+
+			/**
+			 * \brief Get a ready-to-use ECDHE context for the specified curve.
+			 * \param curve The elliptic curve.
+			 * \return A context whose key pair was already generated.
+			 *
+			 * If the pool is empty the key pair is generated inline, which costs exactly what the direct generation used to. A background refill is scheduled whenever the pool runs low.
+			 */
+			ecdhe_context_ptr acquire(elliptic_curve_type curve);
+
+		private:
+
+			void refill(int nid);
+
+			boost::asio::io_service& m_io_service;
+			size_t m_keys_per_curve;
+
+			boost::mutex m_mutex;
+			std::map<int, std::vector<ecdhe_context_ptr> > m_keys;
+			std::map<int, bool> m_refill_pending;
+	};
+}
+
+#endif /* FSCP_ECDHE_KEY_POOL_HPP */
@@ -0,0 +1,83 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file endpoint_hash.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A hash functor for endpoints.
+ */
+
+#ifndef FSCP_ENDPOINT_HASH_HPP
+#define FSCP_ENDPOINT_HASH_HPP
+
+#include <boost/asio.hpp>
+
+namespace fscp
+{
+	/**
+	 * \brief A hash functor for boost::asio UDP endpoints.
+	 *
+	 * Suitable as the hash of an unordered container. Endpoints compare with
+	 * their own operator==() so no dedicated equality functor is needed.
+	 */
+	struct endpoint_hash
+	{
+		size_t operator()(const boost::asio::ip::udp::endpoint& ep) const
+		{
+			size_t seed = ep.port();
+
+			if (ep.address().is_v4())
+			{
+				seed ^= static_cast<size_t>(ep.address().to_v4().to_ulong()) * 2654435761UL;
+			}
+			else
+			{
+				const boost::asio::ip::address_v6::bytes_type bytes = ep.address().to_v6().to_bytes();
+
+				for (size_t i = 0; i < bytes.size(); ++i)
+				{
+					seed = seed * 31 + bytes[i];
+				}
+			}
+
+			return seed;
+		}
+	};
+}
+
+#endif /* FSCP_ENDPOINT_HASH_HPP */
@@ -0,0 +1,203 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file handler_memory.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief Per-operation handler memory recycling for asio operations.
+ */
+
+#ifndef FSCP_HANDLER_MEMORY_HPP
+#define FSCP_HANDLER_MEMORY_HPP
+
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <cstddef>
+#include <utility>
+
+namespace fscp
+{
+	/**
+	 * \brief A small arena that recycles the memory of asio's per-operation state.
+	 *
+	 * Every asynchronous operation normally heap-allocates a small block for its internal state. Handlers wrapped with make_pooled_handler() serve that block from one of a few recycled slots instead, so a steady stream of operations - one outstanding receive per socket, one outstanding write behind the write queue - performs no handler allocation at all.
+	 *
+	 * Slot acquisition is a relaxed atomic exchange, so an arena may safely back operations initiated from different threads; when every slot is busy or the state is unusually large, the allocation simply falls back to the global heap.
+	 */
+	class handler_memory : public boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief The size of one slot.
+			 */
+			static const std::size_t SLOT_SIZE = 1024;
+
+			/**
+			 * \brief The count of slots.
+			 */
+			static const std::size_t SLOT_COUNT = 4;
+
+			/**
+			 * \brief Create a handler memory arena.
+			 */
+			handler_memory()
+			{
+				for (std::size_t slot = 0; slot < SLOT_COUNT; ++slot)
+				{
+					m_in_use[slot].store(false, boost::memory_order_relaxed);
+				}
+			}
+
+			/**
+			 * \brief Allocate memory for one operation.
+			 * \param size The required size.
+			 * \return The memory.
+			 */
+			void* allocate(std::size_t size)
+			{
+				if (size <= SLOT_SIZE)
+				{
+					for (std::size_t slot = 0; slot < SLOT_COUNT; ++slot)
+					{
+						if (!m_in_use[slot].exchange(true, boost::memory_order_acquire))
+						{
+							return m_slots[slot].bytes;
+						}
+					}
+				}
+
+				return ::operator new(size);
+			}
+
+			/**
+			 * \brief Release memory obtained from allocate().
+			 * \param pointer The memory.
+			 */
+			void deallocate(void* pointer)
+			{
+				for (std::size_t slot = 0; slot < SLOT_COUNT; ++slot)
+				{
+					if (pointer == m_slots[slot].bytes)
+					{
+						m_in_use[slot].store(false, boost::memory_order_release);
+
+						return;
+					}
+				}
+
+				::operator delete(pointer);
+			}
+
+		private:
+
+			union slot_type
+			{
+				double align;
+				char bytes[SLOT_SIZE];
+			};
+
+			slot_type m_slots[SLOT_COUNT];
+			boost::atomic<bool> m_in_use[SLOT_COUNT];
+	};
+
+	/**
+	 * \brief A handler wrapper that serves its operation state from a handler_memory arena.
+	 *
+	 * The asio allocation hooks are forwarded to the arena and the invocation hook to the wrapped handler, so strand-wrapped handlers keep their execution guarantees.
+	 */
+	template <typename Handler>
+	class pooled_handler
+	{
+		public:
+
+			/**
+			 * \brief Create a pooled handler.
+			 * \param memory The arena. Must outlive the operation.
+			 * \param handler The wrapped handler.
+			 */
+			pooled_handler(handler_memory& memory, Handler handler) :
+				m_memory(&memory),
+				m_handler(handler)
+			{
+			}
+
+			template <typename... Args>
+			void operator()(Args&&... args)
+			{
+				m_handler(std::forward<Args>(args)...);
+			}
+
+			friend void* asio_handler_allocate(std::size_t size, pooled_handler* this_handler)
+			{
+				return this_handler->m_memory->allocate(size);
+			}
+
+			friend void asio_handler_deallocate(void* pointer, std::size_t, pooled_handler* this_handler)
+			{
+				this_handler->m_memory->deallocate(pointer);
+			}
+
+			template <typename Function>
+			friend void asio_handler_invoke(Function function, pooled_handler* this_handler)
+			{
+				boost_asio_handler_invoke_helpers::invoke(function, this_handler->m_handler);
+			}
+
+		private:
+
+			handler_memory* m_memory;
+			Handler m_handler;
+	};
+
+	/**
+	 * \brief Wrap a handler so its operation state is served from an arena.
+	 * \param memory The arena. Must outlive the operation.
+	 * \param handler The handler.
+	 * \return The wrapped handler.
+	 */
+	template <typename Handler>
+	inline pooled_handler<Handler> make_pooled_handler(handler_memory& memory, Handler handler)
+	{
+		return pooled_handler<Handler>(memory, handler);
+	}
+}
+
+#endif /* FSCP_HANDLER_MEMORY_HPP */
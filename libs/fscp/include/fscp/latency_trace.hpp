@@ -0,0 +1,120 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+
+/**
+ * \file latency_trace.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A cheap sampled latency tracer for the packet paths.
+ */
+
+#ifndef FSCP_LATENCY_TRACE_HPP
+#define FSCP_LATENCY_TRACE_HPP
+
+#include "metrics.hpp"
+
+#include <boost/atomic.hpp>
+
+#include <stdint.h>
+
+namespace fscp
+{
+	/**
+	 * \brief A cheap sampled latency tracer for the packet paths.
+	 *
+	 * When enabled, one frame out of SAMPLE_INTERVAL (per thread) gets timestamped at a pipeline stage and the elapsed time is recorded into a metrics_registry histogram at the stage's completion. The fast path for unsampled frames is a relaxed atomic load and a thread-local counter increment, cheap enough to stay enabled in production.
+	 */
+	class latency_trace
+	{
+		public:
+
+			/**
+			 * \brief The sampling interval: one frame out of this many is traced, per thread.
+			 */
+			static const unsigned int SAMPLE_INTERVAL = 256;
+
+			/**
+			 * \brief Enable or disable the tracing.
+			 * \param enabled The new state.
+			 */
+			static void set_enabled(bool enabled)
+			{
+				s_enabled.store(enabled, boost::memory_order_relaxed);
+			}
+
+			/**
+			 * \brief Check whether the tracing is enabled.
+			 * \return The current state.
+			 */
+			static bool enabled()
+			{
+				return s_enabled.load(boost::memory_order_relaxed);
+			}
+
+			/**
+			 * \brief Get a monotonic timestamp, in nanoseconds.
+			 * \return The timestamp. Only differences are meaningful.
+			 */
+			static uint64_t now();
+
+			/**
+			 * \brief Decide whether the current frame is sampled.
+			 * \return A start timestamp if the frame is sampled, 0 otherwise.
+			 */
+			static uint64_t sample_start();
+
+			/**
+			 * \brief Record the elapsed time since a start timestamp.
+			 * \param histogram The histogram that receives the elapsed nanoseconds.
+			 * \param start The start timestamp, as returned by sample_start(). A 0 start is ignored.
+			 */
+			static void record(metrics_registry::histogram& histogram, uint64_t start)
+			{
+				if (start != 0)
+				{
+					histogram.record(now() - start);
+				}
+			}
+
+		private:
+
+			static boost::atomic<bool> s_enabled;
+	};
+}
+
+#endif /* FSCP_LATENCY_TRACE_HPP */
@@ -0,0 +1,145 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file log_ring_buffer.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A lock-free ring buffer log sink.
+ */
+
+#ifndef FSCP_LOG_RING_BUFFER_HPP
+#define FSCP_LOG_RING_BUFFER_HPP
+
+#include "logger.hpp"
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/scoped_array.hpp>
+
+#include <cstring>
+
+namespace fscp
+{
+	/**
+	 * \brief A lock-free ring buffer log sink.
+	 *
+	 * Records are pushed from any thread without taking a lock, so the sink can back
+	 * a logger used on the data path. When the buffer is full new records are
+	 * dropped and counted instead of blocking the caller. flush() hands the buffered
+	 * records, in order, to a slow handler (file, console, network) from a single
+	 * consumer thread.
+	 *
+	 * Messages longer than MAX_MESSAGE_SIZE are truncated.
+	 */
+	class log_ring_buffer
+	{
+		public:
+
+			/**
+			 * \brief The default capacity, in records.
+			 */
+			static const size_t DEFAULT_CAPACITY = 1024;
+
+			/**
+			 * \brief The maximum message size, in characters.
+			 */
+			static const size_t MAX_MESSAGE_SIZE = 255;
+
+			/**
+			 * \brief Create a new ring buffer.
+			 * \param capacity The capacity, in records. It is rounded up to the next power of two.
+			 */
+			explicit log_ring_buffer(size_t capacity = DEFAULT_CAPACITY);
+
+			/**
+			 * \brief Push a record.
+			 * \param level The log level.
+			 * \param msg The message. It is copied into the record, truncated if needed.
+			 * \param timestamp The timestamp.
+			 *
+			 * This method is lock-free and can be called from any thread. If the buffer is full the record is dropped.
+			 */
+			void push(log_level level, const std::string& msg, const logger::timestamp_type& timestamp);
+
+			/**
+			 * \brief Flush the buffered records.
+			 * \param handler The handler to call for each record, in order.
+			 * \return The count of flushed records.
+			 * \warning Only one thread at a time may call flush().
+			 */
+			size_t flush(const logger::log_handler_type& handler);
+
+			/**
+			 * \brief Get the count of records dropped because the buffer was full.
+			 * \return The count of dropped records.
+			 */
+			size_t dropped() const
+			{
+				return m_dropped.load(boost::memory_order_relaxed);
+			}
+
+			/**
+			 * \brief Get a log handler that pushes into this ring buffer.
+			 * \return The handler, suitable for logger::set_callback().
+			 * \warning The returned handler references this instance, which must outlive the logger.
+			 */
+			logger::log_handler_type make_handler()
+			{
+				return boost::bind(&log_ring_buffer::push, this, _1, _2, _3);
+			}
+
+		private:
+
+			struct record_type
+			{
+				boost::atomic<size_t> sequence;
+				log_level level;
+				logger::timestamp_type timestamp;
+				size_t size;
+				char message[MAX_MESSAGE_SIZE + 1];
+			};
+
+			boost::scoped_array<record_type> m_records;
+			size_t m_mask;
+			boost::atomic<size_t> m_head;
+			size_t m_tail;
+			boost::atomic<size_t> m_dropped;
+	};
+}
+
+#endif /* FSCP_LOG_RING_BUFFER_HPP */
@@ -71,6 +71,51 @@ namespace fscp
 		fatal /**< \brief The fatal log level. */
 	};
 
+	/**
+	 * \brief The numeric values of the log levels, for use in FSCP_LOG_MIN_LEVEL.
+	 */
+#define FSCP_LOG_LEVEL_TRACE 0
+#define FSCP_LOG_LEVEL_DEBUG 1
+#define FSCP_LOG_LEVEL_INFORMATION 2
+#define FSCP_LOG_LEVEL_IMPORTANT 3
+#define FSCP_LOG_LEVEL_WARNING 4
+#define FSCP_LOG_LEVEL_ERROR 5
+#define FSCP_LOG_LEVEL_FATAL 6
+
+	/**
+	 * \brief The lowest log level compiled into this build.
+	 *
+	 * FSCP_LOG() statements below that level - including their streamed
+	 * arguments - are dead code that the compiler removes entirely. Debug
+	 * builds keep everything; release builds keep information and above
+	 * unless FSCP_LOG_MIN_LEVEL is defined on the command line.
+	 */
+#ifndef FSCP_LOG_MIN_LEVEL
+#ifdef FREELAN_DEBUG
+#define FSCP_LOG_MIN_LEVEL FSCP_LOG_LEVEL_TRACE
+#else
+#define FSCP_LOG_MIN_LEVEL FSCP_LOG_LEVEL_INFORMATION
+#endif
+#endif
+
+	/**
+	 * \brief The lowest log level compiled into this build, as a log_level.
+	 */
+	const log_level compiled_log_level = static_cast<log_level>(FSCP_LOG_MIN_LEVEL);
+
+	/**
+	 * \brief Log at the specified level through the specified logger.
+	 *
+	 * Unlike calling the logger directly, the whole statement compiles to
+	 * nothing when level_ is a constant below compiled_log_level: the branch
+	 * is decided at compile time and the streamed arguments are never
+	 * evaluated. Use this form on hot paths; the direct call stays available
+	 * for levels that are always compiled in.
+	 */
+#define FSCP_LOG(logger_, level_) \
+	if ((level_) < ::fscp::compiled_log_level) {} \
+	else (logger_)(level_)
+
 	/**
 	 * \brief A null logger stream.
 	 */
@@ -350,10 +395,12 @@ namespace fscp
 			 * \brief Get a logger stream.
 			 * \param level_ The log level.
 			 * \return The appropriate logger stream.
+			 *
+			 * A null stream is returned when the level is rejected or no callback is set: in that case the values output to the stream are never formatted.
 			 */
 			stream_type operator()(log_level level_) const
 			{
-				if (level_ >= m_level)
+				if (m_handler && (level_ >= m_level))
 				{
 					return logger_stream_impl(string_logger_stream(*this, level_));
 				}
@@ -0,0 +1,86 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file lz4.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A minimal LZ4 block codec.
+ */
+
+#ifndef FSCP_LZ4_HPP
+#define FSCP_LZ4_HPP
+
+#include <stdint.h>
+#include <cstddef>
+
+namespace fscp
+{
+	/**
+	 * \brief Get the worst-case compressed size for a given input size.
+	 * \param size The input size.
+	 * \return The size a compression destination buffer must have to never overflow.
+	 */
+	inline size_t lz4_compress_bound(size_t size)
+	{
+		return size + size / 255 + 16;
+	}
+
+	/**
+	 * \brief Compress a buffer, producing an LZ4 block.
+	 * \param src The input buffer.
+	 * \param src_len The input size.
+	 * \param dst The output buffer.
+	 * \param dst_capacity The output buffer size.
+	 * \return The compressed size, or 0 if the compressed data does not fit within dst_capacity.
+	 *
+	 * Passing a dst_capacity smaller than lz4_compress_bound(src_len) is the cheap escape for incompressible input: the compressor gives up as soon as the output would exceed the capacity instead of finishing the block.
+	 */
+	size_t lz4_compress(const void* src, size_t src_len, void* dst, size_t dst_capacity);
+
+	/**
+	 * \brief Decompress an LZ4 block.
+	 * \param src The compressed block.
+	 * \param src_len The compressed size.
+	 * \param dst The output buffer.
+	 * \param dst_capacity The output buffer size.
+	 * \return The decompressed size, or 0 if the block is malformed or the decompressed data does not fit within dst_capacity.
+	 */
+	size_t lz4_decompress(const void* src, size_t src_len, void* dst, size_t dst_capacity);
+}
+
+#endif /* FSCP_LZ4_HPP */
@@ -0,0 +1,213 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+
+/**
+ * \file metrics.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A lock-free runtime metrics registry.
+ */
+
+#ifndef FSCP_METRICS_HPP
+#define FSCP_METRICS_HPP
+
+#include <map>
+#include <string>
+
+#include <boost/array.hpp>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <stdint.h>
+
+namespace fscp
+{
+	/**
+	 * \brief A registry of runtime counters and histograms.
+	 *
+	 * Counters and histograms are sharded across cache-line-padded slots, one per thread, and updated with relaxed atomic operations only, so the data paths can record events without taking a lock or contending on a shared cache line. The shards are summed when the values are scraped, so a scrape may observe a slightly torn view, which is fine for monitoring purposes.
+	 *
+	 * Looking a metric up by name takes a lock: resolve the reference once at setup time and keep it, never on a per-event basis. The returned references remain valid for the whole registry lifetime.
+	 */
+	class metrics_registry : public boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief The number of shards of every metric.
+			 */
+			static const size_t SHARD_COUNT = 16;
+
+			/**
+			 * \brief The number of histogram buckets.
+			 *
+			 * Bucket N counts the recorded values whose highest set bit is N, so the buckets cover an exponential range.
+			 */
+			static const size_t BUCKET_COUNT = 32;
+
+			/**
+			 * \brief A monotonic counter.
+			 */
+			class counter : public boost::noncopyable
+			{
+				public:
+
+					/**
+					 * \brief Increment the counter.
+					 * \param delta The amount to add.
+					 */
+					void increment(uint64_t delta = 1)
+					{
+						m_shards[shard_index()].value.fetch_add(delta, boost::memory_order_relaxed);
+					}
+
+					/**
+					 * \brief Get the current value, summed across all the shards.
+					 * \return The value.
+					 */
+					uint64_t value() const;
+
+				private:
+
+					struct shard_type
+					{
+						boost::atomic<uint64_t> value;
+						uint8_t padding[64 - sizeof(boost::atomic<uint64_t>) % 64];
+					};
+
+					counter();
+
+					boost::array<shard_type, SHARD_COUNT> m_shards;
+
+					friend class metrics_registry;
+			};
+
+			/**
+			 * \brief An exponentially-bucketed histogram.
+			 */
+			class histogram : public boost::noncopyable
+			{
+				public:
+
+					/**
+					 * \brief An aggregated view of a histogram.
+					 */
+					struct sample_type
+					{
+						uint64_t count;
+						uint64_t sum;
+						boost::array<uint64_t, BUCKET_COUNT> buckets;
+					};
+
+					/**
+					 * \brief Record a value.
+					 * \param value The value.
+					 */
+					void record(uint64_t value);
+
+					/**
+					 * \brief Get an aggregated view, summed across all the shards.
+					 * \return The aggregated view.
+					 */
+					sample_type sample() const;
+
+				private:
+
+					struct shard_type
+					{
+						boost::atomic<uint64_t> count;
+						boost::atomic<uint64_t> sum;
+						boost::array<boost::atomic<uint64_t>, BUCKET_COUNT> buckets;
+						uint8_t padding[64 - (sizeof(boost::atomic<uint64_t>) * (2 + BUCKET_COUNT)) % 64];
+					};
+
+					histogram();
+
+					boost::array<shard_type, SHARD_COUNT> m_shards;
+
+					friend class metrics_registry;
+			};
+
+			/**
+			 * \brief Get the process-wide registry.
+			 * \return The registry.
+			 */
+			static metrics_registry& get_default_instance();
+
+			/**
+			 * \brief Get or create a counter.
+			 * \param name The counter name.
+			 * \return The counter. The reference remains valid for the registry lifetime.
+			 */
+			counter& get_counter(const std::string& name);
+
+			/**
+			 * \brief Get or create a histogram.
+			 * \param name The histogram name.
+			 * \return The histogram. The reference remains valid for the registry lifetime.
+			 */
+			histogram& get_histogram(const std::string& name);
+
+			/**
+			 * \brief Scrape all the counters.
+			 * \return The counter values, indexed by name.
+			 */
+			std::map<std::string, uint64_t> counter_values() const;
+
+			/**
+			 * \brief Scrape all the histograms.
+			 * \return The aggregated histograms, indexed by name.
+			 */
+			std::map<std::string, histogram::sample_type> histogram_values() const;
+
+		private:
+
+			static size_t shard_index();
+
+			typedef std::map<std::string, boost::shared_ptr<counter> > counter_map_type;
+			typedef std::map<std::string, boost::shared_ptr<histogram> > histogram_map_type;
+
+			mutable boost::mutex m_mutex;
+			counter_map_type m_counters;
+			histogram_map_type m_histograms;
+	};
+}
+
+#endif /* FSCP_METRICS_HPP */
@@ -50,11 +50,14 @@
 #include <cryptoplus/buffer.hpp>
 #include <cryptoplus/random/random.hpp>
 #include <cryptoplus/pkey/ecdhe.hpp>
+#include <cryptoplus/cipher/cipher_context.hpp>
 
 #include <boost/optional.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/make_shared.hpp>
 
+#include <vector>
+
 namespace fscp
 {
 	/**
@@ -64,55 +67,82 @@ namespace fscp
 	{
 		public:
 
+			/**
+			 * \brief The default anti-replay window size, in sequence numbers.
+			 */
+			static const size_t DEFAULT_REPLAY_WINDOW_SIZE = 128;
+
 			struct session_parameters
 			{
-				session_parameters(session_number_type _session_number, cipher_suite_type _cipher_suite, elliptic_curve_type _elliptic_curve, const cryptoplus::buffer& _public_key) :
+				session_parameters(session_number_type _session_number, cipher_suite_type _cipher_suite, elliptic_curve_type _elliptic_curve, compression_algorithm_type _compression_algorithm, const cryptoplus::buffer& _public_key) :
 					session_number(_session_number),
 					cipher_suite(_cipher_suite),
 					elliptic_curve(_elliptic_curve),
+					compression_algorithm(_compression_algorithm),
 					public_key(_public_key)
 				{}
 
 				session_number_type session_number;
 				cipher_suite_type cipher_suite;
 				elliptic_curve_type elliptic_curve;
+				compression_algorithm_type compression_algorithm;
 				cryptoplus::buffer public_key;
 			};
 
 			struct next_session_type
 			{
-				next_session_type(session_number_type _session_number, cipher_suite_type _cipher_suite, elliptic_curve_type _elliptic_curve) :
-					ecdhe_context(_elliptic_curve.to_elliptic_curve_nid()),
-					parameters(_session_number, _cipher_suite, _elliptic_curve, ecdhe_context.get_public_key())
+				next_session_type(session_number_type _session_number, cipher_suite_type _cipher_suite, elliptic_curve_type _elliptic_curve, compression_algorithm_type _compression_algorithm, boost::shared_ptr<cryptoplus::pkey::ecdhe_context> _ecdhe_context) :
+					ecdhe_context(_ecdhe_context ? _ecdhe_context : boost::make_shared<cryptoplus::pkey::ecdhe_context>(_elliptic_curve.to_elliptic_curve_nid())),
+					parameters(_session_number, _cipher_suite, _elliptic_curve, _compression_algorithm, ecdhe_context->get_public_key())
 				{}
 
-				cryptoplus::pkey::ecdhe_context ecdhe_context;
+				boost::shared_ptr<cryptoplus::pkey::ecdhe_context> ecdhe_context;
 				session_parameters parameters;
 			};
 
 			struct current_session_type
 			{
-				explicit current_session_type(const session_parameters& _parameters) :
+				current_session_type(const session_parameters& _parameters, size_t _replay_window_size) :
 					parameters(_parameters),
 					local_sequence_number(),
-					remote_sequence_number()
+					remote_sequence_number(),
+					// One word more than the advertised window: as the front advances, register_sequence_number() clears whole words before use (RFC 6479), so the word being cleared cannot count toward the usable window - without the redundant word, every slide across a word boundary would re-accept up to 63 already-seen sequence numbers.
+					replay_window(_replay_window_size / 64 + 1, 0)
 				{}
 
 				bool is_old() const;
 
+				/**
+				 * \brief Get the size of the anti-replay window, in sequence numbers.
+				 *
+				 * The bitmap holds one redundant word on top of this, so the whole advertised window stays covered while the front word is being recycled.
+				 */
+				size_t replay_window_size() const { return (replay_window.size() - 1) * 64; }
+
 				session_parameters parameters;
 				sequence_number_type local_sequence_number;
 				sequence_number_type remote_sequence_number;
+
+				// The anti-replay bitmap, covering the replay_window_size() sequence numbers up to remote_sequence_number, plus the redundant word.
+				std::vector<uint64_t> replay_window;
 				cryptoplus::buffer local_session_key;
 				cryptoplus::buffer remote_session_key;
 				cryptoplus::buffer local_nonce_prefix;
 				cryptoplus::buffer remote_nonce_prefix;
+
+				// Cached cipher contexts, keyed once at session establishment so that per-packet encryption only re-seeds the IV.
+				boost::shared_ptr<cryptoplus::cipher::cipher_context> local_cipher_context;
+				boost::shared_ptr<cryptoplus::cipher::cipher_context> remote_cipher_context;
 			};
 
 			peer_session() :
 				m_local_host_identifier(),
 				m_remote_host_identifier(),
-				m_last_sign_of_life(boost::posix_time::microsec_clock::local_time())
+				m_last_sign_of_life(boost::posix_time::microsec_clock::local_time()),
+				m_last_data_activity(boost::posix_time::min_date_time),
+				m_replay_window_size(DEFAULT_REPLAY_WINDOW_SIZE),
+				m_session_ecdhe_nid(0),
+				m_extended_key_derivation(false)
 			{
 				// Generate a random host identifier.
 				cryptoplus::random::get_random_bytes(m_local_host_identifier.data.data(), m_local_host_identifier.data.size());
@@ -131,6 +161,14 @@ namespace fscp
 			 */
 			bool set_first_remote_host_identifier(const host_identifier_type& _host_identifier);
 
+			/**
+			 * \brief Enable the extended (version 4) key derivation for this peer.
+			 * \param enabled true to enable.
+			 *
+			 * The extended derivation salts the session keys and nonce prefixes with the session number, which is what makes reusing the ECDHE key pair and shared secret across rekeys safe. It MUST only be enabled once the peer was seen speaking protocol version 4 on an authenticated handshake message: a version 3 peer derives unsalted material as per section 3.3 of the specification, and mismatched derivations make every data message fail authentication.
+			 */
+			void set_extended_key_derivation(bool enabled) { m_extended_key_derivation = enabled; }
+
 			/**
 			 * \brief Clear the remote host identifier.
 			 */
@@ -160,23 +198,61 @@ namespace fscp
 				m_last_sign_of_life = boost::posix_time::microsec_clock::local_time();
 			}
 
+			/**
+			 * \brief Record that real data was received over the session.
+			 *
+			 * Unlike keep_alive(), this is only called for non-keep-alive data messages: it tells the lazy keep-alive mode which sessions carry actual traffic, so two idle peers exchanging probes do not keep each other looking active.
+			 */
+			void data_activity()
+			{
+				m_last_data_activity = boost::posix_time::microsec_clock::local_time();
+			}
+
+			/**
+			 * \brief Check whether real data was received recently.
+			 * \param duration The duration to look back over.
+			 * \return true if a non-keep-alive data message was received within the given duration.
+			 */
+			bool has_data_activity_within(const boost::posix_time::time_duration& duration) const
+			{
+				return (boost::posix_time::microsec_clock::local_time() <= m_last_data_activity + duration);
+			}
+
 			/**
 			 * \brief Prepare the next session.
 			 * \param _session_number The next session number.
 			 * \param _cipher_suite The next cipher suite.
 			 * \param _elliptic_curve The next elliptic curve.
+			 * \param _compression_algorithm The next compression algorithm.
+			 * \param _ecdhe_context An ECDHE context whose key pair was already generated, typically taken from an ecdhe_key_pool. If null, a key pair is generated inline.
 			 * \return true if a new session was created.
+			 *
+			 * When the extended key derivation is enabled, a rekey over the same elliptic curve reuses the key pair of the current session, so the subsequent complete_session() finds its cached shared secret and skips the agreement. Otherwise a fresh key pair is used, as a version 3 peer expects.
 			 */
-			bool prepare_session(session_number_type _session_number, cipher_suite_type _cipher_suite, elliptic_curve_type _elliptic_curve);
+			bool prepare_session(session_number_type _session_number, cipher_suite_type _cipher_suite, elliptic_curve_type _elliptic_curve, compression_algorithm_type _compression_algorithm, boost::shared_ptr<cryptoplus::pkey::ecdhe_context> _ecdhe_context = boost::shared_ptr<cryptoplus::pkey::ecdhe_context>());
 
 			/**
 			 * \brief Complete the next session.
 			 * \param remote_public_key The remote public key.
 			 * \param remote_public_key_size The remote public key size.
 			 * \return true if the session was completed.
+			 *
+			 * When the extended key derivation is enabled and both key pairs are unchanged since the last agreement - the common case on rekey - the cached shared secret is reused and the session keys are derived with a handful of PRF invocations, salted with the session number. The forward secrecy boundary is thus the full handshake, as with session resumption; clearing the session drops the cache.
 			 */
 			bool complete_session(const void* remote_public_key, size_t remote_public_key_size);
 
+			/**
+			 * \brief Resume a session from a cached resumption secret.
+			 * \param parameters The parameters of the resumed session.
+			 * \param _resumption_secret The resumption secret derived when the previous session was established.
+			 * \param request_nonce The nonce of the resumption request. Must be SESSION_RESUMPTION_NONCE_SIZE bytes long.
+			 * \param response_nonce The nonce of the resumption response. Must be SESSION_RESUMPTION_NONCE_SIZE bytes long.
+			 * \return true if the session was resumed.
+			 *
+			 * The session keys are derived from the resumption secret and the two nonces: no ECDHE exchange takes place.
+			 */
+			bool resume_session(const session_parameters& parameters, const cryptoplus::buffer& _resumption_secret, const uint8_t* request_nonce, const uint8_t* response_nonce);
+
 			/**
 			 * \brief Get the next session number.
 			 * \return The next session number.
@@ -214,11 +290,71 @@ namespace fscp
 			sequence_number_type increment_local_sequence_number() { return ++m_current_session->local_sequence_number; }
 
 			/**
-			 * \brief Set the remote sequence number.
+			 * \brief The per-session compression statistics, in payload bytes.
+			 */
+			struct compression_statistics_type
+			{
+				compression_statistics_type() :
+					rx_raw_bytes(0),
+					rx_wire_bytes(0)
+				{}
+
+				uint64_t rx_raw_bytes;
+				uint64_t rx_wire_bytes;
+			};
+
+			/**
+			 * \brief Record the sizes of a received data payload.
+			 * \param raw_bytes The payload size after decompression.
+			 * \param wire_bytes The payload size as it traveled, framing included.
+			 */
+			void record_rx_compression(uint64_t raw_bytes, uint64_t wire_bytes)
+			{
+				m_compression_statistics.rx_raw_bytes += raw_bytes;
+				m_compression_statistics.rx_wire_bytes += wire_bytes;
+			}
+
+			/**
+			 * \brief Get the compression statistics.
+			 * \return The compression statistics.
+			 */
+			const compression_statistics_type& compression_statistics() const { return m_compression_statistics; }
+
+			/**
+			 * \brief Set the anti-replay window size.
+			 * \param window_size The window size, in sequence numbers. It is rounded up to a multiple of 64 and clamped to [64, 1024].
+			 *
+			 * Only sessions completed after the call use the new size.
+			 */
+			void set_replay_window_size(size_t window_size);
+
+			/**
+			 * \brief Check whether a remote sequence number would be accepted.
 			 * \param sequence_number The remote sequence number.
-			 * \return true if the sequence number was incremented with the new value, false is the current sequence number is greater than sequence_number.
+			 * \return true if the sequence number is ahead of the window, or inside the window and not seen yet.
 			 */
-			bool set_remote_sequence_number(sequence_number_type sequence_number);
+			bool is_acceptable_sequence_number(sequence_number_type sequence_number) const;
+
+			/**
+			 * \brief Register a remote sequence number into the anti-replay window.
+			 * \param sequence_number The remote sequence number.
+			 * \return true if the sequence number was accepted, false if it was already seen or falls behind the window.
+			 */
+			bool register_sequence_number(sequence_number_type sequence_number);
+
+			/**
+			 * \brief Check if a resumption secret is available.
+			 * \return true if a resumption secret is available.
+			 */
+			bool has_resumption_secret() const { return cryptoplus::buffer_size(m_resumption_secret) > 0; }
+
+			/**
+			 * \brief Get the resumption secret derived from the last established session.
+			 * \return The resumption secret. Empty if no session was established yet.
+			 *
+			 * Both hosts derive the same secret: it is seeded with the XOR of the host identifiers, which does not depend on which side initiated the handshake.
+			 */
+			const cryptoplus::buffer& resumption_secret() const { return m_resumption_secret; }
 
 			/**
 			 * \brief Clear the current session.
@@ -228,13 +364,26 @@ namespace fscp
 
 		private:
 
+			void establish_session(const session_parameters& parameters, const cryptoplus::buffer& secret_key, bool salted = false);
+
 			host_identifier_type m_local_host_identifier;
 			boost::optional<host_identifier_type> m_remote_host_identifier;
 
 			boost::posix_time::ptime m_last_sign_of_life;
+			boost::posix_time::ptime m_last_data_activity;
 
 			boost::shared_ptr<next_session_type> m_next_session;
 			boost::shared_ptr<current_session_type> m_current_session;
+
+			// The derived-key cache: the ECDHE context (and curve) whose key pair produced the cached shared secret, and the remote public key it was agreed with.
+			boost::shared_ptr<cryptoplus::pkey::ecdhe_context> m_session_ecdhe_context;
+			int m_session_ecdhe_nid;
+			cryptoplus::buffer m_cached_remote_public_key;
+			cryptoplus::buffer m_cached_shared_secret;
+			bool m_extended_key_derivation;
+			size_t m_replay_window_size;
+			compression_statistics_type m_compression_statistics;
+			cryptoplus::buffer m_resumption_secret;
 	};
 }
 
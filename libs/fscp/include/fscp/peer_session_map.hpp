@@ -0,0 +1,146 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file peer_session_map.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A sharded peer session map.
+ */
+
+#ifndef FSCP_PEER_SESSION_MAP_HPP
+#define FSCP_PEER_SESSION_MAP_HPP
+
+#include "peer_session.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace fscp
+{
+	/**
+	 * \brief A sharded map of peer sessions.
+	 *
+	 * Lookups only lock the shard that holds the endpoint, so the data path
+	 * can resolve sessions concurrently from any thread. Serializing access
+	 * to the peer_session instances themselves remains the responsibility of
+	 * the caller (the server does it through its session strand).
+	 *
+	 * References returned by operator[]() remain valid for the lifetime of
+	 * the map: entries are never erased, matching the behavior of the plain
+	 * std::map this class replaces.
+	 */
+	class peer_session_map
+	{
+		public:
+
+			peer_session_map() :
+				m_replay_window_size(peer_session::DEFAULT_REPLAY_WINDOW_SIZE)
+			{}
+
+			/**
+			 * \brief The endpoint type.
+			 */
+			typedef boost::asio::ip::udp::endpoint ep_type;
+
+			/**
+			 * \brief The session pointer type.
+			 */
+			typedef boost::shared_ptr<peer_session> peer_session_ptr;
+
+			/**
+			 * \brief An entry of the map.
+			 */
+			typedef std::pair<ep_type, peer_session_ptr> value_type;
+
+			/**
+			 * \brief A stable copy of the map content.
+			 */
+			typedef std::vector<value_type> snapshot_type;
+
+			/**
+			 * \brief Set the anti-replay window size of the sessions created from now on.
+			 * \param window_size The window size, in sequence numbers. See peer_session::set_replay_window_size().
+			 * \warning This method is *NOT* thread-safe and should be called before any session is created.
+			 */
+			void set_replay_window_size(size_t window_size)
+			{
+				m_replay_window_size = window_size;
+			}
+
+			/**
+			 * \brief Get the session associated to an endpoint, creating it if needed.
+			 * \param ep The endpoint.
+			 * \return The session.
+			 */
+			peer_session& operator[](const ep_type& ep);
+
+			/**
+			 * \brief Find the session associated to an endpoint.
+			 * \param ep The endpoint.
+			 * \return The session, or a null pointer if the endpoint is unknown.
+			 */
+			peer_session_ptr find(const ep_type& ep) const;
+
+			/**
+			 * \brief Get a stable copy of all the entries.
+			 * \return The entries.
+			 */
+			snapshot_type snapshot() const;
+
+		private:
+
+			static const size_t SHARD_COUNT = 16;
+
+			static size_t shard_for(const ep_type& ep);
+
+			struct shard_type
+			{
+				mutable boost::mutex mutex;
+				std::map<ep_type, peer_session_ptr> sessions;
+			};
+
+			size_t m_replay_window_size;
+			shard_type m_shards[SHARD_COUNT];
+	};
+}
+
+#endif /* FSCP_PEER_SESSION_MAP_HPP */
@@ -46,20 +46,36 @@
 #define FSCP_SERVER_HPP
 
 #include <boost/asio.hpp>
+#include <boost/asio/coroutine.hpp>
 
 #include "identity_store.hpp"
+#include "server_error.hpp"
 #include "shared_buffer.hpp"
 #include "presentation_store.hpp"
 #include "peer_session.hpp"
+#include "peer_session_map.hpp"
+#include "ecdhe_key_pool.hpp"
+#include "timer_wheel.hpp"
+#include "handler_memory.hpp"
+#include "endpoint_hash.hpp"
 #include "logger.hpp"
+#include "metrics.hpp"
+#include "counted_strand.hpp"
 
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
 #include <boost/optional.hpp>
+#include <boost/array.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <set>
 #include <map>
 #include <queue>
+#include <deque>
+#include <vector>
 #include <iostream>
 
 #include <stdint.h>
@@ -71,6 +87,7 @@ namespace fscp
 	class session_request_message;
 	class clear_session_request_message;
 	class session_message;
+	class session_resumption_message;
 	class clear_session_message;
 	class data_message;
 
@@ -145,6 +162,120 @@ namespace fscp
 			 */
 			typedef boost::function<void (const std::set<ep_type>&)> endpoints_handler_type;
 
+			/**
+			 * \brief Per-peer traffic statistics.
+			 */
+			struct peer_statistics
+			{
+				peer_statistics() :
+					tx_bytes(0),
+					tx_packets(0),
+					rx_bytes(0),
+					rx_packets(0),
+					path_mtu(0),
+					path_rtt_us(0),
+					path_loss_percent(0)
+				{}
+
+				uint64_t tx_bytes; /**< \brief The count of data bytes sent to the peer. */
+				uint64_t tx_packets; /**< \brief The count of data packets sent to the peer. */
+				uint64_t rx_bytes; /**< \brief The count of data bytes received from the peer. */
+				uint64_t rx_packets; /**< \brief The count of data packets received from the peer. */
+				uint64_t path_mtu; /**< \brief The largest data payload validated by path MTU probing, in bytes. 0 until a probe was acknowledged. */
+				uint64_t path_rtt_us; /**< \brief The smoothed path round-trip time measured by quality probes, in microseconds. 0 until a probe was acknowledged. */
+				uint64_t path_loss_percent; /**< \brief The smoothed path probe loss, in percent. */
+			};
+
+			/**
+			 * \brief The queue depth statistics.
+			 *
+			 * The strand gauges count the handlers posted but not yet started; the socket numbers are the last periodic sample across all the receive sockets.
+			 */
+			struct queue_statistics_type
+			{
+				queue_statistics_type() :
+					socket_strand_pending(0),
+					write_queue_strand_pending(0),
+					greet_strand_pending(0),
+					presentation_strand_pending(0),
+					session_strand_pending(0),
+					data_strand_pending(0),
+					contact_strand_pending(0),
+					crypto_strands_pending(0),
+					socket_receive_queue_bytes(0),
+					socket_receive_buffer_size(0),
+					socket_send_buffer_size(0),
+					socket_kernel_drops(0)
+				{}
+
+				uint32_t socket_strand_pending; /**< \brief The pending handlers of the socket strand. */
+				uint32_t write_queue_strand_pending; /**< \brief The pending handlers of the write queue strand. */
+				uint32_t greet_strand_pending; /**< \brief The pending handlers of the greet strand. */
+				uint32_t presentation_strand_pending; /**< \brief The pending handlers of the presentation strand. */
+				uint32_t session_strand_pending; /**< \brief The pending handlers of the session strand. */
+				uint32_t data_strand_pending; /**< \brief The pending handlers of the data strand. */
+				uint32_t contact_strand_pending; /**< \brief The pending handlers of the contact strand. */
+				uint32_t crypto_strands_pending; /**< \brief The pending handlers of all the per-host crypto strands. */
+				uint64_t socket_receive_queue_bytes; /**< \brief The bytes queued in the kernel receive buffers. */
+				uint64_t socket_receive_buffer_size; /**< \brief The total capacity of the kernel receive buffers. */
+				uint64_t socket_send_buffer_size; /**< \brief The effective capacity of the kernel send buffer. */
+				uint64_t socket_kernel_drops; /**< \brief The datagrams the kernel dropped for lack of receive buffer space. Zero when the platform cannot report it. */
+			};
+
+			/**
+			 * \brief A caller-retained endpoint list.
+			 *
+			 * Broadcast overloads taking this type post the shared pointer instead of copying the set on every call.
+			 */
+			typedef boost::shared_ptr<const std::set<ep_type> > endpoint_set_ptr;
+
+			/**
+			 * \brief The egress statistics of a channel.
+			 */
+			struct channel_statistics_type
+			{
+				channel_statistics_type() :
+					depth(0),
+					dropped(0)
+				{}
+
+				size_t depth; /**< The current count of queued datagrams. */
+				size_t dropped; /**< The total count of dropped datagrams. */
+			};
+
+			/**
+			 * \brief The egress statistics, indexed by channel number.
+			 */
+			typedef boost::array<channel_statistics_type, CHANNEL_NUMBER_COUNT> egress_statistics_type;
+
+			/**
+			 * \brief An egress statistics handler.
+			 */
+			typedef boost::function<void (const egress_statistics_type&)> egress_statistics_handler_type;
+
+			/**
+			 * \brief The peer send queue policies.
+			 */
+			enum peer_send_queue_policy_type
+			{
+				PSQ_DROP_NEWEST, /**< \brief Reject the incoming datagram when the queue is full. */
+				PSQ_DROP_OLDEST /**< \brief Evict the oldest parked datagram when the queue is full. */
+			};
+
+			/**
+			 * \brief A handler for peer congestion state changes.
+			 * \param host The host whose congestion state changed.
+			 * \param congested Whether sends to the host are now parked for lack of queue room.
+			 */
+			typedef boost::function<void (const ep_type& host, bool congested)> peer_congestion_handler_type;
+
+			/**
+			 * \brief A handler for when the discovered path MTU of a peer changes.
+			 * \param host The host.
+			 * \param path_mtu The largest data payload, in bytes, validated to traverse the path to the host.
+			 */
+			typedef boost::function<void (const ep_type& host, size_t path_mtu)> path_mtu_changed_handler_type;
+
 			// Callbacks
 
 			/**
@@ -449,6 +580,13 @@ namespace fscp
 			 */
 			void async_reintroduce_to_all(multiple_endpoints_handler_type handler);
 
+			/**
+			 * \brief Resend a presentation message to all the known peers, paced over a window.
+			 * \param handler The handler to call when all the presentation messages were sent or an error occured.
+			 * \param pacing_window The window over which the presentations are spread. Each target gets an even slot in the window, jittered within the slot, so maintenance traffic never leaves as a single burst.
+			 */
+			void async_reintroduce_to_all(multiple_endpoints_handler_type handler, const boost::posix_time::time_duration& pacing_window);
+
 			/**
 			 * \brief Send a presentation message to the specified target.
 			 * \return A map of error codes.
@@ -603,6 +741,26 @@ namespace fscp
 			 */
 			std::set<ep_type> sync_get_session_endpoints();
 
+			/**
+			 * \brief Get a list of endpoints to which the server has an active session, without going through the session strand.
+			 * \return The list of endpoints.
+			 *
+			 * Only the session map shard mutexes are taken, briefly: monitoring can call this from any thread without posting work into - or waiting on - the data path. The result is a snapshot and may be marginally stale.
+			 */
+			std::set<ep_type> get_session_endpoints_snapshot() const;
+
+			/**
+			 * \brief Get a snapshot of the per-peer traffic statistics.
+			 * \return The statistics, indexed by peer endpoint. The entries are cumulative since the server started.
+			 */
+			std::map<ep_type, peer_statistics> get_peer_statistics() const;
+
+			/**
+			 * \brief Get a snapshot of the queue depth statistics.
+			 * \return The statistics. The view may be slightly torn, which is fine for monitoring purposes.
+			 */
+			queue_statistics_type get_queue_statistics() const;
+
 			/**
 			 * \brief Check if a session exists with the specified endpoint.
 			 * \param handler The handler to call with the result.
@@ -909,6 +1067,19 @@ namespace fscp
 			 */
 			void async_send_data(const ep_type& target, channel_number_type channel_number, boost::asio::const_buffer data, simple_handler_type handler);
 
+			/**
+			 * \brief Send data to a host, reusing the caller's buffer for the datagram.
+			 * \param target The target host.
+			 * \param channel_number The channel number.
+			 * \param frame The buffer that holds the data and that remains alive until the send completes.
+			 * \param data The data to send. It must point inside frame.
+			 * \param handler The handler to call when the data was sent or an error occured.
+			 *
+			 * If data sits exactly data_message::DATA_PAYLOAD_OFFSET bytes into frame, the datagram is built in place in frame and no intermediate copy of the cleartext occurs. Otherwise this behaves exactly like async_send_data().
+			 * \warning The cleartext in frame may be overwritten by the encryption: the caller must not read it once this function was called.
+			 */
+			void async_send_data_in_place(const ep_type& target, channel_number_type channel_number, SharedBuffer frame, boost::asio::const_buffer data, simple_handler_type handler);
+
 			/**
 			 * \brief Send data to a host.
 			 * \param target The target host.
@@ -929,6 +1100,15 @@ namespace fscp
 			 */
 			void async_send_data_to_list(const std::set<ep_type>& targets, channel_number_type channel_number, boost::asio::const_buffer data, multiple_endpoints_handler_type handler);
 
+			/**
+			 * \brief Send data to a caller-retained list of hosts.
+			 * \param targets The list of hosts. It is not copied: the caller may reuse the same snapshot across calls but must not mutate it afterwards. The endpoints must already be normalized, as returned by async_get_session_endpoints().
+			 * \param channel_number The channel number.
+			 * \param data The data to send.
+			 * \param handler The handler to call when the data was sent to all hosts or an error occured.
+			 */
+			void async_send_data_to_list(endpoint_set_ptr targets, channel_number_type channel_number, boost::asio::const_buffer data, multiple_endpoints_handler_type handler);
+
 			/**
 			 * \brief Send data to a list of hosts.
 			 * \param begin An iterator to the first endpoint of the list.
@@ -1062,7 +1242,18 @@ namespace fscp
 			 */
 			void async_send_contact_request_to_all(const hash_list_type& hash_list, multiple_endpoints_handler_type handler)
 			{
-				m_session_strand.post(boost::bind(&server::do_send_contact_request_to_all, this, hash_list, handler));
+				m_session_strand.post(boost::bind(&server::do_send_contact_request_to_all, this, hash_list, handler, boost::posix_time::time_duration()));
+			}
+
+			/**
+			 * \brief Send a contact request to all hosts, paced over a window.
+			 * \param hash_list The hashes to include in the contact request.
+			 * \param handler The handler to call when the contact request was sent to all hosts or an error occured.
+			 * \param pacing_window The window over which the sends are spread, with per-target jitter.
+			 */
+			void async_send_contact_request_to_all(const hash_list_type& hash_list, multiple_endpoints_handler_type handler, const boost::posix_time::time_duration& pacing_window)
+			{
+				m_session_strand.post(boost::bind(&server::do_send_contact_request_to_all, this, hash_list, handler, pacing_window));
 			}
 
 			/**
@@ -1145,7 +1336,20 @@ namespace fscp
 			 */
 			void async_send_contact_to_all(const contact_map_type& contact_map, multiple_endpoints_handler_type handler)
 			{
-				m_session_strand.post(boost::bind(&server::do_send_contact_to_all, this, contact_map, handler));
+				// The map is copied once into an immutable snapshot: every per-peer send shares it instead of duplicating it.
+				m_session_strand.post(boost::bind(&server::do_send_contact_to_all, this, boost::make_shared<const contact_map_type>(contact_map), handler, boost::posix_time::time_duration()));
+			}
+
+			/**
+			 * \brief Send contact information to all hosts, paced over a window.
+			 * \param contact_map The contact information.
+			 * \param handler The handler to call when the data was sent to all hosts or an error occured.
+			 * \param pacing_window The window over which the sends are spread, with per-target jitter.
+			 */
+			void async_send_contact_to_all(const contact_map_type& contact_map, multiple_endpoints_handler_type handler, const boost::posix_time::time_duration& pacing_window)
+			{
+				// The map is copied once into an immutable snapshot: every per-peer send shares it instead of duplicating it.
+				m_session_strand.post(boost::bind(&server::do_send_contact_to_all, this, boost::make_shared<const contact_map_type>(contact_map), handler, pacing_window));
 			}
 
 			/**
@@ -1251,15 +1455,379 @@ namespace fscp
 			void do_get_identity(identity_handler_type);
 			void do_set_identity(const identity_store&, void_handler_type);
 
+		public:
+
+			/**
+			 * \brief The default maximum count of datagrams read per receive batch.
+			 */
+			static const size_t DEFAULT_RECEIVE_BATCH_SIZE = 32;
+
+			/**
+			 * \brief Set the maximum count of datagrams that a single receive handler invocation may drain from the socket.
+			 * \param batch_size The batch size. A value of 1 disables batching.
+			 * \warning This method must be called before open().
+			 */
+			void set_receive_batch_size(size_t batch_size)
+			{
+				m_receive_batch_size = (batch_size > 0) ? batch_size : 1;
+			}
+
+			/**
+			 * \brief Set the count of SO_REUSEPORT sockets to open.
+			 * \param count The socket count. A value of 1 (the default) keeps the single-socket mode.
+			 *
+			 * When more than one socket is requested, open() binds them all to the listen endpoint with SO_REUSEPORT so the kernel spreads inbound datagrams across them, one receive loop each. Emission always uses the first socket.
+			 * \warning This method must be called before open(). On platforms without SO_REUSEPORT the extra sockets are not created.
+			 */
+			void set_reuse_port_socket_count(size_t count)
+			{
+				m_reuse_port_socket_count = (count > 0) ? count : 1;
+			}
+
+			/**
+			 * \brief Set the count of crypto worker threads.
+			 * \param count The count of threads dedicated to sealing and opening data messages. A value of 0 (the default) keeps all the cryptography inline.
+			 *
+			 * The workers seal and open data messages in parallel across hosts. Messages exchanged with a given host are still processed in order, through a per-host strand, so the shared cipher contexts are never used concurrently and no reordering is introduced.
+			 * \warning This method must be called before open().
+			 */
+			void set_crypto_worker_count(size_t count)
+			{
+				m_crypto_worker_count = count;
+			}
+
+			/**
+			 * \brief Set the anti-replay window size.
+			 * \param window_size The window size, in sequence numbers. It is rounded up to a multiple of 64 and clamped to [64, 1024].
+			 *
+			 * Datagrams reordered within the window are accepted exactly once, instead of being dropped when they arrive behind the highest sequence number seen.
+			 * \warning This method must be called before open().
+			 */
+			void set_replay_window_size(size_t window_size)
+			{
+				m_peer_sessions.set_replay_window_size(window_size);
+			}
+
+			/**
+			 * \brief Set the count of precomputed ephemeral ECDHE keys kept per elliptic curve.
+			 * \param count The count of keys. A value of 0 disables the precomputation and ephemeral keys are generated on the handshake path, as before.
+			 *
+			 * The pool refills itself in the background, so session establishment only consumes a ready-made key and derives the shared secret.
+			 * \warning This method must be called before open().
+			 */
+			void set_ecdhe_keys_per_curve(size_t count)
+			{
+				m_ecdhe_key_pool.set_keys_per_curve(count);
+			}
+
+			/**
+			 * \brief Set the contact flush interval.
+			 * \param interval The time during which contact requests and CONTACT answers are accumulated before being sent. A zero duration (the default) disables the batching and everything is sent immediately.
+			 *
+			 * With batching enabled, hashes requested from the same host within the interval are coalesced into a single CONTACT-REQUEST datagram, and the answers destined to a given host are aggregated into a single CONTACT message.
+			 * \warning This method must be called before open().
+			 */
+			void set_contact_flush_interval(const boost::posix_time::time_duration& interval)
+			{
+				m_contact_flush_interval = interval;
+			}
+
+			/**
+			 * \brief Set the egress priority of a channel.
+			 * \param channel_number The channel number.
+			 * \param priority The priority. Lower values are sent first. The default for every channel is 1.
+			 *
+			 * When several channels have datagrams queued, the channel with the lowest priority value is serviced first. Non-data messages (handshake, keep-alive and contact traffic) always go before any channel.
+			 * \warning This method must be called before open().
+			 */
+			void set_channel_priority(channel_number_type channel_number, unsigned int priority)
+			{
+				m_channel_write_queues[channel_number].priority = priority;
+			}
+
+			/**
+			 * \brief Set the maximum egress queue depth of a channel.
+			 * \param channel_number The channel number.
+			 * \param max_depth The maximum count of queued datagrams. A value of 0 (the default) means no limit.
+			 *
+			 * When the limit is reached, further sends on the channel fail with server_error::egress_queue_full instead of delaying the other channels.
+			 * \warning This method must be called before open().
+			 */
+			void set_channel_queue_depth(channel_number_type channel_number, size_t max_depth)
+			{
+				m_channel_write_queues[channel_number].max_depth = max_depth;
+			}
+
+			/**
+			 * \brief Set the IP TOS byte of a channel's egress traffic.
+			 * \param channel_number The channel number.
+			 * \param tos The TOS byte, or a negative value (the default) to mark the channel like data traffic.
+			 *
+			 * Datagrams queued on the channel are written with this marking, so classes of encapsulated traffic can keep distinct DSCP values on the underlay. The marking is switched around the channel's writes, like the control marking.
+			 * \warning This method must be called before open(). It has no effect on platforms without IP_TOS/IPV6_TCLASS support.
+			 */
+			void set_channel_tos(channel_number_type channel_number, int tos)
+			{
+				m_channel_write_queues[channel_number].tos = tos;
+			}
+
+			/**
+			 * \brief Set the per-source handshake rate limit.
+			 * \param limit The maximum count of handshake datagrams (HELLO requests, presentations and session requests) accepted per source address and per 10 seconds window. A value of 0 (the default) means no limit.
+			 *
+			 * Sources are tracked in a fixed-size hashed table whose hash secret rotates with the window, so a spoofed-source flood can neither grow the tracking state nor keep a victim address pinned to a saturated slot. Peers with an established session are never limited, so renegotiations proceed under flood.
+			 * \warning This method must be called before open().
+			 */
+			void set_handshake_rate_limit(size_t limit)
+			{
+				m_handshake_rate_limit = limit;
+			}
+
+			/**
+			 * \brief Enable the lazy keep-alive mode.
+			 * \param enabled Whether idle sessions are probed on a decaying schedule. Disabled by default.
+			 *
+			 * In a large mesh most sessions are idle most of the time, yet each one is probed at the full keep-alive rate, so the background load grows with the square of the node count. With this mode enabled, sessions that carried real data recently keep the full rate, while idle sessions have their probing interval doubled after each unanswered-by-data interval, up to SESSION_LAZY_KEEP_ALIVE_MAX_PERIOD. The first data message in either direction restores the full rate. The session timeout scales with the decayed interval, so a slowly probed peer is not declared lost by our own quietness.
+			 * \warning This method must be called before open(). An idle session behind a NAT whose mapping timeout is shorter than the decayed interval may be lost and will be re-established on the next contact.
+			 */
+			void set_lazy_keep_alive(bool enabled)
+			{
+				m_lazy_keep_alive = enabled;
+			}
+
+			/**
+			 * \brief Get the egress statistics.
+			 * \param handler The handler to call with the current statistics.
+			 */
+			void async_get_egress_statistics(egress_statistics_handler_type handler)
+			{
+				m_write_queue_strand.post(boost::bind(&server::do_get_egress_statistics, this, handler));
+			}
+
+			/**
+			 * \brief Enable UDP segmentation offload.
+			 * \param enabled Whether to use UDP GSO/GRO on the sockets. Disabled by default.
+			 *
+			 * When enabled, back-to-back data messages queued for the same peer are handed to the kernel as a single super-buffer carrying the segment size (UDP_SEGMENT), and coalesced ingress super-datagrams (UDP_GRO) are split back into individual messages before dispatch. This cuts the per-datagram system call and network stack traversal cost on bulk flows.
+			 * \warning This method must be called before open(). It has no effect on platforms without UDP_SEGMENT/UDP_GRO support.
+			 */
+			void set_udp_offload(bool enabled)
+			{
+				m_udp_offload = enabled;
+			}
+
+			/**
+			 * \brief Enable kernel receive timestamping.
+			 * \param enabled Whether to request SO_TIMESTAMPING receive timestamps on the sockets. Disabled by default.
+			 *
+			 * When enabled, every received datagram carries the time the kernel accepted it, so latency figures can separate the network round-trip from the time the datagram spent queued inside the daemon: hello round-trip durations are measured up to the kernel receive time instead of the processing time, and the queueing delay itself is sampled on keep-alive receipt into the "fscp.receive.queueing_delay_us" histogram.
+			 * \warning This method must be called before open(). It has no effect on platforms without SO_TIMESTAMPING support.
+			 */
+			void set_kernel_timestamping(bool enabled)
+			{
+				m_kernel_timestamping = enabled;
+			}
+
+			/**
+			 * \brief Set the kernel receive buffer size of the sockets.
+			 * \param size The requested SO_RCVBUF size, in bytes. A value of 0 (the default) keeps the kernel default.
+			 *
+			 * The effective size granted by the kernel is visible in the queue statistics as socket_receive_buffer_size.
+			 * \warning This method must be called before open().
+			 */
+			void set_receive_buffer_size(size_t size)
+			{
+				m_requested_receive_buffer_size = size;
+			}
+
+			/**
+			 * \brief Set the kernel send buffer size of the sockets.
+			 * \param size The requested SO_SNDBUF size, in bytes. A value of 0 (the default) keeps the kernel default.
+			 *
+			 * The effective size granted by the kernel is visible in the queue statistics as socket_send_buffer_size.
+			 * \warning This method must be called before open().
+			 */
+			void set_send_buffer_size(size_t size)
+			{
+				m_requested_send_buffer_size = size;
+			}
+
+			/**
+			 * \brief Set the socket busy-poll budget.
+			 * \param microseconds The SO_BUSY_POLL value, in microseconds. A value of 0 (the default) disables busy polling.
+			 *
+			 * Busy polling lets the kernel spin on the device queue for up to the given budget before sleeping, trading CPU for receive latency on fast links.
+			 * \warning This method must be called before open(). It has no effect on platforms without SO_BUSY_POLL support.
+			 */
+			void set_busy_poll(unsigned int microseconds)
+			{
+				m_busy_poll_microseconds = microseconds;
+			}
+
+			/**
+			 * \brief Set the IP TOS byte of data traffic.
+			 * \param tos The TOS byte (the DSCP is its upper six bits). A negative value (the default) keeps the kernel default.
+			 *
+			 * The value becomes the socket default, so every datagram not re-marked as control traffic carries it.
+			 * \warning This method must be called before open(). It has no effect on platforms without IP_TOS/IPV6_TCLASS support.
+			 */
+			void set_data_tos(int tos)
+			{
+				m_data_tos = tos;
+			}
+
+			/**
+			 * \brief Set the IP TOS byte of control traffic.
+			 * \param tos The TOS byte. A negative value (the default) marks control traffic like data traffic.
+			 *
+			 * Handshake, keep-alive and contact datagrams are re-marked with this value just before their (low-rate) writes, so underlay QoS can prioritize tunnel control traffic over the bulk frames.
+			 * \warning This method must be called before open(). It has no effect on platforms without IP_TOS/IPV6_TCLASS support.
+			 */
+			void set_control_tos(int tos)
+			{
+				m_control_tos = tos;
+			}
+
+			/**
+			 * \brief Enable negotiated payload compression.
+			 * \param enabled Whether to advertise LZ4 compression during session handshakes. Disabled by default.
+			 *
+			 * Compression applies to sessions negotiated after the call where both hosts advertise it. Data payloads above COMPRESSION_THRESHOLD are LZ4-compressed before encryption; incompressible payloads escape with a one-byte marker. The achieved ratio is visible through the "fscp.compression.*" counters.
+			 * \warning This method must be called before open().
+			 */
+			void set_compression(bool enabled)
+			{
+				m_compression_algorithms = enabled ? compression_algorithm_list_type{ compression_algorithm_type::lz4, compression_algorithm_type::none } : get_default_compression_algorithms();
+			}
+
+			/**
+			 * \brief Enable per-peer path MTU discovery.
+			 * \param enabled Whether to probe the path to every established session. Disabled by default.
+			 *
+			 * When enabled, every session is probed with padded frames on CHANNEL_NUMBER_PMTU: a binary search converges on the largest data payload the path delivers, then re-probes periodically to catch path changes. The discovered value shows up in the peer statistics and through the path MTU changed callback. On Linux the sockets send with the DF bit set so an undersized tunnel hop drops the probe instead of fragmenting it.
+			 * \warning This method must be called before open().
+			 */
+			void set_path_mtu_discovery(bool enabled)
+			{
+				m_path_mtu_discovery = enabled;
+			}
+
+			/**
+			 * \brief Enable multipath peer sessions.
+			 * \param enabled Whether to spread traffic across the known paths of a peer. Disabled by default.
+			 *
+			 * A dual-homed peer reached over several endpoints holds one established session per endpoint; the server groups them by remote host identifier, measures every path's round-trip time and loss with probes on CHANNEL_NUMBER_PMTU, and steers data sends onto the fastest healthy path. Because every path carries its own established session, failing over is a routing decision: no session keys are renegotiated.
+			 * \warning This method must be called before open().
+			 */
+			void set_multipath(bool enabled)
+			{
+				m_multipath = enabled;
+			}
+
+			/**
+			 * \brief Enable spraying bulk sends across paths.
+			 * \param enabled Whether to round-robin data sends across all the healthy paths of a peer instead of pinning them to the best one. Disabled by default.
+			 *
+			 * Only meaningful when multipath is enabled. Spraying trades per-flow ordering stability for aggregate throughput.
+			 * \warning This method must be called before open().
+			 */
+			void set_multipath_spray(bool enabled)
+			{
+				m_multipath_spray = enabled;
+			}
+
+			/**
+			 * \brief Enable session resumption.
+			 * \param enabled Whether to cache a resumption secret when a session is established. Disabled by default.
+			 *
+			 * When a session is established the hosts derive a shared resumption secret. On reconnect within SESSION_RESUMPTION_VALIDITY, a single HMAC-authenticated round-trip re-keys from the cached secret: no certificate exchange, signature or ECDHE takes place. If the peer lost its secret (or does not resume), the next attempt falls back to the full handshake.
+			 * \warning This method must be called before open().
+			 */
+			void set_session_resumption(bool enabled)
+			{
+				m_session_resumption = enabled;
+			}
+
+			/**
+			 * \brief Set the per-peer send queue depth.
+			 * \param depth The maximum count of in-flight data messages per peer. A value of 0 (the default) leaves sends unbounded.
+			 *
+			 * When a peer has depth messages in flight, further data sends to it are parked in a queue of up to depth entries; beyond that the configured policy decides what is dropped. This keeps one degraded path from ballooning the whole process memory.
+			 * \warning This method must be called before open().
+			 */
+			void set_peer_send_queue_depth(size_t depth)
+			{
+				m_peer_send_queue_depth = depth;
+			}
+
+			/**
+			 * \brief Set the per-peer send queue overflow policy.
+			 * \param policy The policy. The default is PSQ_DROP_NEWEST.
+			 *
+			 * Dropped datagrams complete with server_error::egress_queue_full.
+			 * \warning This method must be called before open().
+			 */
+			void set_peer_send_queue_policy(peer_send_queue_policy_type policy)
+			{
+				m_peer_send_queue_policy = policy;
+			}
+
+			/**
+			 * \brief Set the peer congestion callback.
+			 * \param callback The callback, called whenever sends to a peer start or stop being parked. It is invoked from an internal strand and must not block.
+			 * \warning This method must be called before open().
+			 */
+			void set_peer_congestion_callback(peer_congestion_handler_type callback)
+			{
+				m_peer_congestion_handler = callback;
+			}
+
+			/**
+			 * \brief Set the path MTU changed callback.
+			 * \param callback The callback. It is called from an internal strand and must not block.
+			 *
+			 * The callback fires whenever the discovery converges on a value different from the last reported one.
+			 * \warning This method must be called before open().
+			 */
+			void set_path_mtu_changed_callback(path_mtu_changed_handler_type callback)
+			{
+				m_path_mtu_changed_handler = callback;
+			}
+
 		private:
 
-			void async_receive_from()
+			void async_receive_from(socket_type* socket)
 			{
-				m_socket_strand.post(boost::bind(&server::do_async_receive_from, this));
+				m_socket_strand.post(boost::bind(&server::do_async_receive_from, this, socket));
 			}
 
-			void do_async_receive_from();
-			void handle_receive_from(const identity_store&, boost::shared_ptr<ep_type>, SharedBuffer, const boost::system::error_code&, size_t);
+			void apply_socket_tuning(socket_type& socket);
+			void apply_tos(socket_type& socket, int tos);
+			void do_marked_write(int tos, void_handler_type write_handler);
+			void do_async_receive_from(socket_type* socket);
+			void handle_receive_from(const identity_store&, socket_type*, boost::shared_ptr<ep_type>, SharedBuffer, const boost::system::error_code&, size_t);
+
+			/**
+			 * \brief A datagram drained from the socket, awaiting dispatch.
+			 */
+			struct pending_datagram_type
+			{
+				ep_type sender;
+				SharedBuffer buffer;
+				size_t size;
+				boost::posix_time::ptime receive_time;
+			};
+
+			/**
+			 * \brief Dispatch a drained batch with per-peer deficit round-robin.
+			 *
+			 * Datagrams are binned per source endpoint and each peer spends a byte budget per scheduling pass, so a peer that floods the socket has its backlog processed after - not ahead of - the datagrams of every other peer in the batch. Per-peer arrival order is preserved and nothing is dropped.
+			 */
+			void dispatch_datagrams_fair(const identity_store& identity, std::vector<pending_datagram_type>& datagrams);
+			void process_datagram(const ep_type&, const identity_store&, SharedBuffer, size_t, const boost::posix_time::ptime&);
+			bool admit_control_message(const ep_type&);
+			bool admit_handshake_message(const ep_type&);
+			size_t drain_pending_datagrams(socket_type& socket, const identity_store&, size_t already_received);
 
 			ep_type to_socket_format(const ep_type& ep);
 
@@ -1267,134 +1835,274 @@ namespace fscp
 			{
 				public:
 					template <typename ConstBufferSequence, typename WriteHandler>
-					void operator()(boost::asio::ip::udp::socket* socket, const ConstBufferSequence& data, const ep_type& target, int flags, WriteHandler handler)
+					void operator()(handler_memory* memory, boost::asio::ip::udp::socket* socket, const ConstBufferSequence& data, const ep_type& target, int flags, WriteHandler handler)
 					{
+						assert(memory);
 						assert(socket);
 
-						socket->async_send_to(data, target, flags, handler);
+						// The write queue admits one socket write at a time, so the per-operation state of every send recycles the same arena slot instead of hitting the heap.
+						socket->async_send_to(data, target, flags, make_pooled_handler(*memory, handler));
 					}
 			};
 
 			template <typename ConstBufferSequence, typename WriteHandler>
 			void async_send_to(const ConstBufferSequence& data, const ep_type& target, WriteHandler handler)
 			{
-				const void_handler_type write_handler = boost::bind<void>(async_sender(), &m_socket, data, to_socket_format(target), 0, handler);
+				void_handler_type write_handler = boost::bind<void>(async_sender(), &m_send_handler_memory, &m_socket, data, to_socket_format(target), 0, handler);
+
+				if ((m_control_tos >= 0) && (m_control_tos != m_data_tos))
+				{
+					// Control datagrams carry their own marking: the TOS byte is switched around the write and restored for the bulk frames. Control traffic is low-rate, so the extra socket option calls are negligible.
+					write_handler = boost::bind(&server::do_marked_write, this, m_control_tos, write_handler);
+				}
 
 				m_write_queue_strand.post(boost::bind(&server::push_write, this, write_handler));
 			}
 
+			template <typename ConstBufferSequence, typename WriteHandler>
+			void async_send_to(const ConstBufferSequence& data, const ep_type& target, channel_number_type channel_number, WriteHandler handler)
+			{
+				const void_handler_type write_handler = boost::bind<void>(async_sender(), &m_send_handler_memory, &m_socket, data, to_socket_format(target), 0, handler);
+				const void_handler_type drop_handler = boost::bind<void>(handler, server_error::make_error_code(server_error::egress_queue_full), 0);
+
+				m_write_queue_strand.post(boost::bind(&server::push_channel_write, this, channel_number, write_handler, drop_handler));
+			}
+
+			/**
+			 * \brief A super-buffer of back-to-back datagrams bound to the same peer, sent as one UDP_SEGMENT write.
+			 */
+			struct gso_aggregate_type
+			{
+				gso_aggregate_type() :
+					size(0),
+					segment_size(0),
+					segment_count(0)
+				{}
+
+				ep_type target;
+				SharedBuffer data;
+				size_t size;
+				size_t segment_size;
+				size_t segment_count;
+				std::vector<simple_handler_type> handlers;
+			};
+
+			struct egress_entry_type
+			{
+				egress_entry_type()
+				{}
+
+				egress_entry_type(void_handler_type _write_handler, void_handler_type _drop_handler) :
+					write_handler(_write_handler),
+					drop_handler(_drop_handler)
+				{}
+
+				egress_entry_type(void_handler_type _write_handler, void_handler_type _drop_handler, boost::shared_ptr<gso_aggregate_type> _aggregate) :
+					write_handler(_write_handler),
+					drop_handler(_drop_handler),
+					aggregate(_aggregate)
+				{}
+
+				void_handler_type write_handler;
+				void_handler_type drop_handler;
+				boost::shared_ptr<gso_aggregate_type> aggregate;
+			};
+
+			struct egress_queue_type
+			{
+				egress_queue_type() :
+					priority(1),
+					max_depth(0),
+					dropped(0),
+					tos(-1)
+				{}
+
+				std::queue<egress_entry_type> entries;
+				unsigned int priority;
+				size_t max_depth;
+				size_t dropped;
+				int tos;
+				boost::shared_ptr<gso_aggregate_type> open_aggregate;
+			};
+
+			void async_send_datagram(SharedBuffer datagram, size_t size, const ep_type& target, channel_number_type channel_number, simple_handler_type handler);
+
 			void push_write(void_handler_type);
+			void push_channel_write(channel_number_type, void_handler_type, void_handler_type);
+#ifdef __linux__
+			void push_datagram_write(SharedBuffer, size_t, const ep_type&, channel_number_type, simple_handler_type);
+			void do_send_gso_aggregate(boost::shared_ptr<gso_aggregate_type>);
+#endif
 			void pop_write();
+			void do_get_egress_statistics(egress_statistics_handler_type);
+
+			void handle_send_to(const boost::system::error_code& ec, size_t)
+			{
+				if (ec && (ec != boost::asio::error::operation_aborted))
+				{
+					m_socket_errors_counter.increment();
+				}
+			}
 
-			void handle_send_to(const boost::system::error_code&, size_t) {};
+			void do_sample_socket_telemetry(const boost::system::error_code&);
 
 			socket_type m_socket;
-			boost::asio::strand m_socket_strand;
-			std::queue<void_handler_type> m_write_queue;
-			boost::asio::strand m_write_queue_strand;
+			handler_memory m_receive_handler_memory;
+			handler_memory m_send_handler_memory;
+			size_t m_requested_receive_buffer_size;
+			size_t m_requested_send_buffer_size;
+			unsigned int m_busy_poll_microseconds;
+			int m_data_tos;
+			int m_control_tos;
+			std::vector<boost::shared_ptr<socket_type> > m_extra_sockets;
+			size_t m_receive_batch_size;
+
+			// The admission state for control messages. Only ever touched from the socket strand.
+			boost::posix_time::ptime m_admission_tick_start;
+			size_t m_admission_session_admitted;
+			size_t m_admission_unknown_admitted;
+
+			// The per-source handshake rate limiting state. Only ever touched from the socket strand.
+			struct handshake_slot_type
+			{
+				handshake_slot_type() :
+					window(0),
+					count(0)
+				{}
+
+				uint64_t window;
+				size_t count;
+			};
+
+			size_t m_handshake_rate_limit;
+			uint64_t m_handshake_window;
+			uint32_t m_handshake_hash_secret;
+			std::vector<handshake_slot_type> m_handshake_slots;
+
+			// The protocol version each endpoint was seen speaking, recorded from the handshake messages on the socket strand and read from the session strand when choosing the SESSION_REQUEST layout - hence the lock. Unknown endpoints are assumed to speak version 3, so nothing a legacy host cannot parse is ever sent first.
+			void record_peer_version(const ep_type&, unsigned char);
+			unsigned char get_peer_version(const ep_type&) const;
+
+			mutable boost::mutex m_peer_versions_mutex;
+			std::map<ep_type, unsigned char> m_peer_versions;
+			size_t m_reuse_port_socket_count;
+			bool m_udp_offload;
+			bool m_kernel_timestamping;
+			bool m_path_mtu_discovery;
+			bool m_multipath;
+			bool m_multipath_spray;
+			bool m_session_resumption;
+			boost::atomic<uint32_t> m_socket_strand_pending;
+			counted_strand m_socket_strand;
+			std::queue<void_handler_type> m_control_write_queue;
+			boost::array<egress_queue_type, CHANNEL_NUMBER_COUNT> m_channel_write_queues;
+			bool m_write_in_flight;
+			boost::atomic<uint32_t> m_write_queue_strand_pending;
+			counted_strand m_write_queue_strand;
+			boost::atomic<uint64_t> m_socket_receive_queue_bytes;
+			boost::atomic<uint64_t> m_socket_receive_buffer_size;
+			boost::atomic<uint64_t> m_socket_send_buffer_size;
+			uint64_t m_last_socket_kernel_drops;
+			timer_wheel::timer_id_type m_socket_telemetry_timer_id;
+
+			boost::shared_ptr<counted_strand> crypto_strand_for(const ep_type& host);
+
+			boost::asio::io_service m_crypto_io_service;
+			boost::scoped_ptr<boost::asio::io_service::work> m_crypto_work;
+			boost::thread_group m_crypto_threads;
+			size_t m_crypto_worker_count;
+			boost::atomic<uint32_t> m_crypto_strands_pending;
+			boost::unordered_map<ep_type, boost::shared_ptr<counted_strand>, endpoint_hash> m_crypto_strands;
+
+			ecdhe_key_pool m_ecdhe_key_pool;
 
 		private: // HELLO messages
 
 			/**
-			 * @brief Represents a context for an endpoint.
+			 * @brief One outstanding greet.
+			 *
+			 * Slots are preallocated and recycled through a free list: a burst of greets costs no allocations, and both replies and timeouts resolve their slot by index. The hello unique number carries the slot index and the slot generation, so a stale reply for a recycled slot is recognized and dropped.
 			 */
-			class ep_hello_context_type
+			struct hello_slot_type
 			{
-				public:
+				hello_slot_type() :
+					generation(0),
+					in_use(false),
+					timer_id(0),
+					success(false)
+				{}
+
+				ep_type target;
+				uint16_t generation;
+				bool in_use;
+				timer_wheel::timer_id_type timer_id;
+				boost::posix_time::ptime start_date;
+				boost::posix_time::ptime response_date;
+				bool success;
+
+				// The slot doubles as the coroutine frame of the greet flow: everything a step needs lives here instead of traveling through bind-captured copies.
+				boost::asio::coroutine coroutine;
+				duration_handler_type handler;
+				boost::posix_time::time_duration timeout;
+			};
 
-					/**
-					 * @brief Generate an unique number.
-					 * @warning The first invocation of this function is *NOT* thread-safe in C++03.
-					 */
-					static uint32_t generate_unique_number();
-
-					/**
-					 * @brief Create a new context.
-					 */
-					ep_hello_context_type();
-
-					/**
-					 * @brief Returns the current hello unique number and generates a new one.
-					 * @return The current hello unique number.
-					 */
-					uint32_t next_hello_unique_number();
-
-					/**
-					 * @brief Asynchronously waits for a hello reply.
-					 * @param io_service The io_service instance to use for the wait.
-					 * @param hello_unique_number The unique hello number.
-					 * @param timeout The time to wait for the reply.
-					 * @param handler The handler to call upon timeout or cancellation.
-					 */
-					template <typename WaitHandler>
-					void async_wait_reply(boost::asio::io_service& io_service, uint32_t hello_unique_number, const boost::posix_time::time_duration& timeout, WaitHandler handler);
-
-					/**
-					 * @brief Cancel a hello reply wait timer.
-					 * @param hello_unique_number The hello reply number.
-					 * @param success Whether the cancel is the result of a received reply.
-					 * @return true if the timer was cancelled or false if it was too late to do so.
-					 */
-					bool cancel_reply_wait(uint32_t hello_unique_number, bool success);
-
-					/**
-					 * @brief Cancel all pending hello request wait timers.
-					 *
-					 * This call is similar to calling cancel_reply_wait(<num>, false) for all hello unique numbers.
-					 */
-					void cancel_all_reply_wait();
-
-					/**
-					 * @brief Remove a hello reply wait from the pending list.
-					 * @param hello_unique_number The hello reply number.
-					 * @param duration A variable whose value after the call will be the time elapsed since the creation of the request.
-					 * @return The success status of the request.
-					 */
-					bool remove_reply_wait(uint32_t hello_unique_number, boost::posix_time::time_duration& duration);
+			/**
+			 * @brief Acquire a greet slot.
+			 * @param target The greeted host.
+			 * @return The slot index, or boost::none if the pool hit its hard limit.
+			 */
+			boost::optional<size_t> acquire_hello_slot(const ep_type& target);
 
-				private:
+			/**
+			 * @brief Release a greet slot back to the free list, bumping its generation.
+			 * @param slot_index The slot index.
+			 */
+			void release_hello_slot(size_t slot_index);
 
-					struct pending_request_status
-					{
-						pending_request_status() :
-							timer(),
-							start_date(boost::posix_time::microsec_clock::universal_time()),
-							success(false)
-						{}
-
-						pending_request_status(boost::shared_ptr<boost::asio::deadline_timer> _timer) :
-							timer(_timer),
-							start_date(boost::posix_time::microsec_clock::universal_time()),
-							success(false)
-						{}
-
-						boost::shared_ptr<boost::asio::deadline_timer> timer;
-						boost::posix_time::ptime start_date;
-						bool success;
-					};
-
-					typedef std::map<uint32_t, pending_request_status> pending_requests_map;
-
-					uint32_t m_current_hello_unique_number;
-					pending_requests_map m_pending_requests;
-			};
+			/**
+			 * @brief Encode a slot index and its current generation into a hello unique number.
+			 * @param slot_index The slot index.
+			 * @return The hello unique number.
+			 */
+			uint32_t encode_hello_unique_number(size_t slot_index) const;
+
+			/**
+			 * @brief Decode a hello unique number back into a slot index.
+			 * @param hello_unique_number The hello unique number.
+			 * @param slot_index A variable whose value after a successful call is the slot index.
+			 * @return true if the number designates a slot that is in use with a matching generation.
+			 */
+			bool decode_hello_unique_number(uint32_t hello_unique_number, size_t& slot_index) const;
 
-			typedef std::map<ep_type, ep_hello_context_type> ep_hello_context_map;
 
 			void do_greet(const ep_type&, duration_handler_type, const boost::posix_time::time_duration&);
-			void do_greet_handler(const ep_type&, uint32_t, duration_handler_type, const boost::posix_time::time_duration&, const boost::system::error_code&, size_t);
-			void do_greet_timeout(const ep_type&, uint32_t, duration_handler_type, const boost::system::error_code&);
+
+			/**
+			 * @brief Run one step of the greet flow.
+			 * @param slot_index The slot holding the flow state.
+			 * @param ec The result of the asynchronous operation that resumed the flow.
+			 *
+			 * The flow is a stackless coroutine whose frame is the pooled hello
+			 * slot: every asynchronous step reenters this method in the greet
+			 * strand, so the whole conversation reads top to bottom and resuming
+			 * a step costs no allocation. New multi-step flows should follow the
+			 * same pattern.
+			 */
+			void do_greet_flow(size_t slot_index, const boost::system::error_code& ec);
 			void do_cancel_all_greetings();
 
-			void handle_hello_message_from(const hello_message&, const ep_type&);
+			void handle_hello_message_from(const hello_message&, const ep_type&, const boost::posix_time::ptime&);
 			void do_handle_hello_request(const ep_type&, uint32_t);
-			void do_handle_hello_response(const ep_type&, uint32_t);
+			void do_handle_hello_response(const ep_type&, uint32_t, const boost::posix_time::ptime&);
 
 			void do_set_accept_hello_messages_default(bool, void_handler_type);
 			void do_set_hello_message_received_callback(hello_message_received_handler_type, void_handler_type);
 
-			ep_hello_context_map m_ep_hello_contexts;
-			boost::asio::strand m_greet_strand;
+			std::vector<hello_slot_type> m_hello_slots;
+			std::vector<size_t> m_hello_free_slots;
+			uint32_t m_hello_number_mask; /**< @brief XORed into every hello unique number so they are not guessable off-path. */
+			boost::atomic<uint32_t> m_greet_strand_pending;
+			counted_strand m_greet_strand;
 			bool m_accept_hello_messages_default;
 			hello_message_received_handler_type m_hello_message_received_handler;
 
@@ -1402,28 +2110,108 @@ namespace fscp
 
 			typedef std::map<ep_type, presentation_store> presentation_store_map;
 
+			/**
+			 * \brief An index from certificate hash to the endpoint that presented it.
+			 *
+			 * Kept in sync with m_presentation_store_map so answering a CONTACT_REQUEST resolves a hash without scanning the presentations.
+			 */
+			typedef boost::unordered_map<hash_type, ep_type, hash_type_hash> presentation_hash_index_type;
+
+			/**
+			 * @brief A counting bloom filter over the indexed presentation hashes.
+			 *
+			 * Contact request lookups are dominated by misses during mesh churn: the filter answers "definitely unknown" with a few cache-friendly probes before any map access. Counters, rather than bits, make removals exact as presentations are cleared; a saturated counter is simply never decremented again. The probe positions are carved directly out of the requested hash, which already is a uniform cryptographic hash.
+			 */
+			class presentation_hash_filter
+			{
+				public:
+
+					presentation_hash_filter() :
+						m_counters(FILTER_SIZE, 0)
+					{
+					}
+
+					void insert(const hash_type& hash)
+					{
+						for (size_t probe_index = 0; probe_index < PROBE_COUNT; ++probe_index)
+						{
+							uint8_t& counter = m_counters[probe(hash, probe_index)];
+
+							if (counter < 0xFF)
+							{
+								++counter;
+							}
+						}
+					}
+
+					void erase(const hash_type& hash)
+					{
+						for (size_t probe_index = 0; probe_index < PROBE_COUNT; ++probe_index)
+						{
+							uint8_t& counter = m_counters[probe(hash, probe_index)];
+
+							if ((counter > 0) && (counter < 0xFF))
+							{
+								--counter;
+							}
+						}
+					}
+
+					bool contains(const hash_type& hash) const
+					{
+						for (size_t probe_index = 0; probe_index < PROBE_COUNT; ++probe_index)
+						{
+							if (m_counters[probe(hash, probe_index)] == 0)
+							{
+								return false;
+							}
+						}
+
+						return true;
+					}
+
+				private:
+
+					static const size_t FILTER_SIZE = 8192;
+					static const size_t PROBE_COUNT = 4;
+
+					static size_t probe(const hash_type& hash, size_t probe_index)
+					{
+						return (static_cast<size_t>(hash.data[probe_index * 2]) | (static_cast<size_t>(hash.data[probe_index * 2 + 1]) << 8)) % FILTER_SIZE;
+					}
+
+					std::vector<uint8_t> m_counters;
+			};
+
+			void unindex_presentation(const ep_type&);
+
 			bool has_presentation_store_for(const ep_type&) const;
 			void do_introduce_to(const ep_type&, simple_handler_type);
-			void do_reintroduce_to_all(multiple_endpoints_handler_type);
+			void do_reintroduce_to_all(multiple_endpoints_handler_type, const boost::posix_time::time_duration&);
 			void do_get_presentation(const ep_type&, optional_presentation_store_handler_type);
 			void do_set_presentation(const ep_type&, cert_type, void_handler_type);
 			void do_clear_presentation(const ep_type&, void_handler_type);
 			void handle_presentation_message_from(const presentation_message&, const ep_type&);
 			void do_handle_presentation(const ep_type&, bool, cert_type);
+			void do_accept_presentation(const ep_type&, cert_type);
 
 			void do_set_presentation_message_received_callback(presentation_message_received_handler_type, void_handler_type);
 
 			// This strand is also used by session requests and session messages during the cipherment/decipherment phase.
-			boost::asio::strand m_presentation_strand;
+			boost::atomic<uint32_t> m_presentation_strand_pending;
+			counted_strand m_presentation_strand;
 			presentation_store_map m_presentation_store_map;
+			presentation_hash_index_type m_presentation_hash_index;
+			presentation_hash_filter m_presentation_hash_filter;
 			presentation_message_received_handler_type m_presentation_message_received_handler;
 
 		private: // SESSION_REQUEST messages
 
-			typedef std::map<ep_type, peer_session> peer_session_map_type;
+			typedef peer_session_map peer_session_map_type;
 
 			static cipher_suite_type get_first_common_supported_cipher_suite(const cipher_suite_list_type&, const cipher_suite_list_type&, cipher_suite_type);
 			static elliptic_curve_type get_first_common_supported_elliptic_curve(const elliptic_curve_list_type&, const elliptic_curve_list_type&, elliptic_curve_type);
+			static compression_algorithm_type get_first_common_supported_compression_algorithm(const compression_algorithm_list_type&, const compression_algorithm_list_type&, compression_algorithm_type);
 
 			void do_request_session(const identity_store&, const ep_type&, simple_handler_type);
 			void do_close_session(const ep_type&, simple_handler_type);
@@ -1440,13 +2228,15 @@ namespace fscp
 			void do_set_session_request_message_received_callback(session_request_received_handler_type, void_handler_type);
 
 			// This strand is common to session requests, session messages and data messages.
-			boost::asio::strand m_session_strand;
+			boost::atomic<uint32_t> m_session_strand_pending;
+			counted_strand m_session_strand;
 
 			peer_session_map_type m_peer_sessions;
 
 			bool m_accept_session_request_messages_default;
 			cipher_suite_list_type m_cipher_suites;
 			elliptic_curve_list_type m_elliptic_curves;
+			compression_algorithm_list_type m_compression_algorithms;
 			session_request_received_handler_type m_session_request_message_received_handler;
 
 		private: // SESSION messages
@@ -1469,43 +2259,264 @@ namespace fscp
 			session_established_handler_type m_session_established_handler;
 			session_lost_handler_type m_session_lost_handler;
 
+			metrics_registry::histogram& m_handshake_duration_histogram;
+			std::map<ep_type, boost::posix_time::ptime> m_handshake_start_map;
+
 		private: // DATA messages
 
+			/**
+			 * \brief A datagram pending emission.
+			 */
+			struct datagram_type
+			{
+				ep_type target;
+				SharedBuffer data;
+				size_t size;
+				simple_handler_type handler;
+			};
+
+			/**
+			 * \brief A batch of datagrams to flush as one vectored send.
+			 */
+			typedef std::vector<datagram_type> datagram_batch_type;
+
 			void do_send_data(const ep_type&, channel_number_type, boost::asio::const_buffer, simple_handler_type);
-			void do_send_data_to_list(const std::set<ep_type>&, channel_number_type, boost::asio::const_buffer, multiple_endpoints_handler_type);
+			void do_send_data_in_place(const ep_type&, channel_number_type, SharedBuffer, boost::asio::const_buffer, simple_handler_type);
+			void do_send_data_to_list(endpoint_set_ptr, channel_number_type, boost::asio::const_buffer, multiple_endpoints_handler_type);
 			void do_send_data_to_all(channel_number_type, boost::asio::const_buffer, multiple_endpoints_handler_type);
 			void do_send_data_to_session(peer_session&, const ep_type&, channel_number_type, boost::asio::const_buffer, simple_handler_type);
+			bool build_data_datagram(peer_session&, const ep_type&, channel_number_type, boost::asio::const_buffer, simple_handler_type, datagram_batch_type&);
+#ifdef __linux__
+			void do_flush_datagram_batch(boost::shared_ptr<datagram_batch_type>);
+#endif
+			struct pending_peer_send_type
+			{
+				channel_number_type channel_number;
+				SharedBuffer frame;
+				boost::asio::const_buffer data;
+				simple_handler_type handler;
+			};
+
+			struct peer_egress_state_type
+			{
+				peer_egress_state_type() :
+					in_flight(0),
+					congested(false)
+				{}
+
+				size_t in_flight;
+				bool congested;
+				std::deque<pending_peer_send_type> pending;
+			};
+
+			typedef boost::unordered_map<ep_type, peer_egress_state_type, endpoint_hash> peer_egress_state_map;
+
+			bool acquire_peer_send_slot(const ep_type&, channel_number_type, SharedBuffer, boost::asio::const_buffer, simple_handler_type&);
+			void handle_peer_send_complete(const ep_type&, simple_handler_type, const boost::system::error_code&);
+			void do_release_peer_send_slot(const ep_type&);
+			void do_fail_pending_peer_sends();
+
+			size_t m_peer_send_queue_depth;
+			peer_send_queue_policy_type m_peer_send_queue_policy;
+			peer_congestion_handler_type m_peer_congestion_handler;
+			peer_egress_state_map m_peer_egress_states;
+
+			metrics_registry::counter& m_data_bytes_in_counter;
+			metrics_registry::counter& m_data_bytes_out_counter;
+			metrics_registry::counter& m_socket_errors_counter;
+			metrics_registry::counter& m_drop_no_session_counter;
+			metrics_registry::counter& m_drop_malformed_counter;
+			metrics_registry::counter& m_drop_unknown_type_counter;
+			metrics_registry::counter& m_shed_control_counter;
+			metrics_registry::counter& m_shed_unknown_source_counter;
+			metrics_registry::counter& m_shed_handshake_counter;
+			metrics_registry::counter& m_shed_memory_counter;
+			metrics_registry::counter& m_socket_kernel_drops_counter;
+			metrics_registry::counter& m_compression_rx_raw_bytes_counter;
+			metrics_registry::counter& m_compression_rx_wire_bytes_counter;
+			metrics_registry::histogram& m_receive_queueing_delay_histogram;
+			mutable boost::mutex m_peer_statistics_mutex;
+			std::map<ep_type, peer_statistics> m_peer_statistics;
+
 			void do_send_contact_request(const ep_type&, const hash_list_type&, simple_handler_type);
 			void do_send_contact_request_to_list(const std::set<ep_type>&, const hash_list_type&, multiple_endpoints_handler_type);
-			void do_send_contact_request_to_all(const hash_list_type&, multiple_endpoints_handler_type);
+			void do_send_contact_request_to_all(const hash_list_type&, multiple_endpoints_handler_type, const boost::posix_time::time_duration&);
 			void do_send_contact_request_to_session(peer_session&, const ep_type&, const hash_list_type&, simple_handler_type);
-			void do_send_contact(const ep_type&, const contact_map_type&, simple_handler_type);
-			void do_send_contact_to_list(const std::set<ep_type>&, const contact_map_type&, multiple_endpoints_handler_type);
-			void do_send_contact_to_all(const contact_map_type&, multiple_endpoints_handler_type);
-			void do_send_contact_to_session(peer_session&, const ep_type&, const contact_map_type&, simple_handler_type);
+			void do_send_contact_request_now(peer_session&, const ep_type&, const hash_list_type&, simple_handler_type);
+			void do_send_contact(const ep_type&, boost::shared_ptr<const contact_map_type>, simple_handler_type);
+			void do_send_contact_to_list(const std::set<ep_type>&, boost::shared_ptr<const contact_map_type>, multiple_endpoints_handler_type);
+			void do_send_contact_to_all(boost::shared_ptr<const contact_map_type>, multiple_endpoints_handler_type, const boost::posix_time::time_duration&);
+			void do_send_contact_to_session(peer_session&, const ep_type&, boost::shared_ptr<const contact_map_type>, simple_handler_type);
+			void do_send_contact_batch(peer_session&, const ep_type&, boost::shared_ptr<const contact_map_type>, simple_handler_type);
 			void handle_data_message_from(const identity_store&, SharedBuffer, const data_message&, const ep_type&);
-			void do_handle_data(const identity_store&, const ep_type&, const data_message&);
+			void do_handle_data(const identity_store&, const ep_type&, boost::shared_ptr<peer_session>, SharedBuffer, const data_message&);
+			bool unframe_cleartext(peer_session&, SharedBuffer&, boost::asio::const_buffer&);
+			void do_handle_data_opened(const identity_store&, const ep_type&, boost::shared_ptr<peer_session>, sequence_number_type, message_type, SharedBuffer, boost::asio::const_buffer);
+			void do_open_data(const identity_store&, const ep_type&, boost::shared_ptr<peer_session>, boost::shared_ptr<cryptoplus::cipher::cipher_context>, cryptoplus::buffer, SharedBuffer, data_message);
+			void do_seal_and_send(const ep_type&, channel_number_type, sequence_number_type, boost::shared_ptr<cryptoplus::cipher::cipher_context>, cryptoplus::buffer, compression_algorithm_type, SharedBuffer, boost::asio::const_buffer, simple_handler_type);
+			void do_seal_and_send_keep_alive(const ep_type&, sequence_number_type, boost::shared_ptr<cryptoplus::cipher::cipher_context>, cryptoplus::buffer, simple_handler_type);
+			void do_seal_and_send_contact_request(const ep_type&, sequence_number_type, boost::shared_ptr<cryptoplus::cipher::cipher_context>, cryptoplus::buffer, hash_list_type, simple_handler_type);
+			void do_seal_and_send_contact(const ep_type&, sequence_number_type, boost::shared_ptr<cryptoplus::cipher::cipher_context>, cryptoplus::buffer, boost::shared_ptr<const contact_map_type>, simple_handler_type);
 			void do_handle_data_message(const ep_type&, message_type, SharedBuffer, boost::asio::const_buffer);
 			void do_handle_contact_request(const ep_type&, const std::set<hash_type>&);
-			void do_handle_contact(const ep_type&, const contact_map_type&);
+			void do_handle_contact(const ep_type&, boost::shared_ptr<const contact_map_type>, size_t);
+
+			void do_enqueue_contact(const ep_type&, const contact_map_type&);
+			void schedule_contact_flush();
+			void do_flush_contacts(const boost::system::error_code&);
 
 			void do_set_data_received_callback(data_received_handler_type, void_handler_type);
 			void do_set_contact_request_received_callback(contact_request_received_handler_type, void_handler_type);
 			void do_set_contact_received_callback(contact_received_handler_type, void_handler_type);
 
-			boost::asio::strand m_data_strand;
-			boost::asio::strand m_contact_strand;
+			boost::atomic<uint32_t> m_data_strand_pending;
+			counted_strand m_data_strand;
+			boost::atomic<uint32_t> m_contact_strand_pending;
+			counted_strand m_contact_strand;
 
 			data_received_handler_type m_data_received_handler;
 			contact_request_received_handler_type m_contact_request_message_received_handler;
 			contact_received_handler_type m_contact_message_received_handler;
 
+			struct pending_contact_request_type
+			{
+				hash_list_type hash_list;
+				std::vector<simple_handler_type> handlers;
+			};
+
+			typedef std::map<ep_type, pending_contact_request_type> pending_contact_request_map;
+			typedef std::map<ep_type, contact_map_type> pending_contact_map;
+
+			boost::posix_time::time_duration m_contact_flush_interval;
+			pending_contact_request_map m_pending_contact_requests;
+			pending_contact_map m_pending_contacts;
+			timer_wheel::timer_id_type m_contact_flush_timer_id;
+
 		private: // Keep-alive
 
+			// The adaptive keep-alive state for one endpoint. Only ever touched from the session strand.
+			//
+			// Each peer starts at SESSION_KEEP_ALIVE_PERIOD and, after enough quiet intervals, the interval is doubled to probe the NAT's actual mapping timeout. When a stretched interval loses the peer, the last interval that worked is restored and kept for as long as the endpoint is known, including across session losses.
+			//
+			// In the lazy keep-alive mode, idle_interval additionally decays while the session carries no real data and snaps back to the NAT-learned interval as soon as data flows again.
+			struct keep_alive_context_type
+			{
+				keep_alive_context_type() :
+					interval(SESSION_KEEP_ALIVE_PERIOD),
+					idle_interval(SESSION_KEEP_ALIVE_PERIOD),
+					learned(false),
+					quiet_intervals(0),
+					last_send(boost::posix_time::min_date_time)
+				{}
+
+				boost::posix_time::time_duration interval;
+				boost::posix_time::time_duration idle_interval;
+				bool learned;
+				unsigned int quiet_intervals;
+				boost::posix_time::ptime last_send;
+			};
+
 			void do_check_keep_alive(const boost::system::error_code&);
 			void do_send_keep_alive(const ep_type&, simple_handler_type);
 
-			boost::asio::deadline_timer m_keep_alive_timer;
+			timer_wheel m_timer_wheel;
+			timer_wheel::timer_id_type m_keep_alive_timer_id;
+			std::map<ep_type, keep_alive_context_type> m_keep_alive_contexts;
+			bool m_lazy_keep_alive;
+
+		private: // Path MTU discovery
+
+			// The binary search state for one peer. Only ever touched from the session strand.
+			struct path_mtu_context_type
+			{
+				path_mtu_context_type() :
+					low(0),
+					high(0),
+					probe_size(0),
+					retries(0),
+					probe_in_flight(false),
+					converged(false),
+					reported(0)
+				{}
+
+				size_t low; /**< \brief The largest payload acknowledged so far. */
+				size_t high; /**< \brief The smallest payload known (or assumed) undeliverable, minus one. 0 until the search starts. */
+				size_t probe_size;
+				size_t retries;
+				bool probe_in_flight;
+				bool converged;
+				size_t reported; /**< \brief The last value handed to the callback. */
+				boost::posix_time::ptime probe_date;
+				boost::posix_time::ptime reprobe_date;
+			};
+
+			void do_check_path_mtu(const boost::system::error_code&);
+			void do_send_path_mtu_probe(const ep_type&, path_mtu_context_type&);
+			void do_advance_path_mtu(const ep_type&, path_mtu_context_type&);
+			void do_handle_path_mtu_probe(const ep_type&, uint16_t);
+			void do_handle_path_mtu_ack(const ep_type&, uint16_t);
+			void do_send_probe_frame(const ep_type&, SharedBuffer, size_t);
+
+			std::map<ep_type, path_mtu_context_type> m_path_mtu_contexts;
+			path_mtu_changed_handler_type m_path_mtu_changed_handler;
+			timer_wheel::timer_id_type m_path_mtu_timer_id;
+
+		private: // Multipath
+
+			// The quality measurements of one path. Only ever touched from the session strand.
+			struct path_quality_context_type
+			{
+				path_quality_context_type() :
+					next_sequence(0),
+					outstanding_sequence(0),
+					probe_in_flight(false),
+					srtt_us(0),
+					loss_ewma(0.0)
+				{}
+
+				uint32_t next_sequence;
+				uint32_t outstanding_sequence;
+				bool probe_in_flight;
+				boost::posix_time::ptime probe_date;
+				uint64_t srtt_us; /**< \brief The smoothed round-trip time, in microseconds. 0 until the first sample. */
+				double loss_ewma; /**< \brief The smoothed probe loss, in [0, 1]. */
+			};
+
+			void do_probe_path_quality();
+			void do_handle_path_quality_probe(const ep_type&, uint32_t);
+			void do_handle_path_quality_ack(const ep_type&, uint32_t);
+			ep_type select_path(const ep_type&);
+
+			std::map<ep_type, path_quality_context_type> m_path_quality_contexts;
+			std::map<host_identifier_type, std::set<ep_type>> m_host_paths;
+			std::map<host_identifier_type, size_t> m_spray_counters;
+
+		private: // Session resumption
+
+			// The cached resumption state for one host. Only ever touched from the session strand.
+			struct session_resumption_context_type
+			{
+				session_resumption_context_type() :
+					session_number(0),
+					pending(false)
+				{}
+
+				cryptoplus::buffer secret;
+				cipher_suite_type cipher_suite;
+				elliptic_curve_type elliptic_curve;
+				compression_algorithm_type compression_algorithm;
+				boost::posix_time::ptime expiry;
+				session_number_type session_number; /**< \brief The session number proposed by our outstanding resumption request. */
+				bool pending; /**< \brief Whether we sent a resumption request that was not answered yet. */
+				boost::array<uint8_t, SESSION_RESUMPTION_NONCE_SIZE> request_nonce;
+			};
+
+			void do_cache_session_resumption(const ep_type&, const peer_session&);
+			bool do_request_session_resumption(const ep_type&, simple_handler_type);
+			void do_handle_session_resumption_request(const ep_type&, const session_resumption_message&);
+			void do_handle_session_resumption_response(const ep_type&, const session_resumption_message&);
+
+			std::map<ep_type, session_resumption_context_type> m_session_resumption_contexts;
 
 		private: // Misc
 
@@ -72,13 +72,14 @@ namespace fscp
 			 * \param session_number The session number.
 			 * \param host_identifier The host identifier.
 			 * \param cs The cipher suite.
+			 * \param comp The compression algorithm.
 			 * \param ec The elliptic curve.
 			 * \param pub_key The public key.
 			 * \param pub_key_len The public key length.
 			 * \param sig_key The private key to use to sign the ciphertext.
 			 * \return The count of bytes written.
 			 */
-			static size_t write(void* buf, size_t buf_len, session_number_type session_number, const host_identifier_type& host_identifier, cipher_suite_type cs, elliptic_curve_type ec, const void* pub_key, size_t pub_key_len, cryptoplus::pkey::pkey sig_key);
+			static size_t write(void* buf, size_t buf_len, session_number_type session_number, const host_identifier_type& host_identifier, cipher_suite_type cs, elliptic_curve_type ec, compression_algorithm_type comp, const void* pub_key, size_t pub_key_len, cryptoplus::pkey::pkey sig_key);
 
 			/**
 			 * \brief Create a session_message from a message.
@@ -110,6 +111,14 @@ namespace fscp
 			 */
 			elliptic_curve_type elliptic_curve() const;
 
+			/**
+			 * \brief Get the compression algorithm.
+			 * \return The compression algorithm.
+			 *
+			 * The value travels in a formerly-reserved byte that older implementations zero-fill, so a peer that does not negotiate compression reads as "none".
+			 */
+			compression_algorithm_type compression_algorithm() const;
+
 			/**
 			 * \brief Get the public key.
 			 * \return The public key.
@@ -179,6 +188,11 @@ namespace fscp
 		return buffer_tools::get<uint8_t>(payload(), sizeof(session_number_type) + host_identifier_type::data_type::static_size + sizeof(uint8_t));
 	}
 
+	inline compression_algorithm_type session_message::compression_algorithm() const
+	{
+		return buffer_tools::get<uint8_t>(payload(), sizeof(session_number_type) + host_identifier_type::data_type::static_size + sizeof(uint8_t) * 2);
+	}
+
 	inline const uint8_t* session_message::public_key() const
 	{
 		return payload() + sizeof(session_number_type) + host_identifier_type::data_type::static_size + sizeof(uint8_t) * 2 + 2 + sizeof(uint16_t);
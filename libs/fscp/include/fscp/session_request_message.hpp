@@ -72,10 +72,12 @@ namespace fscp
 			 * \param host_identifier The host identifier.
 			 * \param cs_cap The cipher suite capabilities.
 			 * \param ec_cap The elliptic curve capabilities.
+			 * \param comp_cap The compression algorithm capabilities. Only written when version carries them.
 			 * \param sig_key The private key to use to sign the ciphertext.
+			 * \param version The protocol version to write. Hosts that were not seen speaking COMPRESSION_PROTOCOL_VERSION must be sent the version 3 layout, without the compression capability list.
 			 * \return The count of bytes written.
 			 */
-			static size_t write(void* buf, size_t buf_len, session_number_type session_number, const host_identifier_type& host_identifier, const cipher_suite_list_type& cs_cap, const elliptic_curve_list_type& ec_cap, cryptoplus::pkey::pkey sig_key);
+			static size_t write(void* buf, size_t buf_len, session_number_type session_number, const host_identifier_type& host_identifier, const cipher_suite_list_type& cs_cap, const elliptic_curve_list_type& ec_cap, const compression_algorithm_list_type& comp_cap, cryptoplus::pkey::pkey sig_key, unsigned char version = CURRENT_PROTOCOL_VERSION);
 
 			/**
 			 * \brief Create a session_request_message from a message.
@@ -119,6 +121,24 @@ namespace fscp
 			 */
 			size_t elliptic_curve_capabilities_size() const;
 
+			/**
+			 * \brief Check whether the message carries a compression algorithm capability list.
+			 * \return true when the message was written with the version 4 layout. Version 3 messages carry no list and negotiate to no compression.
+			 */
+			bool has_compression_algorithm_capabilities() const;
+
+			/**
+			 * \brief Get the compression algorithm capabilities.
+			 * \return The compression algorithm capabilities. Empty for version 3 messages.
+			 */
+			compression_algorithm_list_type compression_algorithm_capabilities() const;
+
+			/**
+			 * \brief Get the compression algorithm capabilities size.
+			 * \return The compression algorithm capabilities size.
+			 */
+			size_t compression_algorithm_capabilities_size() const;
+
 			/**
 			 * \brief Get the header size, without the signature.
 			 * \return The header size, without the signature.
@@ -148,6 +168,8 @@ namespace fscp
 
 			/**
 			 * \brief The min length of the body.
+			 *
+			 * The third length field (the compression algorithm capability list) only exists in version 4 messages, so the minimum is the version 3 layout.
 			 */
 			static const size_t MIN_BODY_LENGTH = sizeof(session_number_type) + host_identifier_type::data_type::static_size + sizeof(uint16_t) * 2;
 	};
@@ -176,9 +198,31 @@ namespace fscp
 		return ntohs(buffer_tools::get<uint16_t>(payload(), sizeof(session_number_type) + host_identifier_type::data_type::static_size + sizeof(uint16_t) + cipher_suite_capabilities_size()));
 	}
 
+	inline bool session_request_message::has_compression_algorithm_capabilities() const
+	{
+		return (version() >= COMPRESSION_PROTOCOL_VERSION);
+	}
+
+	inline size_t session_request_message::compression_algorithm_capabilities_size() const
+	{
+		if (!has_compression_algorithm_capabilities())
+		{
+			return 0;
+		}
+
+		return ntohs(buffer_tools::get<uint16_t>(payload(), sizeof(session_number_type) + host_identifier_type::data_type::static_size + sizeof(uint16_t) + cipher_suite_capabilities_size() + sizeof(uint16_t) + elliptic_curve_capabilities_size()));
+	}
+
 	inline size_t session_request_message::header_size() const
 	{
-		return sizeof(session_number_type) + host_identifier_type::data_type::static_size + sizeof(uint16_t) + cipher_suite_capabilities_size() + sizeof(uint16_t) + elliptic_curve_capabilities_size();
+		const size_t base = sizeof(session_number_type) + host_identifier_type::data_type::static_size + sizeof(uint16_t) + cipher_suite_capabilities_size() + sizeof(uint16_t) + elliptic_curve_capabilities_size();
+
+		if (!has_compression_algorithm_capabilities())
+		{
+			return base;
+		}
+
+		return base + sizeof(uint16_t) + compression_algorithm_capabilities_size();
 	}
 
 	inline const uint8_t* session_request_message::header_signature() const
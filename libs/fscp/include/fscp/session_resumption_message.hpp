@@ -0,0 +1,212 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file session_resumption_message.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A session resumption message class.
+ */
+
+#ifndef FSCP_SESSION_RESUMPTION_MESSAGE_HPP
+#define FSCP_SESSION_RESUMPTION_MESSAGE_HPP
+
+#include "message.hpp"
+
+#include "buffer_tools.hpp"
+#include "constants.hpp"
+
+#include <stdint.h>
+#include <cstring>
+
+#include <boost/asio.hpp>
+
+namespace fscp
+{
+	/**
+	 * \brief A session resumption message class.
+	 *
+	 * Unlike SESSION_REQUEST and SESSION messages, session resumption messages are not signed: they are authenticated with a HMAC keyed with the resumption secret both hosts derived when the previous session was established. A valid HMAC thus proves the sender took part in a fully verified handshake recently.
+	 */
+	class session_resumption_message : public message
+	{
+		public:
+
+			/**
+			 * \brief Write a session resumption message to a buffer.
+			 * \param buf The buffer to write to.
+			 * \param buf_len The length of buf.
+			 * \param type The message type. Must be MESSAGE_TYPE_SESSION_RESUMPTION_REQUEST or MESSAGE_TYPE_SESSION_RESUMPTION.
+			 * \param session_number The session number.
+			 * \param host_identifier The host identifier.
+			 * \param nonce The nonce. Must be SESSION_RESUMPTION_NONCE_SIZE bytes long.
+			 * \param cipher_suite The cipher suite of the resumed session.
+			 * \param elliptic_curve The elliptic curve of the resumed session.
+			 * \param compression_algorithm The compression algorithm of the resumed session.
+			 * \param resumption_secret The resumption secret to key the HMAC with.
+			 * \return The count of bytes written.
+			 */
+			static size_t write(void* buf, size_t buf_len, message_type type, session_number_type session_number, const host_identifier_type& host_identifier, const uint8_t* nonce, cipher_suite_type cipher_suite, elliptic_curve_type elliptic_curve, compression_algorithm_type compression_algorithm, const cryptoplus::buffer& resumption_secret);
+
+			/**
+			 * \brief Create a session_resumption_message from a message.
+			 * \param message The message.
+			 */
+			session_resumption_message(const message& message);
+
+			/**
+			 * \brief Get the session number.
+			 * \return The session number.
+			 */
+			session_number_type session_number() const;
+
+			/**
+			 * \brief Get the host identifier.
+			 * \return The host identifier.
+			 */
+			host_identifier_type host_identifier() const;
+
+			/**
+			 * \brief Get the nonce.
+			 * \return The nonce. It is SESSION_RESUMPTION_NONCE_SIZE bytes long.
+			 */
+			const uint8_t* nonce() const;
+
+			/**
+			 * \brief Get the cipher suite of the resumed session.
+			 * \return The cipher suite.
+			 */
+			cipher_suite_type cipher_suite() const;
+
+			/**
+			 * \brief Get the elliptic curve of the resumed session.
+			 * \return The elliptic curve.
+			 */
+			elliptic_curve_type elliptic_curve() const;
+
+			/**
+			 * \brief Get the compression algorithm of the resumed session.
+			 * \return The compression algorithm.
+			 */
+			compression_algorithm_type compression_algorithm() const;
+
+			/**
+			 * \brief Get the header size, without the HMAC.
+			 * \return The header size, without the HMAC.
+			 */
+			size_t header_size() const;
+
+			/**
+			 * \brief Get the header HMAC.
+			 * \return The header HMAC.
+			 */
+			const uint8_t* header_hmac() const;
+
+			/**
+			 * \brief Get the header HMAC size.
+			 * \return The header HMAC size.
+			 */
+			size_t header_hmac_size() const;
+
+			/**
+			 * \brief Check if the HMAC matches with a given resumption secret.
+			 * \param resumption_secret The resumption secret to use.
+			 * \return If the check fails, false is returned.
+			 *
+			 * The message type takes part in the HMAC so a request cannot be reflected back as a response.
+			 */
+			bool check_hmac(const cryptoplus::buffer& resumption_secret) const;
+
+		protected:
+
+			/**
+			 * \brief The min length of the body.
+			 */
+			static const size_t MIN_BODY_LENGTH = sizeof(session_number_type) + host_identifier_type::data_type::static_size + SESSION_RESUMPTION_NONCE_SIZE + 3 + sizeof(uint16_t);
+	};
+
+	inline session_number_type session_resumption_message::session_number() const
+	{
+		return ntohl(buffer_tools::get<session_number_type>(payload(), 0));
+	}
+
+	inline host_identifier_type session_resumption_message::host_identifier() const
+	{
+		host_identifier_type result;
+
+		std::copy(payload() + sizeof(session_number_type), payload() + sizeof(session_number_type) + result.data.size(), result.data.begin());
+
+		return result;
+	}
+
+	inline const uint8_t* session_resumption_message::nonce() const
+	{
+		return payload() + sizeof(session_number_type) + host_identifier_type::data_type::static_size;
+	}
+
+	inline cipher_suite_type session_resumption_message::cipher_suite() const
+	{
+		return buffer_tools::get<uint8_t>(payload(), sizeof(session_number_type) + host_identifier_type::data_type::static_size + SESSION_RESUMPTION_NONCE_SIZE);
+	}
+
+	inline elliptic_curve_type session_resumption_message::elliptic_curve() const
+	{
+		return buffer_tools::get<uint8_t>(payload(), sizeof(session_number_type) + host_identifier_type::data_type::static_size + SESSION_RESUMPTION_NONCE_SIZE + 1);
+	}
+
+	inline compression_algorithm_type session_resumption_message::compression_algorithm() const
+	{
+		return buffer_tools::get<uint8_t>(payload(), sizeof(session_number_type) + host_identifier_type::data_type::static_size + SESSION_RESUMPTION_NONCE_SIZE + 2);
+	}
+
+	inline size_t session_resumption_message::header_size() const
+	{
+		return sizeof(session_number_type) + host_identifier_type::data_type::static_size + SESSION_RESUMPTION_NONCE_SIZE + 3;
+	}
+
+	inline const uint8_t* session_resumption_message::header_hmac() const
+	{
+		return payload() + header_size() + sizeof(uint16_t);
+	}
+
+	inline size_t session_resumption_message::header_hmac_size() const
+	{
+		return ntohs(buffer_tools::get<uint16_t>(payload(), header_size()));
+	}
+}
+
+#endif /* FSCP_SESSION_RESUMPTION_MESSAGE_HPP */
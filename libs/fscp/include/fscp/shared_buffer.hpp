@@ -44,6 +44,8 @@
 
 #pragma once
 
+#include "buffer_pool.hpp"
+
 #include <boost/asio.hpp>
 #include <boost/shared_array.hpp>
 
@@ -59,14 +61,46 @@ namespace fscp
 	template <typename Type> Type buffer_cast(const SharedBuffer&);
 	size_t buffer_size(const SharedBuffer&);
 
+	namespace detail
+	{
+		/**
+		 * \brief A deleter that returns a buffer to the pool it was acquired from.
+		 */
+		class pooled_buffer_deleter
+		{
+			public:
+				pooled_buffer_deleter(size_t capacity) :
+					m_capacity(capacity)
+				{}
+
+				void operator()(uint8_t* data) const
+				{
+					buffer_pool::instance().release(data, m_capacity);
+				}
+
+			private:
+				size_t m_capacity;
+		};
+	}
+
 	class SharedBuffer
 	{
 		public:
-			SharedBuffer(size_t size) :
-				m_size(size),
-				m_data(new uint8_t[size])
+			SharedBuffer() :
+				m_size(0)
 			{}
 
+			SharedBuffer(size_t size) :
+				m_size(size)
+			{
+				// The pool may return a buffer bigger than requested: expose the whole capacity.
+				size_t capacity = size;
+				uint8_t* const data = buffer_pool::instance().acquire(capacity);
+
+				m_size = capacity;
+				m_data = boost::shared_array<uint8_t>(data, detail::pooled_buffer_deleter(capacity));
+			}
+
 		private:
 			size_t m_size;
 			boost::shared_array<uint8_t> m_data;
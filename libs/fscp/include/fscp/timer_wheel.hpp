@@ -0,0 +1,169 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file timer_wheel.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A hashed timer wheel.
+ */
+
+#ifndef FSCP_TIMER_WHEEL_HPP
+#define FSCP_TIMER_WHEEL_HPP
+
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <list>
+#include <map>
+#include <vector>
+
+#include <stdint.h>
+
+namespace fscp
+{
+	/**
+	 * \brief A hashed timer wheel.
+	 *
+	 * Multiplexes many coarse timeouts onto a single boost::asio::deadline_timer: one
+	 * tick advances the wheel and fires every expired entry, so scheduling and
+	 * cancelling a timeout is O(1) regardless of how many are pending.
+	 *
+	 * Handlers receive the same error codes a deadline_timer would: a default
+	 * constructed error code upon expiration and boost::asio::error::operation_aborted
+	 * upon cancellation. Handlers are always invoked through the associated
+	 * io_service, never from within async_wait() or cancel().
+	 *
+	 * All methods are thread-safe.
+	 */
+	class timer_wheel
+	{
+		public:
+
+			/**
+			 * \brief The wait handler type.
+			 */
+			typedef boost::function<void (const boost::system::error_code&)> wait_handler_type;
+
+			/**
+			 * \brief The timer identifier type.
+			 *
+			 * The value 0 never identifies a pending timer.
+			 */
+			typedef uint64_t timer_id_type;
+
+			/**
+			 * \brief The default tick duration.
+			 */
+			static const unsigned int DEFAULT_TICK_MILLISECONDS = 100;
+
+			/**
+			 * \brief The default slot count.
+			 */
+			static const size_t DEFAULT_SLOT_COUNT = 512;
+
+			/**
+			 * \brief Create a new timer wheel.
+			 * \param io_service The io_service to run the tick timer on and to invoke the handlers through.
+			 * \param tick_duration The duration of one tick. Timeouts are rounded up to the next tick.
+			 * \param slot_count The number of slots on the wheel.
+			 */
+			explicit timer_wheel(boost::asio::io_service& io_service, const boost::posix_time::time_duration& tick_duration = boost::posix_time::milliseconds(DEFAULT_TICK_MILLISECONDS), size_t slot_count = DEFAULT_SLOT_COUNT);
+
+			/**
+			 * \brief Start ticking.
+			 *
+			 * Calling start() on a started wheel has no effect.
+			 */
+			void start();
+
+			/**
+			 * \brief Stop ticking.
+			 *
+			 * All pending entries are cancelled, as if cancel() had been called on each of them.
+			 */
+			void stop();
+
+			/**
+			 * \brief Schedule a timeout.
+			 * \param timeout The time to wait before the handler is called.
+			 * \param handler The handler to call upon expiration or cancellation.
+			 * \return The identifier of the scheduled timer, to be passed to cancel().
+			 */
+			timer_id_type async_wait(const boost::posix_time::time_duration& timeout, wait_handler_type handler);
+
+			/**
+			 * \brief Cancel a pending timeout.
+			 * \param id The identifier returned by async_wait().
+			 * \return true if the entry was still pending and its handler will be called with boost::asio::error::operation_aborted, or false if it was too late to do so.
+			 */
+			bool cancel(timer_id_type id);
+
+		private:
+
+			struct entry_type
+			{
+				entry_type(timer_id_type _id, size_t _remaining_laps, wait_handler_type _handler) :
+					id(_id),
+					remaining_laps(_remaining_laps),
+					handler(_handler)
+				{}
+
+				timer_id_type id;
+				size_t remaining_laps;
+				wait_handler_type handler;
+			};
+
+			typedef std::list<entry_type> slot_type;
+
+			void do_tick(const boost::system::error_code&);
+
+			boost::asio::io_service& m_io_service;
+			boost::asio::deadline_timer m_tick_timer;
+			const boost::posix_time::time_duration m_tick_duration;
+			std::vector<slot_type> m_slots;
+			std::map<timer_id_type, size_t> m_slot_indexes;
+			size_t m_current_slot;
+			timer_id_type m_next_timer_id;
+			bool m_running;
+			mutable boost::mutex m_mutex;
+	};
+}
+
+#endif /* FSCP_TIMER_WHEEL_HPP */
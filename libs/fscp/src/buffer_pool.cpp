@@ -0,0 +1,381 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file buffer_pool.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A size-classed buffer pool.
+ */
+
+#include "buffer_pool.hpp"
+
+#include <cryptoplus/allocation_stats.hpp>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+namespace fscp
+{
+	buffer_pool& buffer_pool::instance()
+	{
+		// The first call to this function is *NOT* thread-safe in C++03 !
+		static buffer_pool pool;
+
+		return pool;
+	}
+
+	uint8_t* buffer_pool::acquire(size_t& size)
+	{
+		size_t cls = 0;
+
+		if (!size_class(size, cls))
+		{
+			// The request is bigger than the largest size class: serve it directly from the heap.
+			cryptoplus::allocation_stats::record_allocation(cryptoplus::allocation_stats::ALLOCATION_TAG_SHARED_BUFFER, size);
+
+			update_pressure(m_outstanding_bytes.fetch_add(size, boost::memory_order_relaxed) + size);
+
+			return new uint8_t[size];
+		}
+
+		const size_t capacity = static_cast<size_t>(1) << (MIN_SIZE_CLASS_BITS + cls);
+
+		update_pressure(m_outstanding_bytes.fetch_add(capacity, boost::memory_order_relaxed) + capacity);
+
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			std::vector<uint8_t*>& free_list = m_free_lists[cls];
+
+			++m_class_acquisitions[cls];
+			++m_class_recent_acquisitions[cls];
+
+			if (--m_adaptation_countdown == 0)
+			{
+				adapt_caps();
+			}
+
+			if (!free_list.empty())
+			{
+				uint8_t* const data = free_list.back();
+
+				free_list.pop_back();
+				++m_reuse_count;
+
+				size = capacity;
+
+				return data;
+			}
+
+			++m_allocation_count;
+
+			if (m_arena && ((m_arena_size - m_arena_offset) >= capacity))
+			{
+				uint8_t* const data = m_arena + m_arena_offset;
+
+				m_arena_offset += capacity;
+
+				size = capacity;
+
+				// Slots carved from the arena are accounted like heap buffers: the accounting sizes the packet footprint, wherever it lives.
+				cryptoplus::allocation_stats::record_allocation(cryptoplus::allocation_stats::ALLOCATION_TAG_SHARED_BUFFER, capacity);
+
+				return data;
+			}
+		}
+
+		size = capacity;
+
+		cryptoplus::allocation_stats::record_allocation(cryptoplus::allocation_stats::ALLOCATION_TAG_SHARED_BUFFER, capacity);
+
+		return new uint8_t[capacity];
+	}
+
+	void buffer_pool::release(uint8_t* data, size_t capacity)
+	{
+		update_pressure(m_outstanding_bytes.fetch_sub(capacity, boost::memory_order_relaxed) - capacity);
+
+		size_t cls = 0;
+
+		// Only capacities that exactly match a size class can come from the pool.
+		if (size_class(capacity, cls) && ((static_cast<size_t>(1) << (MIN_SIZE_CLASS_BITS + cls)) == capacity))
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			std::vector<uint8_t*>& free_list = m_free_lists[cls];
+
+			// Arena slots are permanent and already bounded by the arena size: they always return to their free list. The cap only bounds the heap-backed spares.
+			if (from_arena(data) || (free_list.size() < m_class_caps[cls]))
+			{
+				free_list.push_back(data);
+
+				return;
+			}
+		}
+
+		// Buffers held by the pool stay accounted as live: the accounting sizes the whole footprint, not just the in-flight part.
+		cryptoplus::allocation_stats::record_release(cryptoplus::allocation_stats::ALLOCATION_TAG_SHARED_BUFFER, capacity);
+
+		delete[] data;
+	}
+
+	buffer_pool::statistics_type buffer_pool::statistics() const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		statistics_type result = { m_allocation_count, m_reuse_count, 0, 0, m_arena_size, m_arena_offset, m_budget, m_outstanding_bytes.load(boost::memory_order_relaxed), m_pressure.load(boost::memory_order_relaxed) };
+
+		result.size_classes.reserve(SIZE_CLASS_COUNT);
+
+		for (size_t cls = 0; cls < SIZE_CLASS_COUNT; ++cls)
+		{
+			result.pooled_buffer_count += m_free_lists[cls].size();
+			result.pooled_bytes += m_free_lists[cls].size() * (static_cast<size_t>(1) << (MIN_SIZE_CLASS_BITS + cls));
+
+			const size_class_statistics_type class_statistics = { static_cast<size_t>(1) << (MIN_SIZE_CLASS_BITS + cls), m_class_acquisitions[cls], m_free_lists[cls].size(), m_class_caps[cls] };
+
+			result.size_classes.push_back(class_statistics);
+		}
+
+		return result;
+	}
+
+	bool buffer_pool::size_class(size_t size, size_t& result)
+	{
+		size_t bits = MIN_SIZE_CLASS_BITS;
+
+		while ((static_cast<size_t>(1) << bits) < size)
+		{
+			if (bits == MAX_SIZE_CLASS_BITS)
+			{
+				return false;
+			}
+
+			++bits;
+		}
+
+		result = bits - MIN_SIZE_CLASS_BITS;
+
+		return true;
+	}
+
+	bool buffer_pool::reserve_arena(size_t bytes, bool huge_pages)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		if (m_arena || (bytes == 0))
+		{
+			return false;
+		}
+
+#ifndef _WIN32
+		void* arena = MAP_FAILED;
+
+		if (huge_pages)
+		{
+#ifdef MAP_HUGETLB
+			// An explicit huge page mapping requires the size to be a multiple of the huge page size.
+			const size_t huge_page_size = 2 * 1024 * 1024;
+			const size_t rounded_bytes = (bytes + huge_page_size - 1) & ~(huge_page_size - 1);
+
+			arena = ::mmap(NULL, rounded_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+			if (arena != MAP_FAILED)
+			{
+				bytes = rounded_bytes;
+			}
+#endif
+		}
+
+		if (arena == MAP_FAILED)
+		{
+			// Either huge pages were not requested, or none are reserved on the system: use a regular mapping.
+			arena = ::mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+			if (arena == MAP_FAILED)
+			{
+				return false;
+			}
+
+#ifdef MADV_HUGEPAGE
+			if (huge_pages)
+			{
+				::madvise(arena, bytes, MADV_HUGEPAGE);
+			}
+#endif
+		}
+
+		m_arena = static_cast<uint8_t*>(arena);
+#else
+		static_cast<void>(huge_pages);
+
+		m_arena = new uint8_t[bytes];
+#endif
+
+		m_arena_size = bytes;
+		m_arena_offset = 0;
+
+		return true;
+	}
+
+	bool buffer_pool::from_arena(const uint8_t* data) const
+	{
+		return (m_arena != NULL) && (data >= m_arena) && (data < (m_arena + m_arena_size));
+	}
+
+	void buffer_pool::adapt_caps()
+	{
+		// Called with m_mutex held.
+		size_t total = 0;
+
+		for (size_t cls = 0; cls < SIZE_CLASS_COUNT; ++cls)
+		{
+			total += m_class_recent_acquisitions[cls];
+		}
+
+		if (total > 0)
+		{
+			for (size_t cls = 0; cls < SIZE_CLASS_COUNT; ++cls)
+			{
+				// Each class gets a share of the spare stock proportional to its share of the recent traffic, down to a small floor so a mode shift never starts from zero.
+				size_t cap = (MAX_POOLED_BUFFERS_PER_CLASS * m_class_recent_acquisitions[cls]) / total;
+
+				if (cap < MIN_POOLED_BUFFERS_PER_CLASS)
+				{
+					cap = MIN_POOLED_BUFFERS_PER_CLASS;
+				}
+
+				m_class_caps[cls] = cap;
+
+				// Trim the heap-backed spares above the new cap. Arena slots are permanent and stay pooled.
+				std::vector<uint8_t*>& free_list = m_free_lists[cls];
+				const size_t capacity = static_cast<size_t>(1) << (MIN_SIZE_CLASS_BITS + cls);
+
+				for (size_t i = free_list.size(); (i > 0) && (free_list.size() > cap); --i)
+				{
+					if (!from_arena(free_list[i - 1]))
+					{
+						delete[] free_list[i - 1];
+						free_list.erase(free_list.begin() + (i - 1));
+
+						cryptoplus::allocation_stats::record_release(cryptoplus::allocation_stats::ALLOCATION_TAG_SHARED_BUFFER, capacity);
+					}
+				}
+
+				// Halve the histogram so the caps track the recent distribution, not the all-time one.
+				m_class_recent_acquisitions[cls] /= 2;
+			}
+		}
+
+		m_adaptation_countdown = ADAPTATION_PERIOD;
+	}
+
+	void buffer_pool::update_pressure(size_t outstanding)
+	{
+		if (m_budget == 0)
+		{
+			return;
+		}
+
+		int pressure = PRESSURE_NONE;
+
+		// The thresholds match the pressure_level_type documentation: 70%, 85% and 95% of the budget.
+		if (outstanding >= (m_budget / 100) * 95)
+		{
+			pressure = PRESSURE_SHED_BULK;
+		}
+		else if (outstanding >= (m_budget / 100) * 85)
+		{
+			pressure = PRESSURE_SHED_HANDSHAKES;
+		}
+		else if (outstanding >= (m_budget / 100) * 70)
+		{
+			pressure = PRESSURE_SHED_BROADCASTS;
+		}
+
+		if (m_pressure.load(boost::memory_order_relaxed) != pressure)
+		{
+			m_pressure.store(pressure, boost::memory_order_relaxed);
+		}
+	}
+
+	buffer_pool::buffer_pool() :
+		m_adaptation_countdown(ADAPTATION_PERIOD),
+		m_allocation_count(0),
+		m_reuse_count(0),
+		m_budget(0),
+		m_outstanding_bytes(0),
+		m_pressure(PRESSURE_NONE),
+		m_arena(NULL),
+		m_arena_size(0),
+		m_arena_offset(0)
+	{
+		for (size_t cls = 0; cls < SIZE_CLASS_COUNT; ++cls)
+		{
+			m_class_acquisitions[cls] = 0;
+			m_class_recent_acquisitions[cls] = 0;
+
+			// Until the first adaptation, every class may stock spares as before.
+			m_class_caps[cls] = MAX_POOLED_BUFFERS_PER_CLASS;
+		}
+	}
+
+	buffer_pool::~buffer_pool()
+	{
+		for (size_t cls = 0; cls < SIZE_CLASS_COUNT; ++cls)
+		{
+			for (std::vector<uint8_t*>::iterator it = m_free_lists[cls].begin(); it != m_free_lists[cls].end(); ++it)
+			{
+				if (!from_arena(*it))
+				{
+					delete[] *it;
+				}
+			}
+		}
+
+		if (m_arena)
+		{
+#ifndef _WIN32
+			::munmap(m_arena, m_arena_size);
+#else
+			delete[] m_arena;
+#endif
+		}
+	}
+}
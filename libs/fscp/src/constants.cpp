@@ -53,8 +53,14 @@ namespace fscp
 	const cipher_suite_type::value_type cipher_suite_type::unsupported = 0x00;
 	const cipher_suite_type::value_type cipher_suite_type::ecdhe_rsa_aes128_gcm_sha256 = 0x01;
 	const cipher_suite_type::value_type cipher_suite_type::ecdhe_rsa_aes256_gcm_sha384 = 0x02;
+	const cipher_suite_type::value_type cipher_suite_type::ecdhe_rsa_chacha20_poly1305_sha256 = 0x03;
 	const std::string cipher_suite_type::ecdhe_rsa_aes128_gcm_sha256_string("ecdhe_rsa_aes128_gcm_sha256");
 	const std::string cipher_suite_type::ecdhe_rsa_aes256_gcm_sha384_string("ecdhe_rsa_aes256_gcm_sha384");
+	const std::string cipher_suite_type::ecdhe_rsa_chacha20_poly1305_sha256_string("ecdhe_rsa_chacha20_poly1305_sha256");
+	const compression_algorithm_type::value_type compression_algorithm_type::none = 0x00;
+	const compression_algorithm_type::value_type compression_algorithm_type::lz4 = 0x01;
+	const std::string compression_algorithm_type::none_string("none");
+	const std::string compression_algorithm_type::lz4_string("lz4");
 	const elliptic_curve_type::value_type elliptic_curve_type::unsupported = 0x00;
 	const elliptic_curve_type::value_type elliptic_curve_type::sect571k1 = 0x01;
 	const elliptic_curve_type::value_type elliptic_curve_type::secp384r1 = 0x02;
@@ -87,7 +93,7 @@ namespace fscp
 	{
 		cryptoplus::hash::message_digest_context mdctx;
 		mdctx.initialize(get_default_digest_algorithm());
-		mdctx.update(cert.write_der());
+		mdctx.update(cert.cached_der());
 		mdctx.finalize(buf, buflen);
 	}
 
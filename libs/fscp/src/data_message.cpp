@@ -44,6 +44,12 @@
 
 #include "data_message.hpp"
 
+#include <cryptoplus/engine.hpp>
+
+#include "lz4.hpp"
+#include "metrics.hpp"
+
+#include <cryptoplus/allocation_stats.hpp>
 #include <cryptoplus/cipher/cipher_context.hpp>
 #include <cryptoplus/hash/hmac.hpp>
 #include <cryptoplus/random/random.hpp>
@@ -57,7 +63,9 @@ namespace fscp
 {
 	namespace
 	{
-		typedef std::vector<uint8_t> iv_type;
+		// The scratch containers account their heap usage, so the cost of building messages shows up in the allocation statistics.
+		typedef std::vector<uint8_t, cryptoplus::accounting_allocator<uint8_t, cryptoplus::allocation_stats::ALLOCATION_TAG_MESSAGE> > scratch_type;
+		typedef scratch_type iv_type;
 
 		iv_type compute_iv(const void* nonce_prefix, size_t nonce_prefix_len, sequence_number_type sequence_number)
 		{
@@ -73,15 +81,117 @@ namespace fscp
 		{
 			return hash.data;
 		}
+
+		scratch_type build_contact_cleartext(const contact_map_type& contact_map)
+		{
+			scratch_type cleartext;
+			cleartext.resize(contact_map.size() * 49);
+
+			scratch_type::iterator ptr = cleartext.begin();
+
+			for (contact_map_type::const_iterator it = contact_map.begin(); it != contact_map.end(); ++it)
+			{
+				// We copy the hash
+				ptr = std::copy(it->first.data.begin(), it->first.data.end(), ptr);
+
+				if (it->second.address().is_v4())
+				{
+					*(ptr++) = static_cast<uint8_t>(ENDPOINT_TYPE_IPV4);
+
+					boost::asio::ip::address_v4::bytes_type bytes = it->second.address().to_v4().to_bytes();
+
+					ptr = std::copy(bytes.begin(), bytes.end(), ptr);
+
+					*(reinterpret_cast<uint16_t*>(&*ptr)) = htons(it->second.port());
+
+					ptr += sizeof(uint16_t);
+				}
+				else if (it->second.address().is_v6())
+				{
+					*(ptr++) = static_cast<uint8_t>(ENDPOINT_TYPE_IPV6);
+
+					boost::asio::ip::address_v6::bytes_type bytes = it->second.address().to_v6().to_bytes();
+
+					ptr = std::copy(bytes.begin(), bytes.end(), ptr);
+
+					*(reinterpret_cast<uint16_t*>(&*ptr)) = htons(it->second.port());
+
+					ptr += sizeof(uint16_t);
+				}
+			}
+
+			cleartext.resize(std::distance(cleartext.begin(), ptr));
+
+			return cleartext;
+		}
+
+		scratch_type frame_cleartext(const void* _cleartext, size_t cleartext_len)
+		{
+			static metrics_registry::counter& tx_raw_bytes_counter = metrics_registry::get_default_instance().get_counter("fscp.compression.tx_raw_bytes");
+			static metrics_registry::counter& tx_wire_bytes_counter = metrics_registry::get_default_instance().get_counter("fscp.compression.tx_wire_bytes");
+
+			const uint8_t* const cleartext = static_cast<const uint8_t*>(_cleartext);
+
+			scratch_type framed;
+
+			if ((cleartext_len >= COMPRESSION_THRESHOLD) && (cleartext_len <= 65535))
+			{
+				// The compressor gets just under the raw-frame size as capacity: incompressible input escapes as soon as the output stops paying for itself.
+				framed.resize(1 + sizeof(uint16_t) + (cleartext_len - sizeof(uint16_t) - 1));
+
+				const size_t compressed_len = lz4_compress(cleartext, cleartext_len, &framed[1 + sizeof(uint16_t)], cleartext_len - sizeof(uint16_t) - 1);
+
+				if (compressed_len > 0)
+				{
+					framed[0] = data_message::DATA_FRAME_LZ4;
+					buffer_tools::set<uint16_t>(&framed[0], 1, htons(static_cast<uint16_t>(cleartext_len)));
+					framed.resize(1 + sizeof(uint16_t) + compressed_len);
+
+					tx_raw_bytes_counter.increment(cleartext_len);
+					tx_wire_bytes_counter.increment(framed.size());
+
+					return framed;
+				}
+			}
+
+			// The raw escape: incompressible or small payloads cost a single marker byte.
+			framed.resize(1 + cleartext_len);
+			framed[0] = data_message::DATA_FRAME_RAW;
+			std::memcpy(&framed[1], cleartext, cleartext_len);
+
+			tx_raw_bytes_counter.increment(cleartext_len);
+			tx_wire_bytes_counter.increment(framed.size());
+
+			return framed;
+		}
 	}
 
 	using boost::make_transform_iterator;
 
-	size_t data_message::write(void* buf, size_t buf_len, channel_number_type channel_number, sequence_number_type _sequence_number, data_message::calg_t cipher_algorithm, const void* _cleartext, size_t cleartext_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len)
+	size_t data_message::write(void* buf, size_t buf_len, channel_number_type channel_number, sequence_number_type _sequence_number, data_message::calg_t cipher_algorithm, const void* _cleartext, size_t cleartext_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, compression_algorithm_type compression)
 	{
+		if (compression == compression_algorithm_type::lz4)
+		{
+			const scratch_type framed = frame_cleartext(_cleartext, cleartext_len);
+
+			return raw_write(buf, buf_len, _sequence_number, cipher_algorithm, &framed[0], framed.size(), enc_key, enc_key_len, nonce_prefix, nonce_prefix_len, to_data_message_type(channel_number));
+		}
+
 		return raw_write(buf, buf_len, _sequence_number, cipher_algorithm, _cleartext, cleartext_len, enc_key, enc_key_len, nonce_prefix, nonce_prefix_len, to_data_message_type(channel_number));
 	}
 
+	size_t data_message::write(void* buf, size_t buf_len, channel_number_type channel_number, sequence_number_type _sequence_number, cryptoplus::cipher::cipher_context& cipher_context, const void* _cleartext, size_t cleartext_len, const void* nonce_prefix, size_t nonce_prefix_len, compression_algorithm_type compression)
+	{
+		if (compression == compression_algorithm_type::lz4)
+		{
+			const scratch_type framed = frame_cleartext(_cleartext, cleartext_len);
+
+			return raw_write(buf, buf_len, _sequence_number, cipher_context, &framed[0], framed.size(), nonce_prefix, nonce_prefix_len, to_data_message_type(channel_number));
+		}
+
+		return raw_write(buf, buf_len, _sequence_number, cipher_context, _cleartext, cleartext_len, nonce_prefix, nonce_prefix_len, to_data_message_type(channel_number));
+	}
+
 	size_t data_message::write_keep_alive(void* buf, size_t buf_len, sequence_number_type _sequence_number, data_message::calg_t cipher_algorithm, size_t random_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len)
 	{
 		const cryptoplus::buffer random = cryptoplus::random::get_random_bytes(random_len);
@@ -89,54 +199,39 @@ namespace fscp
 		return raw_write(buf, buf_len, _sequence_number, cipher_algorithm, cryptoplus::buffer_cast<const uint8_t*>(random), cryptoplus::buffer_size(random), enc_key, enc_key_len, nonce_prefix, nonce_prefix_len, MESSAGE_TYPE_KEEP_ALIVE);
 	}
 
-	size_t data_message::write_contact_request(void* buf, size_t buf_len, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, const hash_list_type& hash_list, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len)
+	size_t data_message::write_keep_alive(void* buf, size_t buf_len, sequence_number_type _sequence_number, cryptoplus::cipher::cipher_context& cipher_context, size_t random_len, const void* nonce_prefix, size_t nonce_prefix_len)
 	{
-		const std::vector<hash_type::data_type> hash_vec(make_transform_iterator(hash_list.begin(), hash_to_data), make_transform_iterator(hash_list.end(), hash_to_data));
+		const cryptoplus::buffer random = cryptoplus::random::get_random_bytes(random_len);
 
-		return raw_write(buf, buf_len, sequence_number, cipher_algorithm, reinterpret_cast<const char*>(&hash_vec[0]), hash_vec.size() * hash_type::data_type::static_size, enc_key, enc_key_len, nonce_prefix, nonce_prefix_len, MESSAGE_TYPE_CONTACT_REQUEST);
+		return raw_write(buf, buf_len, _sequence_number, cipher_context, cryptoplus::buffer_cast<const uint8_t*>(random), cryptoplus::buffer_size(random), nonce_prefix, nonce_prefix_len, MESSAGE_TYPE_KEEP_ALIVE);
 	}
 
-	size_t data_message::write_contact(void* buf, size_t buf_len, sequence_number_type _sequence_number, data_message::calg_t cipher_algorithm, const contact_map_type& contact_map, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len)
+	size_t data_message::write_contact_request(void* buf, size_t buf_len, sequence_number_type sequence_number, data_message::calg_t cipher_algorithm, const hash_list_type& hash_list, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len)
 	{
-		std::vector<uint8_t> cleartext;
-		cleartext.resize(contact_map.size() * 49);
-
-		std::vector<uint8_t>::iterator ptr = cleartext.begin();
-
-		for (contact_map_type::const_iterator it = contact_map.begin(); it != contact_map.end(); ++it)
-		{
-			// We copy the hash
-			ptr = std::copy(it->first.data.begin(), it->first.data.end(), ptr);
-
-			if (it->second.address().is_v4())
-			{
-				*(ptr++) = static_cast<uint8_t>(ENDPOINT_TYPE_IPV4);
-
-				boost::asio::ip::address_v4::bytes_type bytes = it->second.address().to_v4().to_bytes();
-
-				ptr = std::copy(bytes.begin(), bytes.end(), ptr);
-
-				*(reinterpret_cast<uint16_t*>(&*ptr)) = htons(it->second.port());
+		const std::vector<hash_type::data_type, cryptoplus::accounting_allocator<hash_type::data_type, cryptoplus::allocation_stats::ALLOCATION_TAG_MESSAGE> > hash_vec(make_transform_iterator(hash_list.begin(), hash_to_data), make_transform_iterator(hash_list.end(), hash_to_data));
 
-				ptr += sizeof(uint16_t);
-			}
-			else if (it->second.address().is_v6())
-			{
-				*(ptr++) = static_cast<uint8_t>(ENDPOINT_TYPE_IPV6);
+		return raw_write(buf, buf_len, sequence_number, cipher_algorithm, reinterpret_cast<const char*>(&hash_vec[0]), hash_vec.size() * hash_type::data_type::static_size, enc_key, enc_key_len, nonce_prefix, nonce_prefix_len, MESSAGE_TYPE_CONTACT_REQUEST);
+	}
 
-				boost::asio::ip::address_v6::bytes_type bytes = it->second.address().to_v6().to_bytes();
+	size_t data_message::write_contact_request(void* buf, size_t buf_len, sequence_number_type sequence_number, cryptoplus::cipher::cipher_context& cipher_context, const hash_list_type& hash_list, const void* nonce_prefix, size_t nonce_prefix_len)
+	{
+		const std::vector<hash_type::data_type, cryptoplus::accounting_allocator<hash_type::data_type, cryptoplus::allocation_stats::ALLOCATION_TAG_MESSAGE> > hash_vec(make_transform_iterator(hash_list.begin(), hash_to_data), make_transform_iterator(hash_list.end(), hash_to_data));
 
-				ptr = std::copy(bytes.begin(), bytes.end(), ptr);
+		return raw_write(buf, buf_len, sequence_number, cipher_context, reinterpret_cast<const char*>(&hash_vec[0]), hash_vec.size() * hash_type::data_type::static_size, nonce_prefix, nonce_prefix_len, MESSAGE_TYPE_CONTACT_REQUEST);
+	}
 
-				*(reinterpret_cast<uint16_t*>(&*ptr)) = htons(it->second.port());
+	size_t data_message::write_contact(void* buf, size_t buf_len, sequence_number_type _sequence_number, data_message::calg_t cipher_algorithm, const contact_map_type& contact_map, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len)
+	{
+		scratch_type cleartext = build_contact_cleartext(contact_map);
 
-				ptr += sizeof(uint16_t);
-			}
-		}
+		return raw_write(buf, buf_len, _sequence_number, cipher_algorithm, &cleartext[0], cleartext.size(), enc_key, enc_key_len, nonce_prefix, nonce_prefix_len, MESSAGE_TYPE_CONTACT);
+	}
 
-		cleartext.resize(std::distance(cleartext.begin(), ptr));
+	size_t data_message::write_contact(void* buf, size_t buf_len, sequence_number_type _sequence_number, cryptoplus::cipher::cipher_context& cipher_context, const contact_map_type& contact_map, const void* nonce_prefix, size_t nonce_prefix_len)
+	{
+		scratch_type cleartext = build_contact_cleartext(contact_map);
 
-		return raw_write(buf, buf_len, _sequence_number, cipher_algorithm, &cleartext[0], cleartext.size(), enc_key, enc_key_len, nonce_prefix, nonce_prefix_len, MESSAGE_TYPE_CONTACT);
+		return raw_write(buf, buf_len, _sequence_number, cipher_context, &cleartext[0], cleartext.size(), nonce_prefix, nonce_prefix_len, MESSAGE_TYPE_CONTACT);
 	}
 
 	hash_list_type data_message::parse_hash_list(const void* buf, size_t buflen)
@@ -258,6 +353,33 @@ namespace fscp
 		}
 	}
 
+	size_t data_message::uncompress_cleartext(void* dst, size_t dst_capacity, const void* _framed, size_t framed_len)
+	{
+		const uint8_t* const framed = static_cast<const uint8_t*>(_framed);
+
+		if ((framed_len < 1 + sizeof(uint16_t) + 1) || (framed[0] != DATA_FRAME_LZ4))
+		{
+			throw std::runtime_error("Invalid message structure");
+		}
+
+		const size_t raw_len = ntohs(buffer_tools::get<uint16_t>(framed, 1));
+
+		if (raw_len > dst_capacity)
+		{
+			throw std::runtime_error("Invalid message structure");
+		}
+
+		// The destination capacity is clamped to the announced size: a block that decompresses to anything else is malformed.
+		const size_t count = lz4_decompress(framed + 1 + sizeof(uint16_t), framed_len - 1 - sizeof(uint16_t), dst, raw_len);
+
+		if (count != raw_len)
+		{
+			throw std::runtime_error("Invalid message structure");
+		}
+
+		return count;
+	}
+
 	size_t data_message::get_cleartext(void* buf, size_t buf_len, data_message::calg_t cipher_algorithm, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len) const
 	{
 		assert(enc_key);
@@ -266,14 +388,14 @@ namespace fscp
 		{
 			const iv_type iv = compute_iv(nonce_prefix, nonce_prefix_len, sequence_number());
 
-			cryptoplus::cipher::cipher_context cipher_context;
+			// The thread-local context keeps its EVP allocation and algorithm setup across calls: only the GCM attributes, the key and the IV are set per message.
+			cryptoplus::cipher::cipher_context& cipher_context = cryptoplus::cipher::cipher_context::thread_local_context(cipher_algorithm, cryptoplus::cipher::cipher_context::decrypt);
 
-			// First initialization - required to set GCM specific attributes
-			cipher_context.initialize(cipher_algorithm, cryptoplus::cipher::cipher_context::decrypt, NULL, 0, NULL);
 			cipher_context.ctrl_set(EVP_CTRL_GCM_SET_IVLEN, static_cast<int>(iv.size()));
 			cipher_context.ctrl(EVP_CTRL_GCM_SET_TAG, static_cast<int>(tag_size()), const_cast<uint8_t*>(tag()));
 
-			cipher_context.initialize(data_message::calg_t(), cryptoplus::cipher::cipher_context::unchanged, enc_key, enc_key_len, iv.data());
+			// A selected hardware engine is only engaged above its size threshold: small messages are not worth its per-request cost.
+			cipher_context.initialize(data_message::calg_t(), cryptoplus::cipher::cipher_context::unchanged, enc_key, enc_key_len, iv.data(), cryptoplus::engine::for_size(ciphertext_size()));
 
 			size_t cnt = cipher_context.update(buf, buf_len, ciphertext(), ciphertext_size());
 
@@ -287,6 +409,52 @@ namespace fscp
 		}
 	}
 
+	size_t data_message::get_cleartext(void* buf, size_t buf_len, cryptoplus::cipher::cipher_context& cipher_context, const void* nonce_prefix, size_t nonce_prefix_len) const
+	{
+		if (buf)
+		{
+			const iv_type iv = compute_iv(nonce_prefix, nonce_prefix_len, sequence_number());
+
+			// The context already holds the key schedule: only the tag and the IV change from one packet to the next.
+			cipher_context.ctrl(EVP_CTRL_GCM_SET_TAG, static_cast<int>(tag_size()), const_cast<uint8_t*>(tag()));
+			cipher_context.set_iv(iv.data());
+
+			size_t cnt = cipher_context.update(buf, buf_len, ciphertext(), ciphertext_size());
+
+			cnt += cipher_context.finalize(static_cast<uint8_t*>(buf) + cnt, buf_len - cnt);
+
+			return cnt;
+		}
+		else
+		{
+			return ciphertext_size();
+		}
+	}
+
+	size_t data_message::open_in_place(void* buf, size_t buf_len, cryptoplus::cipher::cipher_context& cipher_context, const void* nonce_prefix, size_t nonce_prefix_len) const
+	{
+		assert(static_cast<const void*>(buf) == static_cast<const void*>(data()));
+
+		if (buf_len < size())
+		{
+			throw std::runtime_error("buf_len");
+		}
+
+		uint8_t* const cleartext = static_cast<uint8_t*>(buf) + DATA_PAYLOAD_OFFSET;
+
+		const iv_type iv = compute_iv(nonce_prefix, nonce_prefix_len, sequence_number());
+
+		// The context already holds the key schedule: only the tag and the IV change from one packet to the next.
+		cipher_context.ctrl(EVP_CTRL_GCM_SET_TAG, static_cast<int>(tag_size()), const_cast<uint8_t*>(tag()));
+		cipher_context.set_iv(iv.data());
+
+		size_t cnt = cipher_context.update(cleartext, buf_len - DATA_PAYLOAD_OFFSET, ciphertext(), ciphertext_size());
+
+		cnt += cipher_context.finalize(cleartext + cnt, buf_len - DATA_PAYLOAD_OFFSET - cnt);
+
+		return cnt;
+	}
+
 	size_t data_message::raw_write(void* buf, size_t buf_len, sequence_number_type _sequence_number, data_message::calg_t cipher_algorithm, const void* _cleartext, size_t cleartext_len, const void* enc_key, size_t enc_key_len, const void* nonce_prefix, size_t nonce_prefix_len, message_type type)
 	{
 		assert(enc_key);
@@ -304,13 +472,49 @@ namespace fscp
 
 		buffer_tools::set<sequence_number_type>(payload, 0, htonl(_sequence_number));
 
-		cryptoplus::cipher::cipher_context cipher_context;
+		// The thread-local context keeps its EVP allocation and algorithm setup across calls: only the GCM attributes, the key and the IV are set per message.
+		cryptoplus::cipher::cipher_context& cipher_context = cryptoplus::cipher::cipher_context::thread_local_context(cipher_algorithm, cryptoplus::cipher::cipher_context::encrypt);
 
-		// First initialization - required to set GCM specific attributes
-		cipher_context.initialize(cipher_algorithm, cryptoplus::cipher::cipher_context::encrypt, NULL, 0, NULL);
 		cipher_context.ctrl_set(EVP_CTRL_GCM_SET_IVLEN, static_cast<int>(iv.size()));
 
-		cipher_context.initialize(data_message::calg_t(), cryptoplus::cipher::cipher_context::unchanged, enc_key, enc_key_len, iv.data());
+		// A selected hardware engine is only engaged above its size threshold: small messages are not worth its per-request cost.
+		cipher_context.initialize(data_message::calg_t(), cryptoplus::cipher::cipher_context::unchanged, enc_key, enc_key_len, iv.data(), cryptoplus::engine::for_size(cleartext_len));
+
+		const size_t max_ciphertext_len = buf_len - HEADER_LENGTH - sizeof(sequence_number_type) - GCM_TAG_LENGTH - sizeof(uint16_t) - cipher_algorithm.block_size();
+
+		const cryptoplus::buffer cleartext(_cleartext, cleartext_len);
+
+		size_t ciphertext_len = cipher_context.update(ciphertext, max_ciphertext_len, cleartext);
+		ciphertext_len += cipher_context.finalize(ciphertext + ciphertext_len, max_ciphertext_len - ciphertext_len);
+
+		cipher_context.ctrl(EVP_CTRL_GCM_GET_TAG, GCM_TAG_LENGTH, tag);
+
+		buffer_tools::set<uint16_t>(payload, sizeof(sequence_number_type) + GCM_TAG_LENGTH, htons(static_cast<uint16_t>(ciphertext_len)));
+
+		const size_t length = sizeof(sequence_number_type) + GCM_TAG_LENGTH + sizeof(uint16_t) + ciphertext_len;
+
+		return message::write(buf, buf_len, CURRENT_PROTOCOL_VERSION, type, length) + length;
+	}
+
+	size_t data_message::raw_write(void* buf, size_t buf_len, sequence_number_type _sequence_number, cryptoplus::cipher::cipher_context& cipher_context, const void* _cleartext, size_t cleartext_len, const void* nonce_prefix, size_t nonce_prefix_len, message_type type)
+	{
+		const iv_type iv = compute_iv(nonce_prefix, nonce_prefix_len, _sequence_number);
+
+		const data_message::calg_t cipher_algorithm = cipher_context.algorithm();
+
+		if (buf_len < HEADER_LENGTH + sizeof(sequence_number_type) + GCM_TAG_LENGTH + sizeof(uint16_t) + (cleartext_len + cipher_algorithm.block_size()))
+		{
+			throw std::runtime_error("buf_len");
+		}
+
+		uint8_t* const payload = static_cast<uint8_t*>(buf) + HEADER_LENGTH;
+		uint8_t* const tag = payload + sizeof(sequence_number_type);
+		uint8_t* const ciphertext = tag + GCM_TAG_LENGTH + sizeof(uint16_t);
+
+		buffer_tools::set<sequence_number_type>(payload, 0, htonl(_sequence_number));
+
+		// The context already holds the key schedule: only the IV changes from one packet to the next.
+		cipher_context.set_iv(iv.data());
 
 		const size_t max_ciphertext_len = buf_len - HEADER_LENGTH - sizeof(sequence_number_type) - GCM_TAG_LENGTH - sizeof(uint16_t) - cipher_algorithm.block_size();
 
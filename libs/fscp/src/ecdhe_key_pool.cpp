@@ -0,0 +1,111 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file ecdhe_key_pool.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A pool of precomputed ephemeral ECDHE keys.
+ */
+
+#include "ecdhe_key_pool.hpp"
+
+#include <boost/bind.hpp>
+
+namespace fscp
+{
+	ecdhe_key_pool::ecdhe_context_ptr ecdhe_key_pool::acquire(elliptic_curve_type curve)
+	{
+		const int nid = curve.to_elliptic_curve_nid();
+
+		ecdhe_context_ptr result;
+
+		if (m_keys_per_curve > 0)
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			std::vector<ecdhe_context_ptr>& keys = m_keys[nid];
+
+			if (!keys.empty())
+			{
+				result = keys.back();
+				keys.pop_back();
+			}
+
+			if ((keys.size() < m_keys_per_curve) && !m_refill_pending[nid])
+			{
+				m_refill_pending[nid] = true;
+
+				m_io_service.post(boost::bind(&ecdhe_key_pool::refill, this, nid));
+			}
+		}
+
+		if (!result)
+		{
+			// The pool is empty (or disabled): generate the key pair inline, exactly like the direct generation used to.
+			result = boost::make_shared<cryptoplus::pkey::ecdhe_context>(nid);
+			result->generate_keys();
+		}
+
+		return result;
+	}
+
+	void ecdhe_key_pool::refill(int nid)
+	{
+		while (true)
+		{
+			{
+				boost::mutex::scoped_lock lock(m_mutex);
+
+				if (m_keys[nid].size() >= m_keys_per_curve)
+				{
+					m_refill_pending[nid] = false;
+
+					return;
+				}
+			}
+
+			// The generation is done outside of the lock so acquire() never waits on a key generation.
+			const ecdhe_context_ptr key = boost::make_shared<cryptoplus::pkey::ecdhe_context>(nid);
+			key->generate_keys();
+
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			m_keys[nid].push_back(key);
+		}
+	}
+}
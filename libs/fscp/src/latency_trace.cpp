@@ -0,0 +1,87 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+
+/**
+ * \file latency_trace.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A cheap sampled latency tracer for the packet paths.
+ */
+
+#include "latency_trace.hpp"
+
+#include <chrono>
+
+#include <boost/thread/tss.hpp>
+
+namespace fscp
+{
+	boost::atomic<bool> latency_trace::s_enabled(false);
+
+	uint64_t latency_trace::now()
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	uint64_t latency_trace::sample_start()
+	{
+		if (!enabled())
+		{
+			return 0;
+		}
+
+		// Every thread keeps its own sampling counter, so the fast path never touches a shared cache line.
+		static boost::thread_specific_ptr<unsigned int> thread_counter;
+
+		unsigned int* counter = thread_counter.get();
+
+		if (!counter)
+		{
+			counter = new unsigned int(0);
+
+			thread_counter.reset(counter);
+		}
+
+		if (++(*counter) % SAMPLE_INTERVAL != 0)
+		{
+			return 0;
+		}
+
+		return now();
+	}
+}
@@ -0,0 +1,143 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file log_ring_buffer.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A lock-free ring buffer log sink.
+ */
+
+#include "log_ring_buffer.hpp"
+
+#include <algorithm>
+
+namespace fscp
+{
+	log_ring_buffer::log_ring_buffer(size_t capacity) :
+		m_records(),
+		m_mask(0),
+		m_head(0),
+		m_tail(0),
+		m_dropped(0)
+	{
+		size_t real_capacity = 1;
+
+		while (real_capacity < capacity)
+		{
+			real_capacity <<= 1;
+		}
+
+		m_records.reset(new record_type[real_capacity]);
+		m_mask = real_capacity - 1;
+
+		for (size_t i = 0; i < real_capacity; ++i)
+		{
+			m_records[i].sequence.store(i, boost::memory_order_relaxed);
+		}
+	}
+
+	void log_ring_buffer::push(log_level level, const std::string& msg, const logger::timestamp_type& timestamp)
+	{
+		// Bounded multi-producer queue: a producer owns the slot whose sequence number matches its claimed position.
+		size_t pos = m_head.load(boost::memory_order_relaxed);
+
+		for (;;)
+		{
+			record_type& record = m_records[pos & m_mask];
+			const size_t sequence = record.sequence.load(boost::memory_order_acquire);
+			const ptrdiff_t difference = static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(pos);
+
+			if (difference == 0)
+			{
+				if (m_head.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed))
+				{
+					record.level = level;
+					record.timestamp = timestamp;
+					record.size = std::min(msg.size(), MAX_MESSAGE_SIZE);
+					std::memcpy(record.message, msg.data(), record.size);
+
+					record.sequence.store(pos + 1, boost::memory_order_release);
+
+					return;
+				}
+			}
+			else if (difference < 0)
+			{
+				// The consumer has not freed this slot yet: the buffer is full.
+				m_dropped.fetch_add(1, boost::memory_order_relaxed);
+
+				return;
+			}
+			else
+			{
+				// Another producer claimed this position: retry at the new head.
+				pos = m_head.load(boost::memory_order_relaxed);
+			}
+		}
+	}
+
+	size_t log_ring_buffer::flush(const logger::log_handler_type& handler)
+	{
+		size_t count = 0;
+
+		for (;;)
+		{
+			record_type& record = m_records[m_tail & m_mask];
+			const size_t sequence = record.sequence.load(boost::memory_order_acquire);
+
+			if (sequence != m_tail + 1)
+			{
+				// The next record is not published yet.
+				break;
+			}
+
+			if (handler)
+			{
+				handler(record.level, std::string(record.message, record.size), record.timestamp);
+			}
+
+			// Free the slot for the producers, one lap ahead.
+			record.sequence.store(m_tail + m_mask + 1, boost::memory_order_release);
+
+			++m_tail;
+			++count;
+		}
+
+		return count;
+	}
+}
@@ -0,0 +1,334 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file lz4.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A minimal LZ4 block codec.
+ *
+ * This is a small, self-contained implementation of the LZ4 block format
+ * (https://lz4.github.io/lz4/), tuned for the datagram-sized payloads the
+ * library handles: a greedy single-pass match finder with a 4 KB hash table,
+ * and a bounds-checked decompressor that never reads or writes outside the
+ * given buffers.
+ */
+
+#include "lz4.hpp"
+
+#include <cstring>
+
+namespace fscp
+{
+	namespace
+	{
+		const size_t MIN_MATCH = 4;
+
+		// Per the block format: the last 5 bytes are always literals and the last match must not start within the last 12 bytes.
+		const size_t LAST_LITERALS = 5;
+		const size_t MF_LIMIT = 12;
+
+		const size_t MAX_OFFSET = 65535;
+		const size_t HASH_TABLE_SIZE = 4096;
+
+		uint32_t read32(const uint8_t* ptr)
+		{
+			uint32_t value;
+
+			std::memcpy(&value, ptr, sizeof(value));
+
+			return value;
+		}
+
+		uint32_t hash_sequence(uint32_t sequence)
+		{
+			// Fibonacci hashing: the top 12 bits of the product index the table.
+			return (sequence * 2654435761U) >> 20;
+		}
+	}
+
+	size_t lz4_compress(const void* _src, size_t src_len, void* _dst, size_t dst_capacity)
+	{
+		const uint8_t* const src = static_cast<const uint8_t*>(_src);
+		uint8_t* const dst = static_cast<uint8_t*>(_dst);
+
+		if (src_len == 0)
+		{
+			return 0;
+		}
+
+		const uint8_t* ip = src;
+		const uint8_t* anchor = src;
+		const uint8_t* const src_end = src + src_len;
+		const uint8_t* const match_limit = src_end - LAST_LITERALS;
+		const uint8_t* const mf_limit = (src_len > MF_LIMIT) ? src_end - MF_LIMIT : src;
+
+		uint8_t* op = dst;
+		uint8_t* const dst_end = dst + dst_capacity;
+
+		// The table maps a hashed 4-byte sequence to its last position, stored as position + 1 so that 0 means empty.
+		uint32_t table[HASH_TABLE_SIZE] = { 0 };
+
+		while (ip < mf_limit)
+		{
+			const uint32_t sequence = read32(ip);
+			const uint32_t hash = hash_sequence(sequence);
+			const uint32_t candidate = table[hash];
+			const uint32_t position = static_cast<uint32_t>(ip - src);
+
+			table[hash] = position + 1;
+
+			if ((candidate == 0) || (position + 1 - candidate > MAX_OFFSET) || (read32(src + candidate - 1) != sequence))
+			{
+				++ip;
+
+				continue;
+			}
+
+			const uint8_t* const match = src + candidate - 1;
+
+			// Extend the match forward, stopping before the mandatory trailing literals.
+			const uint8_t* mip = ip + MIN_MATCH;
+			const uint8_t* mref = match + MIN_MATCH;
+
+			while ((mip < match_limit) && (*mip == *mref))
+			{
+				++mip;
+				++mref;
+			}
+
+			const size_t match_length = mip - ip - MIN_MATCH;
+			const size_t literal_length = ip - anchor;
+
+			// Worst-case size of this sequence: token, length extensions, literals and offset.
+			if (static_cast<size_t>(dst_end - op) < 1 + literal_length / 255 + 1 + literal_length + 2 + match_length / 255 + 1)
+			{
+				return 0;
+			}
+
+			uint8_t* const token = op++;
+
+			if (literal_length >= 15)
+			{
+				*token = 15 << 4;
+
+				size_t remaining = literal_length - 15;
+
+				for (; remaining >= 255; remaining -= 255)
+				{
+					*op++ = 255;
+				}
+
+				*op++ = static_cast<uint8_t>(remaining);
+			}
+			else
+			{
+				*token = static_cast<uint8_t>(literal_length << 4);
+			}
+
+			std::memcpy(op, anchor, literal_length);
+			op += literal_length;
+
+			const size_t offset = ip - match;
+
+			*op++ = static_cast<uint8_t>(offset & 0xFF);
+			*op++ = static_cast<uint8_t>(offset >> 8);
+
+			if (match_length >= 15)
+			{
+				*token |= 15;
+
+				size_t remaining = match_length - 15;
+
+				for (; remaining >= 255; remaining -= 255)
+				{
+					*op++ = 255;
+				}
+
+				*op++ = static_cast<uint8_t>(remaining);
+			}
+			else
+			{
+				*token |= static_cast<uint8_t>(match_length);
+			}
+
+			ip = mip;
+			anchor = ip;
+		}
+
+		// The remaining input is emitted as the trailing literal run.
+		const size_t literal_length = src_end - anchor;
+
+		if (static_cast<size_t>(dst_end - op) < 1 + literal_length / 255 + 1 + literal_length)
+		{
+			return 0;
+		}
+
+		uint8_t* const token = op++;
+
+		if (literal_length >= 15)
+		{
+			*token = 15 << 4;
+
+			size_t remaining = literal_length - 15;
+
+			for (; remaining >= 255; remaining -= 255)
+			{
+				*op++ = 255;
+			}
+
+			*op++ = static_cast<uint8_t>(remaining);
+		}
+		else
+		{
+			*token = static_cast<uint8_t>(literal_length << 4);
+		}
+
+		std::memcpy(op, anchor, literal_length);
+		op += literal_length;
+
+		return op - dst;
+	}
+
+	size_t lz4_decompress(const void* _src, size_t src_len, void* _dst, size_t dst_capacity)
+	{
+		const uint8_t* ip = static_cast<const uint8_t*>(_src);
+		const uint8_t* const src_end = ip + src_len;
+		uint8_t* const dst = static_cast<uint8_t*>(_dst);
+		uint8_t* op = dst;
+		uint8_t* const dst_end = dst + dst_capacity;
+
+		if (src_len == 0)
+		{
+			return 0;
+		}
+
+		for (;;)
+		{
+			if (ip >= src_end)
+			{
+				return 0;
+			}
+
+			const uint8_t token = *ip++;
+
+			size_t literal_length = token >> 4;
+
+			if (literal_length == 15)
+			{
+				uint8_t extension;
+
+				do
+				{
+					if (ip >= src_end)
+					{
+						return 0;
+					}
+
+					extension = *ip++;
+					literal_length += extension;
+				}
+				while (extension == 255);
+			}
+
+			if ((static_cast<size_t>(src_end - ip) < literal_length) || (static_cast<size_t>(dst_end - op) < literal_length))
+			{
+				return 0;
+			}
+
+			std::memcpy(op, ip, literal_length);
+			op += literal_length;
+			ip += literal_length;
+
+			if (ip == src_end)
+			{
+				// The last sequence carries literals only.
+				break;
+			}
+
+			if (src_end - ip < 2)
+			{
+				return 0;
+			}
+
+			const size_t offset = static_cast<size_t>(ip[0]) | (static_cast<size_t>(ip[1]) << 8);
+
+			ip += 2;
+
+			if ((offset == 0) || (offset > static_cast<size_t>(op - dst)))
+			{
+				return 0;
+			}
+
+			size_t match_length = token & 0x0F;
+
+			if (match_length == 15)
+			{
+				uint8_t extension;
+
+				do
+				{
+					if (ip >= src_end)
+					{
+						return 0;
+					}
+
+					extension = *ip++;
+					match_length += extension;
+				}
+				while (extension == 255);
+			}
+
+			match_length += MIN_MATCH;
+
+			if (static_cast<size_t>(dst_end - op) < match_length)
+			{
+				return 0;
+			}
+
+			// A byte-by-byte copy handles the overlapping case (offset < match_length), which replicates the pattern.
+			const uint8_t* match = op - offset;
+
+			for (size_t i = 0; i < match_length; ++i)
+			{
+				*op++ = *match++;
+			}
+		}
+
+		return op - dst;
+	}
+}
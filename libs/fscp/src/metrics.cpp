@@ -0,0 +1,209 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+
+/**
+ * \file metrics.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A lock-free runtime metrics registry.
+ */
+
+#include "metrics.hpp"
+
+#include <boost/thread/tss.hpp>
+
+namespace fscp
+{
+	metrics_registry::counter::counter()
+	{
+		for (size_t i = 0; i < SHARD_COUNT; ++i)
+		{
+			m_shards[i].value.store(0, boost::memory_order_relaxed);
+		}
+	}
+
+	uint64_t metrics_registry::counter::value() const
+	{
+		uint64_t result = 0;
+
+		for (size_t i = 0; i < SHARD_COUNT; ++i)
+		{
+			result += m_shards[i].value.load(boost::memory_order_relaxed);
+		}
+
+		return result;
+	}
+
+	metrics_registry::histogram::histogram()
+	{
+		for (size_t i = 0; i < SHARD_COUNT; ++i)
+		{
+			m_shards[i].count.store(0, boost::memory_order_relaxed);
+			m_shards[i].sum.store(0, boost::memory_order_relaxed);
+
+			for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket)
+			{
+				m_shards[i].buckets[bucket].store(0, boost::memory_order_relaxed);
+			}
+		}
+	}
+
+	void metrics_registry::histogram::record(uint64_t value)
+	{
+		size_t bucket = 0;
+
+		for (uint64_t remainder = value >> 1; remainder != 0; remainder >>= 1)
+		{
+			bucket++;
+		}
+
+		if (bucket >= BUCKET_COUNT)
+		{
+			bucket = BUCKET_COUNT - 1;
+		}
+
+		shard_type& shard = m_shards[shard_index()];
+
+		shard.count.fetch_add(1, boost::memory_order_relaxed);
+		shard.sum.fetch_add(value, boost::memory_order_relaxed);
+		shard.buckets[bucket].fetch_add(1, boost::memory_order_relaxed);
+	}
+
+	metrics_registry::histogram::sample_type metrics_registry::histogram::sample() const
+	{
+		sample_type result;
+
+		result.count = 0;
+		result.sum = 0;
+		result.buckets.assign(0);
+
+		for (size_t i = 0; i < SHARD_COUNT; ++i)
+		{
+			result.count += m_shards[i].count.load(boost::memory_order_relaxed);
+			result.sum += m_shards[i].sum.load(boost::memory_order_relaxed);
+
+			for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket)
+			{
+				result.buckets[bucket] += m_shards[i].buckets[bucket].load(boost::memory_order_relaxed);
+			}
+		}
+
+		return result;
+	}
+
+	metrics_registry& metrics_registry::get_default_instance()
+	{
+		static metrics_registry instance;
+
+		return instance;
+	}
+
+	metrics_registry::counter& metrics_registry::get_counter(const std::string& name)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		boost::shared_ptr<counter>& entry = m_counters[name];
+
+		if (!entry)
+		{
+			entry.reset(new counter());
+		}
+
+		return *entry;
+	}
+
+	metrics_registry::histogram& metrics_registry::get_histogram(const std::string& name)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		boost::shared_ptr<histogram>& entry = m_histograms[name];
+
+		if (!entry)
+		{
+			entry.reset(new histogram());
+		}
+
+		return *entry;
+	}
+
+	std::map<std::string, uint64_t> metrics_registry::counter_values() const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		std::map<std::string, uint64_t> result;
+
+		for (counter_map_type::const_iterator item = m_counters.begin(); item != m_counters.end(); ++item)
+		{
+			result[item->first] = item->second->value();
+		}
+
+		return result;
+	}
+
+	std::map<std::string, metrics_registry::histogram::sample_type> metrics_registry::histogram_values() const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		std::map<std::string, histogram::sample_type> result;
+
+		for (histogram_map_type::const_iterator item = m_histograms.begin(); item != m_histograms.end(); ++item)
+		{
+			result[item->first] = item->second->sample();
+		}
+
+		return result;
+	}
+
+	size_t metrics_registry::shard_index()
+	{
+		// Every thread gets its own shard, assigned on its first recording. Should more threads than shards show up, some of them share a slot, which only costs some cache-line contention.
+		static boost::thread_specific_ptr<size_t> thread_index;
+		static boost::atomic<size_t> next_index(0);
+
+		size_t* index = thread_index.get();
+
+		if (!index)
+		{
+			index = new size_t(next_index.fetch_add(1, boost::memory_order_relaxed) % SHARD_COUNT);
+
+			thread_index.reset(index);
+		}
+
+		return *index;
+	}
+}
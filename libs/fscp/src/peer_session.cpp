@@ -46,6 +46,9 @@
 
 #include <cryptoplus/tls/tls.hpp>
 
+#include <algorithm>
+#include <vector>
+
 namespace fscp
 {
 	bool peer_session::current_session_type::is_old() const
@@ -66,46 +69,127 @@ namespace fscp
 		return (_host_identifier == *m_remote_host_identifier);
 	}
 
-	bool peer_session::prepare_session(session_number_type _session_number, cipher_suite_type _cipher_suite, elliptic_curve_type _elliptic_curve)
+	bool peer_session::prepare_session(session_number_type _session_number, cipher_suite_type _cipher_suite, elliptic_curve_type _elliptic_curve, compression_algorithm_type _compression_algorithm, boost::shared_ptr<cryptoplus::pkey::ecdhe_context> _ecdhe_context)
 	{
 		if (m_next_session)
 		{
-			if ((m_next_session->parameters.session_number == _session_number) && (m_next_session->parameters.cipher_suite == _cipher_suite) && (m_next_session->parameters.elliptic_curve == _elliptic_curve))
+			if ((m_next_session->parameters.session_number == _session_number) && (m_next_session->parameters.cipher_suite == _cipher_suite) && (m_next_session->parameters.elliptic_curve == _elliptic_curve) && (m_next_session->parameters.compression_algorithm == _compression_algorithm))
 			{
 				// The session in preparation matches the requested one: not creating one to ensure the private DH key stays the same.
 				return false;
 			}
 		}
 
-		m_next_session = boost::make_shared<next_session_type>(_session_number, _cipher_suite, _elliptic_curve);
+		// A rekey with an unchanged curve reuses the key pair that produced the current shared secret: the peer does the same, so neither public key changes and complete_session() can serve the cached secret instead of running a fresh agreement. This is only safe under the extended key derivation, where the session number salts the keys: a version 3 peer gets a fresh key pair every time.
+		if (m_extended_key_derivation && m_session_ecdhe_context && has_current_session() && (m_session_ecdhe_nid == _elliptic_curve.to_elliptic_curve_nid()))
+		{
+			_ecdhe_context = m_session_ecdhe_context;
+		}
+
+		m_next_session = boost::make_shared<next_session_type>(_session_number, _cipher_suite, _elliptic_curve, _compression_algorithm, _ecdhe_context);
 
 		return true;
 	}
 
 	bool peer_session::complete_session(const void* _remote_public_key, size_t remote_public_key_size)
+	{
+		if (!m_next_session || !m_remote_host_identifier)
+		{
+			return false;
+		}
+
+		const auto remote_public_key = cryptoplus::buffer(_remote_public_key, remote_public_key_size);
+
+		cryptoplus::buffer secret_key;
+
+		if (m_extended_key_derivation && (m_next_session->ecdhe_context == m_session_ecdhe_context) && (cryptoplus::buffer_size(m_cached_shared_secret) > 0) && (remote_public_key == m_cached_remote_public_key))
+		{
+			// Both key pairs are unchanged since the last agreement: the agreement would recompute the exact same secret, so the cached one is reused and the rekey costs a handful of PRF invocations instead of a scalar multiplication.
+			secret_key = m_cached_shared_secret;
+		}
+		else
+		{
+			// We get the derived secret key.
+			secret_key = m_next_session->ecdhe_context->derive_secret_key(remote_public_key);
+
+			m_session_ecdhe_context = m_next_session->ecdhe_context;
+			m_session_ecdhe_nid = m_next_session->parameters.elliptic_curve.to_elliptic_curve_nid();
+			m_cached_remote_public_key = remote_public_key;
+			m_cached_shared_secret = secret_key;
+		}
+
+		// Both version 4 hosts salt the derivation, whether or not the secret came from the cache, so both ends always derive the same material. A version 3 peer gets the unsalted derivation of section 3.3 of the specification.
+		establish_session(m_next_session->parameters, secret_key, m_extended_key_derivation);
+
+		m_next_session.reset();
+
+		return true;
+	}
+
+	bool peer_session::resume_session(const session_parameters& parameters, const cryptoplus::buffer& _resumption_secret, const uint8_t* request_nonce, const uint8_t* response_nonce)
 	{
 		using cryptoplus::buffer_cast;
+		using cryptoplus::buffer_size;
 
-		if (!m_next_session || !m_remote_host_identifier)
+		if (!m_remote_host_identifier)
 		{
 			return false;
 		}
 
-		boost::shared_ptr<current_session_type> _current_session = boost::make_shared<current_session_type>(m_next_session->parameters);
+		// The master secret binds both nonces so a replayed resumption message cannot re-create a previous session.
+		uint8_t seed[SESSION_RESUMPTION_NONCE_SIZE * 2];
 
-		const size_t key_length = m_next_session->parameters.cipher_suite.to_cipher_algorithm().key_length();
-		const auto remote_public_key = cryptoplus::buffer(_remote_public_key, remote_public_key_size);
+		std::copy(request_nonce, request_nonce + SESSION_RESUMPTION_NONCE_SIZE, seed);
+		std::copy(response_nonce, response_nonce + SESSION_RESUMPTION_NONCE_SIZE, seed + SESSION_RESUMPTION_NONCE_SIZE);
+
+		const auto secret_key = cryptoplus::tls::prf(
+			48,
+			buffer_cast<const void*>(_resumption_secret),
+			buffer_size(_resumption_secret),
+			"resumption master secret",
+			seed,
+			sizeof(seed),
+			get_default_digest_algorithm()
+		);
+
+		establish_session(parameters, secret_key);
+
+		// Any handshake that was in flight is superseded by the resumed session.
+		m_next_session.reset();
+
+		return true;
+	}
+
+	void peer_session::establish_session(const session_parameters& parameters, const cryptoplus::buffer& secret_key, bool salted)
+	{
+		using cryptoplus::buffer_cast;
+
+		boost::shared_ptr<current_session_type> _current_session = boost::make_shared<current_session_type>(parameters, m_replay_window_size);
 
-		// We get the derived secret key.
-		const auto secret_key = m_next_session->ecdhe_context.derive_secret_key(remote_public_key);
+		const size_t key_length = parameters.cipher_suite.to_cipher_algorithm().key_length();
+
+		std::vector<uint8_t> local_seed(m_local_host_identifier.data.begin(), m_local_host_identifier.data.end());
+		std::vector<uint8_t> remote_seed(m_remote_host_identifier->data.begin(), m_remote_host_identifier->data.end());
+
+		if (salted)
+		{
+			// Under the extended (version 4) derivation, the session number salts the seeds so successive sessions keyed from the same (cached) shared secret still get fresh keys and nonce prefixes. Both hosts agree on the session number, so both ends derive the same material.
+			for (size_t i = 0; i < sizeof(parameters.session_number); ++i)
+			{
+				const uint8_t byte = static_cast<uint8_t>(parameters.session_number >> (8 * (sizeof(parameters.session_number) - 1 - i)));
+
+				local_seed.push_back(byte);
+				remote_seed.push_back(byte);
+			}
+		}
 
 		_current_session->local_session_key = cryptoplus::tls::prf(
 			key_length,
 			buffer_cast<const void*>(secret_key),
 			buffer_size(secret_key),
 			"session key",
-			m_local_host_identifier.data.data(),
-			m_local_host_identifier.data.size(),
+			local_seed.data(),
+			local_seed.size(),
 			get_default_digest_algorithm()
 		);
 
@@ -114,8 +198,8 @@ namespace fscp
 			buffer_cast<const void*>(secret_key),
 			buffer_size(secret_key),
 			"session key",
-			m_remote_host_identifier->data.data(),
-			m_remote_host_identifier->data.size(),
+			remote_seed.data(),
+			remote_seed.size(),
 			get_default_digest_algorithm()
 		);
 
@@ -124,8 +208,8 @@ namespace fscp
 			buffer_cast<const void*>(secret_key),
 			buffer_size(secret_key),
 			"nonce prefix",
-			m_local_host_identifier.data.data(),
-			m_local_host_identifier.data.size(),
+			local_seed.data(),
+			local_seed.size(),
 			get_default_digest_algorithm()
 		);
 
@@ -134,17 +218,45 @@ namespace fscp
 			buffer_cast<const void*>(secret_key),
 			buffer_size(secret_key),
 			"nonce prefix",
-			m_remote_host_identifier->data.data(),
-			m_remote_host_identifier->data.size(),
+			remote_seed.data(),
+			remote_seed.size(),
+			get_default_digest_algorithm()
+		);
+
+		// Key the cipher contexts once per session: the full key schedule is expensive and the key never changes until the next rekey.
+		const cryptoplus::cipher::cipher_algorithm cipher_algorithm = _current_session->parameters.cipher_suite.to_cipher_algorithm();
+
+		_current_session->local_cipher_context = boost::make_shared<cryptoplus::cipher::cipher_context>();
+		_current_session->local_cipher_context->initialize(cipher_algorithm, cryptoplus::cipher::cipher_context::encrypt, NULL, 0, NULL);
+		_current_session->local_cipher_context->ctrl_set(EVP_CTRL_GCM_SET_IVLEN, static_cast<int>(buffer_size(_current_session->local_nonce_prefix) + sizeof(sequence_number_type)));
+		_current_session->local_cipher_context->initialize(cryptoplus::cipher::cipher_algorithm(), cryptoplus::cipher::cipher_context::unchanged, buffer_cast<const void*>(_current_session->local_session_key), buffer_size(_current_session->local_session_key), NULL);
+
+		_current_session->remote_cipher_context = boost::make_shared<cryptoplus::cipher::cipher_context>();
+		_current_session->remote_cipher_context->initialize(cipher_algorithm, cryptoplus::cipher::cipher_context::decrypt, NULL, 0, NULL);
+		_current_session->remote_cipher_context->ctrl_set(EVP_CTRL_GCM_SET_IVLEN, static_cast<int>(buffer_size(_current_session->remote_nonce_prefix) + sizeof(sequence_number_type)));
+		_current_session->remote_cipher_context->initialize(cryptoplus::cipher::cipher_algorithm(), cryptoplus::cipher::cipher_context::unchanged, buffer_cast<const void*>(_current_session->remote_session_key), buffer_size(_current_session->remote_session_key), NULL);
+
+		// Both hosts must end up with the same resumption secret: the seed is the XOR of the host identifiers, which does not depend on which side initiated the handshake.
+		host_identifier_type::data_type resumption_seed;
+
+		for (size_t i = 0; i < resumption_seed.size(); ++i)
+		{
+			resumption_seed[i] = m_local_host_identifier.data[i] ^ m_remote_host_identifier->data[i];
+		}
+
+		m_resumption_secret = cryptoplus::tls::prf(
+			32,
+			buffer_cast<const void*>(secret_key),
+			buffer_size(secret_key),
+			"resumption secret",
+			resumption_seed.data(),
+			resumption_seed.size(),
 			get_default_digest_algorithm()
 		);
 
-		m_next_session.reset();
 		swap(m_current_session, _current_session);
 
 		keep_alive();
-
-		return true;
 	}
 
 	session_number_type peer_session::next_session_number() const
@@ -177,16 +289,69 @@ namespace fscp
 		return m_current_session->parameters;
 	}
 
-	bool peer_session::set_remote_sequence_number(sequence_number_type sequence_number)
+	void peer_session::set_replay_window_size(size_t window_size)
 	{
-		if (sequence_number > m_current_session->remote_sequence_number)
-		{
-			m_current_session->remote_sequence_number = sequence_number;
+		window_size = std::min<size_t>(std::max<size_t>(window_size, 64), 1024);
+
+		// Round up to a whole count of 64-bit words.
+		m_replay_window_size = (window_size + 63) & ~static_cast<size_t>(63);
+	}
+
+	bool peer_session::is_acceptable_sequence_number(sequence_number_type sequence_number) const
+	{
+		const current_session_type& session = *m_current_session;
 
+		if (sequence_number > session.remote_sequence_number)
+		{
 			return true;
 		}
 
-		return false;
+		if (session.remote_sequence_number - sequence_number >= session.replay_window_size())
+		{
+			// The sequence number falls behind the window.
+			return false;
+		}
+
+		const uint64_t word = session.replay_window[(sequence_number / 64) % session.replay_window.size()];
+
+		return ((word & (static_cast<uint64_t>(1) << (sequence_number % 64))) == 0);
+	}
+
+	bool peer_session::register_sequence_number(sequence_number_type sequence_number)
+	{
+		current_session_type& session = *m_current_session;
+		const size_t word_count = session.replay_window.size();
+
+		if (sequence_number > session.remote_sequence_number)
+		{
+			// The window slides forward: the words between the old and the new front are cleared before use, as in RFC 6479.
+			if (sequence_number - session.remote_sequence_number >= session.replay_window_size())
+			{
+				std::fill(session.replay_window.begin(), session.replay_window.end(), static_cast<uint64_t>(0));
+			}
+			else
+			{
+				for (sequence_number_type word = (session.remote_sequence_number / 64) + 1; word <= (sequence_number / 64); ++word)
+				{
+					session.replay_window[word % word_count] = 0;
+				}
+			}
+
+			session.remote_sequence_number = sequence_number;
+		}
+		else if (session.remote_sequence_number - sequence_number >= session.replay_window_size())
+		{
+			return false;
+		}
+		else if ((session.replay_window[(sequence_number / 64) % word_count] & (static_cast<uint64_t>(1) << (sequence_number % 64))) != 0)
+		{
+			// The sequence number was already seen: this is a replay.
+			return false;
+		}
+
+		session.replay_window[(sequence_number / 64) % word_count] |= (static_cast<uint64_t>(1) << (sequence_number % 64));
+
+		return true;
 	}
 
 	bool peer_session::clear()
@@ -198,6 +363,12 @@ namespace fscp
 		m_current_session.reset();
 		m_next_session.reset();
 
+		// A cleared session loses its derived-key cache: the next handshake runs a fresh agreement, restoring the forward secrecy boundary.
+		m_session_ecdhe_context.reset();
+		m_session_ecdhe_nid = 0;
+		m_cached_remote_public_key = cryptoplus::buffer();
+		m_cached_shared_secret = cryptoplus::buffer();
+
 		return result;
 	}
 }
@@ -0,0 +1,106 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file peer_session_map.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A sharded peer session map.
+ */
+
+#include "peer_session_map.hpp"
+
+#include "endpoint_hash.hpp"
+
+#include <boost/make_shared.hpp>
+
+namespace fscp
+{
+	peer_session& peer_session_map::operator[](const ep_type& ep)
+	{
+		shard_type& shard = m_shards[shard_for(ep)];
+
+		boost::mutex::scoped_lock lock(shard.mutex);
+
+		peer_session_ptr& session = shard.sessions[ep];
+
+		if (!session)
+		{
+			session = boost::make_shared<peer_session>();
+			session->set_replay_window_size(m_replay_window_size);
+		}
+
+		return *session;
+	}
+
+	peer_session_map::peer_session_ptr peer_session_map::find(const ep_type& ep) const
+	{
+		const shard_type& shard = m_shards[shard_for(ep)];
+
+		boost::mutex::scoped_lock lock(shard.mutex);
+
+		const std::map<ep_type, peer_session_ptr>::const_iterator item = shard.sessions.find(ep);
+
+		if (item != shard.sessions.end())
+		{
+			return item->second;
+		}
+
+		return peer_session_ptr();
+	}
+
+	peer_session_map::snapshot_type peer_session_map::snapshot() const
+	{
+		snapshot_type result;
+
+		for (size_t i = 0; i < SHARD_COUNT; ++i)
+		{
+			const shard_type& shard = m_shards[i];
+
+			boost::mutex::scoped_lock lock(shard.mutex);
+
+			result.insert(result.end(), shard.sessions.begin(), shard.sessions.end());
+		}
+
+		return result;
+	}
+
+	size_t peer_session_map::shard_for(const ep_type& ep)
+	{
+		return endpoint_hash()(ep) % SHARD_COUNT;
+	}
+}
@@ -52,7 +52,8 @@ namespace fscp
 {
 	size_t presentation_message::write(void* buf, size_t buf_len, presentation_message::cert_type sig_cert)
 	{
-		size_t sig_cert_len = !sig_cert.is_null() ? sig_cert.write_der(static_cast<void*>(0)) : 0;
+		// PRESENTATION messages carry the same certificate to every new peer: the cached form avoids re-running the DER serialization per peer.
+		size_t sig_cert_len = !sig_cert.is_null() ? cryptoplus::buffer_size(sig_cert.cached_der()) : 0;
 
 		if (buf_len < HEADER_LENGTH + MIN_BODY_LENGTH + sig_cert_len)
 		{
@@ -66,7 +67,8 @@ namespace fscp
 
 		if (!sig_cert.is_null())
 		{
-			pbuf += sig_cert.write_der(pbuf);
+			std::memcpy(pbuf, cryptoplus::buffer_cast<const uint8_t*>(sig_cert.cached_der()), sig_cert_len);
+			pbuf += sig_cert_len;
 		}
 
 		message::write(buf, buf_len, CURRENT_PROTOCOL_VERSION, MESSAGE_TYPE_PRESENTATION, pbuf - static_cast<char*>(buf) - HEADER_LENGTH);
@@ -51,6 +51,7 @@
 #include "presentation_message.hpp"
 #include "session_request_message.hpp"
 #include "session_message.hpp"
+#include "session_resumption_message.hpp"
 #include "data_message.hpp"
 
 #include <boost/random.hpp>
@@ -59,7 +60,51 @@
 #include <boost/thread/future.hpp>
 #include <boost/iterator/transform_iterator.hpp>
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/sock_diag.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+
+// The UDP segmentation offload constants only ship with recent kernel headers.
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+// So do the receive timestamping ones.
+#ifndef SO_TIMESTAMPING
+#define SO_TIMESTAMPING 37
+#endif
+#ifndef SCM_TIMESTAMPING
+#define SCM_TIMESTAMPING SO_TIMESTAMPING
+#endif
+
+// And the path MTU discovery ones.
+#ifndef IP_MTU_DISCOVER
+#define IP_MTU_DISCOVER 10
+#endif
+#ifndef IP_PMTUDISC_PROBE
+#define IP_PMTUDISC_PROBE 3
+#endif
+#ifndef IPV6_MTU_DISCOVER
+#define IPV6_MTU_DISCOVER 23
+#endif
+#ifndef IPV6_PMTUDISC_PROBE
+#define IPV6_PMTUDISC_PROBE 3
+#endif
+#endif
 
 namespace fscp
 {
@@ -69,7 +114,97 @@ namespace fscp
 
 	namespace
 	{
+		// The admission stage for control messages only engages once this many handlers are queued on the handshake-related strands.
+		const uint32_t ADMISSION_PRESSURE_THRESHOLD = 64;
+
+		// The admission budgets, per tick, once the admission stage is engaged.
+		const boost::posix_time::time_duration ADMISSION_TICK = boost::posix_time::milliseconds(100);
+		const size_t ADMISSION_SESSION_BUDGET = 64;
+		const size_t ADMISSION_UNKNOWN_SOURCE_BUDGET = 16;
+
+		const size_t HELLO_SLOT_COUNT = 1024;
+		const size_t HELLO_SLOT_LIMIT = 0x10000;
+
+		// The per-source handshake rate limiting window and slot table size.
+		const uint64_t HANDSHAKE_WINDOW_SECONDS = 10;
+		const size_t HANDSHAKE_SLOT_COUNT = 1024;
+
+		uint32_t generate_hello_number_mask()
+		{
+			// The first call to this function is *NOT* thread-safe in C++03 !
+			static boost::mt19937 rng(static_cast<uint32_t>(time(0)));
+
+			return rng();
+		}
+
 		void null_simple_handler(const boost::system::error_code&) {}
+
+		/**
+		 * \brief Compute the send delay of one target within a paced burst.
+		 * \param window The pacing window.
+		 * \param index The index of the target.
+		 * \param count The count of targets. Must not be zero.
+		 * \return The delay.
+		 *
+		 * Each target gets an even slot in the window plus a jitter within its slot, so paced bursts from synchronized nodes do not fire in phase either.
+		 */
+		boost::posix_time::time_duration paced_delay(const boost::posix_time::time_duration& window, size_t index, size_t count)
+		{
+			const int64_t slice = static_cast<int64_t>(window.total_microseconds()) / static_cast<int64_t>(count);
+
+			if (slice <= 0)
+			{
+				return boost::posix_time::time_duration();
+			}
+
+			// A relaxed counter mixed through an avalanche step: cheap, lock-free and random enough for jitter.
+			static boost::atomic<uint32_t> jitter_state(static_cast<uint32_t>(time(0)));
+
+			uint32_t h = jitter_state.fetch_add(UINT32_C(0x9e3779b9), boost::memory_order_relaxed);
+			h ^= h >> 16;
+			h *= UINT32_C(0x45d9f3b);
+			h ^= h >> 16;
+
+			return boost::posix_time::microseconds(static_cast<int64_t>(index) * slice + (static_cast<int64_t>(h) % slice));
+		}
+
+		// The path MTU probe frame: a kind byte, the announced payload size and, for probes, zero padding up to that size.
+		const uint8_t PATH_MTU_FRAME_PROBE = 0x01;
+		const uint8_t PATH_MTU_FRAME_ACK = 0x02;
+		const size_t PATH_MTU_FRAME_HEADER_SIZE = 3;
+
+		// The path quality probe frame: a kind byte and a sequence number, echoed verbatim.
+		const uint8_t PATH_QUALITY_FRAME_PROBE = 0x03;
+		const uint8_t PATH_QUALITY_FRAME_ACK = 0x04;
+		const size_t PATH_QUALITY_FRAME_SIZE = 5;
+
+		// A path whose smoothed probe loss exceeds this ratio is not considered for data.
+		const double PATH_QUALITY_LOSS_THRESHOLD = 0.25;
+
+#ifdef __linux__
+		void set_dont_fragment(int fd, bool is_v6)
+		{
+			// Probes must not be fragmented along the way: an undersized hop has to drop them for the discovery to notice, and ignoring the kernel's cached route MTU lets the probes measure the real path.
+			const int mtu_discover = IP_PMTUDISC_PROBE;
+
+			if (is_v6)
+			{
+				const int mtu_discover_v6 = IPV6_PMTUDISC_PROBE;
+
+				::setsockopt(fd, IPPROTO_IPV6, IPV6_MTU_DISCOVER, &mtu_discover_v6, sizeof(mtu_discover_v6));
+			}
+
+			::setsockopt(fd, IPPROTO_IP, IP_MTU_DISCOVER, &mtu_discover, sizeof(mtu_discover));
+		}
+#endif
+
+		void notify_simple_handlers(const std::vector<server::simple_handler_type>& handlers, const boost::system::error_code& ec)
+		{
+			for (std::vector<server::simple_handler_type>::const_iterator handler = handlers.begin(); handler != handlers.end(); ++handler)
+			{
+				(*handler)(ec);
+			}
+		}
 		void null_multiple_endpoints_handler(const std::map<server::ep_type, boost::system::error_code>&) {}
 
 		server::ep_type normalize(const server::ep_type& ep)
@@ -168,37 +303,58 @@ namespace fscp
 
 				results_gatherer(Handler handler, const set_type& keys) :
 					m_handler(handler),
-					m_keys(keys)
+					m_keys(keys.begin(), keys.end()),
+					m_values(keys.size()),
+#ifndef NDEBUG
+					m_gathered(keys.size(), 0),
+#endif
+					m_remaining(keys.size())
 				{
 					if (m_keys.empty())
 					{
-						m_handler(m_results);
+						m_handler(map_type());
 					}
 				}
 
 				void gather(const KeyType& key, const ValueType& value)
 				{
-					boost::mutex::scoped_lock lock(m_mutex);
+					// The keys vector is sorted (it comes from a set) and never changes after construction: each completion finds its ordinal by binary search and writes its own slot, so concurrent completions need no lock. Only the last one - the one that drops the countdown to zero - assembles the results map and runs the handler.
+					const typename std::vector<KeyType>::const_iterator entry = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+
+					assert((entry != m_keys.end()) && !(key < *entry));
 
-					const size_t erased_count = m_keys.erase(key);
+					const size_t ordinal = static_cast<size_t>(entry - m_keys.begin());
 
-					// Ensure that gather was called only once for a given key.
-					assert(erased_count == 1);
+#ifndef NDEBUG
+					// Ensure that gather is called only once for a given key.
+					assert(m_gathered[ordinal] == 0);
+					m_gathered[ordinal] = 1;
+#endif
 
-					m_results[key] = value;
+					m_values[ordinal] = value;
 
-					if (m_keys.empty())
+					if (m_remaining.fetch_sub(1, boost::memory_order_acq_rel) == 1)
 					{
-						m_handler(m_results);
+						map_type results;
+
+						for (size_t i = 0; i < m_keys.size(); ++i)
+						{
+							results.insert(results.end(), typename map_type::value_type(m_keys[i], m_values[i]));
+						}
+
+						m_handler(results);
 					}
 				}
 
 			private:
 
-				boost::mutex m_mutex;
 				Handler m_handler;
-				set_type m_keys;
-				map_type m_results;
+				std::vector<KeyType> m_keys;
+				std::vector<ValueType> m_values;
+#ifndef NDEBUG
+				std::vector<char> m_gathered;
+#endif
+				boost::atomic<size_t> m_remaining;
 		};
 
 		bool compare_certificates(const server::cert_type& lhs, const server::cert_type& rhs)
@@ -206,8 +362,35 @@ namespace fscp
 			assert(!!lhs);
 			assert(!!rhs);
 
-			return (lhs.write_der() == rhs.write_der());
+			return (lhs.cached_der() == rhs.cached_der());
+		}
+
+#ifdef __linux__
+		bool to_endpoint(const sockaddr_storage& address, server::ep_type& result)
+		{
+			if (address.ss_family == AF_INET)
+			{
+				const sockaddr_in* const sin = reinterpret_cast<const sockaddr_in*>(&address);
+
+				result = server::ep_type(boost::asio::ip::address_v4(ntohl(sin->sin_addr.s_addr)), ntohs(sin->sin_port));
+
+				return true;
+			}
+			else if (address.ss_family == AF_INET6)
+			{
+				const sockaddr_in6* const sin6 = reinterpret_cast<const sockaddr_in6*>(&address);
+
+				boost::asio::ip::address_v6::bytes_type bytes;
+				std::memcpy(bytes.data(), sin6->sin6_addr.s6_addr, bytes.size());
+
+				result = server::ep_type(boost::asio::ip::address_v6(bytes, sin6->sin6_scope_id), ntohs(sin6->sin6_port));
+
+				return true;
+			}
+
+			return false;
 		}
+#endif
 	}
 
 	// Public methods
@@ -216,17 +399,52 @@ namespace fscp
 		m_logger(_logger),
 		m_identity_store(identity),
 		m_socket(io_service),
-		m_socket_strand(io_service),
-		m_write_queue_strand(io_service),
-		m_greet_strand(io_service),
+		m_receive_batch_size(DEFAULT_RECEIVE_BATCH_SIZE),
+		m_admission_tick_start(),
+		m_admission_session_admitted(0),
+		m_admission_unknown_admitted(0),
+		m_handshake_rate_limit(0),
+		m_handshake_window(0),
+		m_handshake_hash_secret(generate_hello_number_mask()),
+		m_reuse_port_socket_count(1),
+		m_udp_offload(false),
+		m_kernel_timestamping(false),
+		m_path_mtu_discovery(false),
+		m_multipath(false),
+		m_multipath_spray(false),
+		m_session_resumption(false),
+		m_socket_strand_pending(0),
+		m_socket_strand(io_service, m_socket_strand_pending),
+		m_write_in_flight(false),
+		m_write_queue_strand_pending(0),
+		m_write_queue_strand(io_service, m_write_queue_strand_pending),
+		m_requested_receive_buffer_size(0),
+		m_requested_send_buffer_size(0),
+		m_busy_poll_microseconds(0),
+		m_data_tos(-1),
+		m_control_tos(-1),
+		m_socket_receive_queue_bytes(0),
+		m_socket_receive_buffer_size(0),
+		m_socket_send_buffer_size(0),
+		m_last_socket_kernel_drops(0),
+		m_socket_telemetry_timer_id(0),
+		m_crypto_worker_count(0),
+		m_crypto_strands_pending(0),
+		m_ecdhe_key_pool(io_service),
+		m_hello_number_mask(generate_hello_number_mask()),
+		m_greet_strand_pending(0),
+		m_greet_strand(io_service, m_greet_strand_pending),
 		m_accept_hello_messages_default(true),
 		m_hello_message_received_handler(),
-		m_presentation_strand(io_service),
+		m_presentation_strand_pending(0),
+		m_presentation_strand(io_service, m_presentation_strand_pending),
 		m_presentation_message_received_handler(),
-		m_session_strand(io_service),
+		m_session_strand_pending(0),
+		m_session_strand(io_service, m_session_strand_pending),
 		m_accept_session_request_messages_default(true),
 		m_cipher_suites(get_default_cipher_suites()),
 		m_elliptic_curves(get_default_elliptic_curves()),
+		m_compression_algorithms(get_default_compression_algorithms()),
 		m_session_request_message_received_handler(),
 		m_accept_session_messages_default(true),
 		m_session_message_received_handler(),
@@ -234,15 +452,50 @@ namespace fscp
 		m_session_error_handler(),
 		m_session_established_handler(),
 		m_session_lost_handler(),
-		m_data_strand(io_service),
-		m_contact_strand(io_service),
+		m_handshake_duration_histogram(metrics_registry::get_default_instance().get_histogram("fscp.session.handshake_duration_ms")),
+		m_peer_send_queue_depth(0),
+		m_peer_send_queue_policy(PSQ_DROP_NEWEST),
+		m_peer_congestion_handler(),
+		m_data_bytes_in_counter(metrics_registry::get_default_instance().get_counter("fscp.data.bytes_in")),
+		m_data_bytes_out_counter(metrics_registry::get_default_instance().get_counter("fscp.data.bytes_out")),
+		m_socket_errors_counter(metrics_registry::get_default_instance().get_counter("fscp.socket.errors")),
+		m_drop_no_session_counter(metrics_registry::get_default_instance().get_counter("fscp.drop.no_session")),
+		m_drop_malformed_counter(metrics_registry::get_default_instance().get_counter("fscp.drop.malformed")),
+		m_drop_unknown_type_counter(metrics_registry::get_default_instance().get_counter("fscp.drop.unknown_type")),
+		m_shed_control_counter(metrics_registry::get_default_instance().get_counter("fscp.shed.control")),
+		m_shed_unknown_source_counter(metrics_registry::get_default_instance().get_counter("fscp.shed.unknown_source")),
+		m_shed_handshake_counter(metrics_registry::get_default_instance().get_counter("fscp.shed.handshake")),
+		m_shed_memory_counter(metrics_registry::get_default_instance().get_counter("fscp.shed.memory_pressure")),
+		m_socket_kernel_drops_counter(metrics_registry::get_default_instance().get_counter("fscp.socket.kernel_drops")),
+		m_compression_rx_raw_bytes_counter(metrics_registry::get_default_instance().get_counter("fscp.compression.rx_raw_bytes")),
+		m_compression_rx_wire_bytes_counter(metrics_registry::get_default_instance().get_counter("fscp.compression.rx_wire_bytes")),
+		m_receive_queueing_delay_histogram(metrics_registry::get_default_instance().get_histogram("fscp.receive.queueing_delay_us")),
+		m_data_strand_pending(0),
+		m_data_strand(io_service, m_data_strand_pending),
+		m_contact_strand_pending(0),
+		m_contact_strand(io_service, m_contact_strand_pending),
 		m_data_received_handler(),
 		m_contact_request_message_received_handler(),
 		m_contact_message_received_handler(),
-		m_keep_alive_timer(io_service, SESSION_KEEP_ALIVE_PERIOD)
+		m_contact_flush_interval(),
+		m_contact_flush_timer_id(0),
+		m_timer_wheel(io_service),
+		m_keep_alive_timer_id(0),
+		m_lazy_keep_alive(false),
+		m_path_mtu_timer_id(0)
 	{
 		// These calls are needed in C++03 to ensure that static initializations are done in a single thread.
 		server_category();
+
+		// Preallocate the greet slots: a burst of greets after a network event costs no allocations.
+		m_hello_slots.resize(HELLO_SLOT_COUNT);
+		m_hello_free_slots.reserve(HELLO_SLOT_COUNT);
+		m_handshake_slots.resize(HANDSHAKE_SLOT_COUNT);
+
+		for (size_t slot_index = HELLO_SLOT_COUNT; slot_index > 0; --slot_index)
+		{
+			m_hello_free_slots.push_back(slot_index - 1);
+		}
 	}
 
 	identity_store server::sync_get_identity()
@@ -277,18 +530,135 @@ namespace fscp
 			m_socket.set_option(boost::asio::ip::v6_only(false));
 		}
 
+#ifdef SO_REUSEPORT
+		typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+
+		if (m_reuse_port_socket_count > 1)
+		{
+			m_socket.set_option(reuse_port(true));
+		}
+#endif
+
 		m_socket.bind(listen_endpoint);
 
-		async_receive_from();
+#ifdef __linux__
+		if (m_udp_offload)
+		{
+			// Let the kernel coalesce ingress bursts into GRO super-datagrams: the segment size is recovered from a control message on read.
+			const int gro = 1;
+			::setsockopt(m_socket.native_handle(), SOL_UDP, UDP_GRO, &gro, sizeof(gro));
+		}
+
+		if (m_kernel_timestamping)
+		{
+			// Have the kernel stamp every received datagram on entry: the timestamp is recovered from a control message on read.
+			const int timestamping = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+			::setsockopt(m_socket.native_handle(), SOL_SOCKET, SO_TIMESTAMPING, &timestamping, sizeof(timestamping));
+		}
+
+		if (m_path_mtu_discovery)
+		{
+			set_dont_fragment(m_socket.native_handle(), listen_endpoint.address().is_v6());
+		}
+#endif
+
+		apply_socket_tuning(m_socket);
+
+		async_receive_from(&m_socket);
+
+#ifdef SO_REUSEPORT
+		// Open the extra SO_REUSEPORT sockets: the kernel spreads inbound datagrams across them so ingress scales with the worker threads instead of funneling through one socket.
+		for (size_t i = 1; i < m_reuse_port_socket_count; ++i)
+		{
+			boost::shared_ptr<socket_type> socket = boost::make_shared<socket_type>(boost::ref(m_socket.get_io_service()));
+
+			socket->open(listen_endpoint.protocol());
+
+			if (listen_endpoint.address().is_v6())
+			{
+				socket->set_option(boost::asio::ip::v6_only(false));
+			}
+
+			socket->set_option(reuse_port(true));
+			socket->bind(listen_endpoint);
+
+#ifdef __linux__
+			if (m_udp_offload)
+			{
+				const int gro = 1;
+				::setsockopt(socket->native_handle(), SOL_UDP, UDP_GRO, &gro, sizeof(gro));
+			}
+
+			if (m_kernel_timestamping)
+			{
+				const int timestamping = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+				::setsockopt(socket->native_handle(), SOL_SOCKET, SO_TIMESTAMPING, &timestamping, sizeof(timestamping));
+			}
+
+			if (m_path_mtu_discovery)
+			{
+				set_dont_fragment(socket->native_handle(), listen_endpoint.address().is_v6());
+			}
+#endif
+
+			apply_socket_tuning(*socket);
+
+			m_extra_sockets.push_back(socket);
+
+			async_receive_from(socket.get());
+		}
+#endif
+
+		if (m_crypto_worker_count > 0)
+		{
+			// Start the crypto workers: they seal and open data messages in parallel across hosts, one per-host strand each so no reordering is introduced.
+			m_crypto_io_service.reset();
+			m_crypto_work.reset(new boost::asio::io_service::work(m_crypto_io_service));
+
+			for (size_t i = 0; i < m_crypto_worker_count; ++i)
+			{
+				m_crypto_threads.create_thread(boost::bind(&boost::asio::io_service::run, &m_crypto_io_service));
+			}
+		}
+
+		// The timer wheel multiplexes the keep-alive period and all the hello timeouts onto a single system timer.
+		m_timer_wheel.start();
 
-		m_keep_alive_timer.async_wait(m_session_strand.wrap(boost::bind(&server::do_check_keep_alive, this, boost::asio::placeholders::error)));
+		m_keep_alive_timer_id = m_timer_wheel.async_wait(SESSION_KEEP_ALIVE_PERIOD, m_session_strand.wrap(boost::bind(&server::do_check_keep_alive, this, _1)));
+
+		m_socket_telemetry_timer_id = m_timer_wheel.async_wait(SOCKET_TELEMETRY_PERIOD, m_socket_strand.wrap(boost::bind(&server::do_sample_socket_telemetry, this, _1)));
+
+		if (m_path_mtu_discovery)
+		{
+			m_path_mtu_timer_id = m_timer_wheel.async_wait(PATH_MTU_PROBE_PERIOD, m_session_strand.wrap(boost::bind(&server::do_check_path_mtu, this, _1)));
+		}
 	}
 
 	void server::close()
 	{
 		cancel_all_greetings();
 
-		m_keep_alive_timer.cancel();
+		m_session_strand.post(boost::bind(&server::do_fail_pending_peer_sends, this));
+
+		m_timer_wheel.cancel(m_keep_alive_timer_id);
+		m_timer_wheel.cancel(m_socket_telemetry_timer_id);
+
+		if (m_path_mtu_discovery)
+		{
+			m_timer_wheel.cancel(m_path_mtu_timer_id);
+		}
+		m_timer_wheel.stop();
+
+		if (m_crypto_work)
+		{
+			m_crypto_work.reset();
+			m_crypto_threads.join_all();
+		}
+
+		for (auto&& socket: m_extra_sockets)
+		{
+			socket->close();
+		}
 
 		m_socket.close();
 	}
@@ -337,7 +707,12 @@ namespace fscp
 
 	void server::async_reintroduce_to_all(multiple_endpoints_handler_type handler)
 	{
-		m_presentation_strand.post(boost::bind(&server::do_reintroduce_to_all, this, handler));
+		m_presentation_strand.post(boost::bind(&server::do_reintroduce_to_all, this, handler, boost::posix_time::time_duration()));
+	}
+
+	void server::async_reintroduce_to_all(multiple_endpoints_handler_type handler, const boost::posix_time::time_duration& pacing_window)
+	{
+		m_presentation_strand.post(boost::bind(&server::do_reintroduce_to_all, this, handler, pacing_window));
 	}
 
 	std::map<server::ep_type, boost::system::error_code> server::sync_reintroduce_to_all()
@@ -387,7 +762,20 @@ namespace fscp
 
 	void server::set_presentation(const ep_type& target, cert_type signature_certificate)
 	{
-		m_presentation_store_map[target] = presentation_store(signature_certificate);
+		unindex_presentation(target);
+
+		const presentation_store store(signature_certificate);
+
+		m_presentation_store_map[target] = store;
+
+		const hash_type hash = store.signature_certificate_hash();
+
+		if (m_presentation_hash_index.find(hash) == m_presentation_hash_index.end())
+		{
+			m_presentation_hash_filter.insert(hash);
+		}
+
+		m_presentation_hash_index[hash] = target;
 	}
 
 	void server::async_set_presentation(const ep_type& target, cert_type signature_certificate, void_handler_type handler)
@@ -407,6 +795,8 @@ namespace fscp
 
 	void server::clear_presentation(const ep_type& target)
 	{
+		unindex_presentation(target);
+
 		m_presentation_store_map.erase(target);
 	}
 
@@ -470,6 +860,162 @@ namespace fscp
 		return promise.get_future().get();
 	}
 
+	std::map<server::ep_type, server::peer_statistics> server::get_peer_statistics() const
+	{
+		boost::mutex::scoped_lock lock(m_peer_statistics_mutex);
+
+		return m_peer_statistics;
+	}
+
+	void server::apply_socket_tuning(socket_type& socket)
+	{
+		boost::system::error_code ec;
+
+		if (m_requested_receive_buffer_size > 0)
+		{
+			// A best-effort request: the kernel clamps the value to its configured maximum. The granted size is reported in the queue statistics.
+			socket.set_option(boost::asio::socket_base::receive_buffer_size(static_cast<int>(m_requested_receive_buffer_size)), ec);
+		}
+
+		if (m_requested_send_buffer_size > 0)
+		{
+			socket.set_option(boost::asio::socket_base::send_buffer_size(static_cast<int>(m_requested_send_buffer_size)), ec);
+		}
+
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+		if (m_busy_poll_microseconds > 0)
+		{
+			// Let the kernel spin on the device queue for up to the budget before sleeping, trading CPU for receive latency.
+			const int busy_poll = static_cast<int>(m_busy_poll_microseconds);
+			::setsockopt(socket.native_handle(), SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll));
+		}
+#endif
+
+		if (m_data_tos >= 0)
+		{
+			apply_tos(socket, m_data_tos);
+		}
+
+		static_cast<void>(ec);
+	}
+
+	void server::apply_tos(socket_type& socket, int tos)
+	{
+#if defined(IP_TOS)
+		::setsockopt(socket.native_handle(), IPPROTO_IP, IP_TOS, reinterpret_cast<const char*>(&tos), sizeof(tos));
+#endif
+#if defined(IPV6_TCLASS)
+		// The socket may be dual-stack: mark the IPv6 traffic class as well.
+		::setsockopt(socket.native_handle(), IPPROTO_IPV6, IPV6_TCLASS, reinterpret_cast<const char*>(&tos), sizeof(tos));
+#endif
+		static_cast<void>(socket);
+		static_cast<void>(tos);
+	}
+
+	void server::do_marked_write(int tos, void_handler_type write_handler)
+	{
+		// All do_marked_write() calls are done in the same strand as the writes, so the marking cannot interleave with another send. The restore runs right after the write initiation: asio sends datagrams speculatively, so the marking covers the actual transmission.
+		apply_tos(m_socket, tos);
+
+		write_handler();
+
+		apply_tos(m_socket, (m_data_tos >= 0) ? m_data_tos : 0);
+	}
+
+	server::queue_statistics_type server::get_queue_statistics() const
+	{
+		queue_statistics_type result;
+
+		result.socket_strand_pending = m_socket_strand_pending.load(boost::memory_order_relaxed);
+		result.write_queue_strand_pending = m_write_queue_strand_pending.load(boost::memory_order_relaxed);
+		result.greet_strand_pending = m_greet_strand_pending.load(boost::memory_order_relaxed);
+		result.presentation_strand_pending = m_presentation_strand_pending.load(boost::memory_order_relaxed);
+		result.session_strand_pending = m_session_strand_pending.load(boost::memory_order_relaxed);
+		result.data_strand_pending = m_data_strand_pending.load(boost::memory_order_relaxed);
+		result.contact_strand_pending = m_contact_strand_pending.load(boost::memory_order_relaxed);
+		result.crypto_strands_pending = m_crypto_strands_pending.load(boost::memory_order_relaxed);
+		result.socket_receive_queue_bytes = m_socket_receive_queue_bytes.load(boost::memory_order_relaxed);
+		result.socket_receive_buffer_size = m_socket_receive_buffer_size.load(boost::memory_order_relaxed);
+		result.socket_send_buffer_size = m_socket_send_buffer_size.load(boost::memory_order_relaxed);
+		result.socket_kernel_drops = m_socket_kernel_drops_counter.value();
+
+		return result;
+	}
+
+	void server::do_sample_socket_telemetry(const boost::system::error_code& ec)
+	{
+		// All do_sample_socket_telemetry() calls are done in the socket strand so the sockets cannot close under us.
+		if (ec != boost::asio::error::operation_aborted)
+		{
+			uint64_t queued_bytes = 0;
+			uint64_t buffer_size_total = 0;
+			uint64_t kernel_drops = 0;
+
+			std::vector<socket_type*> sockets;
+			sockets.push_back(&m_socket);
+
+			for (auto&& socket: m_extra_sockets)
+			{
+				sockets.push_back(socket.get());
+			}
+
+			for (auto&& socket: sockets)
+			{
+				if (!socket->is_open())
+				{
+					continue;
+				}
+
+				boost::system::error_code sample_ec;
+
+				queued_bytes += socket->available(sample_ec);
+
+				boost::asio::socket_base::receive_buffer_size receive_buffer_size;
+				socket->get_option(receive_buffer_size, sample_ec);
+
+				if (!sample_ec)
+				{
+					buffer_size_total += static_cast<uint64_t>(receive_buffer_size.value());
+				}
+
+				if (socket == &m_socket)
+				{
+					// Sends only ever go through the main socket, so its send buffer is the one that matters.
+					boost::asio::socket_base::send_buffer_size send_buffer_size;
+					socket->get_option(send_buffer_size, sample_ec);
+
+					if (!sample_ec)
+					{
+						m_socket_send_buffer_size.store(static_cast<uint64_t>(send_buffer_size.value()), boost::memory_order_relaxed);
+					}
+				}
+
+#if defined(__linux__) && defined(SO_MEMINFO)
+				uint32_t meminfo[SK_MEMINFO_VARS] = {};
+				socklen_t meminfo_len = sizeof(meminfo);
+
+				if (::getsockopt(socket->native_handle(), SOL_SOCKET, SO_MEMINFO, meminfo, &meminfo_len) == 0)
+				{
+					// The kernel value is cumulative since the socket was created.
+					kernel_drops += meminfo[SK_MEMINFO_DROPS];
+				}
+#endif
+			}
+
+			m_socket_receive_queue_bytes.store(queued_bytes, boost::memory_order_relaxed);
+			m_socket_receive_buffer_size.store(buffer_size_total, boost::memory_order_relaxed);
+
+			if (kernel_drops > m_last_socket_kernel_drops)
+			{
+				m_socket_kernel_drops_counter.increment(kernel_drops - m_last_socket_kernel_drops);
+
+				m_last_socket_kernel_drops = kernel_drops;
+			}
+
+			m_socket_telemetry_timer_id = m_timer_wheel.async_wait(SOCKET_TELEMETRY_PERIOD, m_socket_strand.wrap(boost::bind(&server::do_sample_socket_telemetry, this, _1)));
+		}
+	}
+
 	bool server::sync_has_session_with_endpoint(const ep_type& host)
 	{
 		typedef bool result_type;
@@ -600,6 +1146,11 @@ namespace fscp
 		m_session_strand.post(boost::bind(&server::do_send_data, this, normalize(target), channel_number, data, handler));
 	}
 
+	void server::async_send_data_in_place(const ep_type& target, channel_number_type channel_number, SharedBuffer frame, boost::asio::const_buffer data, simple_handler_type handler)
+	{
+		m_session_strand.post(boost::bind(&server::do_send_data_in_place, this, normalize(target), channel_number, frame, data, handler));
+	}
+
 	boost::system::error_code server::sync_send_data(const ep_type& target, channel_number_type channel_number, boost::asio::const_buffer data)
 	{
 		typedef boost::promise<boost::system::error_code> promise_type;
@@ -614,11 +1165,16 @@ namespace fscp
 
 	void server::async_send_data_to_list(const std::set<ep_type>& targets, channel_number_type channel_number, boost::asio::const_buffer data, multiple_endpoints_handler_type handler)
 	{
-		const std::set<ep_type> normalized_targets(boost::make_transform_iterator(targets.begin(), normalize), boost::make_transform_iterator(targets.end(), normalize));
+		const endpoint_set_ptr normalized_targets = boost::make_shared<std::set<ep_type> >(boost::make_transform_iterator(targets.begin(), normalize), boost::make_transform_iterator(targets.end(), normalize));
 
 		m_session_strand.post(boost::bind(&server::do_send_data_to_list, this, normalized_targets, channel_number, data, handler));
 	}
 
+	void server::async_send_data_to_list(endpoint_set_ptr targets, channel_number_type channel_number, boost::asio::const_buffer data, multiple_endpoints_handler_type handler)
+	{
+		m_session_strand.post(boost::bind(&server::do_send_data_to_list, this, targets, channel_number, data, handler));
+	}
+
 	std::map<server::ep_type, boost::system::error_code> server::sync_send_data_to_list(const std::set<ep_type>& targets, channel_number_type channel_number, boost::asio::const_buffer data)
 	{
 		typedef std::map<server::ep_type, boost::system::error_code> result_type;
@@ -701,7 +1257,7 @@ namespace fscp
 
 	void server::async_send_contact(const ep_type& target, const contact_map_type& contact_map, simple_handler_type handler)
 	{
-		m_session_strand.post(boost::bind(&server::do_send_contact, this, normalize(target), contact_map, handler));
+		m_session_strand.post(boost::bind(&server::do_send_contact, this, normalize(target), boost::make_shared<const contact_map_type>(contact_map), handler));
 	}
 
 	boost::system::error_code server::sync_send_contact(const ep_type& target, const contact_map_type& contact_map)
@@ -720,7 +1276,8 @@ namespace fscp
 	{
 		const std::set<ep_type> normalized_targets(boost::make_transform_iterator(targets.begin(), normalize), boost::make_transform_iterator(targets.end(), normalize));
 
-		m_session_strand.post(boost::bind(&server::do_send_contact_to_list, this, normalized_targets, contact_map, handler));
+		// The map is copied once into an immutable snapshot: every per-peer send shares it instead of duplicating it.
+		m_session_strand.post(boost::bind(&server::do_send_contact_to_list, this, normalized_targets, boost::make_shared<const contact_map_type>(contact_map), handler));
 	}
 
 	std::map<server::ep_type, boost::system::error_code> server::sync_send_contact_to_list(const std::set<ep_type>& targets, const contact_map_type& contact_map)
@@ -795,7 +1352,8 @@ namespace fscp
 		// do_set_identity() is executed within the socket strand so this is safe.
 		set_identity(identity);
 
-		async_reintroduce_to_all(&null_multiple_endpoints_handler);
+		// Reintroductions after an identity change are paced: a certificate renewal must not turn into a fleet-wide presentation and crypto burst.
+		async_reintroduce_to_all(&null_multiple_endpoints_handler, DEFAULT_PACING_WINDOW);
 
 		if (handler)
 		{
@@ -803,874 +1361,1183 @@ namespace fscp
 		}
 	}
 
-	void server::do_async_receive_from()
+	void server::do_async_receive_from(socket_type* socket)
 	{
 		// do_async_receive_from() is executed within the socket strand so this is safe.
+		assert(socket);
+
 		boost::shared_ptr<ep_type> sender = boost::make_shared<ep_type>();
 
+#ifdef __linux__
+		if (m_udp_offload || m_kernel_timestamping)
+		{
+			// The GRO segment size and the kernel receive timestamp travel in control messages that the plain asynchronous read cannot expose: wait for readiness and read through recvmmsg() instead.
+			socket->async_receive_from(
+				boost::asio::null_buffers(),
+				*sender,
+				make_pooled_handler(
+					m_receive_handler_memory,
+					boost::bind(
+						&server::handle_receive_from,
+						this,
+						get_identity(),
+						socket,
+						sender,
+						SharedBuffer(),
+						boost::asio::placeholders::error,
+						boost::asio::placeholders::bytes_transferred
+					)
+				)
+			);
+
+			return;
+		}
+#endif
+
 		const auto receive_buffer = SharedBuffer(65536);
 
-		m_socket.async_receive_from(
+		// One receive is outstanding per socket, so its per-operation state recycles an arena slot instead of hitting the heap once per datagram.
+		socket->async_receive_from(
 			buffer(receive_buffer),
 			*sender,
-			boost::bind(
-				&server::handle_receive_from,
-				this,
-				get_identity(),
-				sender,
-				receive_buffer,
-				boost::asio::placeholders::error,
-				boost::asio::placeholders::bytes_transferred
+			make_pooled_handler(
+				m_receive_handler_memory,
+				boost::bind(
+					&server::handle_receive_from,
+					this,
+					get_identity(),
+					socket,
+					sender,
+					receive_buffer,
+					boost::asio::placeholders::error,
+					boost::asio::placeholders::bytes_transferred
+				)
 			)
 		);
 	}
 
-	void server::handle_receive_from(const identity_store& identity, boost::shared_ptr<ep_type> sender, SharedBuffer data, const boost::system::error_code& ec, size_t bytes_received)
+	void server::handle_receive_from(const identity_store& identity, socket_type* socket, boost::shared_ptr<ep_type> sender, SharedBuffer data, const boost::system::error_code& ec, size_t bytes_received)
 	{
+		assert(socket);
 		assert(sender);
 
 		if (ec != boost::asio::error::operation_aborted)
 		{
-			// Let's read again !
-			async_receive_from();
-
-			*sender = normalize(*sender);
-
 			if (!ec)
 			{
-				try
+#ifdef __linux__
+				if ((m_udp_offload || m_kernel_timestamping) && (buffer_size(data) == 0))
+				{
+					// This was only a readiness notification: the pending datagrams, including GRO super-datagrams, are read synchronously.
+					drain_pending_datagrams(*socket, identity, 0);
+				}
+				else
+#endif
 				{
-					message message(buffer_cast<const uint8_t*>(data), bytes_received);
+					process_datagram(normalize(*sender), identity, data, bytes_received, boost::posix_time::microsec_clock::universal_time());
 
-					switch (message.type())
+					// Drain whatever else is already queued on the socket before arming a new asynchronous read: under load this saves one full handler round-trip per datagram.
+					if (m_receive_batch_size > 1)
 					{
-						case MESSAGE_TYPE_DATA_0:
-						case MESSAGE_TYPE_DATA_1:
-						case MESSAGE_TYPE_DATA_2:
-						case MESSAGE_TYPE_DATA_3:
-						case MESSAGE_TYPE_DATA_4:
-						case MESSAGE_TYPE_DATA_5:
-						case MESSAGE_TYPE_DATA_6:
-						case MESSAGE_TYPE_DATA_7:
-						case MESSAGE_TYPE_DATA_8:
-						case MESSAGE_TYPE_DATA_9:
-						case MESSAGE_TYPE_DATA_10:
-						case MESSAGE_TYPE_DATA_11:
-						case MESSAGE_TYPE_DATA_12:
-						case MESSAGE_TYPE_DATA_13:
-						case MESSAGE_TYPE_DATA_14:
-						case MESSAGE_TYPE_DATA_15:
-						case MESSAGE_TYPE_CONTACT_REQUEST:
-						case MESSAGE_TYPE_CONTACT:
-						case MESSAGE_TYPE_KEEP_ALIVE:
-						{
-							data_message data_message(message);
-
-							m_session_strand.post(
-								make_shared_buffer_handler(
-									data,
-									boost::bind(
-										&server::do_handle_data,
-										this,
-										identity,
-										*sender,
-										data_message
-									)
-								)
-							);
-
-							break;
-						}
-						case MESSAGE_TYPE_HELLO_REQUEST:
-						case MESSAGE_TYPE_HELLO_RESPONSE:
-						{
-							hello_message hello_message(message);
+						drain_pending_datagrams(*socket, identity, 1);
+					}
+				}
+			}
+			else if (ec == boost::asio::error::connection_refused)
+			{
+				m_socket_errors_counter.increment();
 
-							handle_hello_message_from(hello_message, *sender);
+				// The host refused the connection, meaning it closed its socket so we can force-terminate the session.
+				async_close_session(normalize(*sender), &null_simple_handler);
+			}
+			else
+			{
+				m_socket_errors_counter.increment();
+			}
 
-							break;
-						}
-						case MESSAGE_TYPE_PRESENTATION:
-						{
-							presentation_message presentation_message(message);
+			// Let's read again !
+			async_receive_from(socket);
+		}
+	}
 
-							handle_presentation_message_from(presentation_message, *sender);
+	size_t server::drain_pending_datagrams(socket_type& socket, const identity_store& identity, size_t already_received)
+	{
+		// handle_receive_from() is the only reader of the socket and is never invoked concurrently with itself, so reading synchronously here cannot race the asynchronous reads.
+		size_t count = 0;
 
-							break;
-						}
-						case MESSAGE_TYPE_SESSION_REQUEST:
-						{
-							session_request_message session_request_message(message);
-
-							m_presentation_strand.post(
-								boost::bind(
-									&server::do_handle_session_request,
-									this,
-									data,
-									identity,
-									*sender,
-									session_request_message
-								)
-							);
-
-							break;
-						}
-						case MESSAGE_TYPE_SESSION:
+		// Dispatch is deferred until the whole batch is drained, so it can be scheduled fairly across peers instead of strictly in arrival order.
+		std::vector<pending_datagram_type> batch;
+		batch.reserve(m_receive_batch_size);
+
+#ifdef __linux__
+		static const size_t BURST_SIZE = 8;
+
+		while (count + already_received < m_receive_batch_size)
+		{
+			const size_t burst = std::min(BURST_SIZE, m_receive_batch_size - already_received - count);
+
+			std::vector<SharedBuffer> buffers;
+			buffers.reserve(burst);
+
+			iovec iov[BURST_SIZE];
+			sockaddr_storage addresses[BURST_SIZE];
+			mmsghdr msgvec[BURST_SIZE];
+			char controls[BURST_SIZE][CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(struct scm_timestamping))];
+
+			for (size_t i = 0; i < burst; ++i)
+			{
+				buffers.push_back(SharedBuffer(65536));
+
+				iov[i].iov_base = buffer_cast<uint8_t*>(buffer(buffers[i]));
+				iov[i].iov_len = buffer_size(buffer(buffers[i]));
+
+				std::memset(&msgvec[i], 0, sizeof(msgvec[i]));
+				msgvec[i].msg_hdr.msg_name = &addresses[i];
+				msgvec[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+				msgvec[i].msg_hdr.msg_iov = &iov[i];
+				msgvec[i].msg_hdr.msg_iovlen = 1;
+
+				if (m_udp_offload || m_kernel_timestamping)
+				{
+					msgvec[i].msg_hdr.msg_control = controls[i];
+					msgvec[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+				}
+			}
+
+			const int received = ::recvmmsg(socket.native_handle(), msgvec, static_cast<unsigned int>(burst), MSG_DONTWAIT, NULL);
+
+			if (received <= 0)
+			{
+				break;
+			}
+
+			for (int i = 0; i < received; ++i)
+			{
+				ep_type sender;
+
+				if (!to_endpoint(addresses[i], sender))
+				{
+					continue;
+				}
+
+				size_t segment_size = 0;
+				boost::posix_time::ptime receive_time = boost::posix_time::microsec_clock::universal_time();
+
+				if (m_udp_offload || m_kernel_timestamping)
+				{
+					for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msgvec[i].msg_hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&msgvec[i].msg_hdr, cmsg))
+					{
+						if ((cmsg->cmsg_level == SOL_UDP) && (cmsg->cmsg_type == UDP_GRO))
 						{
-							session_message session_message(message);
-
-							m_presentation_strand.post(
-								boost::bind(
-									&server::do_handle_session,
-									this,
-									data,
-									identity,
-									*sender,
-									session_message
-								)
-							);
-
-							break;
+							segment_size = static_cast<size_t>(*reinterpret_cast<const int*>(CMSG_DATA(cmsg)));
 						}
-						default:
+						else if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_TIMESTAMPING))
 						{
-							break;
+							struct scm_timestamping timestamps;
+							std::memcpy(&timestamps, CMSG_DATA(cmsg), sizeof(timestamps));
+
+							// ts[0] is the software receive timestamp, in CLOCK_REALTIME.
+							if ((timestamps.ts[0].tv_sec != 0) || (timestamps.ts[0].tv_nsec != 0))
+							{
+								receive_time = boost::posix_time::from_time_t(timestamps.ts[0].tv_sec) + boost::posix_time::microseconds(timestamps.ts[0].tv_nsec / 1000);
+							}
 						}
 					}
 				}
-				catch (std::runtime_error&)
+
+				if ((segment_size > 0) && (msgvec[i].msg_len > segment_size))
+				{
+					// A GRO super-datagram: split it back into the original messages before dispatch.
+					for (size_t offset = 0; offset < msgvec[i].msg_len; offset += segment_size)
+					{
+						const size_t message_size = std::min(segment_size, static_cast<size_t>(msgvec[i].msg_len) - offset);
+						const SharedBuffer message_buffer(65536);
+
+						std::memcpy(buffer_cast<uint8_t*>(buffer(message_buffer)), buffer_cast<const uint8_t*>(buffer(buffers[i])) + offset, message_size);
+
+						const pending_datagram_type pending = { normalize(sender), message_buffer, message_size, receive_time };
+						batch.push_back(pending);
+					}
+				}
+				else
 				{
-					// These errors can happen in normal situations (for instance when a crypto operation fails due to invalid input).
+					const pending_datagram_type pending = { normalize(sender), buffers[i], msgvec[i].msg_len, receive_time };
+					batch.push_back(pending);
 				}
+
+				++count;
 			}
-			else if (ec == boost::asio::error::connection_refused)
+
+			if (static_cast<size_t>(received) < burst)
 			{
-				// The host refused the connection, meaning it closed its socket so we can force-terminate the session.
-				async_close_session(*sender, &null_simple_handler);
+				break;
 			}
 		}
-	}
+#else
+		boost::system::error_code drain_ec;
 
-	void server::push_write(void_handler_type handler)
-	{
-		// All push_write() calls are done in the same strand so the following is thread-safe.
-		if (m_write_queue.empty())
+		while ((count + already_received < m_receive_batch_size) && (socket.available(drain_ec) > 0) && !drain_ec)
 		{
-			// Nothing is being written, lets start the write immediately.
-			m_socket_strand.post(make_causal_handler(handler, m_write_queue_strand.wrap(boost::bind(&server::pop_write, this))));
+			const SharedBuffer receive_buffer(65536);
+			ep_type sender;
+
+			const size_t drained_bytes = socket.receive_from(buffer(receive_buffer), sender, 0, drain_ec);
+
+			if (drain_ec)
+			{
+				break;
+			}
+
+			const pending_datagram_type pending = { normalize(sender), receive_buffer, drained_bytes, boost::posix_time::microsec_clock::universal_time() };
+			batch.push_back(pending);
+
+			++count;
 		}
+#endif
 
-		m_write_queue.push(handler);
+		dispatch_datagrams_fair(identity, batch);
+
+		return count;
 	}
 
-	void server::pop_write()
+	void server::dispatch_datagrams_fair(const identity_store& identity, std::vector<pending_datagram_type>& datagrams)
 	{
-		// All pop_write() calls are done in the same strand so the following is thread-safe.
-		m_write_queue.pop();
+		// The byte budget each peer gets per scheduling pass. One MTU-sized datagram per peer per pass keeps the interleaving fine-grained without starving large frames: a datagram bigger than the quantum simply accumulates deficit over several passes.
+		static const size_t FAIR_QUANTUM = 1500;
 
-		if (!m_write_queue.empty())
+		if (datagrams.size() <= 1)
 		{
-			m_socket_strand.post(make_causal_handler(m_write_queue.front(), m_write_queue_strand.wrap(boost::bind(&server::pop_write, this))));
+			for (const pending_datagram_type& datagram : datagrams)
+			{
+				process_datagram(datagram.sender, identity, datagram.buffer, datagram.size, datagram.receive_time);
+			}
+
+			return;
 		}
-	}
 
-	server::ep_type server::to_socket_format(const server::ep_type& ep)
-	{
-#ifdef WINDOWS
-		if (m_socket.local_endpoint().address().is_v6() && ep.address().is_v4())
+		// Bin the batch per source endpoint, keeping per-peer arrival order.
+		typedef std::deque<size_t> bin_type;
+		std::map<ep_type, bin_type> bins;
+		std::vector<std::map<ep_type, bin_type>::iterator> order;
+
+		for (size_t i = 0; i < datagrams.size(); ++i)
 		{
-			return server::ep_type(boost::asio::ip::address_v6::v4_mapped(ep.address().to_v4()), ep.port());
+			const std::pair<std::map<ep_type, bin_type>::iterator, bool> result = bins.insert(std::make_pair(datagrams[i].sender, bin_type()));
+
+			if (result.second)
+			{
+				order.push_back(result.first);
+			}
+
+			result.first->second.push_back(i);
 		}
-		else
+
+		if (order.size() == 1)
 		{
-			return ep;
+			// A single peer in the batch: fairness does not apply.
+			for (const pending_datagram_type& datagram : datagrams)
+			{
+				process_datagram(datagram.sender, identity, datagram.buffer, datagram.size, datagram.receive_time);
+			}
+
+			return;
 		}
-#else
-		static_cast<void>(ep);
 
-		return ep;
-#endif
-	}
+		// Deficit round-robin across the peers of the batch: everything is dispatched eventually, but a flooding peer's backlog interleaves behind every other peer's datagrams instead of ahead of them.
+		std::vector<size_t> deficits(order.size(), 0);
+		size_t remaining = datagrams.size();
 
-	uint32_t server::ep_hello_context_type::generate_unique_number()
-	{
-		// The first call to this function is *NOT* thread-safe in C++03 !
-		static boost::mt19937 rng(static_cast<uint32_t>(time(0)));
+		while (remaining > 0)
+		{
+			for (size_t p = 0; p < order.size(); ++p)
+			{
+				bin_type& bin = order[p]->second;
 
-		return rng();
-	}
+				if (bin.empty())
+				{
+					continue;
+				}
 
-	server::ep_hello_context_type::ep_hello_context_type() :
-		m_current_hello_unique_number(generate_unique_number())
-	{
-	}
+				deficits[p] += FAIR_QUANTUM;
 
-	uint32_t server::ep_hello_context_type::next_hello_unique_number()
-	{
-		return m_current_hello_unique_number++;
-	}
+				while (!bin.empty() && (datagrams[bin.front()].size <= deficits[p]))
+				{
+					const pending_datagram_type& datagram = datagrams[bin.front()];
 
-	template <typename WaitHandler>
-	void server::ep_hello_context_type::async_wait_reply(boost::asio::io_service& io_service, uint32_t hello_unique_number, const boost::posix_time::time_duration& timeout, WaitHandler handler)
-	{
-		const boost::shared_ptr<boost::asio::deadline_timer> timer = boost::make_shared<boost::asio::deadline_timer>(boost::ref(io_service), timeout);
+					process_datagram(datagram.sender, identity, datagram.buffer, datagram.size, datagram.receive_time);
 
-		m_pending_requests[hello_unique_number] = pending_request_status(timer);
+					deficits[p] -= datagram.size;
+					bin.pop_front();
+					--remaining;
+				}
 
-		timer->async_wait(handler);
+				// An idle peer does not hoard credit.
+				if (bin.empty())
+				{
+					deficits[p] = 0;
+				}
+			}
+		}
 	}
 
-	bool server::ep_hello_context_type::cancel_reply_wait(uint32_t hello_unique_number, bool success)
+	void server::process_datagram(const ep_type& sender, const identity_store& identity, SharedBuffer data, size_t bytes_received, const boost::posix_time::ptime& receive_time)
 	{
-		pending_requests_map::iterator request = m_pending_requests.find(hello_unique_number);
-
-		if (request != m_pending_requests.end())
+		try
 		{
-			if (request->second.timer->cancel() > 0)
-			{
-				// At least one handler was cancelled which means we can set the success flag.
-				request->second.success = success;
+			message message(buffer_cast<const uint8_t*>(data), bytes_received);
 
-				return true;
+			// Under flood, the expensive unauthenticated work (HELLO parsing, presentation and session negotiation crypto) must not starve established-session data traffic: once the handshake strands back up, control messages are only admitted against a small per-tick budget, with known peers served first.
+			if ((message.type() <= MESSAGE_TYPE_SESSION_RESUMPTION) && !admit_control_message(sender))
+			{
+				return;
 			}
-		}
-
-		return false;
-	}
 
-	void server::ep_hello_context_type::cancel_all_reply_wait()
-	{
-		for (pending_requests_map::iterator request = m_pending_requests.begin(); request != m_pending_requests.end(); ++request)
-		{
-			if (request->second.timer->cancel() > 0)
+			// Handshake initiations are further limited per source address, so a single spoofed or misbehaving source cannot monopolize the admission budgets.
+			if (((message.type() == MESSAGE_TYPE_HELLO_REQUEST) || (message.type() == MESSAGE_TYPE_PRESENTATION) || (message.type() == MESSAGE_TYPE_SESSION_REQUEST)) && !admit_handshake_message(sender))
 			{
-				// At least one handler was cancelled which means we can set the success flag.
-				request->second.success = false;
+				return;
 			}
-		}
-	}
 
-	bool server::ep_hello_context_type::remove_reply_wait(uint32_t hello_unique_number, boost::posix_time::time_duration& duration)
-	{
-		pending_requests_map::iterator request = m_pending_requests.find(hello_unique_number);
+			switch (message.type())
+			{
+				case MESSAGE_TYPE_DATA_0:
+				case MESSAGE_TYPE_DATA_1:
+				case MESSAGE_TYPE_DATA_2:
+				case MESSAGE_TYPE_DATA_3:
+				case MESSAGE_TYPE_DATA_4:
+				case MESSAGE_TYPE_DATA_5:
+				case MESSAGE_TYPE_DATA_6:
+				case MESSAGE_TYPE_DATA_7:
+				case MESSAGE_TYPE_DATA_8:
+				case MESSAGE_TYPE_DATA_9:
+				case MESSAGE_TYPE_DATA_10:
+				case MESSAGE_TYPE_DATA_11:
+				case MESSAGE_TYPE_DATA_12:
+				case MESSAGE_TYPE_DATA_13:
+				case MESSAGE_TYPE_DATA_14:
+				case MESSAGE_TYPE_DATA_15:
+				case MESSAGE_TYPE_CONTACT_REQUEST:
+				case MESSAGE_TYPE_CONTACT:
+				case MESSAGE_TYPE_KEEP_ALIVE:
+				{
+					data_message data_message(message);
 
-		assert(request != m_pending_requests.end());
+					// Resolve the session here, in the receive thread: unknown senders are dropped without a strand round-trip and known ones skip the map lookup in the session strand.
+					const boost::shared_ptr<peer_session> p_session = m_peer_sessions.find(sender);
 
-		const bool result = request->second.success;
+					if (!p_session || !p_session->has_current_session())
+					{
+						m_drop_no_session_counter.increment();
 
-		duration = boost::posix_time::microsec_clock::universal_time() - request->second.start_date;
+						FSCP_LOG(m_logger, log_level::trace) << "Received a data message from " << sender << " but no session exists. Ignoring.";
 
-		m_pending_requests.erase(request);
+						break;
+					}
 
-		return result;
+					if (message.type() == MESSAGE_TYPE_KEEP_ALIVE)
+					{
+						// Keep-alives flow at a low, steady rate on every session: use them to sample how long datagrams wait between the kernel receive timestamp and this point. Without kernel timestamping the receive time is taken at read time and the sampled delay only covers the read batching.
+						const boost::posix_time::time_duration queueing_delay = boost::posix_time::microsec_clock::universal_time() - receive_time;
+
+						if (!queueing_delay.is_negative())
+						{
+							m_receive_queueing_delay_histogram.record(static_cast<uint64_t>(queueing_delay.total_microseconds()));
+						}
+					}
+
+					m_session_strand.post(
+						boost::bind(
+							&server::do_handle_data,
+							this,
+							identity,
+							sender,
+							p_session,
+							data,
+							data_message
+						)
+					);
+
+					break;
+				}
+				case MESSAGE_TYPE_HELLO_REQUEST:
+				case MESSAGE_TYPE_HELLO_RESPONSE:
+				{
+					hello_message hello_message(message);
+
+					handle_hello_message_from(hello_message, sender, receive_time);
+
+					break;
+				}
+				case MESSAGE_TYPE_PRESENTATION:
+				{
+					// Handshake messages carry the sender's protocol version: remember it so the later SESSION_REQUEST is written in a layout the peer can parse.
+					record_peer_version(sender, static_cast<unsigned char>(message.version()));
+
+					presentation_message presentation_message(message);
+
+					handle_presentation_message_from(presentation_message, sender);
+
+					break;
+				}
+				case MESSAGE_TYPE_SESSION_REQUEST:
+				{
+					record_peer_version(sender, static_cast<unsigned char>(message.version()));
+
+					session_request_message session_request_message(message);
+
+					m_presentation_strand.post(
+						boost::bind(
+							&server::do_handle_session_request,
+							this,
+							data,
+							identity,
+							sender,
+							session_request_message
+						)
+					);
+
+					break;
+				}
+				case MESSAGE_TYPE_SESSION:
+				{
+					record_peer_version(sender, static_cast<unsigned char>(message.version()));
+
+					session_message session_message(message);
+
+					m_presentation_strand.post(
+						boost::bind(
+							&server::do_handle_session,
+							this,
+							data,
+							identity,
+							sender,
+							session_message
+						)
+					);
+
+					break;
+				}
+				case MESSAGE_TYPE_SESSION_RESUMPTION_REQUEST:
+				case MESSAGE_TYPE_SESSION_RESUMPTION:
+				{
+					session_resumption_message session_resumption_message(message);
+
+					// No presentation is required: the HMAC is checked in the session strand, against the cached resumption secret.
+					m_session_strand.post(
+						make_shared_buffer_handler(
+							data,
+							boost::bind(
+								(message.type() == MESSAGE_TYPE_SESSION_RESUMPTION_REQUEST) ? &server::do_handle_session_resumption_request : &server::do_handle_session_resumption_response,
+								this,
+								sender,
+								session_resumption_message
+							)
+						)
+					);
+
+					break;
+				}
+				default:
+				{
+					m_drop_unknown_type_counter.increment();
+
+					break;
+				}
+			}
+		}
+		catch (std::runtime_error&)
+		{
+			// These errors can happen in normal situations (for instance when a crypto operation fails due to invalid input).
+			m_drop_malformed_counter.increment();
+		}
 	}
 
-	void server::do_greet(const ep_type& target, duration_handler_type handler, const boost::posix_time::time_duration& timeout)
+	bool server::admit_control_message(const ep_type& sender)
 	{
-		if (!m_socket.is_open())
+		// All admit_control_message() calls are done in the socket strand so the following is thread-safe.
+		const uint32_t backlog = m_greet_strand_pending + m_presentation_strand_pending + m_session_strand_pending + m_crypto_strands_pending;
+
+		if (backlog < ADMISSION_PRESSURE_THRESHOLD)
 		{
-			handler(server_error::server_offline, boost::posix_time::time_duration());
+			return true;
+		}
 
-			return;
+		const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+		if (m_admission_tick_start.is_not_a_date_time() || (now >= m_admission_tick_start + ADMISSION_TICK))
+		{
+			m_admission_tick_start = now;
+			m_admission_session_admitted = 0;
+			m_admission_unknown_admitted = 0;
 		}
 
-		// All do_greet() calls are done in the same strand so the following is thread-safe.
-		ep_hello_context_type& ep_hello_context = m_ep_hello_contexts[target];
+		const boost::shared_ptr<peer_session> p_session = m_peer_sessions.find(sender);
 
-		const uint32_t hello_unique_number = ep_hello_context.next_hello_unique_number();
-		const auto send_buffer = SharedBuffer(16);
-		const size_t size = hello_message::write_request(buffer_cast<uint8_t*>(send_buffer), buffer_size(send_buffer), hello_unique_number);
+		if (p_session && p_session->has_current_session())
+		{
+			// Control traffic from peers we already trust - typically renegotiations - gets the bigger budget.
+			if (m_admission_session_admitted < ADMISSION_SESSION_BUDGET)
+			{
+				m_admission_session_admitted++;
 
-		async_send_to(
-			buffer(send_buffer, size),
-			target,
-			m_greet_strand.wrap(
-				make_shared_buffer_handler(
-					send_buffer,
-					boost::bind(
-						&server::do_greet_handler,
-						this,
-						target,
-						hello_unique_number,
-						handler,
-						timeout,
-						boost::asio::placeholders::error,
-						boost::asio::placeholders::bytes_transferred
-					)
-				)
-			)
-		);
-	}
+				return true;
+			}
 
-	void server::do_greet_handler(const ep_type& target, uint32_t hello_unique_number, duration_handler_type handler, const boost::posix_time::time_duration& timeout, const boost::system::error_code& ec, size_t bytes_transferred)
-	{
-		// We don't care what the bytes_transferred value is: if an incomplete frame was sent, it is exactly the same as a network loss and we just wait for the timer expiration silently.
-		static_cast<void>(bytes_transferred);
+			m_shed_control_counter.increment();
 
-		if (ec)
+			return false;
+		}
+
+		if (m_admission_unknown_admitted < ADMISSION_UNKNOWN_SOURCE_BUDGET)
 		{
-			handler(ec, boost::posix_time::time_duration());
+			m_admission_unknown_admitted++;
 
-			return;
+			return true;
 		}
 
-		// All do_greet() calls are done in the same strand so the following is thread-safe.
-		ep_hello_context_type& ep_hello_context = m_ep_hello_contexts[target];
+		m_shed_unknown_source_counter.increment();
 
-		ep_hello_context.async_wait_reply(get_io_service(), hello_unique_number, timeout, m_greet_strand.wrap(boost::bind(&server::do_greet_timeout, this, target, hello_unique_number, handler, _1)));
+		return false;
 	}
 
-	void server::do_greet_timeout(const ep_type& target, uint32_t hello_unique_number, duration_handler_type handler, const boost::system::error_code& ec)
+	bool server::admit_handshake_message(const ep_type& sender)
 	{
-		// All do_greet_timeout() calls are done in the same strand so the following is thread-safe.
-		ep_hello_context_type& ep_hello_context = m_ep_hello_contexts[target];
+		// All admit_handshake_message() calls are done in the socket strand so the following is thread-safe.
+		const buffer_pool::pressure_level_type pressure = buffer_pool::instance().pressure_level();
+
+		if ((m_handshake_rate_limit == 0) && (pressure < buffer_pool::PRESSURE_SHED_HANDSHAKES))
+		{
+			return true;
+		}
 
-		boost::posix_time::time_duration duration;
+		const boost::shared_ptr<peer_session> p_session = m_peer_sessions.find(sender);
 
-		const bool success = ep_hello_context.remove_reply_wait(hello_unique_number, duration);
+		if (p_session && p_session->has_current_session())
+		{
+			// Renegotiations from peers we already trust are never limited.
+			return true;
+		}
 
-		if (ec == boost::asio::error::operation_aborted)
+		if (pressure >= buffer_pool::PRESSURE_SHED_HANDSHAKES)
 		{
-			// The timer was aborted, which means we received a reply or the server was shut down.
-			if (success)
-			{
-				// The success flag is set: the timer was cancelled due to a reply.
-				handler(server_error::success, duration);
+			// Approaching the memory ceiling, handshakes with unknown peers go before anything of the established ones: each would allocate presentation and session state.
+			m_shed_memory_counter.increment();
 
-				return;
-			}
+			return false;
 		}
-		else if (!ec)
-		{
-			// The timer timed out: replacing the error code.
-			handler(server_error::hello_request_timed_out, duration);
 
-			return;
+		if (m_handshake_rate_limit == 0)
+		{
+			return true;
 		}
 
-		handler(ec, duration);
-	}
+		const uint64_t window = static_cast<uint64_t>(time(0)) / HANDSHAKE_WINDOW_SECONDS;
 
-	void server::do_cancel_all_greetings()
-	{
-		// All do_cancel_all_greetings() calls are done in the same strand so the following is thread-safe.
-		for (ep_hello_context_map::iterator hello_context = m_ep_hello_contexts.begin(); hello_context != m_ep_hello_contexts.end(); ++hello_context)
+		if (window != m_handshake_window)
 		{
-			hello_context->second.cancel_all_reply_wait();
+			// A new window gets a new hash secret: a source that shared a saturated slot lands elsewhere.
+			m_handshake_window = window;
+			m_handshake_hash_secret = generate_hello_number_mask();
 		}
-	}
 
-	void server::handle_hello_message_from(const hello_message& _hello_message, const ep_type& sender)
-	{
-		switch (_hello_message.type())
+		// Sources are tracked per address, as an attacker varies its source port freely.
+		uint32_t hash = m_handshake_hash_secret;
+
+		if (sender.address().is_v4())
 		{
-			case MESSAGE_TYPE_HELLO_REQUEST:
-			{
-				// We need to handle the response in the proper strand to avoid race conditions.
-				m_greet_strand.post(boost::bind(&server::do_handle_hello_request, this, sender, _hello_message.unique_number()));
+			const boost::asio::ip::address_v4::bytes_type bytes = sender.address().to_v4().to_bytes();
 
-				break;
-			}
-			case MESSAGE_TYPE_HELLO_RESPONSE:
+			for (size_t i = 0; i < bytes.size(); ++i)
 			{
-				// We need to handle the response in the proper strand to avoid race conditions.
-				m_greet_strand.post(boost::bind(&server::do_handle_hello_response, this, sender, _hello_message.unique_number()));
-
-				break;
+				hash = hash * 31 + bytes[i];
 			}
-			default:
-			{
-				// This should never happen.
-				assert(false);
+		}
+		else
+		{
+			const boost::asio::ip::address_v6::bytes_type bytes = sender.address().to_v6().to_bytes();
 
-				break;
+			for (size_t i = 0; i < bytes.size(); ++i)
+			{
+				hash = hash * 31 + bytes[i];
 			}
 		}
-	}
 
-	void server::do_handle_hello_request(const ep_type& sender, uint32_t hello_unique_number)
-	{
-		// All do_handle_hello_request() calls are done in the same strand so the following is thread-safe.
-		bool can_reply = m_accept_hello_messages_default;
+		handshake_slot_type& slot = m_handshake_slots[hash % HANDSHAKE_SLOT_COUNT];
 
-		if (m_hello_message_received_handler)
+		if (slot.window != window)
 		{
-			can_reply = m_hello_message_received_handler(sender, can_reply);
+			slot.window = window;
+			slot.count = 0;
 		}
 
-		if (can_reply)
+		if (slot.count < m_handshake_rate_limit)
 		{
-			const auto send_buffer = SharedBuffer(16);
-			const size_t size = hello_message::write_response(buffer_cast<uint8_t*>(send_buffer), buffer_size(send_buffer), hello_unique_number);
+			slot.count++;
 
-			async_send_to(
-				buffer(send_buffer, size),
-				sender,
-				make_shared_buffer_handler(
-					send_buffer,
-					boost::bind(
-						&server::handle_send_to,
-						this,
-						boost::asio::placeholders::error,
-						boost::asio::placeholders::bytes_transferred
-					)
-				)
-			);
+			return true;
 		}
-	}
 
-	void server::do_handle_hello_response(const ep_type& sender, uint32_t hello_unique_number)
-	{
-		// All do_handle_hello_response() calls are done in the same strand so the following is thread-safe.
-		ep_hello_context_type& ep_hello_context = m_ep_hello_contexts[sender];
+		m_shed_handshake_counter.increment();
 
-		ep_hello_context.cancel_reply_wait(hello_unique_number, true);
+		return false;
 	}
 
-	void server::do_set_accept_hello_messages_default(bool value, void_handler_type handler)
+	void server::push_write(void_handler_type handler)
 	{
-		// All do_set_accept_hello_messages_default() calls are done in the same strand so the following is thread-safe.
-		set_accept_hello_messages_default(value);
-
-		if (handler)
+		// All push_write() calls are done in the same strand so the following is thread-safe.
+		if (!m_write_in_flight)
 		{
-			handler();
+			// Nothing is being written, lets start the write immediately.
+			m_write_in_flight = true;
+
+			m_socket_strand.post(make_causal_handler(handler, m_write_queue_strand.wrap(boost::bind(&server::pop_write, this))));
+
+			return;
 		}
+
+		m_control_write_queue.push(handler);
 	}
 
-	void server::do_set_hello_message_received_callback(hello_message_received_handler_type callback, void_handler_type handler)
+	void server::push_channel_write(channel_number_type channel_number, void_handler_type handler, void_handler_type drop_handler)
 	{
-		// All do_set_hello_message_received_callback() calls are done in the same strand so the following is thread-safe.
-		set_hello_message_received_callback(callback);
-
-		if (handler)
+		// All push_channel_write() calls are done in the same strand so the following is thread-safe.
+		if (!m_write_in_flight)
 		{
-			handler();
+			// Nothing is being written, lets start the write immediately.
+			m_write_in_flight = true;
+
+			m_socket_strand.post(make_causal_handler(handler, m_write_queue_strand.wrap(boost::bind(&server::pop_write, this))));
+
+			return;
 		}
-	}
 
-	bool server::has_presentation_store_for(const ep_type& ep) const
-	{
-		// This method should only be called from within the presentation strand.
-		presentation_store_map::const_iterator presentation_store = m_presentation_store_map.find(ep);
+		egress_queue_type& queue = m_channel_write_queues[channel_number];
 
-		if (presentation_store != m_presentation_store_map.end())
+		if ((buffer_pool::instance().pressure_level() >= buffer_pool::PRESSURE_SHED_BULK) && drop_handler)
 		{
-			return !(presentation_store->second.empty());
+			// The last shedding stage before the ceiling: bulk datagrams are dropped instead of queued, so the egress queues stop holding buffers alive.
+			queue.dropped++;
+
+			m_shed_memory_counter.increment();
+
+			drop_handler();
+
+			return;
 		}
 
-		return false;
+		if ((queue.max_depth > 0) && (queue.entries.size() >= queue.max_depth) && drop_handler)
+		{
+			// The channel reached its depth limit: dropping the datagram is better than delaying the other channels even more.
+			queue.dropped++;
+
+			drop_handler();
+
+			return;
+		}
+
+		queue.entries.push(egress_entry_type(handler, drop_handler));
 	}
 
-	void server::do_introduce_to(const ep_type& target, simple_handler_type handler)
+	void server::pop_write()
 	{
-		// All do_introduce_to() calls are done in the same strand so the following is thread-safe.
-		if (!m_socket.is_open())
+		// All pop_write() calls are done in the same strand so the following is thread-safe.
+		// Control messages always go first: handshakes, keep-alives and contact traffic must not starve behind bulk data.
+		if (!m_control_write_queue.empty())
 		{
-			handler(server_error::server_offline);
+			m_socket_strand.post(make_causal_handler(m_control_write_queue.front(), m_write_queue_strand.wrap(boost::bind(&server::pop_write, this))));
+
+			m_control_write_queue.pop();
 
 			return;
 		}
 
-		const identity_store& identity = get_identity();
-		const auto send_buffer = SharedBuffer(4096);
+		// Pick the non-empty channel queue with the lowest priority value.
+		egress_queue_type* best = nullptr;
 
-		try
+		for (size_t i = 0; i < m_channel_write_queues.size(); ++i)
 		{
-			const size_t size = presentation_message::write(
-				buffer_cast<uint8_t*>(send_buffer),
-				buffer_size(send_buffer),
-				identity.signature_certificate()
-			);
+			egress_queue_type& queue = m_channel_write_queues[i];
 
-			async_send_to(
-				buffer(send_buffer, size),
-				target,
-				make_shared_buffer_handler(
-					send_buffer,
-					boost::bind(
-						handler,
-						_1
-					)
-				)
-			);
+			if (!queue.entries.empty() && (!best || (queue.priority < best->priority)))
+			{
+				best = &queue;
+			}
 		}
-		catch (const boost::system::system_error& ex)
+
+		if (best)
 		{
-			handler(ex.code());
-		}
-	}
+			if (best->entries.front().aggregate && (best->entries.front().aggregate == best->open_aggregate))
+			{
+				// The aggregate is about to be written: no more segments can be appended to it.
+				best->open_aggregate.reset();
+			}
 
-	void server::do_reintroduce_to_all(multiple_endpoints_handler_type handler)
-	{
-		// All do_reintroduce_to_all() calls are done in the same strand so the following is thread-safe.
-		typedef results_gatherer<ep_type, boost::system::error_code, multiple_endpoints_handler_type> results_gatherer_type;
+			void_handler_type write_handler = best->entries.front().write_handler;
 
-		results_gatherer_type::set_type targets;
+			if ((best->tos >= 0) && (best->tos != m_data_tos))
+			{
+				// The channel carries its own marking: the TOS byte is switched around the write and restored for the bulk frames, like control traffic.
+				write_handler = boost::bind(&server::do_marked_write, this, best->tos, write_handler);
+			}
 
-		for (presentation_store_map::const_iterator presentation_store = m_presentation_store_map.begin(); presentation_store != m_presentation_store_map.end(); ++presentation_store)
-		{
-			targets.insert(presentation_store->first);
-		}
+			m_socket_strand.post(make_causal_handler(write_handler, m_write_queue_strand.wrap(boost::bind(&server::pop_write, this))));
 
-		boost::shared_ptr<results_gatherer_type> rg = boost::make_shared<results_gatherer_type>(handler, targets);
+			best->entries.pop();
 
-		for (presentation_store_map::const_iterator presentation_store = m_presentation_store_map.begin(); presentation_store != m_presentation_store_map.end(); ++presentation_store)
-		{
-			async_introduce_to(presentation_store->first, boost::bind(&results_gatherer_type::gather, rg, presentation_store->first, _1));
+			return;
 		}
-	}
 
-	void server::do_get_presentation(const ep_type& target, optional_presentation_store_handler_type handler)
-	{
-		// All do_get_presentation() calls are done in the same strand so the following is thread-safe.
-		handler(get_presentation(target));
+		m_write_in_flight = false;
 	}
 
-	void server::do_set_presentation(const ep_type& target, cert_type signature_certificate, void_handler_type handler)
+	void server::do_get_egress_statistics(egress_statistics_handler_type handler)
 	{
-		// All do_set_presentation() calls are done in the same strand so the following is thread-safe.
-		set_presentation(target, signature_certificate);
+		// All do_get_egress_statistics() calls are done in the same strand so the following is thread-safe.
+		egress_statistics_type statistics;
 
-		if (handler)
+		for (size_t i = 0; i < m_channel_write_queues.size(); ++i)
 		{
-			handler();
+			statistics[i].depth = m_channel_write_queues[i].entries.size();
+			statistics[i].dropped = m_channel_write_queues[i].dropped;
 		}
+
+		handler(statistics);
 	}
 
-	void server::do_clear_presentation(const ep_type& target, void_handler_type handler)
+	void server::async_send_datagram(SharedBuffer datagram, size_t size, const ep_type& target, channel_number_type channel_number, simple_handler_type handler)
 	{
-		// All do_set_presentation() calls are done in the same strand so the following is thread-safe.
-		clear_presentation(target);
-
-		if (handler)
+#ifdef __linux__
+		if (m_udp_offload)
 		{
-			handler();
-		}
-	}
+			m_write_queue_strand.post(boost::bind(&server::push_datagram_write, this, datagram, size, to_socket_format(target), channel_number, handler));
 
-	void server::handle_presentation_message_from(const presentation_message& _presentation_message, const ep_type& sender)
-	{
-		const auto signature_certificate = _presentation_message.signature_certificate();
+			return;
+		}
+#endif
 
-		async_has_session_with_endpoint(sender, [this, sender, signature_certificate](bool has_session) {
-			m_presentation_strand.post(
+		async_send_to(
+			buffer(datagram, size),
+			target,
+			channel_number,
+			make_shared_buffer_handler(
+				datagram,
 				boost::bind(
-					&server::do_handle_presentation,
-					this,
-					sender,
-					has_session,
-					signature_certificate
+					handler,
+					boost::asio::placeholders::error
 				)
-			);
-		});
+			)
+		);
 	}
 
-	void server::do_handle_presentation(const ep_type& sender, bool has_session, cert_type signature_certificate)
+#ifdef __linux__
+	void server::push_datagram_write(SharedBuffer datagram, size_t size, const ep_type& target, channel_number_type channel_number, simple_handler_type handler)
 	{
-		// All do_handle_presentation() calls are done in the same strand so the following is thread-safe.
-		presentation_status_type presentation_status = PS_FIRST;
+		// All push_datagram_write() calls are done in the same strand so the following is thread-safe.
+		// The kernel refuses GSO sends of more than 64 segments.
+		static const size_t GSO_MAX_SEGMENTS = 64;
 
-		const presentation_store_map::iterator entry = m_presentation_store_map.find(sender);
+		egress_queue_type& queue = m_channel_write_queues[channel_number];
 
-		if (entry != m_presentation_store_map.end())
+		// Try to append to the still-open aggregate at the back of the queue: all segments but the last one must have the same size.
+		const boost::shared_ptr<gso_aggregate_type> open_aggregate = queue.open_aggregate;
+
+		if (open_aggregate && (open_aggregate->target == target) && (size <= open_aggregate->segment_size) && (open_aggregate->segment_count < GSO_MAX_SEGMENTS) && (open_aggregate->size + size <= buffer_size(open_aggregate->data)))
 		{
-			if (compare_certificates(entry->second.signature_certificate(), signature_certificate))
-			{
-				presentation_status = PS_SAME;
-			}
-			else
+			std::memcpy(buffer_cast<uint8_t*>(buffer(open_aggregate->data)) + open_aggregate->size, buffer_cast<const uint8_t*>(buffer(datagram)), size);
+
+			open_aggregate->size += size;
+			open_aggregate->segment_count++;
+			open_aggregate->handlers.push_back(handler);
+
+			if (size < open_aggregate->segment_size)
 			{
-				presentation_status = PS_NEW;
+				// A shorter segment can only be the last one of a GSO send.
+				queue.open_aggregate.reset();
 			}
+
+			return;
 		}
 
-		if (m_presentation_message_received_handler)
+		// The datagram itself becomes the first segment of a new aggregate, without a copy.
+		const boost::shared_ptr<gso_aggregate_type> aggregate = boost::make_shared<gso_aggregate_type>();
+
+		aggregate->target = target;
+		aggregate->data = datagram;
+		aggregate->size = size;
+		aggregate->segment_size = size;
+		aggregate->segment_count = 1;
+		aggregate->handlers.push_back(handler);
+
+		if (!m_write_in_flight)
 		{
-			if (!m_presentation_message_received_handler(sender, signature_certificate, presentation_status, has_session))
-			{
-				return;
-			}
+			// Nothing is being written, lets start the write immediately. The aggregate is not left open: appending to it could race the actual send.
+			m_write_in_flight = true;
+
+			m_socket_strand.post(make_causal_handler(void_handler_type(boost::bind(&server::do_send_gso_aggregate, this, aggregate)), m_write_queue_strand.wrap(boost::bind(&server::pop_write, this))));
+
+			return;
+		}
+
+		if ((queue.max_depth > 0) && (queue.entries.size() >= queue.max_depth))
+		{
+			// The channel reached its depth limit: dropping the datagram is better than delaying the other channels even more.
+			queue.dropped++;
+
+			handler(server_error::make_error_code(server_error::egress_queue_full));
+
+			return;
 		}
 
-		m_presentation_store_map[sender] = presentation_store(signature_certificate);
+		queue.entries.push(egress_entry_type(boost::bind(&server::do_send_gso_aggregate, this, aggregate), void_handler_type(), aggregate));
+		queue.open_aggregate = aggregate;
 	}
 
-	void server::do_set_presentation_message_received_callback(presentation_message_received_handler_type callback, void_handler_type handler)
+	void server::do_send_gso_aggregate(boost::shared_ptr<gso_aggregate_type> aggregate)
 	{
-		// All do_set_presentation_message_received_callback() calls are done in the same strand so the following is thread-safe.
-		set_presentation_message_received_callback(callback);
+		// do_send_gso_aggregate() is executed within the socket strand, as a single write queue entry.
+		assert(aggregate);
 
-		if (handler)
+		iovec iov;
+		iov.iov_base = buffer_cast<uint8_t*>(buffer(aggregate->data));
+		iov.iov_len = aggregate->size;
+
+		msghdr msg;
+		std::memset(&msg, 0, sizeof(msg));
+		msg.msg_name = aggregate->target.data();
+		msg.msg_namelen = static_cast<socklen_t>(aggregate->target.size());
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+
+		char control[CMSG_SPACE(sizeof(uint16_t))] = {};
+
+		if (aggregate->segment_count > 1)
 		{
-			handler();
+			// Hand the kernel one super-buffer and let it do the segmentation.
+			msg.msg_control = control;
+			msg.msg_controllen = sizeof(control);
+
+			cmsghdr* const cmsg = CMSG_FIRSTHDR(&msg);
+			cmsg->cmsg_level = SOL_UDP;
+			cmsg->cmsg_type = UDP_SEGMENT;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			*reinterpret_cast<uint16_t*>(CMSG_DATA(cmsg)) = static_cast<uint16_t>(aggregate->segment_size);
+		}
+
+		const ssize_t result = ::sendmsg(m_socket.native_handle(), &msg, 0);
+
+		if (result < 0)
+		{
+			notify_simple_handlers(aggregate->handlers, boost::system::error_code(errno, boost::system::system_category()));
+
+			return;
 		}
+
+		notify_simple_handlers(aggregate->handlers, boost::system::error_code());
 	}
+#endif
 
-	cipher_suite_type server::get_first_common_supported_cipher_suite(const cipher_suite_list_type& reference, const cipher_suite_list_type& capabilities, cipher_suite_type default_value = cipher_suite_type::unsupported)
+	server::ep_type server::to_socket_format(const server::ep_type& ep)
 	{
-		for (auto&& cs : reference)
+#ifdef WINDOWS
+		if (m_socket.local_endpoint().address().is_v6() && ep.address().is_v4())
 		{
-			if (std::find(capabilities.begin(), capabilities.end(), cs) != capabilities.end())
+			return server::ep_type(boost::asio::ip::address_v6::v4_mapped(ep.address().to_v4()), ep.port());
+		}
+		else
+		{
+			return ep;
+		}
+#else
+		static_cast<void>(ep);
+
+		return ep;
+#endif
+	}
+
+	boost::optional<size_t> server::acquire_hello_slot(const ep_type& target)
+	{
+		// All acquire_hello_slot() calls are done in the greet strand so the following is thread-safe.
+		if (m_hello_free_slots.empty())
+		{
+			if (m_hello_slots.size() >= HELLO_SLOT_LIMIT)
 			{
-				return cs;
+				// The slot index must fit the low 16 bits of the hello unique number.
+				return boost::none;
 			}
+
+			m_hello_free_slots.push_back(m_hello_slots.size());
+			m_hello_slots.resize(m_hello_slots.size() + 1);
 		}
 
-		return default_value;
+		const size_t slot_index = m_hello_free_slots.back();
+		m_hello_free_slots.pop_back();
+
+		hello_slot_type& slot = m_hello_slots[slot_index];
+
+		slot.target = target;
+		slot.in_use = true;
+		slot.timer_id = 0;
+		slot.start_date = boost::posix_time::microsec_clock::universal_time();
+		slot.response_date = boost::posix_time::ptime();
+		slot.success = false;
+		slot.coroutine = boost::asio::coroutine();
+
+		return slot_index;
 	}
 
-	elliptic_curve_type server::get_first_common_supported_elliptic_curve(const elliptic_curve_list_type& reference, const elliptic_curve_list_type& capabilities, elliptic_curve_type default_value = elliptic_curve_type::unsupported)
+	void server::release_hello_slot(size_t slot_index)
+	{
+		// All release_hello_slot() calls are done in the greet strand so the following is thread-safe.
+		hello_slot_type& slot = m_hello_slots[slot_index];
 
+		// Bumping the generation invalidates any hello unique number still referring to this slot.
+		slot.generation++;
+		slot.in_use = false;
+		// Dropping the handler releases whatever state it captured.
+		slot.handler = duration_handler_type();
+
+		m_hello_free_slots.push_back(slot_index);
+	}
+
+	uint32_t server::encode_hello_unique_number(size_t slot_index) const
 	{
-		for (auto&& cs : reference)
+		return ((static_cast<uint32_t>(m_hello_slots[slot_index].generation) << 16) | static_cast<uint32_t>(slot_index)) ^ m_hello_number_mask;
+	}
+
+	bool server::decode_hello_unique_number(uint32_t hello_unique_number, size_t& slot_index) const
+	{
+		const uint32_t value = hello_unique_number ^ m_hello_number_mask;
+
+		slot_index = static_cast<size_t>(value & 0xFFFF);
+
+		if (slot_index >= m_hello_slots.size())
 		{
-			if (std::find(capabilities.begin(), capabilities.end(), cs) != capabilities.end())
-			{
-				return cs;
-			}
+			return false;
 		}
 
-		return default_value;
+		const hello_slot_type& slot = m_hello_slots[slot_index];
+
+		return (slot.in_use && (slot.generation == static_cast<uint16_t>(value >> 16)));
 	}
 
-	void server::do_request_session(const identity_store& identity, const ep_type& target, simple_handler_type handler)
+	void server::do_greet(const ep_type& target, duration_handler_type handler, const boost::posix_time::time_duration& timeout)
 	{
-		// All do_request_session() calls are done in the session strand so the following is thread-safe.
 		if (!m_socket.is_open())
 		{
-			handler(server_error::server_offline);
+			handler(server_error::server_offline, boost::posix_time::time_duration());
 
 			return;
 		}
 
-		peer_session& p_session = m_peer_sessions[target];
+		// All do_greet() calls are done in the same strand so the following is thread-safe.
+		const boost::optional<size_t> slot_index = acquire_hello_slot(target);
 
-		if (p_session.has_current_session())
+		if (!slot_index)
 		{
-			handler(server_error::session_already_exist);
+			handler(boost::asio::error::no_buffer_space, boost::posix_time::time_duration());
 
 			return;
 		}
 
-		const auto send_buffer = SharedBuffer(65536);
+		hello_slot_type& slot = m_hello_slots[*slot_index];
 
-		try
-		{
-			const auto next_session_number = p_session.next_session_number();
-			const auto local_host_identifier = p_session.local_host_identifier();
+		slot.handler = handler;
+		slot.timeout = timeout;
 
-			m_logger(log_level::trace) << "Sending session request message to " << target << " (next_session_number: " << next_session_number << ", local_host_identifier: " << local_host_identifier << ")";
+		do_greet_flow(*slot_index, boost::system::error_code());
+	}
 
-			const size_t size = session_request_message::write(
-				buffer_cast<uint8_t*>(send_buffer),
-				buffer_size(send_buffer),
-				next_session_number,
-				local_host_identifier,
-				m_cipher_suites,
-				m_elliptic_curves,
-				identity.signature_key()
-			);
+#include <boost/asio/yield.hpp>
 
-			async_send_to(
-				buffer(send_buffer, size),
-				target,
-				make_shared_buffer_handler(
-					send_buffer,
-					boost::bind(
-						handler,
-						boost::asio::placeholders::error
-					)
-				)
-			);
-		}
-		catch (const boost::system::system_error& ex)
-		{
-			handler(ex.code());
-		}
-	}
-
-	void server::do_close_session(const ep_type& target, simple_handler_type handler)
+	void server::do_greet_flow(size_t slot_index, const boost::system::error_code& ec)
 	{
-		// All do_close_session() calls are done in the same strand so the following is thread-safe.
+		// Every reentry happens in the greet strand: the slot is both the coroutine frame and the flow state, so resuming a step neither allocates nor races.
+		hello_slot_type& slot = m_hello_slots[slot_index];
 
-		if (m_peer_sessions[target].clear())
+		reenter (slot.coroutine)
 		{
-			handler(server_error::success);
-
-			if (m_session_lost_handler)
+			// Send the HELLO request. The shared buffer only lives for the duration of the send: the slot keeps everything the later steps need.
+			yield
 			{
-				m_session_lost_handler(target, session_loss_reason::manual_termination);
+				const uint32_t hello_unique_number = encode_hello_unique_number(slot_index);
+				const auto send_buffer = SharedBuffer(16);
+				const size_t size = hello_message::write_request(buffer_cast<uint8_t*>(send_buffer), buffer_size(send_buffer), hello_unique_number);
+
+				async_send_to(
+					buffer(send_buffer, size),
+					slot.target,
+					m_greet_strand.wrap(
+						make_shared_buffer_handler(
+							send_buffer,
+							boost::bind(&server::do_greet_flow, this, slot_index, boost::asio::placeholders::error)
+						)
+					)
+				);
 			}
-		}
-		else
-		{
-			handler(server_error::no_session_for_host);
-		}
-	}
 
-	void server::do_handle_session_request(SharedBuffer data, const identity_store& identity, const ep_type& sender, const session_request_message& _session_request_message)
-	{
-		// All do_handle_session_request() calls are done in the presentation strand so the following is thread-safe.
-		if (!has_presentation_store_for(sender))
-		{
-			// No presentation_store for the given host.
-			// We do nothing.
-			m_logger(log_level::trace) << "Received a SESSION_REQUEST from " << sender << " but no presentation is available. Ignoring.";
+			if (ec)
+			{
+				// An incomplete send is indistinguishable from a network loss and waits for the timeout silently: only a send error aborts the flow early.
+				const duration_handler_type handler = slot.handler;
 
-			return;
-		}
+				release_hello_slot(slot_index);
 
-		// We make sure the signatures matches.
-		if (!_session_request_message.check_signature(m_presentation_store_map[sender].signature_certificate().public_key()))
-		{
-			m_logger(log_level::trace) << "Received a SESSION_REQUEST from " << sender << " with an invalid signature. Ignoring.";
+				handler(ec, boost::posix_time::time_duration());
 
-			return;
-		}
+				return;
+			}
 
-		// The make_shared_buffer_handler() call below is necessary so that the reference to session_request_message remains valid.
-		m_session_strand.post(
-			make_shared_buffer_handler(
-				data,
-				boost::bind(
-					&server::do_handle_verified_session_request,
-					this,
-					identity,
-					sender,
-					_session_request_message
-				)
-			)
-		);
-	}
+			// Wait for the response: do_handle_hello_response() cancels the timer, which resumes the flow with operation_aborted and the success flag set.
+			yield slot.timer_id = m_timer_wheel.async_wait(slot.timeout, m_greet_strand.wrap(boost::bind(&server::do_greet_flow, this, slot_index, _1)));
 
-	void server::do_handle_verified_session_request(const identity_store& identity, const ep_type& sender, const session_request_message& _session_request_message)
-	{
-		// All do_handle_verified_session_request() calls are done in the session strand so the following is thread-safe.
+			{
+				const bool success = slot.success;
+				boost::posix_time::time_duration duration;
 
-		// Get the associated session, creating one if none exists.
-		peer_session& p_session = m_peer_sessions[sender];
+				if (slot.response_date.is_not_a_date_time() || (slot.response_date < slot.start_date))
+				{
+					duration = boost::posix_time::microsec_clock::universal_time() - slot.start_date;
+				}
+				else
+				{
+					duration = slot.response_date - slot.start_date;
+				}
 
-		if (!p_session.set_first_remote_host_identifier(_session_request_message.host_identifier()))
-		{
-			m_logger(log_level::trace) << "Received a SESSION_REQUEST from " << sender << " but the host identifier does not match (Received: " << _session_request_message.host_identifier() << ". Expected: " << *p_session.remote_host_identifier() << "). Ignoring.";
+				const duration_handler_type handler = slot.handler;
 
-			// The host identifier does not match.
-			return;
-		}
+				release_hello_slot(slot_index);
 
-		const cipher_suite_list_type cipher_suites = _session_request_message.cipher_suite_capabilities();
-		const elliptic_curve_list_type elliptic_curves = _session_request_message.elliptic_curve_capabilities();
-		const cipher_suite_type calg = get_first_common_supported_cipher_suite(m_cipher_suites, cipher_suites);
-		const elliptic_curve_type ec = get_first_common_supported_elliptic_curve(m_elliptic_curves, elliptic_curves);
+				if (ec == boost::asio::error::operation_aborted)
+				{
+					// The timer was aborted, which means we received a reply or the server was shut down.
+					if (success)
+					{
+						// The success flag is set: the timer was cancelled due to a reply.
+						handler(server_error::success, duration);
 
-		if ((calg == cipher_suite_type::unsupported) || (ec == elliptic_curve_type::unsupported))
-		{
-			// No suitable cipher and/or elliptic curve is available.
-			m_logger(log_level::trace) << "Received a SESSION_REQUEST from " << sender << " but can't agree on the cipher suite to use (Cipher algorithm: " << calg  << ". Elliptic curve: " << ec << "). Ignoring";
+						return;
+					}
+				}
+				else if (!ec)
+				{
+					// The timer timed out: replacing the error code.
+					handler(server_error::hello_request_timed_out, duration);
 
-			return;
+					return;
+				}
+
+				handler(ec, duration);
+			}
 		}
+	}
 
-		bool can_reply = m_accept_session_request_messages_default;
+#include <boost/asio/unyield.hpp>
 
-		if (m_session_request_message_received_handler)
+	void server::do_cancel_all_greetings()
+	{
+		// All do_cancel_all_greetings() calls are done in the same strand so the following is thread-safe.
+		for (size_t slot_index = 0; slot_index < m_hello_slots.size(); ++slot_index)
 		{
-			can_reply = m_session_request_message_received_handler(sender, cipher_suites, elliptic_curves, m_accept_session_request_messages_default);
-		}
+			hello_slot_type& slot = m_hello_slots[slot_index];
 
-		if (!can_reply)
-		{
-			m_logger(log_level::trace) << "Received a SESSION_REQUEST from " << sender << " but not allowed to reply (`m_accept_session_request_messages_default` is " << m_accept_session_request_messages_default << ").";
+			if (slot.in_use && m_timer_wheel.cancel(slot.timer_id))
+			{
+				// The handler was cancelled which means we can set the success flag. The slot itself is released by the timeout handler.
+				slot.success = false;
+			}
 		}
-		else
+	}
+
+	void server::handle_hello_message_from(const hello_message& _hello_message, const ep_type& sender, const boost::posix_time::ptime& receive_time)
+	{
+		switch (_hello_message.type())
 		{
-			if (!p_session.has_current_session())
+			case MESSAGE_TYPE_HELLO_REQUEST:
 			{
-				m_logger(log_level::trace) << "Received a SESSION_REQUEST from " << sender << " with session number " << _session_request_message.session_number() << " and cipher suite " << calg << "_" << ec << ". No current session exist: preparing one and sending it.";
+				// We need to handle the response in the proper strand to avoid race conditions.
+				m_greet_strand.post(boost::bind(&server::do_handle_hello_request, this, sender, _hello_message.unique_number()));
 
-				p_session.prepare_session(_session_request_message.session_number(), calg, ec);
-				do_send_session(identity, sender, p_session.next_session_parameters());
+				break;
 			}
-			else
+			case MESSAGE_TYPE_HELLO_RESPONSE:
 			{
-				m_logger(log_level::trace) << "Current session has number " << p_session.current_session().parameters.session_number << " and " << sender << " requests session number " << _session_request_message.session_number();
-
-				if (_session_request_message.session_number() > p_session.current_session().parameters.session_number)
-				{
-					m_logger(log_level::trace) << "Received a SESSION_REQUEST from " << sender << " with session number " << _session_request_message.session_number() << " and cipher suite " << calg << "_" << ec << ". A current session exists but has the number " << p_session.current_session().parameters.session_number << ": preparing a new session and sending it.";
+				// We need to handle the response in the proper strand to avoid race conditions.
+				m_greet_strand.post(boost::bind(&server::do_handle_hello_response, this, sender, _hello_message.unique_number(), receive_time));
 
-					// A new session is requested. Sending a new message.
-					p_session.prepare_session(_session_request_message.session_number(), calg, ec);
-					do_send_session(identity, sender, p_session.next_session_parameters());
-				}
-				else
-				{
-					m_logger(log_level::trace) << "Received a SESSION_REQUEST from " << sender << " with session number " << _session_request_message.session_number() << " and cipher suite " << calg << "_" << ec << ". A current session exists and has the number " << p_session.current_session().parameters.session_number << ": sending the current session.";
+				break;
+			}
+			default:
+			{
+				// This should never happen.
+				assert(false);
 
-					// An old session is requested: sending the same message.
-					do_send_session(identity, sender, p_session.current_session_parameters());
-				}
+				break;
 			}
 		}
 	}
 
-	std::set<server::ep_type> server::get_session_endpoints() const
+	void server::do_handle_hello_request(const ep_type& sender, uint32_t hello_unique_number)
 	{
-		// All get_session_endpoints() calls are done in the same strand so the following is thread-safe.
-		std::set<ep_type> result;
+		// All do_handle_hello_request() calls are done in the same strand so the following is thread-safe.
+		bool can_reply = m_accept_hello_messages_default;
 
-		for (auto&& p_session: m_peer_sessions)
+		if (m_hello_message_received_handler)
 		{
-			if (p_session.second.has_current_session())
-			{
-				result.insert(p_session.first);
-			}
+			can_reply = m_hello_message_received_handler(sender, can_reply);
 		}
 
-		return result;
+		if (can_reply)
+		{
+			const auto send_buffer = SharedBuffer(16);
+			const size_t size = hello_message::write_response(buffer_cast<uint8_t*>(send_buffer), buffer_size(send_buffer), hello_unique_number);
+
+			async_send_to(
+				buffer(send_buffer, size),
+				sender,
+				make_shared_buffer_handler(
+					send_buffer,
+					boost::bind(
+						&server::handle_send_to,
+						this,
+						boost::asio::placeholders::error,
+						boost::asio::placeholders::bytes_transferred
+					)
+				)
+			);
+		}
 	}
 
-	bool server::has_session_with_endpoint(const ep_type& host)
+	void server::do_handle_hello_response(const ep_type& sender, uint32_t hello_unique_number, const boost::posix_time::ptime& receive_time)
 	{
-		// All has_session_with_endpoint() calls are done in the same strand so the following is thread-safe.
-		const auto p_session = m_peer_sessions.find(host);
+		// All do_handle_hello_response() calls are done in the same strand so the following is thread-safe.
+		size_t slot_index = 0;
 
-		if (p_session != m_peer_sessions.end())
+		if (!decode_hello_unique_number(hello_unique_number, slot_index))
 		{
-			return p_session->second.has_current_session();
+			// Unknown, stale or forged number: nothing to do.
+			return;
 		}
 
-		return false;
-	}
-
-	void server::do_get_session_endpoints(endpoints_handler_type handler)
-	{
-		// All do_get_session_endpoints() calls are done in the same strand so the following is thread-safe.
-		handler(get_session_endpoints());
-	}
-
-	void server::do_has_session_with_endpoint(const ep_type& host, boolean_handler_type handler)
-	{
-		// All do_has_session_with_endpoint() calls are done in the same strand so the following is thread-safe.
-		handler(has_session_with_endpoint(host));
-	}
+		hello_slot_type& slot = m_hello_slots[slot_index];
 
-	void server::do_set_accept_session_request_messages_default(bool value, void_handler_type handler)
-	{
-		// All do_set_hello_message_received_callback() calls are done in the same strand so the following is thread-safe.
-		set_accept_session_request_messages_default(value);
+		if (slot.target != sender)
+		{
+			// The number is valid but the response does not come from the greeted host.
+			return;
+		}
 
-		if (handler)
+		if (m_timer_wheel.cancel(slot.timer_id))
 		{
-			handler();
+			// The handler was cancelled which means we can set the success flag.
+			slot.success = true;
+			slot.response_date = receive_time;
 		}
 	}
 
-	void server::do_set_cipher_suites(cipher_suite_list_type cipher_suites, void_handler_type handler)
+	void server::do_set_accept_hello_messages_default(bool value, void_handler_type handler)
 	{
-		// All do_set_hello_message_received_callback() calls are done in the same strand so the following is thread-safe.
-		set_cipher_suites(cipher_suites);
+		// All do_set_accept_hello_messages_default() calls are done in the same strand so the following is thread-safe.
+		set_accept_hello_messages_default(value);
 
 		if (handler)
 		{
@@ -1678,10 +2545,10 @@ namespace fscp
 		}
 	}
 
-	void server::do_set_elliptic_curves(elliptic_curve_list_type elliptic_curves, void_handler_type handler)
+	void server::do_set_hello_message_received_callback(hello_message_received_handler_type callback, void_handler_type handler)
 	{
 		// All do_set_hello_message_received_callback() calls are done in the same strand so the following is thread-safe.
-		set_elliptic_curves(elliptic_curves);
+		set_hello_message_received_callback(callback);
 
 		if (handler)
 		{
@@ -1689,37 +2556,38 @@ namespace fscp
 		}
 	}
 
-	void server::do_set_session_request_message_received_callback(session_request_received_handler_type callback, void_handler_type handler)
+	bool server::has_presentation_store_for(const ep_type& ep) const
 	{
-		// All do_set_hello_message_received_callback() calls are done in the same strand so the following is thread-safe.
-		set_session_request_message_received_callback(callback);
+		// This method should only be called from within the presentation strand.
+		presentation_store_map::const_iterator presentation_store = m_presentation_store_map.find(ep);
 
-		if (handler)
+		if (presentation_store != m_presentation_store_map.end())
 		{
-			handler();
+			return !(presentation_store->second.empty());
 		}
+
+		return false;
 	}
 
-	void server::do_send_session(const identity_store& identity, const ep_type& target, const peer_session::session_parameters& parameters)
+	void server::do_introduce_to(const ep_type& target, simple_handler_type handler)
 	{
-		// All do_send_session() calls are done in the session strand so the following is thread-safe.
-		m_logger(log_level::trace) << "Sending session message to " << target << " (session number: " << parameters.session_number << ", cipher suite: " << parameters.cipher_suite << ", elliptic curve: " << parameters.elliptic_curve << ").";
+		// All do_introduce_to() calls are done in the same strand so the following is thread-safe.
+		if (!m_socket.is_open())
+		{
+			handler(server_error::server_offline);
 
-		peer_session& p_session = m_peer_sessions[target];
-		const auto send_buffer = SharedBuffer(65536);
+			return;
+		}
+
+		const identity_store& identity = get_identity();
+		const auto send_buffer = SharedBuffer(4096);
 
 		try
 		{
-			const size_t size = session_message::write(
+			const size_t size = presentation_message::write(
 				buffer_cast<uint8_t*>(send_buffer),
 				buffer_size(send_buffer),
-				parameters.session_number,
-				p_session.local_host_identifier(),
-				parameters.cipher_suite,
-				parameters.elliptic_curve,
-				buffer_cast<const void*>(parameters.public_key),
-				buffer_size(parameters.public_key),
-				identity.signature_key()
+				identity.signature_certificate()
 			);
 
 			async_send_to(
@@ -1728,206 +2596,2585 @@ namespace fscp
 				make_shared_buffer_handler(
 					send_buffer,
 					boost::bind(
-						&server::handle_send_to,
-						this,
-						boost::asio::placeholders::error,
-						boost::asio::placeholders::bytes_transferred
+						handler,
+						_1
 					)
 				)
 			);
 		}
 		catch (const boost::system::system_error& ex)
 		{
-			m_logger(log_level::error) << "Error sending session to " << target << ": " << ex.what() << ".";
+			handler(ex.code());
 		}
 	}
 
-	void server::do_handle_session(SharedBuffer data, const identity_store& identity, const ep_type& sender, const session_message& _session_message)
+	void server::do_reintroduce_to_all(multiple_endpoints_handler_type handler, const boost::posix_time::time_duration& pacing_window)
 	{
-		// All do_handle_session() calls are done in the same strand so the following is thread-safe.
+		// All do_reintroduce_to_all() calls are done in the same strand so the following is thread-safe.
+		typedef results_gatherer<ep_type, boost::system::error_code, multiple_endpoints_handler_type> results_gatherer_type;
 
-		if (!has_presentation_store_for(sender))
-		{
-			// No presentation_store for the given host.
-			// We do nothing.
-			m_logger(log_level::trace) << "Received a SESSION from " << sender << " but no presentation is available. Ignoring.";
+		results_gatherer_type::set_type targets;
 
-			return;
+		for (presentation_store_map::const_iterator presentation_store = m_presentation_store_map.begin(); presentation_store != m_presentation_store_map.end(); ++presentation_store)
+		{
+			targets.insert(presentation_store->first);
 		}
 
-		// We make sure the signatures matches.
-		if (!_session_message.check_signature(m_presentation_store_map[sender].signature_certificate().public_key()))
-		{
-			m_logger(log_level::trace) << "Received a SESSION from " << sender << " with an invalid signature. Ignoring.";
+		boost::shared_ptr<results_gatherer_type> rg = boost::make_shared<results_gatherer_type>(handler, targets);
 
-			return;
-		}
+		size_t index = 0;
 
-		m_session_strand.post(
-			make_shared_buffer_handler(
-				data,
+		for (results_gatherer_type::set_type::const_iterator target = targets.begin(); target != targets.end(); ++target, ++index)
+		{
+			const ep_type ep = *target;
+			const simple_handler_type gather_handler = boost::bind(&results_gatherer_type::gather, rg, ep, _1);
+			const boost::posix_time::time_duration delay = (pacing_window.total_microseconds() > 0) ? paced_delay(pacing_window, index, targets.size()) : boost::posix_time::time_duration();
+
+			if (delay.total_microseconds() <= 0)
+			{
+				async_introduce_to(ep, gather_handler);
+			}
+			else
+			{
+				// The timer wheel spreads the presentations over the pacing window. A cancelled entry - the wheel stops when the server closes - surfaces its error through the gatherer.
+				m_timer_wheel.async_wait(delay, [this, ep, gather_handler] (const boost::system::error_code& ec) {
+					if (ec)
+					{
+						gather_handler(ec);
+					}
+					else
+					{
+						async_introduce_to(ep, gather_handler);
+					}
+				});
+			}
+		}
+	}
+
+	void server::do_get_presentation(const ep_type& target, optional_presentation_store_handler_type handler)
+	{
+		// All do_get_presentation() calls are done in the same strand so the following is thread-safe.
+		handler(get_presentation(target));
+	}
+
+	void server::do_set_presentation(const ep_type& target, cert_type signature_certificate, void_handler_type handler)
+	{
+		// All do_set_presentation() calls are done in the same strand so the following is thread-safe.
+		set_presentation(target, signature_certificate);
+
+		if (handler)
+		{
+			handler();
+		}
+	}
+
+	void server::do_clear_presentation(const ep_type& target, void_handler_type handler)
+	{
+		// All do_set_presentation() calls are done in the same strand so the following is thread-safe.
+		clear_presentation(target);
+
+		if (handler)
+		{
+			handler();
+		}
+	}
+
+	void server::handle_presentation_message_from(const presentation_message& _presentation_message, const ep_type& sender)
+	{
+		const auto signature_certificate = _presentation_message.signature_certificate();
+
+		async_has_session_with_endpoint(sender, [this, sender, signature_certificate](bool has_session) {
+			m_presentation_strand.post(
+				boost::bind(
+					&server::do_handle_presentation,
+					this,
+					sender,
+					has_session,
+					signature_certificate
+				)
+			);
+		});
+	}
+
+	void server::do_handle_presentation(const ep_type& sender, bool has_session, cert_type signature_certificate)
+	{
+		// All do_handle_presentation() calls are done in the same strand so the following is thread-safe.
+		presentation_status_type presentation_status = PS_FIRST;
+
+		const presentation_store_map::iterator entry = m_presentation_store_map.find(sender);
+
+		if (entry != m_presentation_store_map.end())
+		{
+			if (compare_certificates(entry->second.signature_certificate(), signature_certificate))
+			{
+				presentation_status = PS_SAME;
+			}
+			else
+			{
+				presentation_status = PS_NEW;
+			}
+		}
+
+		if (m_presentation_message_received_handler)
+		{
+			// The handler typically verifies the certificate chain, which is by far the expensive part of presentation processing. It runs on the crypto thread pool so a burst of PRESENTATIONs - a rebooted node rejoining the mesh - verifies in parallel, and the presentation strand only consumes the verdicts.
+			const presentation_message_received_handler_type handler = m_presentation_message_received_handler;
+
+			m_crypto_io_service.post([this, sender, has_session, signature_certificate, presentation_status, handler] () {
+				if (handler(sender, signature_certificate, presentation_status, has_session))
+				{
+					m_presentation_strand.post(boost::bind(&server::do_accept_presentation, this, sender, signature_certificate));
+				}
+			});
+		}
+		else
+		{
+			set_presentation(sender, signature_certificate);
+		}
+	}
+
+	void server::do_accept_presentation(const ep_type& sender, cert_type signature_certificate)
+	{
+		// All do_accept_presentation() calls are done in the same strand so the following is thread-safe.
+		set_presentation(sender, signature_certificate);
+	}
+
+	void server::unindex_presentation(const ep_type& target)
+	{
+		// This method should only be called from within the presentation strand.
+		const presentation_store_map::const_iterator item = m_presentation_store_map.find(target);
+
+		if ((item == m_presentation_store_map.end()) || item->second.empty())
+		{
+			return;
+		}
+
+		const hash_type hash = item->second.signature_certificate_hash();
+		const presentation_hash_index_type::iterator index_item = m_presentation_hash_index.find(hash);
+
+		if ((index_item != m_presentation_hash_index.end()) && (index_item->second == target))
+		{
+			m_presentation_hash_index.erase(index_item);
+			m_presentation_hash_filter.erase(hash);
+
+			// Another endpoint may have presented the same certificate: reindex one so the hash remains resolvable.
+			for (presentation_store_map::const_iterator it = m_presentation_store_map.begin(); it != m_presentation_store_map.end(); ++it)
+			{
+				if ((it->first != target) && !it->second.empty() && (it->second.signature_certificate_hash() == hash))
+				{
+					m_presentation_hash_index[hash] = it->first;
+					m_presentation_hash_filter.insert(hash);
+
+					break;
+				}
+			}
+		}
+	}
+
+	void server::do_set_presentation_message_received_callback(presentation_message_received_handler_type callback, void_handler_type handler)
+	{
+		// All do_set_presentation_message_received_callback() calls are done in the same strand so the following is thread-safe.
+		set_presentation_message_received_callback(callback);
+
+		if (handler)
+		{
+			handler();
+		}
+	}
+
+	cipher_suite_type server::get_first_common_supported_cipher_suite(const cipher_suite_list_type& reference, const cipher_suite_list_type& capabilities, cipher_suite_type default_value = cipher_suite_type::unsupported)
+	{
+		for (auto&& cs : reference)
+		{
+			if (std::find(capabilities.begin(), capabilities.end(), cs) != capabilities.end())
+			{
+				return cs;
+			}
+		}
+
+		return default_value;
+	}
+
+	elliptic_curve_type server::get_first_common_supported_elliptic_curve(const elliptic_curve_list_type& reference, const elliptic_curve_list_type& capabilities, elliptic_curve_type default_value = elliptic_curve_type::unsupported)
+
+	{
+		for (auto&& cs : reference)
+		{
+			if (std::find(capabilities.begin(), capabilities.end(), cs) != capabilities.end())
+			{
+				return cs;
+			}
+		}
+
+		return default_value;
+	}
+
+	compression_algorithm_type server::get_first_common_supported_compression_algorithm(const compression_algorithm_list_type& reference, const compression_algorithm_list_type& capabilities, compression_algorithm_type default_value = compression_algorithm_type::none)
+
+	{
+		for (auto&& cs : reference)
+		{
+			if (std::find(capabilities.begin(), capabilities.end(), cs) != capabilities.end())
+			{
+				return cs;
+			}
+		}
+
+		return default_value;
+	}
+
+	void server::record_peer_version(const ep_type& sender, unsigned char version)
+	{
+		boost::mutex::scoped_lock lock(m_peer_versions_mutex);
+
+		unsigned char& recorded = m_peer_versions[sender];
+
+		if (version > recorded)
+		{
+			recorded = version;
+		}
+	}
+
+	unsigned char server::get_peer_version(const ep_type& target) const
+	{
+		boost::mutex::scoped_lock lock(m_peer_versions_mutex);
+
+		const std::map<ep_type, unsigned char>::const_iterator version = m_peer_versions.find(target);
+
+		// An endpoint that was never heard from is assumed to speak version 3.
+		return (version != m_peer_versions.end()) ? version->second : 3;
+	}
+
+	void server::do_request_session(const identity_store& identity, const ep_type& target, simple_handler_type handler)
+	{
+		// All do_request_session() calls are done in the session strand so the following is thread-safe.
+		if (!m_socket.is_open())
+		{
+			handler(server_error::server_offline);
+
+			return;
+		}
+
+		peer_session& p_session = m_peer_sessions[target];
+
+		if (p_session.has_current_session())
+		{
+			handler(server_error::session_already_exist);
+
+			return;
+		}
+
+		if (m_session_resumption && do_request_session_resumption(target, handler))
+		{
+			// A resumption request was sent instead: one HMAC-authenticated round-trip re-keys from the cached secret.
+			return;
+		}
+
+		// The negotiation starts now: the timestamp feeds the handshake duration histogram once the session is established.
+		m_handshake_start_map[target] = boost::posix_time::microsec_clock::universal_time();
+
+		const auto send_buffer = SharedBuffer(65536);
+
+		const auto next_session_number = p_session.next_session_number();
+		const auto local_host_identifier = p_session.local_host_identifier();
+
+		// The cipher suite and curve lists belong to the session strand: copy them now so the message can be built elsewhere.
+		const auto cipher_suites = m_cipher_suites;
+		const auto elliptic_curves = m_elliptic_curves;
+		const auto compression_algorithms = m_compression_algorithms;
+
+		// The extended (version 4) layout is only sent to hosts that were seen speaking version 4: a version 3 host would misparse the compression capability list and fail the signature check.
+		const unsigned char peer_version = get_peer_version(target);
+
+		FSCP_LOG(m_logger, log_level::trace) << "Sending session request message to " << target << " (next_session_number: " << next_session_number << ", local_host_identifier: " << local_host_identifier << ")";
+
+		const auto build_and_send = [this, identity, target, next_session_number, local_host_identifier, cipher_suites, elliptic_curves, compression_algorithms, peer_version, send_buffer, handler] () {
+			try
+			{
+				const size_t size = session_request_message::write(
+					buffer_cast<uint8_t*>(send_buffer),
+					buffer_size(send_buffer),
+					next_session_number,
+					local_host_identifier,
+					cipher_suites,
+					elliptic_curves,
+					compression_algorithms,
+					identity.signature_key(),
+					peer_version
+				);
+
+				async_send_to(
+					buffer(send_buffer, size),
+					target,
+					make_shared_buffer_handler(
+						send_buffer,
+						boost::bind(
+							handler,
+							boost::asio::placeholders::error
+						)
+					)
+				);
+			}
+			catch (const boost::system::system_error& ex)
+			{
+				handler(ex.code());
+			}
+		};
+
+		if (m_crypto_worker_count > 0)
+		{
+			// The signature dominates the cost of the message: building it on the crypto workers lets reconnection storms parallelize the handshake crypto across cores instead of serializing it on this strand.
+			m_crypto_io_service.post(build_and_send);
+		}
+		else
+		{
+			build_and_send();
+		}
+	}
+
+	void server::do_close_session(const ep_type& target, simple_handler_type handler)
+	{
+		// All do_close_session() calls are done in the same strand so the following is thread-safe.
+
+		if (m_peer_sessions[target].clear())
+		{
+			handler(server_error::success);
+
+			if (m_session_lost_handler)
+			{
+				m_session_lost_handler(target, session_loss_reason::manual_termination);
+			}
+		}
+		else
+		{
+			handler(server_error::no_session_for_host);
+		}
+	}
+
+	void server::do_handle_session_request(SharedBuffer data, const identity_store& identity, const ep_type& sender, const session_request_message& _session_request_message)
+	{
+		// All do_handle_session_request() calls are done in the presentation strand so the following is thread-safe.
+		if (!has_presentation_store_for(sender))
+		{
+			// No presentation_store for the given host.
+			// We do nothing.
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_REQUEST from " << sender << " but no presentation is available. Ignoring.";
+
+			return;
+		}
+
+		const cryptoplus::pkey::pkey public_key = m_presentation_store_map[sender].signature_certificate().public_key();
+
+		const auto verify_and_continue = [this, data, identity, sender, _session_request_message, public_key] () {
+			// We make sure the signatures matches.
+			if (!_session_request_message.check_signature(public_key))
+			{
+				FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_REQUEST from " << sender << " with an invalid signature. Ignoring.";
+
+				return;
+			}
+
+			// The make_shared_buffer_handler() call below is necessary so that the reference to session_request_message remains valid.
+			m_session_strand.post(
+				make_shared_buffer_handler(
+					data,
+					boost::bind(
+						&server::do_handle_verified_session_request,
+						this,
+						identity,
+						sender,
+						_session_request_message
+					)
+				)
+			);
+		};
+
+		if (m_crypto_worker_count > 0)
+		{
+			// The signature verification dominates the cost of handling the message: running it on the crypto workers lets unrelated peers' handshakes verify in parallel, with the strands only routing verdicts.
+			m_crypto_io_service.post(verify_and_continue);
+		}
+		else
+		{
+			verify_and_continue();
+		}
+	}
+
+	void server::do_handle_verified_session_request(const identity_store& identity, const ep_type& sender, const session_request_message& _session_request_message)
+	{
+		// All do_handle_verified_session_request() calls are done in the session strand so the following is thread-safe.
+
+		// Get the associated session, creating one if none exists.
+		peer_session& p_session = m_peer_sessions[sender];
+
+		if (!p_session.set_first_remote_host_identifier(_session_request_message.host_identifier()))
+		{
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_REQUEST from " << sender << " but the host identifier does not match (Received: " << _session_request_message.host_identifier() << ". Expected: " << *p_session.remote_host_identifier() << "). Ignoring.";
+
+			// The host identifier does not match.
+			return;
+		}
+
+		// The message is authenticated at this point: its version tells whether the peer understands the extended (session-number salted) key derivation.
+		p_session.set_extended_key_derivation(_session_request_message.version() >= COMPRESSION_PROTOCOL_VERSION);
+
+		const cipher_suite_list_type cipher_suites = _session_request_message.cipher_suite_capabilities();
+		const elliptic_curve_list_type elliptic_curves = _session_request_message.elliptic_curve_capabilities();
+		const cipher_suite_type calg = get_first_common_supported_cipher_suite(m_cipher_suites, cipher_suites);
+		const elliptic_curve_type ec = get_first_common_supported_elliptic_curve(m_elliptic_curves, elliptic_curves);
+		const compression_algorithm_type comp = get_first_common_supported_compression_algorithm(m_compression_algorithms, _session_request_message.compression_algorithm_capabilities());
+
+		if ((calg == cipher_suite_type::unsupported) || (ec == elliptic_curve_type::unsupported))
+		{
+			// No suitable cipher and/or elliptic curve is available.
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_REQUEST from " << sender << " but can't agree on the cipher suite to use (Cipher algorithm: " << calg  << ". Elliptic curve: " << ec << "). Ignoring";
+
+			return;
+		}
+
+		bool can_reply = m_accept_session_request_messages_default;
+
+		if (m_session_request_message_received_handler)
+		{
+			can_reply = m_session_request_message_received_handler(sender, cipher_suites, elliptic_curves, m_accept_session_request_messages_default);
+		}
+
+		if (!can_reply)
+		{
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_REQUEST from " << sender << " but not allowed to reply (`m_accept_session_request_messages_default` is " << m_accept_session_request_messages_default << ").";
+		}
+		else
+		{
+			if (!p_session.has_current_session())
+			{
+				FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_REQUEST from " << sender << " with session number " << _session_request_message.session_number() << " and cipher suite " << calg << "_" << ec << ". No current session exist: preparing one and sending it.";
+
+				p_session.prepare_session(_session_request_message.session_number(), calg, ec, comp, m_ecdhe_key_pool.acquire(ec));
+				do_send_session(identity, sender, p_session.next_session_parameters());
+			}
+			else
+			{
+				FSCP_LOG(m_logger, log_level::trace) << "Current session has number " << p_session.current_session().parameters.session_number << " and " << sender << " requests session number " << _session_request_message.session_number();
+
+				if (_session_request_message.session_number() > p_session.current_session().parameters.session_number)
+				{
+					FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_REQUEST from " << sender << " with session number " << _session_request_message.session_number() << " and cipher suite " << calg << "_" << ec << ". A current session exists but has the number " << p_session.current_session().parameters.session_number << ": preparing a new session and sending it.";
+
+					// A new session is requested. Sending a new message.
+					p_session.prepare_session(_session_request_message.session_number(), calg, ec, comp, m_ecdhe_key_pool.acquire(ec));
+					do_send_session(identity, sender, p_session.next_session_parameters());
+				}
+				else
+				{
+					FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_REQUEST from " << sender << " with session number " << _session_request_message.session_number() << " and cipher suite " << calg << "_" << ec << ". A current session exists and has the number " << p_session.current_session().parameters.session_number << ": sending the current session.";
+
+					// An old session is requested: sending the same message.
+					do_send_session(identity, sender, p_session.current_session_parameters());
+				}
+			}
+		}
+	}
+
+	std::set<server::ep_type> server::get_session_endpoints() const
+	{
+		// All get_session_endpoints() calls are done in the same strand so the following is thread-safe.
+		std::set<ep_type> result;
+
+		for (auto&& p_session: m_peer_sessions.snapshot())
+		{
+			if (p_session.second->has_current_session())
+			{
+				result.insert(p_session.first);
+			}
+		}
+
+		return result;
+	}
+
+	std::set<server::ep_type> server::get_session_endpoints_snapshot() const
+	{
+		// The sharded snapshot only locks each shard briefly and the per-session check is the same racy-but-benign read has_session_with_endpoint() already performs from any thread.
+		std::set<ep_type> result;
+
+		for (auto&& p_session: m_peer_sessions.snapshot())
+		{
+			if (p_session.second->has_current_session())
+			{
+				result.insert(p_session.first);
+			}
+		}
+
+		return result;
+	}
+
+	bool server::has_session_with_endpoint(const ep_type& host)
+	{
+		// has_session_with_endpoint() only performs a sharded lookup, so it is safe from any thread.
+		const auto p_session = m_peer_sessions.find(host);
+
+		if (p_session)
+		{
+			return p_session->has_current_session();
+		}
+
+		return false;
+	}
+
+	void server::do_get_session_endpoints(endpoints_handler_type handler)
+	{
+		// All do_get_session_endpoints() calls are done in the same strand so the following is thread-safe.
+		handler(get_session_endpoints());
+	}
+
+	void server::do_has_session_with_endpoint(const ep_type& host, boolean_handler_type handler)
+	{
+		// All do_has_session_with_endpoint() calls are done in the same strand so the following is thread-safe.
+		handler(has_session_with_endpoint(host));
+	}
+
+	void server::do_set_accept_session_request_messages_default(bool value, void_handler_type handler)
+	{
+		// All do_set_hello_message_received_callback() calls are done in the same strand so the following is thread-safe.
+		set_accept_session_request_messages_default(value);
+
+		if (handler)
+		{
+			handler();
+		}
+	}
+
+	void server::do_set_cipher_suites(cipher_suite_list_type cipher_suites, void_handler_type handler)
+	{
+		// All do_set_hello_message_received_callback() calls are done in the same strand so the following is thread-safe.
+		set_cipher_suites(cipher_suites);
+
+		if (handler)
+		{
+			handler();
+		}
+	}
+
+	void server::do_set_elliptic_curves(elliptic_curve_list_type elliptic_curves, void_handler_type handler)
+	{
+		// All do_set_hello_message_received_callback() calls are done in the same strand so the following is thread-safe.
+		set_elliptic_curves(elliptic_curves);
+
+		if (handler)
+		{
+			handler();
+		}
+	}
+
+	void server::do_set_session_request_message_received_callback(session_request_received_handler_type callback, void_handler_type handler)
+	{
+		// All do_set_hello_message_received_callback() calls are done in the same strand so the following is thread-safe.
+		set_session_request_message_received_callback(callback);
+
+		if (handler)
+		{
+			handler();
+		}
+	}
+
+	void server::do_send_session(const identity_store& identity, const ep_type& target, const peer_session::session_parameters& parameters)
+	{
+		// All do_send_session() calls are done in the session strand so the following is thread-safe.
+		FSCP_LOG(m_logger, log_level::trace) << "Sending session message to " << target << " (session number: " << parameters.session_number << ", cipher suite: " << parameters.cipher_suite << ", elliptic curve: " << parameters.elliptic_curve << ").";
+
+		peer_session& p_session = m_peer_sessions[target];
+		const auto send_buffer = SharedBuffer(65536);
+
+		// The session parameters belong to the peer session: copy what the builder needs so the message can be built elsewhere.
+		const auto session_number = parameters.session_number;
+		const auto cipher_suite = parameters.cipher_suite;
+		const auto elliptic_curve = parameters.elliptic_curve;
+		const auto compression_algorithm = parameters.compression_algorithm;
+		const auto public_key = parameters.public_key;
+		const auto local_host_identifier = p_session.local_host_identifier();
+
+		const auto build_and_send = [this, identity, target, session_number, local_host_identifier, cipher_suite, elliptic_curve, compression_algorithm, public_key, send_buffer] () {
+			try
+			{
+				const size_t size = session_message::write(
+					buffer_cast<uint8_t*>(send_buffer),
+					buffer_size(send_buffer),
+					session_number,
+					local_host_identifier,
+					cipher_suite,
+					elliptic_curve,
+					compression_algorithm,
+					buffer_cast<const void*>(public_key),
+					buffer_size(public_key),
+					identity.signature_key()
+				);
+
+				async_send_to(
+					buffer(send_buffer, size),
+					target,
+					make_shared_buffer_handler(
+						send_buffer,
+						boost::bind(
+							&server::handle_send_to,
+							this,
+							boost::asio::placeholders::error,
+							boost::asio::placeholders::bytes_transferred
+						)
+					)
+				);
+			}
+			catch (const boost::system::system_error& ex)
+			{
+				m_logger(log_level::error) << "Error sending session to " << target << ": " << ex.what() << ".";
+			}
+		};
+
+		if (m_crypto_worker_count > 0)
+		{
+			// The signature dominates the cost of the message: building it on the crypto workers lets reconnection storms parallelize the handshake crypto across cores instead of serializing it on this strand.
+			m_crypto_io_service.post(build_and_send);
+		}
+		else
+		{
+			build_and_send();
+		}
+	}
+
+	void server::do_handle_session(SharedBuffer data, const identity_store& identity, const ep_type& sender, const session_message& _session_message)
+	{
+		// All do_handle_session() calls are done in the same strand so the following is thread-safe.
+
+		if (!has_presentation_store_for(sender))
+		{
+			// No presentation_store for the given host.
+			// We do nothing.
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION from " << sender << " but no presentation is available. Ignoring.";
+
+			return;
+		}
+
+		const cryptoplus::pkey::pkey public_key = m_presentation_store_map[sender].signature_certificate().public_key();
+
+		const auto verify_and_continue = [this, data, identity, sender, _session_message, public_key] () {
+			// We make sure the signatures matches.
+			if (!_session_message.check_signature(public_key))
+			{
+				FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION from " << sender << " with an invalid signature. Ignoring.";
+
+				return;
+			}
+
+			m_session_strand.post(
+				make_shared_buffer_handler(
+					data,
+					boost::bind(
+						&server::do_handle_verified_session,
+						this,
+						identity,
+						sender,
+						_session_message
+					)
+				)
+			);
+		};
+
+		if (m_crypto_worker_count > 0)
+		{
+			// Same as for session requests: the verification parallelizes across the crypto workers instead of serializing every peer's handshake on one strand.
+			m_crypto_io_service.post(verify_and_continue);
+		}
+		else
+		{
+			verify_and_continue();
+		}
+	}
+
+	void server::do_handle_verified_session(const identity_store& identity, const ep_type& sender, const session_message& _session_message)
+	{
+		// All do_handle_verified_session() calls are done in the session strand so the following is thread-safe.
+		peer_session& p_session = m_peer_sessions[sender];
+
+		if (!p_session.set_first_remote_host_identifier(_session_message.host_identifier()))
+		{
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION from " << sender << " but the host identifier does not match (Received: " << _session_message.host_identifier() << ". Expected: " << *p_session.remote_host_identifier() << "). Ignoring.";
+
+			// The host identifier does not match.
+			return;
+		}
+
+		// The message is authenticated at this point: its version tells whether the peer understands the extended (session-number salted) key derivation.
+		p_session.set_extended_key_derivation(_session_message.version() >= COMPRESSION_PROTOCOL_VERSION);
+
+		const bool session_is_new = !p_session.has_current_session();
+
+		if (!session_is_new)
+		{
+			if (_session_message.session_number() == p_session.current_session().parameters.session_number)
+			{
+				// The session number matches the current session.
+				if (p_session.current_session().parameters.cipher_suite != _session_message.cipher_suite())
+				{
+					FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION from " << sender << " with session number " << _session_message.session_number() << " and cipher suite " << _session_message.cipher_suite() << ". A session currently exists and has the same number but its cipher suite does not match (" << p_session.current_session().parameters.cipher_suite << "): requesting a new session.";
+
+					// The parameters don't match the current session. Requesting a new one.
+					do_request_session(identity, sender, &null_simple_handler);
+				}
+				else
+				{
+					FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION from " << sender << " with session number " << _session_message.session_number() << " and cipher suite " << _session_message.cipher_suite() << ". A session currently exists and has the same number and cipher suite. Ignoring.";
+				}
+
+				return;
+			}
+			else if (_session_message.session_number() < p_session.current_session().parameters.session_number)
+			{
+				FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION from " << sender << " with session number " << _session_message.session_number() << " and cipher suite " << _session_message.cipher_suite() << ". A session currently exists and has a higher number (" << p_session.current_session().parameters.session_number << "). Ignoring.";
+
+				// This is an old session message. Ignore it.
+				return;
+			}
+		}
+
+		if (_session_message.cipher_suite() == cipher_suite_type::unsupported)
+		{
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION from " << sender << " with session number " << _session_message.session_number() << " but an unsupported cipher suite. Failing session handshake.";
+
+			if (m_session_failed_handler)
+			{
+				m_session_failed_handler(sender, session_is_new);
+			}
+
+			return;
+		}
+
+		if (!_session_message.compression_algorithm().is_valid())
+		{
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION from " << sender << " with session number " << _session_message.session_number() << " but an unknown compression algorithm (" << static_cast<int>(_session_message.compression_algorithm().value()) << "). Failing session handshake.";
+
+			if (m_session_failed_handler)
+			{
+				m_session_failed_handler(sender, session_is_new);
+			}
+
+			return;
+		}
+
+		bool can_accept = m_accept_session_messages_default;
+
+		if (m_session_message_received_handler)
+		{
+			can_accept = m_session_message_received_handler(sender, _session_message.cipher_suite(), _session_message.elliptic_curve(), can_accept);
+		}
+
+		if (!can_accept)
+		{
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION from " << sender << " but not allowed to accept (`m_accept_session_messages_default` is " << m_accept_session_messages_default << ").";
+		}
+		else
+		{
+			bool session_completed = true;
+
+			try
+			{
+				if (!p_session.complete_session(_session_message.public_key(), _session_message.public_key_size()))
+				{
+					FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION from " << sender << " with session number " << _session_message.session_number() << " but no session was prepared yet. Preparing a new one.";
+
+					// We received a session message but no session was prepared yet: we issue one and retry.
+					p_session.prepare_session(_session_message.session_number(), _session_message.cipher_suite(), _session_message.elliptic_curve(), _session_message.compression_algorithm(), m_ecdhe_key_pool.acquire(_session_message.elliptic_curve()));
+
+					if (!p_session.complete_session(_session_message.public_key(), _session_message.public_key_size()))
+					{
+						// Unable to complete the session.
+						m_logger(log_level::warning) << "Unable to compute the session keys with " << sender << ".";
+
+						return;
+					}
+				}
+			}
+			catch (const std::exception& ex)
+			{
+				session_completed = false;
+
+				m_logger(log_level::error) << "Exception while computing the session keys with " << sender << ": " << ex.what() << ".";
+
+				if (m_session_error_handler)
+				{
+					m_session_error_handler(sender, session_is_new, ex);
+				}
+			}
+
+			if (session_completed)
+			{
+				FSCP_LOG(m_logger, log_level::trace) << "Session established with " << sender << ". Sending acknowledgement session message back.";
+
+				do_send_session(identity, sender, p_session.current_session_parameters());
+
+				const auto handshake_start = m_handshake_start_map.find(sender);
+
+				if (handshake_start != m_handshake_start_map.end())
+				{
+					const boost::posix_time::time_duration handshake_duration = boost::posix_time::microsec_clock::universal_time() - handshake_start->second;
+
+					m_handshake_duration_histogram.record(static_cast<uint64_t>(handshake_duration.total_milliseconds()));
+
+					m_handshake_start_map.erase(handshake_start);
+				}
+
+				if (m_session_established_handler)
+				{
+					m_session_established_handler(sender, session_is_new, p_session.current_session().parameters.cipher_suite, p_session.current_session().parameters.elliptic_curve);
+				}
+
+				if (m_session_resumption)
+				{
+					do_cache_session_resumption(sender, p_session);
+				}
+			}
+		}
+	}
+
+	void server::do_cache_session_resumption(const ep_type& host, const peer_session& p_session)
+	{
+		// All do_cache_session_resumption() calls are done in the session strand so the following is thread-safe.
+		if (!p_session.has_resumption_secret() || !p_session.has_current_session())
+		{
+			return;
+		}
+
+		const peer_session::session_parameters& parameters = p_session.current_session().parameters;
+
+		session_resumption_context_type& context = m_session_resumption_contexts[host];
+
+		context.secret = p_session.resumption_secret();
+		context.cipher_suite = parameters.cipher_suite;
+		context.elliptic_curve = parameters.elliptic_curve;
+		context.compression_algorithm = parameters.compression_algorithm;
+		context.expiry = boost::posix_time::microsec_clock::universal_time() + SESSION_RESUMPTION_VALIDITY;
+		context.pending = false;
+	}
+
+	bool server::do_request_session_resumption(const ep_type& target, simple_handler_type handler)
+	{
+		// All do_request_session_resumption() calls are done in the session strand so the following is thread-safe.
+		const auto context_it = m_session_resumption_contexts.find(target);
+
+		if (context_it == m_session_resumption_contexts.end())
+		{
+			return false;
+		}
+
+		session_resumption_context_type& context = context_it->second;
+
+		if (boost::posix_time::microsec_clock::universal_time() > context.expiry)
+		{
+			m_session_resumption_contexts.erase(context_it);
+
+			return false;
+		}
+
+		if (context.pending)
+		{
+			// The previous resumption request went unanswered: the peer probably lost its secret or does not resume. Fall back to the full handshake.
+			m_session_resumption_contexts.erase(context_it);
+
+			return false;
+		}
+
+		peer_session& p_session = m_peer_sessions[target];
+
+		context.pending = true;
+		context.session_number = p_session.next_session_number();
+		cryptoplus::random::get_random_bytes(context.request_nonce.data(), context.request_nonce.size());
+
+		// The negotiation starts now: the timestamp feeds the handshake duration histogram once the session is established.
+		m_handshake_start_map[target] = boost::posix_time::microsec_clock::universal_time();
+
+		FSCP_LOG(m_logger, log_level::trace) << "Sending session resumption request message to " << target << " (session number: " << context.session_number << ").";
+
+		const auto send_buffer = SharedBuffer(1024);
+
+		// Unlike the signed handshake messages, the HMAC is cheap enough to build right here in the session strand.
+		try
+		{
+			const size_t size = session_resumption_message::write(
+				buffer_cast<uint8_t*>(send_buffer),
+				buffer_size(send_buffer),
+				MESSAGE_TYPE_SESSION_RESUMPTION_REQUEST,
+				context.session_number,
+				p_session.local_host_identifier(),
+				context.request_nonce.data(),
+				context.cipher_suite,
+				context.elliptic_curve,
+				context.compression_algorithm,
+				context.secret
+			);
+
+			async_send_to(
+				buffer(send_buffer, size),
+				target,
+				make_shared_buffer_handler(
+					send_buffer,
+					boost::bind(
+						handler,
+						boost::asio::placeholders::error
+					)
+				)
+			);
+		}
+		catch (const boost::system::system_error& ex)
+		{
+			handler(ex.code());
+		}
+
+		return true;
+	}
+
+	void server::do_handle_session_resumption_request(const ep_type& sender, const session_resumption_message& _session_resumption_message)
+	{
+		// All do_handle_session_resumption_request() calls are done in the session strand so the following is thread-safe.
+		if (!m_session_resumption)
+		{
+			return;
+		}
+
+		const auto context_it = m_session_resumption_contexts.find(sender);
+
+		if (context_it == m_session_resumption_contexts.end())
+		{
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_RESUMPTION_REQUEST from " << sender << " but no resumption secret is cached. Ignoring.";
+
+			return;
+		}
+
+		session_resumption_context_type& context = context_it->second;
+
+		if (boost::posix_time::microsec_clock::universal_time() > context.expiry)
+		{
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_RESUMPTION_REQUEST from " << sender << " but the cached resumption secret expired. Ignoring.";
+
+			m_session_resumption_contexts.erase(context_it);
+
+			return;
+		}
+
+		if (!_session_resumption_message.check_hmac(context.secret))
+		{
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_RESUMPTION_REQUEST from " << sender << " with an invalid HMAC. Ignoring.";
+
+			return;
+		}
+
+		peer_session& p_session = m_peer_sessions[sender];
+
+		if (!p_session.set_first_remote_host_identifier(_session_resumption_message.host_identifier()))
+		{
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_RESUMPTION_REQUEST from " << sender << " but the host identifier does not match. Ignoring.";
+
+			return;
+		}
+
+		if (context.pending && !(p_session.local_host_identifier() < _session_resumption_message.host_identifier()))
+		{
+			// Both hosts initiated a resumption at the same time: the host with the lower identifier yields and answers the peer's request, the other ignores it and waits for the answer to its own.
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_RESUMPTION_REQUEST from " << sender << " while our own resumption request is outstanding. Letting the peer answer ours.";
+
+			return;
+		}
+
+		if (p_session.has_current_session() && (_session_resumption_message.session_number() <= p_session.current_session().parameters.session_number))
+		{
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_RESUMPTION_REQUEST from " << sender << " with session number " << _session_resumption_message.session_number() << " but the current session has the number " << p_session.current_session().parameters.session_number << ". Ignoring.";
+
+			return;
+		}
+
+		if ((_session_resumption_message.cipher_suite() != context.cipher_suite) || (_session_resumption_message.elliptic_curve() != context.elliptic_curve) || (_session_resumption_message.compression_algorithm() != context.compression_algorithm))
+		{
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_RESUMPTION_REQUEST from " << sender << " whose parameters do not match the resumed session. Ignoring.";
+
+			return;
+		}
+
+		boost::array<uint8_t, SESSION_RESUMPTION_NONCE_SIZE> response_nonce;
+		cryptoplus::random::get_random_bytes(response_nonce.data(), response_nonce.size());
+
+		// The secret is single-use: keep a copy to key the response, then discard the cached entry.
+		const cryptoplus::buffer secret = context.secret;
+		const peer_session::session_parameters parameters(_session_resumption_message.session_number(), context.cipher_suite, context.elliptic_curve, context.compression_algorithm, cryptoplus::buffer());
+
+		m_session_resumption_contexts.erase(context_it);
+
+		const bool session_is_new = !p_session.has_current_session();
+
+		try
+		{
+			if (!p_session.resume_session(parameters, secret, _session_resumption_message.nonce(), response_nonce.data()))
+			{
+				return;
+			}
+		}
+		catch (const std::exception& ex)
+		{
+			m_logger(log_level::error) << "Exception while resuming the session with " << sender << ": " << ex.what() << ".";
+
+			if (m_session_error_handler)
+			{
+				m_session_error_handler(sender, session_is_new, ex);
+			}
+
+			return;
+		}
+
+		FSCP_LOG(m_logger, log_level::trace) << "Session resumed with " << sender << " (session number: " << _session_resumption_message.session_number() << "). Sending acknowledgement resumption message back.";
+
+		const auto send_buffer = SharedBuffer(1024);
+
+		try
+		{
+			const size_t size = session_resumption_message::write(
+				buffer_cast<uint8_t*>(send_buffer),
+				buffer_size(send_buffer),
+				MESSAGE_TYPE_SESSION_RESUMPTION,
+				_session_resumption_message.session_number(),
+				p_session.local_host_identifier(),
+				response_nonce.data(),
+				parameters.cipher_suite,
+				parameters.elliptic_curve,
+				parameters.compression_algorithm,
+				secret
+			);
+
+			async_send_to(
+				buffer(send_buffer, size),
+				sender,
+				make_shared_buffer_handler(
+					send_buffer,
+					boost::bind(
+						&server::handle_send_to,
+						this,
+						boost::asio::placeholders::error,
+						boost::asio::placeholders::bytes_transferred
+					)
+				)
+			);
+		}
+		catch (const boost::system::system_error& ex)
+		{
+			m_logger(log_level::error) << "Error sending session resumption to " << sender << ": " << ex.code() << ".";
+		}
+
+		if (m_session_established_handler)
+		{
+			m_session_established_handler(sender, session_is_new, parameters.cipher_suite, parameters.elliptic_curve);
+		}
+
+		// The resumed session derived a fresh resumption secret: cache it for the next blip.
+		do_cache_session_resumption(sender, p_session);
+	}
+
+	void server::do_handle_session_resumption_response(const ep_type& sender, const session_resumption_message& _session_resumption_message)
+	{
+		// All do_handle_session_resumption_response() calls are done in the session strand so the following is thread-safe.
+		if (!m_session_resumption)
+		{
+			return;
+		}
+
+		const auto context_it = m_session_resumption_contexts.find(sender);
+
+		if ((context_it == m_session_resumption_contexts.end()) || !context_it->second.pending)
+		{
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_RESUMPTION from " << sender << " but no resumption request is outstanding. Ignoring.";
+
+			return;
+		}
+
+		session_resumption_context_type& context = context_it->second;
+
+		if (!_session_resumption_message.check_hmac(context.secret))
+		{
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_RESUMPTION from " << sender << " with an invalid HMAC. Ignoring.";
+
+			return;
+		}
+
+		peer_session& p_session = m_peer_sessions[sender];
+
+		if (!p_session.set_first_remote_host_identifier(_session_resumption_message.host_identifier()))
+		{
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_RESUMPTION from " << sender << " but the host identifier does not match. Ignoring.";
+
+			return;
+		}
+
+		if (_session_resumption_message.session_number() != context.session_number)
+		{
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_RESUMPTION from " << sender << " with session number " << _session_resumption_message.session_number() << " but " << context.session_number << " was requested. Ignoring.";
+
+			return;
+		}
+
+		if ((_session_resumption_message.cipher_suite() != context.cipher_suite) || (_session_resumption_message.elliptic_curve() != context.elliptic_curve) || (_session_resumption_message.compression_algorithm() != context.compression_algorithm))
+		{
+			FSCP_LOG(m_logger, log_level::trace) << "Received a SESSION_RESUMPTION from " << sender << " whose parameters do not match the resumed session. Ignoring.";
+
+			return;
+		}
+
+		const cryptoplus::buffer secret = context.secret;
+		const boost::array<uint8_t, SESSION_RESUMPTION_NONCE_SIZE> request_nonce = context.request_nonce;
+		const peer_session::session_parameters parameters(context.session_number, context.cipher_suite, context.elliptic_curve, context.compression_algorithm, cryptoplus::buffer());
+
+		m_session_resumption_contexts.erase(context_it);
+
+		const bool session_is_new = !p_session.has_current_session();
+
+		try
+		{
+			if (!p_session.resume_session(parameters, secret, request_nonce.data(), _session_resumption_message.nonce()))
+			{
+				return;
+			}
+		}
+		catch (const std::exception& ex)
+		{
+			m_logger(log_level::error) << "Exception while resuming the session with " << sender << ": " << ex.what() << ".";
+
+			if (m_session_error_handler)
+			{
+				m_session_error_handler(sender, session_is_new, ex);
+			}
+
+			return;
+		}
+
+		FSCP_LOG(m_logger, log_level::trace) << "Session resumed with " << sender << " (session number: " << context.session_number << ").";
+
+		const auto handshake_start = m_handshake_start_map.find(sender);
+
+		if (handshake_start != m_handshake_start_map.end())
+		{
+			const boost::posix_time::time_duration handshake_duration = boost::posix_time::microsec_clock::universal_time() - handshake_start->second;
+
+			m_handshake_duration_histogram.record(static_cast<uint64_t>(handshake_duration.total_milliseconds()));
+
+			m_handshake_start_map.erase(handshake_start);
+		}
+
+		if (m_session_established_handler)
+		{
+			m_session_established_handler(sender, session_is_new, parameters.cipher_suite, parameters.elliptic_curve);
+		}
+
+		// The resumed session derived a fresh resumption secret: cache it for the next blip.
+		do_cache_session_resumption(sender, p_session);
+	}
+
+	void server::do_set_accept_session_messages_default(bool value, void_handler_type handler)
+	{
+		// All do_set_accept_session_messages_default() calls are done in the same strand so the following is thread-safe.
+		set_accept_session_messages_default(value);
+
+		if (handler)
+		{
+			handler();
+		}
+	}
+
+	void server::do_set_session_message_received_callback(session_received_handler_type callback, void_handler_type handler)
+	{
+		// All do_set_session_message_received_callback() calls are done in the same strand so the following is thread-safe.
+		set_session_message_received_callback(callback);
+
+		if (handler)
+		{
+			handler();
+		}
+	}
+
+	void server::do_set_session_failed_callback(session_failed_handler_type callback, void_handler_type handler)
+	{
+		// All do_set_session_failed_callback() calls are done in the same strand so the following is thread-safe.
+		set_session_failed_callback(callback);
+
+		if (handler)
+		{
+			handler();
+		}
+	}
+
+	void server::do_set_session_error_callback(session_error_handler_type callback, void_handler_type handler)
+	{
+		// All do_set_session_error_callback() calls are done in the same strand so the following is thread-safe.
+		set_session_error_callback(callback);
+
+		if (handler)
+		{
+			handler();
+		}
+	}
+
+	void server::do_set_session_established_callback(session_established_handler_type callback, void_handler_type handler)
+	{
+		// All do_set_session_established_callback() calls are done in the same strand so the following is thread-safe.
+		set_session_established_callback(callback);
+
+		if (handler)
+		{
+			handler();
+		}
+	}
+
+	void server::do_set_session_lost_callback(session_lost_handler_type callback, void_handler_type handler)
+	{
+		// All do_set_session_lost_callback() calls are done in the same strand so the following is thread-safe.
+		set_session_lost_callback(callback);
+
+		if (handler)
+		{
+			handler();
+		}
+	}
+
+	boost::shared_ptr<counted_strand> server::crypto_strand_for(const ep_type& host)
+	{
+		// All crypto_strand_for() calls are done in the session strand so the following is thread-safe.
+		boost::shared_ptr<counted_strand>& p_strand = m_crypto_strands[host];
+
+		if (!p_strand)
+		{
+			// All the per-host strands share one gauge: a scrape wants the backlog of the crypto stage as a whole.
+			p_strand = boost::make_shared<counted_strand>(boost::ref(m_crypto_io_service), boost::ref(m_crypto_strands_pending));
+		}
+
+		return p_strand;
+	}
+
+	void server::do_send_data(const ep_type& requested_target, channel_number_type channel_number, boost::asio::const_buffer data, simple_handler_type handler)
+	{
+		// All do_send_data() calls are done in the session strand so the following is thread-safe.
+
+		// With multipath enabled the datagram may leave through a sibling endpoint of the same host, over that path's own session.
+		const ep_type target = select_path(requested_target);
+
+		peer_session& p_session = m_peer_sessions[target];
+
+		do_send_data_to_session(p_session, target, channel_number, data, handler);
+	}
+
+	void server::do_send_data_in_place(const ep_type& requested_target, channel_number_type channel_number, SharedBuffer frame, boost::asio::const_buffer data, simple_handler_type handler)
+	{
+		// All do_send_data_in_place() calls are done in the session strand so the following is thread-safe.
+
+		// With multipath enabled the datagram may leave through a sibling endpoint of the same host, over that path's own session.
+		const ep_type target = select_path(requested_target);
+
+		peer_session& p_session = m_peer_sessions[target];
+
+		if (!m_socket.is_open())
+		{
+			handler(server_error::server_offline);
+
+			return;
+		}
+
+		if (!p_session.has_current_session())
+		{
+			handler(server_error::no_session_for_host);
+
+			return;
+		}
+
+		if (m_crypto_worker_count > 0)
+		{
+			if (!acquire_peer_send_slot(target, channel_number, frame, data, handler))
+			{
+				return;
+			}
+
+			// The sealing is deferred to the crypto workers. The sequence number, cipher context, nonce prefix and compression algorithm are captured here, in the session strand, so a concurrent rekey cannot swap them under the workers' feet.
+			const auto sequence_number = p_session.increment_local_sequence_number();
+			const auto cipher_context = p_session.current_session().local_cipher_context;
+			const auto nonce_prefix = p_session.current_session().local_nonce_prefix;
+			const auto compression = p_session.current_session().parameters.compression_algorithm;
+
+			crypto_strand_for(target)->post([this, target, channel_number, sequence_number, cipher_context, nonce_prefix, compression, frame, data, handler] () {
+				do_seal_and_send(target, channel_number, sequence_number, cipher_context, nonce_prefix, compression, frame, data, handler);
+			});
+
+			return;
+		}
+
+		const uint8_t* const cleartext = buffer_cast<const uint8_t*>(data);
+		const size_t cleartext_len = buffer_size(data);
+		const size_t block_size = p_session.current_session().parameters.cipher_suite.to_cipher_algorithm().block_size();
+
+		// The in-place path requires the cleartext to sit exactly where the ciphertext goes, with enough room behind it for the cipher to finalize.
+		if ((cleartext != buffer_cast<const uint8_t*>(frame) + data_message::DATA_PAYLOAD_OFFSET) || (data_message::DATA_PAYLOAD_OFFSET + cleartext_len + block_size > buffer_size(frame)))
+		{
+			do_send_data_to_session(p_session, target, channel_number, data, handler);
+
+			return;
+		}
+
+		if (!acquire_peer_send_slot(target, channel_number, frame, data, handler))
+		{
+			return;
+		}
+
+		try
+		{
+			// AES-GCM runs in counter mode and supports overlapping source and destination: the header, tag and length are written into the room reserved in front of the cleartext.
+			const size_t size = data_message::write(
+				buffer_cast<uint8_t*>(frame),
+				buffer_size(frame),
+				channel_number,
+				p_session.increment_local_sequence_number(),
+				*p_session.current_session().local_cipher_context,
+				cleartext,
+				cleartext_len,
+				buffer_cast<const uint8_t*>(p_session.current_session().local_nonce_prefix),
+				buffer_size(p_session.current_session().local_nonce_prefix),
+				p_session.current_session().parameters.compression_algorithm
+			);
+
+			async_send_datagram(frame, size, target, channel_number, handler);
+		}
+		catch (const boost::system::system_error& ex)
+		{
+			handler(ex.code());
+		}
+	}
+
+	void server::do_seal_and_send(const ep_type& target, channel_number_type channel_number, sequence_number_type sequence_number, boost::shared_ptr<cryptoplus::cipher::cipher_context> cipher_context, cryptoplus::buffer nonce_prefix, compression_algorithm_type compression, SharedBuffer frame, boost::asio::const_buffer data, simple_handler_type handler)
+	{
+		// All do_seal_and_send() calls for a given host are done in the same crypto strand: the shared cipher context is never used concurrently and the datagrams are queued in order.
+		const uint8_t* const cleartext = buffer_cast<const uint8_t*>(data);
+		const size_t cleartext_len = buffer_size(data);
+		const size_t block_size = cipher_context->algorithm().block_size();
+
+		// The datagram is built in the caller's frame when the cleartext already sits at the expected offset, in a buffer of our own otherwise.
+		SharedBuffer send_buffer = frame;
+
+		if ((buffer_size(frame) == 0) || (cleartext != buffer_cast<const uint8_t*>(frame) + data_message::DATA_PAYLOAD_OFFSET) || (data_message::DATA_PAYLOAD_OFFSET + cleartext_len + block_size > buffer_size(frame)))
+		{
+			send_buffer = SharedBuffer(65536);
+		}
+
+		try
+		{
+			const size_t size = data_message::write(
+				buffer_cast<uint8_t*>(send_buffer),
+				buffer_size(send_buffer),
+				channel_number,
+				sequence_number,
+				*cipher_context,
+				cleartext,
+				cleartext_len,
+				buffer_cast<const uint8_t*>(nonce_prefix),
+				buffer_size(nonce_prefix),
+				compression
+			);
+
+			async_send_datagram(send_buffer, size, target, channel_number, handler);
+		}
+		catch (const boost::system::system_error& ex)
+		{
+			handler(ex.code());
+		}
+	}
+
+	void server::do_send_data_to_list(endpoint_set_ptr _targets, channel_number_type channel_number, boost::asio::const_buffer data, multiple_endpoints_handler_type handler)
+	{
+		// All do_send_data_to_list() calls are done in the session strand so the following is thread-safe.
+		typedef results_gatherer<ep_type, boost::system::error_code, multiple_endpoints_handler_type> results_gatherer_type;
+
+		const std::set<ep_type>& targets = *_targets;
+
+		if ((targets.size() > 1) && (buffer_pool::instance().pressure_level() >= buffer_pool::PRESSURE_SHED_BROADCASTS))
+		{
+			// Approaching the memory ceiling, fan-out goes first: one frame sealed for N peers multiplies its buffer footprint by N, and broadcast traffic tolerates loss by design.
+			m_shed_memory_counter.increment();
+
+			std::map<ep_type, boost::system::error_code> results;
+
+			for (std::set<ep_type>::const_iterator target = targets.begin(); target != targets.end(); ++target)
+			{
+				results[*target] = make_error_code(server_error::memory_pressure);
+			}
+
+			handler(results);
+
+			return;
+		}
+
+		boost::shared_ptr<results_gatherer_type> rg = boost::make_shared<results_gatherer_type>(handler, targets);
+
+#ifdef __linux__
+		if (m_crypto_worker_count > 0)
+		{
+			// With the crypto workers enabled each target is sealed on its own strand, which loses the sendmmsg() batching but parallelizes the encryption across hosts.
+			for (auto&& item: m_peer_sessions.snapshot())
+			{
+				if (targets.count(item.first) > 0)
+				{
+					do_send_data_to_session(*item.second, item.first, channel_number, data, boost::bind(&results_gatherer_type::gather, rg, item.first, _1));
+				}
+			}
+
+			return;
+		}
+
+		// Build every per-peer datagram first and flush them all with a single sendmmsg() call: fanning a frame out to hundreds of peers otherwise costs one system call each.
+		boost::shared_ptr<datagram_batch_type> batch = boost::make_shared<datagram_batch_type>();
+		batch->reserve(targets.size());
+
+		for (auto&& item: m_peer_sessions.snapshot())
+		{
+			if (targets.count(item.first) > 0)
+			{
+				build_data_datagram(*item.second, item.first, channel_number, data, boost::bind(&results_gatherer_type::gather, rg, item.first, _1), *batch);
+			}
+		}
+
+		if (!batch->empty())
+		{
+			m_write_queue_strand.post(boost::bind(&server::push_channel_write, this, channel_number, void_handler_type(boost::bind(&server::do_flush_datagram_batch, this, batch)), void_handler_type()));
+		}
+#else
+		for (auto&& item: m_peer_sessions.snapshot())
+		{
+			if (targets.count(item.first) > 0)
+			{
+				do_send_data_to_session(*item.second, item.first, channel_number, data, boost::bind(&results_gatherer_type::gather, rg, item.first, _1));
+			}
+		}
+#endif
+	}
+
+	void server::do_send_data_to_all(channel_number_type channel_number, boost::asio::const_buffer data, multiple_endpoints_handler_type handler)
+	{
+		// All do_send_data_to_all() calls are done in the session strand so the following is thread-safe.
+		do_send_data_to_list(boost::make_shared<std::set<ep_type> >(get_session_endpoints()), channel_number, data, handler);
+	}
+
+	void server::do_send_data_to_session(peer_session& p_session, const ep_type& target, channel_number_type channel_number, boost::asio::const_buffer data, simple_handler_type handler)
+	{
+		// All do_send_data_to_session() calls are done in the session strand so the following is thread-safe.
+		if (!m_socket.is_open())
+		{
+			handler(server_error::server_offline);
+
+			return;
+		}
+
+		if (!p_session.has_current_session())
+		{
+			handler(server_error::no_session_for_host);
+
+			return;
+		}
+
+		m_data_bytes_out_counter.increment(buffer_size(data));
+
+		{
+			// The send path is serialized by the session strand: the mutex only guards against concurrent scrapes.
+			boost::mutex::scoped_lock lock(m_peer_statistics_mutex);
+
+			peer_statistics& stats = m_peer_statistics[target];
+			stats.tx_bytes += buffer_size(data);
+			stats.tx_packets++;
+		}
+
+		if (!acquire_peer_send_slot(target, channel_number, SharedBuffer(), data, handler))
+		{
+			return;
+		}
+
+		if (m_crypto_worker_count > 0)
+		{
+			// The sealing is deferred to the crypto workers. The sequence number, cipher context, nonce prefix and compression algorithm are captured here, in the session strand, so a concurrent rekey cannot swap them under the workers' feet.
+			const auto sequence_number = p_session.increment_local_sequence_number();
+			const auto cipher_context = p_session.current_session().local_cipher_context;
+			const auto nonce_prefix = p_session.current_session().local_nonce_prefix;
+			const auto compression = p_session.current_session().parameters.compression_algorithm;
+
+			crypto_strand_for(target)->post([this, target, channel_number, sequence_number, cipher_context, nonce_prefix, compression, data, handler] () {
+				do_seal_and_send(target, channel_number, sequence_number, cipher_context, nonce_prefix, compression, SharedBuffer(), data, handler);
+			});
+
+			return;
+		}
+
+		const auto send_buffer = SharedBuffer(65536);
+
+		try
+		{
+			const size_t size = data_message::write(
+				buffer_cast<uint8_t*>(send_buffer),
+				buffer_size(send_buffer),
+				channel_number,
+				p_session.increment_local_sequence_number(),
+				*p_session.current_session().local_cipher_context,
+				buffer_cast<const uint8_t*>(data),
+				buffer_size(data),
+				buffer_cast<const uint8_t*>(p_session.current_session().local_nonce_prefix),
+				buffer_size(p_session.current_session().local_nonce_prefix),
+				p_session.current_session().parameters.compression_algorithm
+			);
+
+			async_send_datagram(send_buffer, size, target, channel_number, handler);
+		}
+		catch (const boost::system::system_error& ex)
+		{
+			handler(ex.code());
+		}
+	}
+
+	bool server::acquire_peer_send_slot(const ep_type& target, channel_number_type channel_number, SharedBuffer frame, boost::asio::const_buffer data, simple_handler_type& handler)
+	{
+		// All acquire_peer_send_slot() calls are done in the session strand so the following is thread-safe.
+		if (m_peer_send_queue_depth == 0)
+		{
+			return true;
+		}
+
+		peer_egress_state_type& state = m_peer_egress_states[target];
+
+		if (state.in_flight < m_peer_send_queue_depth)
+		{
+			state.in_flight++;
+
+			handler = boost::bind(&server::handle_peer_send_complete, this, target, handler, _1);
+
+			return true;
+		}
+
+		if (state.pending.size() >= m_peer_send_queue_depth)
+		{
+			if (m_peer_send_queue_policy == PSQ_DROP_OLDEST)
+			{
+				// Evict the oldest parked datagram to make room for the incoming one.
+				const pending_peer_send_type evicted = state.pending.front();
+				state.pending.pop_front();
+
+				evicted.handler(server_error::egress_queue_full);
+			}
+			else
+			{
+				handler(server_error::egress_queue_full);
+
+				return false;
+			}
+		}
+
+		const pending_peer_send_type pending_send = { channel_number, frame, data, handler };
+		state.pending.push_back(pending_send);
+
+		if (!state.congested)
+		{
+			state.congested = true;
+
+			if (m_peer_congestion_handler)
+			{
+				m_peer_congestion_handler(target, true);
+			}
+		}
+
+		return false;
+	}
+
+	void server::handle_peer_send_complete(const ep_type& target, simple_handler_type handler, const boost::system::error_code& ec)
+	{
+		handler(ec);
+
+		m_session_strand.post(boost::bind(&server::do_release_peer_send_slot, this, target));
+	}
+
+	void server::do_release_peer_send_slot(const ep_type& target)
+	{
+		// All do_release_peer_send_slot() calls are done in the session strand so the following is thread-safe.
+		const peer_egress_state_map::iterator it = m_peer_egress_states.find(target);
+
+		if (it == m_peer_egress_states.end())
+		{
+			return;
+		}
+
+		peer_egress_state_type& state = it->second;
+
+		if (state.in_flight > 0)
+		{
+			state.in_flight--;
+		}
+
+		// Resume the parked datagrams in order. A resumed send that fails inline does not take a slot, so the loop keeps draining until the slots are filled again or the queue is empty.
+		while (!state.pending.empty() && (state.in_flight < m_peer_send_queue_depth))
+		{
+			const pending_peer_send_type pending_send = state.pending.front();
+			state.pending.pop_front();
+
+			do_send_data_in_place(target, pending_send.channel_number, pending_send.frame, pending_send.data, pending_send.handler);
+		}
+
+		if (state.congested && state.pending.empty())
+		{
+			state.congested = false;
+
+			if (m_peer_congestion_handler)
+			{
+				m_peer_congestion_handler(target, false);
+			}
+		}
+
+		if ((state.in_flight == 0) && state.pending.empty())
+		{
+			m_peer_egress_states.erase(it);
+		}
+	}
+
+	void server::do_fail_pending_peer_sends()
+	{
+		// All do_fail_pending_peer_sends() calls are done in the session strand so the following is thread-safe.
+		for (peer_egress_state_map::iterator it = m_peer_egress_states.begin(); it != m_peer_egress_states.end(); ++it)
+		{
+			peer_egress_state_type& state = it->second;
+
+			while (!state.pending.empty())
+			{
+				const pending_peer_send_type pending_send = state.pending.front();
+				state.pending.pop_front();
+
+				pending_send.handler(server_error::server_offline);
+			}
+
+			if (state.congested)
+			{
+				state.congested = false;
+
+				if (m_peer_congestion_handler)
+				{
+					m_peer_congestion_handler(it->first, false);
+				}
+			}
+		}
+
+		m_peer_egress_states.clear();
+	}
+
+	bool server::build_data_datagram(peer_session& p_session, const ep_type& target, channel_number_type channel_number, boost::asio::const_buffer data, simple_handler_type handler, datagram_batch_type& batch)
+	{
+		// All build_data_datagram() calls are done in the session strand so the following is thread-safe.
+		if (!m_socket.is_open())
+		{
+			handler(server_error::server_offline);
+
+			return false;
+		}
+
+		if (!p_session.has_current_session())
+		{
+			handler(server_error::no_session_for_host);
+
+			return false;
+		}
+
+		const auto send_buffer = SharedBuffer(65536);
+
+		try
+		{
+			const size_t size = data_message::write(
+				buffer_cast<uint8_t*>(send_buffer),
+				buffer_size(send_buffer),
+				channel_number,
+				p_session.increment_local_sequence_number(),
+				*p_session.current_session().local_cipher_context,
+				buffer_cast<const uint8_t*>(data),
+				buffer_size(data),
+				buffer_cast<const uint8_t*>(p_session.current_session().local_nonce_prefix),
+				buffer_size(p_session.current_session().local_nonce_prefix),
+				p_session.current_session().parameters.compression_algorithm
+			);
+
+			const datagram_type datagram = { to_socket_format(target), send_buffer, size, handler };
+
+			batch.push_back(datagram);
+
+			return true;
+		}
+		catch (const boost::system::system_error& ex)
+		{
+			handler(ex.code());
+
+			return false;
+		}
+	}
+
+#ifdef __linux__
+	void server::do_flush_datagram_batch(boost::shared_ptr<datagram_batch_type> batch)
+	{
+		// do_flush_datagram_batch() is executed within the socket strand, as a single write queue entry.
+		assert(batch);
+
+		static const size_t BURST_SIZE = 64;
+
+		size_t sent = 0;
+
+		while (sent < batch->size())
+		{
+			const size_t burst = std::min(BURST_SIZE, batch->size() - sent);
+
+			iovec iov[BURST_SIZE];
+			mmsghdr msgvec[BURST_SIZE];
+
+			for (size_t i = 0; i < burst; ++i)
+			{
+				datagram_type& datagram = (*batch)[sent + i];
+
+				iov[i].iov_base = buffer_cast<uint8_t*>(buffer(datagram.data));
+				iov[i].iov_len = datagram.size;
+
+				std::memset(&msgvec[i], 0, sizeof(msgvec[i]));
+				msgvec[i].msg_hdr.msg_name = datagram.target.data();
+				msgvec[i].msg_hdr.msg_namelen = static_cast<socklen_t>(datagram.target.size());
+				msgvec[i].msg_hdr.msg_iov = &iov[i];
+				msgvec[i].msg_hdr.msg_iovlen = 1;
+			}
+
+			const int result = ::sendmmsg(m_socket.native_handle(), msgvec, static_cast<unsigned int>(burst), 0);
+
+			if (result < 0)
+			{
+				const boost::system::error_code ec(errno, boost::system::system_category());
+
+				for (size_t i = sent; i < batch->size(); ++i)
+				{
+					(*batch)[i].handler(ec);
+				}
+
+				return;
+			}
+
+			for (int i = 0; i < result; ++i)
+			{
+				(*batch)[sent + i].handler(boost::system::error_code());
+			}
+
+			sent += result;
+		}
+	}
+#endif
+
+	void server::do_send_contact_request(const ep_type& target, const hash_list_type& hash_list, simple_handler_type handler)
+	{
+		// All do_send_contact_request() calls are done in the session strand so the following is thread-safe.
+		peer_session& p_session = m_peer_sessions[target];
+
+		do_send_contact_request_to_session(p_session, target, hash_list, handler);
+	}
+
+	void server::do_send_contact_request_to_list(const std::set<ep_type>& targets, const hash_list_type& hash_list, multiple_endpoints_handler_type handler)
+	{
+		// All do_send_contact_request_to_list() calls are done in the same strand so the following is thread-safe.
+		typedef results_gatherer<ep_type, boost::system::error_code, multiple_endpoints_handler_type> results_gatherer_type;
+
+		boost::shared_ptr<results_gatherer_type> rg = boost::make_shared<results_gatherer_type>(handler, targets);
+
+		for (auto&& item: m_peer_sessions.snapshot())
+		{
+			if (targets.count(item.first) > 0)
+			{
+				do_send_contact_request_to_session(*item.second, item.first, hash_list, boost::bind(&results_gatherer_type::gather, rg, item.first, _1));
+			}
+		}
+	}
+
+	void server::do_send_contact_request_to_all(const hash_list_type& hash_list, multiple_endpoints_handler_type handler, const boost::posix_time::time_duration& pacing_window)
+	{
+		// All do_send_contact_request_to_all() calls are done in the same strand so the following is thread-safe.
+		const std::set<ep_type> targets = get_session_endpoints();
+
+		if ((pacing_window.total_microseconds() <= 0) || (targets.size() <= 1))
+		{
+			do_send_contact_request_to_list(targets, hash_list, handler);
+
+			return;
+		}
+
+		typedef results_gatherer<ep_type, boost::system::error_code, multiple_endpoints_handler_type> results_gatherer_type;
+
+		boost::shared_ptr<results_gatherer_type> rg = boost::make_shared<results_gatherer_type>(handler, targets);
+
+		size_t index = 0;
+
+		for (std::set<ep_type>::const_iterator target = targets.begin(); target != targets.end(); ++target, ++index)
+		{
+			const ep_type ep = *target;
+			const simple_handler_type gather_handler = boost::bind(&results_gatherer_type::gather, rg, ep, _1);
+
+			// The per-target entry point is used on expiry: it goes back through the session strand and reports no_session_for_host by itself if the session went away in the meantime.
+			m_timer_wheel.async_wait(paced_delay(pacing_window, index, targets.size()), [this, ep, hash_list, gather_handler] (const boost::system::error_code& ec) {
+				if (ec)
+				{
+					gather_handler(ec);
+				}
+				else
+				{
+					async_send_contact_request(ep, hash_list, gather_handler);
+				}
+			});
+		}
+	}
+
+	void server::do_send_contact_request_to_session(peer_session& p_session, const ep_type& target, const hash_list_type& hash_list, simple_handler_type handler)
+	{
+		// All do_send_contact_request_to_session() calls are done in the same strand so the following is thread-safe.
+		if (!m_socket.is_open())
+		{
+			handler(server_error::server_offline);
+
+			return;
+		}
+
+		if (m_contact_flush_interval.total_milliseconds() > 0)
+		{
+			// Batching is enabled: the hashes are coalesced with the other requests for this host and sent in a single datagram at the next flush.
+			static_cast<void>(p_session);
+
+			pending_contact_request_type& pending = m_pending_contact_requests[target];
+
+			pending.hash_list.insert(hash_list.begin(), hash_list.end());
+			pending.handlers.push_back(handler);
+
+			schedule_contact_flush();
+
+			return;
+		}
+
+		do_send_contact_request_now(p_session, target, hash_list, handler);
+	}
+
+	void server::do_send_contact_request_now(peer_session& p_session, const ep_type& target, const hash_list_type& hash_list, simple_handler_type handler)
+	{
+		// All do_send_contact_request_now() calls are done in the same strand so the following is thread-safe.
+		if (!m_socket.is_open())
+		{
+			handler(server_error::server_offline);
+
+			return;
+		}
+
+		if (!p_session.has_current_session())
+		{
+			handler(server_error::no_session_for_host);
+
+			return;
+		}
+
+		if (m_crypto_worker_count > 0)
+		{
+			// The sealing is deferred to the crypto workers, through the same per-host strand as the data messages so the sequence numbers stay in emission order.
+			crypto_strand_for(target)->post(
+				boost::bind(
+					&server::do_seal_and_send_contact_request,
+					this,
+					target,
+					p_session.increment_local_sequence_number(),
+					p_session.current_session().local_cipher_context,
+					p_session.current_session().local_nonce_prefix,
+					hash_list,
+					handler
+				)
+			);
+
+			return;
+		}
+
+		const auto send_buffer = SharedBuffer(65536);
+
+		try
+		{
+			const size_t size = data_message::write_contact_request(
+				buffer_cast<uint8_t*>(send_buffer),
+				buffer_size(send_buffer),
+				p_session.increment_local_sequence_number(),
+				*p_session.current_session().local_cipher_context,
+				hash_list,
+				buffer_cast<const uint8_t*>(p_session.current_session().local_nonce_prefix),
+				buffer_size(p_session.current_session().local_nonce_prefix)
+			);
+
+			async_send_to(
+				buffer(send_buffer, size),
+				target,
+				make_shared_buffer_handler(
+					send_buffer,
+					boost::bind(
+						handler,
+						boost::asio::placeholders::error
+					)
+				)
+			);
+		}
+		catch (const boost::system::system_error& ex)
+		{
+			handler(ex.code());
+		}
+	}
+
+	void server::do_seal_and_send_contact_request(const ep_type& target, sequence_number_type sequence_number, boost::shared_ptr<cryptoplus::cipher::cipher_context> cipher_context, cryptoplus::buffer nonce_prefix, hash_list_type hash_list, simple_handler_type handler)
+	{
+		// All do_seal_and_send_contact_request() calls for a given host are done in the same crypto strand: the shared cipher context is never used concurrently and the datagrams are queued in order.
+		const auto send_buffer = SharedBuffer(65536);
+
+		try
+		{
+			const size_t size = data_message::write_contact_request(
+				buffer_cast<uint8_t*>(send_buffer),
+				buffer_size(send_buffer),
+				sequence_number,
+				*cipher_context,
+				hash_list,
+				buffer_cast<const uint8_t*>(nonce_prefix),
+				buffer_size(nonce_prefix)
+			);
+
+			async_send_to(
+				buffer(send_buffer, size),
+				target,
+				make_shared_buffer_handler(
+					send_buffer,
+					boost::bind(
+						handler,
+						boost::asio::placeholders::error
+					)
+				)
+			);
+		}
+		catch (const boost::system::system_error& ex)
+		{
+			handler(ex.code());
+		}
+	}
+
+	void server::do_send_contact(const ep_type& target, boost::shared_ptr<const contact_map_type> contact_map, simple_handler_type handler)
+	{
+		// All do_send_contact() calls are done in the same strand so the following is thread-safe.
+		peer_session& p_session = m_peer_sessions[target];
+
+		do_send_contact_to_session(p_session, target, contact_map, handler);
+	}
+
+	void server::do_send_contact_to_list(const std::set<ep_type>& targets, boost::shared_ptr<const contact_map_type> contact_map, multiple_endpoints_handler_type handler)
+	{
+		// All do_send_contact_to_list() calls are done in the same strand so the following is thread-safe.
+		typedef results_gatherer<ep_type, boost::system::error_code, multiple_endpoints_handler_type> results_gatherer_type;
+
+		boost::shared_ptr<results_gatherer_type> rg = boost::make_shared<results_gatherer_type>(handler, targets);
+
+		for (auto&& item: m_peer_sessions.snapshot())
+		{
+			if (targets.count(item.first) > 0)
+			{
+				do_send_contact_to_session(*item.second, item.first, contact_map, boost::bind(&results_gatherer_type::gather, rg, item.first, _1));
+			}
+		}
+	}
+
+	void server::do_send_contact_to_all(boost::shared_ptr<const contact_map_type> contact_map, multiple_endpoints_handler_type handler, const boost::posix_time::time_duration& pacing_window)
+	{
+		// All do_send_contact_to_all() calls are done in the same strand so the following is thread-safe.
+		const std::set<ep_type> targets = get_session_endpoints();
+
+		if ((pacing_window.total_microseconds() <= 0) || (targets.size() <= 1))
+		{
+			do_send_contact_to_list(targets, contact_map, handler);
+
+			return;
+		}
+
+		typedef results_gatherer<ep_type, boost::system::error_code, multiple_endpoints_handler_type> results_gatherer_type;
+
+		boost::shared_ptr<results_gatherer_type> rg = boost::make_shared<results_gatherer_type>(handler, targets);
+
+		size_t index = 0;
+
+		for (std::set<ep_type>::const_iterator target = targets.begin(); target != targets.end(); ++target, ++index)
+		{
+			const ep_type ep = *target;
+			const simple_handler_type gather_handler = boost::bind(&results_gatherer_type::gather, rg, ep, _1);
+
+			m_timer_wheel.async_wait(paced_delay(pacing_window, index, targets.size()), [this, ep, contact_map, gather_handler] (const boost::system::error_code& ec) {
+				if (ec)
+				{
+					gather_handler(ec);
+				}
+				else
+				{
+					m_session_strand.post(boost::bind(&server::do_send_contact, this, ep, contact_map, gather_handler));
+				}
+			});
+		}
+	}
+
+	void server::do_send_contact_to_session(peer_session& p_session, const ep_type& target, boost::shared_ptr<const contact_map_type> contact_map, simple_handler_type handler)
+	{
+		// All do_send_contact_to_session() calls are done in the same strand so the following is thread-safe.
+		if (!m_socket.is_open())
+		{
+			handler(server_error::server_offline);
+
+			return;
+		}
+
+		if (!p_session.has_current_session())
+		{
+			handler(server_error::no_session_for_host);
+
+			return;
+		}
+
+		if (contact_map->size() > CONTACT_BATCH_SIZE)
+		{
+			// The map does not fit a single message: split it in batches. The handler reports the fate of the last one.
+			contact_map_type::const_iterator contact_it = contact_map->begin();
+
+			while (contact_it != contact_map->end())
+			{
+				const auto batch = boost::make_shared<contact_map_type>();
+
+				for (size_t count = 0; (count < CONTACT_BATCH_SIZE) && (contact_it != contact_map->end()); ++count, ++contact_it)
+				{
+					batch->insert(*contact_it);
+				}
+
+				do_send_contact_batch(p_session, target, batch, (contact_it == contact_map->end()) ? handler : simple_handler_type(&null_simple_handler));
+			}
+
+			return;
+		}
+
+		do_send_contact_batch(p_session, target, contact_map, handler);
+	}
+
+	void server::do_send_contact_batch(peer_session& p_session, const ep_type& target, boost::shared_ptr<const contact_map_type> contact_map, simple_handler_type handler)
+	{
+		// All do_send_contact_batch() calls are done in the same strand so the following is thread-safe.
+		if (m_crypto_worker_count > 0)
+		{
+			// The sealing is deferred to the crypto workers, through the same per-host strand as the data messages so the sequence numbers stay in emission order.
+			crypto_strand_for(target)->post(
+				boost::bind(
+					&server::do_seal_and_send_contact,
+					this,
+					target,
+					p_session.increment_local_sequence_number(),
+					p_session.current_session().local_cipher_context,
+					p_session.current_session().local_nonce_prefix,
+					contact_map,
+					handler
+				)
+			);
+
+			return;
+		}
+
+		const auto send_buffer = SharedBuffer(65536);
+
+		try
+		{
+			const size_t size = data_message::write_contact(
+				buffer_cast<uint8_t*>(send_buffer),
+				buffer_size(send_buffer),
+				p_session.increment_local_sequence_number(),
+				*p_session.current_session().local_cipher_context,
+				*contact_map,
+				buffer_cast<const uint8_t*>(p_session.current_session().local_nonce_prefix),
+				buffer_size(p_session.current_session().local_nonce_prefix)
+			);
+
+			async_send_to(
+				buffer(send_buffer, size),
+				target,
+				make_shared_buffer_handler(
+					send_buffer,
+					boost::bind(
+						handler,
+						boost::asio::placeholders::error
+					)
+				)
+			);
+		}
+		catch (const boost::system::system_error& ex)
+		{
+			handler(ex.code());
+		}
+	}
+
+	void server::do_seal_and_send_contact(const ep_type& target, sequence_number_type sequence_number, boost::shared_ptr<cryptoplus::cipher::cipher_context> cipher_context, cryptoplus::buffer nonce_prefix, boost::shared_ptr<const contact_map_type> contact_map, simple_handler_type handler)
+	{
+		// All do_seal_and_send_contact() calls for a given host are done in the same crypto strand: the shared cipher context is never used concurrently and the datagrams are queued in order.
+		const auto send_buffer = SharedBuffer(65536);
+
+		try
+		{
+			const size_t size = data_message::write_contact(
+				buffer_cast<uint8_t*>(send_buffer),
+				buffer_size(send_buffer),
+				sequence_number,
+				*cipher_context,
+				*contact_map,
+				buffer_cast<const uint8_t*>(nonce_prefix),
+				buffer_size(nonce_prefix)
+			);
+
+			async_send_to(
+				buffer(send_buffer, size),
+				target,
+				make_shared_buffer_handler(
+					send_buffer,
+					boost::bind(
+						handler,
+						boost::asio::placeholders::error
+					)
+				)
+			);
+		}
+		catch (const boost::system::system_error& ex)
+		{
+			handler(ex.code());
+		}
+	}
+
+	void server::do_handle_data(const identity_store& identity, const ep_type& sender, boost::shared_ptr<peer_session> _p_session, SharedBuffer datagram_buffer, const data_message& _data_message)
+	{
+		// All do_handle_data() calls are done in the same strand so the following is thread-safe.
+		assert(_p_session);
+
+		peer_session& p_session = *_p_session;
+
+		if (!p_session.has_current_session())
+		{
+			// The session was lost between the receive thread lookup and now.
+			FSCP_LOG(m_logger, log_level::trace) << "Received a data message from " << sender << " but no session exists. Ignoring.";
+
+			return;
+		}
+
+		if (!p_session.is_acceptable_sequence_number(_data_message.sequence_number()))
+		{
+			// The message was already received or falls behind the anti-replay window: we ignore it.
+			FSCP_LOG(m_logger, log_level::trace) << "Received a data message from " << sender << " but its sequence number is outside the replay window (received: " << _data_message.sequence_number() << ", highest: " << p_session.current_session().remote_sequence_number << "). Ignoring.";
+
+			return;
+		}
+
+		if (m_crypto_worker_count > 0)
+		{
+			// The expensive opening is deferred to the crypto workers. The cipher context and nonce prefix are captured here, in the session strand, so a concurrent rekey cannot swap them under the workers' feet.
+			crypto_strand_for(sender)->post(
 				boost::bind(
-					&server::do_handle_verified_session,
+					&server::do_open_data,
 					this,
 					identity,
 					sender,
-					_session_message
+					_p_session,
+					p_session.current_session().remote_cipher_context,
+					p_session.current_session().remote_nonce_prefix,
+					datagram_buffer,
+					_data_message
 				)
-			)
-		);
+			);
+
+			return;
+		}
+
+		try
+		{
+			// The cleartext is written over the ciphertext, inside the received datagram: the receive path allocates no per-packet buffer and touches each byte once.
+			const size_t cleartext_len = _data_message.open_in_place(
+				buffer_cast<uint8_t*>(datagram_buffer),
+				buffer_size(datagram_buffer),
+				*p_session.current_session().remote_cipher_context,
+				buffer_cast<const uint8_t*>(p_session.current_session().remote_nonce_prefix),
+				buffer_size(p_session.current_session().remote_nonce_prefix)
+			);
+
+			do_handle_data_opened(identity, sender, _p_session, _data_message.sequence_number(), _data_message.type(), datagram_buffer, buffer(buffer(datagram_buffer) + data_message::DATA_PAYLOAD_OFFSET, cleartext_len));
+		}
+		catch (const boost::system::system_error& ex)
+		{
+			// This can happen if a message is decoded after a session rekeying.
+			m_logger(log_level::error) << "Error deciphering data message from " << sender << ": " << ex.what();
+		}
 	}
 
-	void server::do_handle_verified_session(const identity_store& identity, const ep_type& sender, const session_message& _session_message)
+	void server::do_open_data(const identity_store& identity, const ep_type& sender, boost::shared_ptr<peer_session> p_session, boost::shared_ptr<cryptoplus::cipher::cipher_context> cipher_context, cryptoplus::buffer nonce_prefix, SharedBuffer datagram_buffer, data_message _data_message)
 	{
-		// All do_handle_verified_session() calls are done in the session strand so the following is thread-safe.
-		peer_session& p_session = m_peer_sessions[sender];
+		// All do_open_data() calls for a given host are done in the same crypto strand: the shared cipher context is never used concurrently and the messages are handed back to the session strand in order.
+		try
+		{
+			// The cleartext is written over the ciphertext, inside the received datagram: the receive path allocates no per-packet buffer and touches each byte once.
+			const size_t cleartext_len = _data_message.open_in_place(
+				buffer_cast<uint8_t*>(datagram_buffer),
+				buffer_size(datagram_buffer),
+				*cipher_context,
+				buffer_cast<const uint8_t*>(nonce_prefix),
+				buffer_size(nonce_prefix)
+			);
 
-		if (!p_session.set_first_remote_host_identifier(_session_message.host_identifier()))
+			m_session_strand.post(
+				boost::bind(
+					&server::do_handle_data_opened,
+					this,
+					identity,
+					sender,
+					p_session,
+					_data_message.sequence_number(),
+					_data_message.type(),
+					datagram_buffer,
+					buffer(buffer(datagram_buffer) + data_message::DATA_PAYLOAD_OFFSET, cleartext_len)
+				)
+			);
+		}
+		catch (const boost::system::system_error& ex)
 		{
-			m_logger(log_level::trace) << "Received a SESSION from " << sender << " but the host identifier does not match (Received: " << _session_message.host_identifier() << ". Expected: " << *p_session.remote_host_identifier() << "). Ignoring.";
+			// This can happen if a message is decoded after a session rekeying.
+			m_logger(log_level::error) << "Error deciphering data message from " << sender << ": " << ex.what();
+		}
+	}
 
-			// The host identifier does not match.
+	void server::do_handle_data_opened(const identity_store& identity, const ep_type& sender, boost::shared_ptr<peer_session> _p_session, sequence_number_type sequence_number, message_type type, SharedBuffer cleartext_buffer, boost::asio::const_buffer cleartext)
+	{
+		// All do_handle_data_opened() calls are done in the same strand so the following is thread-safe.
+		peer_session& p_session = *_p_session;
+
+		if (!p_session.has_current_session())
+		{
+			// The session was lost while the message was being deciphered.
 			return;
 		}
 
-		const bool session_is_new = !p_session.has_current_session();
+		if (!p_session.register_sequence_number(sequence_number))
+		{
+			// The same sequence number was registered while the message was being deciphered: this is a replay.
+			return;
+		}
 
-		if (!session_is_new)
+		p_session.keep_alive();
+
+		if (p_session.current_session().is_old())
 		{
-			if (_session_message.session_number() == p_session.current_session().parameters.session_number)
-			{
-				// The session number matches the current session.
-				if (p_session.current_session().parameters.cipher_suite != _session_message.cipher_suite())
-				{
-					m_logger(log_level::trace) << "Received a SESSION from " << sender << " with session number " << _session_message.session_number() << " and cipher suite " << _session_message.cipher_suite() << ". A session currently exists and has the same number but its cipher suite does not match (" << p_session.current_session().parameters.cipher_suite << "): requesting a new session.";
+			// do_send_clear_session() and do_handle_data_opened() are to be invoked through the same strand, so this is fine.
+			p_session.prepare_session(p_session.next_session_number(), p_session.current_session().parameters.cipher_suite, p_session.current_session().parameters.elliptic_curve, p_session.current_session().parameters.compression_algorithm, m_ecdhe_key_pool.acquire(p_session.current_session().parameters.elliptic_curve));
+			do_send_session(identity, sender, p_session.next_session_parameters());
+		}
 
-					// The parameters don't match the current session. Requesting a new one.
-					do_request_session(identity, sender, &null_simple_handler);
-				}
-				else
-				{
-					m_logger(log_level::trace) << "Received a SESSION from " << sender << " with session number " << _session_message.session_number() << " and cipher suite " << _session_message.cipher_suite() << ". A session currently exists and has the same number and cipher suite. Ignoring.";
-				}
+		if (type == MESSAGE_TYPE_KEEP_ALIVE)
+		{
+			// If the message is a keep alive then nothing is to be done and we avoid posting an empty call into the data strand.
+			return;
+		}
 
-				return;
-			}
-			else if (_session_message.session_number() < p_session.current_session().parameters.session_number)
+		// Only real data counts as activity for the lazy keep-alive mode: two idle peers must not keep each other active with their own probes.
+		p_session.data_activity();
+
+		// The probe channel bypasses the compression framing on both sides: the padding must hit the wire at its nominal size.
+		if ((p_session.current_session().parameters.compression_algorithm != compression_algorithm_type::none) && is_data_message_type(type) && (type != to_data_message_type(CHANNEL_NUMBER_PMTU)))
+		{
+			if (!unframe_cleartext(p_session, cleartext_buffer, cleartext))
 			{
-				m_logger(log_level::trace) << "Received a SESSION from " << sender << " with session number " << _session_message.session_number() << " and cipher suite " << _session_message.cipher_suite() << ". A session currently exists and has a higher number (" << p_session.current_session().parameters.session_number << "). Ignoring.";
+				m_logger(log_level::warning) << "Received a data message from " << sender << " with a malformed compression frame. Ignoring.";
 
-				// This is an old session message. Ignore it.
 				return;
 			}
 		}
 
-		if (_session_message.cipher_suite() == cipher_suite_type::unsupported)
+		// We don't need the original buffer at this point, so we just defer handling in another call so that it will free the buffer sooner and that it will allow parallel processing.
+		m_data_strand.post(
+			boost::bind(
+				&server::do_handle_data_message,
+				this,
+				sender,
+				type,
+				cleartext_buffer,
+				cleartext
+			)
+		);
+	}
+
+	bool server::unframe_cleartext(peer_session& p_session, SharedBuffer& cleartext_buffer, boost::asio::const_buffer& cleartext)
+	{
+		// All unframe_cleartext() calls are done in the session strand so the following is thread-safe.
+		const uint8_t* const framed = buffer_cast<const uint8_t*>(cleartext);
+		const size_t framed_len = buffer_size(cleartext);
+
+		if (framed_len < 1)
 		{
-			m_logger(log_level::trace) << "Received a SESSION from " << sender << " with session number " << _session_message.session_number() << " but an unsupported cipher suite. Failing session handshake.";
+			return false;
+		}
 
-			if (m_session_failed_handler)
-			{
-				m_session_failed_handler(sender, session_is_new);
-			}
+		if (framed[0] == data_message::DATA_FRAME_RAW)
+		{
+			// The raw escape costs a single marker byte: the payload starts right behind it.
+			p_session.record_rx_compression(framed_len - 1, framed_len);
+			m_compression_rx_raw_bytes_counter.increment(framed_len - 1);
+			m_compression_rx_wire_bytes_counter.increment(framed_len);
 
-			return;
+			cleartext = buffer(cleartext + 1);
+
+			return true;
 		}
 
-		bool can_accept = m_accept_session_messages_default;
+		// The decompressed payload cannot stay in the received datagram: it would overwrite the block being read.
+		const SharedBuffer raw_buffer(65536);
 
-		if (m_session_message_received_handler)
+		try
 		{
-			can_accept = m_session_message_received_handler(sender, _session_message.cipher_suite(), _session_message.elliptic_curve(), can_accept);
-		}
+			const size_t raw_len = data_message::uncompress_cleartext(
+				buffer_cast<uint8_t*>(raw_buffer),
+				buffer_size(raw_buffer),
+				framed,
+				framed_len
+			);
 
-		if (!can_accept)
+			p_session.record_rx_compression(raw_len, framed_len);
+			m_compression_rx_raw_bytes_counter.increment(raw_len);
+			m_compression_rx_wire_bytes_counter.increment(framed_len);
+
+			cleartext_buffer = raw_buffer;
+			cleartext = buffer(raw_buffer, raw_len);
+
+			return true;
+		}
+		catch (const std::exception&)
 		{
-			m_logger(log_level::trace) << "Received a SESSION from " << sender << " but not allowed to accept (`m_accept_session_messages_default` is " << m_accept_session_messages_default << ").";
+			return false;
 		}
-		else
+	}
+
+	void server::do_handle_data_message(const ep_type& sender, message_type type, SharedBuffer buffer, boost::asio::const_buffer data)
+	{
+		// All do_handle_data_message() calls are done in the same strand so the following is thread-safe.
+		if (type == to_data_message_type(CHANNEL_NUMBER_PMTU))
 		{
-			bool session_completed = true;
+			// The probe channel never reaches the application: probes are acknowledged and acknowledgments feed the binary search, both in the session strand where the state lives.
+			const uint8_t* const payload = buffer_cast<const uint8_t*>(data);
 
-			try
+			if (buffer_size(data) >= PATH_MTU_FRAME_HEADER_SIZE)
 			{
-				if (!p_session.complete_session(_session_message.public_key(), _session_message.public_key_size()))
-				{
-					m_logger(log_level::trace) << "Received a SESSION from " << sender << " with session number " << _session_message.session_number() << " but no session was prepared yet. Preparing a new one.";
+				const uint16_t announced_size = static_cast<uint16_t>((static_cast<uint16_t>(payload[1]) << 8) | payload[2]);
 
-					// We received a session message but no session was prepared yet: we issue one and retry.
-					p_session.prepare_session(_session_message.session_number(), _session_message.cipher_suite(), _session_message.elliptic_curve());
+				if (payload[0] == PATH_MTU_FRAME_PROBE)
+				{
+					m_session_strand.post(boost::bind(&server::do_handle_path_mtu_probe, this, sender, announced_size));
+				}
+				else if (payload[0] == PATH_MTU_FRAME_ACK)
+				{
+					m_session_strand.post(boost::bind(&server::do_handle_path_mtu_ack, this, sender, announced_size));
+				}
+				else if ((buffer_size(data) >= PATH_QUALITY_FRAME_SIZE) && ((payload[0] == PATH_QUALITY_FRAME_PROBE) || (payload[0] == PATH_QUALITY_FRAME_ACK)))
+				{
+					const uint32_t sequence = (static_cast<uint32_t>(payload[1]) << 24) | (static_cast<uint32_t>(payload[2]) << 16) | (static_cast<uint32_t>(payload[3]) << 8) | payload[4];
 
-					if (!p_session.complete_session(_session_message.public_key(), _session_message.public_key_size()))
+					if (payload[0] == PATH_QUALITY_FRAME_PROBE)
 					{
-						// Unable to complete the session.
-						m_logger(log_level::warning) << "Unable to compute the session keys with " << sender << ".";
-
-						return;
+						m_session_strand.post(boost::bind(&server::do_handle_path_quality_probe, this, sender, sequence));
+					}
+					else
+					{
+						m_session_strand.post(boost::bind(&server::do_handle_path_quality_ack, this, sender, sequence));
 					}
 				}
 			}
-			catch (const std::exception& ex)
+
+			return;
+		}
+
+		if (is_data_message_type(type))
+		{
+			m_data_bytes_in_counter.increment(buffer_size(data));
+
 			{
-				session_completed = false;
+				// The receive path is serialized by its strand: the mutex only guards against concurrent scrapes.
+				boost::mutex::scoped_lock lock(m_peer_statistics_mutex);
 
-				m_logger(log_level::error) << "Exception while computing the session keys with " << sender << ": " << ex.what() << ".";
+				peer_statistics& stats = m_peer_statistics[sender];
+				stats.rx_bytes += buffer_size(data);
+				stats.rx_packets++;
+			}
 
-				if (m_session_error_handler)
-				{
-					m_session_error_handler(sender, session_is_new, ex);
-				}
+			// This is safe only because type is a DATA message type.
+			const channel_number_type channel_number = to_channel_number(type);
+
+			if (m_data_received_handler)
+			{
+				m_data_received_handler(sender, channel_number, buffer, data);
+			}
+		}
+		else if (type == MESSAGE_TYPE_CONTACT_REQUEST)
+		{
+			const hash_list_type hash_list = data_message::parse_hash_list(buffer_cast<const uint8_t*>(data), buffer_size(data));
+
+			m_presentation_strand.post(
+				boost::bind(
+					&server::do_handle_contact_request,
+					this,
+					sender,
+					hash_list
+				)
+			);
+		}
+		else if (type == MESSAGE_TYPE_CONTACT)
+		{
+			const auto contact_map = boost::make_shared<const contact_map_type>(data_message::parse_contact_map(buffer_cast<const uint8_t*>(data), buffer_size(data)));
+
+			m_contact_strand.post(
+				boost::bind(
+					&server::do_handle_contact,
+					this,
+					sender,
+					contact_map,
+					static_cast<size_t>(0)
+				)
+			);
+		}
+	}
+
+	void server::do_handle_contact_request(const ep_type& sender, const std::set<hash_type>& hash_list)
+	{
+		// All do_handle_contact_request() calls are done in the same strand so the following is thread-safe.
+		contact_map_type contact_map;
+
+		for (std::set<hash_type>::iterator hash_it = hash_list.begin(); hash_it != hash_list.end(); ++hash_it)
+		{
+			// The bloom filter rejects unknown hashes - the common case when peers spam hashes we never saw - before any map access.
+			if (!m_presentation_hash_filter.contains(*hash_it))
+			{
+				continue;
 			}
 
-			if (session_completed)
+			// The hash index resolves each requested hash directly, without rehashing any certificate.
+			const presentation_hash_index_type::const_iterator index_item = m_presentation_hash_index.find(*hash_it);
+
+			if (index_item == m_presentation_hash_index.end())
 			{
-				m_logger(log_level::trace) << "Session established with " << sender << ". Sending acknowledgement session message back.";
+				continue;
+			}
 
-				do_send_session(identity, sender, p_session.current_session_parameters());
+			const ep_type& target = index_item->second;
+			const presentation_store_map::const_iterator it = m_presentation_store_map.find(target);
+
+			if (it == m_presentation_store_map.end())
+			{
+				continue;
+			}
+
+			if (!m_contact_request_message_received_handler || m_contact_request_message_received_handler(sender, it->second.signature_certificate(), *hash_it, target))
+			{
+				contact_map[*hash_it] = target;
+			}
+		}
+
+		// Our contact map contains some answers: we send those.
+		if (!contact_map.empty())
+		{
+			if (m_contact_flush_interval.total_milliseconds() > 0)
+			{
+				// Batching is enabled: the answers are aggregated with the other pending answers for this host and sent in a single CONTACT message at the next flush.
+				m_session_strand.post(boost::bind(&server::do_enqueue_contact, this, sender, contact_map));
+			}
+			else
+			{
+				async_send_contact(sender, contact_map, &null_simple_handler);
+			}
+		}
+	}
+
+	void server::do_handle_contact(const ep_type& sender, boost::shared_ptr<const contact_map_type> contact_map, size_t offset)
+	{
+		// All do_handle_contact() calls are done in the same strand so the following is thread-safe.
+
+		if (!m_contact_message_received_handler)
+		{
+			return;
+		}
+
+		contact_map_type::const_iterator contact_it = contact_map->begin();
+		std::advance(contact_it, offset);
+
+		for (size_t count = 0; contact_it != contact_map->end(); ++contact_it, ++count)
+		{
+			if (count >= CONTACT_BATCH_SIZE)
+			{
+				// Yield the strand: the remainder is handled in a follow-up so one oversized CONTACT message cannot monopolize the contact strand.
+				m_contact_strand.post(boost::bind(&server::do_handle_contact, this, sender, contact_map, offset + count));
 
-				if (m_session_established_handler)
-				{
-					m_session_established_handler(sender, session_is_new, p_session.current_session().parameters.cipher_suite, p_session.current_session().parameters.elliptic_curve);
-				}
+				return;
 			}
+
+			m_contact_message_received_handler(sender, contact_it->first, contact_it->second);
 		}
 	}
 
-	void server::do_set_accept_session_messages_default(bool value, void_handler_type handler)
+	void server::do_enqueue_contact(const ep_type& target, const contact_map_type& contact_map)
 	{
-		// All do_set_accept_session_messages_default() calls are done in the same strand so the following is thread-safe.
-		set_accept_session_messages_default(value);
+		// All do_enqueue_contact() calls are done in the session strand so the following is thread-safe.
+		m_pending_contacts[target].insert(contact_map.begin(), contact_map.end());
 
-		if (handler)
+		schedule_contact_flush();
+	}
+
+	void server::schedule_contact_flush()
+	{
+		// All schedule_contact_flush() calls are done in the session strand so the following is thread-safe.
+		if (m_contact_flush_timer_id == 0)
 		{
-			handler();
+			m_contact_flush_timer_id = m_timer_wheel.async_wait(m_contact_flush_interval, m_session_strand.wrap(boost::bind(&server::do_flush_contacts, this, _1)));
 		}
 	}
 
-	void server::do_set_session_message_received_callback(session_received_handler_type callback, void_handler_type handler)
+	void server::do_flush_contacts(const boost::system::error_code& ec)
 	{
-		// All do_set_session_message_received_callback() calls are done in the same strand so the following is thread-safe.
-		set_session_message_received_callback(callback);
+		// All do_flush_contacts() calls are done in the session strand so the following is thread-safe.
+		m_contact_flush_timer_id = 0;
 
-		if (handler)
+		pending_contact_request_map pending_requests;
+		pending_requests.swap(m_pending_contact_requests);
+
+		pending_contact_map pending_contacts;
+		pending_contacts.swap(m_pending_contacts);
+
+		if (ec)
 		{
-			handler();
+			// The flush was cancelled, most likely because the server is closing: fail the pending requests.
+			for (pending_contact_request_map::iterator request = pending_requests.begin(); request != pending_requests.end(); ++request)
+			{
+				notify_simple_handlers(request->second.handlers, server_error::server_offline);
+			}
+
+			return;
 		}
-	}
 
-	void server::do_set_session_failed_callback(session_failed_handler_type callback, void_handler_type handler)
-	{
-		// All do_set_session_failed_callback() calls are done in the same strand so the following is thread-safe.
-		set_session_failed_callback(callback);
+		for (pending_contact_request_map::iterator request = pending_requests.begin(); request != pending_requests.end(); ++request)
+		{
+			peer_session& p_session = m_peer_sessions[request->first];
 
-		if (handler)
+			do_send_contact_request_now(p_session, request->first, request->second.hash_list, boost::bind(&notify_simple_handlers, request->second.handlers, _1));
+		}
+
+		for (pending_contact_map::iterator contact = pending_contacts.begin(); contact != pending_contacts.end(); ++contact)
 		{
-			handler();
+			peer_session& p_session = m_peer_sessions[contact->first];
+
+			do_send_contact_to_session(p_session, contact->first, boost::make_shared<const contact_map_type>(contact->second), &null_simple_handler);
 		}
 	}
 
-	void server::do_set_session_error_callback(session_error_handler_type callback, void_handler_type handler)
+	void server::do_set_data_received_callback(data_received_handler_type callback, void_handler_type handler)
 	{
-		// All do_set_session_error_callback() calls are done in the same strand so the following is thread-safe.
-		set_session_error_callback(callback);
+		// All do_set_data_received_callback() calls are done in the same strand so the following is thread-safe.
+		set_data_received_callback(callback);
 
 		if (handler)
 		{
@@ -1935,10 +5182,10 @@ namespace fscp
 		}
 	}
 
-	void server::do_set_session_established_callback(session_established_handler_type callback, void_handler_type handler)
+	void server::do_set_contact_request_received_callback(contact_request_received_handler_type callback, void_handler_type handler)
 	{
-		// All do_set_session_established_callback() calls are done in the same strand so the following is thread-safe.
-		set_session_established_callback(callback);
+		// All do_set_contact_request_received_callback() calls are done in the same strand so the following is thread-safe.
+		set_contact_request_received_callback(callback);
 
 		if (handler)
 		{
@@ -1946,10 +5193,10 @@ namespace fscp
 		}
 	}
 
-	void server::do_set_session_lost_callback(session_lost_handler_type callback, void_handler_type handler)
+	void server::do_set_contact_received_callback(contact_received_handler_type callback, void_handler_type handler)
 	{
-		// All do_set_session_lost_callback() calls are done in the same strand so the following is thread-safe.
-		set_session_lost_callback(callback);
+		// All do_set_contact_received_callback() calls are done in the same strand so the following is thread-safe.
+		set_contact_received_callback(callback);
 
 		if (handler)
 		{
@@ -1957,39 +5204,93 @@ namespace fscp
 		}
 	}
 
-	void server::do_send_data(const ep_type& target, channel_number_type channel_number, boost::asio::const_buffer data, simple_handler_type handler)
+	void server::do_check_keep_alive(const boost::system::error_code& ec)
 	{
-		// All do_send_data() calls are done in the session strand so the following is thread-safe.
-		peer_session& p_session = m_peer_sessions[target];
+		// All do_check_keep_alive() calls are done in the same strand so the following is thread-safe.
+		if (ec != boost::asio::error::operation_aborted)
+		{
+			const boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
 
-		do_send_data_to_session(p_session, target, channel_number, data, handler);
-	}
+			for (auto&& p_session: m_peer_sessions.snapshot())
+			{
+				keep_alive_context_type& context = m_keep_alive_contexts[p_session.first];
 
-	void server::do_send_data_to_list(const std::set<ep_type>& targets, channel_number_type channel_number, boost::asio::const_buffer data, multiple_endpoints_handler_type handler)
-	{
-		// All do_send_data_to_list() calls are done in the session strand so the following is thread-safe.
-		typedef results_gatherer<ep_type, boost::system::error_code, multiple_endpoints_handler_type> results_gatherer_type;
+				boost::posix_time::time_duration pace = context.interval;
 
-		boost::shared_ptr<results_gatherer_type> rg = boost::make_shared<results_gatherer_type>(handler, targets);
+				if (m_lazy_keep_alive)
+				{
+					// The first data message snaps the idle decay back to the full (NAT-learned) rate.
+					if (p_session.second->has_data_activity_within(SESSION_KEEP_ALIVE_PERIOD * 2))
+					{
+						context.idle_interval = context.interval;
+					}
 
-		for (auto&& item: m_peer_sessions)
-		{
-			if (targets.count(item.first) > 0)
+					pace = std::max(context.interval, context.idle_interval);
+				}
+
+				// The tolerated silence scales with the pace we actually send at, so stretched intervals do not get sessions killed by our own quietness.
+				const boost::posix_time::time_duration timeout = std::max(SESSION_TIMEOUT, pace * 3);
+
+				if (p_session.second->has_timed_out(timeout))
+				{
+					if (p_session.second->clear())
+					{
+						// If we were probing beyond the default, the silence most likely means the last stretch exceeded the NAT's mapping timeout: fall back to the last interval that worked and stop probing this endpoint.
+						if (context.interval > SESSION_KEEP_ALIVE_PERIOD)
+						{
+							context.interval = std::max(SESSION_KEEP_ALIVE_PERIOD, context.interval / 2);
+							context.learned = true;
+						}
+
+						context.quiet_intervals = 0;
+						context.idle_interval = context.interval;
+
+						if (m_session_lost_handler)
+						{
+							m_session_lost_handler(p_session.first, session_loss_reason::timeout);
+						}
+					}
+				}
+				else if (now >= context.last_send + pace)
+				{
+					do_send_keep_alive(p_session.first, &null_simple_handler);
+					context.last_send = now;
+
+					// Still no data since the last probe: decay this session further towards the lazy cap.
+					if (m_lazy_keep_alive && !p_session.second->has_data_activity_within(pace))
+					{
+						context.idle_interval = std::min(pace * 2, SESSION_LAZY_KEEP_ALIVE_MAX_PERIOD);
+					}
+
+					// Only a period during which the peer was heard from counts towards stretching: a slow but live flow must not be mistaken for a confirmed longer NAT timeout.
+					if (!context.learned && !p_session.second->has_timed_out(context.interval + SESSION_KEEP_ALIVE_PERIOD))
+					{
+						if (++context.quiet_intervals >= SESSION_KEEP_ALIVE_STRETCH_THRESHOLD)
+						{
+							context.quiet_intervals = 0;
+							context.interval = std::min(context.interval * 2, SESSION_KEEP_ALIVE_MAX_PERIOD);
+
+							if (context.interval >= SESSION_KEEP_ALIVE_MAX_PERIOD)
+							{
+								context.learned = true;
+							}
+						}
+					}
+				}
+			}
+
+			if (m_multipath)
 			{
-				do_send_data_to_session(item.second, item.first, channel_number, data, boost::bind(&results_gatherer_type::gather, rg, item.first, _1));
+				do_probe_path_quality();
 			}
-		}
-	}
 
-	void server::do_send_data_to_all(channel_number_type channel_number, boost::asio::const_buffer data, multiple_endpoints_handler_type handler)
-	{
-		// All do_send_data_to_all() calls are done in the session strand so the following is thread-safe.
-		do_send_data_to_list(get_session_endpoints(), channel_number, data, handler);
+			m_keep_alive_timer_id = m_timer_wheel.async_wait(SESSION_KEEP_ALIVE_PERIOD, m_session_strand.wrap(boost::bind(&server::do_check_keep_alive, this, _1)));
+		}
 	}
 
-	void server::do_send_data_to_session(peer_session& p_session, const ep_type& target, channel_number_type channel_number, boost::asio::const_buffer data, simple_handler_type handler)
+	void server::do_send_keep_alive(const ep_type& target, simple_handler_type handler)
 	{
-		// All do_send_data_to_session() calls are done in the session strand so the following is thread-safe.
+		// All do_send_keep_alive() calls are done in the same strand so the following is thread-safe.
 		if (!m_socket.is_open())
 		{
 			handler(server_error::server_offline);
@@ -1997,6 +5298,8 @@ namespace fscp
 			return;
 		}
 
+		peer_session& p_session = m_peer_sessions[target];
+
 		if (!p_session.has_current_session())
 		{
 			handler(server_error::no_session_for_host);
@@ -2004,20 +5307,34 @@ namespace fscp
 			return;
 		}
 
-		const auto send_buffer = SharedBuffer(65536);
+		if (m_crypto_worker_count > 0)
+		{
+			// The sealing is deferred to the crypto workers, through the same per-host strand as the data messages so the sequence numbers stay in emission order.
+			crypto_strand_for(target)->post(
+				boost::bind(
+					&server::do_seal_and_send_keep_alive,
+					this,
+					target,
+					p_session.increment_local_sequence_number(),
+					p_session.current_session().local_cipher_context,
+					p_session.current_session().local_nonce_prefix,
+					handler
+				)
+			);
+
+			return;
+		}
+
+		const auto send_buffer = SharedBuffer(1024);
 
 		try
 		{
-			const size_t size = data_message::write(
+			const size_t size = data_message::write_keep_alive(
 				buffer_cast<uint8_t*>(send_buffer),
 				buffer_size(send_buffer),
-				channel_number,
 				p_session.increment_local_sequence_number(),
-				p_session.current_session().parameters.cipher_suite.to_cipher_algorithm(),
-				buffer_cast<const uint8_t*>(data),
-				buffer_size(data),
-				buffer_cast<const uint8_t*>(p_session.current_session().local_session_key),
-				buffer_size(p_session.current_session().local_session_key),
+				*p_session.current_session().local_cipher_context,
+				SESSION_KEEP_ALIVE_DATA_SIZE, // This is the count of random data to send.
 				buffer_cast<const uint8_t*>(p_session.current_session().local_nonce_prefix),
 				buffer_size(p_session.current_session().local_nonce_prefix)
 			);
@@ -2040,130 +5357,259 @@ namespace fscp
 		}
 	}
 
-	void server::do_send_contact_request(const ep_type& target, const hash_list_type& hash_list, simple_handler_type handler)
+	void server::do_seal_and_send_keep_alive(const ep_type& target, sequence_number_type sequence_number, boost::shared_ptr<cryptoplus::cipher::cipher_context> cipher_context, cryptoplus::buffer nonce_prefix, simple_handler_type handler)
 	{
-		// All do_send_contact_request() calls are done in the session strand so the following is thread-safe.
-		peer_session& p_session = m_peer_sessions[target];
+		// All do_seal_and_send_keep_alive() calls for a given host are done in the same crypto strand: the shared cipher context is never used concurrently and the datagrams are queued in order.
+		const auto send_buffer = SharedBuffer(1024);
 
-		do_send_contact_request_to_session(p_session, target, hash_list, handler);
+		try
+		{
+			const size_t size = data_message::write_keep_alive(
+				buffer_cast<uint8_t*>(send_buffer),
+				buffer_size(send_buffer),
+				sequence_number,
+				*cipher_context,
+				SESSION_KEEP_ALIVE_DATA_SIZE, // This is the count of random data to send.
+				buffer_cast<const uint8_t*>(nonce_prefix),
+				buffer_size(nonce_prefix)
+			);
+
+			async_send_to(
+				buffer(send_buffer, size),
+				target,
+				make_shared_buffer_handler(
+					send_buffer,
+					boost::bind(
+						handler,
+						boost::asio::placeholders::error
+					)
+				)
+			);
+		}
+		catch (const boost::system::system_error& ex)
+		{
+			handler(ex.code());
+		}
 	}
 
-	void server::do_send_contact_request_to_list(const std::set<ep_type>& targets, const hash_list_type& hash_list, multiple_endpoints_handler_type handler)
+	void server::do_check_path_mtu(const boost::system::error_code& ec)
 	{
-		// All do_send_contact_request_to_list() calls are done in the same strand so the following is thread-safe.
-		typedef results_gatherer<ep_type, boost::system::error_code, multiple_endpoints_handler_type> results_gatherer_type;
+		// All do_check_path_mtu() calls are done in the session strand so the following is thread-safe.
+		if (ec == boost::asio::error::operation_aborted)
+		{
+			return;
+		}
 
-		boost::shared_ptr<results_gatherer_type> rg = boost::make_shared<results_gatherer_type>(handler, targets);
+		const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
 
-		for (auto&& item: m_peer_sessions)
+		for (auto&& p_session: m_peer_sessions.snapshot())
 		{
-			if (targets.count(item.first) > 0)
+			if (!p_session.second->has_current_session())
+			{
+				continue;
+			}
+
+			path_mtu_context_type& context = m_path_mtu_contexts[p_session.first];
+
+			if (context.converged)
+			{
+				if (now < context.reprobe_date)
+				{
+					continue;
+				}
+
+				// Probe the whole range again: the path may have grown as well as shrunk.
+				context.converged = false;
+				context.high = PATH_MTU_MAX_PAYLOAD;
+				context.probe_in_flight = false;
+				context.retries = 0;
+			}
+
+			if (!context.probe_in_flight)
+			{
+				if (context.high == 0)
+				{
+					// A fresh session: start the search over the full range.
+					context.low = PATH_MTU_MIN_PAYLOAD;
+					context.high = PATH_MTU_MAX_PAYLOAD;
+				}
+
+				do_advance_path_mtu(p_session.first, context);
+			}
+			else if (now - context.probe_date >= PATH_MTU_PROBE_TIMEOUT)
+			{
+				if (context.retries < PATH_MTU_PROBE_RETRIES)
+				{
+					context.retries++;
+
+					do_send_path_mtu_probe(p_session.first, context);
+				}
+				else
+				{
+					// The probed size does not make it through: search below it.
+					context.high = context.probe_size - 1;
+					context.probe_in_flight = false;
+					context.retries = 0;
+
+					if (context.high < context.low)
+					{
+						// The previously validated size no longer fits: the path shrank, restart from the floor.
+						context.low = PATH_MTU_MIN_PAYLOAD;
+					}
+
+					do_advance_path_mtu(p_session.first, context);
+				}
+			}
+		}
+
+		// Drop the state of peers whose session is gone.
+		for (auto context = m_path_mtu_contexts.begin(); context != m_path_mtu_contexts.end();)
+		{
+			const auto p_session = m_peer_sessions.find(context->first);
+
+			if (!p_session || !p_session->has_current_session())
+			{
+				context = m_path_mtu_contexts.erase(context);
+			}
+			else
 			{
-				do_send_contact_request_to_session(item.second, item.first, hash_list, boost::bind(&results_gatherer_type::gather, rg, item.first, _1));
+				++context;
 			}
 		}
-	}
 
-	void server::do_send_contact_request_to_all(const hash_list_type& hash_list, multiple_endpoints_handler_type handler)
-	{
-		// All do_send_contact_request_to_all() calls are done in the same strand so the following is thread-safe.
-		do_send_contact_request_to_list(get_session_endpoints(), hash_list, handler);
+		m_path_mtu_timer_id = m_timer_wheel.async_wait(PATH_MTU_PROBE_PERIOD, m_session_strand.wrap(boost::bind(&server::do_check_path_mtu, this, _1)));
 	}
 
-	void server::do_send_contact_request_to_session(peer_session& p_session, const ep_type& target, const hash_list_type& hash_list, simple_handler_type handler)
+	void server::do_advance_path_mtu(const ep_type& target, path_mtu_context_type& context)
 	{
-		// All do_send_contact_request_to_session() calls are done in the same strand so the following is thread-safe.
-		if (!m_socket.is_open())
+		// All do_advance_path_mtu() calls are done in the session strand so the following is thread-safe.
+		if (context.high <= context.low + PATH_MTU_CONVERGENCE)
 		{
-			handler(server_error::server_offline);
+			// The search converged: settle on the validated size and come back later in case the path changes.
+			context.converged = true;
+			context.reprobe_date = boost::posix_time::microsec_clock::universal_time() + PATH_MTU_REPROBE_PERIOD;
 
-			return;
-		}
+			if (context.low != context.reported)
+			{
+				m_logger(log_level::information) << "Path MTU discovery for " << target << " converged: the path delivers data payloads of up to " << context.low << " byte(s).";
 
-		if (!p_session.has_current_session())
-		{
-			handler(server_error::no_session_for_host);
+				context.reported = context.low;
+
+				if (m_path_mtu_changed_handler)
+				{
+					m_path_mtu_changed_handler(target, context.low);
+				}
+			}
 
 			return;
 		}
 
-		const auto send_buffer = SharedBuffer(65536);
+		context.probe_size = (context.low + context.high + 1) / 2;
+		context.retries = 0;
 
-		try
-		{
-			const size_t size = data_message::write_contact_request(
-				buffer_cast<uint8_t*>(send_buffer),
-				buffer_size(send_buffer),
-				p_session.increment_local_sequence_number(),
-				p_session.current_session().parameters.cipher_suite.to_cipher_algorithm(),
-				hash_list,
-				buffer_cast<const uint8_t*>(p_session.current_session().local_session_key),
-				buffer_size(p_session.current_session().local_session_key),
-				buffer_cast<const uint8_t*>(p_session.current_session().local_nonce_prefix),
-				buffer_size(p_session.current_session().local_nonce_prefix)
-			);
+		do_send_path_mtu_probe(target, context);
+	}
 
-			async_send_to(
-				buffer(send_buffer, size),
-				target,
-				make_shared_buffer_handler(
-					send_buffer,
-					boost::bind(
-						handler,
-						boost::asio::placeholders::error
-					)
-				)
-			);
-		}
-		catch (const boost::system::system_error& ex)
+	void server::do_send_path_mtu_probe(const ep_type& target, path_mtu_context_type& context)
+	{
+		// All do_send_path_mtu_probe() calls are done in the session strand so the following is thread-safe.
+		const auto probe_buffer = SharedBuffer(context.probe_size);
+
+		uint8_t* const payload = buffer_cast<uint8_t*>(probe_buffer);
+
+		std::memset(payload, 0x00, context.probe_size);
+		payload[0] = PATH_MTU_FRAME_PROBE;
+		payload[1] = static_cast<uint8_t>(context.probe_size >> 8);
+		payload[2] = static_cast<uint8_t>(context.probe_size & 0xFF);
+
+		context.probe_in_flight = true;
+		context.probe_date = boost::posix_time::microsec_clock::universal_time();
+
+		FSCP_LOG(m_logger, log_level::trace) << "Sending a path MTU probe of " << context.probe_size << " byte(s) to " << target << " (low: " << context.low << ", high: " << context.high << ").";
+
+		do_send_probe_frame(target, probe_buffer, context.probe_size);
+	}
+
+	void server::do_handle_path_mtu_probe(const ep_type& sender, uint16_t announced_size)
+	{
+		// All do_handle_path_mtu_probe() calls are done in the session strand so the following is thread-safe.
+		const auto p_session = m_peer_sessions.find(sender);
+
+		if (!p_session || !p_session->has_current_session())
 		{
-			handler(ex.code());
+			return;
 		}
-	}
 
-	void server::do_send_contact(const ep_type& target, const contact_map_type& contact_map, simple_handler_type handler)
-	{
-		// All do_send_contact() calls are done in the same strand so the following is thread-safe.
-		peer_session& p_session = m_peer_sessions[target];
+		// Echo the announced size in a minimal frame: the reverse path only has to carry three bytes.
+		const auto ack_buffer = SharedBuffer(PATH_MTU_FRAME_HEADER_SIZE);
 
-		do_send_contact_to_session(p_session, target, contact_map, handler);
+		uint8_t* const payload = buffer_cast<uint8_t*>(ack_buffer);
+
+		payload[0] = PATH_MTU_FRAME_ACK;
+		payload[1] = static_cast<uint8_t>(announced_size >> 8);
+		payload[2] = static_cast<uint8_t>(announced_size & 0xFF);
+
+		do_send_probe_frame(sender, ack_buffer, PATH_MTU_FRAME_HEADER_SIZE);
 	}
 
-	void server::do_send_contact_to_list(const std::set<ep_type>& targets, const contact_map_type& contact_map, multiple_endpoints_handler_type handler)
+	void server::do_handle_path_mtu_ack(const ep_type& sender, uint16_t announced_size)
 	{
-		// All do_send_contact_to_list() calls are done in the same strand so the following is thread-safe.
-		typedef results_gatherer<ep_type, boost::system::error_code, multiple_endpoints_handler_type> results_gatherer_type;
+		// All do_handle_path_mtu_ack() calls are done in the session strand so the following is thread-safe.
+		const auto context_entry = m_path_mtu_contexts.find(sender);
 
-		boost::shared_ptr<results_gatherer_type> rg = boost::make_shared<results_gatherer_type>(handler, targets);
+		if (context_entry == m_path_mtu_contexts.end())
+		{
+			return;
+		}
+
+		path_mtu_context_type& context = context_entry->second;
 
-		for (auto&& item: m_peer_sessions)
+		if (!context.probe_in_flight || (announced_size != context.probe_size))
 		{
-			if (targets.count(item.first) > 0)
-			{
-				do_send_contact_to_session(item.second, item.first, contact_map, boost::bind(&results_gatherer_type::gather, rg, item.first, _1));
-			}
+			// A duplicate or stale acknowledgment.
+			return;
 		}
-	}
 
-	void server::do_send_contact_to_all(const contact_map_type& contact_map, multiple_endpoints_handler_type handler)
-	{
-		// All do_send_contact_to_all() calls are done in the same strand so the following is thread-safe.
-		do_send_contact_to_list(get_session_endpoints(), contact_map, handler);
+		// The probed size made it through and back: search above it.
+		context.low = context.probe_size;
+		context.probe_in_flight = false;
+		context.retries = 0;
+
+		{
+			// The discovery runs in the session strand: the mutex only guards against concurrent scrapes.
+			boost::mutex::scoped_lock lock(m_peer_statistics_mutex);
+
+			m_peer_statistics[sender].path_mtu = context.low;
+		}
+
+		do_advance_path_mtu(sender, context);
 	}
 
-	void server::do_send_contact_to_session(peer_session& p_session, const ep_type& target, const contact_map_type& contact_map, simple_handler_type handler)
+	void server::do_send_probe_frame(const ep_type& target, SharedBuffer frame, size_t frame_len)
 	{
-		// All do_send_contact_to_session() calls are done in the same strand so the following is thread-safe.
+		// All do_send_probe_frame() calls are done in the session strand so the following is thread-safe.
 		if (!m_socket.is_open())
 		{
-			handler(server_error::server_offline);
-
 			return;
 		}
 
+		peer_session& p_session = m_peer_sessions[target];
+
 		if (!p_session.has_current_session())
 		{
-			handler(server_error::no_session_for_host);
+			return;
+		}
+
+		if (m_crypto_worker_count > 0)
+		{
+			// The sealing is deferred to the crypto workers. The sequence number, cipher context and nonce prefix are captured here, in the session strand, so a concurrent rekey cannot swap them under the workers' feet. The probe is sealed without compression so its size survives as-is.
+			const auto sequence_number = p_session.increment_local_sequence_number();
+			const auto cipher_context = p_session.current_session().local_cipher_context;
+			const auto nonce_prefix = p_session.current_session().local_nonce_prefix;
+
+			crypto_strand_for(target)->post([this, target, sequence_number, cipher_context, nonce_prefix, frame, frame_len] () {
+				do_seal_and_send(target, CHANNEL_NUMBER_PMTU, sequence_number, cipher_context, nonce_prefix, compression_algorithm_type::none, SharedBuffer(), buffer(frame, frame_len), &null_simple_handler);
+			});
 
 			return;
 		}
@@ -2172,301 +5618,270 @@ namespace fscp
 
 		try
 		{
-			const size_t size = data_message::write_contact(
+			const size_t size = data_message::write(
 				buffer_cast<uint8_t*>(send_buffer),
 				buffer_size(send_buffer),
+				CHANNEL_NUMBER_PMTU,
 				p_session.increment_local_sequence_number(),
-				p_session.current_session().parameters.cipher_suite.to_cipher_algorithm(),
-				contact_map,
-				buffer_cast<const uint8_t*>(p_session.current_session().local_session_key),
-				buffer_size(p_session.current_session().local_session_key),
+				*p_session.current_session().local_cipher_context,
+				buffer_cast<const uint8_t*>(frame),
+				frame_len,
 				buffer_cast<const uint8_t*>(p_session.current_session().local_nonce_prefix),
-				buffer_size(p_session.current_session().local_nonce_prefix)
+				buffer_size(p_session.current_session().local_nonce_prefix),
+				compression_algorithm_type::none
 			);
 
-			async_send_to(
-				buffer(send_buffer, size),
-				target,
-				make_shared_buffer_handler(
-					send_buffer,
-					boost::bind(
-						handler,
-						boost::asio::placeholders::error
-					)
-				)
-			);
+			async_send_datagram(send_buffer, size, target, CHANNEL_NUMBER_PMTU, &null_simple_handler);
 		}
 		catch (const boost::system::system_error& ex)
 		{
-			handler(ex.code());
+			m_logger(log_level::error) << "Error sending probe frame to " << target << ": " << ex.what() << ".";
 		}
 	}
 
-	void server::do_handle_data(const identity_store& identity, const ep_type& sender, const data_message& _data_message)
+	void server::do_probe_path_quality()
 	{
-		// All do_handle_data() calls are done in the same strand so the following is thread-safe.
-		peer_session& p_session = m_peer_sessions[sender];
+		// All do_probe_path_quality() calls are done in the session strand so the following is thread-safe.
+		const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
 
-		if (!p_session.has_current_session())
+		for (auto&& p_session: m_peer_sessions.snapshot())
 		{
-			m_logger(log_level::trace) << "Received a data message from " << sender << " but no session exists. Ignoring.";
-
-			return;
-		}
+			if (!p_session.second->has_current_session())
+			{
+				continue;
+			}
 
-		if (_data_message.sequence_number() <= p_session.current_session().remote_sequence_number)
-		{
-			// The message is outdated: we ignore it.
-			m_logger(log_level::trace) << "Received a data message from " << sender << " but its sequence number is outdated (received: " << _data_message.sequence_number() << ", expecting: " << p_session.current_session().remote_sequence_number << "). Ignoring.";
+			// Group the endpoints by remote host: a dual-homed peer shows up once per path, under the same host identifier.
+			const auto host_identifier = p_session.second->remote_host_identifier();
 
-			return;
-		}
+			if (host_identifier)
+			{
+				m_host_paths[*host_identifier].insert(p_session.first);
+			}
 
-		const auto cleartext_buffer = SharedBuffer(65536);
+			path_quality_context_type& context = m_path_quality_contexts[p_session.first];
 
-		try
-		{
-			const size_t cleartext_len = _data_message.get_cleartext(
-				buffer_cast<uint8_t*>(cleartext_buffer),
-				buffer_size(cleartext_buffer),
-				p_session.current_session().parameters.cipher_suite.to_cipher_algorithm(),
-				buffer_cast<const uint8_t*>(p_session.current_session().remote_session_key),
-				buffer_size(p_session.current_session().remote_session_key),
-				buffer_cast<const uint8_t*>(p_session.current_session().remote_nonce_prefix),
-				buffer_size(p_session.current_session().remote_nonce_prefix)
-			);
+			if (context.probe_in_flight)
+			{
+				// The previous probe was not echoed within a tick: count it as lost.
+				context.loss_ewma = (context.loss_ewma * 7.0 + 1.0) / 8.0;
 
-			p_session.set_remote_sequence_number(_data_message.sequence_number());
-			p_session.keep_alive();
+				{
+					// The probing runs in the session strand: the mutex only guards against concurrent scrapes.
+					boost::mutex::scoped_lock lock(m_peer_statistics_mutex);
 
-			if (p_session.current_session().is_old())
-			{
-				// do_send_clear_session() and do_handle_data() are to be invoked through the same strand, so this is fine.
-				p_session.prepare_session(p_session.next_session_number(), p_session.current_session().parameters.cipher_suite, p_session.current_session().parameters.elliptic_curve);
-				do_send_session(identity, sender, p_session.next_session_parameters());
+					m_peer_statistics[p_session.first].path_loss_percent = static_cast<uint64_t>(context.loss_ewma * 100.0);
+				}
 			}
 
-			const message_type type = _data_message.type();
+			const uint32_t sequence = context.next_sequence++;
 
-			if (type == MESSAGE_TYPE_KEEP_ALIVE)
-			{
-				// If the message is a keep alive then nothing is to be done and we avoid posting an empty call into the data strand.
-				return;
-			}
+			const auto probe_buffer = SharedBuffer(PATH_QUALITY_FRAME_SIZE);
 
-			// We don't need the original buffer at this point, so we just defer handling in another call so that it will free the buffer sooner and that it will allow parallel processing.
-			m_data_strand.post(
-				boost::bind(
-					&server::do_handle_data_message,
-					this,
-					sender,
-					type,
-					cleartext_buffer,
-					buffer(cleartext_buffer, cleartext_len)
-				)
-			);
-		}
-		catch (const boost::system::system_error& ex)
-		{
-			// This can happen if a message is decoded after a session rekeying.
-			m_logger(log_level::error) << "Error deciphering data message from " << sender << ": " << ex.what();
-		}
-	}
+			uint8_t* const payload = buffer_cast<uint8_t*>(probe_buffer);
 
-	void server::do_handle_data_message(const ep_type& sender, message_type type, SharedBuffer buffer, boost::asio::const_buffer data)
-	{
-		// All do_handle_data_message() calls are done in the same strand so the following is thread-safe.
-		if (is_data_message_type(type))
-		{
-			// This is safe only because type is a DATA message type.
-			const channel_number_type channel_number = to_channel_number(type);
+			payload[0] = PATH_QUALITY_FRAME_PROBE;
+			payload[1] = static_cast<uint8_t>(sequence >> 24);
+			payload[2] = static_cast<uint8_t>(sequence >> 16);
+			payload[3] = static_cast<uint8_t>(sequence >> 8);
+			payload[4] = static_cast<uint8_t>(sequence & 0xFF);
 
-			if (m_data_received_handler)
-			{
-				m_data_received_handler(sender, channel_number, buffer, data);
-			}
-		}
-		else if (type == MESSAGE_TYPE_CONTACT_REQUEST)
-		{
-			const hash_list_type hash_list = data_message::parse_hash_list(buffer_cast<const uint8_t*>(data), buffer_size(data));
+			context.outstanding_sequence = sequence;
+			context.probe_in_flight = true;
+			context.probe_date = now;
 
-			m_presentation_strand.post(
-				boost::bind(
-					&server::do_handle_contact_request,
-					this,
-					sender,
-					hash_list
-				)
-			);
+			do_send_probe_frame(p_session.first, probe_buffer, PATH_QUALITY_FRAME_SIZE);
 		}
-		else if (type == MESSAGE_TYPE_CONTACT)
+
+		// Drop the measurements and group entries of paths whose session is gone.
+		for (auto context = m_path_quality_contexts.begin(); context != m_path_quality_contexts.end();)
 		{
-			const contact_map_type contact_map = data_message::parse_contact_map(buffer_cast<const uint8_t*>(data), buffer_size(data));
+			const auto p_session = m_peer_sessions.find(context->first);
 
-			m_contact_strand.post(
-				boost::bind(
-					&server::do_handle_contact,
-					this,
-					sender,
-					contact_map
-				)
-			);
+			if (!p_session || !p_session->has_current_session())
+			{
+				context = m_path_quality_contexts.erase(context);
+			}
+			else
+			{
+				++context;
+			}
 		}
-	}
-
-	void server::do_handle_contact_request(const ep_type& sender, const std::set<hash_type>& hash_list)
-	{
-		// All do_handle_contact_request() calls are done in the same strand so the following is thread-safe.
-		contact_map_type contact_map;
 
-		for (std::set<hash_type>::iterator hash_it = hash_list.begin(); hash_it != hash_list.end(); ++hash_it)
+		for (auto group = m_host_paths.begin(); group != m_host_paths.end();)
 		{
-			for (presentation_store_map::const_iterator it = m_presentation_store_map.begin(); it != m_presentation_store_map.end(); ++it)
+			for (auto path = group->second.begin(); path != group->second.end();)
 			{
-				const hash_type hash = it->second.signature_certificate_hash();
+				const auto p_session = m_peer_sessions.find(*path);
 
-				if (hash == *hash_it)
+				if (!p_session || !p_session->has_current_session())
 				{
-					if (!m_contact_request_message_received_handler || m_contact_request_message_received_handler(sender, it->second.signature_certificate(), hash, it->first))
-					{
-						contact_map[*hash_it] = it->first;
-					}
+					path = group->second.erase(path);
+				}
+				else
+				{
+					++path;
 				}
 			}
-		}
 
-		// Our contact map contains some answers: we send those.
-		if (!contact_map.empty())
-		{
-			async_send_contact(sender, contact_map, &null_simple_handler);
+			if (group->second.empty())
+			{
+				m_spray_counters.erase(group->first);
+				group = m_host_paths.erase(group);
+			}
+			else
+			{
+				++group;
+			}
 		}
 	}
 
-	void server::do_handle_contact(const ep_type& sender, const contact_map_type& contact_map)
+	void server::do_handle_path_quality_probe(const ep_type& sender, uint32_t sequence)
 	{
-		// All do_handle_contact() calls are done in the same strand so the following is thread-safe.
+		// All do_handle_path_quality_probe() calls are done in the session strand so the following is thread-safe.
+		const auto p_session = m_peer_sessions.find(sender);
 
-		if (m_contact_message_received_handler)
+		if (!p_session || !p_session->has_current_session())
 		{
-			for (contact_map_type::const_iterator contact_it = contact_map.begin(); contact_it != contact_map.end(); ++contact_it)
-			{
-				m_contact_message_received_handler(sender, contact_it->first, contact_it->second);
-			}
+			return;
 		}
+
+		// Echo the sequence number so the sender can match the acknowledgment to its probe.
+		const auto ack_buffer = SharedBuffer(PATH_QUALITY_FRAME_SIZE);
+
+		uint8_t* const payload = buffer_cast<uint8_t*>(ack_buffer);
+
+		payload[0] = PATH_QUALITY_FRAME_ACK;
+		payload[1] = static_cast<uint8_t>(sequence >> 24);
+		payload[2] = static_cast<uint8_t>(sequence >> 16);
+		payload[3] = static_cast<uint8_t>(sequence >> 8);
+		payload[4] = static_cast<uint8_t>(sequence & 0xFF);
+
+		do_send_probe_frame(sender, ack_buffer, PATH_QUALITY_FRAME_SIZE);
 	}
 
-	void server::do_set_data_received_callback(data_received_handler_type callback, void_handler_type handler)
+	void server::do_handle_path_quality_ack(const ep_type& sender, uint32_t sequence)
 	{
-		// All do_set_data_received_callback() calls are done in the same strand so the following is thread-safe.
-		set_data_received_callback(callback);
+		// All do_handle_path_quality_ack() calls are done in the session strand so the following is thread-safe.
+		const auto context_entry = m_path_quality_contexts.find(sender);
 
-		if (handler)
+		if (context_entry == m_path_quality_contexts.end())
 		{
-			handler();
+			return;
 		}
-	}
 
-	void server::do_set_contact_request_received_callback(contact_request_received_handler_type callback, void_handler_type handler)
-	{
-		// All do_set_contact_request_received_callback() calls are done in the same strand so the following is thread-safe.
-		set_contact_request_received_callback(callback);
+		path_quality_context_type& context = context_entry->second;
 
-		if (handler)
+		if (!context.probe_in_flight || (sequence != context.outstanding_sequence))
 		{
-			handler();
+			// A duplicate or stale acknowledgment.
+			return;
 		}
-	}
 
-	void server::do_set_contact_received_callback(contact_received_handler_type callback, void_handler_type handler)
-	{
-		// All do_set_contact_received_callback() calls are done in the same strand so the following is thread-safe.
-		set_contact_received_callback(callback);
+		const boost::posix_time::time_duration round_trip = boost::posix_time::microsec_clock::universal_time() - context.probe_date;
+		const uint64_t rtt_us = (round_trip.is_negative()) ? 0 : static_cast<uint64_t>(round_trip.total_microseconds());
+
+		context.probe_in_flight = false;
+		context.srtt_us = (context.srtt_us == 0) ? rtt_us : (context.srtt_us * 7 + rtt_us) / 8;
+		context.loss_ewma = context.loss_ewma * 7.0 / 8.0;
 
-		if (handler)
 		{
-			handler();
+			// The probing runs in the session strand: the mutex only guards against concurrent scrapes.
+			boost::mutex::scoped_lock lock(m_peer_statistics_mutex);
+
+			peer_statistics& stats = m_peer_statistics[sender];
+			stats.path_rtt_us = context.srtt_us;
+			stats.path_loss_percent = static_cast<uint64_t>(context.loss_ewma * 100.0);
 		}
 	}
 
-	void server::do_check_keep_alive(const boost::system::error_code& ec)
+	server::ep_type server::select_path(const ep_type& target)
 	{
-		// All do_check_keep_alive() calls are done in the same strand so the following is thread-safe.
-		if (ec != boost::asio::error::operation_aborted)
+		// All select_path() calls are done in the session strand so the following is thread-safe.
+		if (!m_multipath)
 		{
-			for (auto&& p_session: m_peer_sessions)
-			{
-				if (p_session.second.has_timed_out(SESSION_TIMEOUT))
-				{
-					if (p_session.second.clear())
-					{
-						if (m_session_lost_handler)
-						{
-							m_session_lost_handler(p_session.first, session_loss_reason::timeout);
-						}
-					}
-				}
-				else
-				{
-					do_send_keep_alive(p_session.first, &null_simple_handler);
-				}
-			}
+			return target;
+		}
 
-			m_keep_alive_timer.expires_from_now(SESSION_KEEP_ALIVE_PERIOD);
-			m_keep_alive_timer.async_wait(m_session_strand.wrap(boost::bind(&server::do_check_keep_alive, this, boost::asio::placeholders::error)));
+		const auto p_session = m_peer_sessions.find(target);
+
+		if (!p_session)
+		{
+			return target;
 		}
-	}
 
-	void server::do_send_keep_alive(const ep_type& target, simple_handler_type handler)
-	{
-		// All do_send_keep_alive() calls are done in the same strand so the following is thread-safe.
-		if (!m_socket.is_open())
+		const auto host_identifier = p_session->remote_host_identifier();
+
+		if (!host_identifier)
 		{
-			handler(server_error::server_offline);
+			return target;
+		}
 
-			return;
+		const auto group = m_host_paths.find(*host_identifier);
+
+		if ((group == m_host_paths.end()) || (group->second.size() < 2))
+		{
+			return target;
 		}
 
-		peer_session& p_session = m_peer_sessions[target];
+		// Collect the healthy candidates: paths holding an established session whose probe loss stays reasonable.
+		std::vector<ep_type> healthy;
+		ep_type best = target;
+		uint64_t best_srtt = 0;
+		bool best_valid = false;
 
-		if (!p_session.has_current_session())
+		for (auto&& path: group->second)
 		{
-			handler(server_error::no_session_for_host);
+			const auto path_session = m_peer_sessions.find(path);
 
-			return;
+			if (!path_session || !path_session->has_current_session())
+			{
+				continue;
+			}
+
+			const auto context = m_path_quality_contexts.find(path);
+			const uint64_t srtt_us = (context != m_path_quality_contexts.end()) ? context->second.srtt_us : 0;
+			const double loss = (context != m_path_quality_contexts.end()) ? context->second.loss_ewma : 0.0;
+
+			if (loss >= PATH_QUALITY_LOSS_THRESHOLD)
+			{
+				continue;
+			}
+
+			healthy.push_back(path);
+
+			// An unmeasured path never beats a measured one: its round-trip time is simply unknown.
+			if ((srtt_us > 0) && (!best_valid || (srtt_us < best_srtt)))
+			{
+				best = path;
+				best_srtt = srtt_us;
+				best_valid = true;
+			}
 		}
 
-		const auto send_buffer = SharedBuffer(1024);
+		if (healthy.empty())
+		{
+			// Every path looks bad: stick to what the caller asked for.
+			return target;
+		}
 
-		try
+		if (m_multipath_spray && (healthy.size() > 1))
 		{
-			const size_t size = data_message::write_keep_alive(
-				buffer_cast<uint8_t*>(send_buffer),
-				buffer_size(send_buffer),
-				p_session.increment_local_sequence_number(),
-				p_session.current_session().parameters.cipher_suite.to_cipher_algorithm(),
-				SESSION_KEEP_ALIVE_DATA_SIZE, // This is the count of random data to send.
-				buffer_cast<const uint8_t*>(p_session.current_session().local_session_key),
-				buffer_size(p_session.current_session().local_session_key),
-				buffer_cast<const uint8_t*>(p_session.current_session().local_nonce_prefix),
-				buffer_size(p_session.current_session().local_nonce_prefix)
-			);
+			return healthy[m_spray_counters[*host_identifier]++ % healthy.size()];
+		}
 
-			async_send_to(
-				buffer(send_buffer, size),
-				target,
-				make_shared_buffer_handler(
-					send_buffer,
-					boost::bind(
-						handler,
-						boost::asio::placeholders::error
-					)
-				)
-			);
+		if (best_valid)
+		{
+			return best;
 		}
-		catch (const boost::system::system_error& ex)
+
+		// No path was measured yet: prefer the requested one when it is healthy.
+		if (std::find(healthy.begin(), healthy.end(), target) != healthy.end())
 		{
-			handler(ex.code());
+			return target;
 		}
+
+		return healthy.front();
 	}
 
 	std::ostream& operator<<(std::ostream& os, server::session_loss_reason value)
@@ -86,6 +86,14 @@ namespace fscp
 			{
 				return "No session is available for the specified host";
 			}
+			case server_error::egress_queue_full:
+			{
+				return "The egress queue for the specified channel is full";
+			}
+			case server_error::memory_pressure:
+			{
+				return "The send was shed because the buffer budget is nearly exhausted";
+			}
 			default:
 			{
 				return "Unknown FSCP error";
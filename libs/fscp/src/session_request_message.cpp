@@ -61,12 +61,15 @@ namespace fscp
 		}
 	}
 
-	size_t session_request_message::write(void* buf, size_t buf_len, session_number_type _session_number, const host_identifier_type& _host_identifier, const cipher_suite_list_type& cs_cap, const elliptic_curve_list_type& ec_cap, cryptoplus::pkey::pkey sig_key)
+	size_t session_request_message::write(void* buf, size_t buf_len, session_number_type _session_number, const host_identifier_type& _host_identifier, const cipher_suite_list_type& cs_cap, const elliptic_curve_list_type& ec_cap, const compression_algorithm_list_type& comp_cap, cryptoplus::pkey::pkey sig_key, unsigned char _version)
 	{
 		using cryptoplus::buffer_cast;
 		using cryptoplus::buffer_size;
 
-		const size_t unsigned_payload_size = MIN_BODY_LENGTH + cs_cap.size() + ec_cap.size();
+		// The compression capability list only exists in the version 4 layout: a version 3 host would read its length field as the signature length and fail the signature check.
+		const bool with_compression = (_version >= COMPRESSION_PROTOCOL_VERSION);
+
+		const size_t unsigned_payload_size = MIN_BODY_LENGTH + cs_cap.size() + ec_cap.size() + (with_compression ? sizeof(uint16_t) + comp_cap.size() : 0);
 
 		if (buf_len < HEADER_LENGTH + unsigned_payload_size)
 		{
@@ -99,6 +102,18 @@ namespace fscp
 			}
 		}
 
+		if (with_compression)
+		{
+			buffer_tools::set<uint16_t>(payload, sizeof(_session_number) + host_identifier_type::data_type::static_size + sizeof(uint16_t) + cs_cap.size() + sizeof(uint16_t) + ec_cap.size(), htons(static_cast<uint16_t>(comp_cap.size())));
+
+			uint8_t* comp_buf = payload + sizeof(_session_number) + host_identifier_type::data_type::static_size + sizeof(uint16_t) + cs_cap.size() + sizeof(uint16_t) + ec_cap.size() + sizeof(uint16_t);
+
+			for (auto&& comp: comp_cap)
+			{
+				*comp_buf++ = comp.value();
+			}
+		}
+
 		cryptoplus::hash::message_digest_context mdctx;
 		EVP_PKEY_CTX* evp_ctx = nullptr;
 
@@ -117,7 +132,7 @@ namespace fscp
 		mdctx.digest_sign_finalize(payload + unsigned_payload_size + sizeof(uint16_t), signature_size);
 		buffer_tools::set<uint16_t>(payload, unsigned_payload_size, htons(static_cast<uint16_t>(signature_size)));
 
-		return message::write(buf, buf_len, CURRENT_PROTOCOL_VERSION, MESSAGE_TYPE_SESSION_REQUEST, signed_payload_size) + signed_payload_size;
+		return message::write(buf, buf_len, _version, MESSAGE_TYPE_SESSION_REQUEST, signed_payload_size) + signed_payload_size;
 	}
 
 	session_request_message::session_request_message(const message& _message) :
@@ -138,7 +153,25 @@ namespace fscp
 			throw std::runtime_error("buf_len");
 		}
 
-		if (length() < MIN_BODY_LENGTH + cipher_suite_capabilities_size() + elliptic_curve_capabilities_size() + header_signature_size())
+		if (has_compression_algorithm_capabilities())
+		{
+			if (length() < MIN_BODY_LENGTH + cipher_suite_capabilities_size() + elliptic_curve_capabilities_size() + sizeof(uint16_t))
+			{
+				throw std::runtime_error("buf_len");
+			}
+
+			if (length() < MIN_BODY_LENGTH + cipher_suite_capabilities_size() + elliptic_curve_capabilities_size() + sizeof(uint16_t) + compression_algorithm_capabilities_size())
+			{
+				throw std::runtime_error("buf_len");
+			}
+		}
+
+		if (length() < header_size() + sizeof(uint16_t))
+		{
+			throw std::runtime_error("buf_len");
+		}
+
+		if (length() < header_size() + sizeof(uint16_t) + header_signature_size())
 		{
 			throw std::runtime_error("buf_len");
 		}
@@ -170,6 +203,25 @@ namespace fscp
 		return result;
 	}
 
+	compression_algorithm_list_type session_request_message::compression_algorithm_capabilities() const
+	{
+		if (!has_compression_algorithm_capabilities())
+		{
+			// A version 3 host advertises nothing: the negotiation falls back to no compression.
+			return compression_algorithm_list_type();
+		}
+
+		compression_algorithm_list_type result(compression_algorithm_capabilities_size());
+
+		std::copy(
+			payload() + sizeof(session_number_type) + host_identifier_type::data_type::static_size + sizeof(uint16_t) + cipher_suite_capabilities_size() + sizeof(uint16_t) + elliptic_curve_capabilities_size() + sizeof(uint16_t),
+			payload() + sizeof(session_number_type) + host_identifier_type::data_type::static_size + sizeof(uint16_t) + cipher_suite_capabilities_size() + sizeof(uint16_t) + elliptic_curve_capabilities_size() + sizeof(uint16_t) + compression_algorithm_capabilities_size(),
+			result.begin()
+		);
+
+		return result;
+	}
+
 	bool session_request_message::check_signature(cryptoplus::pkey::pkey key) const
 	{
 		assert(key);
@@ -0,0 +1,148 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file session_resumption_message.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A session resumption message class.
+ */
+
+#include "session_resumption_message.hpp"
+
+#include <cassert>
+#include <stdexcept>
+
+#include <cryptoplus/hash/hmac_context.hpp>
+
+namespace fscp
+{
+	namespace
+	{
+		cryptoplus::buffer compute_hmac(const cryptoplus::buffer& resumption_secret, message_type type, const uint8_t* header, size_t header_len)
+		{
+			using cryptoplus::buffer_cast;
+			using cryptoplus::buffer_size;
+
+			const uint8_t type_byte = static_cast<uint8_t>(type);
+			const cryptoplus::hash::message_digest_algorithm algorithm = get_default_digest_algorithm();
+
+			cryptoplus::hash::hmac_context ctx;
+			ctx.initialize(buffer_cast<const void*>(resumption_secret), buffer_size(resumption_secret), &algorithm);
+			ctx.update(&type_byte, sizeof(type_byte));
+			ctx.update(header, header_len);
+
+			return ctx.finalize();
+		}
+	}
+
+	size_t session_resumption_message::write(void* buf, size_t buf_len, message_type _type, session_number_type _session_number, const host_identifier_type& _host_identifier, const uint8_t* _nonce, cipher_suite_type _cipher_suite, elliptic_curve_type _elliptic_curve, compression_algorithm_type _compression_algorithm, const cryptoplus::buffer& resumption_secret)
+	{
+		using cryptoplus::buffer_cast;
+		using cryptoplus::buffer_size;
+
+		assert((_type == MESSAGE_TYPE_SESSION_RESUMPTION_REQUEST) || (_type == MESSAGE_TYPE_SESSION_RESUMPTION));
+
+		const size_t unsigned_payload_size = sizeof(session_number_type) + host_identifier_type::data_type::static_size + SESSION_RESUMPTION_NONCE_SIZE + 3;
+
+		if (buf_len < HEADER_LENGTH + unsigned_payload_size + sizeof(uint16_t))
+		{
+			throw std::runtime_error("buf_len");
+		}
+
+		uint8_t* const payload = static_cast<uint8_t*>(buf) + HEADER_LENGTH;
+
+		buffer_tools::set<session_number_type>(payload, 0, htonl(_session_number));
+		std::copy(_host_identifier.data.begin(), _host_identifier.data.end(), payload + sizeof(_session_number));
+		std::copy(_nonce, _nonce + SESSION_RESUMPTION_NONCE_SIZE, payload + sizeof(_session_number) + host_identifier_type::data_type::static_size);
+		buffer_tools::set<uint8_t>(payload, sizeof(_session_number) + host_identifier_type::data_type::static_size + SESSION_RESUMPTION_NONCE_SIZE, _cipher_suite.value());
+		buffer_tools::set<uint8_t>(payload, sizeof(_session_number) + host_identifier_type::data_type::static_size + SESSION_RESUMPTION_NONCE_SIZE + 1, _elliptic_curve.value());
+		buffer_tools::set<uint8_t>(payload, sizeof(_session_number) + host_identifier_type::data_type::static_size + SESSION_RESUMPTION_NONCE_SIZE + 2, _compression_algorithm.value());
+
+		const cryptoplus::buffer hmac = compute_hmac(resumption_secret, _type, payload, unsigned_payload_size);
+		const size_t hmac_size = buffer_size(hmac);
+		const size_t signed_payload_size = unsigned_payload_size + sizeof(uint16_t) + hmac_size;
+
+		if (buf_len < HEADER_LENGTH + signed_payload_size)
+		{
+			throw std::runtime_error("buf_len");
+		}
+
+		buffer_tools::set<uint16_t>(payload, unsigned_payload_size, htons(static_cast<uint16_t>(hmac_size)));
+		std::copy(buffer_cast<const uint8_t*>(hmac), buffer_cast<const uint8_t*>(hmac) + hmac_size, payload + unsigned_payload_size + sizeof(uint16_t));
+
+		return message::write(buf, buf_len, CURRENT_PROTOCOL_VERSION, _type, signed_payload_size) + signed_payload_size;
+	}
+
+	session_resumption_message::session_resumption_message(const message& _message) :
+		message(_message)
+	{
+		if (length() < MIN_BODY_LENGTH)
+		{
+			throw std::runtime_error("buf_len");
+		}
+
+		if (length() < MIN_BODY_LENGTH + header_hmac_size())
+		{
+			throw std::runtime_error("buf_len");
+		}
+	}
+
+	bool session_resumption_message::check_hmac(const cryptoplus::buffer& resumption_secret) const
+	{
+		using cryptoplus::buffer_cast;
+		using cryptoplus::buffer_size;
+
+		const cryptoplus::buffer reference = compute_hmac(resumption_secret, type(), payload(), header_size());
+
+		if (buffer_size(reference) != header_hmac_size())
+		{
+			return false;
+		}
+
+		// Compare in constant time so the HMAC cannot be guessed byte by byte.
+		const uint8_t* const reference_data = buffer_cast<const uint8_t*>(reference);
+		uint8_t difference = 0x00;
+
+		for (size_t i = 0; i < header_hmac_size(); ++i)
+		{
+			difference |= (reference_data[i] ^ header_hmac()[i]);
+		}
+
+		return (difference == 0x00);
+	}
+}
@@ -0,0 +1,224 @@
+/*
+ * libfscp - C++ portable OpenSSL cryptographic wrapper library.
+ * Copyright (C) 2010-2011 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfscp.
+ *
+ * libfscp is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfscp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfscp in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file timer_wheel.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A hashed timer wheel.
+ */
+
+#include "timer_wheel.hpp"
+
+#include <boost/bind.hpp>
+
+#include <cassert>
+
+namespace fscp
+{
+	timer_wheel::timer_wheel(boost::asio::io_service& io_service, const boost::posix_time::time_duration& tick_duration, size_t slot_count) :
+		m_io_service(io_service),
+		m_tick_timer(io_service),
+		m_tick_duration(tick_duration),
+		m_slots(slot_count),
+		m_slot_indexes(),
+		m_current_slot(0),
+		m_next_timer_id(1),
+		m_running(false)
+	{
+		assert(slot_count > 0);
+		assert(tick_duration.total_milliseconds() > 0);
+	}
+
+	void timer_wheel::start()
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		if (m_running)
+		{
+			return;
+		}
+
+		m_running = true;
+
+		m_tick_timer.expires_from_now(m_tick_duration);
+		m_tick_timer.async_wait(boost::bind(&timer_wheel::do_tick, this, boost::asio::placeholders::error));
+	}
+
+	void timer_wheel::stop()
+	{
+		std::vector<wait_handler_type> cancelled_handlers;
+
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			if (!m_running)
+			{
+				return;
+			}
+
+			m_running = false;
+
+			m_tick_timer.cancel();
+
+			for (std::vector<slot_type>::iterator slot = m_slots.begin(); slot != m_slots.end(); ++slot)
+			{
+				for (slot_type::iterator entry = slot->begin(); entry != slot->end(); ++entry)
+				{
+					cancelled_handlers.push_back(entry->handler);
+				}
+
+				slot->clear();
+			}
+
+			m_slot_indexes.clear();
+		}
+
+		for (std::vector<wait_handler_type>::iterator handler = cancelled_handlers.begin(); handler != cancelled_handlers.end(); ++handler)
+		{
+			m_io_service.post(boost::bind(*handler, boost::asio::error::operation_aborted));
+		}
+	}
+
+	timer_wheel::timer_id_type timer_wheel::async_wait(const boost::posix_time::time_duration& timeout, wait_handler_type handler)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		// Round the timeout up to the next tick, with a minimum of one full tick so the handler never fires early.
+		const uint64_t tick_milliseconds = static_cast<uint64_t>(m_tick_duration.total_milliseconds());
+		const uint64_t timeout_milliseconds = (timeout.total_milliseconds() > 0) ? static_cast<uint64_t>(timeout.total_milliseconds()) : 0;
+		const uint64_t ticks = (timeout_milliseconds + tick_milliseconds - 1) / tick_milliseconds + 1;
+
+		// The wheel advances to a slot before scanning it, so an entry placed k slots ahead (k in [1, N]) is first visited after k ticks: offsetting by ((ticks - 1) % N) + 1 and counting (ticks - 1) / N laps fires after exactly `ticks` ticks for every value, including the exact multiples of N that the plain ticks / N split would delay by a full revolution.
+		const size_t slot = (m_current_slot + static_cast<size_t>((ticks - 1) % m_slots.size()) + 1) % m_slots.size();
+		const size_t laps = static_cast<size_t>((ticks - 1) / m_slots.size());
+
+		const timer_id_type id = m_next_timer_id++;
+
+		m_slots[slot].push_back(entry_type(id, laps, handler));
+		m_slot_indexes[id] = slot;
+
+		return id;
+	}
+
+	bool timer_wheel::cancel(timer_id_type id)
+	{
+		wait_handler_type handler;
+
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			const std::map<timer_id_type, size_t>::iterator index = m_slot_indexes.find(id);
+
+			if (index == m_slot_indexes.end())
+			{
+				// The entry already expired or was never scheduled.
+				return false;
+			}
+
+			slot_type& slot = m_slots[index->second];
+
+			for (slot_type::iterator entry = slot.begin(); entry != slot.end(); ++entry)
+			{
+				if (entry->id == id)
+				{
+					handler = entry->handler;
+					slot.erase(entry);
+
+					break;
+				}
+			}
+
+			m_slot_indexes.erase(index);
+		}
+
+		assert(handler);
+
+		m_io_service.post(boost::bind(handler, boost::asio::error::operation_aborted));
+
+		return true;
+	}
+
+	void timer_wheel::do_tick(const boost::system::error_code& ec)
+	{
+		if (ec == boost::asio::error::operation_aborted)
+		{
+			return;
+		}
+
+		std::vector<wait_handler_type> expired_handlers;
+
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			if (!m_running)
+			{
+				return;
+			}
+
+			m_current_slot = (m_current_slot + 1) % m_slots.size();
+
+			slot_type& slot = m_slots[m_current_slot];
+
+			for (slot_type::iterator entry = slot.begin(); entry != slot.end();)
+			{
+				if (entry->remaining_laps == 0)
+				{
+					expired_handlers.push_back(entry->handler);
+					m_slot_indexes.erase(entry->id);
+
+					entry = slot.erase(entry);
+				}
+				else
+				{
+					--entry->remaining_laps;
+
+					++entry;
+				}
+			}
+
+			// Rearm relative to the previous expiration so rounding errors do not accumulate.
+			m_tick_timer.expires_at(m_tick_timer.expires_at() + m_tick_duration);
+			m_tick_timer.async_wait(boost::bind(&timer_wheel::do_tick, this, boost::asio::placeholders::error));
+		}
+
+		for (std::vector<wait_handler_type>::iterator handler = expired_handlers.begin(); handler != expired_handlers.end(); ++handler)
+		{
+			m_io_service.post(boost::bind(*handler, boost::system::error_code()));
+		}
+	}
+}
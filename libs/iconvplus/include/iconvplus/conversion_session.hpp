@@ -0,0 +1,178 @@
+/*
+ * libiconvplus - A C++ lightweight wrapper around the iconv library.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libiconvplus.
+ *
+ * libiconvplus is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libiconvplus is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libiconvplus in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file conversion_session.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief The iconv conversion session class.
+ */
+
+#ifndef ICONVPLUS_CONVERSION_SESSION_HPP
+#define ICONVPLUS_CONVERSION_SESSION_HPP
+
+#include "converter.hpp"
+
+namespace iconvplus
+{
+	/**
+	 * \brief A streaming conversion session class.
+	 *
+	 * Unlike converter::convert(), which processes a whole stream per call, a session accepts input in arbitrary chunks: incomplete multi-byte sequences and the iconv shift state are carried over to the next call, so inputs of any size can be converted at a fixed memory footprint. The input and output buffers are allocated once at construction and reused across calls.
+	 */
+	template <typename InputCharType, typename OutputCharType>
+	class conversion_session
+	{
+		public:
+
+			/**
+			 * \brief The default size of the buffers, in bytes.
+			 */
+			static const size_t DEFAULT_CHUNK_SIZE = converter<InputCharType, OutputCharType>::DEFAULT_CHUNK_SIZE;
+
+			/**
+			 * \brief The input char type.
+			 */
+			typedef InputCharType input_char_type;
+
+			/**
+			 * \brief The output char type.
+			 */
+			typedef OutputCharType output_char_type;
+
+			/**
+			 * \brief The output stream type.
+			 */
+			typedef typename output_stream<output_char_type>::type output_stream_type;
+
+			/**
+			 * \brief Create a new conversion session.
+			 * \param ic The iconv instance to use.
+			 * \param chunk_size The buffer size, in bytes. Must be at least max(sizeof(InputCharType), sizeof(OutputCharType)).
+			 *
+			 * A reference is kept on the specified iconv_instance, so it must remain valid during all the lifetime of the session instance.
+			 */
+			explicit conversion_session(const iconv_instance& ic, size_t chunk_size = DEFAULT_CHUNK_SIZE);
+
+			/**
+			 * \brief Convert the next chunk of input.
+			 * \param data The input characters. May end in the middle of a multi-byte sequence: the cut bytes are held over and completed on the next call.
+			 * \param data_len The count of input characters.
+			 * \param os The output stream.
+			 * \param ec The error code, if an error occurs.
+			 * \param non_reversible_conversions If not NULL, *non_reversible_conversions will be updated to indicate the count of non-reversible conversions performed during the call.
+			 * \return true on success. On error, ec is updated to indicate the error.
+			 */
+			bool convert(const input_char_type* data, size_t data_len, output_stream_type& os, boost::system::error_code& ec, size_t* non_reversible_conversions = NULL);
+
+			/**
+			 * \brief Convert the next chunk of input.
+			 * \param data The input characters.
+			 * \param data_len The count of input characters.
+			 * \param os The output stream.
+			 * \param non_reversible_conversions If not NULL, *non_reversible_conversions will be updated to indicate the count of non-reversible conversions performed during the call.
+			 *
+			 * On error, a boost::system::system_error is thrown.
+			 */
+			void convert(const input_char_type* data, size_t data_len, output_stream_type& os, size_t* non_reversible_conversions = NULL);
+
+			/**
+			 * \brief Terminate the conversion.
+			 * \param os The output stream.
+			 * \param ec The error code, if an error occurs.
+			 * \return true on success. On error, ec is updated to indicate the error. In particular, an incomplete multi-byte sequence left over from the last convert() call is reported as EINVAL.
+			 *
+			 * Writes the closing shift sequence, if the destination encoding requires one, and resets the session so it can be reused for another input.
+			 */
+			bool finalize(output_stream_type& os, boost::system::error_code& ec);
+
+			/**
+			 * \brief Terminate the conversion.
+			 * \param os The output stream.
+			 *
+			 * On error, a boost::system::system_error is thrown.
+			 */
+			void finalize(output_stream_type& os);
+
+		private:
+
+			bool do_convert(output_stream_type& os, boost::system::error_code& ec, size_t* non_reversible_conversions);
+
+			const iconv_instance* m_iconv_instance;
+			std::vector<input_char_type> m_input_buffer;
+			std::vector<output_char_type> m_output_buffer;
+			size_t m_pending_size;
+	};
+
+	template <typename InputCharType, typename OutputCharType>
+	inline conversion_session<InputCharType, OutputCharType>::conversion_session(const iconv_instance& ic, size_t chunk_size) :
+		m_iconv_instance(&ic),
+		m_input_buffer(chunk_size / sizeof(input_char_type)),
+		m_output_buffer(chunk_size / sizeof(output_char_type)),
+		m_pending_size(0)
+	{
+		assert(chunk_size > 0);
+		assert(m_input_buffer.size() > 0);
+		assert(m_output_buffer.size() > 0);
+
+		m_iconv_instance->reset();
+	}
+
+	template <typename InputCharType, typename OutputCharType>
+	inline void conversion_session<InputCharType, OutputCharType>::convert(const input_char_type* data, size_t data_len, output_stream_type& os, size_t* non_reversible_conversions)
+	{
+		boost::system::error_code ec;
+
+		if (!convert(data, data_len, os, ec, non_reversible_conversions))
+		{
+			throw boost::system::system_error(ec);
+		}
+	}
+
+	template <typename InputCharType, typename OutputCharType>
+	inline void conversion_session<InputCharType, OutputCharType>::finalize(output_stream_type& os)
+	{
+		boost::system::error_code ec;
+
+		if (!finalize(os, ec))
+		{
+			throw boost::system::system_error(ec);
+		}
+	}
+}
+
+#endif /* ICONVPLUS_CONVERSION_SESSION_HPP */
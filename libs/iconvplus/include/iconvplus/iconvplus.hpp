@@ -48,5 +48,6 @@
 #include "iconv_instance.hpp"
 #include "iconv_error_category.hpp"
 #include "converter.hpp"
+#include "conversion_session.hpp"
 
 #endif /* ICONVPLUS_ICONVPLUS_HPP */
@@ -0,0 +1,175 @@
+/*
+ * libiconvplus - A lightweight C++ wrapper around the iconv library.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libiconvplus.
+ *
+ * libiconvplus is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libiconvplus is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libiconvplus in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file conversion_session.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief The iconv conversion session class.
+ */
+
+#include "conversion_session.hpp"
+
+#include "iconv_error_category.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace iconvplus
+{
+	template <typename InputCharType, typename OutputCharType>
+	bool conversion_session<InputCharType, OutputCharType>::convert(const input_char_type* data, size_t data_len, output_stream_type& os, boost::system::error_code& ec, size_t* non_reversible_conversions)
+	{
+		size_t counter = 0;
+
+		if (!non_reversible_conversions) non_reversible_conversions = &counter;
+
+		while (data_len > 0)
+		{
+			// Top the input buffer up with as many input characters as fit after the held-over bytes, then convert it.
+			const size_t buffer_capacity = m_input_buffer.size() * sizeof(input_char_type);
+			const size_t count = std::min((buffer_capacity - m_pending_size) / sizeof(input_char_type), data_len);
+
+			if (count == 0)
+			{
+				// The held-over sequence fills the whole buffer: it cannot possibly be completed.
+				ec = boost::system::error_code(EINVAL, iconv_category());
+
+				return false;
+			}
+
+			std::memcpy(reinterpret_cast<char*>(&m_input_buffer[0]) + m_pending_size, data, count * sizeof(input_char_type));
+			m_pending_size += count * sizeof(input_char_type);
+			data += count;
+			data_len -= count;
+
+			if (!do_convert(os, ec, non_reversible_conversions))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	template <typename InputCharType, typename OutputCharType>
+	bool conversion_session<InputCharType, OutputCharType>::do_convert(output_stream_type& os, boost::system::error_code& ec, size_t* non_reversible_conversions)
+	{
+		size_t itmp_size = m_pending_size;
+		const char* inbuf = reinterpret_cast<const char*>(&m_input_buffer[0]);
+
+		size_t result;
+
+		do
+		{
+			size_t otmp_size = m_output_buffer.size() * sizeof(output_char_type);
+			char* outbuf = reinterpret_cast<char*>(&m_output_buffer[0]);
+
+			result = m_iconv_instance->convert(&inbuf, &itmp_size, &outbuf, &otmp_size, ec);
+
+			os.write(&m_output_buffer[0], m_output_buffer.size() - otmp_size / sizeof(output_char_type));
+
+			if (result == iconv_instance::ERROR_VALUE)
+			{
+				if (ec.value() == E2BIG)
+				{
+					// We check if the destination buffer will always be too small.
+					if (otmp_size >= m_output_buffer.size() * sizeof(output_char_type))
+					{
+						return false;
+					}
+				}
+				else if (ec.value() == EINVAL)
+				{
+					// An incomplete multi-byte sequence was cut. Lets keep the bytes at the beginning of the input buffer: the next call will complete them.
+					std::memmove(reinterpret_cast<char*>(&m_input_buffer[0]), inbuf, itmp_size);
+					m_pending_size = itmp_size;
+
+					return true;
+				}
+				else
+				{
+					return false;
+				}
+			}
+			else
+			{
+				*non_reversible_conversions += result;
+			}
+		}
+		while ((result == iconv_instance::ERROR_VALUE) && (ec.value() == E2BIG));
+
+		m_pending_size = 0;
+
+		return true;
+	}
+
+	template <typename InputCharType, typename OutputCharType>
+	bool conversion_session<InputCharType, OutputCharType>::finalize(output_stream_type& os, boost::system::error_code& ec)
+	{
+		if (m_pending_size > 0)
+		{
+			// The input ended in the middle of a multi-byte sequence.
+			m_pending_size = 0;
+			m_iconv_instance->reset();
+
+			ec = boost::system::error_code(EINVAL, iconv_category());
+
+			return false;
+		}
+
+		size_t otmp_size = m_output_buffer.size() * sizeof(output_char_type);
+		char* outbuf = reinterpret_cast<char*>(&m_output_buffer[0]);
+
+		// Write the closing shift sequence, if the destination encoding requires one.
+		if (!m_iconv_instance->write_initial_state(&outbuf, &otmp_size, ec))
+		{
+			return false;
+		}
+
+		os.write(&m_output_buffer[0], m_output_buffer.size() - otmp_size / sizeof(output_char_type));
+
+		m_iconv_instance->reset();
+
+		return true;
+	}
+
+	template class conversion_session<char, char>;
+	template class conversion_session<char, wchar_t>;
+	template class conversion_session<wchar_t, char>;
+	template class conversion_session<wchar_t, wchar_t>;
+}
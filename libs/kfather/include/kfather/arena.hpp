@@ -0,0 +1,362 @@
+/*
+ * libkfather - C++ JSON parser/producer library.
+ * Copyright (C) 2010-2012 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libkfather.
+ *
+ * libkfather is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libkfather is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * If you intend to use libkfather in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file arena.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief An arena-backed JSON document representation.
+ */
+
+#ifndef KFATHER_ARENA_HPP
+#define KFATHER_ARENA_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "parser.hpp"
+
+namespace kfather
+{
+	/**
+	 * \brief A bump allocator for one JSON document.
+	 *
+	 * Memory is carved sequentially out of large blocks, so all the nodes and
+	 * strings of a document end up packed together in allocation order, and
+	 * discarding the document costs one deallocation per block instead of one
+	 * per node.
+	 *
+	 * An arena is not thread-safe: use one per document, per thread.
+	 */
+	class arena : public boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief The default block size, in bytes.
+			 */
+			static const size_t DEFAULT_BLOCK_SIZE = 65536;
+
+			/**
+			 * \brief Create an arena.
+			 * \param block_size The size of the blocks to carve allocations from. Allocations larger than this get a dedicated block.
+			 */
+			explicit arena(size_t block_size = DEFAULT_BLOCK_SIZE);
+
+			/**
+			 * \brief Destroy the arena and everything allocated from it.
+			 */
+			~arena();
+
+			/**
+			 * \brief Allocate memory from the arena.
+			 * \param size The count of bytes to allocate.
+			 * \return A pointer to the memory, suitably aligned for any of the document node types. The memory is valid until clear() or destruction.
+			 */
+			void* allocate(size_t size);
+
+			/**
+			 * \brief Copy a string into the arena.
+			 * \param str The characters to copy. May contain null bytes.
+			 * \param len The count of characters.
+			 * \return A pointer to the copy, which is null-terminated for convenience.
+			 */
+			const char* intern(const char* str, size_t len);
+
+			/**
+			 * \brief Discard everything allocated from the arena.
+			 *
+			 * The first block is kept for reuse, so a long-lived arena that
+			 * parses documents of similar sizes stops allocating altogether.
+			 */
+			void clear();
+
+		private:
+
+			struct block
+			{
+				block* next;
+				size_t size;
+				size_t used;
+			};
+
+			block* new_block(size_t data_size);
+
+			block* m_head;
+			size_t m_block_size;
+	};
+
+	class arena_value;
+
+	/**
+	 * \brief A string stored in an arena.
+	 */
+	struct arena_string
+	{
+		/**
+		 * \brief The characters. Null-terminated, but may also contain embedded null bytes: rely on size.
+		 */
+		const char* data;
+
+		/**
+		 * \brief The count of characters.
+		 */
+		size_t size;
+
+		/**
+		 * \brief Get the string as a string_type.
+		 * \return The string.
+		 */
+		string_type str() const
+		{
+			return string_type(data, size);
+		}
+	};
+
+	/**
+	 * \brief A key-value couple of an arena-backed object.
+	 */
+	struct arena_member
+	{
+		/**
+		 * \brief The key.
+		 */
+		arena_string key;
+
+		/**
+		 * \brief The value.
+		 */
+		const arena_value* value;
+
+		/**
+		 * \brief The next member of the same object, in document order, or null.
+		 */
+		const arena_member* next;
+	};
+
+	/**
+	 * \brief A JSON value whose storage lives in an arena.
+	 *
+	 * Unlike object_type, whose std::map sorts keys, object members keep their
+	 * document order. Members and items are chained in allocation order, so
+	 * walking them reads memory sequentially.
+	 *
+	 * Values are created by an arena_builder and are valid for as long as the
+	 * arena they live in.
+	 */
+	class arena_value
+	{
+		public:
+
+			/**
+			 * \brief The kind of a value.
+			 */
+			enum kind_type
+			{
+				null_kind,
+				boolean_kind,
+				number_kind,
+				string_kind,
+				array_kind,
+				object_kind
+			};
+
+			/**
+			 * \brief Get the kind of the value.
+			 * \return The kind.
+			 */
+			kind_type kind() const
+			{
+				return m_kind;
+			}
+
+			/**
+			 * \brief Get the boolean. Only meaningful for boolean_kind values.
+			 * \return The boolean.
+			 */
+			boolean_type as_boolean() const
+			{
+				return m_boolean;
+			}
+
+			/**
+			 * \brief Get the number. Only meaningful for number_kind values.
+			 * \return The number.
+			 */
+			number_type as_number() const
+			{
+				return m_number;
+			}
+
+			/**
+			 * \brief Get the string. Only meaningful for string_kind values.
+			 * \return The string.
+			 */
+			const arena_string& as_string() const
+			{
+				return m_string;
+			}
+
+			/**
+			 * \brief Get the count of items or members. Only meaningful for array_kind and object_kind values.
+			 * \return The count.
+			 */
+			size_t size() const
+			{
+				return m_count;
+			}
+
+			/**
+			 * \brief Get the first item of an array, in document order.
+			 * \return The first item, or null if the array is empty. Iterate with next_sibling().
+			 */
+			const arena_value* first_item() const
+			{
+				return m_first_item;
+			}
+
+			/**
+			 * \brief Get the next item of the enclosing array.
+			 * \return The next item, or null.
+			 */
+			const arena_value* next_sibling() const
+			{
+				return m_next_sibling;
+			}
+
+			/**
+			 * \brief Get the first member of an object, in document order.
+			 * \return The first member, or null if the object is empty. Iterate with arena_member::next.
+			 */
+			const arena_member* first_member() const
+			{
+				return m_first_member;
+			}
+
+			/**
+			 * \brief Get the value a key maps to.
+			 * \param key The key.
+			 * \return The value, or null if the value is not an object or has no such key.
+			 *
+			 * The members are scanned linearly, which beats a map lookup at the
+			 * sizes of objects that occur in practice.
+			 */
+			const arena_value* get(const char* key) const;
+
+		private:
+
+			arena_value() :
+				m_kind(null_kind),
+				m_count(0),
+				m_first_item(NULL),
+				m_last_item(NULL),
+				m_first_member(NULL),
+				m_last_member(NULL),
+				m_next_sibling(NULL)
+			{
+			}
+
+			kind_type m_kind;
+			boolean_type m_boolean;
+			number_type m_number;
+			arena_string m_string;
+			size_t m_count;
+			const arena_value* m_first_item;
+			arena_value* m_last_item;
+			const arena_member* m_first_member;
+			arena_member* m_last_member;
+			arena_value* m_next_sibling;
+
+			friend class arena_builder;
+	};
+
+	/**
+	 * \brief A sax_handler that builds an arena-backed document.
+	 *
+	 * Feed it to parser::parse():
+	 *
+	 * \code
+	 * kfather::arena arena;
+	 * kfather::arena_builder builder(arena);
+	 *
+	 * if (parser.parse(builder, str))
+	 * {
+	 *   const kfather::arena_value* const root = builder.root();
+	 *   // ...
+	 * }
+	 * \endcode
+	 *
+	 * The resulting values live in the arena: discarding the document is
+	 * arena.clear(), and nothing is freed node by node.
+	 */
+	class arena_builder : public sax_handler
+	{
+		public:
+
+			/**
+			 * \brief Create an arena builder.
+			 * \param _arena The arena to allocate the document from. Must live at least as long as the parsed document is used.
+			 */
+			explicit arena_builder(arena& _arena) :
+				m_arena(_arena),
+				m_root(NULL),
+				m_pending_member(NULL)
+			{
+			}
+
+			/**
+			 * \brief Get the root of the last parsed document.
+			 * \return The root value, or null if nothing was parsed yet.
+			 */
+			const arena_value* root() const
+			{
+				return m_root;
+			}
+
+			void on_object_start();
+			void on_key(const string_type& key);
+			void on_object_end();
+			void on_array_start();
+			void on_array_end();
+			void on_string(const string_type& value);
+			void on_number(number_type value);
+			void on_boolean(boolean_type value);
+			void on_null();
+
+		private:
+
+			arena_value* new_value(arena_value::kind_type kind);
+			void add(arena_value* value);
+
+			arena& m_arena;
+			const arena_value* m_root;
+			std::vector<arena_value*> m_stack;
+			arena_member* m_pending_member;
+	};
+}
+
+#endif /* KFATHER_ARENA_HPP */
@@ -0,0 +1,128 @@
+/*
+ * libkfather - C++ JSON parser/producer library.
+ * Copyright (C) 2010-2012 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libkfather.
+ *
+ * libkfather is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libkfather is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * If you intend to use libkfather in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file mapped_file.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A read-only memory-mapped file.
+ */
+
+#ifndef KFATHER_MAPPED_FILE_HPP
+#define KFATHER_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+
+namespace kfather
+{
+	/**
+	 * \brief A read-only memory-mapped file.
+	 *
+	 * The file content is mapped into the address space instead of being read
+	 * into a buffer: the operating system pages it in on demand, so parsing a
+	 * mapped file never requires the whole file to fit in memory.
+	 *
+	 * The mapping, and every pointer into it, is valid until close() or
+	 * destruction.
+	 */
+	class mapped_file : public boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief Create an unmapped mapped_file.
+			 */
+			mapped_file();
+
+			/**
+			 * \brief Create a mapped_file and map the specified file.
+			 * \param filename The file to map.
+			 *
+			 * If the mapping fails, a std::runtime_error is thrown.
+			 */
+			explicit mapped_file(const std::string& filename);
+
+			/**
+			 * \brief Destroy the mapped_file, unmapping the file, if any.
+			 */
+			~mapped_file();
+
+			/**
+			 * \brief Map the specified file, closing the current mapping first, if any.
+			 * \param filename The file to map.
+			 *
+			 * If the mapping fails, a std::runtime_error is thrown.
+			 */
+			void open(const std::string& filename);
+
+			/**
+			 * \brief Unmap the file, if any.
+			 *
+			 * Every pointer into the mapping becomes invalid.
+			 */
+			void close();
+
+			/**
+			 * \brief Check whether a file is currently mapped.
+			 * \return true if a file is mapped.
+			 */
+			bool is_open() const
+			{
+				return m_open;
+			}
+
+			/**
+			 * \brief Get a pointer to the mapped content.
+			 * \return The content, or null if the mapped file is empty or not mapped.
+			 */
+			const char* data() const
+			{
+				return m_data;
+			}
+
+			/**
+			 * \brief Get the size of the mapped content.
+			 * \return The size, in bytes.
+			 */
+			size_t size() const
+			{
+				return m_size;
+			}
+
+		private:
+
+			const char* m_data;
+			size_t m_size;
+			bool m_open;
+#ifdef _WIN32
+			void* m_file_handle;
+			void* m_mapping_handle;
+#endif
+	};
+}
+
+#endif /* KFATHER_MAPPED_FILE_HPP */
@@ -0,0 +1,78 @@
+/*
+ * libkfather - C++ JSON parser/producer library.
+ * Copyright (C) 2010-2012 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libkfather.
+ *
+ * libkfather is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libkfather is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * If you intend to use libkfather in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file number.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief Fast JSON number conversions.
+ */
+
+#ifndef KFATHER_NUMBER_HPP
+#define KFATHER_NUMBER_HPP
+
+#include <cstddef>
+
+#include "value.hpp"
+
+namespace kfather
+{
+	/**
+	 * \brief The maximum width of a formatted number, in characters.
+	 */
+	const size_t NUMBER_BUFFER_SIZE = 32;
+
+	/**
+	 * \brief Convert the decimal representation of a JSON number to a number_type.
+	 * \param str The characters to convert. Must match the JSON number grammar.
+	 * \param len The count of characters.
+	 * \param value The value to fill.
+	 * \return true if the conversion took the fast path. When false, value is
+	 * left untouched and the caller must convert through a slower, fully general
+	 * routine.
+	 *
+	 * The fast path covers every number whose decimal mantissa fits 53 bits and
+	 * whose effective power-of-ten exponent is exactly representable - which is
+	 * all of the integers and most of the fixed-point decimals that metric
+	 * documents are made of. It reads nothing but the characters themselves, so
+	 * it is immune to the global locale, unlike the stream extraction it
+	 * replaces.
+	 */
+	bool fast_parse_number(const char* str, size_t len, number_type& value);
+
+	/**
+	 * \brief Format a number the way JSON expects it.
+	 * \param buffer The buffer to format into.
+	 * \param nb The number.
+	 * \return The count of characters written.
+	 *
+	 * Integers within the exactly-representable range are formatted with a
+	 * direct digit loop. Other values get the shortest representation of at
+	 * most 17 significant digits that converts back to exactly nb, so output
+	 * both round-trips and stays as short as an ostream would have printed it.
+	 */
+	size_t format_number(char (&buffer)[NUMBER_BUFFER_SIZE], number_type nb);
+}
+
+#endif /* KFATHER_NUMBER_HPP */
@@ -42,6 +42,75 @@
 
 namespace kfather
 {
+	class mapped_file;
+
+	/**
+	 * \brief A handler for SAX-style JSON parsing.
+	 *
+	 * Derive from this class and override the callbacks you care about: the
+	 * default implementations do nothing, so a handler only pays for what it
+	 * extracts.
+	 *
+	 * The string references passed to on_key() and on_string() point to a
+	 * buffer owned by the parser and are only valid for the duration of the
+	 * call: copy them if you need to keep them.
+	 */
+	class sax_handler
+	{
+		public:
+
+			virtual ~sax_handler() {}
+
+			/**
+			 * \brief Called when an object starts.
+			 */
+			virtual void on_object_start() {}
+
+			/**
+			 * \brief Called for each key of an object, before the value it maps to.
+			 * \param key The key.
+			 */
+			virtual void on_key(const string_type& key) { static_cast<void>(key); }
+
+			/**
+			 * \brief Called when an object ends.
+			 */
+			virtual void on_object_end() {}
+
+			/**
+			 * \brief Called when an array starts.
+			 */
+			virtual void on_array_start() {}
+
+			/**
+			 * \brief Called when an array ends.
+			 */
+			virtual void on_array_end() {}
+
+			/**
+			 * \brief Called for each string value.
+			 * \param value The string.
+			 */
+			virtual void on_string(const string_type& value) { static_cast<void>(value); }
+
+			/**
+			 * \brief Called for each number value.
+			 * \param value The number.
+			 */
+			virtual void on_number(number_type value) { static_cast<void>(value); }
+
+			/**
+			 * \brief Called for each boolean value.
+			 * \param value The boolean.
+			 */
+			virtual void on_boolean(boolean_type value) { static_cast<void>(value); }
+
+			/**
+			 * \brief Called for each null value.
+			 */
+			virtual void on_null() {}
+	};
+
 	/**
 	 * \brief A JSON parser class.
 	 *
@@ -114,6 +183,64 @@ namespace kfather
 			 */
 			bool parse(value_type& value, std::istream& is, size_t* error_pos = NULL);
 
+			/**
+			 * \brief Parse a memory-mapped JSON file.
+			 * \param value The value to fill with the parsed content. On error, value is
+			 * guaranteed to be a null value.
+			 * \param file The mapped file to parse. Must remain mapped for the duration of the call.
+			 * \param error_token A pointer to the first invalid character, into the mapped range.
+			 * \return true if the parsing succeeds.
+			 *
+			 * The content is parsed directly from the mapping, without being read into a buffer first: the operating system pages the file in as the parse advances, so memory usage does not grow with the file size.
+			 */
+			bool parse(value_type& value, const mapped_file& file, const char** error_token = NULL);
+
+			/**
+			 * \brief Parse the specified JSON string buffer, reporting events to a handler.
+			 * \param handler The handler whose callbacks are invoked as the document is read. No value tree is built.
+			 * \param buf The buffer to parse. Must contain a valid JSON string or
+			 * the call will fail. The string must be UTF-8 encoded. buf cannot be
+			 * null.
+			 * \param buflen The length of buf.
+			 * \param error_token A pointer to a pointer to the first invalid
+			 * character of buf, in case the parsing fails.
+			 * \return true if the parsing succeeds, false otherwise.
+			 *
+			 * If the parsing fails, the handler may have been called for the part
+			 * of the document that was read up to the invalid character.
+			 */
+			bool parse(sax_handler& handler, const char* buf, size_t buflen, const char** error_token = NULL);
+
+			/**
+			 * \brief Parse the specified JSON string, reporting events to a handler.
+			 * \param handler The handler whose callbacks are invoked as the document is read. No value tree is built.
+			 * \param str The JSON string to parse. Must contain a valid JSON string or
+			 * the call will fail. The string must be UTF-8 encoded.
+			 * \param error_pos A pointer to a position of the first invalid character.
+			 * \return true if the parsing succeeds, false otherwise.
+			 */
+			bool parse(sax_handler& handler, const std::string& str, std::string::size_type* error_pos = NULL);
+
+			/**
+			 * \brief Parse the specified input stream, reporting events to a handler.
+			 * \param handler The handler whose callbacks are invoked as the document is read. No value tree is built.
+			 * \param is The input stream to parse. The stream must be UTF-8 encoded.
+			 * \param error_pos A pointer to a position of the first invalid character.
+			 * \return true if the parsing succeeds, false otherwise.
+			 */
+			bool parse(sax_handler& handler, std::istream& is, size_t* error_pos = NULL);
+
+			/**
+			 * \brief Parse a memory-mapped JSON file, SAX-style.
+			 * \param handler The handler whose callbacks get invoked as the content is parsed.
+			 * \param file The mapped file to parse. Must remain mapped for the duration of the call.
+			 * \param error_token A pointer to the first invalid character, into the mapped range.
+			 * \return true if the parsing succeeds.
+			 *
+			 * The content is parsed directly from the mapping and the handler sees each value as it goes by, so arbitrarily large files are processed in constant memory.
+			 */
+			bool parse(sax_handler& handler, const mapped_file& file, const char** error_token = NULL);
+
 		private:
 
 			/**
@@ -138,6 +265,18 @@ namespace kfather
 			template <typename IteratorType>
 			bool parse(value_type& value, IteratorType begin, IteratorType end, IteratorType* error_pos = NULL);
 
+			/**
+			 * \brief Parse a range of characters, reporting events to a handler.
+			 * \tparam IteratorType The iterator type.
+			 * \param handler The handler.
+			 * \param begin An iterator to the first character to parse.
+			 * \param end An iterator past the last character to parse.
+			 * \param error_pos A pointer to an iterator where the last parsing error occured.
+			 * \return true if the parsing succeeds, false otherwise.
+			 */
+			template <typename IteratorType>
+			bool parse(sax_handler& handler, IteratorType begin, IteratorType end, IteratorType* error_pos = NULL);
+
 		private:
 
 			class context
@@ -147,6 +286,7 @@ namespace kfather
 					context();
 					void clear();
 					void push_char(char c);
+					void push_chars(const char* str, size_t len);
 					void push_codepoint(uint16_t cp);
 					const std::string& str();
 					bool get_number(number_type&);
@@ -169,6 +309,12 @@ namespace kfather
 			template <typename IteratorType>
 			bool parse_string(context& ctx, string_type& value, IteratorType& ch, IteratorType end);
 			template <typename IteratorType>
+			bool scan_string(context& ctx, IteratorType& ch, IteratorType end);
+			template <typename IteratorType>
+			void skip_plain_run(context& ctx, IteratorType& ch, IteratorType end);
+			void skip_plain_run(context& ctx, const char*& ch, const char* end);
+			void skip_plain_run(context& ctx, std::string::const_iterator& ch, std::string::const_iterator end);
+			template <typename IteratorType>
 			bool parse_number(context& ctx, number_type& value, IteratorType& ch, IteratorType end);
 			template <typename IteratorType>
 			bool parse_boolean(context& ctx, boolean_type& value, IteratorType& ch, IteratorType end);
@@ -180,6 +326,13 @@ namespace kfather
 			bool check_chars(context& ctx, const char* str, IteratorType& ch, IteratorType end);
 			template <typename IteratorType>
 			void skip_whitespace(context& ctx, IteratorType& ch, IteratorType end);
+
+			template <typename IteratorType>
+			bool sax_parse_value(context& ctx, sax_handler& handler, IteratorType& ch, IteratorType end);
+			template <typename IteratorType>
+			bool sax_parse_object(context& ctx, sax_handler& handler, IteratorType& ch, IteratorType end);
+			template <typename IteratorType>
+			bool sax_parse_array(context& ctx, sax_handler& handler, IteratorType& ch, IteratorType end);
 	};
 }
 
@@ -0,0 +1,89 @@
+/*
+ * libkfather - C++ JSON parser/producer library.
+ * Copyright (C) 2010-2012 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libkfather.
+ *
+ * libkfather is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libkfather is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * If you intend to use libkfather in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file serializer.hpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A direct-to-buffer JSON serializer.
+ */
+
+#ifndef KFATHER_SERIALIZER_HPP
+#define KFATHER_SERIALIZER_HPP
+
+#include <string>
+
+#include "value.hpp"
+
+namespace kfather
+{
+	/**
+	 * \brief A JSON serializer that writes straight into a byte buffer.
+	 *
+	 * Produces the same compact form as compact_formatter, but bypasses the
+	 * ostream insertion machinery entirely: integers take an itoa fast path,
+	 * string escaping is table-driven, and an estimation pass sizes the
+	 * buffer so one reserve covers the whole document.
+	 *
+	 * Unlike compact_formatter, control characters in strings are escaped as
+	 * \uXXXX sequences and non-integral numbers are written with enough
+	 * digits to round-trip.
+	 *
+	 * serializer objects are thread-safe and reentrant.
+	 */
+	class serializer
+	{
+		public:
+
+			/**
+			 * \brief Serialize the specified value, appending to the specified buffer.
+			 * \param out The buffer to append to. It is reserved once, up front, for the estimated document size.
+			 * \param value The value to serialize.
+			 */
+			void serialize(std::string& out, const value_type& value) const;
+
+			/**
+			 * \brief Serialize the specified value to a string.
+			 * \param value The value to serialize.
+			 * \return The serialized string.
+			 */
+			std::string serialize(const value_type& value) const
+			{
+				std::string result;
+
+				serialize(result, value);
+
+				return result;
+			}
+
+			/**
+			 * \brief Compute an upper bound of the serialized size of a value.
+			 * \param value The value.
+			 * \return The bound, in bytes. Exact for everything but numbers, which are counted at their maximum width.
+			 */
+			static size_t estimate_size(const value_type& value);
+	};
+}
+
+#endif /* KFATHER_SERIALIZER_HPP */
@@ -0,0 +1,306 @@
+/*
+ * libkfather - C++ JSON parser/producer library.
+ * Copyright (C) 2010-2012 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libkfather.
+ *
+ * libkfather is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libkfather is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * If you intend to use libkfather in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file arena.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief An arena-backed JSON document representation.
+ */
+
+#include "arena.hpp"
+
+#include <cassert>
+#include <cstdlib>
+#include <new>
+
+namespace kfather
+{
+	namespace
+	{
+		// Every allocation is rounded up so the next one is aligned for any of the document node types.
+		const size_t ARENA_ALIGNMENT = sizeof(void*) > sizeof(double) ? sizeof(void*) : sizeof(double);
+
+		size_t align_up(size_t size)
+		{
+			return (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+		}
+	}
+
+	arena::arena(size_t block_size) :
+		m_head(NULL),
+		m_block_size(block_size)
+	{
+	}
+
+	arena::~arena()
+	{
+		while (m_head)
+		{
+			block* const next = m_head->next;
+
+			std::free(m_head);
+
+			m_head = next;
+		}
+	}
+
+	arena::block* arena::new_block(size_t data_size)
+	{
+		block* const result = static_cast<block*>(std::malloc(align_up(sizeof(block)) + data_size));
+
+		if (!result)
+		{
+			throw std::bad_alloc();
+		}
+
+		result->next = NULL;
+		result->size = data_size;
+		result->used = 0;
+
+		return result;
+	}
+
+	void* arena::allocate(size_t size)
+	{
+		size = align_up(size);
+
+		if (!m_head || (m_head->size - m_head->used < size))
+		{
+			if (size > m_block_size)
+			{
+				// An oversized allocation gets a dedicated block, inserted below the current one so its remaining space stays usable.
+				block* const dedicated = new_block(size);
+
+				if (m_head)
+				{
+					dedicated->next = m_head->next;
+					m_head->next = dedicated;
+				}
+				else
+				{
+					m_head = dedicated;
+				}
+
+				dedicated->used = size;
+
+				return reinterpret_cast<char*>(dedicated) + align_up(sizeof(block));
+			}
+
+			block* const fresh = new_block(m_block_size);
+
+			fresh->next = m_head;
+			m_head = fresh;
+		}
+
+		void* const result = reinterpret_cast<char*>(m_head) + align_up(sizeof(block)) + m_head->used;
+
+		m_head->used += size;
+
+		return result;
+	}
+
+	const char* arena::intern(const char* str, size_t len)
+	{
+		char* const result = static_cast<char*>(allocate(len + 1));
+
+		std::memcpy(result, str, len);
+		result[len] = '\0';
+
+		return result;
+	}
+
+	void arena::clear()
+	{
+		while (m_head && m_head->next)
+		{
+			block* const next = m_head->next;
+
+			std::free(m_head);
+
+			m_head = next;
+		}
+
+		if (m_head)
+		{
+			m_head->used = 0;
+		}
+	}
+
+	const arena_value* arena_value::get(const char* key) const
+	{
+		if (m_kind == object_kind)
+		{
+			const size_t key_len = std::strlen(key);
+
+			for (const arena_member* member = m_first_member; member; member = member->next)
+			{
+				if ((member->key.size == key_len) && (std::memcmp(member->key.data, key, key_len) == 0))
+				{
+					return member->value;
+				}
+			}
+		}
+
+		return NULL;
+	}
+
+	arena_value* arena_builder::new_value(arena_value::kind_type kind)
+	{
+		arena_value* const result = new (m_arena.allocate(sizeof(arena_value))) arena_value();
+
+		result->m_kind = kind;
+
+		return result;
+	}
+
+	void arena_builder::add(arena_value* value)
+	{
+		if (m_stack.empty())
+		{
+			// A new document starts: previous nodes stay in the arena until its owner clears it.
+			m_root = value;
+			m_pending_member = NULL;
+
+			return;
+		}
+
+		arena_value* const top = m_stack.back();
+
+		if (top->m_kind == arena_value::array_kind)
+		{
+			if (top->m_last_item)
+			{
+				top->m_last_item->m_next_sibling = value;
+			}
+			else
+			{
+				top->m_first_item = value;
+			}
+
+			top->m_last_item = value;
+			++top->m_count;
+		}
+		else
+		{
+			assert(m_pending_member);
+
+			m_pending_member->value = value;
+			m_pending_member = NULL;
+		}
+	}
+
+	void arena_builder::on_object_start()
+	{
+		arena_value* const value = new_value(arena_value::object_kind);
+
+		add(value);
+
+		m_stack.push_back(value);
+	}
+
+	void arena_builder::on_key(const string_type& key)
+	{
+		assert(!m_stack.empty());
+
+		arena_value* const top = m_stack.back();
+
+		arena_member* const member = static_cast<arena_member*>(m_arena.allocate(sizeof(arena_member)));
+
+		member->key.data = m_arena.intern(key.c_str(), key.size());
+		member->key.size = key.size();
+		member->value = NULL;
+		member->next = NULL;
+
+		if (top->m_last_member)
+		{
+			top->m_last_member->next = member;
+		}
+		else
+		{
+			top->m_first_member = member;
+		}
+
+		top->m_last_member = member;
+		++top->m_count;
+
+		m_pending_member = member;
+	}
+
+	void arena_builder::on_object_end()
+	{
+		assert(!m_stack.empty());
+
+		m_stack.pop_back();
+	}
+
+	void arena_builder::on_array_start()
+	{
+		arena_value* const value = new_value(arena_value::array_kind);
+
+		add(value);
+
+		m_stack.push_back(value);
+	}
+
+	void arena_builder::on_array_end()
+	{
+		assert(!m_stack.empty());
+
+		m_stack.pop_back();
+	}
+
+	void arena_builder::on_string(const string_type& value)
+	{
+		arena_value* const result = new_value(arena_value::string_kind);
+
+		result->m_string.data = m_arena.intern(value.c_str(), value.size());
+		result->m_string.size = value.size();
+
+		add(result);
+	}
+
+	void arena_builder::on_number(number_type value)
+	{
+		arena_value* const result = new_value(arena_value::number_kind);
+
+		result->m_number = value;
+
+		add(result);
+	}
+
+	void arena_builder::on_boolean(boolean_type value)
+	{
+		arena_value* const result = new_value(arena_value::boolean_kind);
+
+		result->m_boolean = value;
+
+		add(result);
+	}
+
+	void arena_builder::on_null()
+	{
+		add(new_value(arena_value::null_kind));
+	}
+}
@@ -31,6 +31,7 @@
 
 #include "formatter.hpp"
 
+#include "number.hpp"
 #include "parser.hpp"
 
 #include <boost/bind.hpp>
@@ -49,7 +50,12 @@ namespace kfather
 
 	std::ostream& base_formatter_visitor::operator()(const number_type& nb) const
 	{
-		return os() << nb;
+		// Formatting into a stack buffer skips the locale machinery of the stream insertion.
+		char digits[NUMBER_BUFFER_SIZE];
+
+		const size_t count = format_number(digits, nb);
+
+		return os().write(digits, static_cast<std::streamsize>(count));
 	}
 
 	std::ostream& base_formatter_visitor::operator()(const string_type& str) const
@@ -0,0 +1,229 @@
+/*
+ * libkfather - C++ JSON parser/producer library.
+ * Copyright (C) 2010-2012 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libkfather.
+ *
+ * libkfather is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libkfather is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * If you intend to use libkfather in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file mapped_file.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A read-only memory-mapped file.
+ */
+
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace kfather
+{
+	namespace
+	{
+		std::runtime_error make_error(const std::string& filename, const std::string& what)
+		{
+			return std::runtime_error("Unable to map \"" + filename + "\": " + what);
+		}
+	}
+
+	mapped_file::mapped_file() :
+		m_data(NULL),
+		m_size(0),
+		m_open(false)
+#ifdef _WIN32
+		,
+		m_file_handle(NULL),
+		m_mapping_handle(NULL)
+#endif
+	{
+	}
+
+	mapped_file::mapped_file(const std::string& filename) :
+		m_data(NULL),
+		m_size(0),
+		m_open(false)
+#ifdef _WIN32
+		,
+		m_file_handle(NULL),
+		m_mapping_handle(NULL)
+#endif
+	{
+		open(filename);
+	}
+
+	mapped_file::~mapped_file()
+	{
+		close();
+	}
+
+#ifdef _WIN32
+
+	void mapped_file::open(const std::string& filename)
+	{
+		close();
+
+		const HANDLE file_handle = ::CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+		if (file_handle == INVALID_HANDLE_VALUE)
+		{
+			throw make_error(filename, "CreateFile() failed");
+		}
+
+		LARGE_INTEGER file_size;
+
+		if (!::GetFileSizeEx(file_handle, &file_size))
+		{
+			::CloseHandle(file_handle);
+
+			throw make_error(filename, "GetFileSizeEx() failed");
+		}
+
+		if (file_size.QuadPart == 0)
+		{
+			// An empty file has nothing to map: CreateFileMapping() would fail on it.
+			::CloseHandle(file_handle);
+
+			m_open = true;
+
+			return;
+		}
+
+		const HANDLE mapping_handle = ::CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+
+		if (!mapping_handle)
+		{
+			::CloseHandle(file_handle);
+
+			throw make_error(filename, "CreateFileMapping() failed");
+		}
+
+		const void* const data = ::MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+
+		if (!data)
+		{
+			::CloseHandle(mapping_handle);
+			::CloseHandle(file_handle);
+
+			throw make_error(filename, "MapViewOfFile() failed");
+		}
+
+		m_data = static_cast<const char*>(data);
+		m_size = static_cast<size_t>(file_size.QuadPart);
+		m_open = true;
+		m_file_handle = file_handle;
+		m_mapping_handle = mapping_handle;
+	}
+
+	void mapped_file::close()
+	{
+		if (m_data)
+		{
+			::UnmapViewOfFile(m_data);
+			::CloseHandle(m_mapping_handle);
+			::CloseHandle(m_file_handle);
+		}
+
+		m_data = NULL;
+		m_size = 0;
+		m_open = false;
+		m_file_handle = NULL;
+		m_mapping_handle = NULL;
+	}
+
+#else
+
+	void mapped_file::open(const std::string& filename)
+	{
+		close();
+
+		const int fd = ::open(filename.c_str(), O_RDONLY);
+
+		if (fd < 0)
+		{
+			throw make_error(filename, ::strerror(errno));
+		}
+
+		struct stat st;
+
+		if (::fstat(fd, &st) != 0)
+		{
+			const int error = errno;
+
+			::close(fd);
+
+			throw make_error(filename, ::strerror(error));
+		}
+
+		if (st.st_size == 0)
+		{
+			// An empty file has nothing to map: mmap() would fail on it.
+			::close(fd);
+
+			m_open = true;
+
+			return;
+		}
+
+		void* const data = ::mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+		// The mapping keeps its own reference to the file: the descriptor is not needed anymore.
+		::close(fd);
+
+		if (data == MAP_FAILED)
+		{
+			throw make_error(filename, ::strerror(errno));
+		}
+
+#ifdef MADV_SEQUENTIAL
+		// Parsing walks the file front to back: let the kernel read ahead aggressively.
+		::madvise(data, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+#endif
+
+		m_data = static_cast<const char*>(data);
+		m_size = static_cast<size_t>(st.st_size);
+		m_open = true;
+	}
+
+	void mapped_file::close()
+	{
+		if (m_data)
+		{
+			::munmap(const_cast<char*>(m_data), m_size);
+		}
+
+		m_data = NULL;
+		m_size = 0;
+		m_open = false;
+	}
+
+#endif
+}
@@ -0,0 +1,230 @@
+/*
+ * libkfather - C++ JSON parser/producer library.
+ * Copyright (C) 2010-2012 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libkfather.
+ *
+ * libkfather is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libkfather is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * If you intend to use libkfather in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file number.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief Fast JSON number conversions.
+ */
+
+#include "number.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <stdint.h>
+
+namespace kfather
+{
+	namespace
+	{
+		// The powers of ten that are exactly representable as doubles: multiplying
+		// or dividing an exact mantissa by one of them is a single correctly
+		// rounded operation.
+		const double exact_powers_of_ten[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+			1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+			1e21, 1e22
+		};
+
+		const int max_exact_power_of_ten = 22;
+
+		// The largest integer a double represents exactly: 2^53.
+		const uint64_t max_exact_mantissa = 9007199254740992ULL;
+	}
+
+	bool fast_parse_number(const char* str, size_t len, number_type& value)
+	{
+		const char* ch = str;
+		const char* const end = str + len;
+
+		bool negative = false;
+
+		if ((ch != end) && (*ch == '-'))
+		{
+			negative = true;
+			++ch;
+		}
+
+		// Accumulate the digits of both the integer and the fraction part into
+		// one decimal mantissa, remembering how many of them sit behind the
+		// period.
+		uint64_t mantissa = 0;
+		int fraction_digits = 0;
+		bool too_many_digits = false;
+
+		for (; (ch != end) && (*ch >= '0') && (*ch <= '9'); ++ch)
+		{
+			if (mantissa > (max_exact_mantissa / 10))
+			{
+				too_many_digits = true;
+				break;
+			}
+
+			mantissa = mantissa * 10 + static_cast<uint64_t>(*ch - '0');
+		}
+
+		if (!too_many_digits && (ch != end) && (*ch == '.'))
+		{
+			++ch;
+
+			for (; (ch != end) && (*ch >= '0') && (*ch <= '9'); ++ch)
+			{
+				if (mantissa > (max_exact_mantissa / 10))
+				{
+					too_many_digits = true;
+					break;
+				}
+
+				mantissa = mantissa * 10 + static_cast<uint64_t>(*ch - '0');
+				++fraction_digits;
+			}
+		}
+
+		if (too_many_digits || (mantissa > max_exact_mantissa))
+		{
+			return false;
+		}
+
+		int exponent = 0;
+
+		if ((ch != end) && ((*ch == 'e') || (*ch == 'E')))
+		{
+			++ch;
+
+			bool exponent_negative = false;
+
+			if (ch != end)
+			{
+				if (*ch == '-')
+				{
+					exponent_negative = true;
+					++ch;
+				}
+				else if (*ch == '+')
+				{
+					++ch;
+				}
+			}
+
+			for (; (ch != end) && (*ch >= '0') && (*ch <= '9'); ++ch)
+			{
+				if (exponent > 9999)
+				{
+					return false;
+				}
+
+				exponent = exponent * 10 + (*ch - '0');
+			}
+
+			if (exponent_negative)
+			{
+				exponent = -exponent;
+			}
+		}
+
+		if (ch != end)
+		{
+			// Trailing characters: the caller handed us something the grammar
+			// should have rejected. Let the general routine deal with it.
+			return false;
+		}
+
+		exponent -= fraction_digits;
+
+		if ((exponent < -max_exact_power_of_ten) || (exponent > max_exact_power_of_ten))
+		{
+			return false;
+		}
+
+		// Both operands are exact, so the single multiplication or division
+		// below rounds correctly, and the result matches what a full
+		// arbitrary-precision conversion would produce.
+		double result = static_cast<double>(mantissa);
+
+		if (exponent > 0)
+		{
+			result *= exact_powers_of_ten[exponent];
+		}
+		else if (exponent < 0)
+		{
+			result /= exact_powers_of_ten[-exponent];
+		}
+
+		value = negative ? -result : result;
+
+		return true;
+	}
+
+	size_t format_number(char (&buffer)[NUMBER_BUFFER_SIZE], number_type nb)
+	{
+		// Integers within the exactly-representable range take the digit-loop path.
+		if ((nb == std::floor(nb)) && (nb >= -9007199254740992.0) && (nb <= 9007199254740992.0))
+		{
+			int64_t value = static_cast<int64_t>(nb);
+
+			char digits[NUMBER_BUFFER_SIZE];
+			char* ch = digits + sizeof(digits);
+
+			const bool negative = (value < 0);
+			uint64_t magnitude = negative ? (0 - static_cast<uint64_t>(value)) : static_cast<uint64_t>(value);
+
+			do
+			{
+				*--ch = static_cast<char>('0' + (magnitude % 10));
+				magnitude /= 10;
+			}
+			while (magnitude != 0);
+
+			if (negative)
+			{
+				*--ch = '-';
+			}
+
+			const size_t count = static_cast<size_t>(digits + sizeof(digits) - ch);
+
+			std::memcpy(buffer, ch, count);
+
+			return count;
+		}
+
+		// Shortest round-trip: most values already convert back exactly from 15
+		// significant digits, so the retries are rare and the common output is
+		// as short as an ostream would have printed it.
+		for (int precision = 15; precision <= 17; ++precision)
+		{
+			const int count = ::snprintf(buffer, sizeof(buffer), "%.*g", precision, nb);
+
+			if ((precision == 17) || (::strtod(buffer, NULL) == nb))
+			{
+				return static_cast<size_t>(count);
+			}
+		}
+
+		return 0;
+	}
+}
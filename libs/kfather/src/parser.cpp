@@ -31,12 +31,22 @@
 
 #include "parser.hpp"
 
+#include "mapped_file.hpp"
+#include "number.hpp"
+
 #include <string>
 #include <sstream>
 #include <cctype>
 #include <cassert>
 #include <streambuf>
 
+#include <cpu_features.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define KFATHER_PARSER_USE_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace kfather
 {
 	namespace
@@ -65,6 +75,85 @@ namespace kfather
 
 			return digit_map[static_cast<uint8_t>(c)];
 		}
+
+		bool is_plain_string_char(char c)
+		{
+			// Anything but the closing quote, an escape or a control character (0x7f included, to match std::iscntrl).
+			const uint8_t uc = static_cast<uint8_t>(c);
+
+			return (c != '"') && (c != '\\') && (uc >= 0x20) && (uc != 0x7f);
+		}
+
+		size_t plain_string_run_plain(const char* begin, const char* end)
+		{
+			const char* ch = begin;
+
+			while ((ch != end) && is_plain_string_char(*ch))
+			{
+				++ch;
+			}
+
+			return static_cast<size_t>(ch - begin);
+		}
+
+#ifdef KFATHER_PARSER_USE_SSE2
+		size_t plain_string_run_sse2(const char* begin, const char* end)
+		{
+			const char* ch = begin;
+
+			// Classify 16 bytes at a time: a chunk with no quote, backslash or control character is skipped whole.
+			const __m128i quotes = _mm_set1_epi8('"');
+			const __m128i backslashes = _mm_set1_epi8('\\');
+			const __m128i controls = _mm_set1_epi8(0x1f);
+			const __m128i dels = _mm_set1_epi8(0x7f);
+
+			while (end - ch >= 16)
+			{
+				const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ch));
+
+				__m128i special = _mm_cmpeq_epi8(chunk, quotes);
+				special = _mm_or_si128(special, _mm_cmpeq_epi8(chunk, backslashes));
+				// min(chunk, 0x1f) == chunk catches every byte below 0x20, unsigned.
+				special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_min_epu8(chunk, controls), chunk));
+				special = _mm_or_si128(special, _mm_cmpeq_epi8(chunk, dels));
+
+				const int mask = _mm_movemask_epi8(special);
+
+				if (mask != 0)
+				{
+#ifdef _MSC_VER
+					unsigned long offset = 0;
+					_BitScanForward(&offset, static_cast<unsigned long>(mask));
+					return static_cast<size_t>(ch - begin) + offset;
+#else
+					return static_cast<size_t>(ch - begin) + static_cast<size_t>(__builtin_ctz(static_cast<unsigned int>(mask)));
+#endif
+				}
+
+				ch += 16;
+			}
+
+			return static_cast<size_t>(ch - begin) + plain_string_run_plain(ch, end);
+		}
+#endif
+
+		typedef size_t (*plain_string_run_function_type)(const char*, const char*);
+
+		// The kernel is bound once from the features of the running CPU, so the string scanner pays no per-call feature check.
+		const plain_string_run_function_type plain_string_run_impl = cpu_features::select<plain_string_run_function_type>(
+			&plain_string_run_plain
+#ifdef KFATHER_PARSER_USE_SSE2
+			, &plain_string_run_sse2
+#endif
+		);
+
+		/**
+		 * \brief Get the length of the prefix of [begin, end) that contains only plain string characters.
+		 */
+		inline size_t plain_string_run(const char* begin, const char* end)
+		{
+			return plain_string_run_impl(begin, end);
+		}
 	}
 
 	bool parser::parse(value_type& value, const char* buf, size_t buflen, const char** error_token)
@@ -136,6 +225,90 @@ namespace kfather
 		}
 	}
 
+	bool parser::parse(value_type& value, const mapped_file& file, const char** error_token)
+	{
+		// An empty mapping has a null data pointer: parse an empty buffer instead, which fails the same way an empty string does.
+		static const char empty = '\0';
+
+		return parse(value, file.data() ? file.data() : &empty, file.size(), error_token);
+	}
+
+	bool parser::parse(sax_handler& handler, const char* buf, size_t buflen, const char** error_token)
+	{
+		assert(buf);
+
+		const char* const end = buf + buflen;
+		const char* ch = buf;
+
+		context ctx;
+
+		skip_whitespace(ctx, ch, end);
+
+		if (!sax_parse_value(ctx, handler, ch, end))
+		{
+			if (error_token)
+			{
+				*error_token = ch;
+			}
+
+			return false;
+		}
+
+		return true;
+	}
+
+	bool parser::parse(sax_handler& handler, const mapped_file& file, const char** error_token)
+	{
+		static const char empty = '\0';
+
+		return parse(handler, file.data() ? file.data() : &empty, file.size(), error_token);
+	}
+
+	bool parser::parse(sax_handler& handler, const std::string& str, std::string::size_type* error_pos)
+	{
+		if (error_pos)
+		{
+			std::string::const_iterator error_it;
+
+			if (!parse(handler, str.begin(), str.end(), &error_it))
+			{
+				*error_pos = std::distance(str.begin(), error_it);
+
+				return false;
+			}
+
+			return true;
+		}
+		else
+		{
+			return parse(handler, str.begin(), str.end());
+		}
+	}
+
+	bool parser::parse(sax_handler& handler, std::istream& is, size_t* error_pos)
+	{
+		const std::istreambuf_iterator<char> begin = std::istreambuf_iterator<char>(is);
+		const std::istreambuf_iterator<char> end;
+
+		if (error_pos)
+		{
+			std::istreambuf_iterator<char> error_it;
+
+			if (!parse(handler, begin, end, &error_it))
+			{
+				*error_pos = static_cast<size_t>(std::distance(begin, error_it));
+
+				return false;
+			}
+
+			return true;
+		}
+		else
+		{
+			return parse(handler, begin, end);
+		}
+	}
+
 	template <typename IteratorType>
 	bool parser::parse(value_type& value, IteratorType begin, IteratorType end, IteratorType* error_pos)
 	{
@@ -158,6 +331,28 @@ namespace kfather
 		return true;
 	}
 
+	template <typename IteratorType>
+	bool parser::parse(sax_handler& handler, IteratorType begin, IteratorType end, IteratorType* error_pos)
+	{
+		IteratorType it = begin;
+
+		context ctx;
+
+		skip_whitespace(ctx, it, end);
+
+		if (!sax_parse_value(ctx, handler, it, end))
+		{
+			if (error_pos)
+			{
+				*error_pos = it;
+			}
+
+			return false;
+		}
+
+		return true;
+	}
+
 	template <typename IteratorType>
 	bool parser::parse_value(context& ctx, value_type& value, IteratorType& ch, IteratorType end)
 	{
@@ -380,6 +575,49 @@ namespace kfather
 
 	template <typename IteratorType>
 	bool parser::parse_string(context& ctx, string_type& value, IteratorType& ch, IteratorType end)
+	{
+		if (!scan_string(ctx, ch, end))
+		{
+			return false;
+		}
+
+		value = ctx.str();
+
+		return true;
+	}
+
+	template <typename IteratorType>
+	void parser::skip_plain_run(context&, IteratorType&, IteratorType)
+	{
+		// Generic iterators go through the scalar loop; the contiguous overloads below do the bulk scanning.
+	}
+
+	void parser::skip_plain_run(context& ctx, const char*& ch, const char* end)
+	{
+		const size_t run = plain_string_run(ch, end);
+
+		if (run > 0)
+		{
+			ctx.push_chars(ch, run);
+
+			ch += run;
+		}
+	}
+
+	void parser::skip_plain_run(context& ctx, std::string::const_iterator& ch, std::string::const_iterator end)
+	{
+		if (ch != end)
+		{
+			const char* ptr = &*ch;
+
+			skip_plain_run(ctx, ptr, ptr + (end - ch));
+
+			ch += (ptr - &*ch);
+		}
+	}
+
+	template <typename IteratorType>
+	bool parser::scan_string(context& ctx, IteratorType& ch, IteratorType end)
 	{
 		ctx.clear();
 
@@ -390,6 +628,14 @@ namespace kfather
 
 		while (ch != end)
 		{
+			// Skip over the run of plain characters ahead, if the iterator exposes contiguous memory.
+			skip_plain_run(ctx, ch, end);
+
+			if (ch == end)
+			{
+				break;
+			}
+
 			if (std::iscntrl(*ch))
 			{
 				return false;
@@ -402,8 +648,6 @@ namespace kfather
 						// The string ends.
 						++ch;
 
-						value = ctx.str();
-
 						return true;
 					}
 
@@ -651,6 +895,215 @@ namespace kfather
 		return false;
 	}
 
+	template <typename IteratorType>
+	bool parser::sax_parse_value(context& ctx, sax_handler& handler, IteratorType& ch, IteratorType end)
+	{
+		if (ch == end)
+		{
+			return false;
+		}
+
+		switch (*ch)
+		{
+			case '{':
+				return sax_parse_object(ctx, handler, ch, end);
+
+			case '[':
+				return sax_parse_array(ctx, handler, ch, end);
+
+			case '"':
+				{
+					if (!scan_string(ctx, ch, end))
+					{
+						return false;
+					}
+
+					handler.on_string(ctx.str());
+
+					return true;
+				}
+
+			case 't':
+			case 'f':
+				{
+					boolean_type bt;
+
+					if (!parse_boolean(ctx, bt, ch, end))
+					{
+						return false;
+					}
+
+					handler.on_boolean(bt);
+
+					return true;
+				}
+
+			case 'n':
+				{
+					null_type nt;
+
+					if (!parse_null(ctx, nt, ch, end))
+					{
+						return false;
+					}
+
+					handler.on_null();
+
+					return true;
+				}
+
+			default:
+				{
+					number_type nb;
+
+					if (!parse_number(ctx, nb, ch, end))
+					{
+						return false;
+					}
+
+					handler.on_number(nb);
+
+					return true;
+				}
+		}
+	}
+
+	template <typename IteratorType>
+	bool parser::sax_parse_object(context& ctx, sax_handler& handler, IteratorType& ch, IteratorType end)
+	{
+		if (!check_char(ctx, '{', ch, end))
+		{
+			return false;
+		}
+
+		handler.on_object_start();
+
+		skip_whitespace(ctx, ch, end);
+
+		if (ch != end)
+		{
+			// Do we have an empty object ?
+			if (*ch == '}')
+			{
+				++ch;
+
+				handler.on_object_end();
+
+				return true;
+			}
+
+			while (ch != end)
+			{
+				if (!scan_string(ctx, ch, end))
+				{
+					return false;
+				}
+
+				handler.on_key(ctx.str());
+
+				skip_whitespace(ctx, ch, end);
+
+				if (!check_char(ctx, ':', ch, end))
+				{
+					return false;
+				}
+
+				skip_whitespace(ctx, ch, end);
+
+				if (!sax_parse_value(ctx, handler, ch, end))
+				{
+					return false;
+				}
+
+				skip_whitespace(ctx, ch, end);
+
+				if (ch != end)
+				{
+					if (*ch == '}')
+					{
+						++ch;
+
+						handler.on_object_end();
+
+						return true;
+					}
+
+					if (*ch != ',')
+					{
+						return false;
+					}
+
+					++ch;
+
+					skip_whitespace(ctx, ch, end);
+				}
+			}
+		}
+
+		return false;
+	}
+
+	template <typename IteratorType>
+	bool parser::sax_parse_array(context& ctx, sax_handler& handler, IteratorType& ch, IteratorType end)
+	{
+		if (!check_char(ctx, '[', ch, end))
+		{
+			return false;
+		}
+
+		handler.on_array_start();
+
+		skip_whitespace(ctx, ch, end);
+
+		if (ch != end)
+		{
+			// Do we have an empty array.
+			if (*ch == ']')
+			{
+				++ch;
+
+				handler.on_array_end();
+
+				return true;
+			}
+
+			while (ch != end)
+			{
+				skip_whitespace(ctx, ch, end);
+
+				if (!sax_parse_value(ctx, handler, ch, end))
+				{
+					return false;
+				}
+
+				skip_whitespace(ctx, ch, end);
+
+				if (ch != end)
+				{
+					if (*ch == ']')
+					{
+						++ch;
+
+						handler.on_array_end();
+
+						return true;
+					}
+
+					if (*ch != ',')
+					{
+						return false;
+					}
+
+					++ch;
+
+					skip_whitespace(ctx, ch, end);
+				}
+			}
+		}
+
+		return false;
+	}
+
 	template <typename IteratorType>
 	bool parser::check_char(context&, char c, IteratorType& ch, IteratorType end)
 	{
@@ -703,6 +1156,13 @@ namespace kfather
 		m_str.push_back(c);
 	}
 
+	void parser::context::push_chars(const char* str, size_t len)
+	{
+		end_codepoints();
+
+		m_str.append(str, len);
+	}
+
 	void parser::context::push_codepoint(uint16_t cp)
 	{
 		m_utf16.push_back(static_cast<char>(cp / 256));
@@ -718,6 +1178,16 @@ namespace kfather
 
 	bool parser::context::get_number(number_type& value)
 	{
+		// The digits were already validated against the JSON grammar: nearly every
+		// number converts through the locale-independent fast path, and only the
+		// extreme ones pay for a stream extraction.
+		if (fast_parse_number(m_str.c_str(), m_str.size(), value))
+		{
+			m_str.clear();
+
+			return true;
+		}
+
 		std::istringstream iss(m_str);
 
 		m_str.clear();
@@ -0,0 +1,282 @@
+/*
+ * libkfather - C++ JSON parser/producer library.
+ * Copyright (C) 2010-2012 Julien Kauffmann <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libkfather.
+ *
+ * libkfather is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libkfather is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * If you intend to use libkfather in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file serializer.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A direct-to-buffer JSON serializer.
+ */
+
+#include "serializer.hpp"
+
+#include "number.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace kfather
+{
+	namespace
+	{
+		/**
+		 * \brief The escape sequence for each byte, or null if the byte is written as-is.
+		 */
+		const char* const ESCAPE_TABLE[256] =
+		{
+			"\\u0000", "\\u0001", "\\u0002", "\\u0003", "\\u0004", "\\u0005", "\\u0006", "\\u0007",
+			"\\b", "\\t", "\\n", "\\u000b", "\\f", "\\r", "\\u000e", "\\u000f",
+			"\\u0010", "\\u0011", "\\u0012", "\\u0013", "\\u0014", "\\u0015", "\\u0016", "\\u0017",
+			"\\u0018", "\\u0019", "\\u001a", "\\u001b", "\\u001c", "\\u001d", "\\u001e", "\\u001f",
+			NULL, NULL, "\\\"", NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, "\\/",
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, "\\\\", NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
+		};
+
+		// Enough for the sign and 20 digits of an int64, or a %.17g double.
+		const size_t MAX_NUMBER_WIDTH = 32;
+
+		void append_string(std::string& out, const string_type& str)
+		{
+			out += '"';
+
+			const char* const data = str.c_str();
+			const size_t size = str.size();
+			size_t run_start = 0;
+
+			for (size_t i = 0; i < size; ++i)
+			{
+				const char* const escape = ESCAPE_TABLE[static_cast<uint8_t>(data[i])];
+
+				if (escape)
+				{
+					out.append(data + run_start, i - run_start);
+					out.append(escape);
+
+					run_start = i + 1;
+				}
+			}
+
+			out.append(data + run_start, size - run_start);
+
+			out += '"';
+		}
+
+		void append_number(std::string& out, number_type nb)
+		{
+			char digits[NUMBER_BUFFER_SIZE];
+
+			out.append(digits, format_number(digits, nb));
+		}
+
+		void append_value(std::string& out, const value_type& value);
+
+		class append_visitor : public boost::static_visitor<void>
+		{
+			public:
+
+				append_visitor(std::string& out) : m_out(out) {}
+
+				void operator()(const null_type&) const
+				{
+					m_out.append("null", 4);
+				}
+
+				void operator()(const boolean_type& bt) const
+				{
+					if (bt)
+					{
+						m_out.append("true", 4);
+					}
+					else
+					{
+						m_out.append("false", 5);
+					}
+				}
+
+				void operator()(const number_type& nb) const
+				{
+					append_number(m_out, nb);
+				}
+
+				void operator()(const string_type& str) const
+				{
+					append_string(m_out, str);
+				}
+
+				void operator()(const array_type& ar) const
+				{
+					m_out += '[';
+
+					for (array_type::items_type::const_iterator it = ar.items.begin(); it != ar.items.end(); ++it)
+					{
+						if (it != ar.items.begin())
+						{
+							m_out += ',';
+						}
+
+						append_value(m_out, *it);
+					}
+
+					m_out += ']';
+				}
+
+				void operator()(const object_type& obj) const
+				{
+					m_out += '{';
+
+					for (object_type::items_type::const_iterator it = obj.items.begin(); it != obj.items.end(); ++it)
+					{
+						if (it != obj.items.begin())
+						{
+							m_out += ',';
+						}
+
+						append_string(m_out, it->first);
+
+						m_out += ':';
+
+						append_value(m_out, it->second);
+					}
+
+					m_out += '}';
+				}
+
+			private:
+
+				std::string& m_out;
+		};
+
+		void append_value(std::string& out, const value_type& value)
+		{
+			boost::apply_visitor(append_visitor(out), value);
+		}
+
+		size_t string_size(const string_type& str)
+		{
+			const char* const data = str.c_str();
+			size_t result = 2 + str.size();
+
+			for (size_t i = 0; i < str.size(); ++i)
+			{
+				const char* const escape = ESCAPE_TABLE[static_cast<uint8_t>(data[i])];
+
+				if (escape)
+				{
+					result += std::strlen(escape) - 1;
+				}
+			}
+
+			return result;
+		}
+
+		class estimate_visitor : public boost::static_visitor<size_t>
+		{
+			public:
+
+				size_t operator()(const null_type&) const
+				{
+					return 4;
+				}
+
+				size_t operator()(const boolean_type&) const
+				{
+					return 5;
+				}
+
+				size_t operator()(const number_type&) const
+				{
+					return MAX_NUMBER_WIDTH;
+				}
+
+				size_t operator()(const string_type& str) const
+				{
+					return string_size(str);
+				}
+
+				size_t operator()(const array_type& ar) const
+				{
+					size_t result = 2 + (ar.items.empty() ? 0 : ar.items.size() - 1);
+
+					for (array_type::items_type::const_iterator it = ar.items.begin(); it != ar.items.end(); ++it)
+					{
+						result += boost::apply_visitor(*this, *it);
+					}
+
+					return result;
+				}
+
+				size_t operator()(const object_type& obj) const
+				{
+					size_t result = 2 + (obj.items.empty() ? 0 : (obj.items.size() * 2) - 1);
+
+					for (object_type::items_type::const_iterator it = obj.items.begin(); it != obj.items.end(); ++it)
+					{
+						result += string_size(it->first);
+						result += boost::apply_visitor(*this, it->second);
+					}
+
+					return result;
+				}
+		};
+	}
+
+	void serializer::serialize(std::string& out, const value_type& value) const
+	{
+		out.reserve(out.size() + estimate_size(value));
+
+		append_value(out, value);
+	}
+
+	size_t serializer::estimate_size(const value_type& value)
+	{
+		return boost::apply_visitor(estimate_visitor(), value);
+	}
+}
@@ -49,16 +49,20 @@
 #include <string>
 #include <atomic>
 #include <vector>
+#include <map>
 #include <set>
 #include <regex>
 #include <type_traits>
 
 #include <boost/optional.hpp>
+#include <boost/utility/string_ref.hpp>
 #include <boost/asio.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/weak_ptr.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/exception/all.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include <cryptoplus/x509/certificate.hpp>
 #include <cryptoplus/pkey/pkey.hpp>
@@ -128,6 +132,45 @@ namespace mongooseplus
 			std::string m_value;
 	};
 
+	/**
+	 * \brief A non-owning view of a HTTP header.
+	 *
+	 * A header_view copies nothing: the key and the value point straight into the buffers mongoose parsed the request into, and are only valid while the request is being handled. Call to_header() when the header has to outlive the handler.
+	 *
+	 * Unlike header_type, the key keeps its original casing: compare it case-insensitively.
+	 */
+	class header_view
+	{
+		public:
+			header_view(boost::string_ref _key, boost::string_ref _value) :
+				m_key(_key),
+				m_value(_value)
+			{}
+
+			boost::string_ref key() const
+			{
+				return m_key;
+			}
+
+			boost::string_ref value() const
+			{
+				return m_value;
+			}
+
+			/**
+			 * \brief Materialize an owned header from the view.
+			 * \return The header.
+			 */
+			header_type to_header() const
+			{
+				return header_type(m_key.to_string(), m_value.to_string());
+			}
+
+		private:
+			boost::string_ref m_key;
+			boost::string_ref m_value;
+	};
+
 	class generic_session
 	{
 		public:
@@ -187,10 +230,28 @@ namespace mongooseplus
 	{
 		public:
 
-			session_handler_type()
-			{
-				generate_session_id();
-			}
+			/**
+			 * \brief The occupancy metrics of the session store.
+			 */
+			struct metrics_type
+			{
+				/**
+				 * \brief The total count of stored sessions, expired ones included until they are collected.
+				 */
+				size_t session_count;
+
+				/**
+				 * \brief The count of sessions held by each shard.
+				 */
+				std::vector<size_t> shard_occupancy;
+
+				/**
+				 * \brief The count of pending expiry wheel entries.
+				 */
+				size_t wheel_entry_count;
+			};
+
+			session_handler_type();
 
 			template <typename SessionType, typename... Types>
 			boost::shared_ptr<SessionType> generate_session(Types&&... values)
@@ -198,7 +259,7 @@ namespace mongooseplus
 				const std::string session_id = generate_session_id();
 				boost::shared_ptr<SessionType> session = boost::make_shared<SessionType>(session_id, std::forward<Types>(values)...);
 
-				m_sessions[session_id] = session;
+				store_session(session);
 
 				return session;
 			}
@@ -207,12 +268,51 @@ namespace mongooseplus
 
 			void clear_expired();
 
+			/**
+			 * \brief Get the occupancy metrics of the session store.
+			 * \return The metrics.
+			 */
+			metrics_type get_metrics() const;
+
 		private:
 
+			/**
+			 * Sessions are spread over independently locked shards, keyed by a
+			 * hash of their identifier, so concurrent lookups only contend when
+			 * they land on the same shard. Expiry goes through a hashed timing
+			 * wheel of one-second slots: clear_expired() only visits the slots
+			 * elapsed since its last call, instead of scanning every session.
+			 */
+			static const size_t SHARD_COUNT = 16;
+			static const size_t WHEEL_SLOT_COUNT = 512;
+
+			struct shard_type
+			{
+				mutable boost::mutex mutex;
+				std::map<std::string, boost::shared_ptr<generic_session>> sessions;
+			};
+
+			struct wheel_entry_type
+			{
+				std::string session_id;
+				boost::weak_ptr<generic_session> session;
+			};
+
+			void store_session(const boost::shared_ptr<generic_session>& session);
+			boost::shared_ptr<generic_session> find_session(const std::string& session_id) const;
+			void drop_session(const std::string& session_id);
+			void schedule(const boost::shared_ptr<generic_session>& session);
+
+			static size_t shard_index_for(const std::string& session_id);
+			static int64_t tick_of(const boost::posix_time::ptime& date);
+
 			std::string generate_session_id() const;
 
 			mutable std::string m_last_session_id;
-			std::map<std::string, boost::shared_ptr<generic_session>> m_sessions;
+			shard_type m_shards[SHARD_COUNT];
+			mutable boost::mutex m_wheel_mutex;
+			std::vector<wheel_entry_type> m_wheel[WHEEL_SLOT_COUNT];
+			int64_t m_last_tick;
 	};
 
 	/**
@@ -231,6 +331,15 @@ namespace mongooseplus
 	typedef boost::error_info<struct tag_headers, header_list_type> headers_error_info;
 	typedef boost::error_info<struct tag_error_content, std::string> error_content_error_info;
 
+	/**
+	 * \brief A streamed response body producer.
+	 *
+	 * The producer is called from the server poll loop, once per poll cycle, whenever the connection can take more data. It must append the next chunk of the body to chunk and return true if more data remains, or false once the body is complete. Data left in chunk on the final call is still sent.
+	 *
+	 * Chunks are written straight to the connection with chunked transfer-encoding: the response body is never accumulated in memory.
+	 */
+	typedef std::function<bool (std::string& chunk)> response_producer_type;
+
 	/**
 	 * \brief A base web server class.
 	 */
@@ -257,6 +366,25 @@ namespace mongooseplus
 			void set_option(const std::string& name, const std::string& value);
 			void set_certificate_and_private_key(cryptoplus::x509::certificate cert, cryptoplus::pkey::pkey private_key);
 
+			/**
+			 * \brief Configure the TLS session cache.
+			 * \param max_sessions The maximum count of cached sessions.
+			 * \param timeout The lifetime of a cached session, in seconds.
+			 *
+			 * Clients that reconnect within the timeout resume their previous session with an abbreviated handshake instead of a full key exchange.
+			 *
+			 * \warning Must be called after set_certificate_and_private_key().
+			 */
+			void set_tls_session_cache(size_t max_sessions, long timeout);
+
+			/**
+			 * \brief Close connections that stay idle for too long.
+			 * \param timeout The idle duration after which a connection is closed, in seconds. Zero disables the limit.
+			 *
+			 * Bounds the file descriptors held by HTTP keep-alive clients that stopped polling.
+			 */
+			void set_connection_idle_timeout(int timeout);
+
 			enum class request_result
 			{
 				handled,
@@ -299,6 +427,9 @@ namespace mongooseplus
 		private:
 			session_handler_type m_session_handler;
 
+			// Response streams in flight, keyed by connection. Only ever touched from the poll loop thread, which dispatches every event: no locking needed.
+			std::map<mg_connection*, response_producer_type> m_response_streams;
+
 			friend class base_authentication_handler;
 			friend class request;
 	};
@@ -336,6 +467,19 @@ namespace mongooseplus
 			boost::optional<header_type> get_header(const std::string& name) const;
 			header_type get_header(const std::string& name, const std::string& default_value) const;
 			header_type get_header(const std::string& name, const std::vector<std::string>& default_values) const;
+
+			/**
+			 * \brief Get a header without copying anything.
+			 * \param name The header name. Case-insensitive.
+			 * \return A view into the connection buffer, or boost::none if the header is absent. The view is only valid while the request is being handled.
+			 */
+			boost::optional<header_view> get_header_view(const char* name) const;
+
+			/**
+			 * \brief Get views of all the headers, without copying any of them.
+			 * \return The views, in request order. The views are only valid while the request is being handled.
+			 */
+			std::vector<header_view> get_header_views() const;
 			std::string request_method() const;
 			std::string http_version() const;
 			std::string query_string() const;
@@ -352,6 +496,20 @@ namespace mongooseplus
 			std::string remote() const;
 			void set_user_param(void* user_param);
 			void* get_user_param() const;
+
+			/**
+			 * \brief Get the path parameters captured during route dispatch.
+			 * \return The parameters, keyed by the name they were declared with in the route pattern.
+			 */
+			const std::map<std::string, std::string>& path_parameters() const
+			{
+				return m_path_parameters;
+			}
+
+			void set_path_parameters(std::map<std::string, std::string>&& parameters)
+			{
+				m_path_parameters = std::move(parameters);
+			}
 			void send_status_code(int status_code);
 			void send_header(const header_type& header);
 			void send_header(header_type&& header);
@@ -374,14 +532,34 @@ namespace mongooseplus
 				send_data(&data[0], data.size());
 			}
 			void send_json(const kfather::value_type& json);
+
+			/**
+			 * \brief Stream the response body from the specified producer.
+			 * \param producer The producer. See response_producer_type for the calling contract.
+			 *
+			 * The producer is pumped from the server poll loop after the handler returns: send the status code and headers first, then register the producer and return from the handler normally. The connection is kept open until the producer reports completion, then closed once the terminating chunk has been flushed.
+			 */
+			void send_stream(response_producer_type producer);
+
+			/**
+			 * \brief Stream the contents of the specified file as the response body.
+			 * \param path The path of the file to stream.
+			 *
+			 * The file is read and sent in fixed-size chunks through the same path as send_stream(): the whole file is never loaded in memory.
+			 */
+			void send_file(const std::string& path);
 			void write(const void* buf, size_t buf_len);
 			void set_from_error(const http_error& ex);
 
 		private:
 			request(web_server&, mg_connection* connection);
+			bool has_response_stream() const;
+			web_server::request_result poll_response_stream();
+			void discard_response_stream();
 			mg_connection* m_connection;
 			web_server& m_web_server;
 			boost::shared_ptr<generic_session> m_session;
+			std::map<std::string, std::string> m_path_parameters;
 
 			friend struct web_server::underlying_server_type;
 	};
@@ -402,7 +580,8 @@ namespace mongooseplus
 
 			void authenticate(request& req) const
 			{
-				const auto authorization_header = req.get_header("authorization");
+				// The authorization header is checked on every request of an authenticated burst: a view avoids copying it just to look at it.
+				const auto authorization_header = req.get_header_view("authorization");
 
 				if (authorization_header)
 				{
@@ -431,7 +610,7 @@ namespace mongooseplus
 			{
 			}
 
-			virtual bool authenticate_from_header(request& req, const header_type& header) const = 0;
+			virtual bool authenticate_from_header(request& req, const header_view& header) const = 0;
 			virtual bool authenticate_from_session(request& req, boost::shared_ptr<generic_session> session) const = 0;
 			virtual void raise_authentication_error() const = 0;
 
@@ -485,7 +664,7 @@ namespace mongooseplus
 
 		protected:
 
-			bool authenticate_from_header(request& req, const header_type& header) const override;
+			bool authenticate_from_header(request& req, const header_view& header) const override;
 			bool authenticate_from_session(request& req, boost::shared_ptr<generic_session> session) const override;
 			virtual bool authenticate_from_username_and_password(request& req, const std::string& username, const std::string& password) const = 0;
 			void raise_authentication_error() const override;
@@ -504,6 +683,7 @@ namespace mongooseplus
 				typedef std::function<request_result (request&)> function_type;
 
 				std::regex url_regex;
+				std::string url_pattern;
 				std::set<std::string> request_methods;
 				std::set<std::string> content_types;
 				boost::shared_ptr<base_authentication_handler> authentication_handler;
@@ -511,17 +691,20 @@ namespace mongooseplus
 
 				route_type(const std::string& _url_regex, function_type _function) :
 					url_regex(_url_regex),
+					url_pattern(_url_regex),
 					function(_function)
 				{}
 
 				route_type(const std::string& _url_regex, const std::set<std::string>& _request_methods, function_type _function) :
 					url_regex(_url_regex),
+					url_pattern(_url_regex),
 					request_methods(_request_methods),
 					function(_function)
 				{}
 
 				route_type(const std::string& _url_regex, const std::set<std::string>& _request_methods, const std::set<std::string>& _content_types, function_type _function) :
 					url_regex(_url_regex),
+					url_pattern(_url_regex),
 					request_methods(_request_methods),
 					content_types(_content_types),
 					function(_function)
@@ -563,9 +746,35 @@ namespace mongooseplus
 			request_result handle_request(request& req) override;
 
 		private:
-			const route_type* get_route(const request&);
+
+			/**
+			 * A node of the dispatch trie. Routes whose pattern is a plain path
+			 * - possibly with ":name" parameter segments, captured into
+			 * request::path_parameters() - are compiled into the trie and
+			 * matched in one pass over the request path; anything that needs
+			 * real regular expression machinery stays on the scan list.
+			 */
+			struct trie_node_type
+			{
+				static const size_t no_child = static_cast<size_t>(-1);
+
+				trie_node_type() :
+					parameter_child(no_child)
+				{}
+
+				std::map<std::string, size_t> literal_children;
+				size_t parameter_child;
+				std::string parameter_name;
+				std::vector<size_t> routes;
+			};
+
+			const route_type* get_route(request&);
+			bool compile_route(size_t route_index);
+			const trie_node_type* match_trie(const std::string& uri, std::map<std::string, std::string>& parameters) const;
 
 			std::vector<route_type> m_routes;
+			std::vector<trie_node_type> m_trie;
+			std::vector<size_t> m_regex_routes;
 	};
 
 	template <typename RequestInfoType>
@@ -1161,6 +1161,7 @@ struct mg_server {
   mg_handler_t event_handler;
   char *config_options[NUM_OPTIONS];
   char local_ip[48];
+  int idle_timeout;           // Added for freelan: close connections idle for that many seconds, 0 disables
 };
 
 // Local endpoint representation
@@ -4471,6 +4472,17 @@ static void transfer_file_data(struct connection *conn) {
 }
 
 int mg_poll_server(struct mg_server *server, int milliseconds) {
+  // Added for freelan: reap keep-alive connections that stayed quiet too long.
+  if (server->idle_timeout > 0) {
+    time_t current_time = time(NULL);
+    struct ns_connection *conn, *next;
+    for (conn = server->ns_server.active_connections; conn != NULL; conn = next) {
+      next = conn->next;
+      if (current_time - conn->last_io_time > server->idle_timeout) {
+        conn->flags |= NSF_CLOSE_IMMEDIATELY;
+      }
+    }
+  }
   return ns_server_poll(&server->ns_server, milliseconds);
 }
 
@@ -4841,6 +4853,40 @@ int mg_set_certificate_and_private_key(struct mg_server* server, X509* cert, EVP
 #endif
 }
 
+// Added for freelan
+int mg_set_ssl_session_cache(struct mg_server* server, int max_sessions, long timeout_seconds) {
+#ifdef NS_ENABLE_SSL
+    static const unsigned char session_id_context[] = "mongooseplus";
+
+    SSL_CTX* ctx = server->ns_server.ssl_ctx;
+
+    if (ctx == NULL)
+    {
+      return 2;
+    }
+
+    // Session identifiers get cached server-side; session tickets are already on
+    // by default for this context and follow the same timeout.
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, max_sessions);
+    SSL_CTX_set_timeout(ctx, timeout_seconds);
+    SSL_CTX_set_session_id_context(ctx, session_id_context, sizeof(session_id_context) - 1);
+
+    return 0;
+#else
+    (void)(server);
+    (void)(max_sessions);
+    (void)(timeout_seconds);
+
+    return 1;
+#endif
+}
+
+// Added for freelan
+void mg_set_idle_timeout(struct mg_server* server, int seconds) {
+  server->idle_timeout = seconds;
+}
+
 const char *mg_get_option(const struct mg_server *server, const char *name) {
   const char **opts = (const char **) server->config_options;
   int i = get_option_index(name);
@@ -56,9 +56,10 @@
 #include <cryptoplus/random/random.hpp>
 
 #include <kfather/parser.hpp>
-#include <kfather/formatter.hpp>
+#include <kfather/serializer.hpp>
 
 #include <cassert>
+#include <fstream>
 
 namespace mongooseplus
 {
@@ -69,6 +70,9 @@ namespace mongooseplus
 			mg_destroy_server(&server);
 		}
 
+		// How much of a file to read and queue per poll cycle when streaming a file response.
+		const size_t FILE_RESPONSE_CHUNK_SIZE = 65536;
+
 		std::string ip_port_to_string(const boost::asio::ip::address& address, uint16_t port)
 		{
 			std::ostringstream oss;
@@ -104,6 +108,49 @@ namespace mongooseplus
 
 			return result;
 		}
+
+		std::vector<std::string> split_path(const std::string& path)
+		{
+			std::vector<std::string> result;
+
+			std::string::size_type start = 0;
+
+			for (std::string::size_type i = 0; i <= path.size(); ++i)
+			{
+				if ((i == path.size()) || (path[i] == '/'))
+				{
+					result.push_back(path.substr(start, i - start));
+
+					start = i + 1;
+				}
+			}
+
+			return result;
+		}
+
+		bool is_parameter_segment(const std::string& segment)
+		{
+			if ((segment.size() < 2) || (segment[0] != ':'))
+			{
+				return false;
+			}
+
+			for (std::string::size_type i = 1; i < segment.size(); ++i)
+			{
+				if (!std::isalnum(static_cast<unsigned char>(segment[i])) && (segment[i] != '_'))
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		bool is_literal_segment(const std::string& segment)
+		{
+			// Any regular expression metacharacter disqualifies the pattern from the trie.
+			return (segment.find_first_of(".^$|()[]{}*+?\\") == std::string::npos);
+		}
 	}
 
 	boost::optional<std::string> header_type::value(const std::string& _key) const
@@ -159,23 +206,162 @@ namespace mongooseplus
 		return items;
 	}
 
+	session_handler_type::session_handler_type() :
+		m_last_tick(tick_of(boost::posix_time::second_clock::universal_time()))
+	{
+		generate_session_id();
+	}
+
+	size_t session_handler_type::shard_index_for(const std::string& session_id)
+	{
+		// Session identifiers are base64 of a SHA-256 chain, so any few bytes of them are uniformly distributed already.
+		size_t hash = 0;
+
+		for (size_t i = 0; (i < 8) && (i < session_id.size()); ++i)
+		{
+			hash = (hash * 31) + static_cast<uint8_t>(session_id[i]);
+		}
+
+		return hash % SHARD_COUNT;
+	}
+
+	int64_t session_handler_type::tick_of(const boost::posix_time::ptime& date)
+	{
+		static const boost::posix_time::ptime epoch = boost::posix_time::from_time_t(0);
+
+		return (date - epoch).total_seconds();
+	}
+
+	void session_handler_type::store_session(const boost::shared_ptr<generic_session>& session)
+	{
+		shard_type& shard = m_shards[shard_index_for(session->session_id())];
+
+		{
+			boost::mutex::scoped_lock lock(shard.mutex);
+
+			shard.sessions[session->session_id()] = session;
+		}
+
+		schedule(session);
+	}
+
+	boost::shared_ptr<generic_session> session_handler_type::find_session(const std::string& session_id) const
+	{
+		const shard_type& shard = m_shards[shard_index_for(session_id)];
+
+		boost::mutex::scoped_lock lock(shard.mutex);
+
+		const auto session_it = shard.sessions.find(session_id);
+
+		if (session_it != shard.sessions.end())
+		{
+			// The wheel may not have fired yet: never hand out an expired session.
+			if (!session_it->second->has_expired())
+			{
+				return session_it->second;
+			}
+		}
+
+		return boost::shared_ptr<generic_session>();
+	}
+
+	void session_handler_type::drop_session(const std::string& session_id)
+	{
+		shard_type& shard = m_shards[shard_index_for(session_id)];
+
+		boost::mutex::scoped_lock lock(shard.mutex);
+
+		shard.sessions.erase(session_id);
+	}
+
+	void session_handler_type::schedule(const boost::shared_ptr<generic_session>& session)
+	{
+		wheel_entry_type entry = { session->session_id(), session };
+
+		const size_t slot = static_cast<size_t>(tick_of(session->expiration_date()) % WHEEL_SLOT_COUNT);
+
+		boost::mutex::scoped_lock lock(m_wheel_mutex);
+
+		m_wheel[slot].push_back(entry);
+	}
+
 	void session_handler_type::clear_expired()
 	{
 		const boost::posix_time::ptime now = boost::posix_time::second_clock::universal_time();
+		const int64_t now_tick = tick_of(now);
+
+		std::vector<wheel_entry_type> due;
+
+		{
+			boost::mutex::scoped_lock lock(m_wheel_mutex);
+
+			if (now_tick <= m_last_tick)
+			{
+				return;
+			}
+
+			// Only the slots elapsed since the last call are visited; a full wheel turn covers them all.
+			const int64_t count = std::min<int64_t>(now_tick - m_last_tick, WHEEL_SLOT_COUNT);
 
-		for (auto&& session_it = m_sessions.begin(); session_it != m_sessions.end();)
+			for (int64_t i = 1; i <= count; ++i)
+			{
+				std::vector<wheel_entry_type>& slot = m_wheel[static_cast<size_t>((m_last_tick + i) % WHEEL_SLOT_COUNT)];
+
+				due.insert(due.end(), slot.begin(), slot.end());
+				slot.clear();
+			}
+
+			m_last_tick = now_tick;
+		}
+
+		for (auto&& entry : due)
 		{
-			if (session_it->second->has_expired(now))
+			const boost::shared_ptr<generic_session> session = entry.session.lock();
+
+			if (!session)
 			{
-				session_it = m_sessions.erase(session_it);
+				continue;
+			}
+
+			if (session->has_expired(now))
+			{
+				drop_session(entry.session_id);
 			}
 			else
 			{
-				++session_it;
+				// The session was renewed, or expires more than a wheel turn away: file it again under its current expiry.
+				schedule(session);
 			}
 		}
 	}
 
+	session_handler_type::metrics_type session_handler_type::get_metrics() const
+	{
+		metrics_type result;
+
+		result.session_count = 0;
+		result.shard_occupancy.reserve(SHARD_COUNT);
+
+		for (size_t i = 0; i < SHARD_COUNT; ++i)
+		{
+			boost::mutex::scoped_lock lock(m_shards[i].mutex);
+
+			result.shard_occupancy.push_back(m_shards[i].sessions.size());
+			result.session_count += m_shards[i].sessions.size();
+		}
+
+		result.wheel_entry_count = 0;
+
+		boost::mutex::scoped_lock lock(m_wheel_mutex);
+
+		for (size_t i = 0; i < WHEEL_SLOT_COUNT; ++i)
+		{
+			result.wheel_entry_count += m_wheel[i].size();
+		}
+
+		return result;
+	}
+
 	std::string session_handler_type::generate_session_id() const
 	{
 		const auto random_bytes = cryptoplus::random::get_random_bytes(32).to_string();
@@ -189,6 +375,9 @@ namespace mongooseplus
 	void web_server::stop()
 	{
 		m_is_running = false;
+
+		// Break the poll loop right away instead of letting it sleep out its timeout.
+		mg_wakeup_server(m_server->server.get());
 	}
 
 	struct web_server::underlying_server_type
@@ -225,13 +414,32 @@ namespace mongooseplus
 				case MG_AUTH:
 					return ws.handle_auth(req);
 				case MG_REQUEST:
+				{
 					ws.prepare_request(req);
-					return ws.handle_request(req);
+
+					const auto result = ws.handle_request(req);
+
+					// A handler that registered a response stream needs the connection kept open so the poll loop can pump it, whatever the handler returned.
+					if ((result == web_server::request_result::handled) && req.has_response_stream())
+					{
+						return web_server::request_result::expect_more;
+					}
+
+					return result;
+				}
 				case MG_POLL:
+				{
+					if (req.has_response_stream())
+					{
+						return req.poll_response_stream();
+					}
+
 					return ws.handle_poll(req);
+				}
 				case MG_HTTP_ERROR:
 					return ws.handle_http_error(req);
 				case MG_CLOSE:
+					req.discard_response_stream();
 					return ws.handle_close(req);
 				default:
 					return web_server::request_result::ignored;
@@ -248,20 +456,21 @@ namespace mongooseplus
 
 	boost::shared_ptr<generic_session> session_handler_type::read_session(const request& req) const
 	{
-		const auto header = req.get_header("cookie");
+		const auto header = req.get_header_view("cookie");
 
 		if (header)
 		{
-			const auto session_id = header->value("session_id");
+			// The view's value points to the null-terminated header mongoose keeps in the connection buffer, which is exactly what mg_parse_header() expects: only the session identifier itself gets materialized.
+			std::string session_id;
+			session_id.resize(256);
 
-			if (session_id)
+			const int len = mg_parse_header(header->value().data(), "session_id", &session_id[0], session_id.size());
+
+			if (len > 0)
 			{
-				const auto session_it = m_sessions.find(*session_id);
+				session_id.resize(len);
 
-				if (session_it != m_sessions.end())
-				{
-					return session_it->second;
-				}
+				return find_session(session_id);
 			}
 		}
 
@@ -275,11 +484,17 @@ namespace mongooseplus
 
 	void web_server::run(int poll_period)
 	{
+		// How long to sleep when no connection is active. Accepts and stop() wakeups interrupt the sleep, so this only bounds how stale a fully idle server can get.
+		static const int IDLE_POLL_PERIOD = 3600000;
+
 		m_is_running = true;
 
+		// mg_poll_server() blocks in select() for up to the given timeout and returns the count of active connections. Connections need periodic polls (keep-alive expiry, MG_POLL callbacks), but an idle server does not: sleep long when idle, at poll_period otherwise.
+		int active_connections = 0;
+
 		while (m_is_running)
 		{
-			mg_poll_server(m_server->server.get(), poll_period);
+			active_connections = mg_poll_server(m_server->server.get(), (active_connections > 0) ? poll_period : IDLE_POLL_PERIOD);
 		}
 	}
 
@@ -317,6 +532,28 @@ namespace mongooseplus
 		}
 	}
 
+	void web_server::set_tls_session_cache(size_t max_sessions, long timeout)
+	{
+		const int result = ::mg_set_ssl_session_cache(m_server->server.get(), static_cast<int>(max_sessions), timeout);
+
+		switch (result)
+		{
+			case 0:
+				return;
+			case 1:
+				throw std::runtime_error("SSL not enabled");
+			case 2:
+				throw std::runtime_error("No SSL context: set a certificate and a private key first");
+			default:
+				throw std::runtime_error("Unknown error");
+		}
+	}
+
+	void web_server::set_connection_idle_timeout(int timeout)
+	{
+		::mg_set_idle_timeout(m_server->server.get(), timeout);
+	}
+
 	void web_server::prepare_request(request& req)
 	{
 		session_handler().clear_expired();
@@ -385,6 +622,34 @@ namespace mongooseplus
 		return header_type(key, value);
 	}
 
+	boost::optional<header_view> request::get_header_view(const char* name) const
+	{
+		// mongoose null-terminates the header values in place in the connection buffer: the view borrows them as-is.
+		const char* const value = mg_get_header(m_connection, name);
+
+		if (value)
+		{
+			return header_view(boost::string_ref(name), boost::string_ref(value));
+		}
+
+		return boost::none;
+	}
+
+	std::vector<header_view> request::get_header_views() const
+	{
+		std::vector<header_view> result;
+		result.reserve(m_connection->num_headers);
+
+		for (int index = 0; index < m_connection->num_headers; ++index)
+		{
+			const auto raw_header = m_connection->http_headers[index];
+
+			result.push_back(header_view(boost::string_ref(raw_header.name), boost::string_ref(raw_header.value)));
+		}
+
+		return result;
+	}
+
 	header_type request::get_header(const std::string& key, const std::vector<std::string>& default_values) const
 	{
 		const char* const value = mg_get_header(m_connection, key.c_str());
@@ -548,7 +813,31 @@ namespace mongooseplus
 	void request::send_json(const kfather::value_type& _json)
 	{
 		send_header("content-type", "application/json");
-		send_data(kfather::compact_formatter().format(_json));
+		send_data(kfather::serializer().serialize(_json));
+	}
+
+	void request::send_stream(response_producer_type producer)
+	{
+		m_web_server.m_response_streams[m_connection] = producer;
+	}
+
+	void request::send_file(const std::string& path)
+	{
+		const auto file = boost::make_shared<std::ifstream>(path.c_str(), std::ios::in | std::ios::binary);
+
+		if (!file->is_open())
+		{
+			throw std::runtime_error("Unable to open file for streaming: " + path);
+		}
+
+		send_stream([file](std::string& chunk)
+		{
+			chunk.resize(FILE_RESPONSE_CHUNK_SIZE);
+			file->read(&chunk[0], chunk.size());
+			chunk.resize(static_cast<size_t>(file->gcount()));
+
+			return !file->eof();
+		});
 	}
 
 	void request::write(const void* buf, size_t buf_len)
@@ -556,6 +845,59 @@ namespace mongooseplus
 		mg_write(m_connection, buf, static_cast<int>(buf_len));
 	}
 
+	bool request::has_response_stream() const
+	{
+		return (m_web_server.m_response_streams.find(m_connection) != m_web_server.m_response_streams.end());
+	}
+
+	web_server::request_result request::poll_response_stream()
+	{
+		const auto stream = m_web_server.m_response_streams.find(m_connection);
+
+		if (stream == m_web_server.m_response_streams.end())
+		{
+			return web_server::request_result::ignored;
+		}
+
+		std::string chunk;
+		bool more = false;
+
+		try
+		{
+			more = stream->second(chunk);
+		}
+		catch (const std::exception&)
+		{
+			// Closing the connection before the terminating chunk is sent is the only way chunked encoding can signal a mid-stream failure to the client.
+			m_web_server.m_response_streams.erase(stream);
+
+			return web_server::request_result::handled;
+		}
+
+		if (!chunk.empty())
+		{
+			// The chunk goes straight to the connection output: send_data() writes it through with chunked transfer-encoding.
+			send_data(chunk);
+		}
+
+		if (more)
+		{
+			return web_server::request_result::expect_more;
+		}
+
+		m_web_server.m_response_streams.erase(stream);
+
+		// A zero-length chunk is the chunked-encoding terminator.
+		send_data("", 0);
+
+		return web_server::request_result::handled;
+	}
+
+	void request::discard_response_stream()
+	{
+		m_web_server.m_response_streams.erase(m_connection);
+	}
+
 	void request::set_from_error(const http_error& ex)
 	{
 		send_status_code(static_cast<int>(ex.code().value()));
@@ -575,27 +917,38 @@ namespace mongooseplus
 		}
 	}
 
-	bool basic_authentication_handler::authenticate_from_header(request& req, const header_type& header) const
+	bool basic_authentication_handler::authenticate_from_header(request& req, const header_view& header) const
 	{
-		std::vector<std::string> items;
-		boost::split(items, header.value(), boost::is_any_of(" "));
+		// The scheme and the token are sliced out of the view: the only copy made is the token handed to the base64 decoder.
+		boost::string_ref value = header.value();
 
-		if (items.size() != 2)
+		const size_t separator = value.find(' ');
+
+		if (separator == boost::string_ref::npos)
 		{
 			return false;
 		}
 
-		for (auto&& item : items)
+		const boost::string_ref scheme_part = value.substr(0, separator);
+
+		boost::string_ref token_part = value.substr(separator + 1);
+
+		while (!token_part.empty() && (token_part.front() == ' '))
 		{
-			boost::trim(item);
+			token_part.remove_prefix(1);
+		}
+
+		while (!token_part.empty() && (token_part.back() == ' '))
+		{
+			token_part.remove_suffix(1);
 		}
 
-		if (items[0] != scheme())
+		if ((scheme_part != boost::string_ref(scheme())) || token_part.empty() || (token_part.find(' ') != boost::string_ref::npos))
 		{
 			return false;
 		}
 
-		const std::string decoded_value = cryptoplus::base64_decode(items[1]).to_string();
+		const std::string decoded_value = cryptoplus::base64_decode(token_part.to_string()).to_string();
 		const size_t separator_index = decoded_value.find_first_of(':');
 		const std::string username = decoded_value.substr(0, separator_index);
 		const std::string password = (separator_index != std::string::npos) ? decoded_value.substr(separator_index + 1) : "";
@@ -650,9 +1003,101 @@ namespace mongooseplus
 	{
 		m_routes.push_back(std::move(route));
 
+		if (!compile_route(m_routes.size() - 1))
+		{
+			m_regex_routes.push_back(m_routes.size() - 1);
+		}
+
 		return m_routes.back();
 	}
 
+	bool routed_web_server::compile_route(size_t route_index)
+	{
+		const std::vector<std::string> segments = split_path(m_routes[route_index].url_pattern);
+
+		// Validate the whole pattern before touching the trie, so a fallback route leaves no stray nodes.
+		for (auto&& segment : segments)
+		{
+			if (!is_parameter_segment(segment) && !is_literal_segment(segment))
+			{
+				return false;
+			}
+		}
+
+		if (m_trie.empty())
+		{
+			m_trie.push_back(trie_node_type());
+		}
+
+		size_t node = 0;
+
+		for (auto&& segment : segments)
+		{
+			if (is_parameter_segment(segment))
+			{
+				if (m_trie[node].parameter_child == trie_node_type::no_child)
+				{
+					m_trie.push_back(trie_node_type());
+					m_trie[node].parameter_child = m_trie.size() - 1;
+					m_trie[node].parameter_name = segment.substr(1);
+				}
+
+				node = m_trie[node].parameter_child;
+			}
+			else
+			{
+				const auto child = m_trie[node].literal_children.find(segment);
+
+				if (child == m_trie[node].literal_children.end())
+				{
+					m_trie.push_back(trie_node_type());
+					m_trie[node].literal_children[segment] = m_trie.size() - 1;
+					node = m_trie.size() - 1;
+				}
+				else
+				{
+					node = child->second;
+				}
+			}
+		}
+
+		m_trie[node].routes.push_back(route_index);
+
+		return true;
+	}
+
+	const routed_web_server::trie_node_type* routed_web_server::match_trie(const std::string& uri, std::map<std::string, std::string>& parameters) const
+	{
+		if (m_trie.empty())
+		{
+			return nullptr;
+		}
+
+		size_t node = 0;
+
+		for (auto&& segment : split_path(uri))
+		{
+			const auto child = m_trie[node].literal_children.find(segment);
+
+			if (child != m_trie[node].literal_children.end())
+			{
+				node = child->second;
+			}
+			else if (m_trie[node].parameter_child != trie_node_type::no_child)
+			{
+				parameters[m_trie[node].parameter_name] = segment;
+
+				node = m_trie[node].parameter_child;
+			}
+			else
+			{
+				return nullptr;
+			}
+		}
+
+		return m_trie[node].routes.empty() ? nullptr : &m_trie[node];
+	}
+
 	routed_web_server::request_result routed_web_server::handle_request(request& req)
 	{
 		try
@@ -689,10 +1134,30 @@ namespace mongooseplus
 		return web_server::handle_request(req);
 	}
 
-	const routed_web_server::route_type* routed_web_server::get_route(const request& req)
+	const routed_web_server::route_type* routed_web_server::get_route(request& req)
 	{
-		const auto routes = to_pointer_list(m_routes);
-		const auto matched_routes = filter(routes, [&req](const route_type* route){ return route->url_matches(req); });
+		// One pass over the path handles every trie-compiled route, whatever their count; only the regex routes are still scanned.
+		std::map<std::string, std::string> parameters;
+
+		const trie_node_type* const node = match_trie(req.uri(), parameters);
+
+		std::vector<const route_type*> matched_routes;
+
+		if (node)
+		{
+			for (auto&& route_index : node->routes)
+			{
+				matched_routes.push_back(&m_routes[route_index]);
+			}
+		}
+
+		for (auto&& route_index : m_regex_routes)
+		{
+			if (m_routes[route_index].url_matches(req))
+			{
+				matched_routes.push_back(&m_routes[route_index]);
+			}
+		}
 
 		if (!matched_routes.empty())
 		{
@@ -712,7 +1177,14 @@ namespace mongooseplus
 				throw http_error(mongooseplus_error::http_406_not_acceptable);
 			}
 
-			return content_matched_routes.front();
+			const route_type* const chosen = content_matched_routes.front();
+
+			if (node && std::any_of(node->routes.begin(), node->routes.end(), [this, chosen](size_t route_index){ return &m_routes[route_index] == chosen; }))
+			{
+				req.set_path_parameters(std::move(parameters));
+			}
+
+			return chosen;
 		}
 
 		return nullptr;
@@ -47,7 +47,11 @@
 #include <boost/asio.hpp>
 #include <boost/optional.hpp>
 
+#include <array>
+#include <functional>
+#include <queue>
 #include <string>
+#include <vector>
 
 #include "protocol.hpp"
 
@@ -131,11 +135,13 @@ namespace netlinkplus
 	 */
 	struct address_entry
 	{
-		address_entry()
+		address_entry() :
+			prefix_length{}
 		{
 		}
 
 		boost::asio::ip::address address;
+		unsigned int prefix_length;
 		interface_entry interface;
 		boost::optional<boost::asio::ip::address> local;
 		boost::optional<boost::asio::ip::address> broadcast;
@@ -143,6 +149,39 @@ namespace netlinkplus
 		boost::optional<std::string> label;
 	};
 
+	/**
+	 * \brief A network link entry.
+	 */
+	struct link_entry
+	{
+		link_entry() :
+			flags{},
+			mtu{}
+		{
+		}
+
+		interface_entry interface;
+		std::string name;
+		unsigned int flags;
+		unsigned int mtu;
+	};
+
+	/**
+	 * \brief A route specification, for batched route operations.
+	 */
+	struct route_specification
+	{
+		route_specification() :
+			destination_length{}
+		{
+		}
+
+		interface_entry interface;
+		boost::asio::ip::address destination;
+		unsigned int destination_length;
+		boost::optional<boost::asio::ip::address> gateway;
+	};
+
 	/**
 	 * \brief Manage routes.
 	 */
@@ -150,6 +189,16 @@ namespace netlinkplus
 	{
 		public:
 
+			/**
+			 * \brief A completion handler for asynchronous operations.
+			 */
+			typedef std::function<void (const boost::system::error_code&)> completion_handler_type;
+
+			/**
+			 * \brief A completion handler for asynchronous route queries.
+			 */
+			typedef std::function<void (const boost::system::error_code&, const route_entry&)> route_handler_type;
+
 			/**
 			 * \brief Create a route manager.
 			 */
@@ -180,6 +229,71 @@ namespace netlinkplus
 			 */
 			void remove_route(const interface_entry& interface, const boost::asio::ip::address& destination, unsigned int destination_length, boost::optional<boost::asio::ip::address> gateway = boost::optional<boost::asio::ip::address>());
 
+			/**
+			 * \brief Get the route entry for the specified host, asynchronously.
+			 * \param host The host to get the route for.
+			 * \param handler The handler called on the io_service once the kernel answered.
+			 *
+			 * Asynchronous operations never block the calling thread on the kernel: the exchange runs on the io_service the manager was created with. They are serialized internally so their responses cannot interleave, but must not be mixed with the synchronous calls while in flight.
+			 */
+			void async_get_route_for(const boost::asio::ip::address& host, route_handler_type handler);
+
+			/**
+			 * \brief Add a route entry, asynchronously.
+			 * \param interface The interface.
+			 * \param destination The destination.
+			 * \param destination_length The destination length.
+			 * \param gateway The gateway.
+			 * \param handler The handler called on the io_service once the kernel acknowledged the route.
+			 */
+			void async_add_route(const interface_entry& interface, const boost::asio::ip::address& destination, unsigned int destination_length, boost::optional<boost::asio::ip::address> gateway, completion_handler_type handler);
+
+			/**
+			 * \brief Remove a route entry, asynchronously.
+			 * \param interface The interface.
+			 * \param destination The destination.
+			 * \param destination_length The destination length.
+			 * \param gateway The gateway.
+			 * \param handler The handler called on the io_service once the kernel acknowledged the removal.
+			 */
+			void async_remove_route(const interface_entry& interface, const boost::asio::ip::address& destination, unsigned int destination_length, boost::optional<boost::asio::ip::address> gateway, completion_handler_type handler);
+
+			/**
+			 * \brief Add several route entries in one batched transaction.
+			 * \param routes The routes to add.
+			 *
+			 * All the requests are sent at once and the acknowledgments are read back afterwards, so adding a large route table costs a few system calls instead of one round-trip per route. The transaction is all-or-nothing: if any route is refused, the routes that were applied are removed again and the error of the refused route is thrown.
+			 */
+			void add_routes(const std::vector<route_specification>& routes);
+
+			/**
+			 * \brief Remove several route entries in one batched transaction.
+			 * \param routes The routes to remove.
+			 *
+			 * All the requests are sent at once and the acknowledgments are read back afterwards, like add_routes(). Removals are not rolled back: the error of the first refused route is thrown once the acknowledgments of its batch were read.
+			 */
+			void remove_routes(const std::vector<route_specification>& routes);
+
+			/**
+			 * \brief Fetch the whole route table in a single dump exchange.
+			 * \param entries The vector to fill. It is cleared but keeps its capacity, so a preallocated vector is reused without reallocation.
+			 *
+			 * The kernel streams the table back as one multipart response: the cost is a single request followed by a burst of reads, instead of one round-trip per route.
+			 */
+			void get_routes(std::vector<route_entry>& entries);
+
+			/**
+			 * \brief Fetch all the interface addresses in a single dump exchange.
+			 * \param entries The vector to fill. It is cleared but keeps its capacity, so a preallocated vector is reused without reallocation.
+			 */
+			void get_addresses(std::vector<address_entry>& entries);
+
+			/**
+			 * \brief Fetch all the network links in a single dump exchange.
+			 * \param entries The vector to fill. It is cleared but keeps its capacity, so a preallocated vector is reused without reallocation.
+			 */
+			void get_links(std::vector<link_entry>& entries);
+
 			/**
 			 * \brief Add an interface address.
 			 * \param interface The interface to set the address on.
@@ -216,9 +330,122 @@ namespace netlinkplus
 
 		private:
 
+			void receive_dump(const std::function<void (const ::nlmsghdr&)>& handler);
+			void process_route_batch(uint16_t message_type, uint16_t message_flags, const std::vector<route_specification>& routes, std::vector<bool>& acked, boost::optional<boost::system::system_error>& failure);
 			void generic_route(uint16_t type, const interface_entry& interface, const boost::asio::ip::address& destination, unsigned int destination_length, boost::optional<boost::asio::ip::address> gateway);
 			void generic_interface_address(uint16_t type, const interface_entry& interface, const boost::asio::ip::address& address, size_t prefix_length, const boost::asio::ip::address& remote_address);
+			void async_generic_route(uint16_t type, const interface_entry& interface, const boost::asio::ip::address& destination, unsigned int destination_length, boost::optional<boost::asio::ip::address> gateway, completion_handler_type handler);
+			void post_operation(std::function<void ()> operation);
+			void complete_operation();
+
+			netlink_route_protocol::socket m_socket;
+			boost::asio::strand m_strand;
+			std::queue<std::function<void ()>> m_operation_queue;
+	};
+
+	/**
+	 * \brief The kind of change a monitor event reports.
+	 */
+	enum class change_type
+	{
+		added,
+		removed
+	};
+
+	/**
+	 * \brief Monitor system route, address and link changes.
+	 *
+	 * The monitor subscribes to the rtnetlink multicast groups and delivers every change the kernel announces as a parsed event on the io_service, so a consumer can maintain its view of the system state incrementally instead of re-reading it with periodic full dumps.
+	 */
+	class monitor
+	{
+		public:
+
+			/**
+			 * \brief A handler for route change events.
+			 */
+			typedef std::function<void (change_type, const route_entry&)> route_handler_type;
+
+			/**
+			 * \brief A handler for address change events.
+			 */
+			typedef std::function<void (change_type, const address_entry&)> address_handler_type;
+
+			/**
+			 * \brief A handler for link change events.
+			 */
+			typedef std::function<void (change_type, const link_entry&)> link_handler_type;
+
+			/**
+			 * \brief A handler for monitoring errors.
+			 */
+			typedef std::function<void (const boost::system::error_code&)> error_handler_type;
+
+			/**
+			 * \brief Create a monitor subscribed to the route, address and link multicast groups.
+			 * \param io_service The io_service the events are delivered on.
+			 *
+			 * Events announced while the monitor exists but was not started yet are buffered by the kernel up to the socket receive buffer size.
+			 */
+			monitor(boost::asio::io_service& io_service);
+
+			/**
+			 * \brief Set the handler called for every route change.
+			 * \param handler The handler.
+			 */
+			void set_route_handler(route_handler_type handler)
+			{
+				m_route_handler = handler;
+			}
+
+			/**
+			 * \brief Set the handler called for every address change.
+			 * \param handler The handler.
+			 */
+			void set_address_handler(address_handler_type handler)
+			{
+				m_address_handler = handler;
+			}
+
+			/**
+			 * \brief Set the handler called for every link change.
+			 * \param handler The handler.
+			 */
+			void set_link_handler(link_handler_type handler)
+			{
+				m_link_handler = handler;
+			}
+
+			/**
+			 * \brief Set the handler called when monitoring fails.
+			 * \param handler The handler. Monitoring stops after a failure and can be resumed with start().
+			 */
+			void set_error_handler(error_handler_type handler)
+			{
+				m_error_handler = handler;
+			}
+
+			/**
+			 * \brief Start delivering events. Does nothing if the monitor is already running.
+			 */
+			void start();
+
+			/**
+			 * \brief Stop delivering events. Events keep accumulating in the socket buffer until start() is called again.
+			 */
+			void stop();
+
+		private:
+
+			void async_receive_next();
+			void process(const ::nlmsghdr& message);
 
 			netlink_route_protocol::socket m_socket;
+			bool m_is_running;
+			std::array<char, 32768> m_receive_buffer;
+			route_handler_type m_route_handler;
+			address_handler_type m_address_handler;
+			link_handler_type m_link_handler;
+			error_handler_type m_error_handler;
 	};
 }
@@ -0,0 +1,267 @@
+/*
+ * libnetlinkplus - A portable netlink extension for Boost::ASIO.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libnetlinkplus.
+ *
+ * libnetlinkplus is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libnetlinkplus is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libnetlinkplus in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file message_arena.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An arena for batched netlink message construction.
+ */
+
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/optional.hpp>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include <cstring>
+#include <vector>
+
+namespace netlinkplus
+{
+	/**
+	 * \brief An arena that lays out consecutive netlink route messages contiguously.
+	 *
+	 * The route add and delete messages emitted during batched operations
+	 * all have one of four fixed shapes: an IPv4 or IPv6 destination,
+	 * with or without a gateway. The attribute offsets of each shape are
+	 * computed once, so appending a message writes its variable fields
+	 * directly at their final offsets in the arena, instead of building
+	 * the message attribute by attribute in a scratch buffer and copying
+	 * it over.
+	 *
+	 * The laid out messages are contiguous and correctly aligned, so the
+	 * whole arena is submitted with a single socket write.
+	 */
+	class route_message_arena
+	{
+		public:
+
+			/**
+			 * \brief Get the size a route message will occupy in the arena, in bytes.
+			 * \param is_v6 Whether the destination is an IPv6 address.
+			 * \param has_gateway Whether the message carries a gateway.
+			 * \return The size, alignment padding included.
+			 */
+			static size_t route_message_size(bool is_v6, bool has_gateway)
+			{
+				return shape_for(is_v6, has_gateway).message_size;
+			}
+
+			/**
+			 * \brief Create a new arena.
+			 * \param initial_capacity The capacity to reserve, in bytes.
+			 */
+			explicit route_message_arena(size_t initial_capacity = 16384) :
+				m_data(),
+				m_message_count(0)
+			{
+				m_data.reserve(initial_capacity);
+			}
+
+			/**
+			 * \brief Discard the laid out messages, keeping the allocation.
+			 */
+			void clear()
+			{
+				m_data.clear();
+				m_message_count = 0;
+			}
+
+			/**
+			 * \brief Check whether the arena holds no message.
+			 * \return true when the arena is empty.
+			 */
+			bool empty() const
+			{
+				return m_data.empty();
+			}
+
+			/**
+			 * \brief Get the size of the laid out messages, in bytes.
+			 * \return The size.
+			 */
+			size_t size() const
+			{
+				return m_data.size();
+			}
+
+			/**
+			 * \brief Get the laid out messages.
+			 * \return The start of the contiguous messages.
+			 */
+			const void* data() const
+			{
+				return m_data.data();
+			}
+
+			/**
+			 * \brief Get the count of laid out messages.
+			 * \return The count.
+			 */
+			size_t message_count() const
+			{
+				return m_message_count;
+			}
+
+			/**
+			 * \brief Append a unicast route message to the arena.
+			 * \param message_type The message type, RTM_NEWROUTE or RTM_DELROUTE.
+			 * \param message_flags The message flags.
+			 * \param destination The route destination.
+			 * \param destination_length The destination prefix length.
+			 * \param interface The output interface index.
+			 * \param gateway The gateway, if any.
+			 * \param sequence The netlink sequence number.
+			 *
+			 * The message targets the main table with universe scope and
+			 * static protocol, like the non-batched route operations.
+			 */
+			void append_route(uint16_t message_type, uint16_t message_flags, const boost::asio::ip::address& destination, unsigned int destination_length, unsigned int interface, const boost::optional<boost::asio::ip::address>& gateway, uint32_t sequence)
+			{
+				const bool is_v6 = destination.is_v6();
+				const shape_type& shape = shape_for(is_v6, static_cast<bool>(gateway));
+
+				const size_t offset = m_data.size();
+				m_data.resize(offset + shape.message_size, 0);
+				char* const base = &m_data[offset];
+
+				::nlmsghdr& header = *reinterpret_cast<::nlmsghdr*>(base);
+				header.nlmsg_len = static_cast<uint32_t>(shape.message_size);
+				header.nlmsg_type = message_type;
+				header.nlmsg_flags = message_flags;
+				header.nlmsg_seq = sequence;
+
+				::rtmsg& subheader = *reinterpret_cast<::rtmsg*>(base + NLMSG_HDRLEN);
+				subheader.rtm_family = is_v6 ? AF_INET6 : AF_INET;
+				subheader.rtm_dst_len = static_cast<unsigned char>(destination_length);
+				subheader.rtm_table = RT_TABLE_MAIN;
+				subheader.rtm_scope = RT_SCOPE_UNIVERSE;
+				subheader.rtm_type = RTN_UNICAST;
+				subheader.rtm_protocol = RTPROT_STATIC;
+
+				write_address_attribute(base + shape.destination_offset, RTA_DST, destination);
+
+				::rtattr& interface_attribute = *reinterpret_cast<::rtattr*>(base + shape.interface_offset);
+				interface_attribute.rta_type = RTA_OIF;
+				interface_attribute.rta_len = RTA_LENGTH(sizeof(unsigned int));
+				std::memcpy(RTA_DATA(&interface_attribute), &interface, sizeof(unsigned int));
+
+				if (gateway)
+				{
+					write_address_attribute(base + shape.gateway_offset, RTA_GATEWAY, *gateway);
+				}
+
+				++m_message_count;
+			}
+
+		private:
+
+			struct shape_type
+			{
+				size_t message_size;
+				size_t destination_offset;
+				size_t interface_offset;
+				size_t gateway_offset;
+				size_t address_size;
+			};
+
+			static shape_type make_shape(bool is_v6, bool has_gateway)
+			{
+				shape_type shape;
+
+				shape.address_size = is_v6 ? 16 : 4;
+
+				size_t size = NLMSG_ALIGN(NLMSG_LENGTH(sizeof(::rtmsg)));
+
+				shape.destination_offset = size;
+				size += RTA_ALIGN(RTA_LENGTH(shape.address_size));
+
+				shape.interface_offset = size;
+				size += RTA_ALIGN(RTA_LENGTH(sizeof(unsigned int)));
+
+				shape.gateway_offset = has_gateway ? size : 0;
+
+				if (has_gateway)
+				{
+					size += RTA_ALIGN(RTA_LENGTH(shape.address_size));
+				}
+
+				shape.message_size = size;
+
+				return shape;
+			}
+
+			static const shape_type& shape_for(bool is_v6, bool has_gateway)
+			{
+				// The four fixed shapes are computed once: appends only patch the variable fields at known offsets.
+				static const shape_type shapes[4] = {
+					make_shape(false, false),
+					make_shape(false, true),
+					make_shape(true, false),
+					make_shape(true, true)
+				};
+
+				return shapes[(is_v6 ? 2 : 0) + (has_gateway ? 1 : 0)];
+			}
+
+			static void write_address_attribute(char* at, int type, const boost::asio::ip::address& _address)
+			{
+				::rtattr& attribute = *reinterpret_cast<::rtattr*>(at);
+
+				attribute.rta_type = type;
+
+				if (_address.is_v4())
+				{
+					const auto bytes = _address.to_v4().to_bytes();
+					attribute.rta_len = RTA_LENGTH(bytes.size());
+					std::memcpy(RTA_DATA(&attribute), bytes.data(), bytes.size());
+				}
+				else
+				{
+					const auto bytes = _address.to_v6().to_bytes();
+					attribute.rta_len = RTA_LENGTH(bytes.size());
+					std::memcpy(RTA_DATA(&attribute), bytes.data(), bytes.size());
+				}
+			}
+
+			std::vector<char> m_data;
+			size_t m_message_count;
+	};
+}
@@ -488,6 +488,34 @@ namespace netlinkplus
 	{
 	};
 
+	template <size_t DataSize>
+	class link_message_type : public generic_message_type<::ifinfomsg, DataSize>, public attribute_message<link_message_type<DataSize>>
+	{
+		public:
+			explicit link_message_type(uint16_t type = 0, uint16_t flags = 0) :
+				generic_message_type<::ifinfomsg, DataSize>(type, flags)
+			{
+			}
+
+			void set_interface(int _interface_index)
+			{
+				this->subheader().ifi_index = _interface_index;
+			}
+	};
+
+	class link_request_type : public link_message_type<1024>
+	{
+		public:
+			explicit link_request_type(uint16_t type = 0, uint16_t flags = 0) :
+				link_message_type<1024>(type, flags)
+			{
+			}
+	};
+
+	class link_response_type : public link_message_type<1024>
+	{
+	};
+
 	class error_message_type : public generic_message_type<::nlmsgerr, 1024>
 	{
 		public:
@@ -44,15 +44,183 @@
 
 #include "manager.hpp"
 #include "messages.hpp"
+#include "message_arena.hpp"
 #include "error.hpp"
 
 #include <net/if.h>
 #include <errno.h>
 
+#include <array>
+
+#include <boost/make_shared.hpp>
+
 namespace netlinkplus
 {
 	namespace
 	{
+		/**
+		 * \brief An iterable view over the attributes of a raw netlink message, for dump responses that never go through the message classes.
+		 */
+		class raw_attributes_type
+		{
+			public:
+
+				class const_iterator : public std::iterator<std::forward_iterator_tag, const ::rtattr>
+				{
+					public:
+
+						const_iterator() :
+							m_ptr(nullptr),
+							m_ptr_len()
+						{
+						}
+
+						const_iterator(const ::rtattr* ptr, size_t ptr_len) :
+							m_ptr(ptr),
+							m_ptr_len(ptr_len)
+						{
+							if (!RTA_OK(m_ptr, m_ptr_len))
+							{
+								*this = const_iterator();
+							}
+						}
+
+						const_iterator& operator++()
+						{
+							m_ptr = RTA_NEXT(m_ptr, m_ptr_len);
+
+							if (!RTA_OK(m_ptr, m_ptr_len))
+							{
+								*this = const_iterator();
+							}
+
+							return *this;
+						}
+
+						bool operator!=(const const_iterator& rhs) const
+						{
+							return (rhs.m_ptr != m_ptr);
+						}
+
+						const ::rtattr& operator*() const
+						{
+							return *m_ptr;
+						}
+
+					private:
+
+						const ::rtattr* m_ptr;
+						size_t m_ptr_len;
+				};
+
+				raw_attributes_type(const ::rtattr* first, size_t len) :
+					m_first(first),
+					m_len(len)
+				{
+				}
+
+				const_iterator begin() const
+				{
+					return const_iterator(m_first, m_len);
+				}
+
+				const_iterator end() const
+				{
+					return {};
+				}
+
+			private:
+
+				const ::rtattr* m_first;
+				size_t m_len;
+		};
+
+		template <typename AddressType>
+		boost::asio::ip::address get_attribute_address(boost::asio::const_buffer data)
+		{
+			typename AddressType::bytes_type bytes;
+
+			if (bytes.size() != buffer_size(data))
+			{
+				throw boost::system::system_error(make_error_code(netlinkplus_error::invalid_response));
+			}
+
+			::memcpy(bytes.data(), boost::asio::buffer_cast<const void*>(data), buffer_size(data));
+
+			return boost::asio::ip::address(AddressType(bytes));
+		}
+
+		std::string get_attribute_string(boost::asio::const_buffer data)
+		{
+			const char* const str = boost::asio::buffer_cast<const char*>(data);
+			const size_t str_len = buffer_size(data);
+
+			// Netlink strings carry their terminating null character.
+			return std::string(str, ((str_len > 0) && (str[str_len - 1] == '\0')) ? str_len - 1 : str_len);
+		}
+
+		template <typename AddressType, typename AttributesType>
+		address_entry get_address_entry(const AttributesType& attributes)
+		{
+			address_entry result;
+
+			for (auto&& attribute : attributes)
+			{
+				const auto data = boost::asio::buffer(RTA_DATA(&attribute), RTA_PAYLOAD(&attribute));
+
+				switch (attribute.rta_type)
+				{
+					case IFA_ADDRESS:
+						result.address = get_attribute_address<AddressType>(data);
+						break;
+					case IFA_LOCAL:
+						result.local = get_attribute_address<AddressType>(data);
+						break;
+					case IFA_BROADCAST:
+						result.broadcast = get_attribute_address<AddressType>(data);
+						break;
+					case IFA_ANYCAST:
+						result.anycast = get_attribute_address<AddressType>(data);
+						break;
+					case IFA_LABEL:
+						result.label = get_attribute_string(data);
+						break;
+				}
+			}
+
+			return result;
+		}
+
+		template <typename AttributesType>
+		link_entry get_link_entry(const AttributesType& attributes)
+		{
+			link_entry result;
+
+			for (auto&& attribute : attributes)
+			{
+				const auto data = boost::asio::buffer(RTA_DATA(&attribute), RTA_PAYLOAD(&attribute));
+
+				switch (attribute.rta_type)
+				{
+					case IFLA_IFNAME:
+						result.name = get_attribute_string(data);
+						break;
+					case IFLA_MTU:
+						if (buffer_size(data) != sizeof(result.mtu))
+						{
+							throw boost::system::system_error(make_error_code(netlinkplus_error::invalid_response));
+						}
+
+						result.mtu = *boost::asio::buffer_cast<const unsigned int*>(data);
+						break;
+				}
+			}
+
+			return result;
+		}
+
+		route_entry parse_route_response(route_response_type& response, size_t cnt);
+
 		template <typename AddressType, typename AttributesType>
 		route_entry get_route_entry(const AttributesType& attributes)
 		{
@@ -155,6 +323,36 @@ namespace netlinkplus
 
 			return result;
 		}
+
+		route_entry parse_route_response(route_response_type& response, size_t cnt)
+		{
+			if (!response.is_valid(cnt))
+			{
+				throw boost::system::system_error(make_error_code(netlinkplus_error::invalid_response));
+			}
+
+			if (response.header().nlmsg_type != RTM_NEWROUTE) {
+				throw boost::system::system_error(make_error_code(netlinkplus_error::unexpected_response_type));
+			}
+
+			const int family = response.subheader().rtm_family;
+
+			route_entry result;
+
+			if (family == AF_INET)
+			{
+				result = get_route_entry<boost::asio::ip::address_v4>(response.attributes());
+			}
+			else
+			{
+				result = get_route_entry<boost::asio::ip::address_v6>(response.attributes());
+			}
+
+			result.destination_length = response.subheader().rtm_dst_len;
+			result.source_length = response.subheader().rtm_src_len;
+
+			return result;
+		}
 	}
 
 	std::string interface_entry::name() const
@@ -188,7 +386,8 @@ namespace netlinkplus
 	}
 
 	manager::manager(boost::asio::io_service& io_service) :
-		m_socket(io_service, netlink_route_protocol::endpoint())
+		m_socket(io_service, netlink_route_protocol::endpoint()),
+		m_strand(io_service)
 	{
 		m_socket.set_option(boost::asio::socket_base::send_buffer_size(32768));
 		m_socket.set_option(boost::asio::socket_base::receive_buffer_size(32768));
@@ -206,42 +405,317 @@ namespace netlinkplus
 		m_socket.send(boost::asio::buffer(request.data(), request.size()));
 		const size_t cnt = m_socket.receive(boost::asio::buffer(response.data(), response.max_size()));
 
-		if (!response.is_valid(cnt))
+		return parse_route_response(response, cnt);
+	}
+
+	void manager::async_get_route_for(const boost::asio::ip::address& host, route_handler_type handler)
+	{
+		const auto request = boost::make_shared<route_request_type>(RTM_GETROUTE, NLM_F_REQUEST);
+		request->set_route_destination(host);
+
+		post_operation([this, request, handler]() {
+			m_socket.async_send(boost::asio::buffer(request->data(), request->size()), m_strand.wrap([this, request, handler](const boost::system::error_code& ec, size_t) {
+				if (ec)
+				{
+					complete_operation();
+					handler(ec, route_entry());
+
+					return;
+				}
+
+				const auto response = boost::make_shared<route_response_type>();
+
+				m_socket.async_receive(boost::asio::buffer(response->data(), response->max_size()), m_strand.wrap([this, response, handler](const boost::system::error_code& ec2, size_t cnt) {
+					complete_operation();
+
+					if (ec2)
+					{
+						handler(ec2, route_entry());
+
+						return;
+					}
+
+					try
+					{
+						const route_entry entry = parse_route_response(*response, cnt);
+
+						handler(boost::system::error_code(), entry);
+					}
+					catch (const boost::system::system_error& ex)
+					{
+						handler(ex.code(), route_entry());
+					}
+				}));
+			}));
+		});
+	}
+
+	void manager::async_add_route(const interface_entry& interface, const boost::asio::ip::address& destination, unsigned int destination_length, boost::optional<boost::asio::ip::address> gateway, completion_handler_type handler)
+	{
+		async_generic_route(RTM_NEWROUTE, interface, destination, destination_length, gateway, handler);
+	}
+
+	void manager::async_remove_route(const interface_entry& interface, const boost::asio::ip::address& destination, unsigned int destination_length, boost::optional<boost::asio::ip::address> gateway, completion_handler_type handler)
+	{
+		async_generic_route(RTM_DELROUTE, interface, destination, destination_length, gateway, handler);
+	}
+
+	void manager::add_route(const interface_entry& interface, const boost::asio::ip::address& destination, unsigned int destination_length, boost::optional<boost::asio::ip::address> gateway)
+	{
+		generic_route(RTM_NEWROUTE, interface, destination, destination_length, gateway);
+	}
+
+	void manager::remove_route(const interface_entry& interface, const boost::asio::ip::address& destination, unsigned int destination_length, boost::optional<boost::asio::ip::address> gateway)
+	{
+		generic_route(RTM_DELROUTE, interface, destination, destination_length, gateway);
+	}
+
+	void manager::process_route_batch(uint16_t message_type, uint16_t message_flags, const std::vector<route_specification>& routes, std::vector<bool>& acked, boost::optional<boost::system::system_error>& failure)
+	{
+		// Netlink accepts several messages per datagram: the requests are sent in large chunks and the acknowledgments are drained afterwards, instead of paying a full round-trip for every route.
+		static const size_t chunk_size = 16384;
+
+		size_t next_route = 0;
+		route_message_arena arena(chunk_size);
+
+		while ((next_route < routes.size()) && !failure)
 		{
-			throw boost::system::system_error(make_error_code(netlinkplus_error::invalid_response));
-		}
+			arena.clear();
 
-		if (response.header().nlmsg_type != RTM_NEWROUTE) {
-			throw boost::system::system_error(make_error_code(netlinkplus_error::unexpected_response_type));
+			const size_t first_route = next_route;
+
+			// Fill the current chunk. The messages all have one of the arena's fixed shapes, so each one is laid out at its final offset instead of being built in a scratch message and copied over. The sequence number of a message is its route index plus one, so the acknowledgments can be matched back to the routes.
+			while (next_route < routes.size())
+			{
+				const route_specification& specification = routes[next_route];
+
+				const size_t message_size = route_message_arena::route_message_size(specification.destination.is_v6(), static_cast<bool>(specification.gateway));
+
+				if (!arena.empty() && (arena.size() + message_size > chunk_size))
+				{
+					break;
+				}
+
+				arena.append_route(message_type, message_flags, specification.destination, specification.destination_length, specification.interface.index(), specification.gateway, static_cast<uint32_t>(next_route + 1));
+
+				++next_route;
+			}
+
+			m_socket.send(boost::asio::buffer(arena.data(), arena.size()));
+
+			// Every message requested an acknowledgment: drain them all, even after a failure, so no stale response is left in the socket.
+			size_t pending = next_route - first_route;
+			std::array<char, 8192> receive_buffer;
+
+			while (pending > 0)
+			{
+				const size_t cnt = m_socket.receive(boost::asio::buffer(receive_buffer));
+
+				int remaining = static_cast<int>(cnt);
+
+				for (const ::nlmsghdr* message = reinterpret_cast<const ::nlmsghdr*>(receive_buffer.data()); NLMSG_OK(message, remaining); message = NLMSG_NEXT(message, remaining))
+				{
+					if (message->nlmsg_type != NLMSG_ERROR)
+					{
+						throw boost::system::system_error(make_error_code(netlinkplus_error::unexpected_response_type));
+					}
+
+					const ::nlmsgerr* const error = static_cast<const ::nlmsgerr*>(NLMSG_DATA(message));
+					const size_t route_index = message->nlmsg_seq - 1;
+
+					--pending;
+
+					if (error->error != 0)
+					{
+						if (!failure)
+						{
+							failure = boost::system::system_error(-error->error, boost::system::system_category());
+						}
+					}
+					else if (route_index < routes.size())
+					{
+						acked[route_index] = true;
+					}
+				}
+			}
 		}
+	}
 
-		const int family = response.subheader().rtm_family;
+	void manager::add_routes(const std::vector<route_specification>& routes)
+	{
+		std::vector<bool> applied(routes.size(), false);
+		boost::optional<boost::system::system_error> failure;
 
-		route_entry result;
+		process_route_batch(RTM_NEWROUTE, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_EXCL, routes, applied, failure);
 
-		if (family == AF_INET)
+		if (failure)
 		{
-			result = get_route_entry<boost::asio::ip::address_v4>(response.attributes());
+			// Roll the transaction back: the routes that were applied are removed again. Removal errors are ignored since there is nothing sensible left to do about them.
+			for (size_t route_index = 0; route_index < routes.size(); ++route_index)
+			{
+				if (applied[route_index])
+				{
+					try
+					{
+						remove_route(routes[route_index].interface, routes[route_index].destination, routes[route_index].destination_length, routes[route_index].gateway);
+					}
+					catch (boost::system::system_error&)
+					{
+					}
+				}
+			}
+
+			throw *failure;
 		}
-		else
+	}
+
+	void manager::remove_routes(const std::vector<route_specification>& routes)
+	{
+		std::vector<bool> removed(routes.size(), false);
+		boost::optional<boost::system::system_error> failure;
+
+		// There is nothing to roll back for removals: the first error, if any, is thrown once the acknowledgments of its batch were read.
+		process_route_batch(RTM_DELROUTE, NLM_F_REQUEST | NLM_F_ACK, routes, removed, failure);
+
+		if (failure)
 		{
-			result = get_route_entry<boost::asio::ip::address_v6>(response.attributes());
+			throw *failure;
 		}
+	}
+
+	void manager::get_routes(std::vector<route_entry>& entries)
+	{
+		entries.clear();
 
-		result.destination_length = response.subheader().rtm_dst_len;
-		result.source_length = response.subheader().rtm_src_len;
+		route_request_type request(RTM_GETROUTE, NLM_F_REQUEST | NLM_F_DUMP);
+		request.subheader().rtm_family = AF_UNSPEC;
 
-		return result;
+		m_socket.send(boost::asio::buffer(request.data(), request.size()));
+
+		receive_dump([&entries](const ::nlmsghdr& message) {
+			if (message.nlmsg_type != RTM_NEWROUTE)
+			{
+				throw boost::system::system_error(make_error_code(netlinkplus_error::unexpected_response_type));
+			}
+
+			const ::rtmsg* const subheader = static_cast<const ::rtmsg*>(NLMSG_DATA(&message));
+			const raw_attributes_type attributes(RTM_RTA(subheader), RTM_PAYLOAD(&message));
+
+			route_entry entry;
+
+			if (subheader->rtm_family == AF_INET)
+			{
+				entry = get_route_entry<boost::asio::ip::address_v4>(attributes);
+			}
+			else if (subheader->rtm_family == AF_INET6)
+			{
+				entry = get_route_entry<boost::asio::ip::address_v6>(attributes);
+			}
+			else
+			{
+				return;
+			}
+
+			entry.destination_length = subheader->rtm_dst_len;
+			entry.source_length = subheader->rtm_src_len;
+
+			entries.push_back(entry);
+		});
 	}
 
-	void manager::add_route(const interface_entry& interface, const boost::asio::ip::address& destination, unsigned int destination_length, boost::optional<boost::asio::ip::address> gateway)
+	void manager::get_addresses(std::vector<address_entry>& entries)
 	{
-		generic_route(RTM_NEWROUTE, interface, destination, destination_length, gateway);
+		entries.clear();
+
+		address_request_type request(RTM_GETADDR, NLM_F_REQUEST | NLM_F_DUMP);
+		request.subheader().ifa_family = AF_UNSPEC;
+
+		m_socket.send(boost::asio::buffer(request.data(), request.size()));
+
+		receive_dump([&entries](const ::nlmsghdr& message) {
+			if (message.nlmsg_type != RTM_NEWADDR)
+			{
+				throw boost::system::system_error(make_error_code(netlinkplus_error::unexpected_response_type));
+			}
+
+			const ::ifaddrmsg* const subheader = static_cast<const ::ifaddrmsg*>(NLMSG_DATA(&message));
+			const raw_attributes_type attributes(IFA_RTA(subheader), IFA_PAYLOAD(&message));
+
+			address_entry entry;
+
+			if (subheader->ifa_family == AF_INET)
+			{
+				entry = get_address_entry<boost::asio::ip::address_v4>(attributes);
+			}
+			else if (subheader->ifa_family == AF_INET6)
+			{
+				entry = get_address_entry<boost::asio::ip::address_v6>(attributes);
+			}
+			else
+			{
+				return;
+			}
+
+			entry.interface = interface_entry(subheader->ifa_index);
+			entry.prefix_length = subheader->ifa_prefixlen;
+
+			entries.push_back(entry);
+		});
 	}
 
-	void manager::remove_route(const interface_entry& interface, const boost::asio::ip::address& destination, unsigned int destination_length, boost::optional<boost::asio::ip::address> gateway)
+	void manager::get_links(std::vector<link_entry>& entries)
 	{
-		generic_route(RTM_DELROUTE, interface, destination, destination_length, gateway);
+		entries.clear();
+
+		link_request_type request(RTM_GETLINK, NLM_F_REQUEST | NLM_F_DUMP);
+
+		m_socket.send(boost::asio::buffer(request.data(), request.size()));
+
+		receive_dump([&entries](const ::nlmsghdr& message) {
+			if (message.nlmsg_type != RTM_NEWLINK)
+			{
+				throw boost::system::system_error(make_error_code(netlinkplus_error::unexpected_response_type));
+			}
+
+			const ::ifinfomsg* const subheader = static_cast<const ::ifinfomsg*>(NLMSG_DATA(&message));
+
+			link_entry entry = get_link_entry(raw_attributes_type(IFLA_RTA(subheader), IFLA_PAYLOAD(&message)));
+			entry.interface = interface_entry(subheader->ifi_index);
+			entry.flags = subheader->ifi_flags;
+
+			entries.push_back(entry);
+		});
+	}
+
+	void manager::receive_dump(const std::function<void (const ::nlmsghdr&)>& handler)
+	{
+		std::array<char, 32768> receive_buffer;
+
+		// A dump answer is multipart: the kernel streams as many datagrams as needed and closes the sequence with a NLMSG_DONE message.
+		for (bool done = false; !done;)
+		{
+			const size_t cnt = m_socket.receive(boost::asio::buffer(receive_buffer));
+
+			int remaining = static_cast<int>(cnt);
+
+			for (const ::nlmsghdr* message = reinterpret_cast<const ::nlmsghdr*>(receive_buffer.data()); NLMSG_OK(message, remaining); message = NLMSG_NEXT(message, remaining))
+			{
+				if (message->nlmsg_type == NLMSG_DONE)
+				{
+					done = true;
+					break;
+				}
+
+				if (message->nlmsg_type == NLMSG_ERROR)
+				{
+					const ::nlmsgerr* const error = static_cast<const ::nlmsgerr*>(NLMSG_DATA(message));
+
+					throw boost::system::system_error(-error->error, boost::system::system_category());
+				}
+
+				handler(*message);
+			}
+		}
 	}
 
 	void manager::add_interface_address(const interface_entry& interface, const boost::asio::ip::address& address, size_t prefix_length)
@@ -311,6 +785,254 @@ namespace netlinkplus
 		}
 	}
 
+	void manager::async_generic_route(uint16_t type, const interface_entry& interface, const boost::asio::ip::address& destination, unsigned int destination_length, boost::optional<boost::asio::ip::address> gateway, completion_handler_type handler)
+	{
+		int flags = NLM_F_REQUEST | NLM_F_ACK;
+
+		if (type == RTM_NEWROUTE)
+		{
+			flags |= NLM_F_CREATE | NLM_F_EXCL;
+		}
+
+		const auto request = boost::make_shared<route_request_type>(type, flags);
+
+		request->subheader().rtm_table = RT_TABLE_MAIN;
+		request->subheader().rtm_scope = RT_SCOPE_UNIVERSE;
+		request->subheader().rtm_type = RTN_UNICAST;
+		request->subheader().rtm_protocol = RTPROT_STATIC;
+
+		request->set_route_destination(destination, destination_length);
+		request->set_output_interface(interface.index());
+
+		if (gateway)
+		{
+			request->set_gateway(*gateway);
+		}
+
+		post_operation([this, request, handler]() {
+			m_socket.async_send(boost::asio::buffer(request->data(), request->size()), m_strand.wrap([this, request, handler](const boost::system::error_code& ec, size_t) {
+				if (ec)
+				{
+					complete_operation();
+					handler(ec);
+
+					return;
+				}
+
+				const auto response = boost::make_shared<error_message_type>();
+
+				m_socket.async_receive(boost::asio::buffer(response->data(), response->max_size()), m_strand.wrap([this, response, handler](const boost::system::error_code& ec2, size_t cnt) {
+					complete_operation();
+
+					if (ec2)
+					{
+						handler(ec2);
+					}
+					else if (!response->is_valid(cnt))
+					{
+						handler(make_error_code(netlinkplus_error::invalid_response));
+					}
+					else if (response->header().nlmsg_type != NLMSG_ERROR)
+					{
+						handler(make_error_code(netlinkplus_error::unexpected_response_type));
+					}
+					else if (response->subheader().error != 0)
+					{
+						handler(boost::system::error_code(-response->subheader().error, boost::system::system_category()));
+					}
+					else
+					{
+						handler(boost::system::error_code());
+					}
+				}));
+			}));
+		});
+	}
+
+	void manager::post_operation(std::function<void ()> operation)
+	{
+		// Operations are serialized: a netlink socket answers requests in order on the same datagram stream, so a second request must not be sent before the first response was read back.
+		m_strand.post([this, operation]() {
+			m_operation_queue.push(operation);
+
+			if (m_operation_queue.size() == 1)
+			{
+				m_operation_queue.front()();
+			}
+		});
+	}
+
+	void manager::complete_operation()
+	{
+		m_operation_queue.pop();
+
+		if (!m_operation_queue.empty())
+		{
+			m_operation_queue.front()();
+		}
+	}
+
+	monitor::monitor(boost::asio::io_service& io_service) :
+		m_socket(io_service, netlink_route_protocol::endpoint(RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR | RTMGRP_LINK)),
+		m_is_running(false)
+	{
+		m_socket.set_option(boost::asio::socket_base::receive_buffer_size(262144));
+	}
+
+	void monitor::start()
+	{
+		if (!m_is_running)
+		{
+			m_is_running = true;
+
+			async_receive_next();
+		}
+	}
+
+	void monitor::stop()
+	{
+		if (m_is_running)
+		{
+			m_is_running = false;
+
+			boost::system::error_code ec;
+			m_socket.cancel(ec);
+		}
+	}
+
+	void monitor::async_receive_next()
+	{
+		m_socket.async_receive(boost::asio::buffer(m_receive_buffer), [this](const boost::system::error_code& ec, size_t cnt) {
+			if (!m_is_running)
+			{
+				return;
+			}
+
+			if (ec)
+			{
+				m_is_running = false;
+
+				if (m_error_handler)
+				{
+					m_error_handler(ec);
+				}
+
+				return;
+			}
+
+			int remaining = static_cast<int>(cnt);
+
+			for (const ::nlmsghdr* message = reinterpret_cast<const ::nlmsghdr*>(m_receive_buffer.data()); NLMSG_OK(message, remaining); message = NLMSG_NEXT(message, remaining))
+			{
+				try
+				{
+					process(*message);
+				}
+				catch (const boost::system::system_error& ex)
+				{
+					// A malformed announcement does not stop monitoring: report it and keep going.
+					if (m_error_handler)
+					{
+						m_error_handler(ex.code());
+					}
+				}
+			}
+
+			async_receive_next();
+		});
+	}
+
+	void monitor::process(const ::nlmsghdr& message)
+	{
+		switch (message.nlmsg_type)
+		{
+			case RTM_NEWROUTE:
+			case RTM_DELROUTE:
+			{
+				if (!m_route_handler)
+				{
+					break;
+				}
+
+				const ::rtmsg* const subheader = static_cast<const ::rtmsg*>(NLMSG_DATA(&message));
+				const raw_attributes_type attributes(RTM_RTA(subheader), RTM_PAYLOAD(&message));
+
+				route_entry entry;
+
+				if (subheader->rtm_family == AF_INET)
+				{
+					entry = get_route_entry<boost::asio::ip::address_v4>(attributes);
+				}
+				else if (subheader->rtm_family == AF_INET6)
+				{
+					entry = get_route_entry<boost::asio::ip::address_v6>(attributes);
+				}
+				else
+				{
+					break;
+				}
+
+				entry.destination_length = subheader->rtm_dst_len;
+				entry.source_length = subheader->rtm_src_len;
+
+				m_route_handler((message.nlmsg_type == RTM_NEWROUTE) ? change_type::added : change_type::removed, entry);
+
+				break;
+			}
+			case RTM_NEWADDR:
+			case RTM_DELADDR:
+			{
+				if (!m_address_handler)
+				{
+					break;
+				}
+
+				const ::ifaddrmsg* const subheader = static_cast<const ::ifaddrmsg*>(NLMSG_DATA(&message));
+				const raw_attributes_type attributes(IFA_RTA(subheader), IFA_PAYLOAD(&message));
+
+				address_entry entry;
+
+				if (subheader->ifa_family == AF_INET)
+				{
+					entry = get_address_entry<boost::asio::ip::address_v4>(attributes);
+				}
+				else if (subheader->ifa_family == AF_INET6)
+				{
+					entry = get_address_entry<boost::asio::ip::address_v6>(attributes);
+				}
+				else
+				{
+					break;
+				}
+
+				entry.interface = interface_entry(subheader->ifa_index);
+				entry.prefix_length = subheader->ifa_prefixlen;
+
+				m_address_handler((message.nlmsg_type == RTM_NEWADDR) ? change_type::added : change_type::removed, entry);
+
+				break;
+			}
+			case RTM_NEWLINK:
+			case RTM_DELLINK:
+			{
+				if (!m_link_handler)
+				{
+					break;
+				}
+
+				const ::ifinfomsg* const subheader = static_cast<const ::ifinfomsg*>(NLMSG_DATA(&message));
+
+				link_entry entry = get_link_entry(raw_attributes_type(IFLA_RTA(subheader), IFLA_PAYLOAD(&message)));
+				entry.interface = interface_entry(subheader->ifi_index);
+				entry.flags = subheader->ifi_flags;
+
+				m_link_handler((message.nlmsg_type == RTM_NEWLINK) ? change_type::added : change_type::removed, entry);
+
+				break;
+			}
+		}
+	}
+
 	void manager::generic_interface_address(uint16_t type, const interface_entry& interface, const boost::asio::ip::address& address, size_t prefix_length, const boost::asio::ip::address& remote_address)
 	{
 		using boost::asio::buffer_size;
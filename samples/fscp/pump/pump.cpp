@@ -0,0 +1,337 @@
+/**
+ * \file pump.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A traffic generator that stresses the data path.
+ *
+ * The pump establishes a session with a sink and pushes frames of a
+ * configurable size at a configurable rate through the in-place send API, so
+ * data path performance can be reproduced without a full deployment:
+ *
+ *   pump [host] [port] [frame_size] [rate] [cipher_suite]
+ *
+ * host defaults to 127.0.0.1, port to 12000, frame_size to 1400 bytes and
+ * rate - in frames per second - to 0, which means flooding with a fixed
+ * window of outstanding sends. cipher_suite restricts the session to one
+ * suite, like "ecdhe_rsa_aes128_gcm_sha256".
+ *
+ * Each frame carries a sequence number and a send timestamp that the sink
+ * uses to compute loss and latency. Run the sink first.
+ */
+
+#include <fscp/fscp.hpp>
+#include <fscp/server.hpp>
+#include <fscp/shared_buffer.hpp>
+#include <fscp/data_message.hpp>
+
+#include <cryptoplus/cryptoplus.hpp>
+#include <cryptoplus/error/error_strings.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <iostream>
+
+using boost::asio::buffer_cast;
+using boost::asio::buffer_size;
+
+static boost::mutex output_mutex;
+
+using boost::mutex;
+
+// The count of outstanding sends when flooding.
+static const size_t FLOOD_WINDOW = 32;
+
+// Frames carry a sequence number and a send timestamp.
+static const size_t FRAME_HEADER_SIZE = 2 * sizeof(uint64_t);
+
+static std::atomic<bool> stopping(false);
+static std::atomic<uint64_t> sequence(0);
+static std::atomic<uint64_t> sent_count(0);
+static std::atomic<uint64_t> sent_bytes(0);
+static std::atomic<uint64_t> error_count(0);
+
+void signal_handler(const boost::system::error_code& error, int signal_number, boost::function<void ()> stop_function)
+{
+	if (!error)
+	{
+		{
+			mutex::scoped_lock lock(output_mutex);
+			std::cerr << "Signal caught (" << signal_number << "): exiting..." << std::endl;
+		}
+
+		stop_function();
+	}
+}
+
+static uint64_t timestamp_now()
+{
+	static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+
+	return static_cast<uint64_t>((boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds());
+}
+
+static void send_one_frame(fscp::server& server, const fscp::server::ep_type& target, size_t frame_size, boost::function<void (const boost::system::error_code&)> handler)
+{
+	// The frame is built at DATA_PAYLOAD_OFFSET within the buffer, so the
+	// datagram is encrypted in place and the cleartext is never copied.
+	const fscp::SharedBuffer frame(fscp::data_message::DATA_PAYLOAD_OFFSET + frame_size);
+
+	uint8_t* const payload = buffer_cast<uint8_t*>(frame) + fscp::data_message::DATA_PAYLOAD_OFFSET;
+
+	const uint64_t frame_sequence = sequence++;
+	const uint64_t frame_timestamp = timestamp_now();
+
+	std::memcpy(payload, &frame_sequence, sizeof(frame_sequence));
+	std::memcpy(payload + sizeof(frame_sequence), &frame_timestamp, sizeof(frame_timestamp));
+	std::memset(payload + FRAME_HEADER_SIZE, 0x2a, frame_size - FRAME_HEADER_SIZE);
+
+	server.async_send_data_in_place(
+		target,
+		fscp::CHANNEL_NUMBER_3,
+		frame,
+		boost::asio::const_buffer(payload, frame_size),
+		[frame, frame_size, handler](const boost::system::error_code& ec) {
+			if (ec)
+			{
+				++error_count;
+			}
+			else
+			{
+				++sent_count;
+				sent_bytes += frame_size;
+			}
+
+			handler(ec);
+		}
+	);
+}
+
+static void flood_next(fscp::server& server, const fscp::server::ep_type& target, size_t frame_size)
+{
+	if (stopping)
+	{
+		return;
+	}
+
+	// Each completed send starts the next one: the window stays full without a timer.
+	send_one_frame(server, target, frame_size, [&server, target, frame_size](const boost::system::error_code& ec) {
+		if (!ec || (ec == boost::asio::error::operation_aborted))
+		{
+			if (ec)
+			{
+				return;
+			}
+		}
+
+		flood_next(server, target, frame_size);
+	});
+}
+
+static void paced_burst(fscp::server& server, const fscp::server::ep_type& target, size_t frame_size, unsigned long rate, boost::asio::deadline_timer& pace_timer)
+{
+	if (stopping)
+	{
+		return;
+	}
+
+	// A 10 ms period keeps the bursts small without a busy loop.
+	const unsigned long burst = (rate + 99) / 100;
+
+	for (unsigned long i = 0; i < burst; ++i)
+	{
+		send_one_frame(server, target, frame_size, [](const boost::system::error_code&) {});
+	}
+
+	pace_timer.expires_from_now(boost::posix_time::milliseconds(10));
+	pace_timer.async_wait([&server, target, frame_size, rate, &pace_timer](const boost::system::error_code& ec) {
+		if (ec != boost::asio::error::operation_aborted)
+		{
+			paced_burst(server, target, frame_size, rate, pace_timer);
+		}
+	});
+}
+
+static void report_statistics(boost::asio::deadline_timer& statistics_timer)
+{
+	static uint64_t last_sent_count = 0;
+	static uint64_t last_sent_bytes = 0;
+
+	const uint64_t current_sent_count = sent_count;
+	const uint64_t current_sent_bytes = sent_bytes;
+
+	{
+		mutex::scoped_lock lock(output_mutex);
+
+		std::cout << "sent: " << (current_sent_count - last_sent_count) << " pps, "
+			<< ((current_sent_bytes - last_sent_bytes) * 8.0 / 1000000.0) << " Mbit/s payload, "
+			<< error_count << " errors total" << std::endl;
+	}
+
+	last_sent_count = current_sent_count;
+	last_sent_bytes = current_sent_bytes;
+
+	statistics_timer.expires_from_now(boost::posix_time::seconds(1));
+	statistics_timer.async_wait([&statistics_timer](const boost::system::error_code& ec) {
+		if (ec != boost::asio::error::operation_aborted)
+		{
+			report_statistics(statistics_timer);
+		}
+	});
+}
+
+int main(int argc, char** argv)
+{
+	cryptoplus::crypto_initializer crypto_initializer;
+	cryptoplus::algorithms_initializer algorithms_initializer;
+	cryptoplus::error::error_strings_initializer error_strings_initializer;
+
+	try
+	{
+		const std::string host = (argc > 1) ? argv[1] : "127.0.0.1";
+		const std::string port = (argc > 2) ? argv[2] : "12000";
+		const size_t frame_size = (argc > 3) ? boost::lexical_cast<size_t>(argv[3]) : 1400;
+		const unsigned long rate = (argc > 4) ? boost::lexical_cast<unsigned long>(argv[4]) : 0;
+
+		if (frame_size < FRAME_HEADER_SIZE)
+		{
+			std::cerr << "The frame size must be at least " << FRAME_HEADER_SIZE << " bytes." << std::endl;
+
+			return EXIT_FAILURE;
+		}
+
+		boost::asio::io_service _io_service;
+		boost::asio::signal_set signals(_io_service, SIGINT, SIGTERM);
+		fscp::logger _logger;
+
+		using cryptoplus::file;
+
+		cryptoplus::x509::certificate cert = cryptoplus::x509::certificate::from_certificate(file::open("pump.crt", "r"));
+		cryptoplus::pkey::pkey key = cryptoplus::pkey::pkey::from_private_key(file::open("pump.key", "r"));
+
+		fscp::server server(_io_service, _logger, fscp::identity_store(cert, key));
+
+		if (argc > 5)
+		{
+			// Restricting the capabilities to one suite forces the session onto it.
+			fscp::cipher_suite_list_type cipher_suites;
+			cipher_suites.push_back(fscp::cipher_suite_type::from_string(argv[5]));
+
+			server.set_cipher_suites(cipher_suites);
+		}
+
+		boost::asio::deadline_timer pace_timer(_io_service);
+		boost::asio::deadline_timer statistics_timer(_io_service);
+
+		server.set_presentation_message_received_callback([&server](const fscp::server::ep_type& sender, fscp::server::cert_type sig_cert, fscp::server::presentation_status_type, bool) {
+			{
+				mutex::scoped_lock lock(output_mutex);
+				std::cout << "Received PRESENTATION from " << sender << " (" << sig_cert.subject() << "). Requesting a session." << std::endl;
+			}
+
+			server.async_request_session(sender, [](const boost::system::error_code&) {});
+
+			return true;
+		});
+
+		server.set_session_established_callback([&server, &pace_timer, &statistics_timer, frame_size, rate](const fscp::server::ep_type& host_ep, bool, const fscp::cipher_suite_type& cs, const fscp::elliptic_curve_type&) {
+			{
+				mutex::scoped_lock lock(output_mutex);
+				std::cout << "Session established with " << host_ep << " (cipher suite: " << cs << "). Pumping " << frame_size << "-byte frames";
+
+				if (rate > 0)
+				{
+					std::cout << " at " << rate << " frames per second." << std::endl;
+				}
+				else
+				{
+					std::cout << " with " << FLOOD_WINDOW << " outstanding sends." << std::endl;
+				}
+			}
+
+			if (rate > 0)
+			{
+				paced_burst(server, host_ep, frame_size, rate, pace_timer);
+			}
+			else
+			{
+				for (size_t i = 0; i < FLOOD_WINDOW; ++i)
+				{
+					flood_next(server, host_ep, frame_size);
+				}
+			}
+
+			report_statistics(statistics_timer);
+		});
+
+		server.set_session_lost_callback([](const fscp::server::ep_type& host_ep, fscp::server::session_loss_reason reason) {
+			mutex::scoped_lock lock(output_mutex);
+			std::cout << "Session lost with " << host_ep << " (" << reason << ")" << std::endl;
+		});
+
+		server.open(boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), 0));
+
+		boost::asio::ip::udp::resolver resolver(_io_service);
+		const boost::asio::ip::udp::resolver::query query(host, port);
+		const boost::asio::ip::udp::endpoint target = *resolver.resolve(query);
+
+		server.async_greet(target, [&server, target](const boost::system::error_code& ec, const boost::posix_time::time_duration& duration) {
+			if (ec)
+			{
+				mutex::scoped_lock lock(output_mutex);
+				std::cerr << "No HELLO response from " << target << " after " << duration << ": " << ec.message() << std::endl;
+			}
+			else
+			{
+				{
+					mutex::scoped_lock lock(output_mutex);
+					std::cout << "Received HELLO response from " << target << " after " << duration << ". Introducing ourselves." << std::endl;
+				}
+
+				server.async_introduce_to(target, [](const boost::system::error_code&) {});
+			}
+		});
+
+		auto stop_function = [&]() {
+			stopping = true;
+			pace_timer.cancel();
+			statistics_timer.cancel();
+			server.close();
+		};
+
+		signals.async_wait(boost::bind(signal_handler, _1, _2, stop_function));
+
+		boost::thread_group threads;
+
+		const unsigned int THREAD_COUNT = boost::thread::hardware_concurrency();
+
+		std::cout << "Starting pump with " << THREAD_COUNT << " thread(s). Target is " << host << ":" << port << "." << std::endl;
+
+		for (std::size_t i = 0; i < THREAD_COUNT; ++i)
+		{
+			threads.create_thread([&_io_service]() {
+				_io_service.run();
+			});
+		}
+
+		threads.join_all();
+
+		std::cout << "Sent " << sent_count << " frames (" << sent_bytes << " payload bytes, " << error_count << " errors)." << std::endl;
+	}
+	catch (std::exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
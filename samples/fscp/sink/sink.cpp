@@ -0,0 +1,275 @@
+/**
+ * \file sink.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A measuring sink for the traffic generator.
+ *
+ * The sink accepts a session from a pump and reports delivered frames per
+ * second, goodput and latency once per second:
+ *
+ *   sink [port] [cipher_suite]
+ *
+ * port defaults to 12000. cipher_suite restricts the session to one suite,
+ * like "ecdhe_rsa_aes128_gcm_sha256".
+ *
+ * Latency is computed from the timestamp the pump embeds in every frame: it
+ * is only meaningful when both ends share a clock, which is the case for the
+ * usual single-machine reproduction setup.
+ */
+
+#include <fscp/fscp.hpp>
+#include <fscp/server.hpp>
+#include <fscp/shared_buffer.hpp>
+
+#include <cryptoplus/cryptoplus.hpp>
+#include <cryptoplus/error/error_strings.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <iostream>
+#include <limits>
+
+using boost::asio::buffer_cast;
+using boost::asio::buffer_size;
+
+static boost::mutex output_mutex;
+
+using boost::mutex;
+
+// Frames carry a sequence number and a send timestamp.
+static const size_t FRAME_HEADER_SIZE = 2 * sizeof(uint64_t);
+
+static std::atomic<uint64_t> received_count(0);
+static std::atomic<uint64_t> received_bytes(0);
+static std::atomic<uint64_t> highest_sequence(0);
+static std::atomic<uint64_t> latency_sum(0);
+static std::atomic<uint64_t> latency_min(std::numeric_limits<uint64_t>::max());
+static std::atomic<uint64_t> latency_max(0);
+
+void signal_handler(const boost::system::error_code& error, int signal_number, boost::function<void ()> stop_function)
+{
+	if (!error)
+	{
+		{
+			mutex::scoped_lock lock(output_mutex);
+			std::cerr << "Signal caught (" << signal_number << "): exiting..." << std::endl;
+		}
+
+		stop_function();
+	}
+}
+
+static uint64_t timestamp_now()
+{
+	static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+
+	return static_cast<uint64_t>((boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds());
+}
+
+static void update_maximum(std::atomic<uint64_t>& maximum, uint64_t value)
+{
+	uint64_t current = maximum;
+
+	while ((value > current) && !maximum.compare_exchange_weak(current, value))
+	{
+	}
+}
+
+static void update_minimum(std::atomic<uint64_t>& minimum, uint64_t value)
+{
+	uint64_t current = minimum;
+
+	while ((value < current) && !minimum.compare_exchange_weak(current, value))
+	{
+	}
+}
+
+static void on_data(const fscp::server::ep_type&, fscp::channel_number_type channel_number, fscp::SharedBuffer, boost::asio::const_buffer data)
+{
+	if (channel_number != fscp::CHANNEL_NUMBER_3)
+	{
+		return;
+	}
+
+	const size_t size = buffer_size(data);
+
+	if (size < FRAME_HEADER_SIZE)
+	{
+		return;
+	}
+
+	uint64_t frame_sequence = 0;
+	uint64_t frame_timestamp = 0;
+
+	std::memcpy(&frame_sequence, buffer_cast<const uint8_t*>(data), sizeof(frame_sequence));
+	std::memcpy(&frame_timestamp, buffer_cast<const uint8_t*>(data) + sizeof(frame_sequence), sizeof(frame_timestamp));
+
+	++received_count;
+	received_bytes += size;
+
+	update_maximum(highest_sequence, frame_sequence);
+
+	const uint64_t now = timestamp_now();
+
+	if (now >= frame_timestamp)
+	{
+		const uint64_t latency = now - frame_timestamp;
+
+		latency_sum += latency;
+		update_minimum(latency_min, latency);
+		update_maximum(latency_max, latency);
+	}
+}
+
+static void report_statistics(boost::asio::deadline_timer& statistics_timer)
+{
+	static uint64_t last_received_count = 0;
+	static uint64_t last_received_bytes = 0;
+	static uint64_t last_latency_sum = 0;
+
+	const uint64_t current_received_count = received_count;
+	const uint64_t current_received_bytes = received_bytes;
+	const uint64_t current_latency_sum = latency_sum;
+
+	const uint64_t interval_count = current_received_count - last_received_count;
+
+	{
+		mutex::scoped_lock lock(output_mutex);
+
+		std::cout << "received: " << interval_count << " pps, "
+			<< ((current_received_bytes - last_received_bytes) * 8.0 / 1000000.0) << " Mbit/s goodput";
+
+		if (interval_count > 0)
+		{
+			std::cout << ", latency avg " << ((current_latency_sum - last_latency_sum) / interval_count) << " us"
+				<< " (min " << latency_min << ", max " << latency_max << ")";
+		}
+
+		// The pump numbers frames from zero: everything missing below the highest sequence seen was lost or reordered.
+		if (current_received_count > 0)
+		{
+			const uint64_t expected = highest_sequence + 1;
+
+			std::cout << ", lost " << (expected - current_received_count) << " total";
+		}
+
+		std::cout << std::endl;
+	}
+
+	last_received_count = current_received_count;
+	last_received_bytes = current_received_bytes;
+	last_latency_sum = current_latency_sum;
+
+	statistics_timer.expires_from_now(boost::posix_time::seconds(1));
+	statistics_timer.async_wait([&statistics_timer](const boost::system::error_code& ec) {
+		if (ec != boost::asio::error::operation_aborted)
+		{
+			report_statistics(statistics_timer);
+		}
+	});
+}
+
+int main(int argc, char** argv)
+{
+	cryptoplus::crypto_initializer crypto_initializer;
+	cryptoplus::algorithms_initializer algorithms_initializer;
+	cryptoplus::error::error_strings_initializer error_strings_initializer;
+
+	try
+	{
+		const uint16_t port = (argc > 1) ? boost::lexical_cast<uint16_t>(argv[1]) : 12000;
+
+		boost::asio::io_service _io_service;
+		boost::asio::signal_set signals(_io_service, SIGINT, SIGTERM);
+		fscp::logger _logger;
+
+		using cryptoplus::file;
+
+		cryptoplus::x509::certificate cert = cryptoplus::x509::certificate::from_certificate(file::open("sink.crt", "r"));
+		cryptoplus::pkey::pkey key = cryptoplus::pkey::pkey::from_private_key(file::open("sink.key", "r"));
+
+		fscp::server server(_io_service, _logger, fscp::identity_store(cert, key));
+
+		if (argc > 2)
+		{
+			// Restricting the capabilities to one suite forces the session onto it.
+			fscp::cipher_suite_list_type cipher_suites;
+			cipher_suites.push_back(fscp::cipher_suite_type::from_string(argv[2]));
+
+			server.set_cipher_suites(cipher_suites);
+		}
+
+		boost::asio::deadline_timer statistics_timer(_io_service);
+
+		server.set_presentation_message_received_callback([&server](const fscp::server::ep_type& sender, fscp::server::cert_type sig_cert, fscp::server::presentation_status_type, bool) {
+			{
+				mutex::scoped_lock lock(output_mutex);
+				std::cout << "Received PRESENTATION from " << sender << " (" << sig_cert.subject() << "). Introducing ourselves." << std::endl;
+			}
+
+			// The pump needs our certificate before it can request the session.
+			server.async_introduce_to(sender, [](const boost::system::error_code&) {});
+
+			return true;
+		});
+
+		server.set_session_established_callback([&statistics_timer](const fscp::server::ep_type& host_ep, bool, const fscp::cipher_suite_type& cs, const fscp::elliptic_curve_type&) {
+			{
+				mutex::scoped_lock lock(output_mutex);
+				std::cout << "Session established with " << host_ep << " (cipher suite: " << cs << "). Measuring." << std::endl;
+			}
+
+			report_statistics(statistics_timer);
+		});
+
+		server.set_session_lost_callback([](const fscp::server::ep_type& host_ep, fscp::server::session_loss_reason reason) {
+			mutex::scoped_lock lock(output_mutex);
+			std::cout << "Session lost with " << host_ep << " (" << reason << ")" << std::endl;
+		});
+
+		server.set_data_received_callback(&on_data);
+
+		server.open(boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), port));
+
+		auto stop_function = [&]() {
+			statistics_timer.cancel();
+			server.close();
+		};
+
+		signals.async_wait(boost::bind(signal_handler, _1, _2, stop_function));
+
+		boost::thread_group threads;
+
+		const unsigned int THREAD_COUNT = boost::thread::hardware_concurrency();
+
+		std::cout << "Starting sink with " << THREAD_COUNT << " thread(s) on port " << port << "." << std::endl;
+
+		for (std::size_t i = 0; i < THREAD_COUNT; ++i)
+		{
+			threads.create_thread([&_io_service]() {
+				_io_service.run();
+			});
+		}
+
+		threads.join_all();
+
+		std::cout << "Received " << received_count << " frames (" << received_bytes << " payload bytes)." << std::endl;
+	}
+	catch (std::exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}